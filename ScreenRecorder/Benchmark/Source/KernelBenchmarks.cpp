@@ -0,0 +1,4945 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "CaptureStateMachine.h"
+#include "ChunkedTranscoder.h"
+#include "DirtyRegion.h"
+#include "FilterChain.h"
+#include "FilterChainSink.h"
+#include "FrameDescriptor.h"
+#include "FrameKernels.h"
+#include "FramePipeline.h"
+#include "FramePool.h"
+#include "FrameQueue.h"
+#include "FrameSink.h"
+#include "FrameTracer.h"
+#include "HdrKernels.h"
+#include "HotPathCounters.h"
+#include "KeyframeIndex.h"
+#include "LatencyHistogram.h"
+#include "LiveStreamer.h"
+#include "Mp4Clip.h"
+#include "Mp4Reader.h"
+#include "Mp4Writer.h"
+#include "NalUnits.h"
+#include "PipelineTuner.h"
+#include "PngEncoder.h"
+#include "QualityMetrics.h"
+#include "RawVideoReader.h"
+#include "RawVideoWriter.h"
+#include "SceneChangeDetector.h"
+#include "SharedFramePublisher.h"
+#include "SharedFrameReader.h"
+#include "SimulcastSink.h"
+#include "SnapshotWriter.h"
+#include "SyntheticFrameSource.h"
+#include "ThreadRoles.h"
+#include "TimeLapseSink.h"
+#include "TsDemuxer.h"
+#include "TsMuxer.h"
+#include "UdpStream.h"
+
+// Microbenchmarks for the per-pixel and per-frame kernels on the recording path.
+//
+//   ScreenRecorderBench [--filter substring] [--min-time seconds] [--raw-dir directory]
+//                       [--save-baseline file] [--baseline file [--threshold percent]]
+//                       [--pipeline seconds] [--transcode frames] [--hdr-accuracy frames]
+//                       [--autotune seconds] [--dirty-check frames] [--stride-check frames]
+//                       [--pool-check frames] [--stream-check frames] [--clip-check frames]
+//                       [--alloc-check frames] [--simulcast frames] [--snapshot count]
+//                       [--time-lapse seconds] [--shared-frames frames] [--filter-chain frames]
+//                       [--state-check iterations]
+//
+// Every kernel runs at 1080p, 1440p and 4K. With --baseline the run is compared
+// against a previously saved file and exits non-zero if any kernel regressed.
+// --raw-dir selects the filesystem for the raw recording benchmarks (e.g. a tmpfs
+// mount vs an NVMe-backed ext4/NTFS directory); 1e9 / ns_per_frame is the sustained fps.
+//
+// --pipeline runs a paced 1080p120 capture -> queue -> convert pipeline next to busy threads
+// standing in for the recorded app, once with default scheduling and once with thread roles,
+// and reports capture-to-done latency percentiles instead of the kernel table.
+//
+// --transcode <frames> writes a 720p recording with a scene cut every half second to --raw-dir
+// and runs the chunked offline transcode with the lossless stand-in codec on 1, 2, 4, ... 8 workers
+// and the core count, reporting encode throughput, speedup over one worker and efficiency (speedup
+// per worker). Exits non-zero if efficiency falls below 60% at any count up to the core count;
+// rows with more workers than cores or chunks are only reported.
+//
+// --hdr-accuracy <frames> checks the HDR kernels on random scRGB frames against a double-precision
+// reference and exits non-zero if any sample is off by more than one code value.
+//
+// --autotune <seconds> drives the pipeline auto-tuner with a simulated 120 fps pipeline through
+// calm, bursty-encode, capture-hold-spike and overload phases of that many seconds each, next to
+// the fixed default sizes, and exits non-zero if the tuner does not converge.
+//
+// --dirty-check <frames> edits a 998x562 frame at random and checks that copy, NV12, box
+// downsample, P010 and tone map outputs updated only where dirty (from the edit rects, and from
+// the tile tracker across skipped frames) stay identical to converting the whole frame.
+//
+// --stride-check <frames> feeds frames of odd and even sizes (down to 1x1) to the queue, kernels,
+// scene detector and raw writer at padded pitches and checks every output matches the packed frame.
+//
+// --pool-check <frames> runs queued and directly handed-over frames into a mock encoder that holds
+// samples like an asynchronous MFT, and checks queued frames are wrapped without a copy, no pooled
+// buffer is reused while held (even after the queue is gone), held buffers stay reserved against
+// the memory budget until released, the encoder's own copies are charged to it, free pool buffers
+// are counted as cached (and in the peak) while their pool keeps them, and pool allocations stay bounded.
+// Blocked pushes into a budget that sinks have charged full must drop at once instead of waiting.
+//
+// --stream-check <frames> streams synthetic H.264 access units at 120 fps over loopback UDP as
+// MPEG-TS, plain and with FEC, NACK retransmission and both under simulated loss, and checks every
+// access unit the receiver hands on is byte-identical. Reports packetization and end-to-end latency.
+//
+// --clip-check <frames> writes a variable frame rate H.264 MP4 with irregular GOPs and a resolution
+// change to --raw-dir, checks its keyframe index survives a save/load round trip, then cuts random
+// ranges with the clip tool and checks each opens on the right keyframe with the source samples
+// unchanged. Reports the time per clip.
+//
+// --alloc-check <frames> runs the synthetic source through FramePipeline, the recorder's own
+// per-frame path, into the raw writer: BGRA with the preview tap, snapshots and a shared-frame ring,
+// NV12, tone-mapped scRGB, the filter chain and a simulcast fan-out. Exits non-zero if any
+// steady-state frame allocates on the capture, encode or rendition threads or a stage copies more
+// bytes per frame than its budget. Needs a build with SCREENRECORDER_HOT_PATH_COUNTERS, which the
+// bench project defines.
+//
+// --simulcast <frames> checks that renditions scaled only where dirty match scaling every frame
+// whole, then records a 1080p screen unpaced with 1 to 4 renditions (1080p, 540p, 720p, 360p) and
+// reports CPU per frame, the marginal cost of each added rendition and the same outputs recorded
+// as separate sessions. Mock sinks stop at the encoder's NV12 input; the encode itself is excluded.
+//
+// --snapshot <count> round-trips PNG snapshots of odd sizes through a reference inflate, then
+// encodes 4K motion, slide and textured screens count times on 1, 2, 4, ... threads (at least 4, so strip
+// joins are checked), reporting encode time and size. Last it records 4K with and without a
+// snapshot every 10th frame, to --raw-dir, and compares frame latency on the recording path.
+//
+// --time-lapse <seconds> checks every blend against a per-pixel reference over all frames, with
+// irregular arrival times and gaps of several intervals, then blends that many seconds of a 4K 60
+// fps screen into 1 s intervals and reports CPU per captured frame, per output and held memory,
+// next to blending every frame whole.
+//
+// --shared-frames <frames> publishes a paced 1080p120 screen into a shared-memory ring with 0 to
+// 8 readers, each mapping it by name as another process would and checking every frame in place
+// against its own replay of the screen, then with a reader that holds frames past a lap of the
+// ring. Reports publish cost, wake-up latency and frames read, and fails on any frame that
+// validated but differs, or a lapped read that was not caught.
+//
+// --filter-chain <frames> checks the fused and unfused filter chains, to NV12 and to BGRA, against
+// ScaleBgraBilinear, a reference overlay blend and ConvertBgraToNv12 run in sequence, over odd
+// crops, down- and upscales and overlays hanging off each edge. Then it runs crop/resize/cursor
+// chains on a 4K capture that many frames each, fused and unfused taking turns, reporting the
+// fastest frame of each and traffic to frame-sized buffers (plus last-level cache misses where
+// Linux perf counters are available). Fails on any output byte that differs, or if a chain that
+// fuses (one with less traffic fused) is slower than running its stages in sequence.
+//
+// --state-check <iterations> races start, stop and pool depth requests on several threads against
+// frame delivery, which resizes, through CaptureEngine's state machine on a fake session whose
+// starts and resizes throw now and then. Fails if an operation stalls, a frame runs on a released
+// session, the last pool depth asked for never reaches a running pool, or a final stop does not
+// leave it idle and ready to start again.
+
+namespace KernelBenchmarks
+{
+    struct Resolution
+    {
+        const char* name;
+        int width;
+        int height;
+    };
+
+    const Resolution kResolutions[] =
+    {
+        { "1080p", 1920, 1080 },
+        { "1440p", 2560, 1440 },
+        { "4K",    3840, 2160 },
+    };
+
+    class Benchmark
+    {
+    public:
+        virtual ~Benchmark() = default;
+        virtual const char* Name() const = 0;
+        virtual void Setup(int width, int height) = 0;
+        virtual void RunFrame() = 0;
+        virtual size_t BytesPerFrame() const = 0;
+    };
+
+    // Deterministic non-trivial BGRA content so hashing/diffing/compression can't shortcut
+    void FillPattern(std::vector<uint8_t>& buffer, int width, int height, ptrdiff_t pitch, uint32_t seed)
+    {
+        buffer.assign(static_cast<size_t>(pitch) * height, 0);
+        uint32_t state = seed * 2654435761u + 1;
+
+        for (int y = 0; y < height; ++y)
+        {
+            uint8_t* row = buffer.data() + y * pitch;
+            for (int x = 0; x < width; ++x)
+            {
+                state = state * 1664525u + 1013904223u;
+                row[x * 4 + 0] = static_cast<uint8_t>(x + (state >> 28));
+                row[x * 4 + 1] = static_cast<uint8_t>(y + (state >> 29));
+                row[x * 4 + 2] = static_cast<uint8_t>((x ^ y) + (state >> 30));
+                row[x * 4 + 3] = 255;
+            }
+        }
+    }
+
+    // scRGB content as an FP16 frame pool delivers it: SDR white at 203 nits, every 16th row a
+    // highlight band at ~2400 nits
+    void FillScRgbPattern(std::vector<uint8_t>& buffer, int width, int height, uint32_t seed)
+    {
+        std::vector<uint8_t> bgra;
+        FillPattern(bgra, width, height, width * 4, seed);
+        buffer.resize(static_cast<size_t>(width) * height * 8);
+        HdrKernels::ConvertBgraToScRgb(bgra.data(), width * 4, width, height, buffer.data(), width * 8, 203.0f / HdrKernels::kScRgbNits);
+
+        for (int y = 0; y < height; y += 16)
+        {
+            uint16_t* row = reinterpret_cast<uint16_t*>(buffer.data() + static_cast<size_t>(y) * width * 8);
+            for (int i = 0; i < width * 4; ++i)
+            {
+                if (i % 4 != 3) row[i] = HdrKernels::FloatToHalf(HdrKernels::HalfToFloat(row[i]) * 12.0f);
+            }
+        }
+    }
+
+    // Readback as it was before buffers were kept between frames: a fresh vector per frame filled from mapped memory
+    class SurfaceReadbackCopy : public Benchmark
+    {
+    public:
+        const char* Name() const override { return "surface_readback_copy"; }
+        void Setup(int width, int height) override { size_ = static_cast<size_t>(width) * height * 4; FillPattern(mapped_, width, height, width * 4, 1); }
+        void RunFrame() override
+        {
+            std::vector<uint8_t> image_buffer;
+            image_buffer.reserve(size_);
+            image_buffer.insert(image_buffer.end(), mapped_.data(), mapped_.data() + size_);
+            sink_ = sink_ ^ image_buffer[size_ / 2];
+        }
+        size_t BytesPerFrame() const override { return size_; }
+
+    private:
+        std::vector<uint8_t> mapped_;
+        size_t size_ = 0;
+        volatile uint8_t sink_ = 0;
+    };
+
+    // MFCopyImage-equivalent copy out of a padded (GPU row pitch) source
+    class StridedCopy : public Benchmark
+    {
+    public:
+        const char* Name() const override { return "strided_copy"; }
+        void Setup(int width, int height) override
+        {
+            width_ = width;
+            height_ = height;
+            src_pitch_ = (width * 4 + 255) / 256 * 256 + 256;
+            FillPattern(src_, width, height, src_pitch_, 2);
+            dst_.resize(static_cast<size_t>(width) * height * 4);
+        }
+        void RunFrame() override { FrameKernels::CopyImage(dst_.data(), width_ * 4, src_.data(), src_pitch_, width_ * 4, height_); }
+        size_t BytesPerFrame() const override { return dst_.size(); }
+
+    private:
+        std::vector<uint8_t> src_;
+        std::vector<uint8_t> dst_;
+        ptrdiff_t src_pitch_ = 0;
+        int width_ = 0;
+        int height_ = 0;
+    };
+
+    class FrameHash : public Benchmark
+    {
+    public:
+        const char* Name() const override { return "frame_hash"; }
+        void Setup(int width, int height) override { width_ = width; height_ = height; FillPattern(frame_, width, height, width * 4, 3); }
+        void RunFrame() override { sink_ = sink_ + FrameKernels::HashImage(frame_.data(), width_ * 4, width_ * 4, height_); }
+        size_t BytesPerFrame() const override { return frame_.size(); }
+
+    private:
+        std::vector<uint8_t> frame_;
+        int width_ = 0;
+        int height_ = 0;
+        volatile uint64_t sink_ = 0;
+    };
+
+    // Two frames differing in a caret-sized region, the common desktop case
+    class TileDiff : public Benchmark
+    {
+    public:
+        const char* Name() const override { return "tile_diff"; }
+        void Setup(int width, int height) override
+        {
+            width_ = width;
+            height_ = height;
+            FillPattern(previous_, width, height, width * 4, 4);
+            current_ = previous_;
+            for (int y = height / 2; y < height / 2 + 20; ++y)
+            {
+                std::memset(current_.data() + (static_cast<size_t>(y) * width + width / 2) * 4, 0, 8);
+            }
+            flags_.resize(FrameKernels::TileCount(width, height, 64));
+        }
+        void RunFrame() override
+        {
+            sink_ = sink_ + FrameKernels::DiffTiles(previous_.data(), width_ * 4, current_.data(), width_ * 4, width_, height_, 64, flags_.data());
+        }
+        size_t BytesPerFrame() const override { return previous_.size() * 2; }
+
+    private:
+        std::vector<uint8_t> previous_;
+        std::vector<uint8_t> current_;
+        std::vector<uint8_t> flags_;
+        int width_ = 0;
+        int height_ = 0;
+        volatile size_t sink_ = 0;
+    };
+
+    class ColorConvertNv12 : public Benchmark
+    {
+    public:
+        const char* Name() const override { return "bgra_to_nv12"; }
+        void Setup(int width, int height) override
+        {
+            width_ = width;
+            height_ = height;
+            FillPattern(src_, width, height, width * 4, 5);
+            y_.resize(static_cast<size_t>(width) * height);
+            uv_.resize(static_cast<size_t>(width) * height / 2);
+        }
+        void RunFrame() override { FrameKernels::ConvertBgraToNv12(src_.data(), width_ * 4, width_, height_, y_.data(), width_, uv_.data(), width_); }
+        size_t BytesPerFrame() const override { return src_.size() + y_.size() + uv_.size(); }
+
+    private:
+        std::vector<uint8_t> src_;
+        std::vector<uint8_t> y_;
+        std::vector<uint8_t> uv_;
+        int width_ = 0;
+        int height_ = 0;
+    };
+
+    // HDR10 encode input: FP16 capture -> BT.2020 PQ P010
+    class ScRgbToP010 : public Benchmark
+    {
+    public:
+        const char* Name() const override { return "scrgb_to_p010"; }
+        void Setup(int width, int height) override
+        {
+            width_ = width;
+            height_ = height;
+            FillScRgbPattern(src_, width, height, 14);
+            y_.resize(static_cast<size_t>(width) * height * 2);
+            uv_.resize(static_cast<size_t>(width) * height);
+        }
+        void RunFrame() override
+        {
+            HdrKernels::ConvertScRgbToP010(src_.data(), width_ * 8, width_, height_, y_.data(), width_ * 2, uv_.data(), width_ * 2);
+        }
+        size_t BytesPerFrame() const override { return src_.size() + y_.size() + uv_.size(); }
+
+    private:
+        std::vector<uint8_t> src_;
+        std::vector<uint8_t> y_;
+        std::vector<uint8_t> uv_;
+        int width_ = 0;
+        int height_ = 0;
+    };
+
+    // SDR recording of an HDR desktop: FP16 capture tone-mapped to BGRA on the capture thread
+    class ScRgbToneMap : public Benchmark
+    {
+    public:
+        const char* Name() const override { return "scrgb_tonemap_bgra"; }
+        void Setup(int width, int height) override
+        {
+            width_ = width;
+            height_ = height;
+            FillScRgbPattern(src_, width, height, 15);
+            dst_.resize(static_cast<size_t>(width) * height * 4);
+        }
+        void RunFrame() override
+        {
+            HdrKernels::ToneMapScRgbToBgra(src_.data(), width_ * 8, width_, height_, dst_.data(), width_ * 4, 203.0f, 1000.0f);
+        }
+        size_t BytesPerFrame() const override { return src_.size() + dst_.size(); }
+
+    private:
+        std::vector<uint8_t> src_;
+        std::vector<uint8_t> dst_;
+        int width_ = 0;
+        int height_ = 0;
+    };
+
+    class ScaleTo540p : public Benchmark
+    {
+    public:
+        const char* Name() const override { return "scale_to_540p"; }
+        void Setup(int width, int height) override
+        {
+            width_ = width;
+            height_ = height;
+            FillPattern(src_, width, height, width * 4, 6);
+            dst_.resize(960 * 540 * 4);
+        }
+        void RunFrame() override { FrameKernels::ScaleBgraBilinear(src_.data(), width_ * 4, width_, height_, dst_.data(), 960 * 4, 960, 540); }
+        size_t BytesPerFrame() const override { return src_.size() + dst_.size(); }
+
+    private:
+        std::vector<uint8_t> src_;
+        std::vector<uint8_t> dst_;
+        int width_ = 0;
+        int height_ = 0;
+    };
+
+    // Thumbnail generation done by PreviewTap when a preview is due (5 times a second).
+    // Per recorded frame at 60 fps the amortized cost is ns/frame * 5 / 60.
+    class PreviewDownsample : public Benchmark
+    {
+    public:
+        const char* Name() const override { return "preview_downsample"; }
+        void Setup(int width, int height) override
+        {
+            width_ = width;
+            height_ = height;
+            factor_ = std::min(16, (width + 239) / 240);
+            FillPattern(src_, width, height, width * 4, 9);
+            dst_.resize(static_cast<size_t>(width / factor_) * (height / factor_) * 4);
+        }
+        void RunFrame() override
+        {
+            FrameKernels::DownsampleBgraBox(src_.data(), width_ * 4, width_, height_, factor_, dst_.data(), (width_ / factor_) * 4);
+        }
+        size_t BytesPerFrame() const override { return src_.size(); }
+
+    private:
+        std::vector<uint8_t> src_;
+        std::vector<uint8_t> dst_;
+        int width_ = 0;
+        int height_ = 0;
+        int factor_ = 1;
+    };
+
+    // SceneChangeDetector on the encode thread, once per frame. Alternates two unrelated frames,
+    // so every call also runs the scroll search, which is the worst case.
+    class SceneDetect : public Benchmark
+    {
+    public:
+        const char* Name() const override { return "scene_detect"; }
+        void Setup(int width, int height) override
+        {
+            width_ = width;
+            height_ = height;
+            FillPattern(frames_[0], width, height, width * 4, 10);
+            FillPattern(frames_[1], width, height, width * 4, 11);
+            detector_.Reset();
+        }
+        void RunFrame() override
+        {
+            detector_.Analyze(frames_[next_].data(), width_ * 4, width_, height_);
+            next_ ^= 1;
+        }
+        size_t BytesPerFrame() const override { return frames_[0].size(); }
+
+    private:
+        std::vector<uint8_t> frames_[2];
+        SceneChangeDetector detector_;
+        int next_ = 0;
+        int width_ = 0;
+        int height_ = 0;
+    };
+
+    // Per-frame scoring in the quality harness: tile classification plus PSNR/SSIM on NV12
+    class QualityCompare : public Benchmark
+    {
+    public:
+        const char* Name() const override { return "quality_compare"; }
+        void Setup(int width, int height) override
+        {
+            width_ = width;
+            height_ = height;
+            // NV12 viewed as byte rows: width / 4 "pixels" fill each width-byte row
+            FillPattern(reference_, width / 4, height * 3 / 2, width, 12);
+            FillPattern(decoded_, width / 4, height * 3 / 2, width, 13);
+            classes_.resize(FrameKernels::TileCount(width, height, QualityMetrics::kClassTileSize));
+        }
+        void RunFrame() override
+        {
+            const size_t luma_size = static_cast<size_t>(width_) * height_;
+            Nv12View reference{ reference_.data(), width_, reference_.data() + luma_size, width_ };
+            Nv12View decoded{ decoded_.data(), width_, decoded_.data() + luma_size, width_ };
+
+            FrameQuality quality;
+            QualityMetrics::ClassifyTiles(reference.y, width_, width_, height_, classes_.data());
+            QualityMetrics::CompareNv12(reference, decoded, width_, height_, classes_.data(), quality);
+        }
+        size_t BytesPerFrame() const override { return reference_.size() + decoded_.size(); }
+
+    private:
+        std::vector<uint8_t> reference_;
+        std::vector<uint8_t> decoded_;
+        std::vector<ContentClass> classes_;
+        int width_ = 0;
+        int height_ = 0;
+    };
+
+    // The spans one frame records across the pipeline, with the tracer on and off. Independent
+    // of resolution; "off" is the cost every build pays.
+    class FrameTrace : public Benchmark
+    {
+    public:
+        explicit FrameTrace(bool enabled) : enabled_(enabled) {}
+        ~FrameTrace() override { FrameTracer::Stop(); }
+        const char* Name() const override { return enabled_ ? "frame_trace_on" : "frame_trace_off"; }
+        void Setup(int, int) override
+        {
+            if (enabled_) FrameTracer::Start();
+            else FrameTracer::Stop();
+        }
+        void RunFrame() override
+        {
+            FrameTracer::BeginFrame();
+            TraceSpan arrival_span(TraceStage::Arrival);
+            { TraceSpan span(TraceStage::Readback); }
+            { TraceSpan span(TraceStage::Copy); }
+            { TraceSpan span(TraceStage::Convert); }
+            { TraceSpan span(TraceStage::EncodeSubmit); }
+            { TraceSpan span(TraceStage::DiskWrite); }
+        }
+        size_t BytesPerFrame() const override { return 0; }
+
+    private:
+        bool enabled_;
+    };
+
+    // Stand-in for the container write path: encoded-size packets appended to a buffered file.
+    // Packet size assumes ~0.1 bits per pixel, in line with the default 8 Mbps at 1080p60.
+    class MuxPacketWrite : public Benchmark
+    {
+    public:
+        ~MuxPacketWrite() override { if (file_) std::fclose(file_); }
+        const char* Name() const override { return "mux_packet_write"; }
+        void Setup(int width, int height) override
+        {
+            if (file_) std::fclose(file_);
+            file_ = std::tmpfile();
+            std::setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+            FillPattern(packet_, std::max(1, width * height / 80 / 4), 1, std::max(1, width * height / 80 / 4) * 4, 7);
+        }
+        void RunFrame() override
+        {
+            // 4-byte big-endian NAL length prefix, as written into mdat
+            uint32_t length = static_cast<uint32_t>(packet_.size());
+            header_[0] = static_cast<uint8_t>(length >> 24);
+            header_[1] = static_cast<uint8_t>(length >> 16);
+            header_[2] = static_cast<uint8_t>(length >> 8);
+            header_[3] = static_cast<uint8_t>(length);
+            std::fwrite(header_, 1, sizeof(header_), file_);
+            std::fwrite(packet_.data(), 1, packet_.size(), file_);
+
+            if (std::ftell(file_) > (256 << 20))
+            {
+                std::rewind(file_);
+            }
+        }
+        size_t BytesPerFrame() const override { return packet_.size() + sizeof(header_); }
+
+    private:
+        std::FILE* file_ = nullptr;
+        std::vector<uint8_t> packet_;
+        uint8_t header_[4] = {};
+    };
+
+    // Live streaming packetization: one P-frame sized access unit (same size as mux_packet_write)
+    // into 188-byte TS packets with PES header, PCR and stuffing
+    class TsMux : public Benchmark
+    {
+    public:
+        const char* Name() const override { return "ts_mux"; }
+        void Setup(int width, int height) override
+        {
+            const int size = std::max(1, width * height / 80 / 4);
+            FillPattern(access_unit_, size, 1, size * 4, 7);
+            const uint8_t header[] = { 0x00, 0x00, 0x00, 0x01, 0x09, 0xF0, 0x00, 0x00, 0x00, 0x01, 0x41 };
+            std::memcpy(access_unit_.data(), header, sizeof(header));
+            clock_ = 0;
+        }
+        void RunFrame() override
+        {
+            ts_.clear();
+            muxer_.WriteAccessUnit(access_unit_.data(), access_unit_.size(), clock_, false, ts_);
+            clock_ += 1500;
+        }
+        size_t BytesPerFrame() const override { return access_unit_.size(); }
+
+    private:
+        TsMuxer muxer_{ NalCodec::H264 };
+        std::vector<uint8_t> access_unit_;
+        std::vector<uint8_t> ts_;
+        uint64_t clock_ = 0;
+    };
+
+    // RawVideoWriter fed the way the capture path feeds it. The pooled variant hands it a
+    // page-aligned buffer, which takes the unbuffered write path where the filesystem allows.
+    // The file is restarted every kFramesPerFile frames to bound disk usage.
+    class RawFrameWrite : public Benchmark
+    {
+    public:
+        // Padded: BGRA rows at a GPU-style pitch, written in place
+        enum class Source { Vector, Pooled, Nv12, Padded };
+
+        RawFrameWrite(const std::filesystem::path& directory, Source source)
+            : directory_(directory), source_(source)
+        {
+        }
+        ~RawFrameWrite() override
+        {
+            writer_.reset();
+            std::error_code error;
+            std::filesystem::remove(directory_ / "bench.zraw", error);
+        }
+        const char* Name() const override
+        {
+            switch (source_)
+            {
+            case Source::Nv12: return "raw_write_nv12";
+            case Source::Pooled: return "raw_write_bgra_pooled";
+            case Source::Padded: return "raw_write_bgra_padded";
+            default: return "raw_write_bgra";
+            }
+        }
+        void Setup(int width, int height) override
+        {
+            width_ = width;
+            height_ = height;
+            FillPattern(frame_, width, height, width * 4, 8);
+            pooled_frame_.Resize((frame_.size() + AlignedBuffer::kAlignment - 1) / AlignedBuffer::kAlignment * AlignedBuffer::kAlignment);
+            std::memcpy(pooled_frame_.data(), frame_.data(), frame_.size());
+            padded_pitch_ = (width * 4 + 255) / 256 * 256 + 256;
+            FillPattern(padded_frame_, width, height, padded_pitch_, 8);
+            Restart();
+        }
+        void RunFrame() override
+        {
+            if (writer_->GetFrameCount() >= kFramesPerFile)
+            {
+                Restart();
+            }
+
+            if (source_ == Source::Pooled)
+            {
+                const uint8_t* chunk = pooled_frame_.data();
+                size_t chunk_size = pooled_frame_.size();
+                writer_->WriteFrame(&chunk, &chunk_size, 1);
+            }
+            else if (source_ == Source::Padded)
+            {
+                FrameDescriptor frame = FrameDescriptor::Packed(padded_frame_.data(), FrameFormat::Bgra, width_, height_);
+                frame.planes[0].pitch = padded_pitch_;
+                writer_->ProcessFrame(frame, DirtyRegion::Full(width_, height_));
+            }
+            else
+            {
+                writer_->ProcessFrame(frame_, width_, height_);
+            }
+        }
+        size_t BytesPerFrame() const override
+        {
+            return source_ == Source::Nv12 ? frame_.size() * 3 / 8 : frame_.size();
+        }
+
+    private:
+        static constexpr uint64_t kFramesPerFile = 64;
+
+        void Restart()
+        {
+            writer_.reset();
+            RawPixelFormat pixel_format = source_ == Source::Nv12 ? RawPixelFormat::NV12 : RawPixelFormat::BGRA;
+            writer_ = std::make_unique<RawVideoWriter>(width_, height_, 240, pixel_format, directory_ / "bench.zraw");
+            writer_->Initialize();
+        }
+
+        std::filesystem::path directory_;
+        Source source_;
+        std::unique_ptr<RawVideoWriter> writer_;
+        std::vector<uint8_t> frame_;
+        AlignedBuffer pooled_frame_;
+        std::vector<uint8_t> padded_frame_;
+        ptrdiff_t padded_pitch_ = 0;
+        int width_ = 0;
+        int height_ = 0;
+    };
+
+    // Region variants on a frame with percent of it dirty as four scattered rects, source rows padded
+    // like a mapped staging texture. track diffs alternating frames. Bytes count the whole frame, so
+    // GB/s is the effective rate next to the full kernels.
+    class DirtyRegionUpdate : public Benchmark
+    {
+    public:
+        enum class Stage
+        {
+            Copy,
+            Nv12,
+            Track
+        };
+
+        DirtyRegionUpdate(Stage stage, int percent) : stage_(stage)
+        {
+            const char* stage_name = stage == Stage::Copy ? "copy" : stage == Stage::Nv12 ? "nv12" : "track";
+            name_ = std::string("dirty_") + stage_name + "_" + std::to_string(percent) + "pct";
+            fraction_ = percent / 100.0;
+        }
+
+        const char* Name() const override { return name_.c_str(); }
+        void Setup(int width, int height) override
+        {
+            width_ = width;
+            height_ = height;
+            pitch_ = (width * 4 + 255) / 256 * 256 + 256;
+            FillPattern(frames_[0], width, height, pitch_, 14);
+            frames_[1] = frames_[0];
+
+            region_ = DirtyRegion(width, height);
+            const int side = static_cast<int>(std::sqrt(fraction_ / 4.0 * width * height));
+            for (int quadrant = 0; quadrant < 4; ++quadrant)
+            {
+                const DirtyRect rect = { (quadrant % 2 * 2 + 1) * width / 4 - side / 2, (quadrant / 2 * 2 + 1) * height / 4 - side / 2, side, side };
+                region_.Add(rect);
+                for (int y = rect.y; y < rect.y + rect.height; ++y)
+                {
+                    uint8_t* row = frames_[1].data() + y * pitch_ + static_cast<ptrdiff_t>(rect.x) * 4;
+                    for (int i = 0; i < rect.width * 4; ++i) row[i] ^= 0x5A;
+                }
+            }
+
+            dst_.resize(static_cast<size_t>(width) * height * 4);
+            y_.resize(static_cast<size_t>(width) * height);
+            uv_.resize(static_cast<size_t>(width) * height / 2);
+            tracker_.Reset();
+            tracker_.Update(frames_[0].data(), pitch_, width, height);
+            next_ = 1;
+        }
+        void RunFrame() override
+        {
+            switch (stage_)
+            {
+            case Stage::Copy:
+                FrameKernels::CopyImageRegion(dst_.data(), width_ * 4, frames_[0].data(), pitch_, 4, region_);
+                break;
+            case Stage::Nv12:
+                FrameKernels::ConvertBgraToNv12Region(frames_[0].data(), pitch_, y_.data(), width_, uv_.data(), width_, region_);
+                break;
+            case Stage::Track:
+                sink_ = sink_ + tracker_.Update(frames_[next_].data(), pitch_, width_, height_).GetRects().size();
+                next_ ^= 1;
+                break;
+            }
+        }
+        size_t BytesPerFrame() const override
+        {
+            return stage_ == Stage::Nv12 ? dst_.size() + y_.size() + uv_.size() : dst_.size();
+        }
+
+    private:
+        Stage stage_;
+        std::string name_;
+        double fraction_;
+        std::vector<uint8_t> frames_[2];
+        std::vector<uint8_t> dst_;
+        std::vector<uint8_t> y_;
+        std::vector<uint8_t> uv_;
+        DirtyRegion region_;
+        DirtyRegionTracker tracker_;
+        ptrdiff_t pitch_ = 0;
+        int next_ = 1;
+        int width_ = 0;
+        int height_ = 0;
+        volatile size_t sink_ = 0;
+    };
+
+    double ThreadCpuSeconds()
+    {
+#ifdef _WIN32
+        FILETIME creation_time, exit_time, kernel_time, user_time;
+        GetThreadTimes(GetCurrentThread(), &creation_time, &exit_time, &kernel_time, &user_time);
+        auto to_100ns = [](const FILETIME& ft) { return (static_cast<uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime; };
+        return (to_100ns(kernel_time) + to_100ns(user_time)) / 1e7;
+#else
+        timespec ts{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+    }
+
+    struct Result
+    {
+        std::string key;                // "<kernel> <resolution>"
+        double ns_per_frame;
+        double gb_per_second;
+        double frames_per_core_second;
+    };
+
+    Result Measure(Benchmark& benchmark, const Resolution& resolution, double min_time)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        benchmark.Setup(resolution.width, resolution.height);
+        for (int i = 0; i < 3; ++i)
+        {
+            benchmark.RunFrame();
+        }
+
+        uint64_t frames = 0;
+        double cpu_start = ThreadCpuSeconds();
+        auto wall_start = Clock::now();
+        double elapsed = 0.0;
+
+        while (elapsed < min_time || frames < 10)
+        {
+            benchmark.RunFrame();
+            ++frames;
+            elapsed = std::chrono::duration<double>(Clock::now() - wall_start).count();
+        }
+
+        double cpu_seconds = std::max(ThreadCpuSeconds() - cpu_start, 1e-9);
+
+        Result result;
+        result.key = std::string(benchmark.Name()) + " " + resolution.name;
+        result.ns_per_frame = elapsed * 1e9 / frames;
+        result.gb_per_second = benchmark.BytesPerFrame() * frames / elapsed / 1e9;
+        result.frames_per_core_second = frames / cpu_seconds;
+        return result;
+    }
+
+    std::map<std::string, double> LoadBaseline(const std::string& path)
+    {
+        std::map<std::string, double> baseline;
+        std::ifstream file(path);
+        std::string kernel, resolution;
+        double ns_per_frame;
+
+        while (file >> kernel >> resolution >> ns_per_frame)
+        {
+            baseline[kernel + " " + resolution] = ns_per_frame;
+        }
+        return baseline;
+    }
+
+    struct PipelineResult
+    {
+        uint64_t frames;
+        uint64_t dropped;
+        double p50_ms;
+        double p99_ms;
+        double max_ms;
+    };
+
+    // The "recorded app" owns every core but the last two; with roles, capture and encode
+    // stay off its cores at above-normal priority.
+    PipelineResult RunPipeline(bool use_roles, double seconds)
+    {
+        using Clock = std::chrono::steady_clock;
+        const int width = 1920;
+        const int height = 1080;
+        const auto frame_interval = std::chrono::nanoseconds(1000000000LL / 120);
+
+        const uint64_t process_cores = ThreadRoles::GetProcessCores();
+        uint64_t app_cores = process_cores;
+        int core_count = 0;
+        for (uint64_t mask = process_cores; mask; mask &= mask - 1) ++core_count;
+        for (int core = 63, kept = 0; core >= 0 && kept < 2 && core_count > 2; --core)
+        {
+            if (app_cores & (1ull << core))
+            {
+                app_cores &= ~(1ull << core);
+                ++kept;
+            }
+        }
+
+        ThreadRoles roles;
+        roles.SetTargetCores(app_cores);
+        for (ThreadRole role : { ThreadRole::Capture, ThreadRole::Encode })
+        {
+            ThreadRoleConfig config;
+            config.priority = ThreadPriority::AboveNormal;
+            config.isolate_from_target = true;
+            roles.Configure(role, config);
+        }
+
+        std::atomic<bool> running{ true };
+        std::vector<std::thread> load;
+        for (int i = 0; i < std::max(1, core_count); ++i)
+        {
+            load.emplace_back([&running, app_cores]
+            {
+                ThreadRoles::SetCurrentThreadAffinity(app_cores);
+                volatile uint64_t sink = 0;
+                while (running.load(std::memory_order_relaxed))
+                {
+                    for (int j = 0; j < 10000; ++j) sink = sink * 31 + j;
+                }
+            });
+        }
+
+        MemoryBudget budget(256ull * 1024 * 1024);
+        FrameQueue queue(budget, 4, BackpressurePolicy::Drop);
+        LatencyHistogram latency;
+
+        std::thread encoder([&]
+        {
+            if (use_roles) roles.ApplyToCurrentThread(ThreadRole::Encode);
+
+            std::vector<uint8_t> nv12(static_cast<size_t>(width) * height * 3 / 2);
+            QueuedFrame frame;
+            while (queue.Pop(frame))
+            {
+                FrameKernels::ConvertBgraToNv12(frame.pixels->data(), width * 4, width, height,
+                                                nv12.data(), width, nv12.data() + static_cast<size_t>(width) * height, width);
+                latency.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - frame.capture_time).count());
+                frame.pixels.reset();
+            }
+        });
+
+        uint64_t dropped = 0;
+        {
+            if (use_roles) roles.ApplyToCurrentThread(ThreadRole::Capture);
+
+            std::vector<uint8_t> pattern;
+            FillPattern(pattern, width, height, width * 4, 11);
+
+            auto end = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+            auto next_frame = Clock::now();
+            while (next_frame < end)
+            {
+                std::this_thread::sleep_until(next_frame);
+                const FrameDescriptor frame = FrameDescriptor::Packed(pattern.data(), FrameFormat::Bgra, width, height, Clock::now());
+                dropped += queue.Push(frame, DirtyRegion::Full(width, height)) == PushResult::Dropped ? 1 : 0;
+                next_frame += frame_interval;
+            }
+        }
+
+        queue.Close();
+        encoder.join();
+        running.store(false);
+        for (auto& thread : load) thread.join();
+
+        // Restore the calling thread for anything that runs after
+        ThreadRoles::SetCurrentThreadAffinity(process_cores);
+        ThreadRoles::SetCurrentThreadPriority(ThreadPriority::Normal);
+
+        return { latency.GetCount(), dropped, latency.GetPercentileMs(50.0), latency.GetPercentileMs(99.0), latency.GetMaxMs() };
+    }
+
+    int RunPipelineBenchmark(double seconds)
+    {
+        std::printf("%-18s %8s %8s %10s %10s %10s\n", "pipeline", "frames", "dropped", "p50 ms", "p99 ms", "max ms");
+        for (bool use_roles : { false, true })
+        {
+            PipelineResult result = RunPipeline(use_roles, seconds);
+            std::printf("%-18s %8llu %8llu %10.2f %10.2f %10.2f\n", use_roles ? "thread roles" : "default",
+                        static_cast<unsigned long long>(result.frames), static_cast<unsigned long long>(result.dropped),
+                        result.p50_ms, result.p99_ms, result.max_ms);
+        }
+        return 0;
+    }
+
+    // Speedup per worker the transcode has to keep, up to the core count, for --transcode to pass
+    constexpr double kMinTranscodeEfficiency = 0.6;
+    // Swept even on smaller machines, so tables from different machines line up
+    constexpr int kTranscodeSweepWorkers = 8;
+
+    int RunTranscodeBenchmark(uint64_t frame_count, const std::filesystem::path& directory)
+    {
+        const int width = 1280;
+        const int height = 720;
+        const int fps = 60;
+        const std::filesystem::path input = directory / "transcode_bench.zraw";
+        const std::filesystem::path output = directory / "transcode_bench.mp4";
+
+        {
+            RawVideoWriter writer(width, height, fps, RawPixelFormat::BGRA, input);
+            if (!writer.Initialize())
+            {
+                std::cerr << "Cannot write " << input.string() << std::endl;
+                return 1;
+            }
+
+            // A new scene every 30 frames; within a scene a band of rows changes each frame
+            std::vector<uint8_t> frame;
+            for (uint64_t i = 0; i < frame_count; ++i)
+            {
+                if (i % 30 == 0) FillPattern(frame, width, height, width * 4, static_cast<uint32_t>(i / 30 + 20));
+                uint8_t* band = frame.data() + static_cast<size_t>((i * 16) % (height - 64)) * width * 4;
+                for (size_t j = 0; j < static_cast<size_t>(width) * 4 * 64; ++j) band[j] = static_cast<uint8_t>(band[j] * 5 + i);
+                writer.ProcessFrame(frame, width, height);
+            }
+            writer.Close();
+        }
+
+        // 1, 2, 4, ... up to the larger of the fixed sweep and the core count, which is always run
+        const int cores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        const int max_workers = std::max(cores, kTranscodeSweepWorkers);
+        std::vector<int> worker_counts;
+        for (int workers = 1; workers < max_workers; workers *= 2) worker_counts.push_back(workers);
+        worker_counts.push_back(cores);
+        worker_counts.push_back(max_workers);
+        std::sort(worker_counts.begin(), worker_counts.end());
+        worker_counts.erase(std::unique(worker_counts.begin(), worker_counts.end()), worker_counts.end());
+
+        std::printf("%d cores; efficiency below %.0f%% fails up to the core count\n", cores, kMinTranscodeEfficiency * 100.0);
+        std::printf("%-8s %8s %10s %10s %10s %10s %10s  %s\n", "workers", "chunks", "analyze ms", "encode ms", "fps", "speedup", "efficiency", "verdict");
+
+        double single_worker_ms = 0.0;
+        int exit_code = 0;
+        bool passed = true;
+        for (int workers : worker_counts)
+        {
+            TranscodeOptions options;
+            options.workers = workers;
+            options.min_chunk_seconds = 0.1;
+            options.max_chunk_seconds = 0.5;
+            options.work_dir = directory / "transcode_bench_chunks";
+
+            ChunkedTranscoder transcoder(options, [=] { return std::make_unique<LosslessChunkEncoder>(width, height, fps, RawPixelFormat::BGRA); });
+            TranscodeResult result;
+            if (!transcoder.Run(input, output, result))
+            {
+                std::cerr << "Transcode failed: " << result.error << std::endl;
+                exit_code = 1;
+                break;
+            }
+
+            if (workers == 1) single_worker_ms = result.encode_ms;
+            const double speedup = single_worker_ms / result.encode_ms;
+            const double efficiency = speedup / workers;
+            // More workers than cores or chunks cannot all run at once, so those rows are only reported
+            const char* verdict = "ok";
+            if (workers > cores) verdict = "over cores";
+            else if (static_cast<size_t>(workers) > result.chunks.size()) verdict = "few chunks";
+            else if (efficiency < kMinTranscodeEfficiency) verdict = "LOW";
+            passed = passed && std::strcmp(verdict, "LOW") != 0;
+
+            std::printf("%-8d %8zu %10.0f %10.0f %10.1f %9.2fx %9.0f%%  %s\n", workers, result.chunks.size(), result.analyze_ms, result.encode_ms,
+                        result.frames * 1000.0 / result.encode_ms, speedup, efficiency * 100.0, verdict);
+        }
+        if (exit_code == 0)
+        {
+            std::printf("%s\n", passed ? "PASS" : "FAIL");
+            if (!passed) exit_code = 1;
+        }
+
+        std::error_code error;
+        std::filesystem::remove(input, error);
+        std::filesystem::remove(output, error);
+        return exit_code;
+    }
+
+    // Double-precision references for the HDR kernels, written from the specs rather than from
+    // the kernels: primaries conversion derived from the chromaticities, ST 2084, BT.2020 NCL
+    // and BT.2100 10-bit narrow range
+    namespace HdrReference
+    {
+        double Pq(double nits)
+        {
+            const double m1 = 2610.0 / 16384.0, m2 = 2523.0 / 32.0, c1 = 107.0 / 128.0, c2 = 2413.0 / 128.0, c3 = 2392.0 / 128.0;
+            const double p = std::pow(std::clamp(nits / 10000.0, 0.0, 1.0), m1);
+            return std::pow((c1 + c2 * p) / (1.0 + c3 * p), m2);
+        }
+
+        // RGB -> XYZ for the given primaries and a D65 white point (SMPTE RP 177)
+        void PrimariesToXyz(const double xy[3][2], double m[3][3])
+        {
+            const double white[3] = { 0.3127 / 0.3290, 1.0, (1.0 - 0.3127 - 0.3290) / 0.3290 };
+            double p[3][3];
+            for (int c = 0; c < 3; ++c)
+            {
+                p[0][c] = xy[c][0] / xy[c][1];
+                p[1][c] = 1.0;
+                p[2][c] = (1.0 - xy[c][0] - xy[c][1]) / xy[c][1];
+            }
+
+            // Channel scales s solve p * s = white (Cramer's rule)
+            auto det = [](const double a[3][3])
+            {
+                return a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) - a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0])
+                     + a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+            };
+            const double d = det(p);
+            for (int c = 0; c < 3; ++c)
+            {
+                double q[3][3];
+                std::memcpy(q, p, sizeof(q));
+                for (int r = 0; r < 3; ++r) q[r][c] = white[r];
+                const double scale = det(q) / d;
+                for (int r = 0; r < 3; ++r) m[r][c] = p[r][c] * scale;
+            }
+        }
+
+        void Invert(const double m[3][3], double inverse[3][3])
+        {
+            const double d = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+                           + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+            for (int r = 0; r < 3; ++r)
+            {
+                for (int c = 0; c < 3; ++c)
+                {
+                    const int r1 = (c + 1) % 3, r2 = (c + 2) % 3, c1 = (r + 1) % 3, c2 = (r + 2) % 3;
+                    inverse[r][c] = (m[r1][c1] * m[r2][c2] - m[r1][c2] * m[r2][c1]) / d;
+                }
+            }
+        }
+
+        struct Bt709ToBt2020
+        {
+            double m[3][3];
+
+            Bt709ToBt2020()
+            {
+                const double bt709[3][2] = { { 0.640, 0.330 }, { 0.300, 0.600 }, { 0.150, 0.060 } };
+                const double bt2020[3][2] = { { 0.708, 0.292 }, { 0.170, 0.797 }, { 0.131, 0.046 } };
+                double from[3][3], to[3][3], to_inverse[3][3];
+                PrimariesToXyz(bt709, from);
+                PrimariesToXyz(bt2020, to);
+                Invert(to, to_inverse);
+
+                for (int r = 0; r < 3; ++r)
+                    for (int c = 0; c < 3; ++c)
+                        m[r][c] = to_inverse[r][0] * from[0][c] + to_inverse[r][1] * from[1][c] + to_inverse[r][2] * from[2][c];
+            }
+        };
+
+        void PqRgb(const uint16_t* pixel, double out[3])
+        {
+            static const Bt709ToBt2020 kMatrix;
+
+            double rgb[3];
+            for (int c = 0; c < 3; ++c) rgb[c] = HdrKernels::HalfToFloat(pixel[c]);
+            for (int c = 0; c < 3; ++c)
+            {
+                const double value = kMatrix.m[c][0] * rgb[0] + kMatrix.m[c][1] * rgb[1] + kMatrix.m[c][2] * rgb[2];
+                out[c] = Pq(std::max(value, 0.0) * 80.0);
+            }
+        }
+
+        double Luma(const double rgb[3]) { return 0.2627 * rgb[0] + 0.6780 * rgb[1] + 0.0593 * rgb[2]; }
+
+        double Srgb(double x) { return x <= 0.0031308 ? 12.92 * x : 1.055 * std::pow(x, 1.0 / 2.4) - 0.055; }
+
+        // Knee at 0.75 of white, extended Reinhard above it reaching 1.0 at peak, on the max channel
+        double ToneMap(double value, double white_nits, double peak_nits)
+        {
+            const double peak = peak_nits / white_nits;
+            if (peak <= 1.0) return std::min(value, 1.0);
+            const double knee = 0.75;
+            const double q = (peak - knee) / (1.0 - knee);
+            const double t = (value - knee) / (1.0 - knee);
+            return value <= knee ? value : knee + (1.0 - knee) * t * (1.0 + t / (q * q)) / (1.0 + t);
+        }
+    }
+
+    // Random scRGB over the whole range the kernels see: shadows, SDR, highlights past 10000 nits,
+    // negative (out of BT.709 gamut) components and FP16 denormals
+    void FillRandomScRgb(std::vector<uint16_t>& pixels, uint32_t seed)
+    {
+        uint32_t state = seed * 2654435761u + 1;
+        auto next = [&] { state = state * 1664525u + 1013904223u; return (state >> 8) * (1.0 / 16777216.0); };
+
+        for (size_t i = 0; i < pixels.size(); ++i)
+        {
+            if (i % 4 == 3)
+            {
+                pixels[i] = HdrKernels::FloatToHalf(1.0f);
+                continue;
+            }
+
+            const double kind = next();
+            double value;
+            if (kind < 0.05) value = -0.2 * next();
+            else if (kind < 0.10) value = next() * 6e-5;
+            else if (kind < 0.60) value = next();
+            else value = std::pow(10.0, next() * 6.5 - 4.0);
+            pixels[i] = HdrKernels::FloatToHalf(static_cast<float>(value));
+        }
+    }
+
+    int RunHdrAccuracy(int frames)
+    {
+        // Not a multiple of 4 wide, so the scalar tail is covered too
+        const int width = 262;
+        const int height = 64;
+
+        int half_mismatches = 0;
+        for (uint32_t bits = 0; bits < 0x10000; ++bits)
+        {
+            const uint16_t half = static_cast<uint16_t>(bits);
+            if ((half & 0x7C00) == 0x7C00 && (half & 0x03FF)) continue;
+            half_mismatches += HdrKernels::FloatToHalf(HdrKernels::HalfToFloat(half)) != half ? 1 : 0;
+        }
+
+        std::vector<uint16_t> src(static_cast<size_t>(width) * height * 4);
+        std::vector<uint16_t> y_plane(static_cast<size_t>(width) * height);
+        std::vector<uint16_t> uv_plane(static_cast<size_t>(width) * height / 2);
+        std::vector<uint32_t> bgra(static_cast<size_t>(width) * height);
+
+        const double white_nits = 203.0;
+        const double peak_nits = 1000.0;
+        double max_luma_error = 0.0, max_chroma_error = 0.0, max_tone_error = 0.0;
+        double sum_luma_error = 0.0;
+
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            FillRandomScRgb(src, static_cast<uint32_t>(frame) + 1);
+            const uint8_t* src_bytes = reinterpret_cast<const uint8_t*>(src.data());
+
+            HdrKernels::ConvertScRgbToP010(src_bytes, width * 8, width, height, reinterpret_cast<uint8_t*>(y_plane.data()), width * 2,
+                                           reinterpret_cast<uint8_t*>(uv_plane.data()), width * 2);
+            HdrKernels::ToneMapScRgbToBgra(src_bytes, width * 8, width, height, reinterpret_cast<uint8_t*>(bgra.data()), width * 4,
+                                           static_cast<float>(white_nits), static_cast<float>(peak_nits));
+
+            for (int y = 0; y < height; y += 2)
+            {
+                for (int x = 0; x < width; x += 2)
+                {
+                    double block[3] = { 0.0, 0.0, 0.0 };
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        const size_t index = static_cast<size_t>(y + i / 2) * width + x + (i & 1);
+                        double rgb[3];
+                        HdrReference::PqRgb(&src[index * 4], rgb);
+                        for (int c = 0; c < 3; ++c) block[c] += rgb[c] / 4.0;
+
+                        const double error = std::abs((y_plane[index] >> 6) - (64.0 + 876.0 * HdrReference::Luma(rgb)));
+                        max_luma_error = std::max(max_luma_error, error);
+                        sum_luma_error += error;
+                    }
+
+                    const double luma = HdrReference::Luma(block);
+                    const size_t chroma = static_cast<size_t>(y / 2) * width + x;
+                    max_chroma_error = std::max(max_chroma_error, std::abs((uv_plane[chroma] >> 6) - (512.0 + 896.0 * (block[2] - luma) / 1.8814)));
+                    max_chroma_error = std::max(max_chroma_error, std::abs((uv_plane[chroma + 1] >> 6) - (512.0 + 896.0 * (block[0] - luma) / 1.4746)));
+                }
+            }
+
+            for (size_t i = 0; i < bgra.size(); ++i)
+            {
+                double rgb[3];
+                for (int c = 0; c < 3; ++c) rgb[c] = std::max<double>(HdrKernels::HalfToFloat(src[i * 4 + c]) * 80.0 / white_nits, 0.0);
+                const double peak = std::max({ rgb[0], rgb[1], rgb[2] });
+                const double ratio = peak > 0.0 ? HdrReference::ToneMap(peak, white_nits, peak_nits) / peak : 0.0;
+
+                for (int c = 0; c < 3; ++c)
+                {
+                    const double expected = 255.0 * HdrReference::Srgb(std::min(rgb[c] * ratio, 1.0));
+                    const double actual = (bgra[i] >> ((2 - c) * 8)) & 0xFF;
+                    max_tone_error = std::max(max_tone_error, std::abs(actual - expected));
+                }
+            }
+        }
+
+        const double samples = static_cast<double>(frames) * width * height;
+        std::printf("half round trip      %d mismatches\n", half_mismatches);
+        std::printf("p010 luma            max %.3f, mean %.4f code values\n", max_luma_error, sum_luma_error / samples);
+        std::printf("p010 chroma          max %.3f code values\n", max_chroma_error);
+        std::printf("tone map bgra        max %.3f code values\n", max_tone_error);
+
+        // Rounding alone accounts for 0.5; anything past one code value is a kernel error
+        const bool passed = half_mismatches == 0 && max_luma_error <= 1.0 && max_chroma_error <= 1.0 && max_tone_error <= 1.0;
+        std::printf("%s\n", passed ? "PASS" : "FAIL");
+        return passed ? 0 : 1;
+    }
+
+    namespace AutoTuneSimulation
+    {
+        // One stage cost pattern; costs are drawn per frame from a fixed seed
+        struct Phase
+        {
+            const char* name;
+            double hold_ms;                     // Capture callback holding a pool buffer
+            double hold_spike_ms;               // Every spike_period frames
+            int spike_period;
+            double encode_ms;
+            double burst_encode_ms;             // First burst_frames frames of every second
+            int burst_frames;
+            bool overloaded;                    // Encode slower than capture; drops are expected
+        };
+
+        const Phase kPhases[] =
+        {
+            { "calm",          2.0,  0.0,  0, 5.0,  0.0,  0, false },
+            { "bursty encode", 2.0,  0.0,  0, 5.0, 11.0, 15, false },
+            { "hold spikes",   2.0, 25.0, 60, 5.0,  0.0,  0, false },
+            { "overload",      2.0,  0.0,  0, 10.0, 0.0,  0, true  },
+            { "calm",          2.0,  0.0,  0, 5.0,  0.0,  0, false },
+        };
+
+        struct PhaseResult
+        {
+            uint64_t frames = 0;
+            uint64_t pool_skips = 0;            // Compositor found no free pool buffer
+            uint64_t queue_drops = 0;
+            uint64_t settled_frames = 0;        // Second half of the phase
+            uint64_t settled_drops = 0;
+            double settled_p99_ms = 0.0;
+            uint64_t settled_changes = 0;
+            int pool_buffers = 0;
+            size_t queue_capacity = 0;
+        };
+
+        // Deterministic discrete-event model of capture -> queue -> encode at 120 fps in simulated
+        // time: a pool of P buffers in front of a sequential capture callback, then a queue of C
+        // frames in front of one encoder. Frames count toward the window they arrived in.
+        std::vector<PhaseResult> Run(double phase_seconds, PipelineTuner* tuner, int pool_buffers, size_t queue_capacity)
+        {
+            const double interval_ms = 1000.0 / 120.0;
+            const uint64_t frames_per_window = 120;
+            const uint64_t phase_frames = static_cast<uint64_t>(phase_seconds * 120.0);
+
+            uint32_t state = 12345;
+            auto jitter = [&] { state = state * 1664525u + 1013904223u; return 0.8 + 0.4 * ((state >> 8) * (1.0 / 16777216.0)); };
+
+            std::deque<double> capture_done;    // Frames holding a pool buffer
+            std::deque<double> encode_done;     // Frames queued or encoding
+            double last_capture = 0.0;
+            double last_encode = 0.0;
+
+            TunerWindow window;
+            LatencyHistogram window_latency;
+            LatencyHistogram settled_latency;
+            std::vector<PhaseResult> results;
+            uint64_t frame = 0;
+
+            for (const Phase& phase : kPhases)
+            {
+                PhaseResult result;
+                settled_latency.Reset();
+                const size_t log_before_settled = tuner ? tuner->GetLog().size() : 0;
+                size_t log_at_settled = log_before_settled;
+
+                for (uint64_t i = 0; i < phase_frames; ++i, ++frame)
+                {
+                    const double now = frame * interval_ms;
+                    const bool settled = i >= phase_frames / 2;
+                    if (settled && i == phase_frames / 2 && tuner) log_at_settled = tuner->GetLog().size();
+
+                    while (!capture_done.empty() && capture_done.front() <= now) capture_done.pop_front();
+
+                    double hold = phase.hold_ms * jitter();
+                    if (phase.spike_period && i % phase.spike_period == 0) hold = phase.hold_spike_ms;
+                    const double encode = (phase.burst_frames && i % 120 < static_cast<uint64_t>(phase.burst_frames) ? phase.burst_encode_ms : phase.encode_ms) * jitter();
+
+                    ++result.frames;
+                    if (capture_done.size() >= static_cast<size_t>(pool_buffers))
+                    {
+                        ++result.pool_skips;
+                    }
+                    else
+                    {
+                        last_capture = std::max(now, last_capture) + hold;
+                        capture_done.push_back(last_capture);
+                        window.max_hold_ms = std::max(window.max_hold_ms, hold);
+                        ++window.frames;
+
+                        // Pushed when the callback finishes; pushes happen in arrival order
+                        const double pushed = last_capture;
+                        while (!encode_done.empty() && encode_done.front() <= pushed) encode_done.pop_front();
+                        const size_t waiting = encode_done.empty() ? 0 : encode_done.size() - 1;
+
+                        if (waiting >= queue_capacity)
+                        {
+                            ++result.queue_drops;
+                            ++window.dropped;
+                            if (settled) ++result.settled_drops;
+                        }
+                        else
+                        {
+                            last_encode = std::max(pushed, last_encode) + encode;
+                            encode_done.push_back(last_encode);
+                            window.queue_peak_depth = std::max(window.queue_peak_depth, waiting + 1);
+
+                            const uint64_t latency_ns = static_cast<uint64_t>((last_encode - now) * 1e6);
+                            window_latency.Record(latency_ns);
+                            if (settled) settled_latency.Record(latency_ns);
+                        }
+                    }
+                    if (settled) ++result.settled_frames;
+
+                    if ((frame + 1) % frames_per_window == 0)
+                    {
+                        window.latency_p99_ms = window_latency.GetPercentileMs(99.0);
+                        if (tuner)
+                        {
+                            TunerDecision decision = tuner->Observe(window);
+                            pool_buffers = decision.pool_buffers;
+                            queue_capacity = decision.queue_capacity;
+                        }
+                        window = TunerWindow();
+                        window_latency.Reset();
+                    }
+                }
+
+                result.settled_p99_ms = settled_latency.GetPercentileMs(99.0);
+                result.settled_changes = tuner ? tuner->GetLog().size() - log_at_settled : 0;
+                result.pool_buffers = pool_buffers;
+                result.queue_capacity = queue_capacity;
+                results.push_back(result);
+            }
+
+            return results;
+        }
+
+        void Print(const char* label, const std::vector<PhaseResult>& results)
+        {
+            std::printf("%-16s %-14s %7s %7s %7s %9s %9s %7s %5s %6s\n", label, "phase", "frames", "skips", "drops",
+                        "settled%", "p99 ms", "changes", "pool", "queue");
+            for (size_t i = 0; i < results.size(); ++i)
+            {
+                const PhaseResult& result = results[i];
+                std::printf("%-16s %-14s %7llu %7llu %7llu %9.3f %9.2f %7llu %5d %6zu\n", "", kPhases[i].name,
+                            static_cast<unsigned long long>(result.frames), static_cast<unsigned long long>(result.pool_skips),
+                            static_cast<unsigned long long>(result.queue_drops),
+                            result.settled_frames ? result.settled_drops * 100.0 / result.settled_frames : 0.0,
+                            result.settled_p99_ms, static_cast<unsigned long long>(result.settled_changes),
+                            result.pool_buffers, result.queue_capacity);
+            }
+        }
+    }
+
+    // Checks that the auto-tuner converges: in the second half of every phase there are no pool
+    // skips or queue drops above the tolerated rate (only latency is held when overloaded), p99
+    // stays within budget and the sizes have stopped moving.
+    int RunAutoTuneSimulation(double phase_seconds)
+    {
+        const int default_pool = 2;
+        const size_t default_queue = 4;
+
+        PipelineTunerConfig config;
+        config.latency_budget_ms = 100.0;
+        PipelineTuner tuner(config, 1000.0 / 120.0, default_pool, default_queue);
+
+        std::vector<AutoTuneSimulation::PhaseResult> fixed = AutoTuneSimulation::Run(phase_seconds, nullptr, default_pool, default_queue);
+        std::vector<AutoTuneSimulation::PhaseResult> tuned = AutoTuneSimulation::Run(phase_seconds, &tuner, default_pool, default_queue);
+
+        AutoTuneSimulation::Print("fixed 2/4", fixed);
+        AutoTuneSimulation::Print("auto-tuned", tuned);
+
+        std::printf("\ndecisions (window = 1 s at 120 fps, latency budget %.0f ms)\n", config.latency_budget_ms);
+        for (const TunerDecision& decision : tuner.GetLog())
+        {
+            std::printf("  %4llu  pool %d  queue %2zu  %s\n", static_cast<unsigned long long>(decision.window),
+                        decision.pool_buffers, decision.queue_capacity, decision.reason.c_str());
+        }
+
+        bool passed = true;
+        for (size_t i = 0; i < tuned.size(); ++i)
+        {
+            const AutoTuneSimulation::PhaseResult& result = tuned[i];
+            const bool overloaded = AutoTuneSimulation::kPhases[i].overloaded;
+            const double drop_rate = result.settled_frames ? static_cast<double>(result.settled_drops) / result.settled_frames : 0.0;
+
+            // Calm phases may still hand buffers back one at a time
+            const bool stable = result.settled_changes <= (phase_seconds / 2.0) / config.calm_windows + 1;
+            if ((!overloaded && drop_rate > config.max_drop_rate) || result.settled_p99_ms > config.latency_budget_ms || !stable)
+            {
+                std::printf("phase %zu (%s) did not converge\n", i + 1, AutoTuneSimulation::kPhases[i].name);
+                passed = false;
+            }
+        }
+
+        std::printf("%s\n", passed ? "PASS" : "FAIL");
+        return passed ? 0 : 1;
+    }
+
+    // Everything ScreenRecorder and its sinks keep between frames: copy, NV12 (UV after Y), preview
+    // box downsample, P010 (UV after Y) and the SDR tone map
+    struct DirtyCheckOutputs
+    {
+        static constexpr int kCount = 5;
+        static constexpr const char* kNames[kCount] = { "copy", "nv12", "box/3", "p010", "tone map" };
+        std::vector<uint8_t> planes[kCount];
+    };
+
+    constexpr int kDirtyCheckFactor = 3;
+
+    void ProcessDirtyCheckFrame(DirtyCheckOutputs& out, const std::vector<uint8_t>& bgra, ptrdiff_t pitch, const std::vector<uint8_t>& scrgb,
+                                int width, int height, const DirtyRegion* region, const DirtyRegion* hdr_region)
+    {
+        const size_t pixels = static_cast<size_t>(width) * height;
+        const int box_width = width / kDirtyCheckFactor;
+        out.planes[0].resize(pixels * 4);
+        out.planes[1].resize(pixels * 3 / 2);
+        out.planes[2].resize(static_cast<size_t>(box_width) * (height / kDirtyCheckFactor) * 4);
+        out.planes[3].resize(pixels * 3);
+        out.planes[4].resize(pixels * 4);
+
+        if (!region)
+        {
+            FrameKernels::CopyImage(out.planes[0].data(), width * 4, bgra.data(), pitch, width * 4, height);
+            FrameKernels::ConvertBgraToNv12(bgra.data(), pitch, width, height, out.planes[1].data(), width, out.planes[1].data() + pixels, width);
+            FrameKernels::DownsampleBgraBox(bgra.data(), pitch, width, height, kDirtyCheckFactor, out.planes[2].data(), box_width * 4);
+            HdrKernels::ConvertScRgbToP010(scrgb.data(), width * 8, width, height, out.planes[3].data(), width * 2,
+                                           out.planes[3].data() + pixels * 2, width * 2);
+            HdrKernels::ToneMapScRgbToBgra(scrgb.data(), width * 8, width, height, out.planes[4].data(), width * 4, 203.0f, 1000.0f);
+            return;
+        }
+
+        FrameKernels::CopyImageRegion(out.planes[0].data(), width * 4, bgra.data(), pitch, 4, *region);
+        FrameKernels::ConvertBgraToNv12Region(bgra.data(), pitch, out.planes[1].data(), width, out.planes[1].data() + pixels, width, *region);
+        FrameKernels::DownsampleBgraBoxRegion(bgra.data(), pitch, kDirtyCheckFactor, out.planes[2].data(), box_width * 4, *region);
+        HdrKernels::ConvertScRgbToP010Region(scrgb.data(), width * 8, out.planes[3].data(), width * 2,
+                                             out.planes[3].data() + pixels * 2, width * 2, *hdr_region);
+        HdrKernels::ToneMapScRgbToBgraRegion(scrgb.data(), width * 8, out.planes[4].data(), width * 4, 203.0f, 1000.0f, *hdr_region);
+    }
+
+    // Random edits each frame: none, a few caret-sized rects, one large rect, or more rects than a
+    // region keeps. One set of outputs is updated from the exact edit rects every frame, another from
+    // the tile tracker's regions gathered over three frames as a consumer that drops frames would.
+    // Both must match converting the whole frame.
+    int RunDirtyCheck(int frames)
+    {
+        // Even for 4:2:0, but neither a multiple of the SIMD width nor of the box factor
+        const int width = 998;
+        const int height = 562;
+        const ptrdiff_t pitch = width * 4 + 64;
+        const float gain = 203.0f / HdrKernels::kScRgbNits;
+
+        std::vector<uint8_t> bgra;
+        FillPattern(bgra, width, height, pitch, 40);
+        std::vector<uint8_t> scrgb(static_cast<size_t>(width) * height * 8);
+        HdrKernels::ConvertBgraToScRgb(bgra.data(), pitch, width, height, scrgb.data(), width * 8, gain);
+
+        uint32_t state = 77;
+        auto next = [&](int limit) { state = state * 1664525u + 1013904223u; return static_cast<int>((state >> 8) % static_cast<uint32_t>(limit)); };
+
+        DirtyCheckOutputs reference, exact, tracked;
+        DirtyRegionTracker tracker, hdr_tracker;
+        DirtyRegion pending, pending_hdr;
+        int exact_mismatches[DirtyCheckOutputs::kCount] = {};
+        int tracked_mismatches[DirtyCheckOutputs::kCount] = {};
+        int tracked_checks = 0;
+        double changed_coverage = 0.0, tracked_coverage = 0.0, processed_coverage = 0.0;
+
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            DirtyRegion changed = DirtyRegion::Full(width, height);
+            if (frame > 0)
+            {
+                changed = DirtyRegion(width, height);
+                const int kind = next(10);
+                const int rects = kind == 0 ? 0 : kind == 1 ? 1 : kind == 2 ? 100 : 1 + next(6);
+
+                for (int i = 0; i < rects; ++i)
+                {
+                    const int rect_width = 1 + next(kind == 1 ? width / 2 : kind == 2 ? 8 : 64);
+                    const int rect_height = 1 + next(kind == 1 ? height / 2 : kind == 2 ? 8 : 48);
+                    const DirtyRect rect = { next(width - rect_width + 1), next(height - rect_height + 1), rect_width, rect_height };
+
+                    for (int y = rect.y; y < rect.y + rect.height; ++y)
+                    {
+                        uint8_t* row = bgra.data() + y * pitch + static_cast<ptrdiff_t>(rect.x) * 4;
+                        for (int x = 0; x < rect.width * 4; ++x) row[x] = x % 4 == 3 ? 255 : static_cast<uint8_t>(next(256));
+                    }
+                    HdrKernels::ConvertBgraToScRgb(bgra.data() + rect.y * pitch + static_cast<ptrdiff_t>(rect.x) * 4, pitch, rect.width, rect.height,
+                                                   scrgb.data() + (static_cast<size_t>(rect.y) * width + rect.x) * 8, width * 8, gain);
+                    changed.Add(rect);
+                }
+            }
+
+            const DirtyRegion tracked_region = tracker.Update(bgra.data(), pitch, width, height, 4);
+            const DirtyRegion tracked_hdr_region = hdr_tracker.Update(scrgb.data(), width * 8, width, height, 8);
+            pending.Add(tracked_region);
+            pending_hdr.Add(tracked_hdr_region);
+            changed_coverage += changed.GetCoverage();
+            tracked_coverage += tracked_region.GetCoverage();
+
+            ProcessDirtyCheckFrame(reference, bgra, pitch, scrgb, width, height, nullptr, nullptr);
+            ProcessDirtyCheckFrame(exact, bgra, pitch, scrgb, width, height, &changed, &changed);
+            for (int i = 0; i < DirtyCheckOutputs::kCount; ++i)
+            {
+                exact_mismatches[i] += exact.planes[i] != reference.planes[i] ? 1 : 0;
+            }
+
+            if (frame % 3 == 2 || frame + 1 == frames)
+            {
+                ProcessDirtyCheckFrame(tracked, bgra, pitch, scrgb, width, height, &pending, &pending_hdr);
+                for (int i = 0; i < DirtyCheckOutputs::kCount; ++i)
+                {
+                    tracked_mismatches[i] += tracked.planes[i] != reference.planes[i] ? 1 : 0;
+                }
+                processed_coverage += pending.GetCoverage();
+                ++tracked_checks;
+                pending = DirtyRegion(width, height);
+                pending_hdr = DirtyRegion(width, height);
+            }
+        }
+
+        bool passed = true;
+        std::printf("%-10s %22s %22s\n", "output", "exact rects, every", "tracked, every 3rd");
+        for (int i = 0; i < DirtyCheckOutputs::kCount; ++i)
+        {
+            std::printf("%-10s %12d / %-7d %12d / %-7d\n", DirtyCheckOutputs::kNames[i], exact_mismatches[i], frames, tracked_mismatches[i], tracked_checks);
+            passed = passed && exact_mismatches[i] == 0 && tracked_mismatches[i] == 0;
+        }
+
+        std::printf("mean coverage: edited %.1f%%, tracked %.1f%% per frame, %.1f%% per processed frame\n", changed_coverage * 100.0 / frames,
+                    tracked_coverage * 100.0 / frames, processed_coverage * 100.0 / std::max(1, tracked_checks));
+        std::printf("%s\n", passed ? "PASS" : "FAIL");
+        return passed ? 0 : 1;
+    }
+
+    // Outputs that must not depend on how far apart the input rows are
+    struct StrideCheckOutputs
+    {
+        static constexpr int kCount = 9;
+        static constexpr const char* kNames[kCount] = { "descriptor", "queue", "nv12", "box/3", "scene", "tone map", "p010", "raw bgra", "raw nv12" };
+        std::vector<uint8_t> planes[kCount];
+        bool present[kCount] = {};
+    };
+
+    void ProcessStrideCheckFrame(StrideCheckOutputs& out, const uint8_t* bgra, ptrdiff_t pitch, const uint8_t* scrgb, ptrdiff_t scrgb_pitch,
+                                 int width, int height, const std::filesystem::path& raw_path)
+    {
+        const size_t pixels = static_cast<size_t>(width) * height;
+        const bool even = width % 2 == 0 && height % 2 == 0;
+        auto keep = [&](int i, std::vector<uint8_t>&& plane) { out.planes[i] = std::move(plane); out.present[i] = true; };
+
+        FrameDescriptor frame = FrameDescriptor::Packed(bgra, FrameFormat::Bgra, width, height);
+        frame.planes[0].pitch = pitch;
+        FrameDescriptor too_close = frame;
+        too_close.planes[0].pitch = width * 4 - 1;
+        const FrameDescriptor nv12 = FrameDescriptor::Packed(bgra, FrameFormat::Nv12, width, height);
+        keep(0, { static_cast<uint8_t>(frame.IsValid()), static_cast<uint8_t>(frame.IsPacked() == (pitch == width * 4)),
+                  static_cast<uint8_t>(too_close.IsValid()), static_cast<uint8_t>(nv12.GetRowBytes(1) == static_cast<size_t>((width + 1) / 2 * 2)),
+                  static_cast<uint8_t>(nv12.GetPlaneHeight(1) == (height + 1) / 2) });
+
+        MemoryBudget budget(64ull * 1024 * 1024);
+        FrameQueue queue(budget, 1, BackpressurePolicy::Drop);
+        QueuedFrame queued;
+        queue.Push(frame, DirtyRegion::Full(width, height));
+        queue.Close();
+        if (queue.Pop(queued)) keep(1, std::vector<uint8_t>(queued.pixels->data(), queued.pixels->data() + queued.pixels->size()));
+
+        if (even)
+        {
+            std::vector<uint8_t> converted(pixels * 3 / 2);
+            FrameKernels::ConvertBgraToNv12(bgra, pitch, width, height, converted.data(), width, converted.data() + pixels, width);
+            keep(2, std::move(converted));
+        }
+
+        if (width >= kDirtyCheckFactor && height >= kDirtyCheckFactor)
+        {
+            const int box_width = width / kDirtyCheckFactor;
+            std::vector<uint8_t> box(static_cast<size_t>(box_width) * (height / kDirtyCheckFactor) * 4);
+            FrameKernels::DownsampleBgraBox(bgra, pitch, width, height, kDirtyCheckFactor, box.data(), box_width * 4);
+            keep(3, std::move(box));
+        }
+
+        // Against a shifted copy of itself, so the scroll and histogram paths both run
+        SceneChangeDetector detector;
+        std::vector<double> scene;
+        for (int row_offset : { 0, std::min(1, height - 1) })
+        {
+            const SceneChangeResult result = detector.Analyze(bgra + row_offset * pitch, pitch, width, height - row_offset);
+            scene.insert(scene.end(), { result.histogram_distance, result.mean_difference, result.force_keyframe ? 1.0 : 0.0 });
+        }
+        std::vector<uint8_t> scene_bytes(scene.size() * sizeof(double));
+        std::memcpy(scene_bytes.data(), scene.data(), scene_bytes.size());
+        keep(4, std::move(scene_bytes));
+
+        std::vector<uint8_t> tone_mapped(pixels * 4);
+        HdrKernels::ToneMapScRgbToBgra(scrgb, scrgb_pitch, width, height, tone_mapped.data(), width * 4, 203.0f, 1000.0f);
+        keep(5, std::move(tone_mapped));
+
+        if (even)
+        {
+            std::vector<uint8_t> p010(pixels * 3);
+            HdrKernels::ConvertScRgbToP010(scrgb, scrgb_pitch, width, height, p010.data(), width * 2, p010.data() + pixels * 2, width * 2);
+            keep(6, std::move(p010));
+        }
+
+        // Written from the descriptor, as the recorder does, and read back
+        for (RawPixelFormat format : { RawPixelFormat::BGRA, RawPixelFormat::NV12 })
+        {
+            if (format == RawPixelFormat::NV12 && !even) continue;
+
+            std::vector<uint8_t> read_back;
+            {
+                RawVideoWriter writer(width, height, 60, format, raw_path);
+                if (!writer.Initialize()) continue;
+                writer.ProcessFrame(frame, DirtyRegion::Full(width, height));
+                writer.Close();
+            }
+            RawVideoReader reader;
+            if (reader.Open(raw_path) && reader.GetFrameCount() == 1) reader.ReadFrame(0, read_back);
+            keep(format == RawPixelFormat::BGRA ? 7 : 8, std::move(read_back));
+        }
+        std::error_code error;
+        std::filesystem::remove(raw_path, error);
+    }
+
+    // Every stage fed a frame with tightly packed rows and the same frame at GPU-style padded
+    // pitches must produce the same bytes. Widths include 1 and odd sizes that leave a partial SIMD
+    // block and a partial box; 4:2:0 outputs are only checked at even sizes.
+    int RunStrideCheck(int frames, const std::filesystem::path& raw_directory)
+    {
+        const Resolution sizes[] = { { "1x1", 1, 1 }, { "3x5", 3, 5 }, { "997x563", 997, 563 }, { "998x562", 998, 562 } };
+        const float gain = 203.0f / HdrKernels::kScRgbNits;
+        const std::filesystem::path raw_path = raw_directory / "stride_check.zraw";
+
+        int mismatches[StrideCheckOutputs::kCount] = {};
+        int checks[StrideCheckOutputs::kCount] = {};
+
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            for (const Resolution& size : sizes)
+            {
+                const int width = size.width;
+                const int height = size.height;
+                const ptrdiff_t row_bytes = width * 4;
+
+                std::vector<uint8_t> packed;
+                FillPattern(packed, width, height, row_bytes, static_cast<uint32_t>(50 + frame));
+                std::vector<uint8_t> packed_scrgb(static_cast<size_t>(width) * height * 8);
+                HdrKernels::ConvertBgraToScRgb(packed.data(), row_bytes, width, height, packed_scrgb.data(), row_bytes * 2, gain);
+
+                StrideCheckOutputs reference;
+                ProcessStrideCheckFrame(reference, packed.data(), row_bytes, packed_scrgb.data(), row_bytes * 2, width, height, raw_path);
+                const bool descriptor_ok = reference.planes[0] == std::vector<uint8_t>{ 1, 1, 0, 1, 1 };
+                mismatches[0] += descriptor_ok ? 0 : 1;
+                ++checks[0];
+
+                for (ptrdiff_t pitch : { row_bytes + 4, row_bytes + 64, (row_bytes + 255) / 256 * 256 + 256 })
+                {
+                    // Padding bytes that would show up in any output that reads past a row
+                    std::vector<uint8_t> padded(static_cast<size_t>(pitch) * height, 0xCD);
+                    FrameKernels::CopyImage(padded.data(), pitch, packed.data(), row_bytes, row_bytes, height);
+                    std::vector<uint8_t> padded_scrgb(static_cast<size_t>(pitch) * 2 * height, 0xCD);
+                    FrameKernels::CopyImage(padded_scrgb.data(), pitch * 2, packed_scrgb.data(), row_bytes * 2, row_bytes * 2, height);
+
+                    StrideCheckOutputs out;
+                    ProcessStrideCheckFrame(out, padded.data(), pitch, padded_scrgb.data(), pitch * 2, width, height, raw_path);
+                    for (int i = 0; i < StrideCheckOutputs::kCount; ++i)
+                    {
+                        if (!reference.present[i] && !out.present[i]) continue;
+                        ++checks[i];
+                        if (i == 0)
+                        {
+                            mismatches[i] += out.planes[i] == std::vector<uint8_t>{ 1, 1, 0, 1, 1 } ? 0 : 1;
+                            continue;
+                        }
+                        const bool same = reference.present[i] && out.present[i] && out.planes[i] == reference.planes[i];
+                        // The raw files must also hold exactly the packed pixels
+                        const bool raw_exact = i != 7 || out.planes[i] == packed;
+                        mismatches[i] += same && raw_exact && !out.planes[i].empty() ? 0 : 1;
+                    }
+                }
+            }
+        }
+
+        bool passed = true;
+        std::printf("%-10s %20s\n", "output", "mismatches / checks");
+        for (int i = 0; i < StrideCheckOutputs::kCount; ++i)
+        {
+            std::printf("%-10s %12d / %-7d\n", StrideCheckOutputs::kNames[i], mismatches[i], checks[i]);
+            passed = passed && mismatches[i] == 0 && checks[i] > 0;
+        }
+        std::printf("%s\n", passed ? "PASS" : "FAIL");
+        return passed ? 0 : 1;
+    }
+
+    // Stands in for VideoEncoder with an asynchronous encoder behind it: samples are made the way
+    // VideoEncoder makes them and held for a few frames, then released in no particular order, as an
+    // MFT finishing work would. Each sample is hashed when submitted and again when released, so a
+    // buffer recycled while still held shows up as a mismatch.
+    class MockEncoder : public FrameSink
+    {
+    public:
+        explicit MockEncoder(size_t depth) : depth_(depth) {}
+
+        bool ProcessFrame(const std::vector<uint8_t>& image_buffer, int width, int height) override
+        {
+            return ProcessFrame(FrameDescriptor::Packed(image_buffer.data(), FrameFormat::Bgra, width, height), DirtyRegion::Full(width, height));
+        }
+
+        bool ProcessFrame(const FrameDescriptor& frame, const DirtyRegion&) override
+        {
+            const size_t row_bytes = frame.GetRowBytes(0);
+            RetainedFrame retained = RetainFrame(frame, pool_);
+            if (retained.fill)
+            {
+                FrameKernels::CopyImage(retained.fill, row_bytes, frame.planes[0].data, frame.planes[0].pitch, row_bytes, frame.height);
+                ++copied_;
+            }
+            else
+            {
+                ++wrapped_;
+            }
+
+            const uint64_t hash = FrameKernels::HashImage(retained.data, row_bytes, row_bytes, frame.height);
+            held_.push_back({ std::move(retained.owner), retained.data, row_bytes, frame.height, hash });
+            if (held_.size() > depth_)
+            {
+                state_ = state_ * 1664525u + 1013904223u;
+                Release((state_ >> 8) % held_.size());
+            }
+            return true;
+        }
+
+        bool Close() override
+        {
+            while (!held_.empty()) Release(held_.size() - 1);
+            return true;
+        }
+
+        uint64_t GetWrapped() const { return wrapped_; }
+        uint64_t GetCopied() const { return copied_; }
+        uint64_t GetCorrupted() const { return corrupted_; }
+        FramePoolStats GetPoolStats() const { return pool_.GetStats(); }
+        void SetMemoryBudget(MemoryBudget* budget) { pool_.SetMemoryBudget(budget); }
+
+    private:
+        struct Sample
+        {
+            std::shared_ptr<const void> owner;
+            const uint8_t* data;
+            size_t row_bytes;
+            int rows;
+            uint64_t hash;
+        };
+
+        void Release(size_t index)
+        {
+            const Sample& sample = held_[index];
+            corrupted_ += FrameKernels::HashImage(sample.data, sample.row_bytes, sample.row_bytes, sample.rows) != sample.hash ? 1 : 0;
+            held_.erase(held_.begin() + index);
+        }
+
+        size_t depth_;
+        FramePool pool_;
+        std::deque<Sample> held_;
+        uint32_t state_ = 99;
+        uint64_t wrapped_ = 0;
+        uint64_t copied_ = 0;
+        uint64_t corrupted_ = 0;
+    };
+
+    // Frames that differ from the one before, at a padded pitch as captured
+    void FillPoolCheckFrame(std::vector<uint8_t>& frame, int width, int height, ptrdiff_t pitch, uint64_t index)
+    {
+        FillPattern(frame, width, height, pitch, static_cast<uint32_t>(index % 7 + 60));
+        for (int y = 0; y < height; ++y) std::memcpy(frame.data() + y * pitch, &index, sizeof(index));
+    }
+
+    // The frame path with a mock in place of the encoder. Queued frames, pushed from padded rows and
+    // encoded the way ScreenRecorder::EncodeLoop does, must reach the encoder without a copy and stay
+    // intact until it releases them, also when the queue and its pool are destroyed first. Frames
+    // handed over directly are borrowed and must be copied exactly once.
+    int RunPoolCheck(int frames)
+    {
+        const int width = 640;
+        const int height = 360;
+        const ptrdiff_t pitch = width * 4 + 256;
+        const size_t kEncoderDepth = 4;
+        const size_t kQueueCapacity = 3;
+
+        MemoryBudget budget(256ull * 1024 * 1024);
+        MockEncoder queued_encoder(kEncoderDepth);
+        FramePoolStats queue_pool;
+        uint64_t queue_cached = 0;
+        {
+            FrameQueue queue(budget, kQueueCapacity, BackpressurePolicy::Block);
+
+            std::thread encode_thread([&]
+            {
+                QueuedFrame frame;
+                while (queue.Pop(frame))
+                {
+                    FrameDescriptor descriptor = FrameDescriptor::Packed(frame.pixels->data(), frame.format, frame.width, frame.height, frame.capture_time);
+                    descriptor.owner = frame.pixels;
+                    queued_encoder.ProcessFrame(descriptor, frame.dirty);
+                    frame.pixels.reset();
+                }
+            });
+
+            std::vector<uint8_t> captured;
+            for (int i = 0; i < frames; ++i)
+            {
+                FillPoolCheckFrame(captured, width, height, pitch, i);
+                FrameDescriptor frame = FrameDescriptor::Packed(captured.data(), FrameFormat::Bgra, width, height);
+                frame.planes[0].pitch = pitch;
+                queue.Push(frame, DirtyRegion::Full(width, height));
+            }
+
+            queue.Close();
+            encode_thread.join();
+            queue_pool = queue.GetPool().GetStats();
+            queue_cached = budget.GetCached();
+        }
+        // The encoder still holds samples from the queue's pool, and their bytes stay reserved until it lets go.
+        // The queue's free buffers went with it.
+        const uint64_t held_bytes = budget.GetUsage();
+        const uint64_t orphan_cached = budget.GetCached();
+        queued_encoder.Close();
+        const uint64_t released_bytes = budget.GetUsage() + budget.GetCached();
+        const uint64_t queue_peak = budget.GetPeak();
+
+        // The encoder's own copies are charged through its pool, and kept as cached once released
+        MemoryBudget direct_budget(256ull * 1024 * 1024);
+        MockEncoder direct_encoder(kEncoderDepth);
+        direct_encoder.SetMemoryBudget(&direct_budget);
+        std::vector<uint8_t> captured;
+        for (int i = 0; i < frames; ++i)
+        {
+            FillPoolCheckFrame(captured, width, height, pitch, i);
+            FrameDescriptor frame = FrameDescriptor::Packed(captured.data(), FrameFormat::Bgra, width, height);
+            frame.planes[0].pitch = pitch;
+            direct_encoder.ProcessFrame(frame, DirtyRegion::Full(width, height));
+        }
+        const uint64_t direct_held = direct_budget.GetUsage();
+        direct_encoder.Close();
+        const FramePoolStats direct_pool = direct_encoder.GetPoolStats();
+        const uint64_t direct_released = direct_budget.GetUsage();
+        const uint64_t direct_cached = direct_budget.GetCached();
+
+        // A sink's working buffers are charged past the limit and stay. Blocked pushes must drop
+        // rather than wait for memory no queued frame will give back.
+        const int kChargedFrames = 8;
+        const uint64_t frame_bytes = static_cast<uint64_t>(width) * height * 4;
+        MemoryBudget charged_budget(2 * frame_bytes);
+        MemoryBudget::Reservation sink_buffers = charged_budget.Charge(2 * frame_bytes);
+        int charged_dropped = 0;
+        double charged_ms = 0.0;
+        {
+            FrameQueue queue(charged_budget, kQueueCapacity, BackpressurePolicy::Block);
+            const auto charged_start = std::chrono::steady_clock::now();
+            for (int i = 0; i < kChargedFrames; ++i)
+            {
+                FillPoolCheckFrame(captured, width, height, pitch, i);
+                FrameDescriptor frame = FrameDescriptor::Packed(captured.data(), FrameFormat::Bgra, width, height);
+                frame.planes[0].pitch = pitch;
+                charged_dropped += queue.Push(frame, DirtyRegion::Full(width, height)) == PushResult::Dropped ? 1 : 0;
+            }
+            charged_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - charged_start).count();
+        }
+        sink_buffers.Reset();
+
+        // Buffers in flight: the queue, one being popped, one being pushed and the encoder's
+        const uint64_t queue_allocation_limit = kQueueCapacity + kEncoderDepth + 3;
+        const uint64_t direct_allocation_limit = kEncoderDepth + 1;
+
+        std::printf("%-8s %8s %8s %8s %10s %12s %8s %12s\n", "path", "frames", "wrapped", "copied", "corrupted", "allocations", "reuses", "outstanding");
+        std::printf("%-8s %8d %8llu %8llu %10llu %6llu / %-4llu %8llu %12s\n", "queued", frames,
+                    static_cast<unsigned long long>(queued_encoder.GetWrapped()), static_cast<unsigned long long>(queued_encoder.GetCopied()),
+                    static_cast<unsigned long long>(queued_encoder.GetCorrupted()), static_cast<unsigned long long>(queue_pool.allocations),
+                    static_cast<unsigned long long>(queue_allocation_limit), static_cast<unsigned long long>(queue_pool.reuses), "-");
+        std::printf("%-8s %8d %8llu %8llu %10llu %6llu / %-4llu %8llu %12zu\n", "direct", frames,
+                    static_cast<unsigned long long>(direct_encoder.GetWrapped()), static_cast<unsigned long long>(direct_encoder.GetCopied()),
+                    static_cast<unsigned long long>(direct_encoder.GetCorrupted()), static_cast<unsigned long long>(direct_pool.allocations),
+                    static_cast<unsigned long long>(direct_allocation_limit), static_cast<unsigned long long>(direct_pool.reuses), direct_pool.outstanding);
+
+        // Reservations follow the buffers: what the encoder holds is counted until it releases it
+        const uint64_t expected_held = std::min<uint64_t>(frames, kEncoderDepth) * frame_bytes;
+        std::printf("reserved while the encoder holds samples: %llu bytes (expected %llu), after it lets go: %llu\n",
+                    static_cast<unsigned long long>(held_bytes), static_cast<unsigned long long>(expected_held),
+                    static_cast<unsigned long long>(released_bytes));
+
+        // Free buffers count as cached while their pool keeps them, and the peak covers both
+        const uint64_t expected_queue_cached = queue_pool.free * frame_bytes;
+        const uint64_t peak_limit = queue_allocation_limit * frame_bytes;
+        const uint64_t expected_direct_cached = direct_pool.free * frame_bytes;
+        std::printf("queue pool cached: %llu bytes (expected %llu), after the queue is gone: %llu; peak %llu (at least %llu, at most %llu)\n",
+                    static_cast<unsigned long long>(queue_cached), static_cast<unsigned long long>(expected_queue_cached),
+                    static_cast<unsigned long long>(orphan_cached), static_cast<unsigned long long>(queue_peak),
+                    static_cast<unsigned long long>(held_bytes + queue_cached), static_cast<unsigned long long>(peak_limit));
+        std::printf("encoder pool charged: %llu bytes (expected %llu), after release: %llu, cached %llu (expected %llu)\n",
+                    static_cast<unsigned long long>(direct_held), static_cast<unsigned long long>(expected_held),
+                    static_cast<unsigned long long>(direct_released), static_cast<unsigned long long>(direct_cached),
+                    static_cast<unsigned long long>(expected_direct_cached));
+        std::printf("blocked pushes over a budget charged full: %d / %d dropped in %.1f ms\n", charged_dropped, kChargedFrames, charged_ms);
+
+        const bool passed = charged_dropped == kChargedFrames && charged_ms < 100.0 && held_bytes == expected_held && released_bytes == 0 &&
+                            queue_cached == expected_queue_cached && orphan_cached == 0 &&
+                            queue_peak >= held_bytes + queue_cached && queue_peak <= peak_limit &&
+                            direct_held == expected_held && direct_released == 0 && direct_cached == expected_direct_cached &&
+                            queued_encoder.GetWrapped() == static_cast<uint64_t>(frames) && queued_encoder.GetCopied() == 0 &&
+                            queued_encoder.GetCorrupted() == 0 && queue_pool.allocations <= queue_allocation_limit &&
+                            direct_encoder.GetCopied() == static_cast<uint64_t>(frames) && direct_encoder.GetWrapped() == 0 &&
+                            direct_encoder.GetCorrupted() == 0 && direct_pool.allocations <= direct_allocation_limit && direct_pool.outstanding == 0;
+        std::printf("%s\n", passed ? "PASS" : "FAIL");
+        return passed ? 0 : 1;
+    }
+
+    // Annex B access units shaped like a screen encode: AUD, then SPS/PPS/IDR every second,
+    // otherwise one non-IDR slice. Payload bytes are never zero, so no start code is emulated.
+    std::vector<std::vector<uint8_t>> MakeStreamAccessUnits(int count, int fps)
+    {
+        std::vector<std::vector<uint8_t>> units(count);
+        uint32_t state = 12345;
+        auto next = [&]() { state = state * 1664525u + 1013904223u; return state; };
+        auto append_nal = [&](std::vector<uint8_t>& unit, uint8_t header, size_t size)
+        {
+            unit.insert(unit.end(), { 0x00, 0x00, 0x00, 0x01, header });
+            for (size_t i = 0; i < size; ++i) unit.push_back(static_cast<uint8_t>(next() % 255 + 1));
+        };
+
+        for (int i = 0; i < count; ++i)
+        {
+            std::vector<uint8_t>& unit = units[i];
+            unit.assign({ 0x00, 0x00, 0x00, 0x01, 0x09, 0xF0 });
+            if (i % fps == 0)
+            {
+                append_nal(unit, 0x67, 12);
+                append_nal(unit, 0x68, 4);
+                append_nal(unit, 0x65, 40000 + next() % 20000);
+            }
+            else
+            {
+                append_nal(unit, 0x41, 1000 + next() % 12000);
+            }
+        }
+        return units;
+    }
+
+    struct StreamCheckResult
+    {
+        int delivered = 0;
+        int corrupted = 0;
+        LiveStreamStats sender;
+        StreamReceiverStats receiver;
+        LatencyHistogram end_to_end;
+        double seconds = 0.0;
+    };
+
+    // Sends frames access units paced at fps through LiveStreamer to a receiver on loopback and
+    // matches what comes out of the demuxer against what went in, by PTS
+    void RunStreamScenario(const std::vector<std::vector<uint8_t>>& units, int frames, int fps,
+                           const StreamTransportConfig& transport, double loss, StreamCheckResult& result)
+    {
+        using Clock = std::chrono::steady_clock;
+        const int kPtsDelayMs = 50;
+
+        UdpStreamReceiver receiver;
+        if (!receiver.Open(0, transport)) return;
+
+        StreamConfig config;
+        config.port = receiver.GetLocalEndpoint().port;
+        config.transport = transport;
+        config.pts_delay_ms = kPtsDelayMs;
+        LiveStreamer streamer;
+        if (!streamer.Start(config, NalCodec::H264)) return;
+        streamer.GetSender().SetSimulatedLoss(loss, 7);
+
+        // Capture times are exact multiples of the frame duration so PTS identifies the frame
+        std::map<uint64_t, int> frame_by_pts;
+        for (int i = 0; i < static_cast<int>(units.size()); ++i)
+        {
+            const uint64_t us = static_cast<uint64_t>(i) * 1000000 / fps;
+            frame_by_pts[us * 9 / 100 + kPtsDelayMs * 90] = i;
+        }
+
+        std::vector<std::atomic<int64_t>> sent_ns(units.size());
+        std::vector<uint8_t> seen(frames, 0);
+        std::atomic<bool> sending{ true };
+
+        std::thread receive_thread([&]
+        {
+            TsDemuxer demuxer;
+            std::vector<uint8_t> ts;
+            std::vector<TsAccessUnit> received;
+            Clock::time_point last_data = Clock::now();
+
+            while (sending.load() || Clock::now() - last_data < std::chrono::milliseconds(300))
+            {
+                ts.clear();
+                received.clear();
+                if (!receiver.Poll(ts, std::chrono::milliseconds(5))) break;
+                if (ts.empty()) continue;
+
+                last_data = Clock::now();
+                demuxer.Push(ts.data(), ts.size(), received);
+                const int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+
+                for (const TsAccessUnit& unit : received)
+                {
+                    auto frame = frame_by_pts.find(unit.pts_90k);
+                    if (frame == frame_by_pts.end())
+                    {
+                        ++result.corrupted;
+                        continue;
+                    }
+                    if (frame->second >= frames) continue;
+
+                    result.end_to_end.Record(static_cast<uint64_t>(std::max<int64_t>(0, now_ns - sent_ns[frame->second].load())));
+                    if (unit.data != units[frame->second] || seen[frame->second]++)
+                    {
+                        ++result.corrupted;
+                        continue;
+                    }
+                    ++result.delivered;
+                }
+            }
+        });
+
+        // The access units after frames only flush out losses at the tail
+        const auto capture_base = Clock::now();
+        const auto start = Clock::now();
+        for (int i = 0; i < static_cast<int>(units.size()); ++i)
+        {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(static_cast<int64_t>(i) * 1000000 / fps));
+            const auto capture_time = capture_base + std::chrono::microseconds(static_cast<int64_t>(i) * 1000000 / fps);
+            sent_ns[i].store(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+            streamer.WriteAccessUnit(units[i].data(), units[i].size(), capture_time, i % fps == 0);
+        }
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        sending.store(false);
+        receive_thread.join();
+
+        result.sender = streamer.GetStats();
+        result.receiver = receiver.GetStats();
+        streamer.Stop();
+    }
+
+    int RunStreamCheck(int frames)
+    {
+        const int fps = 120;
+        const std::vector<std::vector<uint8_t>> units = MakeStreamAccessUnits(frames + 8, fps);
+
+        struct Scenario
+        {
+            const char* name;
+            int fec_group;
+            bool retransmit;
+            double loss;
+            bool must_deliver_all;
+        };
+        const Scenario scenarios[] =
+        {
+            { "plain", 0, false, 0.0, true },
+            { "fec", 5, false, 0.02, false },
+            { "nack", 0, true, 0.02, true },
+            { "fec+nack", 5, true, 0.05, true },
+        };
+
+        std::printf("%-9s %5s %9s %9s %6s %6s %6s %6s %10s %10s %10s %10s %9s\n", "transport", "loss", "delivered", "corrupted",
+                    "lost", "fec", "resent", "dgram", "pack p50", "pack p99", "e2e p50", "e2e p99", "Mbit/s");
+
+        bool passed = true;
+        for (const Scenario& scenario : scenarios)
+        {
+            StreamTransportConfig transport;
+            transport.fec_group = scenario.fec_group;
+            transport.retransmit = scenario.retransmit;
+
+            StreamCheckResult result;
+            RunStreamScenario(units, frames, fps, transport, scenario.loss, result);
+
+            const double mbits = result.seconds > 0 ? result.sender.transport.bytes * 8.0 / result.seconds / 1e6 : 0.0;
+            std::printf("%-9s %4.0f%% %4d/%-4d %9d %6llu %6llu %6llu %6llu %8.3fms %8.3fms %8.2fms %8.2fms %9.1f\n",
+                        scenario.name, scenario.loss * 100.0, result.delivered, frames, result.corrupted,
+                        static_cast<unsigned long long>(result.receiver.lost), static_cast<unsigned long long>(result.receiver.recovered_fec),
+                        static_cast<unsigned long long>(result.sender.transport.retransmitted),
+                        static_cast<unsigned long long>(result.sender.transport.datagrams),
+                        result.sender.packetize_p50_ms, result.sender.packetize_p99_ms,
+                        result.end_to_end.GetPercentileMs(50.0), result.end_to_end.GetPercentileMs(99.0), mbits);
+
+            // FEC alone can't repair two losses in one group, so a few access units may go missing,
+            // but nothing damaged may get through
+            const bool complete = scenario.must_deliver_all ? result.delivered == frames : result.delivered * 100 >= frames * 95;
+            const bool repaired = scenario.loss == 0.0 ||
+                                  ((scenario.fec_group == 0 || result.receiver.recovered_fec > 0) &&
+                                   (!scenario.retransmit || result.sender.transport.retransmitted > 0));
+            passed &= complete && repaired && result.corrupted == 0;
+        }
+
+        std::printf("%s\n", passed ? "PASS" : "FAIL");
+        return passed ? 0 : 1;
+    }
+
+    // Minimal H.264 SPS (baseline, POC type 2) for the given picture size, as a NAL with header
+    std::vector<uint8_t> MakeH264Sps(int width, int height)
+    {
+        std::vector<uint8_t> rbsp = { 66, 0, 40 };
+        uint32_t bits = 0;
+        int bit_count = 0;
+        auto put = [&](uint32_t value, int count)
+        {
+            for (int i = count - 1; i >= 0; --i)
+            {
+                bits = (bits << 1) | ((value >> i) & 1);
+                if (++bit_count == 8)
+                {
+                    rbsp.push_back(static_cast<uint8_t>(bits));
+                    bits = 0;
+                    bit_count = 0;
+                }
+            }
+        };
+        auto put_ue = [&](uint32_t value)
+        {
+            int length = 0;
+            while ((value + 1) >> (length + 1)) ++length;
+            put(0, length);
+            put(value + 1, length + 1);
+        };
+
+        const int mbs_x = (width + 15) / 16;
+        const int mbs_y = (height + 15) / 16;
+        put_ue(0);                  // seq_parameter_set_id
+        put_ue(0);                  // log2_max_frame_num_minus4
+        put_ue(2);                  // pic_order_cnt_type
+        put_ue(1);                  // max_num_ref_frames
+        put(0, 1);                  // gaps_in_frame_num_value_allowed_flag
+        put_ue(mbs_x - 1);
+        put_ue(mbs_y - 1);
+        put(1, 1);                  // frame_mbs_only_flag
+        put(1, 1);                  // direct_8x8_inference_flag
+        const bool crop = mbs_x * 16 != width || mbs_y * 16 != height;
+        put(crop ? 1 : 0, 1);
+        if (crop)
+        {
+            put_ue(0);
+            put_ue((mbs_x * 16 - width) / 2);
+            put_ue(0);
+            put_ue((mbs_y * 16 - height) / 2);
+        }
+        put(0, 1);                  // vui_parameters_present_flag
+        put(1, 1);                  // rbsp_stop_one_bit
+        if (bit_count > 0) put(0, 8 - bit_count);
+
+        std::vector<uint8_t> nal = { 0x67 };
+        int zeros = 0;
+        for (uint8_t byte : rbsp)
+        {
+            if (zeros >= 2 && byte <= 3)
+            {
+                nal.push_back(3);
+                zeros = 0;
+            }
+            nal.push_back(byte);
+            zeros = byte == 0 ? zeros + 1 : 0;
+        }
+        return nal;
+    }
+
+    // Length-prefixed H.264 samples with a keyframe every two seconds plus irregular scene cuts,
+    // variable frame durations like an idle desktop, and a resolution change two thirds in.
+    // Sample bytes are regenerated from the index, so nothing but the layout is held in memory.
+    struct ClipFixture
+    {
+        static constexpr uint32_t kTimescale = 90000;
+
+        std::vector<uint32_t> payload_sizes;
+        std::vector<uint32_t> durations;
+        std::vector<uint8_t> keyframes;
+        uint64_t switch_sample = 0;
+        std::vector<uint8_t> sps[2];
+        std::vector<uint8_t> pps = { 0x68, 0xCE, 0x38, 0x80 };
+
+        void Generate(int frames)
+        {
+            uint32_t state = 777;
+            auto next = [&]() { state = state * 1664525u + 1013904223u; return state >> 8; };
+            const uint32_t frame_durations[] = { 1500, 1500, 1500, 1500, 1500, 1500, 3000, 4500, 1501, 90000 };
+
+            sps[0] = MakeH264Sps(1920, 1080);
+            sps[1] = MakeH264Sps(1366, 768);
+            payload_sizes.resize(frames);
+            durations.resize(frames);
+            keyframes.resize(frames);
+
+            uint32_t since_keyframe = 0;
+            for (int i = 0; i < frames; ++i)
+            {
+                const bool scene_cut = next() % 97 == 0;
+                keyframes[i] = i == 0 || since_keyframe >= 120 || scene_cut;
+                if (!switch_sample && i >= frames * 2 / 3 && keyframes[i] && i > 0) switch_sample = i;
+                since_keyframe = keyframes[i] ? 1 : since_keyframe + 1;
+                payload_sizes[i] = keyframes[i] ? 30000 + next() % 30000 : 500 + next() % 8000;
+                durations[i] = frame_durations[next() % 10];
+            }
+        }
+
+        void GetSample(uint64_t index, std::vector<uint8_t>& data) const
+        {
+            data.clear();
+            auto append_nal = [&](const uint8_t* nal, size_t size)
+            {
+                const uint8_t length[4] = { static_cast<uint8_t>(size >> 24), static_cast<uint8_t>(size >> 16),
+                                            static_cast<uint8_t>(size >> 8), static_cast<uint8_t>(size) };
+                data.insert(data.end(), length, length + 4);
+                data.insert(data.end(), nal, nal + size);
+            };
+
+            if (keyframes[index])
+            {
+                const std::vector<uint8_t>& active_sps = sps[switch_sample && index >= switch_sample ? 1 : 0];
+                append_nal(active_sps.data(), active_sps.size());
+                append_nal(pps.data(), pps.size());
+            }
+
+            std::vector<uint8_t> slice(payload_sizes[index]);
+            slice[0] = keyframes[index] ? 0x65 : 0x41;
+            uint32_t state = static_cast<uint32_t>(index) * 2654435761u + 1;
+            for (size_t i = 1; i < slice.size(); ++i)
+            {
+                state = state * 1664525u + 1013904223u;
+                slice[i] = static_cast<uint8_t>(state >> 24);
+            }
+            append_nal(slice.data(), slice.size());
+        }
+
+        bool Write(const std::filesystem::path& path) const
+        {
+            SequenceInfo info;
+            if (!NalUnits::ParseSps(NalCodec::H264, sps[0].data(), sps[0].size(), info)) return false;
+
+            Mp4Writer writer(kTimescale);
+            if (!writer.Open(path)) return false;
+            writer.SetVideoFormat(info.width, info.height, NalUnits::BuildSampleEntry(NalCodec::H264, info, {}, sps[0], pps));
+
+            std::vector<uint8_t> data;
+            for (uint64_t i = 0; i < durations.size(); ++i)
+            {
+                GetSample(i, data);
+                if (!writer.WriteSample(data.data(), data.size(), durations[i], keyframes[i] != 0)) return false;
+            }
+            return writer.Close();
+        }
+    };
+
+    // Checks one clip against the fixture: it must open on the last keyframe at or before the
+    // start, hold the source samples unchanged and end at the first sample reaching the end time,
+    // unless the resolution changes first
+    bool VerifyClip(const ClipFixture& fixture, const std::filesystem::path& clip_path, const ClipOptions& options,
+                    const ClipResult& result, std::string& problem)
+    {
+        const uint64_t start_time = static_cast<uint64_t>(options.start_seconds * ClipFixture::kTimescale);
+        const uint64_t end_time = start_time + static_cast<uint64_t>(options.duration_seconds * ClipFixture::kTimescale);
+
+        uint64_t first = 0;
+        uint64_t first_time = 0;
+        uint64_t time = 0;
+        for (uint64_t i = 0; i < fixture.durations.size() && time <= start_time; time += fixture.durations[i++])
+        {
+            if (fixture.keyframes[i])
+            {
+                first = i;
+                first_time = time;
+            }
+        }
+        const uint64_t limit = first < fixture.switch_sample ? fixture.switch_sample : fixture.durations.size();
+
+        Mp4Reader clip;
+        if (!clip.Open(clip_path))
+        {
+            problem = "clip does not open: " + clip.GetError();
+            return false;
+        }
+
+        const int expected_width = first < fixture.switch_sample ? 1920 : 1366;
+        if (result.width != expected_width)
+        {
+            problem = "wrong resolution segment";
+            return false;
+        }
+
+        std::vector<uint8_t> expected;
+        std::vector<uint8_t> actual;
+        time = first_time;
+        uint64_t count = 0;
+        for (uint64_t i = first; i < limit && time < end_time; time += fixture.durations[i++], ++count)
+        {
+            if (count >= clip.GetSampleCount())
+            {
+                problem = "clip ends early at sample " + std::to_string(count);
+                return false;
+            }
+            fixture.GetSample(i, expected);
+            const Mp4Sample& sample = clip.GetSample(count);
+            if (!clip.ReadSample(count, actual) || actual != expected || sample.duration != fixture.durations[i]
+                || sample.is_keyframe != (fixture.keyframes[i] != 0))
+            {
+                problem = "sample " + std::to_string(count) + " differs from source sample " + std::to_string(i);
+                return false;
+            }
+        }
+
+        if (clip.GetSampleCount() != count || result.samples != count)
+        {
+            problem = "clip has " + std::to_string(clip.GetSampleCount()) + " samples, expected " + std::to_string(count);
+            return false;
+        }
+        if (!clip.GetSample(0).is_keyframe || std::abs(result.start_seconds - static_cast<double>(first_time) / ClipFixture::kTimescale) > 1e-9)
+        {
+            problem = "clip does not open on the keyframe before the start";
+            return false;
+        }
+        if (result.stopped_at_resolution_change != (first + count == fixture.switch_sample && time < end_time))
+        {
+            problem = "resolution change not reported";
+            return false;
+        }
+
+        KeyframeIndex clip_index;
+        if (!clip_index.Load(KeyframeIndex::SidecarPath(clip_path)) || !clip_index.Matches(clip_path) || clip_index.GetSampleCount() != count)
+        {
+            problem = "clip has no valid sidecar index";
+            return false;
+        }
+        return true;
+    }
+
+    int RunClipCheck(int frames, const std::filesystem::path& raw_directory)
+    {
+        const std::filesystem::path source_path = raw_directory / "clip_check.mp4";
+        const std::filesystem::path clip_path = raw_directory / "clip_check_clip.mp4";
+        const std::filesystem::path sidecar = KeyframeIndex::SidecarPath(source_path);
+
+        ClipFixture fixture;
+        fixture.Generate(std::max(frames, 240));
+        if (!fixture.Write(source_path))
+        {
+            std::cerr << "Cannot write " << source_path.string() << std::endl;
+            return 1;
+        }
+        std::filesystem::remove(sidecar);
+
+        const uint64_t source_bytes = std::filesystem::file_size(source_path);
+        uint64_t source_keyframes = 0;
+        uint64_t source_duration = 0;
+        for (size_t i = 0; i < fixture.durations.size(); ++i)
+        {
+            source_keyframes += fixture.keyframes[i];
+            source_duration += fixture.durations[i];
+        }
+        const double source_seconds = static_cast<double>(source_duration) / ClipFixture::kTimescale;
+
+        // Index built by the recorder at finalize, then reloaded the way the clip tool sees it
+        auto index_start = std::chrono::steady_clock::now();
+        KeyframeIndex built;
+        bool passed = built.Build(source_path) && built.Save(sidecar);
+        const double index_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - index_start).count();
+
+        KeyframeIndex loaded;
+        passed = passed && loaded.Load(sidecar) && loaded.Matches(source_path) && !loaded.Matches(clip_path);
+        passed = passed && loaded.GetKeyframes().size() == source_keyframes && loaded.GetDuration() == source_duration;
+        passed = passed && loaded.GetSegments().size() == 2 && loaded.GetSegments()[1].first_sample == fixture.switch_sample
+                        && loaded.GetSegments()[0].width == 1920 && loaded.GetSegments()[0].height == 1080
+                        && loaded.GetSegments()[1].width == 1366 && loaded.GetSegments()[1].height == 768;
+        for (size_t i = 0; passed && i < built.GetKeyframes().size(); ++i)
+        {
+            const KeyframeEntry& a = built.GetKeyframes()[i];
+            const KeyframeEntry& b = loaded.GetKeyframes()[i];
+            passed = a.sample == b.sample && a.offset == b.offset && a.decode_time == b.decode_time && fixture.keyframes[a.sample];
+        }
+        const uint64_t sidecar_bytes = std::filesystem::exists(sidecar) ? std::filesystem::file_size(sidecar) : 0;
+
+        std::printf("source      %.1f MB, %zu samples, %.1f s, %llu keyframes, switch at sample %llu\n", source_bytes / 1e6,
+                    fixture.durations.size(), source_seconds, static_cast<unsigned long long>(source_keyframes),
+                    static_cast<unsigned long long>(fixture.switch_sample));
+        std::printf("index       %llu bytes, built in %.2f ms, %s\n", static_cast<unsigned long long>(sidecar_bytes), index_ms,
+                    passed ? "round trip ok" : "MISMATCH");
+
+        // Random ranges, plus the edges: the very start, a range across the resolution change and one past the end
+        uint32_t state = 4242;
+        auto next = [&]() { state = state * 1664525u + 1013904223u; return state >> 8; };
+        std::vector<std::pair<double, double>> ranges = { { 0.0, 1.0 }, { source_seconds - 0.01, 30.0 } };
+        uint64_t switch_time = 0;
+        for (uint64_t i = 0; i < fixture.switch_sample; ++i) switch_time += fixture.durations[i];
+        ranges.emplace_back(static_cast<double>(switch_time) / ClipFixture::kTimescale - 3.0, 10.0);
+        for (int i = 0; i < 40; ++i)
+        {
+            ranges.emplace_back(source_seconds * (next() % 10000) / 10000.0, 0.5 + (next() % 2000) / 100.0);
+        }
+
+        std::printf("%-24s %8s %8s %8s %10s %9s  %s\n", "range", "start", "samples", "MB", "ms", "MB/s", "result");
+
+        double total_ms = 0.0;
+        uint64_t total_bytes = 0;
+        int failures = 0;
+        for (size_t i = 0; i < ranges.size(); ++i)
+        {
+            ClipOptions options;
+            options.start_seconds = ranges[i].first;
+            options.duration_seconds = ranges[i].second;
+
+            // The first clip finds no sidecar and must rebuild it
+            if (i == 0) std::filesystem::remove(sidecar);
+
+            ClipResult result;
+            const auto start = std::chrono::steady_clock::now();
+            const bool extracted = Mp4Clip::Extract(source_path, clip_path, options, result);
+            const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            std::string problem;
+            bool ok = extracted && VerifyClip(fixture, clip_path, options, result, problem);
+            if (extracted && result.index_rebuilt != (i == 0))
+            {
+                ok = false;
+                problem = i == 0 ? "missing sidecar was not rebuilt" : "valid sidecar was rebuilt";
+            }
+            if (!extracted) problem = result.error;
+
+            total_ms += ms;
+            total_bytes += result.bytes;
+            failures += ok ? 0 : 1;
+            if (i < 3 || !ok || i % 8 == 0)
+            {
+                char label[64];
+                std::snprintf(label, sizeof(label), "%.2f s + %.2f s", options.start_seconds, options.duration_seconds);
+                std::printf("%-24s %7.2fs %8llu %8.2f %10.2f %9.0f  %s\n", label, result.start_seconds,
+                            static_cast<unsigned long long>(result.samples), result.bytes / 1e6, ms,
+                            ms > 0 ? result.bytes / 1e3 / ms : 0.0, ok ? (result.stopped_at_resolution_change ? "ok (cut at resolution change)" : "ok") : problem.c_str());
+            }
+        }
+
+        std::printf("%zu clips, %d failed, %.2f ms mean, %.0f MB/s copied\n", ranges.size(), failures, total_ms / ranges.size(),
+                    total_ms > 0 ? total_bytes / 1e3 / total_ms : 0.0);
+
+        std::filesystem::remove(source_path);
+        std::filesystem::remove(sidecar);
+        std::filesystem::remove(clip_path);
+        std::filesystem::remove(KeyframeIndex::SidecarPath(clip_path));
+
+        passed &= failures == 0;
+        std::printf("%s\n", passed ? "PASS" : "FAIL");
+        return passed ? 0 : 1;
+    }
+
+    // Per-frame tallies of one pipeline thread, from the end of warm-up on
+    struct AllocCheckThread
+    {
+        uint64_t frames = 0;
+        uint64_t allocating_frames = 0;
+        uint64_t allocations = 0;
+        uint64_t bytes = 0;
+        uint64_t max_allocations = 0;
+
+        void Record(const AllocationTally& tally)
+        {
+            ++frames;
+            allocating_frames += tally.allocations > 0 ? 1 : 0;
+            allocations += tally.allocations;
+            bytes += tally.bytes;
+            max_allocations = std::max(max_allocations, tally.allocations);
+        }
+    };
+
+    struct AllocCheckStage
+    {
+        TraceStage stage;
+        double budget;              // Bytes per frame, in units of one BGRA frame
+    };
+
+    // What one alloc-check pass runs alongside the frame queue and scene detection
+    struct AllocCheckPath
+    {
+        const char* name;
+        RawPixelFormat pixel_format;    // Of the raw writer at the end
+        bool tone_map;                  // The source delivers scRGB, tone-mapped on the capture thread
+        bool taps;                      // Preview tap, snapshots requested while recording, a shared-frame ring
+        bool filter_chain;              // Crop and half-size resize, converted to the writer's format in the same pass
+        bool simulcast;                 // Fanned out to the writer and a half-size rendition, each on a worker
+        std::vector<AllocCheckStage> budgets;
+    };
+
+    // Forwards to a sink and tallies the thread that calls it (a simulcast worker) as the check tallies
+    // capture and encode: allocations from one call to the next, copy counters from the end of warm-up on
+    class AllocCheckSink : public FrameSink
+    {
+    public:
+        AllocCheckSink(std::shared_ptr<FrameSink> sink, uint64_t warmup) : sink_(std::move(sink)), warmup_(warmup) {}
+
+        bool ProcessFrame(const std::vector<uint8_t>& image_buffer, int width, int height) override
+        {
+            return ProcessFrame(FrameDescriptor::Packed(image_buffer.data(), FrameFormat::Bgra, width, height), DirtyRegion::Full(width, height));
+        }
+
+        bool ProcessFrame(const FrameDescriptor& frame, const DirtyRegion& dirty) override
+        {
+            const uint64_t index = calls_++;
+            if (index > warmup_) thread_.Record(scope_.Get());
+            scope_ = AllocationScope();
+            if (index == warmup_) Snapshot(start_);
+            const bool result = sink_->ProcessFrame(frame, dirty);
+            Snapshot(end_);
+            return result;
+        }
+
+        bool Close() override { return sink_->Close(); }
+
+        // After Close
+        const AllocCheckThread& GetThread() const { return thread_; }
+        uint64_t GetCopied(TraceStage stage) const { return end_[static_cast<int>(stage)] - start_[static_cast<int>(stage)]; }
+
+    private:
+        static void Snapshot(uint64_t* bytes)
+        {
+            for (int i = 0; i < kTraceStageCount; ++i) bytes[i] = HotPathCounters::GetThreadCopyBytes(static_cast<TraceStage>(i));
+        }
+
+        std::shared_ptr<FrameSink> sink_;
+        uint64_t warmup_;
+        uint64_t calls_ = 0;
+        AllocCheckThread thread_;
+        AllocationScope scope_;
+        uint64_t start_[kTraceStageCount] = {};
+        uint64_t end_[kTraceStageCount] = {};
+    };
+
+    // The recording path on the synthetic source through FramePipeline, the code ScreenRecorder runs
+    // per frame: capture callback -> queue -> encode thread -> sinks. Each thread's allocations are
+    // tallied per frame (from one frame's start to the next, so queue waits are included), and its
+    // copy counters are read at its first and last steady-state frame.
+    bool RunAllocCheckScenario(const AllocCheckPath& path, int width, int height, int frames, const std::filesystem::path& raw_directory)
+    {
+        const int warmup = 30;
+        const uint64_t total = static_cast<uint64_t>(warmup + frames);
+        const double frame_bytes = static_cast<double>(width) * height * 4;
+        const std::filesystem::path raw_path = raw_directory / "alloc_check.zraw";
+        const std::filesystem::path rendition_path = raw_directory / "alloc_check_rendition.zraw";
+        const std::filesystem::path snapshot_path = raw_directory / "alloc_check.png";
+
+        FilterChainConfig filters;
+        filters.crop = DirtyRect{ width / 16, height / 16, width - width / 8, height - height / 8 };
+        filters.output_width = width / 2;
+        filters.output_height = height / 2;
+        const int output_width = path.filter_chain ? filters.output_width : width;
+        const int output_height = path.filter_chain ? filters.output_height : height;
+
+        MemoryBudget budget(256ull * 1024 * 1024);
+        FrameQueue queue(budget, 4, BackpressurePolicy::Block);
+
+        auto writer = std::make_shared<RawVideoWriter>(output_width, output_height, 60, path.pixel_format, raw_path);
+        writer->SetMemoryBudget(&budget);
+        if (!writer->Initialize())
+        {
+            std::cerr << "Cannot write " << raw_path.string() << std::endl;
+            return false;
+        }
+
+        std::shared_ptr<FrameSink> sink = writer;
+        std::vector<std::shared_ptr<AllocCheckSink>> workers;
+        if (path.simulcast)
+        {
+            auto rendition_writer = std::make_shared<RawVideoWriter>(width / 2, height / 2, 60, path.pixel_format, rendition_path);
+            rendition_writer->SetMemoryBudget(&budget);
+            if (!rendition_writer->Initialize())
+            {
+                std::cerr << "Cannot write " << rendition_path.string() << std::endl;
+                return false;
+            }
+
+            auto simulcast = std::make_shared<SimulcastSink>();
+            simulcast->SetMemoryBudget(&budget);
+            workers.push_back(std::make_shared<AllocCheckSink>(writer, warmup));
+            workers.push_back(std::make_shared<AllocCheckSink>(rendition_writer, warmup));
+            simulcast->AddRendition(workers[0]);
+            simulcast->AddRendition(workers[1], width / 2, height / 2);
+            queue.SetSinkHeldFrames(simulcast->GetHeldFrames());
+            sink = simulcast;
+        }
+        if (path.filter_chain)
+        {
+            const FrameFormat format = path.pixel_format == RawPixelFormat::NV12 ? FrameFormat::Nv12 : FrameFormat::Bgra;
+            auto filter_chain = std::make_shared<FilterChainSink>(sink, filters, format);
+            filter_chain->SetMemoryBudget(&budget);
+            sink = filter_chain;
+        }
+
+        PreviewTap preview_tap(1000);
+        SnapshotWriter snapshots(1);
+        snapshots.SetMemoryBudget(&budget);
+        const std::string ring_name = "alloc_check." + std::to_string(static_cast<unsigned long long>(std::chrono::steady_clock::now().time_since_epoch().count()));
+        SharedFramePublisher publisher(ring_name, 4);
+        publisher.SetMemoryBudget(&budget);
+        if (path.taps && !publisher.Open(width, height))
+        {
+            std::cerr << "Cannot create shared memory " << ring_name << std::endl;
+            return false;
+        }
+
+        FramePipeline pipeline(budget);
+        pipeline.SetSink(sink.get());
+        pipeline.SetToneMap(path.tone_map);
+        pipeline.SetSceneDetection(SceneChangeConfig(), [] {});
+        if (path.taps)
+        {
+            pipeline.SetPreviewTap(&preview_tap);
+            pipeline.SetSnapshotWriter(&snapshots);
+            pipeline.SetSharedPublisher(&publisher);
+        }
+        pipeline.Start(&queue, std::chrono::milliseconds(16));
+
+        AllocCheckThread capture;
+        AllocCheckThread encode;
+        uint64_t capture_start[kTraceStageCount] = {};
+        uint64_t capture_end[kTraceStageCount] = {};
+        uint64_t encode_start[kTraceStageCount] = {};
+        uint64_t encode_end[kTraceStageCount] = {};
+        auto snapshot = [](uint64_t* bytes)
+        {
+            for (int i = 0; i < kTraceStageCount; ++i) bytes[i] = HotPathCounters::GetThreadCopyBytes(static_cast<TraceStage>(i));
+        };
+
+        // The source thread renders and diffs before each callback, so the tally between two
+        // callbacks is one whole frame
+        uint64_t callbacks = 0;
+        std::atomic<bool> source_done{ false };
+        AllocationScope capture_scope;
+        SyntheticFrameSource source(width, height, 0);
+        source.SetHdrOutput(path.tone_map);
+        source.SetOutputCallback([&](const FrameDescriptor& frame, const DirtyRegion& dirty)
+        {
+            const uint64_t index = callbacks++;
+            if (index > warmup && index <= total) capture.Record(capture_scope.Get());
+            capture_scope = AllocationScope();
+            if (index == warmup) snapshot(capture_start);
+            if (index == total)
+            {
+                snapshot(capture_end);
+                queue.Close();
+                source_done.store(true, std::memory_order_release);
+            }
+            if (index >= total) return;
+
+            pipeline.OnFrameCaptured(frame, dirty);
+        });
+
+        std::thread encode_thread([&]
+        {
+            QueuedFrame frame;
+            uint64_t index = 0;
+            AllocationScope scope;
+            while (queue.Pop(frame))
+            {
+                if (index == warmup) snapshot(encode_start);
+                pipeline.EncodeQueued(frame);
+                if (++index > warmup) encode.Record(scope.Get());
+                scope = AllocationScope();
+            }
+            snapshot(encode_end);
+        });
+
+        // Snapshots are asked for from outside the recording threads, as the UI would
+        source.StartCapture();
+        while (path.taps && !source_done.load(std::memory_order_acquire))
+        {
+            snapshots.Request(snapshot_path.wstring());
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        encode_thread.join();
+        source.StopCapture();
+        sink->Close();
+        publisher.Close();
+        const std::vector<SnapshotResult> snapshot_results = snapshots.GetResults();
+        std::filesystem::remove(raw_path);
+        std::filesystem::remove(rendition_path);
+        std::filesystem::remove(snapshot_path);
+
+        const FramePipelineStats stats = pipeline.GetStats();
+        bool passed = source_done.load(std::memory_order_acquire) && capture.frames == static_cast<uint64_t>(frames)
+                      && encode.frames == static_cast<uint64_t>(frames) && stats.frames_failed == 0;
+        std::vector<std::pair<std::string, const AllocCheckThread*>> threads = { { "capture", &capture }, { "encode", &encode } };
+        for (size_t i = 0; i < workers.size(); ++i) threads.push_back({ "worker " + std::to_string(i), &workers[i]->GetThread() });
+        for (const auto& [thread_name, thread] : threads)
+        {
+            std::printf("%-10s %-8s %8llu %10llu %12llu %12llu %10llu\n", path.name, thread_name.c_str(),
+                        static_cast<unsigned long long>(thread->frames), static_cast<unsigned long long>(thread->allocating_frames),
+                        static_cast<unsigned long long>(thread->allocations), static_cast<unsigned long long>(thread->bytes),
+                        static_cast<unsigned long long>(thread->max_allocations));
+            passed = passed && thread->allocating_frames == 0 && thread->frames > 0;
+        }
+
+        if (path.taps)
+        {
+            size_t saved = 0;
+            for (const SnapshotResult& result : snapshot_results) saved += result.saved ? 1 : 0;
+            std::printf("%-10s snapshots %zu / %zu saved, shared ring %llu frames published\n", path.name, saved, snapshot_results.size(),
+                        static_cast<unsigned long long>(publisher.GetStats().frames_published));
+            passed = passed && !snapshot_results.empty() && saved == snapshot_results.size()
+                     && publisher.GetStats().frames_published == stats.frames_encoded;
+        }
+
+        for (const AllocCheckStage& stage : path.budgets)
+        {
+            const int i = static_cast<int>(stage.stage);
+            uint64_t copied = capture_end[i] - capture_start[i] + encode_end[i] - encode_start[i];
+            for (const std::shared_ptr<AllocCheckSink>& worker : workers) copied += worker->GetCopied(stage.stage);
+            const double per_frame = static_cast<double>(copied) / frames / frame_bytes;
+            const bool ok = per_frame <= stage.budget + 1e-9;
+            std::printf("%-10s %-10s %8.3f / %-6.3f frames copied per frame  %s\n", path.name, FrameTracer::GetStageName(stage.stage),
+                        per_frame, stage.budget, ok ? "ok" : "OVER BUDGET");
+            passed = passed && ok;
+        }
+        return passed;
+    }
+
+    int RunAllocCheck(int frames, const std::filesystem::path& raw_directory)
+    {
+        if (!HotPathCounters::kEnabled)
+        {
+            std::cerr << "--alloc-check needs a build with SCREENRECORDER_HOT_PATH_COUNTERS defined" << std::endl;
+            return 1;
+        }
+
+        const int width = 640;
+        const int height = 360;
+
+        // Budgets in BGRA frames: the readback, the dirty part into the tracker's reference plus the
+        // one copy into the queue, at most a full conversion and one slot of each stored format.
+        // scRGB is two BGRA frames' worth. The shared ring takes at most one more copy; the fan-out
+        // and pinned snapshots take none.
+        const double frame_bytes = static_cast<double>(width) * height * 4;
+        auto slot = [&](uint64_t bytes) { return static_cast<double>((bytes + kRawSlotAlignment - 1) / kRawSlotAlignment * kRawSlotAlignment) / frame_bytes; };
+        const uint64_t pixels = static_cast<uint64_t>(width) * height;
+        const uint64_t half_pixels = pixels / 4;
+
+        const std::vector<AllocCheckPath> paths = {
+            { "BGRA", RawPixelFormat::BGRA, false, true, false, false,
+              { { TraceStage::Readback, 1.0 }, { TraceStage::Copy, 3.0 }, { TraceStage::Convert, 0.0 }, { TraceStage::DiskWrite, slot(pixels * 4) } } },
+            { "NV12", RawPixelFormat::NV12, false, false, false, false,
+              { { TraceStage::Readback, 1.0 }, { TraceStage::Copy, 2.0 }, { TraceStage::Convert, 1.0 }, { TraceStage::DiskWrite, slot(pixels * 3 / 2) } } },
+            { "tonemap", RawPixelFormat::BGRA, true, false, false, false,
+              { { TraceStage::Readback, 2.0 }, { TraceStage::Copy, 3.0 }, { TraceStage::Convert, 2.0 }, { TraceStage::DiskWrite, slot(pixels * 4) } } },
+            { "filter", RawPixelFormat::NV12, false, false, true, false,
+              { { TraceStage::Readback, 1.0 }, { TraceStage::Copy, 2.0 + half_pixels * 3 / 2 / frame_bytes }, { TraceStage::Convert, half_pixels * 3 / 2 / frame_bytes },
+                { TraceStage::DiskWrite, slot(half_pixels * 3 / 2) } } },
+            { "simulcast", RawPixelFormat::BGRA, false, false, false, true,
+              { { TraceStage::Readback, 1.0 }, { TraceStage::Copy, 2.0 }, { TraceStage::Convert, 0.25 },
+                { TraceStage::DiskWrite, slot(pixels * 4) + slot(half_pixels * 4) } } },
+        };
+
+        std::printf("%-10s %-8s %8s %10s %12s %12s %10s\n", "path", "thread", "frames", "allocating", "allocations", "bytes", "max/frame");
+        bool passed = true;
+        for (const AllocCheckPath& path : paths)
+        {
+            passed = RunAllocCheckScenario(path, width, height, frames, raw_directory) && passed;
+        }
+
+        std::printf("%s\n", passed ? "PASS" : "FAIL");
+        return passed ? 0 : 1;
+    }
+
+    // Stands in for VideoEncoder behind the fan-out: holds on to the sample the way the encoder does
+    // (wrapped when owned, copied otherwise) and converts the dirty part to NV12 as the MFT's input
+    // stage would. Keeps every frame it was given when collecting, for the accuracy check.
+    class RenditionSink : public FrameSink
+    {
+    public:
+        explicit RenditionSink(bool collect = false) : collect_(collect) {}
+
+        bool ProcessFrame(const std::vector<uint8_t>& image_buffer, int width, int height) override
+        {
+            return ProcessFrame(FrameDescriptor::Packed(image_buffer.data(), FrameFormat::Bgra, width, height), DirtyRegion::Full(width, height));
+        }
+
+        bool ProcessFrame(const FrameDescriptor& frame, const DirtyRegion& dirty) override
+        {
+            const size_t row_bytes = frame.GetRowBytes(0);
+            RetainedFrame retained = RetainFrame(frame, pool_);
+            if (retained.fill) FrameKernels::CopyImage(retained.fill, row_bytes, frame.planes[0].data, frame.planes[0].pitch, row_bytes, frame.height);
+
+            const size_t pixels = static_cast<size_t>(frame.width) * frame.height;
+            DirtyRegion region = dirty.ForFrame(frame.width, frame.height);
+            if (frame.width != width_ || frame.height != height_)
+            {
+                nv12_.resize(pixels * 3 / 2);
+                width_ = frame.width;
+                height_ = frame.height;
+                region = DirtyRegion::Full(width_, height_);
+            }
+            FrameKernels::ConvertBgraToNv12Region(retained.data, row_bytes, nv12_.data(), width_, nv12_.data() + pixels, width_, region);
+
+            if (collect_) frames_.emplace_back(retained.data, retained.data + row_bytes * frame.height);
+            ++frame_count_;
+            return true;
+        }
+
+        bool Close() override { return true; }
+
+        uint64_t GetFrameCount() const { return frame_count_; }
+        int GetWidth() const { return width_; }
+        int GetHeight() const { return height_; }
+        const std::vector<std::vector<uint8_t>>& GetFrames() const { return frames_; }
+
+    private:
+        bool collect_;
+        FramePool pool_;
+        std::vector<uint8_t> nv12_;
+        int width_ = 0;
+        int height_ = 0;
+        uint64_t frame_count_ = 0;
+        std::vector<std::vector<uint8_t>> frames_;
+    };
+
+    double ProcessCpuSeconds()
+    {
+#ifdef _WIN32
+        FILETIME creation_time, exit_time, kernel_time, user_time;
+        GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time);
+        auto to_100ns = [](const FILETIME& ft) { return (static_cast<uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime; };
+        return (to_100ns(kernel_time) + to_100ns(user_time)) / 1e7;
+#else
+        timespec ts{};
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+    }
+
+    // Random edits to a 640x360 frame, handed over alternately owned and borrowed at a padded pitch,
+    // fanned out to a full-size, two downscaled (one odd) and one upscaled rendition. Every frame
+    // each rendition got, scaled only where dirty, must equal scaling the whole frame.
+    bool RunSimulcastAccuracy(int frames)
+    {
+        const int width = 640;
+        const int height = 360;
+        const ptrdiff_t pitch = width * 4 + 128;
+        const std::pair<int, int> sizes[] = { { 0, 0 }, { 320, 180 }, { 427, 241 }, { 1000, 563 } };
+
+        std::vector<uint8_t> bgra;
+        FillPattern(bgra, width, height, pitch, 90);
+        uint32_t state = 91;
+        auto next = [&](int limit) { state = state * 1664525u + 1013904223u; return static_cast<int>((state >> 8) % static_cast<uint32_t>(limit)); };
+
+        std::vector<std::shared_ptr<RenditionSink>> sinks;
+        std::vector<std::vector<uint8_t>> sources;
+        {
+            SimulcastSink simulcast(nullptr, 2);
+            for (const auto& size : sizes)
+            {
+                sinks.push_back(std::make_shared<RenditionSink>(true));
+                simulcast.AddRendition(sinks.back(), size.first, size.second);
+            }
+
+            for (int frame = 0; frame < frames; ++frame)
+            {
+                DirtyRegion changed = DirtyRegion::Full(width, height);
+                if (frame > 0)
+                {
+                    changed = DirtyRegion(width, height);
+                    const int rects = next(5);
+                    for (int i = 0; i < rects; ++i)
+                    {
+                        const int rect_width = 1 + next(i == 0 ? width / 3 : 24);
+                        const int rect_height = 1 + next(i == 0 ? height / 3 : 16);
+                        const DirtyRect rect = { next(width - rect_width + 1), next(height - rect_height + 1), rect_width, rect_height };
+                        for (int y = rect.y; y < rect.y + rect.height; ++y)
+                        {
+                            uint8_t* row = bgra.data() + y * pitch + static_cast<ptrdiff_t>(rect.x) * 4;
+                            for (int x = 0; x < rect.width * 4; ++x) row[x] = static_cast<uint8_t>(next(256));
+                        }
+                        changed.Add(rect);
+                    }
+                }
+
+                auto packed = std::make_shared<std::vector<uint8_t>>(static_cast<size_t>(width) * height * 4);
+                FrameKernels::CopyImage(packed->data(), width * 4, bgra.data(), pitch, width * 4, height);
+                sources.push_back(*packed);
+
+                FrameDescriptor descriptor = FrameDescriptor::Packed(packed->data(), FrameFormat::Bgra, width, height);
+                if (frame % 2 == 0)
+                {
+                    descriptor.owner = packed;
+                }
+                else
+                {
+                    descriptor = FrameDescriptor::Packed(bgra.data(), FrameFormat::Bgra, width, height);
+                    descriptor.planes[0].pitch = pitch;
+                }
+                simulcast.ProcessFrame(descriptor, changed);
+            }
+            simulcast.Close();
+        }
+
+        bool passed = true;
+        std::printf("%-12s %8s %10s\n", "rendition", "frames", "mismatched");
+        std::vector<uint8_t> reference;
+        for (const std::shared_ptr<RenditionSink>& sink : sinks)
+        {
+            const int out_width = sink->GetWidth();
+            const int out_height = sink->GetHeight();
+            int mismatched = 0;
+            for (size_t i = 0; i < sink->GetFrames().size() && i < sources.size(); ++i)
+            {
+                const std::vector<uint8_t>* expected = &sources[i];
+                if (out_width != width || out_height != height)
+                {
+                    reference.resize(static_cast<size_t>(out_width) * out_height * 4);
+                    FrameKernels::ScaleBgraBilinear(sources[i].data(), width * 4, width, height, reference.data(), out_width * 4, out_width, out_height);
+                    expected = &reference;
+                }
+                mismatched += sink->GetFrames()[i] != *expected ? 1 : 0;
+            }
+
+            char size[32];
+            std::snprintf(size, sizeof(size), "%dx%d", out_width, out_height);
+            std::printf("%-12s %8zu %10d\n", size, sink->GetFrames().size(), mismatched);
+            passed = passed && mismatched == 0 && sink->GetFrames().size() == static_cast<size_t>(frames) && out_width % 2 == 0 && out_height % 2 == 0;
+        }
+        return passed;
+    }
+
+    struct SimulcastCost
+    {
+        double cpu_ms = 0.0;        // Per frame, all threads, screen updates excluded
+        double fps = 0.0;
+        bool complete = false;
+    };
+
+    // A 1080p screen with a window dragged across it and a full repaint every 60 frames, recorded
+    // unpaced. One session reads each frame back once and fans it out; the alternative is one
+    // session per output, each with its own readback and encode thread.
+    SimulcastCost RunSimulcastCost(const std::vector<std::pair<int, int>>& sizes, bool separate, int frames)
+    {
+        const int width = 1920;
+        const int height = 1080;
+        const ptrdiff_t surface_pitch = width * 4 + 256;
+        const int box = 320;
+
+        std::vector<uint8_t> surface;
+        FillPattern(surface, width, height, surface_pitch, 95);
+
+        std::vector<std::shared_ptr<RenditionSink>> sinks;
+        std::vector<std::unique_ptr<SimulcastSink>> sessions;
+        for (size_t i = 0; i < sizes.size(); ++i)
+        {
+            if (i == 0 || separate) sessions.push_back(std::make_unique<SimulcastSink>());
+            sinks.push_back(std::make_shared<RenditionSink>());
+            sessions.back()->AddRendition(sinks.back(), sizes[i].first, sizes[i].second);
+        }
+        std::vector<FramePool> pools(sessions.size());
+
+        const int warmup = 10;
+        double screen_cpu = 0.0;
+        double cpu_start = 0.0;
+        auto wall_start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < warmup + frames; ++frame)
+        {
+            if (frame == warmup)
+            {
+                cpu_start = ProcessCpuSeconds();
+                screen_cpu = 0.0;
+                wall_start = std::chrono::steady_clock::now();
+            }
+
+            const double screen_start = ThreadCpuSeconds();
+            DirtyRegion dirty = DirtyRegion::Full(width, height);
+            if (frame % 60 != 0)
+            {
+                const int x = (frame * 7) % (width - box - 8);
+                const int y = (frame * 3) % (height - box - 8);
+                dirty = DirtyRegion(width, height);
+                dirty.Add(DirtyRect{ x, y, box + 8, box + 4 });
+                for (int row = y + 4; row < y + 4 + box; ++row)
+                {
+                    std::memset(surface.data() + row * surface_pitch + static_cast<ptrdiff_t>(x + 8) * 4, frame & 0xff, static_cast<size_t>(box) * 4);
+                }
+            }
+            else
+            {
+                for (int row = 0; row < height; ++row)
+                {
+                    uint8_t* pixels = surface.data() + row * surface_pitch;
+                    for (int i = 0; i < width * 4; ++i) pixels[i] ^= 0x55;
+                }
+            }
+            screen_cpu += ThreadCpuSeconds() - screen_start;
+
+            for (size_t i = 0; i < sessions.size(); ++i)
+            {
+                PooledFrame readback = pools[i].Acquire(static_cast<size_t>(width) * height * 4);
+                FrameKernels::CopyImage(readback->data(), width * 4, surface.data(), surface_pitch, width * 4, height);
+                FrameDescriptor descriptor = FrameDescriptor::Packed(readback->data(), FrameFormat::Bgra, width, height);
+                descriptor.owner = std::move(readback);
+                sessions[i]->ProcessFrame(descriptor, dirty);
+            }
+        }
+        for (const std::unique_ptr<SimulcastSink>& session : sessions) session->Close();
+
+        SimulcastCost cost;
+        const double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+        cost.cpu_ms = (ProcessCpuSeconds() - cpu_start - screen_cpu) * 1e3 / frames;
+        cost.fps = frames / wall_seconds;
+        cost.complete = true;
+        for (const std::shared_ptr<RenditionSink>& sink : sinks) cost.complete = cost.complete && sink->GetFrameCount() == static_cast<uint64_t>(warmup + frames);
+        return cost;
+    }
+
+    int RunSimulcastBenchmark(int frames)
+    {
+        const bool accurate = RunSimulcastAccuracy(std::min(frames, 60));
+
+        // Main output, then the proxies in the order a user would add them
+        const std::vector<std::pair<int, int>> outputs = { { 0, 0 }, { 960, 540 }, { 1280, 720 }, { 640, 360 } };
+
+        std::printf("\n1080p capture, NV12 input prep per rendition (the encode itself is not modelled)\n");
+        std::printf("%-12s %16s %12s %16s %10s %12s\n", "rendition", "simulcast ms/f", "marginal", "separate ms/f", "saved", "fps");
+        bool complete = true;
+        double previous = 0.0;
+        for (size_t count = 1; count <= outputs.size(); ++count)
+        {
+            const std::vector<std::pair<int, int>> sizes(outputs.begin(), outputs.begin() + count);
+            const SimulcastCost simulcast = RunSimulcastCost(sizes, false, frames);
+            const SimulcastCost separate = RunSimulcastCost(sizes, true, frames);
+            complete = complete && simulcast.complete && separate.complete;
+
+            char size[32];
+            if (sizes.back().first == 0) std::snprintf(size, sizeof(size), "1920x1080");
+            else std::snprintf(size, sizeof(size), "+%dx%d", sizes.back().first, sizes.back().second);
+            std::printf("%-12s %16.3f %12.3f %16.3f %9.1f%% %12.1f\n", size, simulcast.cpu_ms, simulcast.cpu_ms - previous, separate.cpu_ms,
+                        separate.cpu_ms > 0 ? (1.0 - simulcast.cpu_ms / separate.cpu_ms) * 100.0 : 0.0, simulcast.fps);
+            previous = simulcast.cpu_ms;
+        }
+
+        const bool passed = accurate && complete;
+        std::printf("%s\n", passed ? "PASS" : "FAIL");
+        return passed ? 0 : 1;
+    }
+
+    // Reference inflate for checking the PNG encoder with nothing of its own: stored and dynamic
+    // Huffman blocks (all the encoder writes), decoded a bit at a time as in zlib's puff
+    class Inflater
+    {
+    public:
+        Inflater(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+        bool Inflate(std::vector<uint8_t>& out)
+        {
+            out.clear();
+            int is_final = 0;
+            while (!is_final)
+            {
+                is_final = Bits(1);
+                const int type = Bits(2);
+                if (type == 0)
+                {
+                    bit_buffer_ = 0;
+                    bit_count_ = 0;
+                    if (position_ + 4 > size_) return false;
+                    const size_t length = data_[position_] | (data_[position_ + 1] << 8);
+                    const size_t complement = data_[position_ + 2] | (data_[position_ + 3] << 8);
+                    position_ += 4;
+                    if (length != (~complement & 0xFFFF) || position_ + length > size_) return false;
+                    out.insert(out.end(), data_ + position_, data_ + position_ + length);
+                    position_ += length;
+                }
+                else if (type != 2 || !InflateDynamicBlock(out))
+                {
+                    return false;
+                }
+                if (overrun_) return false;
+            }
+            return true;
+        }
+
+        size_t GetPosition() const { return position_; }
+
+    private:
+        struct Table
+        {
+            int counts[16];
+            int symbols[288];
+        };
+
+        int Bits(int count)
+        {
+            uint64_t value = bit_buffer_;
+            while (bit_count_ < count)
+            {
+                if (position_ >= size_)
+                {
+                    overrun_ = true;
+                    return 0;
+                }
+                value |= static_cast<uint64_t>(data_[position_++]) << bit_count_;
+                bit_count_ += 8;
+            }
+            bit_buffer_ = value >> count;
+            bit_count_ -= count;
+            return static_cast<int>(value & ((1ull << count) - 1));
+        }
+
+        static void Build(Table& table, const uint8_t* lengths, int count)
+        {
+            int offsets[16] = {};
+            std::fill(std::begin(table.counts), std::end(table.counts), 0);
+            for (int i = 0; i < count; ++i) ++table.counts[lengths[i]];
+            table.counts[0] = 0;
+            for (int length = 1; length < 15; ++length) offsets[length + 1] = offsets[length] + table.counts[length];
+            for (int i = 0; i < count; ++i)
+            {
+                if (lengths[i]) table.symbols[offsets[lengths[i]]++] = i;
+            }
+        }
+
+        int Decode(const Table& table)
+        {
+            int code = 0;
+            int first = 0;
+            int index = 0;
+            for (int length = 1; length < 16; ++length)
+            {
+                code |= Bits(1);
+                const int count = table.counts[length];
+                if (code - count < first) return table.symbols[index + (code - first)];
+                index += count;
+                first = (first + count) << 1;
+                code <<= 1;
+                if (overrun_) return -1;
+            }
+            return -1;
+        }
+
+        bool InflateDynamicBlock(std::vector<uint8_t>& out)
+        {
+            static const int kOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+            static const int kLengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+            static const int kLengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+            static const int kDistanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+            static const int kDistanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+            const int litlen_count = Bits(5) + 257;
+            const int distance_count = Bits(5) + 1;
+            const int code_length_count = Bits(4) + 4;
+            if (litlen_count > 286 || distance_count > 30) return false;
+
+            uint8_t lengths[320] = {};
+            for (int i = 0; i < code_length_count; ++i) lengths[kOrder[i]] = static_cast<uint8_t>(Bits(3));
+            Table code_lengths;
+            Build(code_lengths, lengths, 19);
+
+            int index = 0;
+            while (index < litlen_count + distance_count)
+            {
+                int symbol = Decode(code_lengths);
+                if (symbol < 0) return false;
+                if (symbol < 16)
+                {
+                    lengths[index++] = static_cast<uint8_t>(symbol);
+                    continue;
+                }
+
+                uint8_t length = 0;
+                int repeat = 0;
+                if (symbol == 16)
+                {
+                    if (index == 0) return false;
+                    length = lengths[index - 1];
+                    repeat = 3 + Bits(2);
+                }
+                else
+                {
+                    repeat = symbol == 17 ? 3 + Bits(3) : 11 + Bits(7);
+                }
+                if (index + repeat > litlen_count + distance_count) return false;
+                while (repeat--) lengths[index++] = length;
+            }
+            if (lengths[256] == 0) return false;
+
+            Table litlen;
+            Table distance;
+            Build(litlen, lengths, litlen_count);
+            Build(distance, lengths + litlen_count, distance_count);
+
+            for (;;)
+            {
+                int symbol = Decode(litlen);
+                if (symbol < 0 || symbol > 285) return false;
+                if (symbol < 256)
+                {
+                    out.push_back(static_cast<uint8_t>(symbol));
+                    continue;
+                }
+                if (symbol == 256) return true;
+
+                symbol -= 257;
+                const size_t length = kLengthBase[symbol] + Bits(kLengthExtra[symbol]);
+                const int distance_symbol = Decode(distance);
+                if (distance_symbol < 0 || distance_symbol > 29) return false;
+                const size_t back = kDistanceBase[distance_symbol] + Bits(kDistanceExtra[distance_symbol]);
+                if (back > out.size()) return false;
+                for (size_t i = 0; i < length; ++i) out.push_back(out[out.size() - back]);
+            }
+        }
+
+        const uint8_t* data_;
+        size_t size_;
+        size_t position_ = 0;
+        uint64_t bit_buffer_ = 0;
+        int bit_count_ = 0;
+        bool overrun_ = false;
+    };
+
+    uint32_t ReadBe32(const uint8_t* data)
+    {
+        return (static_cast<uint32_t>(data[0]) << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+    }
+
+    // Chunk CRCs, the zlib stream and its Adler-32, then every row unfiltered and compared with the
+    // frame's BGR. Empty when they match, else what was wrong.
+    std::string CheckPng(const std::vector<uint8_t>& png, const FrameDescriptor& frame)
+    {
+        static const uint8_t kSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        if (png.size() < 8 || std::memcmp(png.data(), kSignature, 8) != 0) return "bad signature";
+
+        std::vector<uint8_t> stream;
+        int width = 0;
+        int height = 0;
+        bool ended = false;
+        for (size_t position = 8; position < png.size() && !ended;)
+        {
+            if (position + 12 > png.size()) return "truncated chunk";
+            const uint32_t length = ReadBe32(png.data() + position);
+            if (position + 12 + length > png.size()) return "truncated chunk";
+            const uint8_t* type = png.data() + position + 4;
+            const uint8_t* body = type + 4;
+
+            // Bitwise, so the encoder's table is not checked against itself
+            uint32_t crc = 0xFFFFFFFFu;
+            for (uint32_t i = 0; i < length + 4; ++i)
+            {
+                crc ^= type[i];
+                for (int bit = 0; bit < 8; ++bit) crc = crc & 1 ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+            }
+            if (~crc != ReadBe32(body + length)) return "chunk CRC mismatch";
+
+            if (std::memcmp(type, "IHDR", 4) == 0)
+            {
+                width = static_cast<int>(ReadBe32(body));
+                height = static_cast<int>(ReadBe32(body + 4));
+                if (body[8] != 8 || body[9] != 2 || body[12] != 0) return "not 8-bit RGB";
+            }
+            else if (std::memcmp(type, "IDAT", 4) == 0)
+            {
+                stream.insert(stream.end(), body, body + length);
+            }
+            ended = std::memcmp(type, "IEND", 4) == 0;
+            position += 12 + length;
+        }
+        if (!ended) return "no IEND";
+        if (width != frame.width || height != frame.height) return "wrong size";
+        if (stream.size() < 6 || stream[0] != 0x78 || ((stream[0] << 8) | stream[1]) % 31 != 0) return "bad zlib header";
+
+        std::vector<uint8_t> filtered;
+        Inflater inflater(stream.data() + 2, stream.size() - 2);
+        if (!inflater.Inflate(filtered)) return "inflate failed";
+        if (inflater.GetPosition() + 2 + 4 != stream.size()) return "data after the deflate stream";
+
+        uint32_t a = 1;
+        uint32_t b = 0;
+        for (uint8_t value : filtered)
+        {
+            a = (a + value) % 65521;
+            b = (b + a) % 65521;
+        }
+        if (((b << 16) | a) != ReadBe32(stream.data() + stream.size() - 4)) return "Adler-32 mismatch";
+
+        const size_t row_bytes = static_cast<size_t>(width) * 3;
+        if (filtered.size() != (row_bytes + 1) * height) return "wrong amount of image data";
+
+        std::vector<uint8_t> prior(row_bytes, 0);
+        std::vector<uint8_t> row(row_bytes);
+        for (int y = 0; y < height; ++y)
+        {
+            const uint8_t* line = filtered.data() + y * (row_bytes + 1);
+            const int filter = line[0];
+            for (size_t x = 0; x < row_bytes; ++x)
+            {
+                const int left = x >= 3 ? row[x - 3] : 0;
+                const int above = prior[x];
+                const int above_left = x >= 3 ? prior[x - 3] : 0;
+                int predicted = 0;
+                if (filter == 1) predicted = left;
+                else if (filter == 2) predicted = above;
+                else if (filter == 3) predicted = (left + above) / 2;
+                else if (filter == 4)
+                {
+                    const int p = left + above - above_left;
+                    const int pa = std::abs(p - left);
+                    const int pb = std::abs(p - above);
+                    const int pc = std::abs(p - above_left);
+                    predicted = pa <= pb && pa <= pc ? left : pb <= pc ? above : above_left;
+                }
+                else if (filter != 0) return "unknown filter";
+                row[x] = static_cast<uint8_t>(line[1 + x] + predicted);
+            }
+
+            const uint8_t* source = frame.planes[0].data + y * frame.planes[0].pitch;
+            for (int x = 0; x < width; ++x)
+            {
+                if (row[x * 3] != source[x * 4 + 2] || row[x * 3 + 1] != source[x * 4 + 1] || row[x * 3 + 2] != source[x * 4]) return "pixels differ";
+            }
+            std::swap(row, prior);
+        }
+        return std::string();
+    }
+
+    // One frame of the synthetic screen, some way in so the pattern has moved
+    std::vector<uint8_t> CaptureSyntheticFrame(int width, int height, SyntheticPattern pattern, uint64_t index)
+    {
+        std::vector<uint8_t> captured;
+        std::mutex mutex;
+        std::condition_variable done;
+        uint64_t seen = 0;
+        SyntheticFrameSource source(width, height, 0, pattern);
+        source.SetOutputCallback([&](const FrameDescriptor& frame, const DirtyRegion&)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (seen++ != index) return;
+            captured.resize(frame.GetRowBytes(0) * frame.height);
+            FrameKernels::CopyImage(captured.data(), frame.GetRowBytes(0), frame.planes[0].data, frame.planes[0].pitch, frame.GetRowBytes(0), frame.height);
+            done.notify_all();
+        });
+        source.StartCapture();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            done.wait(lock, [&] { return !captured.empty(); });
+        }
+        source.StopCapture();
+        return captured;
+    }
+
+    struct SnapshotPathResult
+    {
+        double fps = 0.0;
+        double latency_p50_ms = 0.0;
+        double latency_p99_ms = 0.0;
+        uint64_t copied_bytes = 0;  // On the recording thread, by the snapshot writer
+        std::vector<SnapshotResult> snapshots;
+    };
+
+    // The recording path at 4K, as ScreenRecorder runs it with a queue: synthetic capture -> queue
+    // -> recording thread pinning snapshots, then scene detection standing in for the sink. With
+    // snapshot_every > 0 a snapshot is requested every that many frames.
+    SnapshotPathResult RunSnapshotPath(int frames, int snapshot_every, const std::filesystem::path& directory)
+    {
+        const int width = 3840;
+        const int height = 2160;
+        const int warmup = 10;
+        const uint64_t total = static_cast<uint64_t>(warmup + frames);
+
+        MemoryBudget budget(512ull * 1024 * 1024);
+        FrameQueue queue(budget, 4, BackpressurePolicy::Block);
+        SnapshotWriter snapshots;
+        SnapshotPathResult result;
+
+        uint64_t callbacks = 0;
+        DirtyRegion pending_dirty;
+        SyntheticFrameSource source(width, height, 0);
+        source.SetOutputCallback([&](const FrameDescriptor& frame, const DirtyRegion& dirty)
+        {
+            const uint64_t index = callbacks++;
+            if (index == total) queue.Close();
+            if (index >= total) return;
+
+            if (snapshot_every > 0 && index >= static_cast<uint64_t>(warmup) && (index - warmup) % snapshot_every == 0)
+            {
+                snapshots.Request((directory / ("screenrecorder_snapshot_" + std::to_string(index) + ".png")).wstring());
+            }
+            pending_dirty.Add(dirty.ForFrame(frame.width, frame.height));
+            if (queue.Push(frame, pending_dirty) != PushResult::Dropped) pending_dirty = DirtyRegion(frame.width, frame.height);
+        });
+
+        LatencyHistogram latency;
+        auto wall_start = std::chrono::steady_clock::now();
+        std::thread encode_thread([&]
+        {
+            SceneChangeDetector detector;
+            QueuedFrame frame;
+            uint64_t index = 0;
+            uint64_t copied_start = 0;
+            while (queue.Pop(frame))
+            {
+                if (index == static_cast<uint64_t>(warmup))
+                {
+                    copied_start = HotPathCounters::GetThreadCopyBytes(TraceStage::Copy);
+                    wall_start = std::chrono::steady_clock::now();
+                }
+
+                FrameDescriptor descriptor = FrameDescriptor::Packed(frame.pixels->data(), frame.format, frame.width, frame.height, frame.capture_time);
+                descriptor.owner = frame.pixels;
+                snapshots.OnFrame(descriptor);
+                detector.Analyze(descriptor.planes[0].data, descriptor.planes[0].pitch, descriptor.width, descriptor.height);
+                if (index++ >= static_cast<uint64_t>(warmup))
+                {
+                    latency.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - frame.capture_time).count());
+                }
+                frame.pixels.reset();
+            }
+            result.copied_bytes = HotPathCounters::GetThreadCopyBytes(TraceStage::Copy) - copied_start;
+        });
+
+        source.StartCapture();
+        encode_thread.join();
+        const double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+        source.StopCapture();
+        snapshots.Flush();
+
+        result.fps = frames / wall_seconds;
+        result.latency_p50_ms = latency.GetPercentileMs(50.0);
+        result.latency_p99_ms = latency.GetPercentileMs(99.0);
+        result.snapshots = snapshots.GetResults();
+        return result;
+    }
+
+    int RunSnapshotBenchmark(int count, const std::filesystem::path& directory)
+    {
+        bool passed = true;
+        const int cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+        // Odd sizes, padded pitches and more strips than some images have rows
+        const std::pair<int, int> sizes[] = { { 1, 1 }, { 3, 2 }, { 37, 23 }, { 257, 130 }, { 1001, 7 } };
+        int round_trips = 0;
+        for (const auto& size : sizes)
+        {
+            const ptrdiff_t pitch = size.first * 4 + 64;
+            std::vector<uint8_t> bgra;
+            FillPattern(bgra, size.first, size.second, pitch, static_cast<uint32_t>(size.first * 31 + size.second));
+            FrameDescriptor frame = FrameDescriptor::Packed(bgra.data(), FrameFormat::Bgra, size.first, size.second);
+            frame.planes[0].pitch = pitch;
+            for (int threads = 1; threads <= 5; ++threads)
+            {
+                PngEncoder encoder(threads);
+                std::vector<uint8_t> png;
+                const std::string problem = encoder.Encode(frame, png) ? CheckPng(png, frame) : "encode failed";
+                if (!problem.empty())
+                {
+                    std::printf("%dx%d on %d threads: %s\n", size.first, size.second, threads, problem.c_str());
+                    passed = false;
+                }
+                ++round_trips;
+            }
+        }
+        std::printf("%d small round trips %s\n\n", round_trips, passed ? "ok" : "FAILED");
+
+        std::vector<int> thread_counts;
+        for (int threads = 1; threads <= std::max(4, cores); threads *= 2) thread_counts.push_back(threads);
+
+        const int width = 3840;
+        const int height = 2160;
+        const double frame_mb = static_cast<double>(width) * height * 4 / 1e6;
+        std::printf("4K snapshot encode, mean of %d (filter and deflate are CPU ms summed over strips)\n", count);
+        std::printf("%-8s %8s %10s %10s %10s %12s %10s %10s %8s\n", "screen", "threads", "ms", "best ms", "MB/s", "filter ms", "deflate ms", "MB", "ratio");
+        // The synthetic screens are mostly flat, as desktops are; the textured one is the hard case
+        for (const char* name : { "motion", "slides", "textured" })
+        {
+            std::vector<uint8_t> bgra;
+            if (std::strcmp(name, "textured") == 0) FillPattern(bgra, width, height, width * 4, 97);
+            else bgra = CaptureSyntheticFrame(width, height, std::strcmp(name, "motion") == 0 ? SyntheticPattern::Motion : SyntheticPattern::Slides, 45);
+            const FrameDescriptor frame = FrameDescriptor::Packed(bgra.data(), FrameFormat::Bgra, width, height);
+
+            for (int threads : thread_counts)
+            {
+                PngEncoder encoder(threads);
+                std::vector<uint8_t> png;
+                double total_ms = 0.0;
+                double best_ms = 1e30;
+                double filter_ms = 0.0;
+                double deflate_ms = 0.0;
+                encoder.Encode(frame, png);
+                for (int i = 0; i < count; ++i)
+                {
+                    encoder.Encode(frame, png);
+                    const PngEncodeStats& stats = encoder.GetLastStats();
+                    total_ms += stats.total_ms;
+                    best_ms = std::min(best_ms, stats.total_ms);
+                    filter_ms += stats.filter_ms;
+                    deflate_ms += stats.deflate_ms;
+                }
+
+                const std::string problem = CheckPng(png, frame);
+                const double mean_ms = total_ms / count;
+                std::printf("%-8s %8d %10.1f %10.1f %10.0f %12.1f %10.1f %10.2f %7.1f%% %s\n", name, threads, mean_ms, best_ms,
+                            mean_ms > 0 ? frame_mb * 1e3 / mean_ms : 0.0, filter_ms / count, deflate_ms / count, png.size() / 1e6,
+                            png.size() * 100.0 / (frame_mb * 1e6), problem.empty() ? "" : problem.c_str());
+                passed = passed && problem.empty();
+            }
+        }
+
+        // Encoding runs at below-normal priority beside the recording thread, whose own cost is a
+        // reference taken on the queued frame
+        const int path_frames = std::max(60, count * 10);
+        const SnapshotPathResult plain = RunSnapshotPath(path_frames, 0, directory);
+        const SnapshotPathResult with = RunSnapshotPath(path_frames, 10, directory);
+
+        std::printf("\n4K recording path, %d frames unpaced, scene detection as the sink\n", path_frames);
+        std::printf("%-16s %8s %10s %10s %10s %12s %12s %12s\n", "snapshots", "fps", "p50 ms", "p99 ms", "taken", "max pin us", "mean enc ms", "copied MB");
+        for (const SnapshotPathResult* run : { &plain, &with })
+        {
+            double max_pin_us = 0.0;
+            double encode_ms = 0.0;
+            for (const SnapshotResult& snapshot : run->snapshots)
+            {
+                max_pin_us = std::max(max_pin_us, snapshot.pin_us);
+                encode_ms += snapshot.encode_ms;
+            }
+            std::printf("%-16s %8.1f %10.2f %10.2f %10zu %12.1f %12.1f %12.2f\n", run == &plain ? "none" : "every 10th", run->fps,
+                        run->latency_p50_ms, run->latency_p99_ms, run->snapshots.size(), max_pin_us,
+                        run->snapshots.empty() ? 0.0 : encode_ms / run->snapshots.size(), run->copied_bytes / 1e6);
+        }
+
+        // Every snapshot written and readable; queued frames are pinned, never copied
+        int unreadable = 0;
+        for (const SnapshotResult& snapshot : with.snapshots)
+        {
+            std::ifstream file(std::filesystem::path(snapshot.path), std::ios::binary);
+            std::vector<uint8_t> png((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            file.close();
+            std::filesystem::remove(std::filesystem::path(snapshot.path));
+
+            const bool readable = snapshot.saved && png.size() == snapshot.bytes && png.size() > 33 && ReadBe32(png.data() + 16) == static_cast<uint32_t>(width)
+                                  && ReadBe32(png.data() + 20) == static_cast<uint32_t>(height);
+            unreadable += readable ? 0 : 1;
+        }
+        const size_t expected = static_cast<size_t>((path_frames + 9) / 10);
+        std::printf("%zu of %zu snapshots written, %d unreadable\n", with.snapshots.size(), expected, unreadable);
+        passed = passed && with.snapshots.size() == expected && unreadable == 0 && with.copied_bytes == 0;
+
+        std::printf("%s\n", passed ? "PASS" : "FAIL");
+        return passed ? 0 : 1;
+    }
+
+    // Keeps every time-lapse frame with its timestamp, and whether it came with an empty dirty region
+    class TimeLapseCollector : public FrameSink
+    {
+    public:
+        explicit TimeLapseCollector(bool collect) : collect_(collect) {}
+
+        bool ProcessFrame(const std::vector<uint8_t>& image_buffer, int width, int height) override
+        {
+            return ProcessFrame(FrameDescriptor::Packed(image_buffer.data(), FrameFormat::Bgra, width, height), DirtyRegion::Full(width, height));
+        }
+
+        bool ProcessFrame(const FrameDescriptor& frame, const DirtyRegion& dirty) override
+        {
+            if (collect_)
+            {
+                const size_t row_bytes = frame.GetRowBytes(0);
+                frames_.emplace_back();
+                frames_.back().resize(row_bytes * frame.height);
+                FrameKernels::CopyImage(frames_.back().data(), row_bytes, frame.planes[0].data, frame.planes[0].pitch, row_bytes, frame.height);
+            }
+            timestamps_.push_back(frame.timestamp);
+            unchanged_ += dirty.IsEmpty() ? 1 : 0;
+            return true;
+        }
+
+        bool Close() override { ++closed_; return true; }
+
+        const std::vector<std::vector<uint8_t>>& GetFrames() const { return frames_; }
+        const std::vector<std::chrono::steady_clock::time_point>& GetTimestamps() const { return timestamps_; }
+        int GetUnchanged() const { return unchanged_; }
+        int GetClosed() const { return closed_; }
+
+    private:
+        bool collect_;
+        std::vector<std::vector<uint8_t>> frames_;
+        std::vector<std::chrono::steady_clock::time_point> timestamps_;
+        int unchanged_ = 0;
+        int closed_ = 0;
+    };
+
+    int TimeLapseTick(std::chrono::nanoseconds elapsed, std::chrono::nanoseconds interval)
+    {
+        if (elapsed.count() <= 0) return 0;
+        if (elapsed >= interval) return TimeLapseSink::kTicks;
+        return static_cast<int>(elapsed.count() * TimeLapseSink::kTicks / interval.count());
+    }
+
+    // Random edits to a 203x131 frame (partial tiles on both edges) at a padded pitch, arriving at
+    // irregular times with gaps of several intervals. Every blend must match a per-pixel reference
+    // over all frames exactly: sum of value x ticks on screen, rounded down by 256, and the max.
+    bool RunTimeLapseAccuracy(int frames)
+    {
+        const int width = 203;
+        const int height = 131;
+        const ptrdiff_t pitch = width * 4 + 96;
+        const size_t frame_bytes = static_cast<size_t>(width) * height * 4;
+        const std::chrono::nanoseconds interval(1000000000);
+
+        std::vector<uint8_t> bgra;
+        FillPattern(bgra, width, height, pitch, 120);
+        uint32_t state = 121;
+        auto next = [&](int limit) { state = state * 1664525u + 1013904223u; return static_cast<int>((state >> 8) % static_cast<uint32_t>(limit)); };
+
+        // Irregular arrival: mostly 1-300 ms apart, now and then a pause of up to 3.5 intervals
+        std::vector<std::vector<uint8_t>> sources;
+        std::vector<std::chrono::nanoseconds> offsets;
+        std::vector<DirtyRegion> regions;
+        std::chrono::nanoseconds offset(0);
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            DirtyRegion changed = DirtyRegion::Full(width, height);
+            if (frame > 0)
+            {
+                offset += std::chrono::milliseconds(next(10) == 0 ? 1000 + next(2500) : 1 + next(300));
+                changed = DirtyRegion(width, height);
+                const int rects = next(4);
+                for (int i = 0; i < rects; ++i)
+                {
+                    const int rect_width = 1 + next(i == 0 ? width / 2 : 30);
+                    const int rect_height = 1 + next(i == 0 ? height / 2 : 20);
+                    const DirtyRect rect = { next(width - rect_width + 1), next(height - rect_height + 1), rect_width, rect_height };
+                    for (int y = rect.y; y < rect.y + rect.height; ++y)
+                    {
+                        uint8_t* row = bgra.data() + y * pitch + static_cast<ptrdiff_t>(rect.x) * 4;
+                        for (int x = 0; x < rect.width * 4; ++x) row[x] = static_cast<uint8_t>(next(256));
+                    }
+                    changed.Add(rect);
+                }
+            }
+            sources.emplace_back(frame_bytes);
+            FrameKernels::CopyImage(sources.back().data(), width * 4, bgra.data(), pitch, width * 4, height);
+            offsets.push_back(offset);
+            regions.push_back(changed);
+        }
+
+        const size_t expected_frames = static_cast<size_t>(offsets.back() / interval) + 1;
+        const auto base = std::chrono::steady_clock::now();
+        const TimeLapseBlend blends[] = { TimeLapseBlend::Average, TimeLapseBlend::Max, TimeLapseBlend::Sample };
+        const char* names[] = { "average", "max", "sample" };
+
+        bool passed = true;
+        std::printf("%-10s %8s %8s %10s %10s %12s\n", "blend", "input", "output", "repeated", "mismatched", "max error");
+        for (int b = 0; b < 3; ++b)
+        {
+            auto collector = std::make_shared<TimeLapseCollector>(true);
+            TimeLapseSink sink(collector, 1.0, blends[b]);
+
+            // Replays the screen through a pitch-padded surface, so the sink reads borrowed strided frames
+            std::vector<uint8_t> surface(static_cast<size_t>(pitch) * height);
+            for (int frame = 0; frame < frames; ++frame)
+            {
+                FrameKernels::CopyImage(surface.data(), pitch, sources[frame].data(), width * 4, width * 4, height);
+                FrameDescriptor descriptor = FrameDescriptor::Packed(surface.data(), FrameFormat::Bgra, width, height, base + offsets[frame]);
+                descriptor.planes[0].pitch = pitch;
+                sink.ProcessFrame(descriptor, regions[frame]);
+            }
+            sink.Close();
+            sink.Close();
+
+            int mismatched = 0;
+            int max_error = 0;
+            std::vector<uint32_t> reference(frame_bytes);
+            size_t first = 0;
+            for (size_t k = 0; k < collector->GetFrames().size(); ++k)
+            {
+                const std::chrono::nanoseconds begin = interval * static_cast<int64_t>(k);
+                // The frame up at the interval's start, then every arrival in it
+                while (first < offsets.size() && offsets[first] < begin) ++first;
+                const size_t carried = first > 0 ? first - 1 : 0;
+                size_t last = first;
+                while (last < offsets.size() && offsets[last] < begin + interval) ++last;
+
+                std::fill(reference.begin(), reference.end(), 0);
+                for (size_t j = carried; j < last; ++j)
+                {
+                    const int from = j < first ? 0 : TimeLapseTick(offsets[j] - begin, interval);
+                    const int to = j + 1 < last ? TimeLapseTick(offsets[j + 1] - begin, interval) : TimeLapseSink::kTicks;
+                    const uint8_t* pixels = sources[j].data();
+                    for (size_t i = 0; i < frame_bytes; ++i)
+                    {
+                        if (blends[b] == TimeLapseBlend::Average) reference[i] += pixels[i] * static_cast<uint32_t>(to - from);
+                        else if (blends[b] == TimeLapseBlend::Max) reference[i] = std::max<uint32_t>(reference[i], pixels[i]);
+                        else reference[i] = pixels[i];
+                    }
+                }
+
+                const std::vector<uint8_t>& output = collector->GetFrames()[k];
+                bool matches = output.size() == frame_bytes && collector->GetTimestamps()[k] == base + begin + interval;
+                for (size_t i = 0; matches && i < frame_bytes; ++i)
+                {
+                    const uint32_t expected = blends[b] == TimeLapseBlend::Average ? (reference[i] + 128) >> 8 : reference[i];
+                    const int error = std::abs(static_cast<int>(output[i]) - static_cast<int>(expected));
+                    max_error = std::max(max_error, error);
+                    matches = error == 0;
+                }
+                mismatched += matches ? 0 : 1;
+            }
+
+            const TimeLapseStats stats = sink.GetStats();
+            std::printf("%-10s %8llu %8zu %10llu %10d %12d\n", names[b], static_cast<unsigned long long>(stats.frames_in), collector->GetFrames().size(),
+                        static_cast<unsigned long long>(stats.frames_repeated), mismatched, max_error);
+            passed = passed && mismatched == 0 && collector->GetFrames().size() == expected_frames && stats.frames_out == expected_frames
+                     && stats.frames_in == static_cast<uint64_t>(frames) && stats.frames_repeated > 0 && collector->GetClosed() == 1;
+        }
+        return passed;
+    }
+
+    struct TimeLapseCost
+    {
+        double cpu_ms = 0.0;        // Per captured frame, screen updates excluded
+        double blend_ms = 0.0;      // Of which folding in, as the sink measures it
+        double resolve_ms = 0.0;    // Per output frame
+        size_t outputs = 0;
+        size_t buffer_bytes = 0;
+    };
+
+    // A 4K screen at 60 fps with a window dragged across it and a full repaint every 2 s, on
+    // synthetic timestamps so the run goes as fast as the sink allows. full_frames hands the sink
+    // every frame as wholly dirty, which is what blending without dirty regions costs.
+    TimeLapseCost RunTimeLapseCost(TimeLapseBlend blend, bool full_frames, int frames)
+    {
+        const int width = 3840;
+        const int height = 2160;
+        const ptrdiff_t surface_pitch = width * 4 + 256;
+        const int box = 480;
+        const std::chrono::nanoseconds frame_interval(1000000000 / 60);
+
+        std::vector<uint8_t> surface;
+        FillPattern(surface, width, height, surface_pitch, 125);
+
+        auto collector = std::make_shared<TimeLapseCollector>(false);
+        TimeLapseSink sink(collector, 1.0, blend);
+        const auto base = std::chrono::steady_clock::now();
+
+        double sink_cpu = 0.0;
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            DirtyRegion dirty = DirtyRegion::Full(width, height);
+            if (frame % 120 != 0)
+            {
+                const int x = (frame * 11) % (width - box - 8);
+                const int y = (frame * 5) % (height - box - 8);
+                dirty = DirtyRegion(width, height);
+                dirty.Add(DirtyRect{ x, y, box + 8, box + 4 });
+                for (int row = y + 4; row < y + 4 + box; ++row)
+                {
+                    std::memset(surface.data() + row * surface_pitch + static_cast<ptrdiff_t>(x + 8) * 4, frame & 0xff, static_cast<size_t>(box) * 4);
+                }
+            }
+            else
+            {
+                for (int row = 0; row < height; ++row)
+                {
+                    uint8_t* pixels = surface.data() + row * surface_pitch;
+                    for (int i = 0; i < width * 4; ++i) pixels[i] ^= 0x55;
+                }
+            }
+
+            FrameDescriptor descriptor = FrameDescriptor::Packed(surface.data(), FrameFormat::Bgra, width, height, base + frame_interval * frame);
+            descriptor.planes[0].pitch = surface_pitch;
+            const double sink_start = ThreadCpuSeconds();
+            sink.ProcessFrame(descriptor, full_frames ? DirtyRegion::Full(width, height) : dirty);
+            sink_cpu += ThreadCpuSeconds() - sink_start;
+        }
+        const double close_start = ThreadCpuSeconds();
+        sink.Close();
+        sink_cpu += ThreadCpuSeconds() - close_start;
+
+        const TimeLapseStats stats = sink.GetStats();
+        TimeLapseCost cost;
+        cost.cpu_ms = sink_cpu * 1e3 / frames;
+        cost.blend_ms = stats.blend_ms / frames;
+        cost.resolve_ms = stats.frames_out ? stats.resolve_ms / stats.frames_out : 0.0;
+        cost.outputs = collector->GetTimestamps().size();
+        cost.buffer_bytes = stats.buffer_bytes;
+        return cost;
+    }
+
+    int RunTimeLapseBenchmark(double seconds)
+    {
+        const bool accurate = RunTimeLapseAccuracy(300);
+
+        const int frames = std::max(2, static_cast<int>(seconds * 60));
+        const size_t expected_outputs = static_cast<size_t>((frames - 1) * static_cast<int64_t>(1000000000 / 60) / 1000000000) + 1;
+
+        struct Row
+        {
+            const char* name;
+            TimeLapseBlend blend;
+            bool full_frames;
+        };
+        const Row rows[] =
+        {
+            { "average", TimeLapseBlend::Average, false },
+            { "max", TimeLapseBlend::Max, false },
+            { "sample", TimeLapseBlend::Sample, false },
+            { "average, whole frames", TimeLapseBlend::Average, true },
+        };
+
+        std::printf("\n4K at 60 fps, %d frames into 1 s intervals, window drag plus a full repaint every 2 s\n", frames);
+        std::printf("%-22s %12s %12s %14s %8s %10s\n", "blend", "cpu ms/f", "blend ms/f", "resolve ms/out", "outputs", "buffer MB");
+        bool complete = true;
+        for (const Row& row : rows)
+        {
+            const TimeLapseCost cost = RunTimeLapseCost(row.blend, row.full_frames, frames);
+            std::printf("%-22s %12.3f %12.3f %14.2f %8zu %10.1f\n", row.name, cost.cpu_ms, cost.blend_ms, cost.resolve_ms, cost.outputs, cost.buffer_bytes / 1e6);
+            complete = complete && cost.outputs == expected_outputs;
+        }
+
+        const bool passed = accurate && complete;
+        std::printf("%s\n", passed ? "PASS" : "FAIL");
+        return passed ? 0 : 1;
+    }
+
+    // The shared-frame screen: frame 1 is the base pattern, each later frame moves a box, and
+    // every 60th inverts the whole screen. Publisher and readers replay it the same way.
+    void ApplySharedFrameEdit(std::vector<uint8_t>& screen, int width, int height, ptrdiff_t pitch, uint64_t frame, DirtyRegion* dirty)
+    {
+        if (frame % 60 == 0)
+        {
+            for (int y = 0; y < height; ++y)
+            {
+                uint8_t* row = screen.data() + y * pitch;
+                for (int x = 0; x < width * 4; ++x) row[x] ^= 0x33;
+            }
+            if (dirty) *dirty = DirtyRegion::Full(width, height);
+            return;
+        }
+
+        const int box_width = 200;
+        const int box_height = 120;
+        const DirtyRect rect = { static_cast<int>(frame * 37 % (width - box_width)), static_cast<int>(frame * 23 % (height - box_height)), box_width, box_height };
+        for (int y = rect.y; y < rect.y + rect.height; ++y)
+        {
+            std::memset(screen.data() + y * pitch + static_cast<ptrdiff_t>(rect.x) * 4, static_cast<int>(frame & 0xff), static_cast<size_t>(rect.width) * 4);
+        }
+        if (dirty)
+        {
+            *dirty = DirtyRegion(width, height);
+            dirty->Add(rect);
+        }
+    }
+
+    struct SharedReaderResult
+    {
+        std::vector<double> wake_ms;    // Publish done to reader holding the frame
+        uint64_t verified = 0;          // Compared in place and still whole afterwards
+        uint64_t mismatched = 0;
+        SharedFrameReaderStats stats;
+        bool opened = false;
+    };
+
+    // A separate mapping of the ring by name, as another process would open it. Every frame is
+    // compared in place against a local replay of the screen; hold_ms keeps it longer, like a
+    // slow OCR pass, so the publisher laps it.
+    SharedReaderResult RunSharedReader(const std::string& name, int width, int height, int hold_ms)
+    {
+        SharedReaderResult result;
+        SharedFrameReader reader;
+        result.opened = reader.Open(name);
+        if (!result.opened) return result;
+
+        std::vector<uint8_t> replica;
+        FillPattern(replica, width, height, width * 4, 130);
+        uint64_t replayed = 1;
+
+        SharedFrameView view;
+        for (;;)
+        {
+            const SharedFrameStatus status = reader.WaitForFrame(view, std::chrono::milliseconds(200));
+            if (status == SharedFrameStatus::Closed) break;
+            if (status == SharedFrameStatus::Timeout) continue;
+
+            result.wake_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - view.publish_time).count());
+            if (hold_ms > 0) std::this_thread::sleep_for(std::chrono::milliseconds(hold_ms));
+
+            while (replayed < view.frame_number) ApplySharedFrameEdit(replica, width, height, width * 4, ++replayed, nullptr);
+            bool equal = view.width == width && view.height == height;
+            for (int y = 0; equal && y < height; ++y)
+            {
+                equal = std::memcmp(view.data + y * view.pitch, replica.data() + static_cast<size_t>(y) * width * 4, static_cast<size_t>(width) * 4) == 0;
+            }
+            if (reader.Validate(view))
+            {
+                ++result.verified;
+                result.mismatched += equal ? 0 : 1;
+            }
+        }
+
+        result.stats = reader.GetStats();
+        return result;
+    }
+
+    double PercentileMs(std::vector<double> samples, double percentile)
+    {
+        if (samples.empty()) return 0.0;
+        std::sort(samples.begin(), samples.end());
+        const size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0 * samples.size()));
+        return samples[std::min(samples.size() - 1, rank > 0 ? rank - 1 : 0)];
+    }
+
+    int RunSharedFramesBenchmark(int frames)
+    {
+        const int width = 1920;
+        const int height = 1080;
+        const ptrdiff_t surface_pitch = width * 4 + 256;
+        const auto frame_interval = std::chrono::nanoseconds(1000000000 / 120);
+
+        struct Row
+        {
+            const char* name;
+            int fast_readers;
+            bool slow_reader;
+        };
+        const Row rows[] =
+        {
+            { "none", 0, false },
+            { "1", 1, false },
+            { "2", 2, false },
+            { "4", 4, false },
+            { "8", 8, false },
+            { "4 + slow", 4, true },
+        };
+
+        std::printf("1080p at 120 fps, %d frames, 4-slot ring; the slow reader holds each frame 40 ms\n", frames);
+        std::printf("%-10s %10s %10s %10s %10s %10s %8s %8s %8s %10s\n", "readers", "pub us", "pub max us", "copied MB", "wake p50", "wake p99",
+                    "read %", "torn", "slow %", "mismatched");
+
+        bool passed = true;
+        for (const Row& row : rows)
+        {
+            const std::string name = "bench." + std::to_string(static_cast<unsigned long long>(std::chrono::steady_clock::now().time_since_epoch().count()));
+            SharedFramePublisher publisher(name, 4);
+            if (!publisher.Open(width, height))
+            {
+                std::printf("Cannot create shared memory %s\n", name.c_str());
+                return 1;
+            }
+
+            const int readers = row.fast_readers + (row.slow_reader ? 1 : 0);
+            std::vector<SharedReaderResult> results(readers);
+            std::vector<std::thread> threads;
+            for (int i = 0; i < readers; ++i)
+            {
+                const int hold_ms = i == row.fast_readers ? 40 : 0;
+                threads.emplace_back([&, i, hold_ms] { results[i] = RunSharedReader(name, width, height, hold_ms); });
+            }
+            // Readers that open late just start from the newest frame
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+            std::vector<uint8_t> surface;
+            FillPattern(surface, width, height, surface_pitch, 130);
+            double max_publish_us = 0.0;
+            auto next_frame = std::chrono::steady_clock::now();
+            for (int frame = 1; frame <= frames; ++frame)
+            {
+                DirtyRegion dirty = DirtyRegion::Full(width, height);
+                if (frame > 1) ApplySharedFrameEdit(surface, width, height, surface_pitch, static_cast<uint64_t>(frame), &dirty);
+
+                FrameDescriptor descriptor = FrameDescriptor::Packed(surface.data(), FrameFormat::Bgra, width, height);
+                descriptor.planes[0].pitch = surface_pitch;
+                auto publish_start = std::chrono::steady_clock::now();
+                passed = publisher.ProcessFrame(descriptor, dirty) && passed;
+                max_publish_us = std::max(max_publish_us, std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - publish_start).count());
+
+                next_frame += frame_interval;
+                std::this_thread::sleep_until(next_frame);
+            }
+            const SharedFramePublisherStats publisher_stats = publisher.GetStats();
+            publisher.Close();
+            for (std::thread& thread : threads) thread.join();
+
+            std::vector<double> wake_ms;
+            uint64_t fast_read = 0;
+            uint64_t torn = 0;
+            uint64_t mismatched = 0;
+            double slow_percent = 0.0;
+            for (int i = 0; i < readers; ++i)
+            {
+                const SharedReaderResult& result = results[i];
+                mismatched += result.mismatched;
+                torn += result.stats.frames_torn;
+                passed = passed && result.opened && result.verified > 0;
+                if (i < row.fast_readers)
+                {
+                    wake_ms.insert(wake_ms.end(), result.wake_ms.begin(), result.wake_ms.end());
+                    fast_read += result.stats.frames_read;
+                }
+                else
+                {
+                    slow_percent = result.stats.frames_read * 100.0 / frames;
+                    // Held past a lap of the ring, so some reads must have been caught as torn
+                    passed = passed && result.stats.frames_torn > 0;
+                }
+            }
+
+            char slow[16] = "-";
+            if (row.slow_reader) std::snprintf(slow, sizeof(slow), "%.1f", slow_percent);
+            std::printf("%-10s %10.1f %10.1f %10.1f %10.3f %10.3f %8.1f %8llu %8s %10llu\n", row.name, publisher_stats.publish_ms * 1e3 / frames, max_publish_us,
+                        publisher_stats.bytes_copied / 1e6, PercentileMs(wake_ms, 50.0), PercentileMs(wake_ms, 99.0),
+                        row.fast_readers ? fast_read * 100.0 / (static_cast<double>(frames) * row.fast_readers) : 0.0,
+                        static_cast<unsigned long long>(torn), slow, static_cast<unsigned long long>(mismatched));
+
+            // Patching slots from the dirty history copies far less than whole frames
+            passed = passed && mismatched == 0 && publisher_stats.frames_published == static_cast<uint64_t>(frames)
+                     && publisher_stats.bytes_copied < static_cast<uint64_t>(frames) * width * height * 4 / 2;
+        }
+
+        std::printf("%s\n", passed ? "PASS" : "FAIL");
+        return passed ? 0 : 1;
+    }
+
+    // Last-level cache misses of this thread, where perf_event_open is allowed; elsewhere (Windows,
+    // containers without PMU access) IsOpen is false and the column reads "-"
+    class CacheMissCounter
+    {
+    public:
+        CacheMissCounter()
+        {
+#ifdef __linux__
+            perf_event_attr attributes{};
+            attributes.type = PERF_TYPE_HARDWARE;
+            attributes.size = sizeof(attributes);
+            attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+            attributes.disabled = 1;
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+            fd_ = static_cast<int>(syscall(__NR_perf_event_open, &attributes, 0, -1, -1, 0));
+#endif
+        }
+
+        ~CacheMissCounter()
+        {
+#ifdef __linux__
+            if (fd_ >= 0) close(fd_);
+#endif
+        }
+
+        bool IsOpen() const { return fd_ >= 0; }
+
+        void Start()
+        {
+#ifdef __linux__
+            if (fd_ < 0) return;
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+        }
+
+        uint64_t Stop()
+        {
+            uint64_t misses = 0;
+#ifdef __linux__
+            if (fd_ < 0) return 0;
+            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd_, &misses, sizeof(misses)) != sizeof(misses)) misses = 0;
+#endif
+            return misses;
+        }
+
+    private:
+        int fd_ = -1;
+    };
+
+    // The filter chain's stages one after another with the existing kernels: crop offset,
+    // ScaleBgraBilinear, a straight-alpha blend, ConvertBgraToNv12
+    void ReferenceFilterChain(const std::vector<uint8_t>& capture, ptrdiff_t pitch, const FilterChainConfig& resolved,
+                              const std::vector<uint8_t>& overlay, int overlay_width, int overlay_height, int overlay_x, int overlay_y,
+                              std::vector<uint8_t>& bgra, std::vector<uint8_t>& nv12)
+    {
+        const int width = resolved.output_width;
+        const int height = resolved.output_height;
+        const uint8_t* crop = capture.data() + resolved.crop.y * pitch + static_cast<ptrdiff_t>(resolved.crop.x) * 4;
+        bgra.assign(static_cast<size_t>(width) * height * 4, 0);
+        if (width == resolved.crop.width && height == resolved.crop.height)
+        {
+            FrameKernels::CopyImage(bgra.data(), width * 4, crop, pitch, static_cast<size_t>(width) * 4, height);
+        }
+        else
+        {
+            FrameKernels::ScaleBgraBilinear(crop, pitch, resolved.crop.width, resolved.crop.height, bgra.data(), width * 4, width, height);
+        }
+
+        for (int y = 0; y < overlay_height; ++y)
+        {
+            for (int x = 0; x < overlay_width; ++x)
+            {
+                const int out_x = overlay_x + x;
+                const int out_y = overlay_y + y;
+                if (out_x < 0 || out_y < 0 || out_x >= width || out_y >= height) continue;
+
+                const uint8_t* src = overlay.data() + (static_cast<size_t>(y) * overlay_width + x) * 4;
+                uint8_t* dst = bgra.data() + (static_cast<size_t>(out_y) * width + out_x) * 4;
+                const double alpha = src[3] / 255.0;
+                for (int c = 0; c < 3; ++c) dst[c] = static_cast<uint8_t>(std::floor(src[c] * alpha + dst[c] * (1.0 - alpha) + 0.5));
+            }
+        }
+
+        const size_t pixels = static_cast<size_t>(width) * height;
+        nv12.assign(pixels * 3 / 2, 0);
+        FrameKernels::ConvertBgraToNv12(bgra.data(), width * 4, width, height, nv12.data(), width, nv12.data() + pixels, width);
+    }
+
+    // A cursor-sized overlay: an opaque body, a soft edge and transparent corners
+    std::vector<uint8_t> MakeOverlay(int width, int height, uint32_t seed)
+    {
+        std::vector<uint8_t> overlay;
+        FillPattern(overlay, width, height, static_cast<ptrdiff_t>(width) * 4, seed);
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                const int edge = std::min(std::min(x, width - 1 - x), std::min(y, height - 1 - y));
+                overlay[(static_cast<size_t>(y) * width + x) * 4 + 3] = static_cast<uint8_t>(edge == 0 ? 0 : edge < 4 ? edge * 60 + (x * 7 + y) % 16 : 255);
+            }
+        }
+        return overlay;
+    }
+
+    bool RunFilterChainAccuracy()
+    {
+        struct Case
+        {
+            const char* name;
+            DirtyRect crop;
+            int output_width;
+            int output_height;
+            bool overlay;
+        };
+        const Case cases[] =
+        {
+            { "whole capture", {}, 0, 0, false },
+            { "odd crop + overlay", { 3, 5, 1001, 701 }, 0, 0, true },
+            { "crop -> 640x360 + overlay", { 17, 9, 1600, 900 }, 640, 360, true },
+            { "crop -> 1920x1080 (up)", { 101, 33, 1000, 563 }, 1920, 1080, true },
+            { "whole -> 1280x720", {}, 1280, 720, false },
+            { "whole -> 302x170 (rows skipped)", {}, 302, 170, true },
+            { "crop past the edge", { 1500, 900, 4000, 4000 }, 0, 0, true },
+        };
+
+        const int capture_width = 1919;
+        const int capture_height = 1081;
+        const ptrdiff_t pitch = static_cast<ptrdiff_t>(capture_width) * 4 + 192;
+        const int overlay_width = 48;
+        const int overlay_height = 40;
+
+        std::printf("Filter chain vs the kernels in sequence, %dx%d capture at pitch %td\n", capture_width, capture_height, pitch);
+        std::printf("%-34s %10s %10s %10s %10s\n", "case", "output", "fused", "unfused", "bgra");
+        bool passed = true;
+        for (const Case& test : cases)
+        {
+            FilterChainConfig config;
+            config.crop = test.crop;
+            config.output_width = test.output_width;
+            config.output_height = test.output_height;
+            const FilterChainConfig resolved = config.Resolve(capture_width, capture_height);
+            const int width = resolved.output_width;
+            const int height = resolved.output_height;
+            const size_t pixels = static_cast<size_t>(width) * height;
+
+            FilterChainConfig unfused_config = config;
+            unfused_config.fused = false;
+            FilterChain fused(config);
+            FilterChain unfused(unfused_config);
+            const std::vector<uint8_t> overlay = MakeOverlay(overlay_width, overlay_height, 77);
+            if (test.overlay)
+            {
+                fused.SetOverlay(overlay.data(), overlay_width * 4, overlay_width, overlay_height);
+                unfused.SetOverlay(overlay.data(), overlay_width * 4, overlay_width, overlay_height);
+            }
+
+            size_t mismatched[3] = {};
+            std::vector<uint8_t> capture, reference_bgra, reference_nv12;
+            std::vector<uint8_t> fused_nv12(pixels * 3 / 2), unfused_nv12(pixels * 3 / 2), bgra(pixels * 4);
+            for (int frame = 0; frame < 4; ++frame)
+            {
+                FillPattern(capture, capture_width, capture_height, pitch, 300 + frame);
+                const FrameDescriptor descriptor = [&]
+                {
+                    FrameDescriptor d = FrameDescriptor::Packed(capture.data(), FrameFormat::Bgra, capture_width, capture_height);
+                    d.planes[0].pitch = pitch;
+                    return d;
+                }();
+
+                // Off the left and top, inside, off the right and bottom
+                const int positions[4][2] = { { -20, -13 }, { width / 3, height / 2 }, { width - 30, 7 }, { 11, height - 25 } };
+                const int overlay_x = positions[frame][0];
+                const int overlay_y = positions[frame][1];
+                fused.SetOverlayPosition(overlay_x, overlay_y);
+                unfused.SetOverlayPosition(overlay_x, overlay_y);
+                ReferenceFilterChain(capture, pitch, resolved, overlay, test.overlay ? overlay_width : 0, overlay_height, overlay_x, overlay_y,
+                                     reference_bgra, reference_nv12);
+
+                passed = passed && fused.ProcessToNv12(descriptor, fused_nv12.data(), width, fused_nv12.data() + pixels, width);
+                passed = passed && unfused.ProcessToNv12(descriptor, unfused_nv12.data(), width, unfused_nv12.data() + pixels, width);
+                passed = passed && fused.ProcessToBgra(descriptor, bgra.data(), width * 4);
+                for (size_t i = 0; i < reference_nv12.size(); ++i)
+                {
+                    mismatched[0] += fused_nv12[i] != reference_nv12[i];
+                    mismatched[1] += unfused_nv12[i] != reference_nv12[i];
+                }
+                for (size_t i = 0; i < reference_bgra.size(); ++i) mismatched[2] += bgra[i] != reference_bgra[i];
+            }
+
+            char output[24];
+            std::snprintf(output, sizeof(output), "%dx%d", width, height);
+            std::printf("%-34s %10s %10zu %10zu %10zu\n", test.name, output, mismatched[0], mismatched[1], mismatched[2]);
+            passed = passed && mismatched[0] == 0 && mismatched[1] == 0 && mismatched[2] == 0;
+        }
+        return passed;
+    }
+
+    // Fused time per frame over unfused, for a chain that fuses, below which --filter-chain fails
+    constexpr double kMinFusedSpeedup = 1.0;
+
+    int RunFilterChainBenchmark(int frames)
+    {
+        const bool accurate = RunFilterChainAccuracy();
+
+        struct Row
+        {
+            const char* name;
+            int capture_width;
+            int capture_height;
+            DirtyRect crop;
+            int output_width;
+            int output_height;
+            bool cursor;
+            bool bgra;
+        };
+        const Row rows[] =
+        {
+            { "4K -> NV12", 3840, 2160, {}, 0, 0, false, false },
+            { "4K + cursor -> NV12", 3840, 2160, {}, 0, 0, true, false },
+            { "4K -> 1080p NV12", 3840, 2160, {}, 1920, 1080, false, false },
+            { "4K crop 1440p -> 1080p + cursor", 3840, 2160, { 640, 360, 2560, 1440 }, 1920, 1080, true, false },
+            { "1080p -> 4K NV12", 1920, 1080, {}, 3840, 2160, false, false },
+            { "4K -> 1080p BGRA + cursor", 3840, 2160, {}, 1920, 1080, true, true },
+        };
+
+        CacheMissCounter cache_misses;
+        std::printf("\n%d frames per chain, padded capture pitch, fastest frame; traffic counts frame-sized buffers only%s\n", frames,
+                    cache_misses.IsOpen() ? "" : " (no perf counters here)");
+        std::printf("Chains that save traffic by fusing fail below %.2fx; the rest run the same single pass both ways\n", kMinFusedSpeedup);
+        std::printf("%-32s %10s %10s %8s %10s %10s %10s %10s  %s\n", "chain", "fused ms", "unfused ms", "speedup", "fused MB", "unfused MB",
+                    "fused LLC", "unfused LLC", "verdict");
+
+        const int cursor_width = 32;
+        const int cursor_height = 32;
+        const std::vector<uint8_t> cursor = MakeOverlay(cursor_width, cursor_height, 5);
+        bool fast = true;
+        for (const Row& row : rows)
+        {
+            const ptrdiff_t pitch = static_cast<ptrdiff_t>(row.capture_width) * 4 + 256;
+            std::vector<uint8_t> capture;
+            FillPattern(capture, row.capture_width, row.capture_height, pitch, 9);
+            FrameDescriptor descriptor = FrameDescriptor::Packed(capture.data(), FrameFormat::Bgra, row.capture_width, row.capture_height);
+            descriptor.planes[0].pitch = pitch;
+
+            // [0] unfused, [1] fused
+            std::unique_ptr<FilterChain> chains[2];
+            for (int fused = 0; fused < 2; ++fused)
+            {
+                FilterChainConfig config;
+                config.crop = row.crop;
+                config.output_width = row.output_width;
+                config.output_height = row.output_height;
+                config.fused = fused != 0;
+                chains[fused] = std::make_unique<FilterChain>(config);
+                if (row.cursor) chains[fused]->SetOverlay(cursor.data(), cursor_width * 4, cursor_width, cursor_height);
+            }
+
+            const int width = chains[0]->GetOutputWidth(row.capture_width, row.capture_height);
+            const int height = chains[0]->GetOutputHeight(row.capture_width, row.capture_height);
+            const size_t pixels = static_cast<size_t>(width) * height;
+            std::vector<uint8_t> outputs[2];
+            auto run = [&](int fused, int frame)
+            {
+                FilterChain& chain = *chains[fused];
+                std::vector<uint8_t>& output = outputs[fused];
+                output.resize(row.bgra ? pixels * 4 : pixels * 3 / 2);
+                chain.SetOverlayPosition(frame * 13 % (width - cursor_width), frame * 7 % (height - cursor_height));
+                if (row.bgra) chain.ProcessToBgra(descriptor, output.data(), width * 4);
+                else chain.ProcessToNv12(descriptor, output.data(), width, output.data() + pixels, width);
+            };
+
+            // Warm-up sizes the buffers; only the timed frames count. The two chains take turns so
+            // drift in clock speed or load hits both, and each is timed by its fastest frame, which
+            // a preempted or interrupted frame cannot make slower.
+            run(1, 0);
+            run(0, 0);
+            const FilterChainStats before[2] = { chains[0]->GetStats(), chains[1]->GetStats() };
+            std::vector<double> frame_ms[2];
+            double llc_misses[2] = {};
+            for (int frame = 1; frame <= frames; ++frame)
+            {
+                for (int fused = 1; fused >= 0; --fused)
+                {
+                    const double start_ms = chains[fused]->GetStats().process_ms;
+                    cache_misses.Start();
+                    run(fused, frame);
+                    llc_misses[fused] += static_cast<double>(cache_misses.Stop()) / frames;
+                    frame_ms[fused].push_back(chains[fused]->GetStats().process_ms - start_ms);
+                }
+            }
+
+            double ms[2] = {};
+            double megabytes[2] = {};
+            for (int fused = 0; fused < 2; ++fused)
+            {
+                const FilterChainStats after = chains[fused]->GetStats();
+                ms[fused] = frame_ms[fused].empty() ? 0.0 : *std::min_element(frame_ms[fused].begin(), frame_ms[fused].end());
+                megabytes[fused] = (after.bytes_read - before[fused].bytes_read + after.bytes_written - before[fused].bytes_written) / 1e6 / frames;
+            }
+
+            char llc[2][16] = { "-", "-" };
+            if (cache_misses.IsOpen())
+            {
+                for (int i = 0; i < 2; ++i) std::snprintf(llc[i], sizeof(llc[i]), "%.0fk", llc_misses[i] / 1e3);
+            }
+            // Without an intermediate to save, fused is the unfused pass and only noise tells them apart
+            const double speedup = ms[1] > 0 ? ms[0] / ms[1] : 0.0;
+            const char* verdict = "ok";
+            if (megabytes[1] >= megabytes[0]) verdict = "one pass";
+            else if (speedup < kMinFusedSpeedup) verdict = "SLOWER";
+            fast = fast && std::strcmp(verdict, "SLOWER") != 0;
+
+            std::printf("%-32s %10.3f %10.3f %7.2fx %10.1f %10.1f %10s %10s  %s\n", row.name, ms[1], ms[0], speedup,
+                        megabytes[1], megabytes[0], llc[1], llc[0], verdict);
+        }
+
+        const bool passed = accurate && fast;
+        std::printf("%s\n", passed ? "PASS" : "FAIL");
+        return passed ? 0 : 1;
+    }
+
+    // CaptureEngine's lifecycle around a fake session. Every fail_every-th start or resize throws
+    // while building it, the way CreateFreeThreaded and Recreate do on a lost device. Pool depth
+    // requests from other threads are applied by the next frame, as OnFrameArrived does.
+    class FakeCaptureSource
+    {
+    public:
+        explicit FakeCaptureSource(uint32_t fail_every) : fail_every_(fail_every) {}
+
+        void StartCapture()
+        {
+            if (!state_.BeginStart()) return;
+
+            try
+            {
+                const int buffers = requested_pool_buffers_.load(std::memory_order_relaxed);
+                session_open_.store(true, std::memory_order_relaxed);
+                std::this_thread::sleep_for(kBuildTime);
+                if (ShouldFail()) throw std::runtime_error("device removed");
+                pool_buffers_.store(buffers, std::memory_order_relaxed);
+            }
+            catch (...)
+            {
+                session_open_.store(false, std::memory_order_relaxed);
+                state_.EndStart(false);
+                failed_starts_.fetch_add(1, std::memory_order_relaxed);
+                throw;
+            }
+
+            state_.EndStart(true);
+            starts_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void SetFramePoolBuffers(int buffers) { requested_pool_buffers_.store(buffers, std::memory_order_relaxed); }
+        int GetFramePoolBuffers() const { return pool_buffers_.load(std::memory_order_relaxed); }
+        int GetRequestedFramePoolBuffers() const { return requested_pool_buffers_.load(std::memory_order_relaxed); }
+
+        void StopCapture()
+        {
+            if (!state_.BeginStop()) return;
+
+            session_open_.store(false, std::memory_order_relaxed);
+            state_.EndStop();
+            stops_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Like OnFrameArrived, including a resize from inside the frame now and then
+        void DeliverFrame(bool resize)
+        {
+            CaptureStateMachine::FrameScope frame_scope(state_);
+            if (!frame_scope.IsRunning()) return;
+
+            // A stop must not release the session while a frame that saw it running is still here
+            if (!session_open_.load(std::memory_order_relaxed)) unsafe_frames_.fetch_add(1, std::memory_order_relaxed);
+            frames_.fetch_add(1, std::memory_order_relaxed);
+
+            const int requested_buffers = requested_pool_buffers_.load(std::memory_order_relaxed);
+            if (resize || requested_buffers != pool_buffers_.load(std::memory_order_relaxed))
+            {
+                try
+                {
+                    Reinitialize(requested_buffers);
+                }
+                catch (const std::exception&)
+                {
+                }
+            }
+        }
+
+        CaptureState GetState() const { return state_.GetState(); }
+        bool IsSessionOpen() const { return session_open_.load(std::memory_order_relaxed); }
+
+        std::atomic<uint64_t> starts_{ 0 };
+        std::atomic<uint64_t> failed_starts_{ 0 };
+        std::atomic<uint64_t> resizes_{ 0 };
+        std::atomic<uint64_t> failed_resizes_{ 0 };
+        std::atomic<uint64_t> stops_{ 0 };
+        std::atomic<uint64_t> frames_{ 0 };
+        std::atomic<uint64_t> unsafe_frames_{ 0 };
+
+    private:
+        // Creating or recreating the pool, long enough for the other threads to run into it
+        static constexpr std::chrono::microseconds kBuildTime{ 20 };
+
+        // Frame threads only, which may overlap
+        bool Reinitialize(int buffers)
+        {
+            if (!state_.BeginResize()) return false;
+
+            try
+            {
+                std::this_thread::sleep_for(kBuildTime);
+                if (ShouldFail()) throw std::runtime_error("device removed");
+            }
+            catch (...)
+            {
+                state_.EndResize();
+                failed_resizes_.fetch_add(1, std::memory_order_relaxed);
+                throw;
+            }
+
+            pool_buffers_.store(buffers, std::memory_order_relaxed);
+            state_.EndResize();
+            resizes_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        bool ShouldFail()
+        {
+            return fail_every_ > 0 && attempts_.fetch_add(1, std::memory_order_relaxed) % fail_every_ == fail_every_ - 1;
+        }
+
+        CaptureStateMachine state_;
+        std::atomic<bool> session_open_{ false };
+        std::atomic<int> pool_buffers_{ 2 };
+        std::atomic<int> requested_pool_buffers_{ 2 };
+        std::atomic<uint32_t> attempts_{ 0 };
+        uint32_t fail_every_;
+    };
+
+    const char* GetStateName(CaptureState state)
+    {
+        switch (state)
+        {
+        case CaptureState::Idle: return "idle";
+        case CaptureState::Starting: return "starting";
+        case CaptureState::Running: return "running";
+        case CaptureState::Resizing: return "resizing";
+        case CaptureState::Stopping: return "stopping";
+        }
+        return "?";
+    }
+
+    // Control threads start, stop and resize the fake source at random while frame threads deliver
+    // into it. Every operation has to return: a start or resize that throws and leaves the state
+    // behind makes the next stop spin forever, so a stall of a few seconds fails the run. After a
+    // final stop the source must be idle with its session released, and start again cleanly.
+    int RunStateCheck(int iterations)
+    {
+        struct Scenario
+        {
+            const char* name;
+            int control_threads;
+            int frame_threads;
+            uint32_t fail_every;
+        };
+        const Scenario scenarios[] =
+        {
+            { "serial, no faults",      1, 0, 0 },
+            { "serial, faults",         1, 0, 3 },
+            { "racing, no faults",      3, 2, 0 },
+            { "racing, faults",         3, 2, 3 },
+            { "racing, every op fails", 3, 2, 1 },
+        };
+
+        std::printf("%-24s %8s %8s %8s %8s %8s %8s %10s %8s %10s %6s\n", "scenario", "starts", "failed", "resizes", "failed", "stops",
+                    "frames", "unsafe", "final", "restart", "pool");
+
+        bool passed = true;
+        for (const Scenario& scenario : scenarios)
+        {
+            FakeCaptureSource source(scenario.fail_every);
+            std::atomic<uint64_t> operations{ 0 };
+            std::atomic<int> control_running{ scenario.control_threads };
+            std::atomic<bool> go{ false };
+
+            std::vector<std::thread> threads;
+            for (int t = 0; t < scenario.control_threads; ++t)
+            {
+                threads.emplace_back([&, t]
+                {
+                    while (!go.load()) std::this_thread::yield();
+                    uint32_t state = 2463534242u + t * 7919u;
+                    for (int i = 0; i < iterations; ++i)
+                    {
+                        state ^= state << 13;
+                        state ^= state >> 17;
+                        state ^= state << 5;
+                        try
+                        {
+                            switch (state % 3)
+                            {
+                            case 0: source.StartCapture(); break;
+                            case 1: source.StopCapture(); break;
+                            default: source.SetFramePoolBuffers(static_cast<int>(state >> 8) % 8 + 1); break;
+                            }
+                        }
+                        catch (const std::exception&)
+                        {
+                        }
+                        operations.fetch_add(1, std::memory_order_relaxed);
+                        std::this_thread::yield();
+                    }
+                    control_running.fetch_sub(1, std::memory_order_relaxed);
+                });
+            }
+            for (int t = 0; t < scenario.frame_threads; ++t)
+            {
+                threads.emplace_back([&, t]
+                {
+                    while (!go.load()) std::this_thread::yield();
+                    for (uint64_t frame = t; control_running.load(std::memory_order_relaxed) > 0; ++frame)
+                    {
+                        source.DeliverFrame(frame % 16 == 15);
+                        std::this_thread::sleep_for(std::chrono::microseconds(100));
+                    }
+                });
+            }
+
+            go.store(true);
+
+            // No operation takes more than a handoff; a stall means one is spinning on a stuck state
+            uint64_t last_operations = ~0ull;
+            auto last_progress = std::chrono::steady_clock::now();
+            while (control_running.load(std::memory_order_relaxed) > 0)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                const uint64_t now_operations = operations.load(std::memory_order_relaxed);
+                if (now_operations != last_operations)
+                {
+                    last_operations = now_operations;
+                    last_progress = std::chrono::steady_clock::now();
+                }
+                else if (std::chrono::steady_clock::now() - last_progress > std::chrono::seconds(5))
+                {
+                    std::printf("%-24s stalled after %llu operations in state %s\nFAIL\n", scenario.name,
+                                static_cast<unsigned long long>(now_operations), GetStateName(source.GetState()));
+                    std::fflush(stdout);
+                    std::_Exit(1);
+                }
+            }
+            for (std::thread& thread : threads) thread.join();
+
+            // Pool depth requests racing frames that resize: the last one reaches the pool within a few frames
+            const char* pool = "-";
+            for (int attempt = 0; attempt < 8 && source.GetState() != CaptureState::Running; ++attempt)
+            {
+                try
+                {
+                    source.StartCapture();
+                }
+                catch (const std::exception&)
+                {
+                }
+            }
+            if (source.GetState() == CaptureState::Running)
+            {
+                std::atomic<bool> requesting{ true };
+                std::thread frame_thread([&]
+                {
+                    while (requesting.load()) source.DeliverFrame(true);
+                });
+                for (int i = 0; i < 64; ++i)
+                {
+                    source.SetFramePoolBuffers(i * 5 % 8 + 1);
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                }
+                requesting.store(false);
+                frame_thread.join();
+
+                for (int i = 0; i < 32 && source.GetFramePoolBuffers() != source.GetRequestedFramePoolBuffers(); ++i) source.DeliverFrame(false);
+                pool = source.GetFramePoolBuffers() == source.GetRequestedFramePoolBuffers() ? "ok" : "lost";
+            }
+
+            source.StopCapture();
+            const CaptureState final_state = source.GetState();
+            const bool released = !source.IsSessionOpen();
+
+            // Whatever the run left behind, a start either runs or throws and leaves the source idle
+            bool restarts = false;
+            try
+            {
+                source.StartCapture();
+                restarts = source.GetState() == CaptureState::Running;
+            }
+            catch (const std::exception&)
+            {
+                restarts = source.GetState() == CaptureState::Idle;
+            }
+            source.StopCapture();
+
+            const uint64_t unsafe = source.unsafe_frames_.load();
+            const bool ok = final_state == CaptureState::Idle && released && restarts && source.GetState() == CaptureState::Idle && unsafe == 0 &&
+                            std::strcmp(pool, "lost") != 0;
+            passed = passed && ok;
+
+            std::printf("%-24s %8llu %8llu %8llu %8llu %8llu %8llu %10llu %8s %10s %6s\n", scenario.name,
+                        static_cast<unsigned long long>(source.starts_.load()), static_cast<unsigned long long>(source.failed_starts_.load()),
+                        static_cast<unsigned long long>(source.resizes_.load()), static_cast<unsigned long long>(source.failed_resizes_.load()),
+                        static_cast<unsigned long long>(source.stops_.load()), static_cast<unsigned long long>(source.frames_.load()),
+                        static_cast<unsigned long long>(unsafe), GetStateName(final_state), restarts ? "ok" : "stuck", pool);
+        }
+
+        std::printf("%s\n", passed ? "PASS" : "FAIL");
+        return passed ? 0 : 1;
+    }
+
+    int Run(int argc, char* argv[])
+    {
+        std::string filter;
+        std::string save_baseline_path;
+        std::string baseline_path;
+        std::filesystem::path raw_directory = std::filesystem::temp_directory_path();
+        double min_time = 0.5;
+        double threshold_percent = 10.0;
+        double pipeline_seconds = 0.0;
+        uint64_t transcode_frames = 0;
+        int hdr_accuracy_frames = 0;
+        double autotune_seconds = 0.0;
+        int dirty_check_frames = 0;
+        int stride_check_frames = 0;
+        int pool_check_frames = 0;
+        int stream_check_frames = 0;
+        int clip_check_frames = 0;
+        int alloc_check_frames = 0;
+        int simulcast_frames = 0;
+        int snapshot_count = 0;
+        double time_lapse_seconds = 0.0;
+        int shared_frames = 0;
+        int filter_chain_frames = 0;
+        int state_check_iterations = 0;
+
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            std::string arg = argv[i];
+            if (arg == "--filter") filter = argv[i + 1];
+            else if (arg == "--min-time") min_time = std::atof(argv[i + 1]);
+            else if (arg == "--save-baseline") save_baseline_path = argv[i + 1];
+            else if (arg == "--baseline") baseline_path = argv[i + 1];
+            else if (arg == "--threshold") threshold_percent = std::atof(argv[i + 1]);
+            else if (arg == "--raw-dir") raw_directory = argv[i + 1];
+            else if (arg == "--pipeline") pipeline_seconds = std::atof(argv[i + 1]);
+            else if (arg == "--transcode") transcode_frames = std::strtoull(argv[i + 1], nullptr, 10);
+            else if (arg == "--hdr-accuracy") hdr_accuracy_frames = std::atoi(argv[i + 1]);
+            else if (arg == "--autotune") autotune_seconds = std::atof(argv[i + 1]);
+            else if (arg == "--dirty-check") dirty_check_frames = std::atoi(argv[i + 1]);
+            else if (arg == "--stride-check") stride_check_frames = std::atoi(argv[i + 1]);
+            else if (arg == "--pool-check") pool_check_frames = std::atoi(argv[i + 1]);
+            else if (arg == "--stream-check") stream_check_frames = std::atoi(argv[i + 1]);
+            else if (arg == "--clip-check") clip_check_frames = std::atoi(argv[i + 1]);
+            else if (arg == "--alloc-check") alloc_check_frames = std::atoi(argv[i + 1]);
+            else if (arg == "--simulcast") simulcast_frames = std::atoi(argv[i + 1]);
+            else if (arg == "--snapshot") snapshot_count = std::atoi(argv[i + 1]);
+            else if (arg == "--time-lapse") time_lapse_seconds = std::atof(argv[i + 1]);
+            else if (arg == "--shared-frames") shared_frames = std::atoi(argv[i + 1]);
+            else if (arg == "--filter-chain") filter_chain_frames = std::atoi(argv[i + 1]);
+            else if (arg == "--state-check") state_check_iterations = std::atoi(argv[i + 1]);
+            else
+            {
+                std::cerr << "Unknown option " << arg << std::endl;
+                return 2;
+            }
+        }
+
+        if (pipeline_seconds > 0.0)
+        {
+            return RunPipelineBenchmark(pipeline_seconds);
+        }
+
+        if (transcode_frames > 0)
+        {
+            return RunTranscodeBenchmark(transcode_frames, raw_directory);
+        }
+
+        if (hdr_accuracy_frames > 0)
+        {
+            return RunHdrAccuracy(hdr_accuracy_frames);
+        }
+
+        if (autotune_seconds > 0.0)
+        {
+            return RunAutoTuneSimulation(autotune_seconds);
+        }
+
+        if (dirty_check_frames > 0)
+        {
+            return RunDirtyCheck(dirty_check_frames);
+        }
+
+        if (stride_check_frames > 0)
+        {
+            return RunStrideCheck(stride_check_frames, raw_directory);
+        }
+
+        if (pool_check_frames > 0)
+        {
+            return RunPoolCheck(pool_check_frames);
+        }
+
+        if (stream_check_frames > 0)
+        {
+            return RunStreamCheck(stream_check_frames);
+        }
+
+        if (clip_check_frames > 0)
+        {
+            return RunClipCheck(clip_check_frames, raw_directory);
+        }
+
+        if (alloc_check_frames > 0)
+        {
+            return RunAllocCheck(alloc_check_frames, raw_directory);
+        }
+
+        if (simulcast_frames > 0)
+        {
+            return RunSimulcastBenchmark(simulcast_frames);
+        }
+
+        if (snapshot_count > 0)
+        {
+            return RunSnapshotBenchmark(snapshot_count, raw_directory);
+        }
+
+        if (time_lapse_seconds > 0.0)
+        {
+            return RunTimeLapseBenchmark(time_lapse_seconds);
+        }
+
+        if (shared_frames > 0)
+        {
+            return RunSharedFramesBenchmark(shared_frames);
+        }
+
+        if (filter_chain_frames > 0)
+        {
+            return RunFilterChainBenchmark(filter_chain_frames);
+        }
+
+        if (state_check_iterations > 0)
+        {
+            return RunStateCheck(state_check_iterations);
+        }
+
+        std::vector<std::unique_ptr<Benchmark>> benchmarks;
+        benchmarks.emplace_back(new SurfaceReadbackCopy());
+        benchmarks.emplace_back(new StridedCopy());
+        benchmarks.emplace_back(new FrameHash());
+        benchmarks.emplace_back(new TileDiff());
+        benchmarks.emplace_back(new ColorConvertNv12());
+        for (int percent : { 1, 10, 50 })
+        {
+            benchmarks.emplace_back(new DirtyRegionUpdate(DirtyRegionUpdate::Stage::Copy, percent));
+            benchmarks.emplace_back(new DirtyRegionUpdate(DirtyRegionUpdate::Stage::Nv12, percent));
+            benchmarks.emplace_back(new DirtyRegionUpdate(DirtyRegionUpdate::Stage::Track, percent));
+        }
+        benchmarks.emplace_back(new ScRgbToP010());
+        benchmarks.emplace_back(new ScRgbToneMap());
+        benchmarks.emplace_back(new ScaleTo540p());
+        benchmarks.emplace_back(new PreviewDownsample());
+        benchmarks.emplace_back(new SceneDetect());
+        benchmarks.emplace_back(new QualityCompare());
+        benchmarks.emplace_back(new FrameTrace(false));
+        benchmarks.emplace_back(new FrameTrace(true));
+        benchmarks.emplace_back(new MuxPacketWrite());
+        benchmarks.emplace_back(new TsMux());
+        benchmarks.emplace_back(new RawFrameWrite(raw_directory, RawFrameWrite::Source::Vector));
+        benchmarks.emplace_back(new RawFrameWrite(raw_directory, RawFrameWrite::Source::Pooled));
+        benchmarks.emplace_back(new RawFrameWrite(raw_directory, RawFrameWrite::Source::Nv12));
+        benchmarks.emplace_back(new RawFrameWrite(raw_directory, RawFrameWrite::Source::Padded));
+
+        std::map<std::string, double> baseline;
+        if (!baseline_path.empty())
+        {
+            baseline = LoadBaseline(baseline_path);
+        }
+
+        std::ostringstream saved;
+        int regressions = 0;
+
+        std::printf("%-24s %-6s %12s %10s %16s %10s\n", "kernel", "res", "ns/frame", "GB/s", "frames/core-s", "vs base");
+
+        for (auto& benchmark : benchmarks)
+        {
+            if (!filter.empty() && std::string(benchmark->Name()).find(filter) == std::string::npos) continue;
+
+            for (const Resolution& resolution : kResolutions)
+            {
+                Result result = Measure(*benchmark, resolution, min_time);
+                saved << result.key << " " << result.ns_per_frame << "\n";
+
+                std::string comparison = "-";
+                auto base = baseline.find(result.key);
+                if (base != baseline.end())
+                {
+                    double delta_percent = (result.ns_per_frame / base->second - 1.0) * 100.0;
+                    char text[32];
+                    std::snprintf(text, sizeof(text), "%+.1f%%%s", delta_percent, delta_percent > threshold_percent ? " !!" : "");
+                    comparison = text;
+                    regressions += delta_percent > threshold_percent ? 1 : 0;
+                }
+
+                std::printf("%-24s %-6s %12.0f %10.2f %16.1f %10s\n", benchmark->Name(), resolution.name,
+                            result.ns_per_frame, result.gb_per_second, result.frames_per_core_second, comparison.c_str());
+            }
+        }
+
+        if (!save_baseline_path.empty())
+        {
+            std::ofstream(save_baseline_path) << saved.str();
+        }
+
+        if (regressions > 0)
+        {
+            std::printf("%d regression(s) above %.1f%%\n", regressions, threshold_percent);
+            return 1;
+        }
+
+        return 0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    return KernelBenchmarks::Run(argc, argv);
+}
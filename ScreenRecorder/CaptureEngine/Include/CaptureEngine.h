@@ -22,8 +22,14 @@
 #include <functional>
 #include <winrt/impl/windows.graphics.capture.0.h>
 #include <Windows.Graphics.Capture.Interop.h>
+#include <atomic>
 #include <mutex>
 
+#include "CaptureStateMachine.h"
+#include "DirtyRegion.h"
+#include "FrameDescriptor.h"
+#include "FrameSource.h"
+
 namespace winrt
 {
     using namespace winrt::Windows::Graphics::DirectX::Direct3D11;
@@ -34,8 +40,6 @@ namespace winrt
 
 using namespace Microsoft::WRL;
 
-using OutputBufferCallback = std::function<void(std::vector<uint8_t>&, int, int)>;
-
 class CaptureEngine 
 {
 
@@ -43,7 +47,6 @@ public:
     CaptureEngine(int monitor_number, int width, int height);
 
     bool Initialize();
-    void Reinitialize();
     void StartCapture();
     void StopCapture();
     void SetOutputCallback(OutputBufferCallback output_callback);
@@ -53,6 +56,19 @@ public:
 
     int  GetCaptureItemWidth();
     int  GetCaptureItemHeight();
+    // FP16 scRGB frames (8 bytes per pixel) instead of BGRA; keeps HDR content above SDR white.
+    // Ignored unless idle; applies from the next StartCapture.
+    void SetHdrCapture(bool enabled);
+    bool IsHdrCapture() const { return pixel_format_ == winrt::DirectXPixelFormat::R16G16B16A16Float; }
+    int  GetBytesPerPixel() const { return IsHdrCapture() ? 8 : 4; }
+    // Frame pool depth, 2 unless tuned. From any thread: a running session recreates its pool from
+    // the frame thread at the next frame, otherwise the next StartCapture uses it.
+    void SetFramePoolBuffers(int buffers);
+    // What the pool was last made with
+    int  GetFramePoolBuffers() const { return pool_buffers_.load(std::memory_order_relaxed); }
+    // Longest a pool buffer was held by the frame callback since the last call
+    uint64_t TakeMaxFrameHoldNs();
+    CaptureState GetState() const { return state_.GetState(); }
 
     ~ CaptureEngine();
 
@@ -60,22 +76,31 @@ private:
     void OnFrameArrived(
         winrt::Windows::Graphics::Capture::Direct3D11CaptureFramePool sender,
         winrt::Windows::Foundation::IInspectable const& args);
+    // Frame thread only. Recreates the running pool; false if a stop or an overlapping frame's
+    // resize holds the state, leaving the change for the next frame.
+    bool Reinitialize(int buffers, int width, int height);
 
     winrt::GraphicsCaptureItem GetMonitorCaptureItemFromIndex(int monitor_index);
     winrt::GraphicsCaptureItem GetWindowCaptureItem(HWND window_handle);
     winrt::GraphicsCaptureItem GetMonitorCaptureItem(HMONITOR monitor);
 
-    bool ConvertSurfaceToImageBuffer(winrt::IDirect3DSurface const& surface, int input_width, int input_height, 
-                                     std::vector<uint8_t>& image_buffer, int& output_width, int& output_height);
+    // Copies only dirty into the staging texture unless it had to be (re)made, in which case dirty
+    // becomes full, then maps it into frame. The caller unmaps.
+    bool MapSurface(winrt::IDirect3DSurface const& surface, int input_width, int input_height, DirtyRegion& dirty,
+                    FrameDescriptor& frame);
 
 
     ComPtr<ID3D11Texture2D> GetTextureFromSurface(winrt::IDirect3DSurface const& surface);
 
+    // Closes the session and the frame pool, whichever exist
+    void ReleaseSession();
+
 
     OutputBufferCallback output_callback;
 
-    int width_;
-    int height_;
+    // Changed by the frame thread on a resize, read by overlapping frames
+    std::atomic<int> width_;
+    std::atomic<int> height_;
     int monitor_number_;
 
     bool is_application_capturing;
@@ -93,6 +118,18 @@ private:
     winrt::com_ptr<IDXGISwapChain3> swap_chain;
 
     ComPtr<ID3D11Texture2D> current_frame;
-	std::mutex mutex_;
+    ComPtr<ID3D11Texture2D> staging_texture_;   // Last frame read back, mapped while the callback runs
+    std::mutex readback_mutex_;
+    std::atomic<bool> readback_skipped_{ false };
+    bool reports_dirty_regions_ = false;
+    DirtyRegionTracker dirty_tracker_;
+
+    static constexpr uint64_t kNoReadback = ~0ull;
+    uint64_t readback_epoch_ = kNoReadback;      // Epoch of the frame in the staging texture
+
+    CaptureStateMachine state_;
+    std::atomic<int> pool_buffers_{ 2 };
+    std::atomic<int> requested_pool_buffers_{ 2 };  // Applied by the next frame when it differs
+    std::atomic<uint64_t> max_hold_ns_{ 0 };
 
 };
\ No newline at end of file
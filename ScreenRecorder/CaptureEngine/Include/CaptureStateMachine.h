@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Capture session lifecycle. Control operations move between states with CAS so
+// the frame path only ever does atomic loads and never waits on a lock.
+enum class CaptureState : uint32_t
+{
+    Idle,
+    Starting,
+    Running,
+    Resizing,
+    Stopping
+};
+
+// The lifecycle a capture source runs through, kept apart from the platform code so it can be
+// exercised without a capture device. Every Begin* that returns true must be followed by its
+// End*, whether or not the work in between succeeded, or StopCapture waits forever.
+class CaptureStateMachine
+{
+public:
+    // Idle -> Starting
+    bool BeginStart();
+    // Starting -> Running with a new epoch, or back to Idle when building the session failed
+    void EndStart(bool started);
+
+    // Running -> Resizing
+    bool BeginResize();
+    // Back to Running with a new epoch. A failed resize still ends here so a stop can tear down.
+    void EndResize();
+
+    // Running -> Stopping, waiting out a start or resize in progress, then bumps the epoch and
+    // waits for frames in flight. False if already idle or stopping.
+    bool BeginStop();
+    // Stopping -> Idle once the session is released
+    void EndStop();
+
+    // Held by the frame callback for as long as it touches the session's resources
+    class FrameScope
+    {
+    public:
+        explicit FrameScope(CaptureStateMachine& machine);
+        ~FrameScope();
+        FrameScope(const FrameScope&) = delete;
+        FrameScope& operator=(const FrameScope&) = delete;
+
+        bool IsRunning() const { return running_; }
+        uint64_t GetEpoch() const { return epoch_; }
+
+    private:
+        CaptureStateMachine& machine_;
+        bool running_ = false;
+        uint64_t epoch_ = 0;
+    };
+
+    CaptureState GetState() const { return state_.load(std::memory_order_acquire); }
+    uint64_t GetEpoch() const { return epoch_.load(std::memory_order_acquire); }
+
+private:
+    bool TryTransition(CaptureState from, CaptureState to);
+    void WaitForFramesInFlight();
+
+    std::atomic<CaptureState> state_{ CaptureState::Idle };
+    std::atomic<uint64_t> epoch_{ 0 };          // Bumped on every start/resize/stop; frames from an older epoch are dropped
+    std::atomic<int> frames_in_flight_{ 0 };
+};
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <functional>
+
+#include "DirtyRegion.h"
+#include "FrameDescriptor.h"
+
+// dirty is what changed since the previous call. The frame's rows point into the source's own
+// memory (a mapped staging texture for captures) and are only valid during the call.
+using OutputBufferCallback = std::function<void(const FrameDescriptor&, const DirtyRegion&)>;
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "DirtyRegion.h"
+#include "FrameSource.h"
+
+enum class SyntheticPattern
+{
+    Motion,         // Gradient with a bouncing box and a scrolling bar; something changes every frame
+    Slides          // Presentation-like: static slides, a page scroll on each, hard cuts between them
+};
+
+// Generates deterministic BGRA frames on its own thread and feeds them through the
+// same OutputBufferCallback as CaptureEngine. Used for headless and repeatable runs.
+class SyntheticFrameSource
+{
+public:
+    SyntheticFrameSource(int width, int height, int fps, SyntheticPattern pattern = SyntheticPattern::Motion);
+    ~SyntheticFrameSource();
+
+    void SetOutputCallback(OutputBufferCallback output_callback);
+    // FP16 scRGB frames like an HDR capture: SDR white at 203 nits, the scrolling bar a 1000-nit
+    // highlight. Call before StartCapture.
+    void SetHdrOutput(bool enabled) { hdr_output_ = enabled; }
+    void StartCapture();
+    void StopCapture();
+
+    uint64_t GetFrameCount() const { return frame_count_.load(std::memory_order_relaxed); }
+
+private:
+    void Run();
+    void RenderFrame(uint64_t frame_index, std::vector<uint8_t>& image_buffer);
+    void ConvertToHdr(const std::vector<uint8_t>& image_buffer);
+    void RenderSlideFrame(uint64_t frame_index, std::vector<uint8_t>& image_buffer);
+    void RenderSlideRow(int slide, int document_row, uint8_t* row) const;
+
+    OutputBufferCallback output_callback;
+
+    int width_;
+    int height_;
+    int fps_;                                   // 0 = unpaced, deliver frames as fast as the consumer takes them
+    SyntheticPattern pattern_;
+
+    std::vector<uint8_t> background_;
+    std::vector<uint8_t> slide_;                // Current slide frame, scrolled in place
+    int slide_index_ = -1;
+    int slide_scroll_ = 0;
+    int highlight_top_ = 0;                     // Rows of the current frame shown as an HDR highlight
+    int highlight_bottom_ = 0;
+    bool hdr_output_ = false;
+    std::vector<uint8_t> hdr_buffer_;
+    DirtyRegionTracker dirty_tracker_;
+    std::thread worker_;
+    std::atomic<bool> is_running_{ false };
+    std::atomic<uint64_t> frame_count_{ 0 };
+};
@@ -1,5 +1,13 @@
 ﻿#include "CaptureEngine.h"
+#include "FrameKernels.h"
+#include "FrameTracer.h"
+#include "HotPathCounters.h"
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <mutex>
+#include <thread>
+#include <winrt/Windows.Foundation.Metadata.h>
 
 CaptureEngine::CaptureEngine(int monitor_number, int width, int height)
     : monitor_number_(monitor_number), width_(width), height_(height) 
@@ -15,7 +23,7 @@ CaptureEngine::CaptureEngine(int monitor_number, int width, int height)
 
 bool CaptureEngine::Initialize()
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    if (GetState() != CaptureState::Idle) return false;
 
     D3D11_CREATE_DEVICE_FLAG create_device_flags = D3D11_CREATE_DEVICE_BGRA_SUPPORT;
 
@@ -50,52 +58,122 @@ bool CaptureEngine::Initialize()
     return true;
 }
 
-void CaptureEngine::Reinitialize()
+bool CaptureEngine::Reinitialize(int buffers, int width, int height)
 {
-	if (frame_pool_)
-	{
-        frame_pool_.Recreate(
-            d3d_device_,
-            pixel_format_,
-            2,
-            { width_, height_ });
-	}
+    if (!state_.BeginResize()) return false;
+
+    try
+    {
+        if (frame_pool_)
+        {
+            frame_pool_.Recreate(
+                d3d_device_,
+                pixel_format_,
+                buffers,
+                { width, height });
+        }
+    }
+    catch (...)
+    {
+        // Device lost; the old pool stays in place for StopCapture to close
+        state_.EndResize();
+        throw;
+    }
+
+    width_ = width;
+    height_ = height;
+    pool_buffers_.store(buffers, std::memory_order_relaxed);
+    state_.EndResize();
+    return true;
 }
 
 
 void CaptureEngine::StartCapture()
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-
     if (!capture_item_) return;
+    if (!state_.BeginStart()) return;
 
-	frame_pool_ = winrt::Direct3D11CaptureFramePool::CreateFreeThreaded(
-		d3d_device_,
-        pixel_format_,
-		2,
-        {width_, height_});
+    try
+    {
+        const int buffers = requested_pool_buffers_.load(std::memory_order_relaxed);
+        frame_pool_ = winrt::Direct3D11CaptureFramePool::CreateFreeThreaded(
+            d3d_device_,
+            pixel_format_,
+            buffers,
+            {width_.load(), height_.load()});
+        pool_buffers_.store(buffers, std::memory_order_relaxed);
 
-    frame_pool_.FrameArrived({ this, &CaptureEngine::OnFrameArrived });
+        frame_arrived_token = frame_pool_.FrameArrived({ this, &CaptureEngine::OnFrameArrived });
     
-    session_ = frame_pool_.CreateCaptureSession(capture_item_);
-    session_.StartCapture();
+        session_ = frame_pool_.CreateCaptureSession(capture_item_);
+
+        // Newer builds report what changed between frames; older ones fall back to a tile diff
+        reports_dirty_regions_ = winrt::Windows::Foundation::Metadata::ApiInformation::IsPropertyPresent(
+            L"Windows.Graphics.Capture.GraphicsCaptureSession", L"DirtyRegionMode");
+        if (reports_dirty_regions_)
+        {
+            session_.DirtyRegionMode(winrt::GraphicsCaptureDirtyRegionMode::ReportOnly);
+        }
+    }
+    catch (...)
+    {
+        ReleaseSession();
+        state_.EndStart(false);
+        throw;
+    }
+
+    staging_texture_.Reset();
+    dirty_tracker_.Reset();
+
+    state_.EndStart(true);
+
+    try
+    {
+        session_.StartCapture();
+    }
+    catch (...)
+    {
+        StopCapture();
+        throw;
+    }
 }
 
 void CaptureEngine::StopCapture()
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    if (!state_.BeginStop()) return;
 
+    ReleaseSession();
+
+    state_.EndStop();
+}
+
+void CaptureEngine::ReleaseSession()
+{
     if (session_) 
     {
         session_.Close();
+        session_ = nullptr;
     }
 
     if (frame_pool_)
     {
+        frame_pool_.FrameArrived(frame_arrived_token);
         frame_pool_.Close();
+        frame_pool_ = nullptr;
     }
 }
 
+void CaptureEngine::SetFramePoolBuffers(int buffers)
+{
+    // Only the frame thread recreates the pool, so a request can't lose a race with a resize
+    requested_pool_buffers_.store(std::clamp(buffers, 1, 8), std::memory_order_relaxed);
+}
+
+uint64_t CaptureEngine::TakeMaxFrameHoldNs()
+{
+    return max_hold_ns_.exchange(0, std::memory_order_relaxed);
+}
+
 void CaptureEngine::SetOutputCallback(OutputBufferCallback output_callback)
 {
     this->output_callback = output_callback;
@@ -120,6 +198,13 @@ bool CaptureEngine::CaptureMonitor(HMONITOR monitor)
     return capture_item_ != nullptr;
 }
 
+void CaptureEngine::SetHdrCapture(bool enabled)
+{
+    if (GetState() != CaptureState::Idle) return;
+
+    pixel_format_ = enabled ? winrt::DirectXPixelFormat::R16G16B16A16Float : winrt::DirectXPixelFormat::B8G8R8A8UIntNormalized;
+}
+
 int CaptureEngine::GetCaptureItemWidth()
 {
     if (capture_item_)
@@ -147,31 +232,98 @@ CaptureEngine::~CaptureEngine()
 
 void CaptureEngine::OnFrameArrived(winrt::Windows::Graphics::Capture::Direct3D11CaptureFramePool sender, winrt::Windows::Foundation::IInspectable const& args)
 {
+    // Keeps StopCapture from closing the pool underneath us
+    CaptureStateMachine::FrameScope frame_scope(state_);
+    if (!frame_scope.IsRunning()) return;
+
+    const uint64_t frame_epoch = frame_scope.GetEpoch();
+
+    // The pool buffer goes back when frame is released, after this guard's scope starts
+    struct HoldGuard
+    {
+        std::atomic<uint64_t>& max_hold_ns;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        ~HoldGuard()
+        {
+            const uint64_t held = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            uint64_t current = max_hold_ns.load(std::memory_order_relaxed);
+            while (held > current && !max_hold_ns.compare_exchange_weak(current, held, std::memory_order_relaxed)) {}
+        }
+    } hold_guard{ max_hold_ns_ };
+
     auto frame = sender.TryGetNextFrame();
+    if (!frame) return;
+    const auto arrival_time = std::chrono::steady_clock::now();
+
+    FrameTracer::BeginFrame();
+    FrameTracer::SetThreadName("capture");
+    TraceSpan arrival_span(TraceStage::Arrival);
+
     auto surface = frame.Surface();
 
     int input_width = static_cast<int>(frame.ContentSize().Width);
     int input_height = static_cast<int>(frame.ContentSize().Height);
 
-    if (!is_application_capturing && (input_width != width_ || input_height != height_)) //For Resolution changes 
+    // Resolution changes and pool depth requests. Size and count are only committed once the pool
+    // has them, so whatever doesn't get through (a stop, an overlapping frame, a lost device) is
+    // seen again by the next frame.
+    const bool is_resized = !is_application_capturing && (input_width != width_ || input_height != height_);
+    const int requested_buffers = requested_pool_buffers_.load(std::memory_order_relaxed);
+    if (is_resized || requested_buffers != pool_buffers_.load(std::memory_order_relaxed))
     {
-		width_ = input_width;
-		height_ = input_height;
-
-		Reinitialize();
+		try
+		{
+			Reinitialize(requested_buffers, is_resized ? input_width : width_.load(), is_resized ? input_height : height_.load());
+		}
+		catch (...)
+		{
+			// Nothing above the event handler can take it
+		}
 		return;
     }
 
-    int output_width = 0;
-    int output_height = 0;
-	std::vector<uint8_t> image_buffer;
+    // The staging texture is shared between frames; free-threaded arrivals that overlap skip the late one
+    std::unique_lock<std::mutex> readback_lock(readback_mutex_, std::try_to_lock);
+    if (!readback_lock.owns_lock())
+    {
+        readback_skipped_.store(true, std::memory_order_relaxed);
+        return;
+    }
 
-    if (output_callback
-		&& ConvertSurfaceToImageBuffer(surface, input_width, input_height, image_buffer, output_width, output_height)
-        && output_width > 0 && output_height > 0)
+    // Reported regions are relative to the previous frame, so they only help if that one was read back
+    const bool skipped = readback_skipped_.exchange(false, std::memory_order_relaxed);
+    DirtyRegion dirty;
+    if (reports_dirty_regions_ && !is_application_capturing && !skipped && readback_epoch_ == frame_epoch)
     {
-        output_callback(image_buffer, output_width, output_height);
+        dirty = DirtyRegion(input_width, input_height);
+        for (auto const& rect : frame.DirtyRegions())
+        {
+            dirty.Add(DirtyRect{ rect.X, rect.Y, rect.Width, rect.Height });
+        }
     }
+
+    FrameDescriptor descriptor;
+    descriptor.timestamp = arrival_time;
+    if (!output_callback || !MapSurface(surface, input_width, input_height, dirty, descriptor))
+    {
+        readback_epoch_ = kNoReadback;
+        return;
+    }
+
+    readback_epoch_ = frame_epoch;
+    if (!reports_dirty_regions_ || is_application_capturing)
+    {
+        dirty = dirty_tracker_.Update(descriptor.planes[0].data, descriptor.planes[0].pitch, descriptor.width, descriptor.height,
+                                      descriptor.GetBytesPerPixel());
+    }
+
+    // The callback reads straight from the mapped texture, padded rows and all
+    if (state_.GetEpoch() == frame_epoch)
+    {
+        output_callback(descriptor, dirty);
+    }
+
+    d3d_context_->Unmap(staging_texture_.Get(), 0);
 }
 
 winrt::Windows::Graphics::Capture::GraphicsCaptureItem CaptureEngine::GetMonitorCaptureItemFromIndex(int monitor_index)
@@ -219,12 +371,9 @@ winrt::Windows::Graphics::Capture::GraphicsCaptureItem CaptureEngine::GetMonitor
     return item;
 }
 
-bool CaptureEngine::ConvertSurfaceToImageBuffer(winrt::IDirect3DSurface const& surface, int input_width, int input_height, 
-                                                std::vector<uint8_t>& image_buffer, int& output_width, int& output_height)
+bool CaptureEngine::MapSurface(winrt::IDirect3DSurface const& surface, int input_width, int input_height, DirtyRegion& dirty,
+                               FrameDescriptor& frame)
 {
-
-	std::lock_guard<std::mutex> lock(mutex_);
-
 	if (!surface) return false;
     bool result = false;
 
@@ -249,14 +398,40 @@ bool CaptureEngine::ConvertSurfaceToImageBuffer(winrt::IDirect3DSurface const& s
 			staging_desc.Height = height_;
 		}
 
-        size_t buffer_size = staging_desc.Width * staging_desc.Height * 4;
+        TraceSpan readback_span(TraceStage::Readback);
 
-        ComPtr<ID3D11Texture2D> staging_texture;
-        HRESULT hr = d3d11_device->CreateTexture2D(&staging_desc, nullptr, staging_texture.GetAddressOf());
+        // The staging texture keeps the previous frame, so only dirty rects need the GPU copy.
+        // Window capture centres content of varying size and starts from a cleared texture each time.
+        D3D11_TEXTURE2D_DESC kept_desc{};
+        if (staging_texture_) staging_texture_->GetDesc(&kept_desc);
+        if (is_application_capturing || !staging_texture_ || kept_desc.Width != staging_desc.Width
+            || kept_desc.Height != staging_desc.Height || kept_desc.Format != staging_desc.Format)
+        {
+            staging_texture_.Reset();
+            HRESULT hr = d3d11_device->CreateTexture2D(&staging_desc, nullptr, staging_texture_.GetAddressOf());
+            if (FAILED(hr)) return false;
+
+            dirty = DirtyRegion();
+        }
+        ID3D11Texture2D* staging_texture = staging_texture_.Get();
 
-        if (!is_application_capturing)
+        dirty = dirty.ForFrame(staging_desc.Width, staging_desc.Height);
+
+        const uint64_t bytes_per_pixel = GetBytesPerPixel();
+        if (!is_application_capturing && dirty.IsFull())
+        {
+            d3d_context_->CopyResource(staging_texture, current_frame_texture.Get());
+            HotPathCounters::CountCopy(TraceStage::Readback, static_cast<uint64_t>(staging_desc.Width) * staging_desc.Height * bytes_per_pixel);
+        }
+        else if (!is_application_capturing)
         {
-            d3d_context_->CopyResource(staging_texture.Get(), current_frame_texture.Get());
+            HotPathCounters::CountCopy(TraceStage::Readback, dirty.GetArea() * bytes_per_pixel);
+            for (const DirtyRect& rect : dirty.GetRects())
+            {
+                D3D11_BOX box = { static_cast<UINT>(rect.x), static_cast<UINT>(rect.y), 0,
+                                  static_cast<UINT>(rect.x + rect.width), static_cast<UINT>(rect.y + rect.height), 1 };
+                d3d_context_->CopySubresourceRegion(staging_texture, 0, rect.x, rect.y, 0, current_frame_texture.Get(), 0, &box);
+            }
         }
         else
         {
@@ -285,8 +460,9 @@ bool CaptureEngine::ConvertSurfaceToImageBuffer(winrt::IDirect3DSurface const& s
 				offset_y = (height_ - input_height) / 2;
 			}
 
+            HotPathCounters::CountCopy(TraceStage::Readback, static_cast<uint64_t>(input_width) * input_height * bytes_per_pixel);
             d3d_context_->CopySubresourceRegion(
-                staging_texture.Get(),       // Destination texture
+                staging_texture,             // Destination texture
                 0,                           // Subresource index
                 offset_x, offset_y, 0,       // Destination X, Y, Z
                 current_frame_texture.Get(), // Source texture
@@ -294,26 +470,23 @@ bool CaptureEngine::ConvertSurfaceToImageBuffer(winrt::IDirect3DSurface const& s
                 &srcBox                      // Source box
             );
 
-            buffer_size = width_ * height_ * 4;
         }
 
-        image_buffer.reserve(buffer_size);
-
         D3D11_MAPPED_SUBRESOURCE mapped_resource{};
-        hr = d3d_context_->Map(staging_texture.Get(), 0, D3D11_MAP_READ, 0, &mapped_resource);
+        HRESULT hr = d3d_context_->Map(staging_texture, 0, D3D11_MAP_READ, 0, &mapped_resource);
 
         if (SUCCEEDED(hr))
         {
-            uint8_t* src = static_cast<uint8_t*>(mapped_resource.pData);
-            image_buffer.insert(image_buffer.end(), src, src + buffer_size);
+            // Map waits for the GPU copy, so the readback ends here; the caller unmaps
+            readback_span.End();
 
-            output_width = staging_desc.Width;
-            output_height = staging_desc.Height;
+            frame.format = IsHdrCapture() ? FrameFormat::ScRgb : FrameFormat::Bgra;
+            frame.width = staging_desc.Width;
+            frame.height = staging_desc.Height;
+            frame.planes[0] = { static_cast<const uint8_t*>(mapped_resource.pData), static_cast<ptrdiff_t>(mapped_resource.RowPitch) };
 
 			result = true;
         }
-
-        d3d_context_->Unmap(staging_texture.Get(), 0);
     }
     else
     {
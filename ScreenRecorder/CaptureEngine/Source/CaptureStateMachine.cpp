@@ -0,0 +1,80 @@
+#include "CaptureStateMachine.h"
+
+#include <thread>
+
+bool CaptureStateMachine::BeginStart()
+{
+    return TryTransition(CaptureState::Idle, CaptureState::Starting);
+}
+
+void CaptureStateMachine::EndStart(bool started)
+{
+    if (started)
+    {
+        epoch_.fetch_add(1, std::memory_order_acq_rel);
+    }
+    state_.store(started ? CaptureState::Running : CaptureState::Idle, std::memory_order_release);
+}
+
+bool CaptureStateMachine::BeginResize()
+{
+    return TryTransition(CaptureState::Running, CaptureState::Resizing);
+}
+
+void CaptureStateMachine::EndResize()
+{
+    epoch_.fetch_add(1, std::memory_order_acq_rel);
+    state_.store(CaptureState::Running, std::memory_order_release);
+}
+
+bool CaptureStateMachine::BeginStop()
+{
+    CaptureState expected = CaptureState::Running;
+    while (!state_.compare_exchange_weak(expected, CaptureState::Stopping, std::memory_order_acq_rel))
+    {
+        if (expected == CaptureState::Idle || expected == CaptureState::Stopping)
+        {
+            return false;
+        }
+
+        // Starting/Resizing hand back to Running or Idle shortly; wait for that handoff
+        expected = CaptureState::Running;
+        std::this_thread::yield();
+    }
+
+    epoch_.fetch_add(1, std::memory_order_acq_rel);
+    WaitForFramesInFlight();
+    return true;
+}
+
+void CaptureStateMachine::EndStop()
+{
+    state_.store(CaptureState::Idle, std::memory_order_release);
+}
+
+CaptureStateMachine::FrameScope::FrameScope(CaptureStateMachine& machine)
+    : machine_(machine)
+{
+    // Announce the frame before checking state so a stop can't release the session underneath us
+    machine_.frames_in_flight_.fetch_add(1, std::memory_order_seq_cst);
+    running_ = machine_.state_.load(std::memory_order_seq_cst) == CaptureState::Running;
+    epoch_ = machine_.epoch_.load(std::memory_order_acquire);
+}
+
+CaptureStateMachine::FrameScope::~FrameScope()
+{
+    machine_.frames_in_flight_.fetch_sub(1, std::memory_order_release);
+}
+
+bool CaptureStateMachine::TryTransition(CaptureState from, CaptureState to)
+{
+    return state_.compare_exchange_strong(from, to, std::memory_order_acq_rel);
+}
+
+void CaptureStateMachine::WaitForFramesInFlight()
+{
+    while (frames_in_flight_.load(std::memory_order_acquire) > 0)
+    {
+        std::this_thread::yield();
+    }
+}
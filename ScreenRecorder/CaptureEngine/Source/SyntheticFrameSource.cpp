@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "FrameTracer.h"
+#include "HdrKernels.h"
+#include "HotPathCounters.h"
+#include "SyntheticFrameSource.h"
+
+namespace
+{
+    constexpr int kBoxSize = 128;
+    constexpr int kBarHeight = 24;
+
+    // Slides: 6 s each at the nominal rate; static for 2 s, scroll for 2 s, static again
+    constexpr int kSlideSeconds = 6;
+    constexpr int kScrollStartSeconds = 2;
+    constexpr int kScrollSeconds = 2;
+    constexpr int kScrollRowsPerFrame = 6;
+    constexpr int kLineHeight = 36;
+
+    constexpr float kHdrWhiteNits = 203.0f;
+    constexpr float kHdrHighlightNits = 1000.0f;
+
+    uint32_t Mix(uint32_t value)
+    {
+        value ^= value >> 16;
+        value *= 0x7FEB352Du;
+        value ^= value >> 15;
+        value *= 0x846CA68Bu;
+        return value ^ (value >> 16);
+    }
+}
+
+SyntheticFrameSource::SyntheticFrameSource(int width, int height, int fps, SyntheticPattern pattern)
+    : width_(width), height_(height), fps_(fps), pattern_(pattern)
+{
+    output_callback = nullptr;
+    background_.resize(static_cast<size_t>(width_) * height_ * 4);
+
+    for (int y = 0; y < height_; ++y)
+    {
+        uint8_t* row = background_.data() + static_cast<size_t>(y) * width_ * 4;
+        for (int x = 0; x < width_; ++x)
+        {
+            row[x * 4 + 0] = static_cast<uint8_t>((x * 255) / (width_ > 1 ? width_ - 1 : 1));
+            row[x * 4 + 1] = static_cast<uint8_t>((y * 255) / (height_ > 1 ? height_ - 1 : 1));
+            row[x * 4 + 2] = static_cast<uint8_t>(((x / 32) + (y / 32)) % 2 ? 96 : 160);
+            row[x * 4 + 3] = 255;
+        }
+    }
+}
+
+SyntheticFrameSource::~SyntheticFrameSource()
+{
+    StopCapture();
+}
+
+void SyntheticFrameSource::SetOutputCallback(OutputBufferCallback output_callback)
+{
+    this->output_callback = output_callback;
+}
+
+void SyntheticFrameSource::StartCapture()
+{
+    bool expected = false;
+    if (!is_running_.compare_exchange_strong(expected, true)) return;
+
+    frame_count_.store(0, std::memory_order_relaxed);
+    dirty_tracker_.Reset();
+    worker_ = std::thread(&SyntheticFrameSource::Run, this);
+}
+
+void SyntheticFrameSource::StopCapture()
+{
+    is_running_.store(false, std::memory_order_release);
+
+    if (worker_.joinable())
+    {
+        worker_.join();
+    }
+}
+
+void SyntheticFrameSource::Run()
+{
+    using Clock = std::chrono::steady_clock;
+
+    const auto frame_interval = fps_ > 0 ? std::chrono::nanoseconds(1000000000LL / fps_) : std::chrono::nanoseconds(0);
+    auto next_frame_time = Clock::now();
+
+    std::vector<uint8_t> image_buffer;
+    uint64_t frame_index = 0;
+
+    while (is_running_.load(std::memory_order_acquire))
+    {
+        {
+            FrameTracer::BeginFrame();
+            FrameTracer::SetThreadName("synthetic source");
+            TraceSpan arrival_span(TraceStage::Arrival);
+            const auto arrival_time = Clock::now();
+
+            {
+                // Rendering stands in for the GPU readback of a real capture
+                TraceSpan readback_span(TraceStage::Readback);
+                RenderFrame(frame_index, image_buffer);
+                if (hdr_output_) ConvertToHdr(image_buffer);
+                HotPathCounters::CountCopy(TraceStage::Readback, hdr_output_ ? hdr_buffer_.size() : image_buffer.size());
+            }
+
+            if (output_callback)
+            {
+                // Frames are rendered whole, so what changed comes from a diff like on captures without reported regions
+                const FrameDescriptor frame = FrameDescriptor::Packed(hdr_output_ ? hdr_buffer_.data() : image_buffer.data(),
+                                                                      hdr_output_ ? FrameFormat::ScRgb : FrameFormat::Bgra,
+                                                                      width_, height_, arrival_time);
+                const DirtyRegion& dirty = dirty_tracker_.Update(frame.planes[0].data, frame.planes[0].pitch, width_, height_,
+                                                                 frame.GetBytesPerPixel());
+                output_callback(frame, dirty);
+            }
+        }
+
+        ++frame_index;
+        frame_count_.store(frame_index, std::memory_order_relaxed);
+
+        if (fps_ > 0)
+        {
+            next_frame_time += frame_interval;
+            std::this_thread::sleep_until(next_frame_time);
+        }
+    }
+}
+
+void SyntheticFrameSource::ConvertToHdr(const std::vector<uint8_t>& image_buffer)
+{
+    const ptrdiff_t pitch = static_cast<ptrdiff_t>(width_) * 8;
+    hdr_buffer_.resize(static_cast<size_t>(height_) * pitch);
+    HdrKernels::ConvertBgraToScRgb(image_buffer.data(), static_cast<ptrdiff_t>(width_) * 4, width_, height_,
+                                   hdr_buffer_.data(), pitch, kHdrWhiteNits / HdrKernels::kScRgbNits);
+
+    const float boost = kHdrHighlightNits / kHdrWhiteNits;
+    for (int y = highlight_top_; y < highlight_bottom_; ++y)
+    {
+        uint16_t* row = reinterpret_cast<uint16_t*>(hdr_buffer_.data() + y * pitch);
+        for (int x = 0; x < width_ * 4; ++x)
+        {
+            if (x % 4 != 3) row[x] = HdrKernels::FloatToHalf(HdrKernels::HalfToFloat(row[x]) * boost);
+        }
+    }
+}
+
+void SyntheticFrameSource::RenderFrame(uint64_t frame_index, std::vector<uint8_t>& image_buffer)
+{
+    highlight_top_ = 0;
+    highlight_bottom_ = 0;
+
+    if (pattern_ == SyntheticPattern::Slides)
+    {
+        RenderSlideFrame(frame_index, image_buffer);
+        return;
+    }
+
+    image_buffer.resize(background_.size());
+    std::memcpy(image_buffer.data(), background_.data(), background_.size());
+
+    const size_t row_bytes = static_cast<size_t>(width_) * 4;
+
+    // Bouncing box exercises motion, a scrolling bar exercises full-width changes
+    if (width_ > kBoxSize && height_ > kBoxSize)
+    {
+        const int span_x = width_ - kBoxSize;
+        const int span_y = height_ - kBoxSize;
+        int box_x = static_cast<int>((frame_index * 7) % (2 * span_x));
+        int box_y = static_cast<int>((frame_index * 5) % (2 * span_y));
+        box_x = box_x < span_x ? box_x : 2 * span_x - box_x;
+        box_y = box_y < span_y ? box_y : 2 * span_y - box_y;
+
+        for (int y = box_y; y < box_y + kBoxSize; ++y)
+        {
+            uint8_t* pixel = image_buffer.data() + y * row_bytes + static_cast<size_t>(box_x) * 4;
+            for (int x = 0; x < kBoxSize; ++x, pixel += 4)
+            {
+                pixel[0] = 32;
+                pixel[1] = static_cast<uint8_t>(frame_index);
+                pixel[2] = 224;
+            }
+        }
+    }
+
+    if (height_ > kBarHeight)
+    {
+        const int bar_y = static_cast<int>((frame_index * 3) % (height_ - kBarHeight));
+        highlight_top_ = bar_y;
+        highlight_bottom_ = bar_y + kBarHeight;
+        for (int y = bar_y; y < bar_y + kBarHeight; ++y)
+        {
+            std::memset(image_buffer.data() + y * row_bytes, 0xF0, row_bytes);
+        }
+    }
+}
+
+void SyntheticFrameSource::RenderSlideFrame(uint64_t frame_index, std::vector<uint8_t>& image_buffer)
+{
+    // Timing follows frame numbers, not the clock, so unpaced runs see the same sequence
+    const int rate = fps_ > 0 ? fps_ : 60;
+    const uint64_t frames_per_slide = static_cast<uint64_t>(kSlideSeconds) * rate;
+    const int slide = static_cast<int>(frame_index / frames_per_slide);
+    const uint64_t slide_frame = frame_index % frames_per_slide;
+    const size_t row_bytes = static_cast<size_t>(width_) * 4;
+
+    int scroll = 0;
+    if (slide_frame >= static_cast<uint64_t>(kScrollStartSeconds) * rate)
+    {
+        uint64_t scroll_frames = std::min<uint64_t>(slide_frame - static_cast<uint64_t>(kScrollStartSeconds) * rate,
+                                                    static_cast<uint64_t>(kScrollSeconds) * rate);
+        scroll = static_cast<int>(scroll_frames) * kScrollRowsPerFrame;
+    }
+
+    slide_.resize(static_cast<size_t>(height_) * row_bytes);
+
+    if (slide != slide_index_ || scroll < slide_scroll_)
+    {
+        for (int y = 0; y < height_; ++y)
+        {
+            RenderSlideRow(slide, y + scroll, slide_.data() + y * row_bytes);
+        }
+    }
+    else if (scroll > slide_scroll_)
+    {
+        // Shift the page up and draw only the rows that scrolled into view
+        const int shift = std::min(scroll - slide_scroll_, height_);
+        std::memmove(slide_.data(), slide_.data() + shift * row_bytes, (height_ - shift) * row_bytes);
+        for (int y = height_ - shift; y < height_; ++y)
+        {
+            RenderSlideRow(slide, y + scroll, slide_.data() + y * row_bytes);
+        }
+    }
+
+    slide_index_ = slide;
+    slide_scroll_ = scroll;
+
+    image_buffer.resize(slide_.size());
+    std::memcpy(image_buffer.data(), slide_.data(), slide_.size());
+}
+
+void SyntheticFrameSource::RenderSlideRow(int slide, int document_row, uint8_t* row) const
+{
+    // Each slide has its own palette: a tinted page, a dark title band and lines of "words"
+    const uint32_t slide_seed = Mix(static_cast<uint32_t>(slide) + 1);
+    const uint8_t page[3] = { static_cast<uint8_t>(160 + (slide_seed & 0x5F)), static_cast<uint8_t>(160 + ((slide_seed >> 8) & 0x5F)),
+                              static_cast<uint8_t>(160 + ((slide_seed >> 16) & 0x5F)) };
+    const uint8_t ink[3] = { static_cast<uint8_t>((slide_seed >> 4) & 0x3F), static_cast<uint8_t>((slide_seed >> 12) & 0x3F),
+                             static_cast<uint8_t>((slide_seed >> 20) & 0x3F) };
+
+    const int title_height = height_ / 6;
+    const bool is_title = document_row < title_height;
+    const int line = document_row / kLineHeight;
+    const bool is_text = !is_title && document_row % kLineHeight >= kLineHeight / 3;
+
+    const int margin = width_ / 12;
+    int word_end = margin;
+    bool in_word = false;
+    uint32_t word_seed = Mix(slide_seed ^ static_cast<uint32_t>(line) * 0x9E3779B9u);
+
+    for (int x = 0; x < width_; ++x)
+    {
+        const uint8_t* color = page;
+
+        if (is_title)
+        {
+            color = ink;
+        }
+        else if (is_text && x >= margin && x < width_ - margin)
+        {
+            if (x >= word_end)
+            {
+                // Alternate words and gaps of pseudo-random length
+                word_seed = Mix(word_seed);
+                in_word = !in_word;
+                word_end = x + (in_word ? 24 + static_cast<int>(word_seed % 120) : 12 + static_cast<int>(word_seed % 12));
+            }
+            color = in_word ? ink : page;
+        }
+
+        row[x * 4 + 0] = color[0];
+        row[x * 4 + 1] = color[1];
+        row[x * 4 + 2] = color[2];
+        row[x * 4 + 3] = 255;
+    }
+}
@@ -0,0 +1,97 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "KeyframeIndex.h"
+#include "Mp4Clip.h"
+
+// Cuts a clip out of a recording without re-encoding, or writes the keyframe index that makes
+// such cuts instant for recordings made before the recorder wrote one.
+//
+//   ScreenRecorderClip recording.mp4 --start 3600 [--duration 30] [--output clip.mp4] [--no-index]
+//   ScreenRecorderClip recording.mp4 --index
+//
+// The clip starts on the keyframe at or before --start, so it can begin up to one GOP early.
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: ScreenRecorderClip input.mp4 [--start seconds] [--duration seconds] [--output file.mp4] [--no-index] | --index" << std::endl;
+        return 2;
+    }
+
+    std::filesystem::path input = argv[1];
+    std::filesystem::path output;
+    ClipOptions options;
+    bool index_only = false;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+
+        if (arg == "--index") index_only = true;
+        else if (arg == "--no-index") options.write_index = false;
+        else if (i + 1 < argc && arg == "--start") options.start_seconds = std::atof(argv[++i]);
+        else if (i + 1 < argc && arg == "--duration") options.duration_seconds = std::atof(argv[++i]);
+        else if (i + 1 < argc && arg == "--output") output = argv[++i];
+        else
+        {
+            std::cerr << "Invalid option: " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    if (options.start_seconds < 0 || options.duration_seconds < 0)
+    {
+        std::cerr << "--start and --duration must not be negative" << std::endl;
+        return 2;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    if (index_only)
+    {
+        KeyframeIndex index;
+        if (!index.Build(input) || !index.Save(KeyframeIndex::SidecarPath(input)))
+        {
+            std::cerr << "Indexing failed: " << (index.GetError().empty() ? "cannot write the index" : index.GetError()) << std::endl;
+            return 1;
+        }
+
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::printf("keyframes   %zu in %llu samples, %zu resolution segment(s)\n", index.GetKeyframes().size(),
+                    static_cast<unsigned long long>(index.GetSampleCount()), index.GetSegments().size());
+        std::printf("indexed     in %.1f ms\n", milliseconds);
+        std::cout << "Wrote " << KeyframeIndex::SidecarPath(input).string() << std::endl;
+        return 0;
+    }
+
+    if (output.empty())
+    {
+        output = input;
+        output.replace_filename(input.stem().string() + "_clip.mp4");
+    }
+
+    ClipResult result;
+    bool clipped = Mp4Clip::Extract(input, output, options, result);
+
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (!clipped)
+    {
+        std::cerr << "Clip failed: " << result.error << std::endl;
+        return 1;
+    }
+
+    std::printf("resolution  %dx%d\n", result.width, result.height);
+    std::printf("range       %.3f s + %.3f s (%llu samples, %llu keyframes)\n", result.start_seconds, result.duration_seconds,
+                static_cast<unsigned long long>(result.samples), static_cast<unsigned long long>(result.keyframes));
+    std::printf("copied      %.1f MB in %.1f ms%s\n", result.bytes / 1e6, milliseconds, result.index_rebuilt ? " (index rebuilt)" : "");
+    if (result.stopped_at_resolution_change) std::printf("note        cut short where the resolution changes\n");
+
+    std::cout << "Wrote " << output.string() << std::endl;
+    return 0;
+}
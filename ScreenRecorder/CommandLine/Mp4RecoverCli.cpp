@@ -0,0 +1,84 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "Mp4Recovery.h"
+
+// Rebuilds a playable file from a recording that was cut off before the MP4 index was
+// written (crash, power loss, killed process).
+//
+//   ScreenRecorderRecover broken.mp4 [--output fixed.mp4] [--fps 60] [--codec h264|h265]
+//                         [--reference intact.mp4]
+//
+// Parameter sets are taken from the stream when present, otherwise from --reference, an
+// intact recording made with the same resolution and codec settings.
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: ScreenRecorderRecover input.mp4 [--output file.mp4] [--fps N] [--codec h264|h265] [--reference intact.mp4]" << std::endl;
+        return 2;
+    }
+
+    std::filesystem::path input = argv[1];
+    std::filesystem::path output;
+    RecoveryOptions options;
+
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+        std::string arg = argv[i];
+        std::string value = argv[i + 1];
+
+        if (arg == "--output") output = value;
+        else if (arg == "--fps") options.fps = std::atoi(value.c_str());
+        else if (arg == "--reference") options.reference = value;
+        else if (arg == "--codec" && (value == "h264" || value == "h265" || value == "hevc"))
+        {
+            options.auto_codec = false;
+            options.codec = value == "h264" ? NalCodec::H264 : NalCodec::H265;
+        }
+        else
+        {
+            std::cerr << "Invalid option: " << arg << " " << value << std::endl;
+            return 2;
+        }
+    }
+
+    if (options.fps <= 0)
+    {
+        std::cerr << "--fps must be positive" << std::endl;
+        return 2;
+    }
+
+    if (output.empty())
+    {
+        output = input;
+        output.replace_filename(input.stem().string() + "_recovered.mp4");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    RecoveryResult result;
+    bool recovered = Mp4Recovery::Recover(input, output, options, result);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("codec       %s (%s)\n", result.codec == NalCodec::H264 ? "h264" : "h265", result.annex_b ? "annex-b" : "length-prefixed");
+    std::printf("resolution  %dx%d\n", result.width, result.height);
+    std::printf("samples     %llu (%llu keyframes, %.1f s at %d fps)\n", static_cast<unsigned long long>(result.samples),
+                static_cast<unsigned long long>(result.keyframes), static_cast<double>(result.samples) / options.fps, options.fps);
+    std::printf("scanned     %.1f MB in %.2f s (%.0f MB/s), %llu bytes discarded\n", result.bytes_scanned / 1e6, seconds,
+                seconds > 0 ? result.bytes_scanned / 1e6 / seconds : 0.0, static_cast<unsigned long long>(result.bytes_discarded));
+
+    if (!recovered)
+    {
+        std::cerr << "Recovery failed: " << (result.error.empty() ? "no complete frames found" : result.error) << std::endl;
+        return 1;
+    }
+
+    std::cout << "Wrote " << output.string() << std::endl;
+    return 0;
+}
@@ -0,0 +1,487 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#include "FrameKernels.h"
+#include "QualityMetrics.h"
+#include "RawVideoReader.h"
+#include "RawVideoWriter.h"
+
+#ifdef _WIN32
+#include "VideoDecoder.h"
+#include "VideoEncoder.h"
+#endif
+
+// Encodes a reference sequence at several codec / bitrate / scale points, decodes each
+// result and scores it against the reference with PSNR and SSIM, overall and per region
+// (text, image, flat). References are BGRA .zraw files, e.g. from
+// ScreenRecorderCli --mode raw-bgra, so real screen content can be replayed.
+//
+//   ScreenRecorderQuality desk.zraw --codecs h264,h265 --bitrates 2000000,4000000,8000000
+//                         [--scales 1,0.75,0.5] [--frames N] [--work-dir dir] [--keep]
+//                         [--per-frame quality.csv] [--json results.json|-]
+//
+// Codec "raw" writes lossless BGRA .zraw and reads it back. It is the only codec off Windows;
+// combined with --scales it still exercises the scaling and metric path.
+
+namespace QualityHarness
+{
+    struct HarnessOptions
+    {
+        std::filesystem::path input;
+        std::vector<std::string> codecs{ "h264" };
+        std::vector<int> bitrates{ 8000000 };
+        std::vector<double> scales{ 1.0 };
+        uint64_t max_frames = 0;                // 0 = whole reference
+        std::filesystem::path work_dir;
+        bool keep_outputs = false;
+        std::string per_frame_csv;
+        std::string json;                       // "-" writes to stdout
+    };
+
+    struct RunResult
+    {
+        std::string codec;
+        int bitrate = 0;                        // Requested; 0 for raw
+        double scale = 1.0;
+        int encoded_width = 0;
+        int encoded_height = 0;
+        uint64_t frames_encoded = 0;
+        uint64_t frames_decoded = 0;
+        uint64_t output_bytes = 0;
+        double output_kbps = 0.0;
+        double encode_ms_per_frame = 0.0;
+        FrameQuality quality;
+        std::vector<FrameQuality> per_frame;
+        std::string error;
+    };
+
+    class FrameDecoder
+    {
+    public:
+        virtual ~FrameDecoder() = default;
+        virtual bool ReadFrame(std::vector<uint8_t>& image_buffer, int& width, int& height) = 0;
+    };
+
+    class RawFrameDecoder : public FrameDecoder
+    {
+    public:
+        bool Open(const std::filesystem::path& path) { return reader_.Open(path) && reader_.GetPixelFormat() == RawPixelFormat::BGRA; }
+        bool ReadFrame(std::vector<uint8_t>& image_buffer, int& width, int& height) override
+        {
+            width = static_cast<int>(reader_.GetHeader().width);
+            height = static_cast<int>(reader_.GetHeader().height);
+            return reader_.ReadFrame(next_frame_++, image_buffer);
+        }
+
+    private:
+        RawVideoReader reader_;
+        uint64_t next_frame_ = 0;
+    };
+
+#ifdef _WIN32
+    class MediaFoundationFrameDecoder : public FrameDecoder
+    {
+    public:
+        bool Open(const std::filesystem::path& path) { return decoder_.Open(path.wstring()); }
+        bool ReadFrame(std::vector<uint8_t>& image_buffer, int& width, int& height) override
+        {
+            return decoder_.ReadFrame(image_buffer, width, height);
+        }
+
+    private:
+        VideoDecoder decoder_;
+    };
+
+    bool ParseCodec(const std::string& name, VideoCodec& codec)
+    {
+        if (name == "h264") codec = VideoCodec::H264;
+        else if (name == "h265" || name == "hevc") codec = VideoCodec::H265;
+        else if (name == "vp8") codec = VideoCodec::VP8;
+        else if (name == "vp9") codec = VideoCodec::VP9;
+        else if (name == "av1") codec = VideoCodec::AV1;
+        else return false;
+
+        return true;
+    }
+#endif
+
+    std::vector<std::string> SplitList(const std::string& list)
+    {
+        std::vector<std::string> items;
+        std::stringstream stream(list);
+        std::string item;
+        while (std::getline(stream, item, ','))
+        {
+            if (!item.empty()) items.push_back(item);
+        }
+        return items;
+    }
+
+    std::shared_ptr<FrameSink> CreateEncoder(const std::string& codec, int width, int height, int fps, int bitrate,
+                                             const std::filesystem::path& output, std::string& error)
+    {
+        if (codec == "raw")
+        {
+            auto writer = std::make_shared<RawVideoWriter>(width, height, fps, RawPixelFormat::BGRA, output);
+            if (writer->Initialize()) return writer;
+
+            error = "cannot create " + output.string();
+            return nullptr;
+        }
+
+#ifdef _WIN32
+        VideoCodec video_codec;
+        if (!ParseCodec(codec, video_codec))
+        {
+            error = "unknown codec";
+            return nullptr;
+        }
+
+        auto encoder = std::make_shared<VideoEncoder>(width, height, fps, bitrate, L"", output.wstring());
+        if (encoder->Initialize(video_codec)) return encoder;
+
+        error = "encoder unavailable";
+        return nullptr;
+#else
+        error = "only the raw codec is available on this platform";
+        return nullptr;
+#endif
+    }
+
+    std::unique_ptr<FrameDecoder> CreateDecoder(const std::string& codec, const std::filesystem::path& output)
+    {
+        if (codec == "raw")
+        {
+            auto decoder = std::make_unique<RawFrameDecoder>();
+            if (decoder->Open(output)) return decoder;
+            return nullptr;
+        }
+
+#ifdef _WIN32
+        auto decoder = std::make_unique<MediaFoundationFrameDecoder>();
+        if (decoder->Open(output)) return decoder;
+#endif
+        return nullptr;
+    }
+
+    void ScaleFrame(const std::vector<uint8_t>& source, int source_width, int source_height,
+                    std::vector<uint8_t>& target, int target_width, int target_height)
+    {
+        target.resize(static_cast<size_t>(target_width) * target_height * 4);
+        FrameKernels::ScaleBgraBilinear(source.data(), static_cast<ptrdiff_t>(source_width) * 4, source_width, source_height,
+                                        target.data(), static_cast<ptrdiff_t>(target_width) * 4, target_width, target_height);
+    }
+
+    void ConvertToNv12(const std::vector<uint8_t>& image, int width, int height, std::vector<uint8_t>& nv12, Nv12View& view)
+    {
+        nv12.resize(static_cast<size_t>(width) * height * 3 / 2);
+        uint8_t* y_plane = nv12.data();
+        uint8_t* uv_plane = y_plane + static_cast<size_t>(width) * height;
+        FrameKernels::ConvertBgraToNv12(image.data(), static_cast<ptrdiff_t>(width) * 4, width, height, y_plane, width, uv_plane, width);
+        view = Nv12View{ y_plane, width, uv_plane, width };
+    }
+
+    bool Run(RawVideoReader& reference, uint64_t frame_count, const HarnessOptions& options, RunResult& result)
+    {
+        const RawFileHeader& header = reference.GetHeader();
+        const int width = static_cast<int>(header.width);
+        const int height = static_cast<int>(header.height);
+        const int fps = header.fps > 0 ? static_cast<int>(header.fps) : 60;
+
+        // NV12 needs even dimensions at both sizes
+        result.encoded_width = std::max(2, static_cast<int>(width * result.scale) & ~1);
+        result.encoded_height = std::max(2, static_cast<int>(height * result.scale) & ~1);
+        const bool scaled = result.encoded_width != width || result.encoded_height != height;
+
+        std::ostringstream name;
+        name << result.codec << "_" << result.bitrate << "_" << result.encoded_width << "x" << result.encoded_height
+             << (result.codec == "raw" ? ".zraw" : ".mp4");
+        std::filesystem::path output = options.work_dir / name.str();
+
+        std::shared_ptr<FrameSink> encoder = CreateEncoder(result.codec, result.encoded_width, result.encoded_height, fps, result.bitrate, output, result.error);
+        if (!encoder) return false;
+
+        std::vector<uint8_t> frame;
+        std::vector<uint8_t> scaled_frame;
+        std::chrono::steady_clock::duration encode_time{};
+
+        for (uint64_t i = 0; i < frame_count; ++i)
+        {
+            if (!reference.ReadFrame(i, frame))
+            {
+                result.error = "cannot read reference frame " + std::to_string(i);
+                return false;
+            }
+            if (scaled) ScaleFrame(frame, width, height, scaled_frame, result.encoded_width, result.encoded_height);
+
+            auto start = std::chrono::steady_clock::now();
+            bool encoded = encoder->ProcessFrame(scaled ? scaled_frame : frame, result.encoded_width, result.encoded_height);
+            encode_time += std::chrono::steady_clock::now() - start;
+
+            if (encoded) ++result.frames_encoded;
+        }
+
+        // Flushing the encoder's lookahead is part of the cost
+        auto start = std::chrono::steady_clock::now();
+        encoder->Close();
+        encode_time += std::chrono::steady_clock::now() - start;
+        encoder.reset();
+
+        std::error_code error_code;
+        result.output_bytes = std::filesystem::file_size(output, error_code);
+        result.output_kbps = frame_count ? result.output_bytes * 8.0 / (static_cast<double>(frame_count) / fps) / 1000.0 : 0.0;
+        result.encode_ms_per_frame = frame_count ? std::chrono::duration<double, std::milli>(encode_time).count() / frame_count : 0.0;
+
+        std::unique_ptr<FrameDecoder> decoder = CreateDecoder(result.codec, output);
+        if (!decoder)
+        {
+            result.error = "cannot decode " + output.string();
+            return false;
+        }
+
+        std::vector<uint8_t> decoded;
+        std::vector<uint8_t> reference_nv12;
+        std::vector<uint8_t> decoded_nv12;
+        std::vector<ContentClass> classes(FrameKernels::TileCount(width, height, QualityMetrics::kClassTileSize));
+        int decoded_width = 0;
+        int decoded_height = 0;
+
+        while (result.frames_decoded < frame_count && decoder->ReadFrame(decoded, decoded_width, decoded_height))
+        {
+            if (decoded_width != result.encoded_width || decoded_height != result.encoded_height)
+            {
+                result.error = "decoded size differs from encoded size";
+                return false;
+            }
+            if (!reference.ReadFrame(result.frames_decoded, frame)) break;
+
+            if (scaled)
+            {
+                // Score what a viewer sees: the decoded picture brought back to the reference size
+                ScaleFrame(decoded, decoded_width, decoded_height, scaled_frame, width, height);
+                decoded.swap(scaled_frame);
+            }
+
+            Nv12View reference_view;
+            Nv12View decoded_view;
+            ConvertToNv12(frame, width, height, reference_nv12, reference_view);
+            ConvertToNv12(decoded, width, height, decoded_nv12, decoded_view);
+            QualityMetrics::ClassifyTiles(reference_view.y, reference_view.y_pitch, width, height, classes.data());
+
+            FrameQuality frame_quality;
+            QualityMetrics::CompareNv12(reference_view, decoded_view, width, height, classes.data(), frame_quality);
+            result.quality.Add(frame_quality);
+            if (!options.per_frame_csv.empty()) result.per_frame.push_back(frame_quality);
+
+            ++result.frames_decoded;
+        }
+
+        if (!options.keep_outputs) std::filesystem::remove(output, error_code);
+
+        if (result.frames_decoded == 0) result.error = "no frames decoded";
+        return result.frames_decoded > 0;
+    }
+
+    void PrintResults(const std::vector<RunResult>& results)
+    {
+        std::printf("%-6s %9s %11s %10s %9s %8s %8s %8s %8s %8s %8s %8s\n", "codec", "bitrate", "size", "kbps", "enc_ms",
+                    "psnr_y", "psnr_uv", "ssim_y", "text_db", "text_ss", "image_db", "image_ss");
+
+        for (const RunResult& result : results)
+        {
+            char size[32];
+            std::snprintf(size, sizeof(size), "%dx%d", result.encoded_width, result.encoded_height);
+
+            if (!result.error.empty())
+            {
+                std::printf("%-6s %9d %11s  failed: %s\n", result.codec.c_str(), result.bitrate, size, result.error.c_str());
+                continue;
+            }
+
+            const QualityTotals& text = result.quality.luma_by_class[static_cast<int>(ContentClass::Text)];
+            const QualityTotals& image = result.quality.luma_by_class[static_cast<int>(ContentClass::Image)];
+            std::printf("%-6s %9d %11s %10.0f %9.2f %8.2f %8.2f %8.4f %8.2f %8.4f %8.2f %8.4f\n", result.codec.c_str(), result.bitrate, size,
+                        result.output_kbps, result.encode_ms_per_frame, result.quality.luma.GetPsnr(), result.quality.chroma.GetPsnr(),
+                        result.quality.luma.GetSsim(), text.GetPsnr(), text.GetSsim(), image.GetPsnr(), image.GetSsim());
+        }
+    }
+
+    void WriteJson(const std::vector<RunResult>& results, const std::string& path)
+    {
+        std::ostringstream json;
+        json << "[\n";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const RunResult& result = results[i];
+            json << "  {\n"
+                 << "    \"codec\": \"" << result.codec << "\",\n"
+                 << "    \"bitrate\": " << result.bitrate << ",\n"
+                 << "    \"scale\": " << result.scale << ",\n"
+                 << "    \"width\": " << result.encoded_width << ",\n"
+                 << "    \"height\": " << result.encoded_height << ",\n"
+                 << "    \"frames_encoded\": " << result.frames_encoded << ",\n"
+                 << "    \"frames_decoded\": " << result.frames_decoded << ",\n"
+                 << "    \"output_bytes\": " << result.output_bytes << ",\n"
+                 << "    \"output_kbps\": " << result.output_kbps << ",\n"
+                 << "    \"encode_ms_per_frame\": " << result.encode_ms_per_frame << ",\n"
+                 << "    \"psnr_y\": " << result.quality.luma.GetPsnr() << ",\n"
+                 << "    \"psnr_uv\": " << result.quality.chroma.GetPsnr() << ",\n"
+                 << "    \"ssim_y\": " << result.quality.luma.GetSsim() << ",\n";
+
+            for (int c = 0; c < kContentClassCount; ++c)
+            {
+                const char* class_name = QualityMetrics::GetClassName(static_cast<ContentClass>(c));
+                const QualityTotals& totals = result.quality.luma_by_class[c];
+                json << "    \"" << class_name << "_share\": " << (result.quality.luma.samples ? static_cast<double>(totals.samples) / result.quality.luma.samples : 0.0) << ",\n"
+                     << "    \"" << class_name << "_psnr_y\": " << totals.GetPsnr() << ",\n"
+                     << "    \"" << class_name << "_ssim_y\": " << totals.GetSsim() << ",\n";
+            }
+
+            json << "    \"error\": \"" << result.error << "\"\n"
+                 << "  }" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        json << "]\n";
+
+        if (path == "-") std::cout << json.str();
+        else std::ofstream(path) << json.str();
+    }
+
+    void WritePerFrameCsv(const std::vector<RunResult>& results, const std::string& path)
+    {
+        std::ofstream csv(path);
+        csv << "codec,bitrate,width,height,frame,psnr_y,psnr_uv,ssim_y,text_psnr_y,text_ssim_y,image_psnr_y,image_ssim_y\n";
+
+        for (const RunResult& result : results)
+        {
+            for (size_t frame = 0; frame < result.per_frame.size(); ++frame)
+            {
+                const FrameQuality& quality = result.per_frame[frame];
+                const QualityTotals& text = quality.luma_by_class[static_cast<int>(ContentClass::Text)];
+                const QualityTotals& image = quality.luma_by_class[static_cast<int>(ContentClass::Image)];
+                csv << result.codec << ',' << result.bitrate << ',' << result.encoded_width << ',' << result.encoded_height << ',' << frame << ','
+                    << quality.luma.GetPsnr() << ',' << quality.chroma.GetPsnr() << ',' << quality.luma.GetSsim() << ','
+                    << text.GetPsnr() << ',' << text.GetSsim() << ',' << image.GetPsnr() << ',' << image.GetSsim() << '\n';
+            }
+        }
+    }
+
+    bool ParseArguments(int argc, char* argv[], HarnessOptions& options)
+    {
+        if (argc < 2) return false;
+        options.input = argv[1];
+        options.work_dir = std::filesystem::temp_directory_path() / "ScreenRecorderQuality";
+
+        for (int i = 2; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg == "--keep")
+            {
+                options.keep_outputs = true;
+                continue;
+            }
+            if (i + 1 >= argc) return false;
+
+            std::string value = argv[++i];
+            if (arg == "--codecs") options.codecs = SplitList(value);
+            else if (arg == "--frames") options.max_frames = std::strtoull(value.c_str(), nullptr, 10);
+            else if (arg == "--work-dir") options.work_dir = value;
+            else if (arg == "--per-frame") options.per_frame_csv = value;
+            else if (arg == "--json") options.json = value;
+            else if (arg == "--bitrates")
+            {
+                options.bitrates.clear();
+                for (const std::string& item : SplitList(value)) options.bitrates.push_back(std::atoi(item.c_str()));
+            }
+            else if (arg == "--scales")
+            {
+                options.scales.clear();
+                for (const std::string& item : SplitList(value)) options.scales.push_back(std::atof(item.c_str()));
+            }
+            else
+            {
+                std::cerr << "Invalid option: " << arg << " " << value << std::endl;
+                return false;
+            }
+        }
+
+        return !options.codecs.empty() && !options.bitrates.empty() && !options.scales.empty();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    QualityHarness::HarnessOptions options;
+    if (!QualityHarness::ParseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: ScreenRecorderQuality reference.zraw [--codecs raw,h264,h265,vp9,av1] [--bitrates 2000000,8000000]\n"
+                  << "                             [--scales 1,0.75,0.5] [--frames N] [--work-dir dir] [--keep]\n"
+                  << "                             [--per-frame file.csv] [--json file.json|-]" << std::endl;
+        return 2;
+    }
+
+#ifdef _WIN32
+    CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+#endif
+
+    RawVideoReader reference;
+    if (!reference.Open(options.input))
+    {
+        std::cerr << "Cannot read " << options.input.string() << std::endl;
+        return 1;
+    }
+    if (reference.GetPixelFormat() != RawPixelFormat::BGRA || reference.GetHeader().width % 2 || reference.GetHeader().height % 2)
+    {
+        std::cerr << "The reference must be BGRA with even dimensions (record it with --mode raw-bgra)" << std::endl;
+        return 1;
+    }
+
+    uint64_t frame_count = reference.GetFrameCount();
+    if (options.max_frames > 0 && options.max_frames < frame_count) frame_count = options.max_frames;
+
+    std::error_code error_code;
+    std::filesystem::create_directories(options.work_dir, error_code);
+
+    std::vector<QualityHarness::RunResult> results;
+    for (const std::string& codec : options.codecs)
+    {
+        // Lossless output has no bitrate to choose
+        std::vector<int> bitrates = codec == "raw" ? std::vector<int>{ 0 } : options.bitrates;
+
+        for (int bitrate : bitrates)
+        {
+            for (double scale : options.scales)
+            {
+                QualityHarness::RunResult result;
+                result.codec = codec;
+                result.bitrate = bitrate;
+                result.scale = scale;
+                QualityHarness::Run(reference, frame_count, options, result);
+                results.push_back(std::move(result));
+            }
+        }
+    }
+
+    QualityHarness::PrintResults(results);
+    if (!options.json.empty()) QualityHarness::WriteJson(results, options.json);
+    if (!options.per_frame_csv.empty()) QualityHarness::WritePerFrameCsv(results, options.per_frame_csv);
+
+    for (const QualityHarness::RunResult& result : results)
+    {
+        if (!result.error.empty()) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,964 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ScreenRecorder.h"
+
+// Headless front-end for ScreenRecorder. Every option can be given as a flag
+// (--fps 60) or as a key=value line in a --config file; flags win.
+//
+//   ScreenRecorderCli --source synthetic --width 1920 --height 1080 --fps 240 --unpaced
+//                     --duration 10 --codec h264 --output C:\runs\out.mp4 --stats out.json
+//
+//   ScreenRecorderCli --mode stream --stream udp://192.168.1.20:5000 --stream-fec 5 --stream-retransmit 1
+//
+//   ScreenRecorderCli --bitrate 20000000 --rendition 960x540@2000000 --rendition 1280x720@4000000:h265
+//
+// --rendition may repeat; each one is another file from the same capture (<name>_960x540.mp4).
+//
+//   ScreenRecorderCli --duration 60 --snapshot-at 5,30,55
+//
+// --snapshot-at saves a lossless PNG of the frame at each time into the recording, next to the
+// output as <name>_snap1.png, <name>_snap2.png, ...; the encode runs off the recording path.
+//
+//   ScreenRecorderCli --duration 3600 --time-lapse 10 --time-lapse-blend max --time-lapse-fps 30
+//
+// --time-lapse turns every N seconds of capture into one frame, so an hour plays back in 12 s at
+// 30 fps. average blends each interval by time on screen, max keeps the brightest value each pixel
+// reached (a moving cursor leaves a trail), sample keeps the interval's last frame.
+//
+//   ScreenRecorderCli --duration 600 --shared-frames desk --shared-frame-slots 4
+//
+// --shared-frames also publishes every frame into a shared-memory ring named desk, which local
+// tools open with SharedFrameReader and read in place; a slow tool skips frames, never the recorder.
+//
+//   ScreenRecorderCli --crop 0,0,2560,1440 --scale 1280x720 --mode raw-nv12
+//
+// --crop and --scale run every frame through the filter chain before it is encoded or written:
+// cropped, resized and, for raw-nv12, converted in one banded pass. --unfused-filters runs the
+// stages one after another over whole frames instead.
+//
+// Off Windows only --source synthetic with --mode raw-bgra or raw-nv12 is built: the capture and
+// the encoders are WinRT and Media Foundation.
+
+namespace RecorderCli
+{
+    struct CliOptions
+    {
+        std::wstring source = L"monitor";      // monitor | window | synthetic
+        int monitor_index = 1;
+        std::wstring window_title;
+        double duration_seconds = 10.0;
+        int fps = 0;                           // 0 = use the monitor refresh rate
+        int bitrate = 8000000;
+        std::wstring codec = L"h264";
+        std::wstring mode = L"encoded";        // encoded | raw-bgra | raw-nv12 | stream
+        std::wstring stream = L"udp://127.0.0.1:5000";  // Stream mode destination
+        int stream_fec = 0;                    // Media datagrams per parity datagram; 0 = off
+        bool stream_retransmit = false;        // NACK-driven resends; FEC and resends need a receiver that speaks them
+        int stream_latency_ms = 80;            // Receiver's wait for a missing datagram
+        int width = 1920;                      // synthetic source only
+        int height = 1080;                     // synthetic source only
+        bool paced = true;
+        std::wstring pattern = L"motion";      // synthetic source only: motion | slides
+        bool scene_detect = true;              // Encoded mode: keyframes on scene cuts, long GOP otherwise
+        double gop_seconds = 10.0;
+        int queue_depth = 4;                   // 0 = encode on the capture thread
+        int memory_budget_mb = 1024;
+        std::wstring backpressure;             // drop | downscale | block; default block when unpaced, else drop
+        ThreadRoleConfig thread_roles[kThreadRoleCount];
+        bool isolate_target = false;           // Keep every role off the recorded process's cores
+        int target_pid = 0;                    // Recorded process for monitor capture; window capture finds it itself
+        std::wstring output;
+        std::wstring stats;                    // "-" writes to stdout
+        std::wstring trace;                    // .json for chrome://tracing, .pftrace for Perfetto
+        int trace_events = 1 << 16;            // Ring size per thread; older spans are overwritten
+        std::wstring hdr = L"off";             // off | hdr10 | tonemap
+        double sdr_white_nits = 203.0;         // Where SDR white sits on the HDR desktop
+        double hdr_peak_nits = 1000.0;         // tonemap: brightest highlight kept
+        bool auto_tune = false;                // Resize the frame pool and queue while recording
+        PipelineTunerConfig tuner;
+        std::vector<std::wstring> renditions;  // WxH@bitrate[:codec], encoded mode only
+        std::vector<double> snapshot_at;       // Seconds into the recording
+        double time_lapse = 0.0;               // Seconds of capture per output frame; 0 = off
+        std::wstring time_lapse_blend = L"average";  // average | max | sample
+        int time_lapse_fps = 30;               // Playback rate of the time-lapse
+        std::wstring shared_frames;            // Shared-memory ring name; empty = off
+        int shared_frame_slots = 4;
+        std::wstring crop;                     // x,y,w,h in capture pixels; empty = whole capture
+        std::wstring scale;                    // WxH output; empty = the crop's size
+        bool unfused_filters = false;
+    };
+
+    std::atomic<bool> stop_requested{ false };
+
+#ifdef _WIN32
+    BOOL WINAPI ConsoleCtrlHandler(DWORD ctrl_type)
+    {
+        if (ctrl_type == CTRL_C_EVENT || ctrl_type == CTRL_BREAK_EVENT)
+        {
+            stop_requested.store(true);
+            return TRUE;
+        }
+        return FALSE;
+    }
+
+    std::string ToUtf8(const std::wstring& wide_string)
+    {
+        if (wide_string.empty()) return std::string();
+
+        int size = WideCharToMultiByte(CP_UTF8, 0, wide_string.c_str(), static_cast<int>(wide_string.size()), nullptr, 0, nullptr, nullptr);
+        std::string result(size, '\0');
+        WideCharToMultiByte(CP_UTF8, 0, wide_string.c_str(), static_cast<int>(wide_string.size()), result.data(), size, nullptr, nullptr);
+        return result;
+    }
+
+    std::wstring FromUtf8(const std::string& narrow_string)
+    {
+        if (narrow_string.empty()) return std::wstring();
+
+        int size = MultiByteToWideChar(CP_UTF8, 0, narrow_string.c_str(), static_cast<int>(narrow_string.size()), nullptr, 0);
+        std::wstring result(size, L'\0');
+        MultiByteToWideChar(CP_UTF8, 0, narrow_string.c_str(), static_cast<int>(narrow_string.size()), result.data(), size);
+        return result;
+    }
+#else
+    void SignalHandler(int)
+    {
+        stop_requested.store(true);
+    }
+
+    // wchar_t holds a whole code point here
+    std::string ToUtf8(const std::wstring& wide_string)
+    {
+        std::string result;
+        for (wchar_t wide_char : wide_string)
+        {
+            const uint32_t c = static_cast<uint32_t>(wide_char);
+            if (c < 0x80)
+            {
+                result.push_back(static_cast<char>(c));
+            }
+            else if (c < 0x800)
+            {
+                result.push_back(static_cast<char>(0xC0 | (c >> 6)));
+                result.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            }
+            else if (c < 0x10000)
+            {
+                result.push_back(static_cast<char>(0xE0 | (c >> 12)));
+                result.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+                result.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            }
+            else
+            {
+                result.push_back(static_cast<char>(0xF0 | (c >> 18)));
+                result.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+                result.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+                result.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            }
+        }
+        return result;
+    }
+
+    std::wstring FromUtf8(const std::string& narrow_string)
+    {
+        std::wstring result;
+        for (size_t i = 0; i < narrow_string.size();)
+        {
+            const unsigned char lead = static_cast<unsigned char>(narrow_string[i]);
+            const size_t length = lead < 0xC0 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+            uint32_t c = length == 1 ? lead : lead & (0x7F >> length);
+            for (size_t k = 1; k < length && i + k < narrow_string.size(); ++k)
+            {
+                c = (c << 6) | (static_cast<unsigned char>(narrow_string[i + k]) & 0x3F);
+            }
+            result.push_back(static_cast<wchar_t>(c));
+            i += length;
+        }
+        return result;
+    }
+#endif
+
+    std::string JsonEscape(const std::string& value)
+    {
+        std::string escaped;
+        for (char c : value)
+        {
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                // Raw control characters are not allowed in a JSON string
+                char code[8];
+                std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned>(c));
+                escaped.append(code);
+                continue;
+            }
+            if (c == '"' || c == '\\') escaped.push_back('\\');
+            escaped.push_back(c);
+        }
+        return escaped;
+    }
+
+    bool ParseCodec(const std::wstring& name, VideoCodec& codec)
+    {
+        if (name == L"h264") codec = VideoCodec::H264;
+        else if (name == L"h265" || name == L"hevc") codec = VideoCodec::H265;
+        else if (name == L"vp8") codec = VideoCodec::VP8;
+        else if (name == L"vp9") codec = VideoCodec::VP9;
+        else if (name == L"av1") codec = VideoCodec::AV1;
+        else return false;
+
+        return true;
+    }
+
+    // 960x540@2000000 or 960x540@2000000:h265; the codec defaults to the main output's
+    bool ParseRendition(const std::wstring& spec, VideoCodec default_codec, RenditionConfig& rendition)
+    {
+        size_t by = spec.find(L'x');
+        size_t at = spec.find(L'@');
+        if (by == std::wstring::npos || at == std::wstring::npos || at < by) return false;
+
+        size_t colon = spec.find(L':', at);
+        rendition.codec = default_codec;
+        if (colon != std::wstring::npos && !ParseCodec(spec.substr(colon + 1), rendition.codec)) return false;
+
+        try
+        {
+            rendition.width = std::stoi(spec.substr(0, by));
+            rendition.height = std::stoi(spec.substr(by + 1, at - by - 1));
+            rendition.bitrate = std::stoi(spec.substr(at + 1, colon == std::wstring::npos ? std::wstring::npos : colon - at - 1));
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+
+        return rendition.width > 0 && rendition.height > 0 && rendition.bitrate > 0;
+    }
+
+    // --crop x,y,w,h and --scale WxH; false if either is malformed
+    bool ParseFilterChain(const std::wstring& crop, const std::wstring& scale, FilterChainConfig& config)
+    {
+        try
+        {
+            if (!crop.empty())
+            {
+                int values[4];
+                size_t start = 0;
+                for (int i = 0; i < 4; ++i)
+                {
+                    size_t comma = crop.find(L',', start);
+                    if ((comma == std::wstring::npos) != (i == 3)) return false;
+                    values[i] = std::stoi(crop.substr(start, comma == std::wstring::npos ? std::wstring::npos : comma - start));
+                    start = comma + 1;
+                }
+                if (values[0] < 0 || values[1] < 0 || values[2] <= 0 || values[3] <= 0) return false;
+                config.crop = { values[0], values[1], values[2], values[3] };
+            }
+            if (!scale.empty())
+            {
+                size_t by = scale.find(L'x');
+                if (by == std::wstring::npos) return false;
+                config.output_width = std::stoi(scale.substr(0, by));
+                config.output_height = std::stoi(scale.substr(by + 1));
+                if (config.output_width <= 0 || config.output_height <= 0) return false;
+            }
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+
+        return true;
+    }
+
+    bool ParseOutputMode(const std::wstring& name, OutputMode& output_mode)
+    {
+        if (name == L"encoded") output_mode = OutputMode::Encoded;
+        else if (name == L"raw-bgra") output_mode = OutputMode::RawBgra;
+        else if (name == L"raw-nv12") output_mode = OutputMode::RawNv12;
+        else if (name == L"stream") output_mode = OutputMode::Stream;
+        else return false;
+
+        return true;
+    }
+
+    bool ParsePattern(const std::wstring& name, SyntheticPattern& pattern)
+    {
+        if (name == L"motion") pattern = SyntheticPattern::Motion;
+        else if (name == L"slides") pattern = SyntheticPattern::Slides;
+        else return false;
+
+        return true;
+    }
+
+    bool ParseHdrMode(const std::wstring& name, HdrMode& mode)
+    {
+        if (name == L"off") mode = HdrMode::Off;
+        else if (name == L"hdr10") mode = HdrMode::Hdr10;
+        else if (name == L"tonemap") mode = HdrMode::ToneMapSdr;
+        else return false;
+
+        return true;
+    }
+
+    bool ParseTimeLapseBlend(const std::wstring& name, TimeLapseBlend& blend)
+    {
+        if (name == L"average") blend = TimeLapseBlend::Average;
+        else if (name == L"max") blend = TimeLapseBlend::Max;
+        else if (name == L"sample") blend = TimeLapseBlend::Sample;
+        else return false;
+
+        return true;
+    }
+
+    bool ParseBackpressure(const std::wstring& name, BackpressurePolicy& policy)
+    {
+        if (name == L"drop") policy = BackpressurePolicy::Drop;
+        else if (name == L"downscale") policy = BackpressurePolicy::Downscale;
+        else if (name == L"block") policy = BackpressurePolicy::Block;
+        else return false;
+
+        return true;
+    }
+
+    // 5,30,55: seconds into the recording, sorted
+    bool ParseSeconds(const std::wstring& list, std::vector<double>& seconds)
+    {
+        size_t start = 0;
+        while (start <= list.size())
+        {
+            size_t comma = list.find(L',', start);
+            if (comma == std::wstring::npos) comma = list.size();
+            const double value = std::stod(list.substr(start, comma - start));
+            if (value < 0) return false;
+            seconds.push_back(value);
+            start = comma + 1;
+        }
+        std::sort(seconds.begin(), seconds.end());
+        return !seconds.empty();
+    }
+
+    // affinity-<role>=0-3,6 and priority-<role>=above-normal
+    bool ApplyThreadRoleOption(CliOptions& options, const std::wstring& key, const std::wstring& value)
+    {
+        size_t dash = key.find(L'-');
+        if (dash == std::wstring::npos) return false;
+
+        ThreadRole role;
+        if (!ThreadRoles::ParseRole(ToUtf8(key.substr(dash + 1)), role)) return false;
+
+        ThreadRoleConfig& config = options.thread_roles[static_cast<int>(role)];
+        if (key.compare(0, dash, L"affinity") == 0) return ThreadRoles::ParseCoreList(ToUtf8(value), config.affinity_mask);
+        if (key.compare(0, dash, L"priority") == 0) return ThreadRoles::ParsePriority(ToUtf8(value), config.priority);
+
+        return false;
+    }
+
+    bool ApplyOption(CliOptions& options, const std::wstring& key, const std::wstring& value)
+    {
+        if (key.rfind(L"affinity-", 0) == 0 || key.rfind(L"priority-", 0) == 0)
+        {
+            return ApplyThreadRoleOption(options, key, value);
+        }
+
+        try
+        {
+            if (key == L"source") options.source = value;
+            else if (key == L"monitor") options.monitor_index = std::stoi(value);
+            else if (key == L"window") options.window_title = value;
+            else if (key == L"duration") options.duration_seconds = std::stod(value);
+            else if (key == L"fps") options.fps = std::stoi(value);
+            else if (key == L"bitrate") options.bitrate = std::stoi(value);
+            else if (key == L"codec") options.codec = value;
+            else if (key == L"mode") options.mode = value;
+            else if (key == L"stream") options.stream = value;
+            else if (key == L"stream-fec") options.stream_fec = std::stoi(value);
+            else if (key == L"stream-retransmit") options.stream_retransmit = value != L"0" && value != L"false";
+            else if (key == L"stream-latency-ms") options.stream_latency_ms = std::stoi(value);
+            else if (key == L"width") options.width = std::stoi(value);
+            else if (key == L"height") options.height = std::stoi(value);
+            else if (key == L"paced") options.paced = value != L"0" && value != L"false";
+            else if (key == L"pattern") options.pattern = value;
+            else if (key == L"scene-detect") options.scene_detect = value != L"0" && value != L"false";
+            else if (key == L"gop-seconds") options.gop_seconds = std::stod(value);
+            else if (key == L"queue-depth") options.queue_depth = std::stoi(value);
+            else if (key == L"memory-budget-mb") options.memory_budget_mb = std::stoi(value);
+            else if (key == L"backpressure") options.backpressure = value;
+            else if (key == L"isolate-target") options.isolate_target = value != L"0" && value != L"false";
+            else if (key == L"target-pid") options.target_pid = std::stoi(value);
+            else if (key == L"output") options.output = value;
+            else if (key == L"stats") options.stats = value;
+            else if (key == L"trace") options.trace = value;
+            else if (key == L"trace-events") options.trace_events = std::stoi(value);
+            else if (key == L"hdr") options.hdr = value;
+            else if (key == L"sdr-white") options.sdr_white_nits = std::stod(value);
+            else if (key == L"hdr-peak") options.hdr_peak_nits = std::stod(value);
+            else if (key == L"auto-tune") options.auto_tune = value != L"0" && value != L"false";
+            else if (key == L"tune-max-pool") options.tuner.max_pool_buffers = std::stoi(value);
+            else if (key == L"tune-max-queue") options.tuner.max_queue_capacity = std::stoul(value);
+            else if (key == L"tune-latency-ms") options.tuner.latency_budget_ms = std::stod(value);
+            else if (key == L"tune-window") options.tuner.window_seconds = std::stod(value);
+            else if (key == L"rendition") options.renditions.push_back(value);
+            else if (key == L"snapshot-at") return ParseSeconds(value, options.snapshot_at);
+            else if (key == L"time-lapse") options.time_lapse = std::stod(value);
+            else if (key == L"time-lapse-blend") options.time_lapse_blend = value;
+            else if (key == L"time-lapse-fps") options.time_lapse_fps = std::stoi(value);
+            else if (key == L"shared-frames") options.shared_frames = value;
+            else if (key == L"shared-frame-slots") options.shared_frame_slots = std::stoi(value);
+            else if (key == L"crop") options.crop = value;
+            else if (key == L"scale") options.scale = value;
+            else if (key == L"unfused-filters") options.unfused_filters = value != L"0" && value != L"false";
+            else return false;
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+
+        return true;
+    }
+
+    bool LoadConfigFile(CliOptions& options, const std::wstring& config_path)
+    {
+        std::ifstream config_file{ std::filesystem::path(config_path) };
+        if (!config_file) return false;
+
+        std::string line;
+        while (std::getline(config_file, line))
+        {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty() || line[0] == '#') continue;
+
+            size_t separator = line.find('=');
+            if (separator == std::string::npos) return false;
+
+            if (!ApplyOption(options, FromUtf8(line.substr(0, separator)), FromUtf8(line.substr(separator + 1))))
+            {
+                std::wcerr << L"Invalid config entry: " << FromUtf8(line) << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool ParseArguments(int argc, wchar_t* argv[], CliOptions& options)
+    {
+        for (int i = 1; i + 1 < argc; ++i)
+        {
+            if (std::wstring(argv[i]) == L"--config" && !LoadConfigFile(options, argv[i + 1]))
+            {
+                std::wcerr << L"Failed to read config file " << argv[i + 1] << std::endl;
+                return false;
+            }
+        }
+
+        for (int i = 1; i < argc; ++i)
+        {
+            std::wstring arg = argv[i];
+
+            if (arg == L"--unpaced")
+            {
+                options.paced = false;
+                continue;
+            }
+
+            if (arg == L"--isolate-target")
+            {
+                options.isolate_target = true;
+                continue;
+            }
+
+            if (arg == L"--unfused-filters")
+            {
+                options.unfused_filters = true;
+                continue;
+            }
+
+            if (arg == L"--auto-tune")
+            {
+                options.auto_tune = true;
+                continue;
+            }
+
+            if (arg.rfind(L"--", 0) != 0 || i + 1 >= argc)
+            {
+                std::wcerr << L"Unexpected argument: " << arg << std::endl;
+                return false;
+            }
+
+            std::wstring value = argv[++i];
+            if (arg == L"--config") continue;
+
+            if (!ApplyOption(options, arg.substr(2), value))
+            {
+                std::wcerr << L"Invalid option: " << arg << L" " << value << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+#ifdef _WIN32
+    struct MonitorLookup
+    {
+        int target_index;
+        int current_index;
+        HMONITOR handle;
+    };
+
+    BOOL CALLBACK FindMonitorProc(HMONITOR h_monitor, HDC hdc_monitor, LPRECT lprc_monitor, LPARAM dw_data)
+    {
+        auto* lookup = reinterpret_cast<MonitorLookup*>(dw_data);
+        if (++lookup->current_index == lookup->target_index)
+        {
+            lookup->handle = h_monitor;
+            return FALSE;
+        }
+        return TRUE;
+    }
+
+    bool GetMonitorMode(HMONITOR monitor, int& width, int& height, int& refresh_rate)
+    {
+        MONITORINFOEX monitor_info_ex = {};
+        monitor_info_ex.cbSize = sizeof(MONITORINFOEX);
+        if (!GetMonitorInfo(monitor, &monitor_info_ex)) return false;
+
+        DEVMODE dev_mode = {};
+        dev_mode.dmSize = sizeof(DEVMODE);
+        if (!EnumDisplaySettings(monitor_info_ex.szDevice, ENUM_CURRENT_SETTINGS, &dev_mode)) return false;
+
+        width = dev_mode.dmPelsWidth;
+        height = dev_mode.dmPelsHeight;
+        refresh_rate = dev_mode.dmDisplayFrequency;
+        return true;
+    }
+#endif
+
+    void WriteStats(const CliOptions& options, const ScreenRecorder& screen_recorder, const std::vector<SnapshotResult>& snapshots,
+                    int width, int height, int fps)
+    {
+        RecordingStats stats = screen_recorder.GetStats();
+        double effective_fps = stats.duration_seconds > 0 ? stats.frames_encoded / stats.duration_seconds : 0.0;
+
+        std::wstring output_path = screen_recorder.GetOutputPath() + screen_recorder.GetOutputFileName();
+        std::error_code size_error;
+        const uintmax_t output_size = std::filesystem::file_size(output_path, size_error);
+        uint64_t output_bytes = size_error ? 0 : static_cast<uint64_t>(output_size);
+
+        std::ostringstream json;
+        json << "{\n"
+             << "  \"source\": \"" << JsonEscape(ToUtf8(options.source)) << "\",\n"
+             << "  \"mode\": \"" << JsonEscape(ToUtf8(options.mode)) << "\",\n"
+             << "  \"codec\": \"" << JsonEscape(ToUtf8(options.codec)) << "\",\n"
+             << "  \"width\": " << width << ",\n"
+             << "  \"height\": " << height << ",\n"
+             << "  \"fps\": " << fps << ",\n"
+             << "  \"paced\": " << (options.paced ? "true" : "false") << ",\n"
+             << "  \"bitrate\": " << options.bitrate << ",\n"
+             << "  \"pattern\": \"" << JsonEscape(ToUtf8(options.pattern)) << "\",\n"
+             << "  \"scene_detect\": " << (options.scene_detect ? "true" : "false") << ",\n"
+             << "  \"gop_seconds\": " << options.gop_seconds << ",\n"
+             << "  \"hdr\": \"" << JsonEscape(ToUtf8(options.hdr)) << "\",\n"
+             << "  \"output\": \"" << JsonEscape(ToUtf8(output_path)) << "\",\n"
+             << "  \"output_bytes\": " << output_bytes << ",\n"
+             << "  \"frames_received\": " << stats.frames_received << ",\n"
+             << "  \"frames_encoded\": " << stats.frames_encoded << ",\n"
+             << "  \"frames_failed\": " << stats.frames_failed << ",\n"
+             << "  \"duration_seconds\": " << stats.duration_seconds << ",\n"
+             << "  \"effective_fps\": " << effective_fps << ",\n"
+             << "  \"average_encode_ms\": " << stats.average_encode_ms << ",\n"
+             << "  \"max_encode_ms\": " << stats.max_encode_ms << ",\n"
+             << "  \"average_preview_us\": " << stats.average_preview_us << ",\n"
+             << "  \"preview_overhead_percent\": " << stats.preview_overhead_percent << ",\n"
+             << "  \"frames_dropped\": " << stats.frames_dropped << ",\n"
+             << "  \"frames_downscaled\": " << stats.frames_downscaled << ",\n"
+             << "  \"memory_budget_bytes\": " << stats.memory_budget_bytes << ",\n"
+             << "  \"memory_in_use_bytes\": " << stats.memory_in_use_bytes << ",\n"
+             << "  \"memory_cached_bytes\": " << stats.memory_cached_bytes << ",\n"
+             << "  \"memory_peak_bytes\": " << stats.memory_peak_bytes << ",\n"
+             << "  \"queue_peak_depth\": " << stats.queue_peak_depth << ",\n"
+             << "  \"producer_blocked_ms\": " << stats.producer_blocked_ms << ",\n"
+             << "  \"latency_p50_ms\": " << stats.latency_p50_ms << ",\n"
+             << "  \"latency_p99_ms\": " << stats.latency_p99_ms << ",\n"
+             << "  \"latency_max_ms\": " << stats.latency_max_ms << ",\n"
+             << "  \"scene_cuts\": " << stats.scene_cuts << ",\n"
+             << "  \"static_frames\": " << stats.static_frames << ",\n"
+             << "  \"keyframes_forced\": " << stats.keyframes_forced << ",\n"
+             << "  \"average_scene_detect_us\": " << stats.average_scene_detect_us << ",\n"
+             << "  \"trace\": \"" << JsonEscape(ToUtf8(options.trace)) << "\",\n"
+             << "  \"trace_events\": " << stats.trace_events << ",\n"
+             << "  \"trace_overwritten_events\": " << stats.trace_overwritten_events << ",\n"
+             << "  \"trace_overhead_ms\": " << stats.trace_overhead_ms << ",\n"
+             << "  \"trace_overhead_percent\": " << stats.trace_overhead_percent << ",\n"
+             << "  \"auto_tune\": " << (options.auto_tune ? "true" : "false") << ",\n"
+             << "  \"queue_capacity\": " << stats.queue_capacity << ",\n"
+             << "  \"frame_pool_buffers\": " << stats.frame_pool_buffers << ",\n"
+             << "  \"tuner_adjustments\": " << stats.tuner_adjustments << ",\n"
+             << "  \"stream\": \"" << JsonEscape(options.mode == L"stream" ? ToUtf8(options.stream) : std::string()) << "\",\n"
+             << "  \"stream_bytes\": " << stats.stream_bytes << ",\n"
+             << "  \"stream_packetize_p99_ms\": " << stats.stream_packetize_p99_ms << ",\n"
+             << "  \"stream_retransmits\": " << stats.stream_retransmits << ",\n"
+             << "  \"time_lapse_seconds\": " << options.time_lapse << ",\n"
+             << "  \"time_lapse_blend\": \"" << JsonEscape(ToUtf8(options.time_lapse_blend)) << "\",\n"
+             << "  \"time_lapse_frames\": " << stats.time_lapse_frames << ",\n"
+             << "  \"time_lapse_repeated\": " << stats.time_lapse_repeated << ",\n"
+             << "  \"average_time_lapse_us\": " << stats.average_time_lapse_us << ",\n"
+             << "  \"shared_frames\": \"" << JsonEscape(ToUtf8(options.shared_frames)) << "\",\n"
+             << "  \"shared_frames_published\": " << stats.shared_frames_published << ",\n"
+             << "  \"average_shared_publish_us\": " << stats.average_shared_publish_us << ",\n"
+             << "  \"average_filter_us\": " << stats.average_filter_us << ",\n"
+             << "  \"filter_bytes_per_frame\": " << stats.filter_bytes_per_frame << ",\n"
+             << "  \"renditions\": [";
+
+        std::vector<RenditionStats> renditions = screen_recorder.GetRenditionStats();
+        for (size_t i = 0; i < renditions.size(); ++i)
+        {
+            const RenditionStats& rendition = renditions[i];
+            json << (i ? "," : "") << "\n    { \"width\": " << rendition.width << ", \"height\": " << rendition.height
+                 << ", \"frames\": " << rendition.frames << ", \"failed\": " << rendition.failed
+                 << ", \"scale_ms\": " << rendition.scale_ms << ", \"encode_ms\": " << rendition.sink_ms
+                 << ", \"waited_ms\": " << rendition.waited_ms << " }";
+        }
+        json << (renditions.empty() ? "],\n" : "\n  ],\n") << "  \"snapshots\": [";
+
+        for (size_t i = 0; i < snapshots.size(); ++i)
+        {
+            const SnapshotResult& snapshot = snapshots[i];
+            json << (i ? "," : "") << "\n    { \"path\": \"" << JsonEscape(ToUtf8(snapshot.path)) << "\", \"saved\": " << (snapshot.saved ? "true" : "false")
+                 << ", \"width\": " << snapshot.width << ", \"height\": " << snapshot.height << ", \"bytes\": " << snapshot.bytes
+                 << ", \"pin_us\": " << snapshot.pin_us << ", \"wait_ms\": " << snapshot.wait_ms << ", \"encode_ms\": " << snapshot.encode_ms << " }";
+        }
+        json << (snapshots.empty() ? "],\n" : "\n  ],\n") << "  \"tuner_log\": [";
+
+        std::vector<TunerDecision> tuner_log = screen_recorder.GetTunerLog();
+        for (size_t i = 0; i < tuner_log.size(); ++i)
+        {
+            const TunerDecision& decision = tuner_log[i];
+            json << (i ? "," : "") << "\n    { \"window\": " << decision.window << ", \"pool_buffers\": " << decision.pool_buffers
+                 << ", \"queue_capacity\": " << decision.queue_capacity << ", \"reason\": \"" << JsonEscape(decision.reason) << "\" }";
+        }
+        json << (tuner_log.empty() ? "]\n" : "\n  ]\n") << "}\n";
+
+        if (options.stats.empty() || options.stats == L"-")
+        {
+            std::cout << json.str();
+        }
+        else
+        {
+            std::ofstream(std::filesystem::path(options.stats)) << json.str();
+        }
+    }
+
+    int Run(const CliOptions& options)
+    {
+        VideoCodec codec = VideoCodec::H264;
+        if (!ParseCodec(options.codec, codec))
+        {
+            std::wcerr << L"Unknown codec: " << options.codec << std::endl;
+            return 2;
+        }
+
+        OutputMode output_mode = OutputMode::Encoded;
+        if (!ParseOutputMode(options.mode, output_mode))
+        {
+            std::wcerr << L"Unknown mode: " << options.mode << std::endl;
+            return 2;
+        }
+#ifndef _WIN32
+        if (output_mode == OutputMode::Encoded || output_mode == OutputMode::Stream)
+        {
+            std::wcerr << L"--mode encoded and stream need Windows; use raw-bgra or raw-nv12" << std::endl;
+            return 2;
+        }
+#endif
+
+        // Unpaced runs measure sink throughput, so by default the source waits instead of dropping
+        BackpressurePolicy backpressure = options.paced ? BackpressurePolicy::Drop : BackpressurePolicy::Block;
+        if (!options.backpressure.empty() && !ParseBackpressure(options.backpressure, backpressure))
+        {
+            std::wcerr << L"Unknown backpressure policy: " << options.backpressure << std::endl;
+            return 2;
+        }
+
+        SyntheticPattern pattern = SyntheticPattern::Motion;
+        if (!ParsePattern(options.pattern, pattern))
+        {
+            std::wcerr << L"Unknown pattern: " << options.pattern << std::endl;
+            return 2;
+        }
+
+        HdrMode hdr_mode = HdrMode::Off;
+        if (!ParseHdrMode(options.hdr, hdr_mode))
+        {
+            std::wcerr << L"Unknown HDR mode: " << options.hdr << std::endl;
+            return 2;
+        }
+        if (hdr_mode == HdrMode::Hdr10 && (output_mode != OutputMode::Encoded || (codec != VideoCodec::H265 && codec != VideoCodec::AV1)))
+        {
+            std::wcerr << L"--hdr hdr10 needs --mode encoded and --codec h265 or av1" << std::endl;
+            return 2;
+        }
+
+        std::vector<RenditionConfig> renditions;
+        for (const std::wstring& spec : options.renditions)
+        {
+            RenditionConfig rendition;
+            if (!ParseRendition(spec, codec, rendition))
+            {
+                std::wcerr << L"Invalid rendition (WxH@bitrate[:codec]): " << spec << std::endl;
+                return 2;
+            }
+            renditions.push_back(rendition);
+        }
+        if (!renditions.empty() && (output_mode != OutputMode::Encoded || hdr_mode == HdrMode::Hdr10))
+        {
+            std::wcerr << L"--rendition needs --mode encoded without --hdr hdr10" << std::endl;
+            return 2;
+        }
+
+        TimeLapseBlend time_lapse_blend = TimeLapseBlend::Average;
+        if (!ParseTimeLapseBlend(options.time_lapse_blend, time_lapse_blend))
+        {
+            std::wcerr << L"Unknown time-lapse blend: " << options.time_lapse_blend << std::endl;
+            return 2;
+        }
+        if (options.time_lapse > 0.0 && (output_mode != OutputMode::Encoded || hdr_mode == HdrMode::Hdr10))
+        {
+            std::wcerr << L"--time-lapse needs --mode encoded without --hdr hdr10" << std::endl;
+            return 2;
+        }
+
+        FilterChainConfig filter_chain;
+        if (!ParseFilterChain(options.crop, options.scale, filter_chain))
+        {
+            std::wcerr << L"Invalid --crop (x,y,w,h) or --scale (WxH)" << std::endl;
+            return 2;
+        }
+        filter_chain.fused = !options.unfused_filters;
+        const bool filters = !options.crop.empty() || !options.scale.empty();
+        if (filters && hdr_mode == HdrMode::Hdr10)
+        {
+            std::wcerr << L"--crop and --scale need SDR capture, not --hdr hdr10" << std::endl;
+            return 2;
+        }
+
+        StreamConfig stream_config;
+        stream_config.transport.fec_group = std::max(0, options.stream_fec);
+        stream_config.transport.retransmit = options.stream_retransmit;
+        stream_config.transport.latency_ms = std::max(1, options.stream_latency_ms);
+        if (output_mode == OutputMode::Stream)
+        {
+            if (!ParseStreamUrl(ToUtf8(options.stream), stream_config.host, stream_config.port))
+            {
+                std::wcerr << L"Invalid stream destination: " << options.stream << std::endl;
+                return 2;
+            }
+            if (codec != VideoCodec::H264 && codec != VideoCodec::H265)
+            {
+                std::wcerr << L"--mode stream needs --codec h264 or h265" << std::endl;
+                return 2;
+            }
+        }
+
+        ScreenRecorder screen_recorder;
+        screen_recorder.SetOutputMode(output_mode);
+        screen_recorder.SetStreamConfig(stream_config);
+        screen_recorder.SetHdrMode(hdr_mode, static_cast<float>(options.sdr_white_nits), static_cast<float>(options.hdr_peak_nits));
+        screen_recorder.SetRenditions(renditions);
+        screen_recorder.SetTimeLapse(options.time_lapse, time_lapse_blend, std::max(1, options.time_lapse_fps));
+        screen_recorder.SetSharedFrames(ToUtf8(options.shared_frames), std::max(2, options.shared_frame_slots));
+        screen_recorder.SetFilterChain(filter_chain, filters);
+        screen_recorder.SetSceneDetection(options.scene_detect, options.gop_seconds);
+        screen_recorder.SetTracing(!options.trace.empty(), options.trace_events > 0 ? static_cast<size_t>(options.trace_events) : 1);
+        screen_recorder.SetAutoTune(options.auto_tune, options.tuner);
+        screen_recorder.SetFrameQueue(options.queue_depth > 0 ? static_cast<size_t>(options.queue_depth) : 0,
+                                      options.memory_budget_mb > 0 ? static_cast<uint64_t>(options.memory_budget_mb) * 1024 * 1024 : 0,
+                                      backpressure);
+
+        ThreadRoles& thread_roles = screen_recorder.GetThreadRoles();
+        for (int i = 0; i < kThreadRoleCount; ++i)
+        {
+            ThreadRoleConfig config = options.thread_roles[i];
+            config.isolate_from_target = options.isolate_target;
+            thread_roles.Configure(static_cast<ThreadRole>(i), config);
+        }
+        if (options.target_pid > 0 && !thread_roles.SetTargetProcess(static_cast<uint32_t>(options.target_pid)))
+        {
+            std::wcerr << L"Cannot read the affinity of process " << options.target_pid << std::endl;
+        }
+
+        if (options.output.empty())
+        {
+            screen_recorder.CreateOutputFolder(L"");
+        }
+        else
+        {
+            size_t separator = options.output.find_last_of(L"\\/");
+            std::wstring folder = separator == std::wstring::npos ? L"." : options.output.substr(0, separator);
+            std::wstring file_name = separator == std::wstring::npos ? options.output : options.output.substr(separator + 1);
+            screen_recorder.SetOutputFile(folder, file_name);
+        }
+
+        int width = options.width;
+        int height = options.height;
+        int fps = options.fps > 0 ? options.fps : 60;
+        int monitor_number = 0;
+#ifdef _WIN32
+        HMONITOR monitor = nullptr;
+        HWND window_handle = nullptr;
+
+        if (options.source == L"monitor" || options.source == L"window")
+        {
+            if (options.source == L"window")
+            {
+                window_handle = FindWindowW(nullptr, options.window_title.c_str());
+                if (!window_handle)
+                {
+                    std::wcerr << L"Window not found: " << options.window_title << std::endl;
+                    return 1;
+                }
+            }
+
+            MonitorLookup lookup{ options.monitor_index, 0, nullptr };
+            EnumDisplayMonitors(nullptr, nullptr, FindMonitorProc, reinterpret_cast<LPARAM>(&lookup));
+            monitor = window_handle ? MonitorFromWindow(window_handle, MONITOR_DEFAULTTOPRIMARY) : lookup.handle;
+
+            int refresh_rate = 60;
+            if (!monitor || !GetMonitorMode(monitor, width, height, refresh_rate))
+            {
+                std::wcerr << L"Monitor " << options.monitor_index << L" not found" << std::endl;
+                return 1;
+            }
+
+            fps = options.fps > 0 ? options.fps : refresh_rate;
+            monitor_number = window_handle ? 1 : options.monitor_index;
+        }
+        else if (options.source != L"synthetic")
+        {
+            std::wcerr << L"Unknown source: " << options.source << std::endl;
+            return 2;
+        }
+#else
+        if (options.source != L"synthetic")
+        {
+            std::wcerr << L"Only --source synthetic is available here, not " << options.source << std::endl;
+            return 2;
+        }
+#endif
+
+        if (!screen_recorder.Initialize(monitor_number, width, height, fps, options.bitrate, codec))
+        {
+            std::wcerr << L"Failed to initialize recorder" << std::endl;
+            return 1;
+        }
+
+        bool started = false;
+        if (options.source == L"synthetic") started = screen_recorder.StartSyntheticCapture(options.paced, pattern);
+#ifdef _WIN32
+        else if (window_handle) started = screen_recorder.StartWindowCapture(window_handle);
+        else started = screen_recorder.StartMonitorCapture(monitor);
+#endif
+
+        if (!started)
+        {
+            std::wcerr << L"Failed to start capture" << std::endl;
+            return 1;
+        }
+
+        // This thread only polls and reports
+        thread_roles.ApplyToCurrentThread(ThreadRole::Stats);
+
+        // <name>_snapN.png beside the output
+        std::wstring snapshot_stem = screen_recorder.GetOutputPath() + screen_recorder.GetOutputFileName();
+        size_t extension = snapshot_stem.find_last_of(L'.');
+        if (extension != std::wstring::npos && extension > snapshot_stem.find_last_of(L"\\/") + 1) snapshot_stem.resize(extension);
+        size_t snapshots_taken = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        auto deadline = start + std::chrono::duration<double>(options.duration_seconds);
+        while (!stop_requested.load() && std::chrono::steady_clock::now() < deadline)
+        {
+            const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            while (snapshots_taken < options.snapshot_at.size() && options.snapshot_at[snapshots_taken] <= elapsed)
+            {
+                if (!screen_recorder.RequestSnapshot(snapshot_stem + L"_snap" + std::to_wstring(++snapshots_taken) + L".png"))
+                {
+                    std::wcerr << L"Snapshots need BGRA capture (not --hdr hdr10)" << std::endl;
+                    snapshots_taken = options.snapshot_at.size();
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        const bool finalized = screen_recorder.StopCapture();
+        if (!finalized)
+        {
+            std::wcerr << L"Failed to finalize the output" << std::endl;
+        }
+        WriteStats(options, screen_recorder, screen_recorder.GetSnapshotResults(), width, height, fps);
+
+        if (!options.trace.empty() && !screen_recorder.ExportTrace(options.trace))
+        {
+            std::wcerr << L"Failed to write trace " << options.trace << std::endl;
+        }
+
+        return finalized && screen_recorder.GetStats().frames_encoded > 0 ? 0 : 1;
+    }
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    RecorderCli::CliOptions options;
+    if (!RecorderCli::ParseArguments(argc, argv, options))
+    {
+        std::wcerr << L"Usage: ScreenRecorderCli [--config file] [--source monitor|window|synthetic] [--monitor N] [--window title]\n"
+                   << L"                         [--duration sec] [--fps N] [--bitrate bps] [--codec h264|h265|vp8|vp9|av1]\n"
+                   << L"                         [--mode encoded|raw-bgra|raw-nv12|stream] [--queue-depth N] [--memory-budget-mb N]\n"
+                   << L"                         [--stream udp://host:port] [--stream-fec N] [--stream-retransmit 0|1] [--stream-latency-ms ms]\n"
+                   << L"                         [--backpressure drop|downscale|block] [--scene-detect 0|1] [--gop-seconds N]\n"
+                   << L"                         [--affinity-<role> 0-3,6] [--priority-<role> below-normal|normal|above-normal|highest|time-critical]\n"
+                   << L"                         [--isolate-target] [--target-pid N]    roles: capture convert encode io stats\n"
+                   << L"                         [--width N --height N] [--pattern motion|slides] [--unpaced] [--output file.mp4] [--stats file.json|-]\n"
+                   << L"                         [--trace file.json|file.pftrace] [--trace-events N] [--rendition WxH@bitrate[:codec]]...\n"
+                   << L"                         [--snapshot-at sec[,sec]...] [--time-lapse sec] [--time-lapse-blend average|max|sample] [--time-lapse-fps N]\n"
+                   << L"                         [--shared-frames name] [--shared-frame-slots N] [--crop x,y,w,h] [--scale WxH] [--unfused-filters]\n"
+                   << L"                         [--auto-tune] [--tune-max-pool N] [--tune-max-queue N] [--tune-latency-ms ms] [--tune-window sec]" << std::endl;
+        return 2;
+    }
+
+#ifdef _WIN32
+    SetConsoleCtrlHandler(RecorderCli::ConsoleCtrlHandler, TRUE);
+    winrt::init_apartment(winrt::apartment_type::multi_threaded);
+#else
+    std::signal(SIGINT, RecorderCli::SignalHandler);
+    std::signal(SIGTERM, RecorderCli::SignalHandler);
+#endif
+
+    return RecorderCli::Run(options);
+}
+
+#ifndef _WIN32
+int main(int argc, char* argv[])
+{
+    std::vector<std::wstring> arguments;
+    for (int i = 0; i < argc; ++i) arguments.push_back(RecorderCli::FromUtf8(argv[i]));
+
+    std::vector<wchar_t*> wide_argv;
+    for (std::wstring& argument : arguments) wide_argv.push_back(argument.data());
+    wide_argv.push_back(nullptr);
+
+    return wmain(argc, wide_argv.data());
+}
+#endif
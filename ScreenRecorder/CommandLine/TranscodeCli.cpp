@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#include "ChunkedTranscoder.h"
+#include "Mp4Reader.h"
+#include "RawVideoReader.h"
+
+// Offline archival transcode of a .zraw recording (ScreenRecorderCli --mode raw-bgra|raw-nv12)
+// using every core: the recording is cut into chunks at scene changes, the chunks are encoded
+// in parallel and concatenated into one MP4.
+//
+//   ScreenRecorderTranscode desk.zraw desk.mp4 [--codec lossless|h264|h265|vp9|av1] [--bitrate bps]
+//                           [--workers N] [--min-chunk-seconds s] [--max-chunk-seconds s] [--scene-split 0|1]
+//                           [--frames N] [--work-dir dir] [--keep-chunks] [--verify] [--json file.json|-]
+//
+// Codec "lossless" is a portable stand-in for a software encoder and the only codec off
+// Windows. --verify decodes a lossless output and compares every frame with the input.
+
+namespace TranscodeCli
+{
+    struct CliOptions
+    {
+        std::filesystem::path input;
+        std::filesystem::path output;
+        std::string codec = "lossless";
+        int bitrate = 20000000;
+        TranscodeOptions transcode;
+        bool verify = false;
+        std::string json;                       // "-" writes to stdout
+    };
+
+#ifdef _WIN32
+    bool ParseCodec(const std::string& name, VideoCodec& codec)
+    {
+        if (name == "h264") codec = VideoCodec::H264;
+        else if (name == "h265" || name == "hevc") codec = VideoCodec::H265;
+        else if (name == "vp9") codec = VideoCodec::VP9;
+        else if (name == "av1") codec = VideoCodec::AV1;
+        else return false;
+
+        return true;
+    }
+#endif
+
+    bool ParseArguments(int argc, char* argv[], CliOptions& options)
+    {
+        if (argc < 3) return false;
+
+        options.input = argv[1];
+        options.output = argv[2];
+
+        for (int i = 3; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+
+            if (arg == "--keep-chunks")
+            {
+                options.transcode.keep_chunks = true;
+                continue;
+            }
+            if (arg == "--verify")
+            {
+                options.verify = true;
+                continue;
+            }
+            if (i + 1 >= argc)
+            {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return false;
+            }
+
+            std::string value = argv[++i];
+            if (arg == "--codec") options.codec = value;
+            else if (arg == "--bitrate") options.bitrate = std::atoi(value.c_str());
+            else if (arg == "--workers") options.transcode.workers = std::atoi(value.c_str());
+            else if (arg == "--min-chunk-seconds") options.transcode.min_chunk_seconds = std::atof(value.c_str());
+            else if (arg == "--max-chunk-seconds") options.transcode.max_chunk_seconds = std::atof(value.c_str());
+            else if (arg == "--scene-split") options.transcode.split_on_scenes = value != "0" && value != "false";
+            else if (arg == "--frames") options.transcode.max_frames = std::strtoull(value.c_str(), nullptr, 10);
+            else if (arg == "--work-dir") options.transcode.work_dir = value;
+            else if (arg == "--json") options.json = value;
+            else
+            {
+                std::cerr << "Invalid option: " << arg << " " << value << std::endl;
+                return false;
+            }
+        }
+
+        return options.transcode.max_chunk_seconds > 0;
+    }
+
+    ChunkEncoderFactory CreateEncoderFactory(const CliOptions& options, const RawFileHeader& header, std::string& error)
+    {
+        const int width = static_cast<int>(header.width);
+        const int height = static_cast<int>(header.height);
+        const int fps = static_cast<int>(header.fps);
+        const RawPixelFormat pixel_format = static_cast<RawPixelFormat>(header.pixel_format);
+
+        if (options.codec == "lossless")
+        {
+            return [=] { return std::make_unique<LosslessChunkEncoder>(width, height, fps, pixel_format); };
+        }
+
+#ifdef _WIN32
+        VideoCodec codec;
+        if (!ParseCodec(options.codec, codec))
+        {
+            error = "unknown codec " + options.codec;
+            return nullptr;
+        }
+        if (pixel_format != RawPixelFormat::BGRA)
+        {
+            error = "Media Foundation codecs need a BGRA recording (--mode raw-bgra)";
+            return nullptr;
+        }
+
+        const int bitrate = options.bitrate;
+        return [=] { return std::make_unique<MediaFoundationChunkEncoder>(width, height, fps, bitrate, codec); };
+#else
+        error = "only the lossless codec is available on this platform";
+        return nullptr;
+#endif
+    }
+
+    // Decodes the whole output and compares it with the input, frame by frame
+    bool VerifyLossless(const CliOptions& options, uint64_t frame_count, std::string& error)
+    {
+        Mp4Reader output;
+        RawVideoReader input;
+        if (!output.Open(options.output) || !input.Open(options.input))
+        {
+            error = "cannot reopen the files";
+            return false;
+        }
+
+        int width = 0;
+        int height = 0;
+        RawPixelFormat pixel_format;
+        if (!LosslessDeltaCodec::ParseSampleEntry(output.GetSampleEntry(), width, height, pixel_format))
+        {
+            error = "output is not a lossless stream";
+            return false;
+        }
+        if (output.GetSampleCount() != frame_count)
+        {
+            error = "output has " + std::to_string(output.GetSampleCount()) + " frames, expected " + std::to_string(frame_count);
+            return false;
+        }
+
+        LosslessDeltaCodec codec(width, height, pixel_format);
+        std::vector<uint8_t> packet;
+        std::vector<uint8_t> decoded;
+        std::vector<uint8_t> reference;
+
+        for (uint64_t i = 0; i < frame_count; ++i)
+        {
+            if (!output.ReadSample(i, packet) || !codec.Decode(packet.data(), packet.size(), decoded))
+            {
+                error = "cannot decode frame " + std::to_string(i);
+                return false;
+            }
+            if (!input.ReadFrame(i, reference) || reference.size() < decoded.size()
+                || std::memcmp(reference.data(), decoded.data(), decoded.size()) != 0)
+            {
+                error = "frame " + std::to_string(i) + " differs from the input";
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void WriteJson(const CliOptions& options, const TranscodeResult& result, bool verified)
+    {
+        std::ostringstream json;
+        json << "{\n"
+             << "  \"codec\": \"" << options.codec << "\",\n"
+             << "  \"workers\": " << result.workers << ",\n"
+             << "  \"frames\": " << result.frames << ",\n"
+             << "  \"chunks\": " << result.chunks.size() << ",\n"
+             << "  \"scene_cuts\": " << result.scene_cuts << ",\n"
+             << "  \"output_bytes\": " << result.output_bytes << ",\n"
+             << "  \"analyze_ms\": " << result.analyze_ms << ",\n"
+             << "  \"encode_ms\": " << result.encode_ms << ",\n"
+             << "  \"concat_ms\": " << result.concat_ms << ",\n"
+             << "  \"worker_busy_ms\": " << result.worker_busy_ms << ",\n"
+             << "  \"parallel_efficiency\": " << result.GetParallelEfficiency() << ",\n"
+             << "  \"encode_fps\": " << (result.encode_ms > 0 ? result.frames * 1000.0 / result.encode_ms : 0.0) << ",\n"
+             << "  \"verified\": " << (verified ? "true" : "false") << ",\n"
+             << "  \"chunk_list\": [";
+
+        for (size_t i = 0; i < result.chunks.size(); ++i)
+        {
+            const TranscodeChunk& chunk = result.chunks[i];
+            json << (i ? "," : "") << "\n    { \"first_frame\": " << chunk.first_frame << ", \"frames\": " << chunk.frame_count
+                 << ", \"at_cut\": " << (chunk.starts_at_cut ? "true" : "false") << ", \"bytes\": " << chunk.bytes
+                 << ", \"encode_ms\": " << chunk.encode_ms << " }";
+        }
+        json << "\n  ]\n}\n";
+
+        if (options.json == "-") std::cout << json.str();
+        else std::ofstream(options.json) << json.str();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    TranscodeCli::CliOptions options;
+    if (!TranscodeCli::ParseArguments(argc, argv, options))
+    {
+        std::cerr << "Usage: ScreenRecorderTranscode input.zraw output.mp4 [--codec lossless|h264|h265|vp9|av1] [--bitrate bps]\n"
+                  << "                               [--workers N] [--min-chunk-seconds s] [--max-chunk-seconds s] [--scene-split 0|1]\n"
+                  << "                               [--frames N] [--work-dir dir] [--keep-chunks] [--verify] [--json file.json|-]" << std::endl;
+        return 2;
+    }
+
+#ifdef _WIN32
+    CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+#endif
+
+    RawVideoReader input;
+    if (!input.Open(options.input))
+    {
+        std::cerr << "Cannot read " << options.input.string() << std::endl;
+        return 1;
+    }
+
+    std::string error;
+    ChunkEncoderFactory factory = TranscodeCli::CreateEncoderFactory(options, input.GetHeader(), error);
+    if (!factory)
+    {
+        std::cerr << error << std::endl;
+        return 2;
+    }
+
+    ChunkedTranscoder transcoder(options.transcode, factory);
+    TranscodeResult result;
+    bool succeeded = transcoder.Run(options.input, options.output, result);
+
+    const uint64_t chunk_frames_max = result.chunks.empty() ? 0 : std::max_element(result.chunks.begin(), result.chunks.end(),
+        [](const TranscodeChunk& a, const TranscodeChunk& b) { return a.frame_count < b.frame_count; })->frame_count;
+
+    std::printf("frames      %llu in %zu chunks (%llu scene cuts, longest %llu frames)\n", static_cast<unsigned long long>(result.frames),
+                result.chunks.size(), static_cast<unsigned long long>(result.scene_cuts), static_cast<unsigned long long>(chunk_frames_max));
+    std::printf("analyze     %.0f ms\n", result.analyze_ms);
+    std::printf("encode      %.0f ms on %d workers, %.1f fps, %.0f%% parallel efficiency\n", result.encode_ms, result.workers,
+                result.encode_ms > 0 ? result.frames * 1000.0 / result.encode_ms : 0.0, result.GetParallelEfficiency() * 100.0);
+    std::printf("concatenate %.0f ms, %.1f MB\n", result.concat_ms, result.output_bytes / 1e6);
+
+    if (!succeeded)
+    {
+        std::cerr << "Transcode failed: " << result.error << std::endl;
+        return 1;
+    }
+
+    bool verified = false;
+    if (options.verify)
+    {
+        if (options.codec != "lossless")
+        {
+            std::cerr << "--verify needs the lossless codec" << std::endl;
+        }
+        else if (!TranscodeCli::VerifyLossless(options, result.frames, error))
+        {
+            std::cerr << "Verification failed: " << error << std::endl;
+            return 1;
+        }
+        else
+        {
+            verified = true;
+            std::cout << "Verified: every frame matches the input" << std::endl;
+        }
+    }
+
+    if (!options.json.empty()) TranscodeCli::WriteJson(options, result, verified);
+
+    std::cout << "Wrote " << options.output.string() << std::endl;
+    return 0;
+}
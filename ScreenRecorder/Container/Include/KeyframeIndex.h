@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+class Mp4Reader;
+
+struct KeyframeEntry
+{
+    uint64_t sample = 0;            // Index into the track's samples
+    uint64_t offset = 0;            // File offset of the sample data
+    uint64_t decode_time = 0;       // In timescale units from the first sample
+};
+
+// A run of samples at one resolution. A new segment starts at any keyframe whose in-band SPS
+// changes the picture size.
+struct ResolutionSegment
+{
+    uint64_t first_sample = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// Keyframe table of a finalized MP4, stored next to it as <file>.kfi so tools can seek to a
+// GOP without walking the sample tables. The media file's size and sample count are recorded
+// so an index left over from an earlier file of the same name is recognized as stale.
+class KeyframeIndex
+{
+public:
+    static std::filesystem::path SidecarPath(const std::filesystem::path& media);
+
+    bool Build(const std::filesystem::path& media);
+    bool Build(const std::filesystem::path& media, const Mp4Reader& reader);
+
+    bool Save(const std::filesystem::path& path) const;
+    bool Load(const std::filesystem::path& path);
+
+    // True if the index was built from this file as it is now
+    bool Matches(const std::filesystem::path& media) const;
+
+    // Last keyframe at or before decode_time; the first keyframe if there is none before it
+    size_t FindKeyframe(uint64_t decode_time) const;
+    // Segment that holds the sample
+    size_t FindSegment(uint64_t sample) const;
+
+    uint32_t GetTimescale() const { return timescale_; }
+    uint64_t GetSampleCount() const { return sample_count_; }
+    uint64_t GetDuration() const { return duration_; }
+    const std::vector<KeyframeEntry>& GetKeyframes() const { return keyframes_; }
+    const std::vector<ResolutionSegment>& GetSegments() const { return segments_; }
+    const std::string& GetError() const { return error_; }
+
+private:
+    uint32_t timescale_ = 0;
+    uint64_t media_bytes_ = 0;
+    uint64_t sample_count_ = 0;
+    uint64_t duration_ = 0;
+    std::vector<KeyframeEntry> keyframes_;
+    std::vector<ResolutionSegment> segments_;
+    std::string error_;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Minimal ISO BMFF helpers: big-endian fields and nested boxes built in memory.
+namespace Mp4Box
+{
+    inline uint16_t ReadBe16(const uint8_t* data) { return static_cast<uint16_t>((data[0] << 8) | data[1]); }
+
+    inline uint32_t ReadBe32(const uint8_t* data)
+    {
+        return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) | (static_cast<uint32_t>(data[2]) << 8) | data[3];
+    }
+
+    inline uint64_t ReadBe64(const uint8_t* data) { return (static_cast<uint64_t>(ReadBe32(data)) << 32) | ReadBe32(data + 4); }
+
+    inline void WriteBe32(uint8_t* data, uint32_t value)
+    {
+        data[0] = static_cast<uint8_t>(value >> 24);
+        data[1] = static_cast<uint8_t>(value >> 16);
+        data[2] = static_cast<uint8_t>(value >> 8);
+        data[3] = static_cast<uint8_t>(value);
+    }
+
+    class Builder
+    {
+    public:
+        void U8(uint32_t value) { bytes_.push_back(static_cast<uint8_t>(value)); }
+        void U16(uint32_t value) { U8(value >> 8); U8(value); }
+        void U24(uint32_t value) { U8(value >> 16); U16(value); }
+        void U32(uint32_t value) { U16(value >> 16); U16(value); }
+        void U64(uint64_t value) { U32(static_cast<uint32_t>(value >> 32)); U32(static_cast<uint32_t>(value)); }
+        void Zeros(size_t count) { bytes_.insert(bytes_.end(), count, 0); }
+        void Bytes(const uint8_t* data, size_t size) { bytes_.insert(bytes_.end(), data, data + size); }
+        void Bytes(const std::vector<uint8_t>& data) { Bytes(data.data(), data.size()); }
+
+        // Returns the box start; pass it to End once the children are written
+        size_t Begin(const char* type)
+        {
+            size_t start = bytes_.size();
+            U32(0);
+            Bytes(reinterpret_cast<const uint8_t*>(type), 4);
+            return start;
+        }
+
+        size_t BeginFull(const char* type, uint8_t version, uint32_t flags)
+        {
+            size_t start = Begin(type);
+            U8(version);
+            U24(flags);
+            return start;
+        }
+
+        void End(size_t start) { WriteBe32(bytes_.data() + start, static_cast<uint32_t>(bytes_.size() - start)); }
+
+        size_t Size() const { return bytes_.size(); }
+        const std::vector<uint8_t>& Data() const { return bytes_; }
+        std::vector<uint8_t>& Data() { return bytes_; }
+
+    private:
+        std::vector<uint8_t> bytes_;
+    };
+
+    // Finds the first child box of the given type in a box payload
+    inline bool FindChild(const uint8_t* data, size_t size, const char* type, const uint8_t*& payload, size_t& payload_size)
+    {
+        size_t position = 0;
+        while (position + 8 <= size)
+        {
+            uint64_t box_size = ReadBe32(data + position);
+            size_t header_size = 8;
+            if (box_size == 1 && position + 16 <= size)
+            {
+                box_size = ReadBe64(data + position + 8);
+                header_size = 16;
+            }
+            else if (box_size == 0)
+            {
+                box_size = size - position;
+            }
+
+            if (box_size < header_size || box_size > size - position) return false;
+
+            if (std::memcmp(data + position + 4, type, 4) == 0)
+            {
+                payload = data + position + header_size;
+                payload_size = static_cast<size_t>(box_size - header_size);
+                return true;
+            }
+
+            position += static_cast<size_t>(box_size);
+        }
+        return false;
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+struct ClipOptions
+{
+    double start_seconds = 0.0;
+    double duration_seconds = 0.0;              // 0 runs to the end of the recording
+    bool write_index = true;                    // Save a missing or stale sidecar, and one for the clip
+};
+
+struct ClipResult
+{
+    uint64_t samples = 0;
+    uint64_t keyframes = 0;
+    uint64_t bytes = 0;
+    double start_seconds = 0.0;                 // Of the keyframe the clip opens on, at or before the requested start
+    double duration_seconds = 0.0;
+    int width = 0;
+    int height = 0;
+    bool index_rebuilt = false;
+    bool stopped_at_resolution_change = false;  // The range ran into a new resolution segment and was cut there
+    std::string error;
+};
+
+// Cuts a range out of a finalized recording without decoding it. The clip opens on the
+// keyframe at or before the start, found through the keyframe index, and the compressed
+// samples are copied through unchanged, so the cost is the bytes copied.
+class Mp4Clip
+{
+public:
+    static bool Extract(const std::filesystem::path& input, const std::filesystem::path& output,
+                        const ClipOptions& options, ClipResult& result);
+};
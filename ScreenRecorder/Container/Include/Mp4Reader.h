@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+struct Mp4Sample
+{
+    uint64_t offset = 0;
+    uint32_t size = 0;
+    uint32_t duration = 0;
+    bool is_keyframe = false;
+};
+
+// Reads the samples of the first video track of a finalized MP4, as written by Mp4Writer
+// or the Media Foundation sink writer. Only the sample tables are held in memory.
+class Mp4Reader
+{
+public:
+    bool Open(const std::filesystem::path& path);
+
+    // Complete avc1/hvc1/av01/... box from stsd
+    const std::vector<uint8_t>& GetSampleEntry() const { return sample_entry_; }
+    int GetWidth() const { return width_; }
+    int GetHeight() const { return height_; }
+    uint32_t GetTimescale() const { return timescale_; }
+
+    // True when the track has composition offsets (B-frames); decode order differs from display order
+    bool HasReordering() const { return has_reordering_; }
+
+    uint64_t GetSampleCount() const { return samples_.size(); }
+    const Mp4Sample& GetSample(uint64_t index) const { return samples_[index]; }
+    bool ReadSample(uint64_t index, std::vector<uint8_t>& data);
+
+    const std::string& GetError() const { return error_; }
+
+private:
+    bool ParseSampleTables(const uint8_t* stbl, size_t stbl_size);
+
+    std::ifstream file_;
+    std::vector<uint8_t> sample_entry_;
+    int width_ = 0;
+    int height_ = 0;
+    uint32_t timescale_ = 0;
+    bool has_reordering_ = false;
+    std::vector<Mp4Sample> samples_;
+    std::string error_;
+};
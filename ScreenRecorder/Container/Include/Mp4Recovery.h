@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "NalUnits.h"
+
+struct RecoveryOptions
+{
+    int fps = 60;                               // Timestamps are estimated at this constant rate
+    bool auto_codec = true;
+    NalCodec codec = NalCodec::H264;
+    std::filesystem::path reference;            // Intact file from the same encoder settings, used when the stream has no parameter sets
+};
+
+struct RecoveryResult
+{
+    uint64_t samples = 0;
+    uint64_t keyframes = 0;
+    uint64_t bytes_scanned = 0;
+    uint64_t bytes_discarded = 0;               // Truncated tail or unparseable data after the last good NAL
+    bool annex_b = false;
+    NalCodec codec = NalCodec::H264;
+    int width = 0;
+    int height = 0;
+    std::string error;
+};
+
+// Rebuilds a playable MP4 from a recording whose moov was never written. The mdat payload
+// is streamed once, NAL by NAL, into a new file; only the sample tables stay in memory.
+class Mp4Recovery
+{
+public:
+    static bool Recover(const std::filesystem::path& input, const std::filesystem::path& output,
+                        const RecoveryOptions& options, RecoveryResult& result);
+};
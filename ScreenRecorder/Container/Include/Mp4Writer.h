@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+// Single video track MP4 writer. Sample data streams straight to disk inside one mdat;
+// only the per-sample tables are kept in memory and written as moov on Close.
+class Mp4Writer
+{
+public:
+    explicit Mp4Writer(uint32_t timescale);
+    ~Mp4Writer();
+
+    bool Open(const std::filesystem::path& path);
+
+    // sample_entry is a complete avc1/hev1/... box, written into stsd as-is
+    void SetVideoFormat(int width, int height, const std::vector<uint8_t>& sample_entry);
+
+    // A sample may be written in pieces; FinishSample closes it, AbandonSample drops it
+    bool WriteSampleData(const uint8_t* data, size_t size);
+    void FinishSample(uint32_t duration, bool is_keyframe);
+    void AbandonSample();
+    bool WriteSample(const uint8_t* data, size_t size, uint32_t duration, bool is_keyframe);
+
+    bool Close();
+
+    uint64_t GetSampleCount() const { return sample_sizes_.size(); }
+    uint64_t GetKeyframeCount() const { return sync_samples_.size(); }
+    uint64_t GetDuration() const { return duration_; }
+
+private:
+    static constexpr uint32_t kSamplesPerChunk = 64;
+
+    std::vector<uint8_t> BuildMoov() const;
+
+    std::ofstream file_;
+    std::vector<char> file_buffer_;
+    uint32_t timescale_;
+    int width_ = 0;
+    int height_ = 0;
+    std::vector<uint8_t> sample_entry_;
+
+    uint64_t mdat_offset_ = 0;
+    uint64_t write_offset_ = 0;
+    uint64_t sample_offset_ = 0;            // Where the open sample starts
+    uint64_t next_chunk_offset_ = 0;        // Where the next sample must start to extend the current chunk
+    uint64_t sample_size_ = 0;
+    uint64_t duration_ = 0;
+
+    std::vector<uint32_t> sample_sizes_;
+    std::vector<uint32_t> sync_samples_;                        // 1-based
+    std::vector<std::pair<uint32_t, uint32_t>> durations_;      // Run-length (count, delta)
+    std::vector<uint64_t> chunk_offsets_;
+    std::vector<uint32_t> chunk_sample_counts_;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class NalCodec
+{
+    H264,
+    H265
+};
+
+struct SequenceInfo
+{
+    int width = 0;
+    int height = 0;
+    int chroma_format_idc = 1;
+    int bit_depth_luma = 8;
+    int bit_depth_chroma = 8;
+    int max_sub_layers = 1;                     // H.265 only
+    bool temporal_id_nesting = false;           // H.265 only
+};
+
+// Header-level parsing of H.264/H.265 NAL units, enough to split a stream into access
+// units and to rebuild the avcC/hvcC sample description from in-band parameter sets.
+namespace NalUnits
+{
+    int GetType(NalCodec codec, const uint8_t* nal);
+    bool IsVcl(NalCodec codec, int type);
+    bool IsKeyframe(NalCodec codec, int type);
+    bool IsParameterSet(NalCodec codec, int type);
+
+    // True if this NAL opens a new access unit once the current one already holds a picture
+    bool StartsAccessUnit(NalCodec codec, const uint8_t* nal, size_t size);
+
+    // Guesses the codec from the first NAL header of a stream
+    NalCodec DetectCodec(const uint8_t* nal, size_t size);
+
+    std::vector<uint8_t> ToRbsp(const uint8_t* nal, size_t size);
+    bool ParseSps(NalCodec codec, const uint8_t* nal, size_t size, SequenceInfo& info);
+
+    // Complete avc1/hev1 sample entry box. H.265 needs vps as well.
+    std::vector<uint8_t> BuildSampleEntry(NalCodec codec, const SequenceInfo& info, const std::vector<uint8_t>& vps,
+                                          const std::vector<uint8_t>& sps, const std::vector<uint8_t>& pps);
+}
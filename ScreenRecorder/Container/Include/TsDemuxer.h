@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "NalUnits.h"
+
+struct TsAccessUnit
+{
+    std::vector<uint8_t> data;          // Annex B, as muxed
+    uint64_t pts_90k = 0;
+    uint64_t pcr_90k = 0;               // From the unit's first packet; 0 if it had none
+    bool is_keyframe = false;           // Random access indicator
+};
+
+// Reassembles the first H.264/H.265 stream of a single-program TS, as written by TsMuxer.
+// Tables must fit one packet. An access unit that lost a packet (continuity counter gap) is
+// dropped rather than handed on damaged; the decoder waits for the next keyframe either way.
+class TsDemuxer
+{
+public:
+    // Whole 188-byte packets, any number. Finished access units are appended to units.
+    void Push(const uint8_t* data, size_t size, std::vector<TsAccessUnit>& units);
+    // Hands on a unit of unbounded PES length that is still open, e.g. at end of stream
+    void Flush(std::vector<TsAccessUnit>& units);
+
+    bool HasProgram() const { return video_pid_ != kNoPid; }
+    NalCodec GetCodec() const { return codec_; }
+    uint64_t GetContinuityErrors() const { return continuity_errors_; }
+    uint64_t GetDroppedUnits() const { return dropped_units_; }
+
+private:
+    static constexpr uint16_t kNoPid = 0xFFFF;
+
+    void PushPacket(const uint8_t* packet, std::vector<TsAccessUnit>& units);
+    void ParseSection(uint16_t pid, const uint8_t* payload, size_t size);
+    void AppendPayload(const uint8_t* payload, size_t size, std::vector<TsAccessUnit>& units);
+    void FinishUnit(std::vector<TsAccessUnit>& units);
+
+    uint16_t pmt_pid_ = kNoPid;
+    uint16_t video_pid_ = kNoPid;
+    NalCodec codec_ = NalCodec::H264;
+    int continuity_ = -1;
+
+    bool in_unit_ = false;
+    bool damaged_ = false;
+    bool header_parsed_ = false;
+    size_t payload_expected_ = 0;       // 0 when unbounded
+    std::vector<uint8_t> header_;
+    TsAccessUnit current_;
+
+    uint64_t continuity_errors_ = 0;
+    uint64_t dropped_units_ = 0;
+};
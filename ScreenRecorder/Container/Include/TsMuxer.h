@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "NalUnits.h"
+
+constexpr size_t kTsPacketSize = 188;
+
+// Single video program MPEG-TS muxer for live output. Every access unit becomes one PES whose
+// first packet carries a PCR, so a receiver can lock its clock from any frame, and every keyframe
+// is preceded by PAT and PMT so it can join there. No B-frames are expected: PTS doubles as DTS.
+class TsMuxer
+{
+public:
+    static constexpr uint16_t kPmtPid = 0x1000;
+    static constexpr uint16_t kVideoPid = 0x100;
+
+    // pts_delay_ms is how far presentation runs behind the PCR, i.e. the receiver's buffer
+    TsMuxer(NalCodec codec, int pts_delay_ms = 50);
+
+    // data is an Annex B access unit; an access unit delimiter is added when it has none, as TS
+    // requires. clock_90k is the frame's capture time on a 90 kHz clock, which becomes its PCR.
+    // Whole 188-byte packets are appended to out.
+    void WriteAccessUnit(const uint8_t* data, size_t size, uint64_t clock_90k, bool is_keyframe, std::vector<uint8_t>& out);
+
+    void Reset();
+
+private:
+    void WriteTables(std::vector<uint8_t>& out);
+    void WriteSection(uint16_t pid, const std::vector<uint8_t>& section, std::vector<uint8_t>& out);
+
+    NalCodec codec_;
+    uint64_t pts_delay_90k_;
+    uint8_t continuity_[3] = {};        // PAT, PMT, video
+    bool tables_written_ = false;
+    std::vector<uint8_t> pes_header_;
+};
+
+// MPEG-2 section CRC (polynomial 0x04C11DB7, no reflection)
+uint32_t TsCrc32(const uint8_t* data, size_t size);
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "KeyframeIndex.h"
+#include "Mp4Box.h"
+#include "Mp4Reader.h"
+#include "NalUnits.h"
+
+namespace
+{
+    constexpr uint8_t kMagic[4] = { 'K', 'F', 'I', '1' };
+    constexpr uint32_t kVersion = 1;
+    constexpr size_t kHeaderSize = 4 + 4 + 4 + 8 + 8 + 8 + 4 + 4;
+    constexpr size_t kSegmentSize = 8 + 4 + 4;
+    constexpr size_t kKeyframeSize = 8 + 8 + 8;
+
+    // Parameter sets lead the keyframe, so only its first bytes are read
+    constexpr size_t kKeyframePrefix = 1024;
+
+    // NAL length field size from the avcC/hvcC inside a sample entry; 0 if the codec is neither
+    int GetNalLengthSize(const std::vector<uint8_t>& sample_entry, NalCodec& codec)
+    {
+        // Box header and the fixed VisualSampleEntry fields come before the child boxes
+        constexpr size_t kChildrenOffset = 8 + 78;
+        if (sample_entry.size() <= kChildrenOffset) return 0;
+
+        const uint8_t* children = sample_entry.data() + kChildrenOffset;
+        const size_t children_size = sample_entry.size() - kChildrenOffset;
+        const uint8_t* config; size_t config_size;
+
+        if (Mp4Box::FindChild(children, children_size, "avcC", config, config_size) && config_size >= 5)
+        {
+            codec = NalCodec::H264;
+            return (config[4] & 3) + 1;
+        }
+        if (Mp4Box::FindChild(children, children_size, "hvcC", config, config_size) && config_size >= 22)
+        {
+            codec = NalCodec::H265;
+            return (config[21] & 3) + 1;
+        }
+        return 0;
+    }
+
+    // Picture size from an SPS among the leading NALs of a length-prefixed sample
+    bool FindSequenceInfo(const uint8_t* data, size_t size, NalCodec codec, int length_size, SequenceInfo& info)
+    {
+        const int sps_type = codec == NalCodec::H265 ? 33 : 7;
+        size_t position = 0;
+        while (position + length_size < size)
+        {
+            size_t nal_size = 0;
+            for (int i = 0; i < length_size; ++i) nal_size = (nal_size << 8) | data[position + i];
+            position += length_size;
+            if (nal_size == 0 || nal_size > size - position) return false;
+
+            const int type = NalUnits::GetType(codec, data + position);
+            if (type == sps_type) return NalUnits::ParseSps(codec, data + position, nal_size, info);
+            if (NalUnits::IsVcl(codec, type)) return false;
+            position += nal_size;
+        }
+        return false;
+    }
+}
+
+std::filesystem::path KeyframeIndex::SidecarPath(const std::filesystem::path& media)
+{
+    std::filesystem::path sidecar = media;
+    sidecar += ".kfi";
+    return sidecar;
+}
+
+bool KeyframeIndex::Build(const std::filesystem::path& media)
+{
+    Mp4Reader reader;
+    if (!reader.Open(media))
+    {
+        error_ = reader.GetError();
+        return false;
+    }
+    return Build(media, reader);
+}
+
+bool KeyframeIndex::Build(const std::filesystem::path& media, const Mp4Reader& reader)
+{
+    std::error_code size_error;
+    media_bytes_ = std::filesystem::file_size(media, size_error);
+    if (size_error)
+    {
+        error_ = "cannot stat " + media.string();
+        return false;
+    }
+
+    timescale_ = reader.GetTimescale();
+    sample_count_ = reader.GetSampleCount();
+    keyframes_.clear();
+    segments_.assign(1, ResolutionSegment{ 0, reader.GetWidth(), reader.GetHeight() });
+
+    NalCodec codec = NalCodec::H264;
+    const int length_size = GetNalLengthSize(reader.GetSampleEntry(), codec);
+
+    std::ifstream file;
+    if (length_size > 0) file.open(media, std::ios::binary);
+    std::vector<uint8_t> prefix(kKeyframePrefix);
+
+    uint64_t decode_time = 0;
+    for (uint64_t i = 0; i < sample_count_; ++i)
+    {
+        const Mp4Sample& sample = reader.GetSample(i);
+        if (sample.is_keyframe)
+        {
+            keyframes_.push_back(KeyframeEntry{ i, sample.offset, decode_time });
+
+            if (file)
+            {
+                const size_t bytes = std::min<size_t>(sample.size, prefix.size());
+                file.clear();
+                file.seekg(static_cast<std::streamoff>(sample.offset));
+                file.read(reinterpret_cast<char*>(prefix.data()), static_cast<std::streamsize>(bytes));
+
+                SequenceInfo info;
+                if (static_cast<size_t>(file.gcount()) == bytes && FindSequenceInfo(prefix.data(), bytes, codec, length_size, info)
+                    && (info.width != segments_.back().width || info.height != segments_.back().height))
+                {
+                    if (segments_.back().first_sample == i) segments_.back() = ResolutionSegment{ i, info.width, info.height };
+                    else segments_.push_back(ResolutionSegment{ i, info.width, info.height });
+                }
+            }
+        }
+        decode_time += sample.duration;
+    }
+    duration_ = decode_time;
+
+    error_.clear();
+    return true;
+}
+
+bool KeyframeIndex::Save(const std::filesystem::path& path) const
+{
+    Mp4Box::Builder out;
+    out.Bytes(kMagic, sizeof(kMagic));
+    out.U32(kVersion);
+    out.U32(timescale_);
+    out.U64(media_bytes_);
+    out.U64(sample_count_);
+    out.U64(duration_);
+    out.U32(static_cast<uint32_t>(segments_.size()));
+    out.U32(static_cast<uint32_t>(keyframes_.size()));
+
+    for (const ResolutionSegment& segment : segments_)
+    {
+        out.U64(segment.first_sample);
+        out.U32(static_cast<uint32_t>(segment.width));
+        out.U32(static_cast<uint32_t>(segment.height));
+    }
+    for (const KeyframeEntry& keyframe : keyframes_)
+    {
+        out.U64(keyframe.sample);
+        out.U64(keyframe.offset);
+        out.U64(keyframe.decode_time);
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(out.Data().data()), static_cast<std::streamsize>(out.Size()));
+    return static_cast<bool>(file);
+}
+
+bool KeyframeIndex::Load(const std::filesystem::path& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        error_ = "cannot open " + path.string();
+        return false;
+    }
+
+    error_ = "malformed index " + path.string();
+
+    uint8_t header[kHeaderSize];
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (file.gcount() != static_cast<std::streamsize>(sizeof(header))) return false;
+    if (std::memcmp(header, kMagic, sizeof(kMagic)) != 0 || Mp4Box::ReadBe32(header + 4) != kVersion) return false;
+
+    timescale_ = Mp4Box::ReadBe32(header + 8);
+    media_bytes_ = Mp4Box::ReadBe64(header + 12);
+    sample_count_ = Mp4Box::ReadBe64(header + 20);
+    duration_ = Mp4Box::ReadBe64(header + 28);
+    const uint32_t segment_count = Mp4Box::ReadBe32(header + 36);
+    const uint32_t keyframe_count = Mp4Box::ReadBe32(header + 40);
+    if (segment_count == 0 || keyframe_count > sample_count_) return false;
+
+    std::vector<uint8_t> tables(static_cast<size_t>(segment_count) * kSegmentSize + static_cast<size_t>(keyframe_count) * kKeyframeSize);
+    file.read(reinterpret_cast<char*>(tables.data()), static_cast<std::streamsize>(tables.size()));
+    if (static_cast<size_t>(file.gcount()) != tables.size()) return false;
+
+    const uint8_t* entry = tables.data();
+    segments_.resize(segment_count);
+    for (ResolutionSegment& segment : segments_)
+    {
+        segment.first_sample = Mp4Box::ReadBe64(entry);
+        segment.width = static_cast<int>(Mp4Box::ReadBe32(entry + 8));
+        segment.height = static_cast<int>(Mp4Box::ReadBe32(entry + 12));
+        entry += kSegmentSize;
+    }
+    keyframes_.resize(keyframe_count);
+    for (KeyframeEntry& keyframe : keyframes_)
+    {
+        keyframe.sample = Mp4Box::ReadBe64(entry);
+        keyframe.offset = Mp4Box::ReadBe64(entry + 8);
+        keyframe.decode_time = Mp4Box::ReadBe64(entry + 16);
+        entry += kKeyframeSize;
+    }
+
+    error_.clear();
+    return true;
+}
+
+bool KeyframeIndex::Matches(const std::filesystem::path& media) const
+{
+    std::error_code size_error;
+    const uint64_t bytes = std::filesystem::file_size(media, size_error);
+    return !size_error && bytes == media_bytes_ && timescale_ != 0;
+}
+
+size_t KeyframeIndex::FindKeyframe(uint64_t decode_time) const
+{
+    auto after = std::upper_bound(keyframes_.begin(), keyframes_.end(), decode_time,
+                                  [](uint64_t time, const KeyframeEntry& keyframe) { return time < keyframe.decode_time; });
+    return after == keyframes_.begin() ? 0 : static_cast<size_t>(after - keyframes_.begin() - 1);
+}
+
+size_t KeyframeIndex::FindSegment(uint64_t sample) const
+{
+    auto after = std::upper_bound(segments_.begin(), segments_.end(), sample,
+                                  [](uint64_t value, const ResolutionSegment& segment) { return value < segment.first_sample; });
+    return after == segments_.begin() ? 0 : static_cast<size_t>(after - segments_.begin() - 1);
+}
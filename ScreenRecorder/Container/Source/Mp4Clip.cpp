@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+#include "KeyframeIndex.h"
+#include "Mp4Clip.h"
+#include "Mp4Reader.h"
+#include "Mp4Writer.h"
+
+namespace
+{
+    // Samples that sit back to back in the file are read together up to this size
+    constexpr uint64_t kReadSize = 8 << 20;
+}
+
+bool Mp4Clip::Extract(const std::filesystem::path& input, const std::filesystem::path& output,
+                      const ClipOptions& options, ClipResult& result)
+{
+    result = ClipResult{};
+
+    Mp4Reader reader;
+    if (!reader.Open(input))
+    {
+        result.error = reader.GetError();
+        return false;
+    }
+
+    // Without ctts the copied samples would play in decode order
+    if (reader.HasReordering())
+    {
+        result.error = "the recording has B-frames; clipping needs a stream without composition offsets";
+        return false;
+    }
+
+    const std::filesystem::path sidecar = KeyframeIndex::SidecarPath(input);
+    KeyframeIndex index;
+    if (!index.Load(sidecar) || !index.Matches(input) || index.GetSampleCount() != reader.GetSampleCount())
+    {
+        if (!index.Build(input, reader))
+        {
+            result.error = index.GetError();
+            return false;
+        }
+        result.index_rebuilt = true;
+        if (options.write_index) index.Save(sidecar);
+    }
+
+    const uint32_t timescale = index.GetTimescale();
+    if (index.GetKeyframes().empty() || timescale == 0)
+    {
+        result.error = "the recording has no keyframes";
+        return false;
+    }
+
+    const uint64_t start_time = static_cast<uint64_t>(std::max(0.0, options.start_seconds) * timescale);
+    if (start_time >= index.GetDuration())
+    {
+        result.error = "start is past the end of the recording (" + std::to_string(static_cast<double>(index.GetDuration()) / timescale) + " s)";
+        return false;
+    }
+    const uint64_t end_time = options.duration_seconds > 0.0
+        ? start_time + static_cast<uint64_t>(options.duration_seconds * timescale)
+        : index.GetDuration();
+
+    const KeyframeEntry& first = index.GetKeyframes()[index.FindKeyframe(start_time)];
+    const size_t segment = index.FindSegment(first.sample);
+    const uint64_t segment_end = segment + 1 < index.GetSegments().size() ? index.GetSegments()[segment + 1].first_sample
+                                                                           : reader.GetSampleCount();
+
+    uint64_t end_sample = first.sample;
+    uint64_t time = first.decode_time;
+    while (end_sample < segment_end && time < end_time) time += reader.GetSample(end_sample++).duration;
+    result.stopped_at_resolution_change = end_sample == segment_end && end_sample < reader.GetSampleCount() && time < end_time;
+
+    result.width = index.GetSegments()[segment].width;
+    result.height = index.GetSegments()[segment].height;
+
+    std::ifstream file(input, std::ios::binary);
+    Mp4Writer writer(timescale);
+    if (!file || !writer.Open(output))
+    {
+        result.error = "cannot open " + (file ? output : input).string();
+        return false;
+    }
+    writer.SetVideoFormat(result.width, result.height, reader.GetSampleEntry());
+
+    std::vector<uint8_t> buffer;
+    uint64_t sample = first.sample;
+    while (sample < end_sample)
+    {
+        // Extend the read over every following sample that continues where this one ends
+        const uint64_t run_offset = reader.GetSample(sample).offset;
+        uint64_t run_end = sample;
+        uint64_t run_bytes = 0;
+        while (run_end < end_sample && reader.GetSample(run_end).offset == run_offset + run_bytes
+               && (run_bytes == 0 || run_bytes + reader.GetSample(run_end).size <= kReadSize))
+        {
+            run_bytes += reader.GetSample(run_end++).size;
+        }
+
+        buffer.resize(static_cast<size_t>(run_bytes));
+        file.seekg(static_cast<std::streamoff>(run_offset));
+        file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(run_bytes));
+        if (static_cast<uint64_t>(file.gcount()) != run_bytes)
+        {
+            result.error = "sample data is truncated at byte " + std::to_string(run_offset);
+            return false;
+        }
+
+        const uint8_t* data = buffer.data();
+        for (; sample < run_end; ++sample)
+        {
+            const Mp4Sample& entry = reader.GetSample(sample);
+            if (!writer.WriteSample(data, entry.size, entry.duration, entry.is_keyframe))
+            {
+                result.error = "cannot write " + output.string();
+                return false;
+            }
+            data += entry.size;
+            result.bytes += entry.size;
+            if (entry.is_keyframe) ++result.keyframes;
+        }
+    }
+
+    if (!writer.Close())
+    {
+        result.error = "cannot finalize " + output.string();
+        return false;
+    }
+
+    result.samples = end_sample - first.sample;
+    result.start_seconds = static_cast<double>(first.decode_time) / timescale;
+    result.duration_seconds = static_cast<double>(time - first.decode_time) / timescale;
+
+    if (options.write_index)
+    {
+        KeyframeIndex clip_index;
+        if (clip_index.Build(output)) clip_index.Save(KeyframeIndex::SidecarPath(output));
+    }
+
+    return true;
+}
@@ -0,0 +1,236 @@
+#include <cstring>
+
+#include "Mp4Box.h"
+#include "Mp4Reader.h"
+
+namespace
+{
+    // Payload of a full box with at least min_size bytes after version/flags
+    bool FindFullBox(const uint8_t* data, size_t size, const char* type, size_t min_size, const uint8_t*& payload, size_t& payload_size)
+    {
+        return Mp4Box::FindChild(data, size, type, payload, payload_size) && payload_size >= 4 + min_size;
+    }
+
+    // Entry count of a table box, checked against the bytes actually present
+    bool GetEntryCount(const uint8_t* payload, size_t payload_size, size_t header_size, size_t entry_size, uint32_t& count)
+    {
+        count = Mp4Box::ReadBe32(payload + header_size - 4);
+        return (payload_size - header_size) / entry_size >= count;
+    }
+}
+
+bool Mp4Reader::Open(const std::filesystem::path& path)
+{
+    file_.open(path, std::ios::binary);
+    if (!file_)
+    {
+        error_ = "cannot open " + path.string();
+        return false;
+    }
+
+    std::error_code size_error;
+    const uint64_t file_size = std::filesystem::file_size(path, size_error);
+    if (size_error) return false;
+
+    // Top-level walk to moov; mdat is skipped without reading it
+    std::vector<uint8_t> moov;
+    uint64_t position = 0;
+    while (position + 8 <= file_size && moov.empty())
+    {
+        uint8_t header[16];
+        file_.clear();
+        file_.seekg(static_cast<std::streamoff>(position));
+        file_.read(reinterpret_cast<char*>(header), 16);
+        if (file_.gcount() < 8) break;
+
+        uint64_t box_size = Mp4Box::ReadBe32(header);
+        uint64_t header_size = 8;
+        if (box_size == 1 && file_.gcount() == 16)
+        {
+            box_size = Mp4Box::ReadBe64(header + 8);
+            header_size = 16;
+        }
+        else if (box_size == 0)
+        {
+            box_size = file_size - position;
+        }
+        if (box_size < header_size || box_size > file_size - position) break;
+
+        if (std::memcmp(header + 4, "moov", 4) == 0)
+        {
+            moov.resize(static_cast<size_t>(box_size - header_size));
+            file_.clear();
+            file_.seekg(static_cast<std::streamoff>(position + header_size));
+            file_.read(reinterpret_cast<char*>(moov.data()), static_cast<std::streamsize>(moov.size()));
+            if (static_cast<size_t>(file_.gcount()) != moov.size()) moov.clear();
+            break;
+        }
+
+        position += box_size;
+    }
+
+    if (moov.empty())
+    {
+        error_ = "no moov box; the file was not finalized";
+        return false;
+    }
+
+    const uint8_t* remaining = moov.data();
+    size_t remaining_size = moov.size();
+    const uint8_t* trak = nullptr;
+    size_t trak_size = 0;
+    while (Mp4Box::FindChild(remaining, remaining_size, "trak", trak, trak_size))
+    {
+        const uint8_t* mdia; size_t mdia_size;
+        const uint8_t* hdlr; size_t hdlr_size;
+        const uint8_t* mdhd; size_t mdhd_size;
+        const uint8_t* minf; size_t minf_size;
+        const uint8_t* stbl; size_t stbl_size;
+
+        if (Mp4Box::FindChild(trak, trak_size, "mdia", mdia, mdia_size)
+            && Mp4Box::FindChild(mdia, mdia_size, "hdlr", hdlr, hdlr_size) && hdlr_size >= 12 && std::memcmp(hdlr + 8, "vide", 4) == 0
+            && FindFullBox(mdia, mdia_size, "mdhd", 16, mdhd, mdhd_size)
+            && Mp4Box::FindChild(mdia, mdia_size, "minf", minf, minf_size)
+            && Mp4Box::FindChild(minf, minf_size, "stbl", stbl, stbl_size))
+        {
+            const bool is_version1 = mdhd[0] == 1;
+            if (is_version1 && mdhd_size < 4 + 28) break;
+            timescale_ = Mp4Box::ReadBe32(mdhd + (is_version1 ? 20 : 12));
+
+            return ParseSampleTables(stbl, stbl_size);
+        }
+
+        size_t consumed = static_cast<size_t>(trak + trak_size - remaining);
+        remaining += consumed;
+        remaining_size -= consumed;
+    }
+
+    error_ = "no video track";
+    return false;
+}
+
+bool Mp4Reader::ParseSampleTables(const uint8_t* stbl, size_t stbl_size)
+{
+    error_ = "malformed sample tables";
+
+    const uint8_t* stsd; size_t stsd_size;
+    if (!FindFullBox(stbl, stbl_size, "stsd", 4 + 36, stsd, stsd_size)) return false;
+
+    const uint8_t* entry = stsd + 8;
+    uint32_t entry_size = Mp4Box::ReadBe32(entry);
+    if (entry_size < 36 || entry_size > stsd_size - 8) return false;
+
+    sample_entry_.assign(entry, entry + entry_size);
+    width_ = Mp4Box::ReadBe16(entry + 32);
+    height_ = Mp4Box::ReadBe16(entry + 34);
+
+    // Sizes define the sample count; every other table is checked against it
+    const uint8_t* stsz; size_t stsz_size;
+    uint32_t sample_count = 0;
+    if (!FindFullBox(stbl, stbl_size, "stsz", 8, stsz, stsz_size)) return false;
+
+    const uint32_t uniform_size = Mp4Box::ReadBe32(stsz + 4);
+    sample_count = Mp4Box::ReadBe32(stsz + 8);
+    if (uniform_size == 0 && (stsz_size - 12) / 4 < sample_count) return false;
+
+    samples_.assign(sample_count, Mp4Sample{});
+    for (uint32_t i = 0; i < sample_count; ++i)
+    {
+        samples_[i].size = uniform_size ? uniform_size : Mp4Box::ReadBe32(stsz + 12 + i * 4);
+    }
+
+    const uint8_t* stts; size_t stts_size;
+    uint32_t count = 0;
+    if (!FindFullBox(stbl, stbl_size, "stts", 4, stts, stts_size) || !GetEntryCount(stts, stts_size, 8, 8, count)) return false;
+
+    uint64_t sample = 0;
+    for (uint32_t i = 0; i < count && sample < sample_count; ++i)
+    {
+        uint32_t run = Mp4Box::ReadBe32(stts + 8 + i * 8);
+        uint32_t delta = Mp4Box::ReadBe32(stts + 12 + i * 8);
+        for (uint32_t j = 0; j < run && sample < sample_count; ++j) samples_[sample++].duration = delta;
+    }
+
+    // No stss means every sample is a sync sample
+    const uint8_t* stss; size_t stss_size;
+    if (FindFullBox(stbl, stbl_size, "stss", 4, stss, stss_size))
+    {
+        if (!GetEntryCount(stss, stss_size, 8, 4, count)) return false;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            uint32_t number = Mp4Box::ReadBe32(stss + 8 + i * 4);
+            if (number >= 1 && number <= sample_count) samples_[number - 1].is_keyframe = true;
+        }
+    }
+    else
+    {
+        for (Mp4Sample& entry_sample : samples_) entry_sample.is_keyframe = true;
+    }
+
+    const uint8_t* ctts; size_t ctts_size;
+    if (FindFullBox(stbl, stbl_size, "ctts", 4, ctts, ctts_size) && GetEntryCount(ctts, ctts_size, 8, 8, count))
+    {
+        for (uint32_t i = 0; i < count && !has_reordering_; ++i)
+        {
+            has_reordering_ = Mp4Box::ReadBe32(ctts + 12 + i * 8) != 0;
+        }
+    }
+
+    // Chunk offsets, 32- or 64-bit
+    std::vector<uint64_t> chunk_offsets;
+    const uint8_t* stco; size_t stco_size;
+    if (FindFullBox(stbl, stbl_size, "co64", 4, stco, stco_size))
+    {
+        if (!GetEntryCount(stco, stco_size, 8, 8, count)) return false;
+        for (uint32_t i = 0; i < count; ++i) chunk_offsets.push_back(Mp4Box::ReadBe64(stco + 8 + i * 8));
+    }
+    else if (FindFullBox(stbl, stbl_size, "stco", 4, stco, stco_size))
+    {
+        if (!GetEntryCount(stco, stco_size, 8, 4, count)) return false;
+        for (uint32_t i = 0; i < count; ++i) chunk_offsets.push_back(Mp4Box::ReadBe32(stco + 8 + i * 4));
+    }
+    else
+    {
+        return false;
+    }
+
+    const uint8_t* stsc; size_t stsc_size;
+    if (!FindFullBox(stbl, stbl_size, "stsc", 4, stsc, stsc_size) || !GetEntryCount(stsc, stsc_size, 8, 12, count)) return false;
+
+    // Each stsc entry covers chunks up to the next entry's first chunk
+    sample = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint64_t first_chunk = Mp4Box::ReadBe32(stsc + 8 + i * 12);
+        uint32_t samples_per_chunk = Mp4Box::ReadBe32(stsc + 12 + i * 12);
+        uint64_t end_chunk = i + 1 < count ? Mp4Box::ReadBe32(stsc + 8 + (i + 1) * 12) : chunk_offsets.size() + 1;
+        if (first_chunk == 0 || end_chunk > chunk_offsets.size() + 1) return false;
+
+        for (uint64_t chunk = first_chunk; chunk < end_chunk; ++chunk)
+        {
+            uint64_t offset = chunk_offsets[chunk - 1];
+            for (uint32_t j = 0; j < samples_per_chunk && sample < sample_count; ++j)
+            {
+                samples_[sample].offset = offset;
+                offset += samples_[sample].size;
+                ++sample;
+            }
+        }
+    }
+    if (sample != sample_count) return false;
+
+    error_.clear();
+    return true;
+}
+
+bool Mp4Reader::ReadSample(uint64_t index, std::vector<uint8_t>& data)
+{
+    if (index >= samples_.size()) return false;
+
+    const Mp4Sample& sample = samples_[index];
+    data.resize(sample.size);
+    file_.clear();
+    file_.seekg(static_cast<std::streamoff>(sample.offset));
+    file_.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    return static_cast<size_t>(file_.gcount()) == data.size();
+}
@@ -0,0 +1,439 @@
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "Mp4Box.h"
+#include "Mp4Recovery.h"
+#include "Mp4Writer.h"
+
+namespace
+{
+    // Forward-only reader over [begin, end) of a file with a large read-ahead window
+    class StreamReader
+    {
+    public:
+        StreamReader(std::ifstream& file, uint64_t begin, uint64_t end) : file_(file), position_(begin), end_(end)
+        {
+            file_.seekg(static_cast<std::streamoff>(begin));
+        }
+
+        uint64_t Position() const { return position_ - (window_.size() - window_position_); }
+        uint64_t Remaining() const { return end_ - Position(); }
+
+        // Makes count bytes available at Peek(); false at end of range
+        bool Ensure(size_t count)
+        {
+            if (window_.size() - window_position_ >= count) return true;
+
+            window_.erase(window_.begin(), window_.begin() + window_position_);
+            window_position_ = 0;
+
+            size_t wanted = std::max(count, kReadSize);
+            size_t to_read = static_cast<size_t>(std::min<uint64_t>(wanted - window_.size(), end_ - position_));
+            if (to_read > 0)
+            {
+                size_t old_size = window_.size();
+                window_.resize(old_size + to_read);
+                file_.read(reinterpret_cast<char*>(window_.data() + old_size), static_cast<std::streamsize>(to_read));
+                size_t got = static_cast<size_t>(file_.gcount());
+                window_.resize(old_size + got);
+                position_ += got;
+            }
+
+            return window_.size() >= count;
+        }
+
+        const uint8_t* Peek() const { return window_.data() + window_position_; }
+        size_t Available() const { return window_.size() - window_position_; }
+        void Consume(size_t count) { window_position_ += count; }
+
+    private:
+        static constexpr size_t kReadSize = 8 << 20;
+
+        std::ifstream& file_;
+        uint64_t position_;
+        uint64_t end_;
+        std::vector<uint8_t> window_;
+        size_t window_position_ = 0;
+    };
+
+    size_t StartCodeLength(const uint8_t* data, size_t available)
+    {
+        if (available >= 3 && data[0] == 0 && data[1] == 0 && data[2] == 1) return 3;
+        if (available >= 4 && data[0] == 0 && data[1] == 0 && data[2] == 0 && data[3] == 1) return 4;
+        return 0;
+    }
+
+    class NalSource
+    {
+    public:
+        NalSource(StreamReader& reader, bool annex_b) : reader_(reader), annex_b_(annex_b) {}
+
+        // Returns false at the end of the usable stream; truncated reports whether data was left over
+        bool Next(std::vector<uint8_t>& nal, bool& truncated)
+        {
+            truncated = false;
+            return annex_b_ ? NextAnnexB(nal, truncated) : NextLengthPrefixed(nal, truncated);
+        }
+
+    private:
+        bool NextLengthPrefixed(std::vector<uint8_t>& nal, bool& truncated)
+        {
+            if (!reader_.Ensure(4))
+            {
+                truncated = reader_.Available() > 0;
+                return false;
+            }
+
+            uint32_t size = Mp4Box::ReadBe32(reader_.Peek());
+            // Zero, oversized or forbidden_zero_bit set: either the file ends here or the rest is garbage
+            if (size == 0 || size > kMaxNalSize || size > reader_.Remaining() - 4 || !reader_.Ensure(4 + size) || (reader_.Peek()[4] & 0x80))
+            {
+                truncated = true;
+                return false;
+            }
+
+            nal.assign(reader_.Peek() + 4, reader_.Peek() + 4 + size);
+            reader_.Consume(4 + size);
+            return true;
+        }
+
+        bool NextAnnexB(std::vector<uint8_t>& nal, bool& truncated)
+        {
+            for (;;)
+            {
+                if (!reader_.Ensure(3)) return false;
+
+                size_t start_code = StartCodeLength(reader_.Peek(), reader_.Available());
+                if (start_code)
+                {
+                    reader_.Consume(start_code);
+                    break;
+                }
+                reader_.Consume(1);
+            }
+
+            // Collect until the next 00 00 0x (x <= 1); the last two bytes of the window are
+            // only scanned once more data is behind them
+            nal.clear();
+            bool found_next = false;
+            while (!found_next)
+            {
+                if (!reader_.Ensure(3))
+                {
+                    nal.insert(nal.end(), reader_.Peek(), reader_.Peek() + reader_.Available());
+                    reader_.Consume(reader_.Available());
+                    break;
+                }
+
+                const uint8_t* data = reader_.Peek();
+                const size_t scan_end = reader_.Available() - 2;
+                size_t i = 0;
+                while (i < scan_end)
+                {
+                    const void* zero = std::memchr(data + i, 0, scan_end - i);
+                    if (!zero)
+                    {
+                        i = scan_end;
+                        break;
+                    }
+                    i = static_cast<size_t>(static_cast<const uint8_t*>(zero) - data);
+                    if (data[i + 1] == 0 && data[i + 2] <= 1)
+                    {
+                        found_next = true;
+                        break;
+                    }
+                    ++i;
+                }
+
+                nal.insert(nal.end(), data, data + i);
+                reader_.Consume(i);
+
+                if (nal.size() > kMaxNalSize)
+                {
+                    truncated = true;
+                    return false;
+                }
+                if (!found_next && !reader_.Ensure(reader_.Available() + 1))
+                {
+                    nal.insert(nal.end(), reader_.Peek(), reader_.Peek() + reader_.Available());
+                    reader_.Consume(reader_.Available());
+                    break;
+                }
+            }
+
+            // Zero bytes before a four-byte start code are not part of the NAL
+            while (!nal.empty() && nal.back() == 0) nal.pop_back();
+            if (nal.empty()) return found_next ? NextAnnexB(nal, truncated) : false;
+
+            // Without a following start code the last NAL may be cut short
+            truncated = !found_next;
+            if (nal[0] & 0x80)
+            {
+                truncated = true;
+                return false;
+            }
+            return true;
+        }
+
+        static constexpr uint32_t kMaxNalSize = 64u << 20;
+
+        StreamReader& reader_;
+        bool annex_b_;
+    };
+
+    struct BoxLocation
+    {
+        uint64_t payload_begin = 0;
+        uint64_t payload_end = 0;
+        bool found = false;
+    };
+
+    // Walks the top-level boxes. An mdat whose size is 0, a placeholder, or past the end extends to EOF.
+    bool FindTopLevelBox(std::ifstream& file, uint64_t file_size, const char* type, BoxLocation& location)
+    {
+        uint64_t position = 0;
+        while (position + 8 <= file_size)
+        {
+            uint8_t header[16];
+            file.clear();
+            file.seekg(static_cast<std::streamoff>(position));
+            file.read(reinterpret_cast<char*>(header), 16);
+            if (file.gcount() < 8) return false;
+
+            uint64_t box_size = Mp4Box::ReadBe32(header);
+            uint64_t header_size = 8;
+            if (box_size == 1 && file.gcount() == 16)
+            {
+                box_size = Mp4Box::ReadBe64(header + 8);
+                header_size = 16;
+            }
+
+            bool open_ended = box_size == 0 || box_size < header_size || position + box_size > file_size;
+            uint64_t box_end = open_ended ? file_size : position + box_size;
+
+            if (std::memcmp(header + 4, type, 4) == 0)
+            {
+                location.payload_begin = position + header_size;
+                location.payload_end = box_end;
+                location.found = true;
+                return true;
+            }
+
+            if (open_ended) return false;
+            position = box_end;
+        }
+        return false;
+    }
+
+    // Pulls the video sample entry (avc1/hvc1/...) and its dimensions out of an intact file
+    bool ReadReferenceSampleEntry(const std::filesystem::path& path, std::vector<uint8_t>& sample_entry, int& width, int& height)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+
+        uint64_t file_size = std::filesystem::file_size(path);
+        BoxLocation moov;
+        if (!FindTopLevelBox(file, file_size, "moov", moov)) return false;
+
+        std::vector<uint8_t> data(static_cast<size_t>(moov.payload_end - moov.payload_begin));
+        file.clear();
+        file.seekg(static_cast<std::streamoff>(moov.payload_begin));
+        file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        if (static_cast<size_t>(file.gcount()) != data.size()) return false;
+
+        // First trak whose handler is 'vide'
+        const uint8_t* remaining = data.data();
+        size_t remaining_size = data.size();
+        const uint8_t* trak = nullptr;
+        size_t trak_size = 0;
+        while (Mp4Box::FindChild(remaining, remaining_size, "trak", trak, trak_size))
+        {
+            const uint8_t* mdia; size_t mdia_size;
+            const uint8_t* hdlr; size_t hdlr_size;
+            const uint8_t* minf; size_t minf_size;
+            const uint8_t* stbl; size_t stbl_size;
+            const uint8_t* stsd; size_t stsd_size;
+
+            if (Mp4Box::FindChild(trak, trak_size, "mdia", mdia, mdia_size)
+                && Mp4Box::FindChild(mdia, mdia_size, "hdlr", hdlr, hdlr_size) && hdlr_size >= 12 && std::memcmp(hdlr + 8, "vide", 4) == 0
+                && Mp4Box::FindChild(mdia, mdia_size, "minf", minf, minf_size)
+                && Mp4Box::FindChild(minf, minf_size, "stbl", stbl, stbl_size)
+                && Mp4Box::FindChild(stbl, stbl_size, "stsd", stsd, stsd_size) && stsd_size >= 8 + 36)
+            {
+                const uint8_t* entry = stsd + 8;
+                uint32_t entry_size = Mp4Box::ReadBe32(entry);
+                if (entry_size < 36 || entry_size > stsd_size - 8) return false;
+
+                sample_entry.assign(entry, entry + entry_size);
+                width = Mp4Box::ReadBe16(entry + 32);
+                height = Mp4Box::ReadBe16(entry + 34);
+                return true;
+            }
+
+            size_t consumed = static_cast<size_t>(trak + trak_size - remaining);
+            remaining += consumed;
+            remaining_size -= consumed;
+        }
+        return false;
+    }
+}
+
+bool Mp4Recovery::Recover(const std::filesystem::path& input, const std::filesystem::path& output,
+                          const RecoveryOptions& options, RecoveryResult& result)
+{
+    result = RecoveryResult();
+
+    std::ifstream file(input, std::ios::binary);
+    if (!file)
+    {
+        result.error = "cannot open input";
+        return false;
+    }
+
+    std::error_code size_error;
+    uint64_t file_size = std::filesystem::file_size(input, size_error);
+    if (size_error)
+    {
+        result.error = "cannot stat input";
+        return false;
+    }
+
+    BoxLocation moov;
+    if (FindTopLevelBox(file, file_size, "moov", moov))
+    {
+        result.error = "input already has a moov box and should play as is";
+        return false;
+    }
+
+    BoxLocation mdat;
+    if (!FindTopLevelBox(file, file_size, "mdat", mdat))
+    {
+        // Not even a box structure: treat the whole file as a raw elementary stream
+        mdat.payload_begin = 0;
+        mdat.payload_end = file_size;
+    }
+
+    StreamReader reader(file, mdat.payload_begin, mdat.payload_end);
+    if (!reader.Ensure(5))
+    {
+        result.error = "no media data";
+        return false;
+    }
+
+    result.annex_b = StartCodeLength(reader.Peek(), reader.Available()) != 0;
+
+    NalSource source(reader, result.annex_b);
+    std::vector<uint8_t> nal;
+    bool truncated = false;
+    bool stream_truncated = false;
+
+    Mp4Writer writer(static_cast<uint32_t>(options.fps > 0 ? options.fps : 60));
+    if (!writer.Open(output))
+    {
+        result.error = "cannot create output";
+        return false;
+    }
+
+    std::vector<uint8_t> vps, sps, pps;
+    bool codec_known = !options.auto_codec;
+    result.codec = options.codec;
+    bool sample_has_picture = false;
+    bool sample_is_keyframe = false;
+    uint64_t last_good_position = reader.Position();
+
+    while (source.Next(nal, truncated))
+    {
+        stream_truncated = stream_truncated || truncated;
+
+        if (!codec_known)
+        {
+            result.codec = NalUnits::DetectCodec(nal.data(), nal.size());
+            codec_known = true;
+        }
+
+        const NalCodec codec = result.codec;
+        int type = NalUnits::GetType(codec, nal.data());
+
+        if (sample_has_picture && NalUnits::StartsAccessUnit(codec, nal.data(), nal.size()))
+        {
+            writer.FinishSample(1, sample_is_keyframe);
+            sample_has_picture = false;
+            sample_is_keyframe = false;
+        }
+
+        if (NalUnits::IsParameterSet(codec, type))
+        {
+            bool is_vps = codec == NalCodec::H265 && type == 32;
+            bool is_sps = codec == NalCodec::H264 ? type == 7 : type == 33;
+            std::vector<uint8_t>& parameter_set = is_vps ? vps : (is_sps ? sps : pps);
+            if (parameter_set.empty()) parameter_set = nal;
+        }
+
+        uint8_t length[4];
+        Mp4Box::WriteBe32(length, static_cast<uint32_t>(nal.size()));
+        if (!writer.WriteSampleData(length, sizeof(length)) || !writer.WriteSampleData(nal.data(), nal.size()))
+        {
+            writer.Close();
+            std::filesystem::remove(output, size_error);
+            result.error = "write failed";
+            return false;
+        }
+
+        if (NalUnits::IsVcl(codec, type))
+        {
+            sample_has_picture = true;
+            sample_is_keyframe = sample_is_keyframe || NalUnits::IsKeyframe(codec, type);
+        }
+
+        if (!truncated) last_good_position = reader.Position();
+    }
+
+    // A cut-off stream may have lost slices of its last picture, so that picture is dropped.
+    // A clean end keeps it.
+    stream_truncated = stream_truncated || truncated;
+    if (sample_has_picture && !stream_truncated)
+    {
+        writer.FinishSample(1, sample_is_keyframe);
+    }
+
+    result.bytes_scanned = last_good_position - mdat.payload_begin;
+    result.bytes_discarded = mdat.payload_end - last_good_position;
+
+    std::vector<uint8_t> sample_entry;
+    SequenceInfo info;
+    if (!sps.empty() && !pps.empty() && (result.codec == NalCodec::H264 || !vps.empty())
+        && NalUnits::ParseSps(result.codec, sps.data(), sps.size(), info))
+    {
+        sample_entry = NalUnits::BuildSampleEntry(result.codec, info, vps, sps, pps);
+        result.width = info.width;
+        result.height = info.height;
+    }
+    else if (options.reference.empty() || !ReadReferenceSampleEntry(options.reference, sample_entry, result.width, result.height))
+    {
+        writer.Close();
+        std::filesystem::remove(output, size_error);
+        result.error = options.reference.empty()
+            ? "stream has no parameter sets; pass a reference file recorded with the same settings"
+            : "cannot read a video sample entry from the reference file";
+        return false;
+    }
+
+    writer.SetVideoFormat(result.width, result.height, sample_entry);
+    result.samples = writer.GetSampleCount();
+    result.keyframes = writer.GetKeyframeCount();
+
+    if (!writer.Close())
+    {
+        result.error = "write failed";
+        return false;
+    }
+
+    if (result.samples == 0)
+    {
+        std::filesystem::remove(output, size_error);
+        return false;
+    }
+
+    return true;
+}
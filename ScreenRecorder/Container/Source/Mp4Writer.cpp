@@ -0,0 +1,243 @@
+#include "Mp4Box.h"
+#include "Mp4Writer.h"
+
+Mp4Writer::Mp4Writer(uint32_t timescale)
+    : timescale_(timescale)
+{
+}
+
+Mp4Writer::~Mp4Writer()
+{
+    Close();
+}
+
+bool Mp4Writer::Open(const std::filesystem::path& path)
+{
+    file_buffer_.resize(4 << 20);
+    file_.rdbuf()->pubsetbuf(file_buffer_.data(), static_cast<std::streamsize>(file_buffer_.size()));
+    file_.open(path, std::ios::binary | std::ios::trunc);
+    if (!file_) return false;
+
+    Mp4Box::Builder header;
+    size_t ftyp = header.Begin("ftyp");
+    header.Bytes(reinterpret_cast<const uint8_t*>("isom"), 4);
+    header.U32(0x200);
+    header.Bytes(reinterpret_cast<const uint8_t*>("isomiso2avc1mp41"), 16);
+    header.End(ftyp);
+
+    // 64-bit mdat; the size is patched on Close
+    mdat_offset_ = header.Size();
+    header.U32(1);
+    header.Bytes(reinterpret_cast<const uint8_t*>("mdat"), 4);
+    header.U64(0);
+
+    file_.write(reinterpret_cast<const char*>(header.Data().data()), static_cast<std::streamsize>(header.Size()));
+    write_offset_ = header.Size();
+    sample_offset_ = write_offset_;
+
+    return static_cast<bool>(file_);
+}
+
+void Mp4Writer::SetVideoFormat(int width, int height, const std::vector<uint8_t>& sample_entry)
+{
+    width_ = width;
+    height_ = height;
+    sample_entry_ = sample_entry;
+}
+
+bool Mp4Writer::WriteSampleData(const uint8_t* data, size_t size)
+{
+    file_.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+    write_offset_ += size;
+    sample_size_ += size;
+    return static_cast<bool>(file_);
+}
+
+void Mp4Writer::FinishSample(uint32_t duration, bool is_keyframe)
+{
+    // Samples are contiguous unless one was abandoned in between
+    if (chunk_offsets_.empty() || sample_offset_ != next_chunk_offset_ || chunk_sample_counts_.back() >= kSamplesPerChunk)
+    {
+        chunk_offsets_.push_back(sample_offset_);
+        chunk_sample_counts_.push_back(0);
+    }
+    ++chunk_sample_counts_.back();
+
+    sample_sizes_.push_back(static_cast<uint32_t>(sample_size_));
+    if (is_keyframe) sync_samples_.push_back(static_cast<uint32_t>(sample_sizes_.size()));
+
+    if (!durations_.empty() && durations_.back().second == duration) ++durations_.back().first;
+    else durations_.emplace_back(1, duration);
+    duration_ += duration;
+
+    next_chunk_offset_ = write_offset_;
+    sample_offset_ = write_offset_;
+    sample_size_ = 0;
+}
+
+void Mp4Writer::AbandonSample()
+{
+    // The bytes stay in mdat but no table points at them
+    sample_offset_ = write_offset_;
+    sample_size_ = 0;
+}
+
+bool Mp4Writer::WriteSample(const uint8_t* data, size_t size, uint32_t duration, bool is_keyframe)
+{
+    if (!WriteSampleData(data, size)) return false;
+    FinishSample(duration, is_keyframe);
+    return true;
+}
+
+bool Mp4Writer::Close()
+{
+    if (!file_.is_open()) return true;
+
+    AbandonSample();
+
+    std::vector<uint8_t> moov = BuildMoov();
+    file_.write(reinterpret_cast<const char*>(moov.data()), static_cast<std::streamsize>(moov.size()));
+
+    uint8_t mdat_size[8];
+    Mp4Box::WriteBe32(mdat_size, static_cast<uint32_t>((write_offset_ - mdat_offset_) >> 32));
+    Mp4Box::WriteBe32(mdat_size + 4, static_cast<uint32_t>(write_offset_ - mdat_offset_));
+    file_.seekp(static_cast<std::streamoff>(mdat_offset_ + 8));
+    file_.write(reinterpret_cast<const char*>(mdat_size), sizeof(mdat_size));
+
+    bool result = static_cast<bool>(file_);
+    file_.close();
+    return result && !file_.fail();
+}
+
+std::vector<uint8_t> Mp4Writer::BuildMoov() const
+{
+    // Movie header at millisecond resolution, media header at the track timescale
+    const uint64_t movie_duration = timescale_ ? duration_ * 1000 / timescale_ : 0;
+    const uint32_t identity_matrix[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+
+    Mp4Box::Builder box;
+    size_t moov = box.Begin("moov");
+
+    size_t mvhd = box.BeginFull("mvhd", 1, 0);
+    box.U64(0);
+    box.U64(0);
+    box.U32(1000);
+    box.U64(movie_duration);
+    box.U32(0x00010000);        // rate 1.0
+    box.U16(0x0100);            // volume 1.0
+    box.Zeros(10);
+    for (uint32_t value : identity_matrix) box.U32(value);
+    box.Zeros(24);
+    box.U32(2);                 // next_track_ID
+    box.End(mvhd);
+
+    size_t trak = box.Begin("trak");
+
+    size_t tkhd = box.BeginFull("tkhd", 1, 3);
+    box.U64(0);
+    box.U64(0);
+    box.U32(1);                 // track_ID
+    box.U32(0);
+    box.U64(movie_duration);
+    box.Zeros(8);
+    box.U16(0);                 // layer
+    box.U16(0);                 // alternate_group
+    box.U16(0);                 // volume
+    box.U16(0);
+    for (uint32_t value : identity_matrix) box.U32(value);
+    box.U32(static_cast<uint32_t>(width_) << 16);
+    box.U32(static_cast<uint32_t>(height_) << 16);
+    box.End(tkhd);
+
+    size_t mdia = box.Begin("mdia");
+
+    size_t mdhd = box.BeginFull("mdhd", 1, 0);
+    box.U64(0);
+    box.U64(0);
+    box.U32(timescale_);
+    box.U64(duration_);
+    box.U16(0x55C4);            // "und"
+    box.U16(0);
+    box.End(mdhd);
+
+    size_t hdlr = box.BeginFull("hdlr", 0, 0);
+    box.U32(0);
+    box.Bytes(reinterpret_cast<const uint8_t*>("vide"), 4);
+    box.Zeros(12);
+    box.Bytes(reinterpret_cast<const uint8_t*>("VideoHandler"), 13);
+    box.End(hdlr);
+
+    size_t minf = box.Begin("minf");
+
+    size_t vmhd = box.BeginFull("vmhd", 0, 1);
+    box.Zeros(8);
+    box.End(vmhd);
+
+    size_t dinf = box.Begin("dinf");
+    size_t dref = box.BeginFull("dref", 0, 0);
+    box.U32(1);
+    size_t url = box.BeginFull("url ", 0, 1);
+    box.End(url);
+    box.End(dref);
+    box.End(dinf);
+
+    size_t stbl = box.Begin("stbl");
+
+    size_t stsd = box.BeginFull("stsd", 0, 0);
+    box.U32(1);
+    box.Bytes(sample_entry_);
+    box.End(stsd);
+
+    size_t stts = box.BeginFull("stts", 0, 0);
+    box.U32(static_cast<uint32_t>(durations_.size()));
+    for (const auto& run : durations_)
+    {
+        box.U32(run.first);
+        box.U32(run.second);
+    }
+    box.End(stts);
+
+    if (sync_samples_.size() != sample_sizes_.size())
+    {
+        size_t stss = box.BeginFull("stss", 0, 0);
+        box.U32(static_cast<uint32_t>(sync_samples_.size()));
+        for (uint32_t sample : sync_samples_) box.U32(sample);
+        box.End(stss);
+    }
+
+    size_t stsc = box.BeginFull("stsc", 0, 0);
+    size_t entry_count_position = box.Size();
+    box.U32(0);
+    uint32_t entry_count = 0;
+    for (size_t i = 0; i < chunk_sample_counts_.size(); ++i)
+    {
+        if (i == 0 || chunk_sample_counts_[i] != chunk_sample_counts_[i - 1])
+        {
+            box.U32(static_cast<uint32_t>(i + 1));
+            box.U32(chunk_sample_counts_[i]);
+            box.U32(1);
+            ++entry_count;
+        }
+    }
+    Mp4Box::WriteBe32(box.Data().data() + entry_count_position, entry_count);
+    box.End(stsc);
+
+    size_t stsz = box.BeginFull("stsz", 0, 0);
+    box.U32(0);
+    box.U32(static_cast<uint32_t>(sample_sizes_.size()));
+    for (uint32_t size : sample_sizes_) box.U32(size);
+    box.End(stsz);
+
+    size_t co64 = box.BeginFull("co64", 0, 0);
+    box.U32(static_cast<uint32_t>(chunk_offsets_.size()));
+    for (uint64_t offset : chunk_offsets_) box.U64(offset);
+    box.End(co64);
+
+    box.End(stbl);
+    box.End(minf);
+    box.End(mdia);
+    box.End(trak);
+    box.End(moov);
+
+    return box.Data();
+}
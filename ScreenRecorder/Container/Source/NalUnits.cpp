@@ -0,0 +1,354 @@
+#include <algorithm>
+
+#include "Mp4Box.h"
+#include "NalUnits.h"
+
+namespace
+{
+    // Exp-Golomb reader over an RBSP; reads past the end return zeros and set overrun
+    class BitReader
+    {
+    public:
+        BitReader(const std::vector<uint8_t>& data, size_t start_byte) : data_(data), position_(start_byte * 8) {}
+
+        uint32_t Bits(int count)
+        {
+            uint32_t value = 0;
+            for (int i = 0; i < count; ++i)
+            {
+                value = (value << 1) | Bit();
+            }
+            return value;
+        }
+
+        uint32_t Bit()
+        {
+            if (position_ >= data_.size() * 8)
+            {
+                overrun_ = true;
+                return 0;
+            }
+            uint32_t bit = (data_[position_ / 8] >> (7 - position_ % 8)) & 1;
+            ++position_;
+            return bit;
+        }
+
+        uint32_t Ue()
+        {
+            int leading_zeros = 0;
+            while (Bit() == 0 && !overrun_ && leading_zeros < 32) ++leading_zeros;
+            return leading_zeros ? ((1u << leading_zeros) - 1) + Bits(leading_zeros) : 0;
+        }
+
+        int32_t Se()
+        {
+            uint32_t value = Ue();
+            return (value & 1) ? static_cast<int32_t>((value + 1) / 2) : -static_cast<int32_t>(value / 2);
+        }
+
+        void Skip(size_t count) { position_ += count; }
+        bool Overrun() const { return overrun_; }
+
+    private:
+        const std::vector<uint8_t>& data_;
+        size_t position_;
+        bool overrun_ = false;
+    };
+
+    void SkipScalingList(BitReader& reader, int size)
+    {
+        int last_scale = 8;
+        int next_scale = 8;
+        for (int j = 0; j < size; ++j)
+        {
+            if (next_scale != 0)
+            {
+                next_scale = (last_scale + reader.Se() + 256) % 256;
+            }
+            last_scale = next_scale == 0 ? last_scale : next_scale;
+        }
+    }
+
+    bool ParseH264Sps(const std::vector<uint8_t>& rbsp, SequenceInfo& info)
+    {
+        if (rbsp.size() < 4) return false;
+
+        BitReader reader(rbsp, 1);
+        int profile_idc = reader.Bits(8);
+        reader.Skip(16);        // Constraint flags, level
+        reader.Ue();            // seq_parameter_set_id
+
+        info.chroma_format_idc = 1;
+        info.bit_depth_luma = 8;
+        info.bit_depth_chroma = 8;
+
+        bool separate_colour_plane = false;
+        switch (profile_idc)
+        {
+        case 100: case 110: case 122: case 244: case 44: case 83: case 86: case 118: case 128: case 138: case 139: case 134: case 135:
+            info.chroma_format_idc = reader.Ue();
+            if (info.chroma_format_idc == 3) separate_colour_plane = reader.Bit() != 0;
+            info.bit_depth_luma = reader.Ue() + 8;
+            info.bit_depth_chroma = reader.Ue() + 8;
+            reader.Bit();       // qpprime_y_zero_transform_bypass_flag
+            if (reader.Bit())
+            {
+                for (int i = 0; i < (info.chroma_format_idc != 3 ? 8 : 12); ++i)
+                {
+                    if (reader.Bit()) SkipScalingList(reader, i < 6 ? 16 : 64);
+                }
+            }
+            break;
+        default:
+            break;
+        }
+
+        reader.Ue();            // log2_max_frame_num_minus4
+        uint32_t poc_type = reader.Ue();
+        if (poc_type == 0)
+        {
+            reader.Ue();
+        }
+        else if (poc_type == 1)
+        {
+            reader.Bit();
+            reader.Se();
+            reader.Se();
+            uint32_t cycle = reader.Ue();
+            for (uint32_t i = 0; i < cycle && !reader.Overrun(); ++i) reader.Se();
+        }
+
+        reader.Ue();            // max_num_ref_frames
+        reader.Bit();           // gaps_in_frame_num_value_allowed_flag
+        uint32_t width_in_mbs = reader.Ue() + 1;
+        uint32_t height_in_map_units = reader.Ue() + 1;
+        uint32_t frame_mbs_only = reader.Bit();
+        if (!frame_mbs_only) reader.Bit();
+        reader.Bit();           // direct_8x8_inference_flag
+
+        uint32_t crop_left = 0, crop_right = 0, crop_top = 0, crop_bottom = 0;
+        if (reader.Bit())
+        {
+            crop_left = reader.Ue();
+            crop_right = reader.Ue();
+            crop_top = reader.Ue();
+            crop_bottom = reader.Ue();
+        }
+
+        int chroma_array_type = separate_colour_plane ? 0 : info.chroma_format_idc;
+        int crop_unit_x = chroma_array_type == 0 ? 1 : (chroma_array_type == 3 ? 1 : 2);
+        int crop_unit_y = (chroma_array_type == 0 ? 1 : (chroma_array_type == 1 ? 2 : 1)) * (2 - frame_mbs_only);
+
+        info.width = static_cast<int>(width_in_mbs * 16 - crop_unit_x * (crop_left + crop_right));
+        info.height = static_cast<int>((2 - frame_mbs_only) * height_in_map_units * 16 - crop_unit_y * (crop_top + crop_bottom));
+
+        return !reader.Overrun() && info.width > 0 && info.height > 0;
+    }
+
+    bool ParseH265Sps(const std::vector<uint8_t>& rbsp, SequenceInfo& info)
+    {
+        if (rbsp.size() < 16) return false;
+
+        BitReader reader(rbsp, 2);
+        reader.Bits(4);         // sps_video_parameter_set_id
+        int max_sub_layers_minus1 = reader.Bits(3);
+        info.max_sub_layers = max_sub_layers_minus1 + 1;
+        info.temporal_id_nesting = reader.Bit() != 0;
+
+        // profile_tier_level: 88 bits of general profile, 8 of level, then the sub-layers
+        reader.Skip(96);
+        bool profile_present[8] = {};
+        bool level_present[8] = {};
+        for (int i = 0; i < max_sub_layers_minus1; ++i)
+        {
+            profile_present[i] = reader.Bit() != 0;
+            level_present[i] = reader.Bit() != 0;
+        }
+        if (max_sub_layers_minus1 > 0)
+        {
+            reader.Skip(2 * (8 - max_sub_layers_minus1));
+        }
+        for (int i = 0; i < max_sub_layers_minus1; ++i)
+        {
+            if (profile_present[i]) reader.Skip(88);
+            if (level_present[i]) reader.Skip(8);
+        }
+
+        reader.Ue();            // sps_seq_parameter_set_id
+        info.chroma_format_idc = reader.Ue();
+        if (info.chroma_format_idc == 3) reader.Bit();
+        uint32_t width = reader.Ue();
+        uint32_t height = reader.Ue();
+
+        if (reader.Bit())
+        {
+            int sub_width = info.chroma_format_idc == 1 || info.chroma_format_idc == 2 ? 2 : 1;
+            int sub_height = info.chroma_format_idc == 1 ? 2 : 1;
+            uint32_t left = reader.Ue(), right = reader.Ue(), top = reader.Ue(), bottom = reader.Ue();
+            width -= sub_width * (left + right);
+            height -= sub_height * (top + bottom);
+        }
+
+        info.bit_depth_luma = reader.Ue() + 8;
+        info.bit_depth_chroma = reader.Ue() + 8;
+        info.width = static_cast<int>(width);
+        info.height = static_cast<int>(height);
+
+        return !reader.Overrun() && info.width > 0 && info.height > 0;
+    }
+
+    void WriteVisualSampleEntryHeader(Mp4Box::Builder& box, const SequenceInfo& info)
+    {
+        box.Zeros(6);
+        box.U16(1);             // data_reference_index
+        box.Zeros(16);
+        box.U16(info.width);
+        box.U16(info.height);
+        box.U32(0x00480000);    // 72 dpi
+        box.U32(0x00480000);
+        box.U32(0);
+        box.U16(1);             // frame_count
+        box.Zeros(32);          // compressorname
+        box.U16(0x0018);
+        box.U16(0xFFFF);
+    }
+
+    void WriteNalArray(Mp4Box::Builder& box, int type, const std::vector<uint8_t>& nal)
+    {
+        box.U8(0x80 | type);    // array_completeness
+        box.U16(1);
+        box.U16(static_cast<uint32_t>(nal.size()));
+        box.Bytes(nal);
+    }
+}
+
+namespace NalUnits
+{
+    int GetType(NalCodec codec, const uint8_t* nal)
+    {
+        return codec == NalCodec::H264 ? (nal[0] & 0x1F) : ((nal[0] >> 1) & 0x3F);
+    }
+
+    bool IsVcl(NalCodec codec, int type)
+    {
+        return codec == NalCodec::H264 ? (type >= 1 && type <= 5) : (type >= 0 && type <= 31);
+    }
+
+    bool IsKeyframe(NalCodec codec, int type)
+    {
+        return codec == NalCodec::H264 ? type == 5 : (type >= 16 && type <= 23);
+    }
+
+    bool IsParameterSet(NalCodec codec, int type)
+    {
+        return codec == NalCodec::H264 ? (type == 7 || type == 8) : (type >= 32 && type <= 34);
+    }
+
+    bool StartsAccessUnit(NalCodec codec, const uint8_t* nal, size_t size)
+    {
+        int type = GetType(codec, nal);
+
+        if (codec == NalCodec::H264)
+        {
+            if (type == 6 || type == 7 || type == 8 || type == 9 || (type >= 14 && type <= 18)) return true;
+            // first_mb_in_slice == 0 is a single '1' bit
+            return IsVcl(codec, type) && size > 1 && (nal[1] & 0x80);
+        }
+
+        if (type == 35 || type == 32 || type == 33 || type == 34 || type == 39 || (type >= 41 && type <= 44) || (type >= 48 && type <= 55)) return true;
+        // first_slice_segment_in_pic_flag
+        return IsVcl(codec, type) && size > 2 && (nal[2] & 0x80);
+    }
+
+    NalCodec DetectCodec(const uint8_t* nal, size_t size)
+    {
+        // H.265 headers are two bytes with nuh_layer_id 0 and nuh_temporal_id_plus1 >= 1
+        if (size >= 2 && (nal[0] & 0x81) == 0 && (nal[1] & 0xF8) == 0 && (nal[1] & 0x07) != 0)
+        {
+            int type = (nal[0] >> 1) & 0x3F;
+            if ((type >= 32 && type <= 35) || type == 39 || (type >= 16 && type <= 21) || type <= 9) return NalCodec::H265;
+        }
+        return NalCodec::H264;
+    }
+
+    std::vector<uint8_t> ToRbsp(const uint8_t* nal, size_t size)
+    {
+        std::vector<uint8_t> rbsp;
+        rbsp.reserve(size);
+
+        int zeros = 0;
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (zeros >= 2 && nal[i] == 0x03)
+            {
+                zeros = 0;
+                continue;
+            }
+            zeros = nal[i] == 0 ? zeros + 1 : 0;
+            rbsp.push_back(nal[i]);
+        }
+        return rbsp;
+    }
+
+    bool ParseSps(NalCodec codec, const uint8_t* nal, size_t size, SequenceInfo& info)
+    {
+        std::vector<uint8_t> rbsp = ToRbsp(nal, size);
+        return codec == NalCodec::H264 ? ParseH264Sps(rbsp, info) : ParseH265Sps(rbsp, info);
+    }
+
+    std::vector<uint8_t> BuildSampleEntry(NalCodec codec, const SequenceInfo& info, const std::vector<uint8_t>& vps,
+                                          const std::vector<uint8_t>& sps, const std::vector<uint8_t>& pps)
+    {
+        Mp4Box::Builder box;
+
+        if (codec == NalCodec::H264)
+        {
+            size_t entry = box.Begin("avc1");
+            WriteVisualSampleEntryHeader(box, info);
+
+            size_t config = box.Begin("avcC");
+            box.U8(1);
+            box.U8(sps.size() > 1 ? sps[1] : 0);            // profile_idc
+            box.U8(sps.size() > 2 ? sps[2] : 0);            // constraint flags
+            box.U8(sps.size() > 3 ? sps[3] : 0);            // level_idc
+            box.U8(0xFF);                                   // 4-byte NAL lengths
+            box.U8(0xE1);
+            box.U16(static_cast<uint32_t>(sps.size()));
+            box.Bytes(sps);
+            box.U8(1);
+            box.U16(static_cast<uint32_t>(pps.size()));
+            box.Bytes(pps);
+            box.End(config);
+
+            box.End(entry);
+            return box.Data();
+        }
+
+        // The general profile_tier_level is the 12 bytes after the SPS header byte
+        std::vector<uint8_t> rbsp = ToRbsp(sps.data(), sps.size());
+        rbsp.resize(std::max<size_t>(rbsp.size(), 15), 0);
+        const uint8_t* general_ptl = rbsp.data() + 3;
+
+        size_t entry = box.Begin("hev1");
+        WriteVisualSampleEntryHeader(box, info);
+
+        size_t config = box.Begin("hvcC");
+        box.U8(1);
+        box.Bytes(general_ptl, 12);                         // profile space/tier/idc, compatibility, constraints, level
+        box.U16(0xF000);                                    // min_spatial_segmentation_idc
+        box.U8(0xFC);                                       // parallelismType
+        box.U8(0xFC | info.chroma_format_idc);
+        box.U8(0xF8 | (info.bit_depth_luma - 8));
+        box.U8(0xF8 | (info.bit_depth_chroma - 8));
+        box.U16(0);                                         // avgFrameRate
+        box.U8((info.max_sub_layers << 3) | (info.temporal_id_nesting ? 0x04 : 0) | 0x03);
+        box.U8(3);
+        WriteNalArray(box, 32, vps);
+        WriteNalArray(box, 33, sps);
+        WriteNalArray(box, 34, pps);
+        box.End(config);
+
+        box.End(entry);
+        return box.Data();
+    }
+}
@@ -0,0 +1,182 @@
+#include <algorithm>
+
+#include "TsDemuxer.h"
+#include "TsMuxer.h"
+
+namespace
+{
+    uint64_t ReadTimestamp(const uint8_t* field)
+    {
+        return (static_cast<uint64_t>(field[0] & 0x0E) << 29) | (static_cast<uint64_t>(field[1]) << 22) |
+               (static_cast<uint64_t>(field[2] & 0xFE) << 14) | (static_cast<uint64_t>(field[3]) << 7) | (field[4] >> 1);
+    }
+}
+
+void TsDemuxer::Push(const uint8_t* data, size_t size, std::vector<TsAccessUnit>& units)
+{
+    for (size_t offset = 0; offset + kTsPacketSize <= size; offset += kTsPacketSize)
+    {
+        if (data[offset] == 0x47) PushPacket(data + offset, units);
+    }
+}
+
+void TsDemuxer::Flush(std::vector<TsAccessUnit>& units)
+{
+    if (in_unit_) FinishUnit(units);
+}
+
+void TsDemuxer::PushPacket(const uint8_t* packet, std::vector<TsAccessUnit>& units)
+{
+    const bool payload_start = (packet[1] & 0x40) != 0;
+    const uint16_t pid = static_cast<uint16_t>(((packet[1] & 0x1F) << 8) | packet[2]);
+    const int adaptation_control = (packet[3] >> 4) & 0x3;
+    const int continuity = packet[3] & 0x0F;
+
+    const uint8_t* payload = packet + 4;
+    size_t payload_size = kTsPacketSize - 4;
+    uint64_t pcr = 0;
+    bool random_access = false;
+
+    if (adaptation_control & 0x2)
+    {
+        const size_t length = payload[0];
+        if (length > 183) return;
+        if (length > 0)
+        {
+            random_access = (payload[1] & 0x40) != 0;
+            if ((payload[1] & 0x10) && length >= 7)
+            {
+                const uint8_t* field = payload + 2;
+                pcr = (static_cast<uint64_t>(field[0]) << 25) | (static_cast<uint64_t>(field[1]) << 17) |
+                      (static_cast<uint64_t>(field[2]) << 9) | (static_cast<uint64_t>(field[3]) << 1) | (field[4] >> 7);
+            }
+        }
+        payload += 1 + length;
+        payload_size -= 1 + length;
+    }
+    if (!(adaptation_control & 0x1)) return;
+
+    if (pid == 0 || pid == pmt_pid_)
+    {
+        if (payload_start) ParseSection(pid, payload, payload_size);
+        return;
+    }
+    if (pid != video_pid_) return;
+
+    if (continuity_ >= 0 && continuity != ((continuity_ + 1) & 0x0F))
+    {
+        ++continuity_errors_;
+        damaged_ = in_unit_;
+    }
+    continuity_ = continuity;
+
+    if (payload_start)
+    {
+        if (in_unit_) FinishUnit(units);
+
+        in_unit_ = true;
+        damaged_ = false;
+        header_parsed_ = false;
+        header_.clear();
+        current_ = TsAccessUnit();
+        current_.pcr_90k = pcr;
+        current_.is_keyframe = random_access;
+    }
+    if (!in_unit_) return;
+
+    AppendPayload(payload, payload_size, units);
+}
+
+void TsDemuxer::ParseSection(uint16_t pid, const uint8_t* payload, size_t size)
+{
+    const size_t pointer = payload[0];
+    if (1 + pointer + 3 > size) return;
+
+    const uint8_t* section = payload + 1 + pointer;
+    const size_t section_size = 3 + (((section[1] & 0x0F) << 8) | section[2]);
+    if (1 + pointer + section_size > size || section_size < 12) return;
+    if (TsCrc32(section, section_size) != 0) return;
+
+    const uint8_t* entries = section + 8;
+    const uint8_t* end = section + section_size - 4;
+
+    if (pid == 0 && section[0] == 0x00)
+    {
+        for (; entries + 4 <= end; entries += 4)
+        {
+            const uint16_t program = static_cast<uint16_t>((entries[0] << 8) | entries[1]);
+            if (program == 0) continue;
+
+            pmt_pid_ = static_cast<uint16_t>(((entries[2] & 0x1F) << 8) | entries[3]);
+            return;
+        }
+        return;
+    }
+
+    if (section[0] != 0x02) return;
+
+    const size_t program_info = ((entries[2] & 0x0F) << 8) | entries[3];
+    for (entries += 4 + program_info; entries + 5 <= end; )
+    {
+        const uint8_t stream_type = entries[0];
+        const uint16_t stream_pid = static_cast<uint16_t>(((entries[1] & 0x1F) << 8) | entries[2]);
+        const size_t info_length = ((entries[3] & 0x0F) << 8) | entries[4];
+
+        if (stream_type == 0x1B || stream_type == 0x24)
+        {
+            if (stream_pid != video_pid_) continuity_ = -1;
+            video_pid_ = stream_pid;
+            codec_ = stream_type == 0x24 ? NalCodec::H265 : NalCodec::H264;
+            return;
+        }
+        entries += 5 + info_length;
+    }
+}
+
+void TsDemuxer::AppendPayload(const uint8_t* payload, size_t size, std::vector<TsAccessUnit>& units)
+{
+    if (!header_parsed_)
+    {
+        header_.insert(header_.end(), payload, payload + size);
+        if (header_.size() < 9) return;
+        const size_t header_size = 9 + header_[8];
+        if (header_.size() < header_size) return;
+
+        if (header_[0] != 0 || header_[1] != 0 || header_[2] != 1)
+        {
+            damaged_ = true;
+            header_parsed_ = true;
+            return;
+        }
+
+        if ((header_[7] & 0x80) && header_size >= 14) current_.pts_90k = ReadTimestamp(header_.data() + 9);
+        const size_t pes_length = (header_[4] << 8) | header_[5];
+        payload_expected_ = pes_length > 0 && pes_length >= header_size - 6 ? pes_length - (header_size - 6) : 0;
+        header_parsed_ = true;
+
+        current_.data.assign(header_.begin() + header_size, header_.end());
+    }
+    else
+    {
+        current_.data.insert(current_.data.end(), payload, payload + size);
+    }
+
+    if (payload_expected_ > 0 && current_.data.size() >= payload_expected_)
+    {
+        current_.data.resize(payload_expected_);
+        FinishUnit(units);
+    }
+}
+
+void TsDemuxer::FinishUnit(std::vector<TsAccessUnit>& units)
+{
+    in_unit_ = false;
+    if (damaged_ || !header_parsed_ || current_.data.empty())
+    {
+        ++dropped_units_;
+        return;
+    }
+
+    units.push_back(std::move(current_));
+    current_ = TsAccessUnit();
+}
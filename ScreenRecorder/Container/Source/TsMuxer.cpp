@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <cstring>
+
+#include "TsMuxer.h"
+
+namespace
+{
+    constexpr uint8_t kSyncByte = 0x47;
+    constexpr size_t kTsPayloadSize = kTsPacketSize - 4;
+    constexpr uint8_t kAdaptationRandomAccess = 0x40;
+    constexpr uint8_t kAdaptationPcr = 0x10;
+
+    constexpr uint8_t kH264Aud[] = { 0x00, 0x00, 0x00, 0x01, 0x09, 0xF0 };
+    constexpr uint8_t kH265Aud[] = { 0x00, 0x00, 0x00, 0x01, 0x46, 0x01, 0x50 };
+
+    // Start of the first NAL after its start code, or null
+    const uint8_t* FirstNal(const uint8_t* data, size_t size)
+    {
+        for (size_t i = 0; i + 3 < size; ++i)
+        {
+            if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) return data + i + 3;
+            if (data[i] != 0) return nullptr;
+        }
+        return nullptr;
+    }
+
+    void WriteTimestamp(std::vector<uint8_t>& out, uint8_t prefix, uint64_t timestamp)
+    {
+        timestamp &= (1ull << 33) - 1;
+        out.push_back(static_cast<uint8_t>((prefix << 4) | ((timestamp >> 29) & 0x0E) | 1));
+        out.push_back(static_cast<uint8_t>(timestamp >> 22));
+        out.push_back(static_cast<uint8_t>(((timestamp >> 14) & 0xFE) | 1));
+        out.push_back(static_cast<uint8_t>(timestamp >> 7));
+        out.push_back(static_cast<uint8_t>(((timestamp << 1) & 0xFE) | 1));
+    }
+
+    uint8_t* BeginPacket(std::vector<uint8_t>& out, uint16_t pid, bool payload_start, bool has_adaptation, uint8_t& continuity)
+    {
+        const size_t offset = out.size();
+        out.resize(offset + kTsPacketSize);
+        uint8_t* packet = out.data() + offset;
+        packet[0] = kSyncByte;
+        packet[1] = static_cast<uint8_t>((payload_start ? 0x40 : 0) | ((pid >> 8) & 0x1F));
+        packet[2] = static_cast<uint8_t>(pid);
+        packet[3] = static_cast<uint8_t>((has_adaptation ? 0x30 : 0x10) | (continuity & 0x0F));
+        continuity = static_cast<uint8_t>((continuity + 1) & 0x0F);
+        return packet;
+    }
+}
+
+uint32_t TsCrc32(const uint8_t* data, size_t size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; ++i)
+    {
+        crc ^= static_cast<uint32_t>(data[i]) << 24;
+        for (int bit = 0; bit < 8; ++bit) crc = crc & 0x80000000 ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+    }
+    return crc;
+}
+
+TsMuxer::TsMuxer(NalCodec codec, int pts_delay_ms)
+    : codec_(codec), pts_delay_90k_(static_cast<uint64_t>(std::max(0, pts_delay_ms)) * 90)
+{
+}
+
+void TsMuxer::Reset()
+{
+    std::memset(continuity_, 0, sizeof(continuity_));
+    tables_written_ = false;
+}
+
+void TsMuxer::WriteSection(uint16_t pid, const std::vector<uint8_t>& section, std::vector<uint8_t>& out)
+{
+    uint8_t* packet = BeginPacket(out, pid, true, false, continuity_[pid == 0 ? 0 : 1]);
+    packet[4] = 0;      // pointer_field
+    std::memcpy(packet + 5, section.data(), section.size());
+    std::memset(packet + 5 + section.size(), 0xFF, kTsPacketSize - 5 - section.size());
+}
+
+void TsMuxer::WriteTables(std::vector<uint8_t>& out)
+{
+    auto finish = [](std::vector<uint8_t>& section)
+    {
+        const size_t length = section.size() - 3 + 4;
+        section[1] = static_cast<uint8_t>(0xB0 | (length >> 8));
+        section[2] = static_cast<uint8_t>(length);
+        const uint32_t crc = TsCrc32(section.data(), section.size());
+        section.insert(section.end(), { static_cast<uint8_t>(crc >> 24), static_cast<uint8_t>(crc >> 16), static_cast<uint8_t>(crc >> 8), static_cast<uint8_t>(crc) });
+    };
+
+    // Program 1 on kPmtPid
+    std::vector<uint8_t> pat = { 0x00, 0, 0, 0x00, 0x01, 0xC1, 0x00, 0x00,
+                                 0x00, 0x01, static_cast<uint8_t>(0xE0 | (kPmtPid >> 8)), static_cast<uint8_t>(kPmtPid & 0xFF) };
+    finish(pat);
+    WriteSection(0, pat, out);
+
+    // One video stream, which also carries the PCR
+    const uint8_t stream_type = codec_ == NalCodec::H265 ? 0x24 : 0x1B;
+    std::vector<uint8_t> pmt = { 0x02, 0, 0, 0x00, 0x01, 0xC1, 0x00, 0x00,
+                                 static_cast<uint8_t>(0xE0 | (kVideoPid >> 8)), static_cast<uint8_t>(kVideoPid & 0xFF), 0xF0, 0x00,
+                                 stream_type, static_cast<uint8_t>(0xE0 | (kVideoPid >> 8)), static_cast<uint8_t>(kVideoPid & 0xFF), 0xF0, 0x00 };
+    finish(pmt);
+    WriteSection(kPmtPid, pmt, out);
+
+    tables_written_ = true;
+}
+
+void TsMuxer::WriteAccessUnit(const uint8_t* data, size_t size, uint64_t clock_90k, bool is_keyframe, std::vector<uint8_t>& out)
+{
+    if (is_keyframe || !tables_written_) WriteTables(out);
+
+    const uint8_t* first_nal = FirstNal(data, size);
+    const bool has_aud = first_nal && NalUnits::GetType(codec_, first_nal) == (codec_ == NalCodec::H265 ? 35 : 9);
+    const uint8_t* aud = codec_ == NalCodec::H265 ? kH265Aud : kH264Aud;
+    const size_t aud_size = has_aud ? 0 : (codec_ == NalCodec::H265 ? sizeof(kH265Aud) : sizeof(kH264Aud));
+
+    // A bounded length lets the receiver hand the frame on as soon as its last packet arrives
+    // instead of waiting for the next one; frames too large for the field use 0 (unbounded)
+    const size_t pes_payload = 3 + 5 + aud_size + size;
+    const uint16_t pes_length = pes_payload <= 0xFFFF ? static_cast<uint16_t>(pes_payload) : 0;
+
+    pes_header_.assign({ 0x00, 0x00, 0x01, 0xE0, static_cast<uint8_t>(pes_length >> 8), static_cast<uint8_t>(pes_length), 0x84, 0x80, 0x05 });
+    WriteTimestamp(pes_header_, 0x2, clock_90k + pts_delay_90k_);
+    pes_header_.insert(pes_header_.end(), aud, aud + aud_size);
+
+    const size_t total = pes_header_.size() + size;
+    size_t written = 0;
+    bool first = true;
+
+    while (written < total)
+    {
+        const size_t remaining = total - written;
+
+        // The first packet carries the PCR; the last is padded out with adaptation field stuffing
+        size_t adaptation = first ? 8 : 0;
+        if (remaining < kTsPayloadSize - adaptation) adaptation = kTsPayloadSize - remaining;
+
+        uint8_t* packet = BeginPacket(out, kVideoPid, first, adaptation > 0, continuity_[2]);
+        uint8_t* payload = packet + 4;
+
+        if (adaptation > 0)
+        {
+            payload[0] = static_cast<uint8_t>(adaptation - 1);
+            if (adaptation > 1)
+            {
+                uint8_t* field = payload + 2;
+                payload[1] = 0;
+                if (first)
+                {
+                    payload[1] = static_cast<uint8_t>(kAdaptationPcr | (is_keyframe ? kAdaptationRandomAccess : 0));
+                    const uint64_t pcr_base = clock_90k & ((1ull << 33) - 1);
+                    field[0] = static_cast<uint8_t>(pcr_base >> 25);
+                    field[1] = static_cast<uint8_t>(pcr_base >> 17);
+                    field[2] = static_cast<uint8_t>(pcr_base >> 9);
+                    field[3] = static_cast<uint8_t>(pcr_base >> 1);
+                    field[4] = static_cast<uint8_t>(((pcr_base & 1) << 7) | 0x7E);
+                    field[5] = 0;
+                    field += 6;
+                }
+                std::memset(field, 0xFF, payload + adaptation - field);
+            }
+            payload += adaptation;
+        }
+
+        size_t count = kTsPayloadSize - adaptation;
+        while (count > 0)
+        {
+            const bool in_header = written < pes_header_.size();
+            const uint8_t* source = in_header ? pes_header_.data() + written : data + (written - pes_header_.size());
+            const size_t chunk = std::min(count, in_header ? pes_header_.size() - written : total - written);
+            std::memcpy(payload, source, chunk);
+            payload += chunk;
+            written += chunk;
+            count -= chunk;
+        }
+
+        first = false;
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+// Owning byte buffer with page alignment, suitable for unbuffered/direct file I/O
+// and for SIMD kernels that want aligned rows.
+class AlignedBuffer
+{
+public:
+    static constexpr size_t kAlignment = 4096;
+
+    AlignedBuffer() = default;
+    explicit AlignedBuffer(size_t size) { Resize(size); }
+    ~AlignedBuffer() { Release(); }
+
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+    AlignedBuffer(AlignedBuffer&& other) noexcept : data_(other.data_), size_(other.size_)
+    {
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+
+    AlignedBuffer& operator=(AlignedBuffer&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Release();
+            data_ = other.data_;
+            size_ = other.size_;
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+        return *this;
+    }
+
+    // Contents are not preserved across a size change
+    void Resize(size_t size)
+    {
+        if (size == size_) return;
+
+        Release();
+        if (size > 0)
+        {
+            data_ = static_cast<uint8_t*>(::operator new(size, std::align_val_t(kAlignment)));
+            size_ = size;
+        }
+    }
+
+    uint8_t* data() { return data_; }
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    void Release()
+    {
+        if (data_)
+        {
+            ::operator delete(data_, std::align_val_t(kAlignment));
+        }
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+struct DirtyRect
+{
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// The parts of a frame that changed since the previous frame from the same source, in pixels.
+// Rects may overlap: everything done per rect is idempotent, so overlap only costs time. Past
+// kMaxRects the region collapses to its bounding box. Rects are stored inline, so regions are
+// copied around the frame path without allocating. A region made for another frame size
+// (including a default-constructed one) means "unknown" and is treated as full.
+class DirtyRegion
+{
+public:
+    DirtyRegion() = default;
+    // Nothing changed
+    DirtyRegion(int width, int height) : width_(width), height_(height) {}
+
+    static DirtyRegion Full(int width, int height);
+    // One rect per run of changed tiles in a tile row; runs that line up with the row above extend it
+    static DirtyRegion FromTiles(const uint8_t* tile_flags, int width, int height, int tile_size);
+
+    // Clipped to the frame
+    void Add(const DirtyRect& rect);
+    // Union, for frames that were skipped on the way to a consumer
+    void Add(const DirtyRegion& other);
+    void Clear() { count_ = 0; }
+
+    // This region if it was made for width x height, a full one otherwise
+    DirtyRegion ForFrame(int width, int height) const;
+    // Edges pushed out to multiples of alignment (2 for 4:2:0 chroma, the factor for box
+    // downsampling), clipped to the frame
+    DirtyRegion Aligned(int alignment) const;
+    // The same changes in a bilinear resize of the frame to width x height: every output pixel
+    // that reads a changed pixel, with a pixel of slack for the filter's rounding
+    DirtyRegion Scaled(int width, int height) const;
+
+    bool IsEmpty() const { return count_ == 0; }
+    bool IsFull() const;
+    int GetWidth() const { return width_; }
+    int GetHeight() const { return height_; }
+    // Overlap counts twice
+    uint64_t GetArea() const;
+    double GetCoverage() const;
+    std::span<const DirtyRect> GetRects() const { return { rects_, count_ }; }
+
+    static constexpr size_t kMaxRects = 64;
+
+private:
+    void CollapseToBounds();
+    // Grows the single collapsed rect to cover rect as well
+    void Extend(const DirtyRect& rect);
+
+    int width_ = 0;
+    int height_ = 0;
+    size_t count_ = 0;
+    DirtyRect rects_[kMaxRects];
+};
+
+// Dirty regions for sources that can't report them: each frame is diffed tile by tile against
+// the previous one, and only the changed tiles are copied into the reference.
+class DirtyRegionTracker
+{
+public:
+    explicit DirtyRegionTracker(int tile_size = 64);
+
+    // The first frame and any change of size or format are full
+    const DirtyRegion& Update(const uint8_t* frame, ptrdiff_t pitch, int width, int height, int bytes_per_pixel = 4);
+    void Reset();
+
+private:
+    int tile_size_;
+    int width_ = 0;
+    int height_ = 0;
+    int bytes_per_pixel_ = 0;
+    std::vector<uint8_t> reference_;
+    std::vector<uint8_t> tile_flags_;
+    DirtyRegion region_;
+};
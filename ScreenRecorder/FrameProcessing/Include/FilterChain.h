@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "AlignedBuffer.h"
+#include "DirtyRegion.h"
+#include "FrameDescriptor.h"
+
+struct FilterChainConfig
+{
+    DirtyRect crop;                 // In capture pixels, clipped to the frame; empty keeps the whole capture
+    int output_width = 0;           // Bilinear resize of the crop; 0 x 0 keeps its size
+    int output_height = 0;
+    bool fused = true;              // false runs each stage over the whole frame, through a full-size intermediate
+
+    // Crop clipped to a capture_width x capture_height frame and the output size filled in, both
+    // rounded down to even sizes for NV12
+    FilterChainConfig Resolve(int capture_width, int capture_height) const;
+};
+
+struct FilterChainStats
+{
+    uint64_t frames = 0;
+    double process_ms = 0.0;        // Total
+    // Traffic to frame-sized buffers (capture, intermediate, output), which do not stay in cache.
+    // Fused bands are sized to stay in L2 and are not counted.
+    uint64_t bytes_read = 0;
+    uint64_t bytes_written = 0;
+    size_t scratch_bytes = 0;       // Band buffer, or the full intermediate frame when unfused
+};
+
+// Crop, bilinear resize, an alpha-blended overlay (a cursor, a watermark) and BGRA -> NV12 as one
+// pass over the capture. Output rows are made a band at a time: the band is resized into a buffer
+// small enough to stay in L2, the overlay is blended into it and it is converted from there, so
+// the capture is read once and nothing frame-sized is written but the output. Unfused, the same
+// stages run over the whole frame one after another, for comparison and as a fallback. Where
+// there is no intermediate to save (BGRA out, or NV12 without a resize or an overlay on screen)
+// fused is that same single pass. Crop is an offset into the capture either way. Output pixels
+// match FrameKernels::ScaleBgraBilinear and ConvertBgraToNv12 run in sequence.
+class FilterChain
+{
+public:
+    explicit FilterChain(const FilterChainConfig& config = FilterChainConfig());
+
+    // Straight-alpha BGRA, copied. Placed in output pixels and clipped, so it may hang off an edge.
+    void SetOverlay(const uint8_t* bgra, ptrdiff_t pitch, int width, int height);
+    void SetOverlayPosition(int x, int y);
+    void ClearOverlay();
+    // The overlay's rect in output pixels, clipped; empty without one
+    DirtyRect GetOverlayRect() const;
+
+    // The output size for a capture of this size
+    int GetOutputWidth(int capture_width, int capture_height) const;
+    int GetOutputHeight(int capture_width, int capture_height) const;
+
+    // BGRA in. dst is GetOutputWidth x GetOutputHeight.
+    bool ProcessToBgra(const FrameDescriptor& frame, uint8_t* dst, ptrdiff_t dst_pitch);
+    bool ProcessToNv12(const FrameDescriptor& frame, uint8_t* dst_y, ptrdiff_t y_pitch, uint8_t* dst_uv, ptrdiff_t uv_pitch);
+
+    const FilterChainConfig& GetConfig() const { return config_; }
+    FilterChainStats GetStats() const { return stats_; }
+
+private:
+    // Set up for a capture size: resolved crop, resize tables, band size, buffers
+    void Prepare(int capture_width, int capture_height);
+    bool Process(const FrameDescriptor& frame, uint8_t* dst_bgra, ptrdiff_t bgra_pitch, uint8_t* dst_y, ptrdiff_t y_pitch,
+                 uint8_t* dst_uv, ptrdiff_t uv_pitch);
+
+    // Output rows [y_begin, y_end) of the resize into dst, which holds row y_begin first
+    void ScaleRows(const uint8_t* crop, ptrdiff_t pitch, int y_begin, int y_end, uint8_t* dst, ptrdiff_t dst_pitch);
+    // Horizontal pass of one source row, 16-bit per channel, through a cache of the last two
+    const uint16_t* GetScaledRow(const uint8_t* crop, ptrdiff_t pitch, int source_row);
+    // Overlay blended into output rows [y_begin, y_end), held in rows from y_begin
+    void BlendOverlay(uint8_t* rows, ptrdiff_t pitch, int y_begin, int y_end) const;
+
+    FilterChainConfig config_;
+    FilterChainConfig resolved_;
+    int capture_width_ = 0;
+    int capture_height_ = 0;
+    bool scales_ = false;
+    int band_rows_ = 0;
+
+    // Per output column: byte offset of the left source pixel and its weight | the right one's << 16.
+    // Both pixels are always inside the row; a clamped edge becomes weights 0 and 256.
+    std::vector<int32_t> column_offsets_;
+    std::vector<uint32_t> column_weights_;
+    std::vector<int32_t> row_sources_;      // Per output row: source row of the top tap
+    std::vector<uint16_t> row_weights_;     // And the bottom tap's weight
+    std::vector<uint16_t> scaled_rows_;     // Two horizontal passes, out_width * 4 each
+    int cached_rows_[2] = { -1, -1 };
+    uint64_t source_rows_read_ = 0;
+
+    AlignedBuffer scratch_;
+    ptrdiff_t scratch_pitch_ = 0;
+    std::vector<uint8_t> overlay_;
+    int overlay_width_ = 0;
+    int overlay_height_ = 0;
+    int overlay_x_ = 0;
+    int overlay_y_ = 0;
+
+    FilterChainStats stats_;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+enum class FrameFormat
+{
+    Bgra,           // 8-bit BGRA
+    ScRgb,          // FP16 RGBA, linear BT.709, 1.0 = 80 nits
+    Nv12,           // 8-bit Y plane, then interleaved UV at half resolution
+    P010            // NV12 layout with 16-bit samples, the value in the top 10 bits
+};
+
+struct FramePlane
+{
+    const uint8_t* data = nullptr;
+    ptrdiff_t pitch = 0;            // Bytes from one row start to the next, padding included
+};
+
+// A frame as every stage sees it: where each plane's rows start and how far apart they are.
+// Rows may be padded, e.g. a mapped staging texture's RowPitch, and stages read them in place
+// rather than repacking. Unless owner is set, the pixels belong to the producer and are valid
+// only for the call the descriptor is passed to.
+struct FrameDescriptor
+{
+    FrameFormat format = FrameFormat::Bgra;
+    int width = 0;
+    int height = 0;
+    FramePlane planes[2];
+    std::chrono::steady_clock::time_point timestamp;    // Capture time
+    // Keeps the planes alive. A receiver that needs them after the call (an encoder that queues
+    // samples) keeps a copy instead of copying the pixels.
+    std::shared_ptr<const void> owner;
+
+    // Planes tightly packed and back to back, as in a std::vector frame
+    static FrameDescriptor Packed(const uint8_t* data, FrameFormat format, int width, int height,
+                                  std::chrono::steady_clock::time_point timestamp = std::chrono::steady_clock::now())
+    {
+        FrameDescriptor frame;
+        frame.format = format;
+        frame.width = width;
+        frame.height = height;
+        frame.timestamp = timestamp;
+        frame.planes[0] = { data, static_cast<ptrdiff_t>(frame.GetRowBytes(0)) };
+        if (frame.GetPlaneCount() > 1)
+        {
+            frame.planes[1] = { data + frame.GetRowBytes(0) * height, static_cast<ptrdiff_t>(frame.GetRowBytes(1)) };
+        }
+        return frame;
+    }
+
+    int GetPlaneCount() const { return format == FrameFormat::Nv12 || format == FrameFormat::P010 ? 2 : 1; }
+
+    // Of the first plane
+    int GetBytesPerPixel() const
+    {
+        switch (format)
+        {
+        case FrameFormat::ScRgb: return 8;
+        case FrameFormat::Nv12: return 1;
+        case FrameFormat::P010: return 2;
+        default: return 4;
+        }
+    }
+
+    // Pixel bytes in one row of the plane, without padding. Chroma rows hold a U and V sample
+    // for every two pixels, rounded up.
+    size_t GetRowBytes(int plane) const
+    {
+        if (plane == 0) return static_cast<size_t>(width) * GetBytesPerPixel();
+        return static_cast<size_t>(width + 1) / 2 * 2 * GetBytesPerPixel();
+    }
+
+    int GetPlaneHeight(int plane) const { return plane == 0 ? height : (height + 1) / 2; }
+
+    // Every plane present with rows no closer than their pixel bytes
+    bool IsValid() const
+    {
+        if (width <= 0 || height <= 0) return false;
+        for (int plane = 0; plane < GetPlaneCount(); ++plane)
+        {
+            if (!planes[plane].data || planes[plane].pitch < static_cast<ptrdiff_t>(GetRowBytes(plane))) return false;
+        }
+        return true;
+    }
+
+    bool IsPacked() const
+    {
+        for (int plane = 0; plane < GetPlaneCount(); ++plane)
+        {
+            if (planes[plane].pitch != static_cast<ptrdiff_t>(GetRowBytes(plane))) return false;
+        }
+        return true;
+    }
+};
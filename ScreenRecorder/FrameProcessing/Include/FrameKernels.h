@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "DirtyRegion.h"
+
+// Per-pixel kernels shared by the capture/encode path, tools and benchmarks.
+// All images are BGRA unless noted; pitches are in bytes.
+namespace FrameKernels
+{
+    // Row-by-row copy between buffers with independent pitches (MFCopyImage equivalent)
+    void CopyImage(uint8_t* dst, ptrdiff_t dst_pitch, const uint8_t* src, ptrdiff_t src_pitch, size_t row_bytes, int rows);
+
+    // CopyImage of only the region's rects; both images are region.GetWidth() x GetHeight()
+    void CopyImageRegion(uint8_t* dst, ptrdiff_t dst_pitch, const uint8_t* src, ptrdiff_t src_pitch, int bytes_per_pixel,
+                         const DirtyRegion& region);
+
+    // 64-bit content hash of an image region, used for duplicate-frame detection
+    uint64_t HashImage(const uint8_t* src, ptrdiff_t src_pitch, size_t row_bytes, int rows);
+
+    // Compares two frames tile by tile. tile_flags receives one byte per tile (row-major, 1 = changed)
+    // and must hold TileCount(width, height, tile_size) entries. Returns the number of changed tiles.
+    size_t TileCount(int width, int height, int tile_size);
+    size_t DiffTiles(const uint8_t* a, ptrdiff_t a_pitch, const uint8_t* b, ptrdiff_t b_pitch,
+                     int width, int height, int tile_size, uint8_t* tile_flags);
+
+    // BGRA -> NV12, BT.709 limited range. width and height must be even.
+    void ConvertBgraToNv12(const uint8_t* src, ptrdiff_t src_pitch, int width, int height,
+                           uint8_t* dst_y, ptrdiff_t y_pitch, uint8_t* dst_uv, ptrdiff_t uv_pitch);
+    // Updates only the region of an NV12 image converted from the previous frame (rects are widened to 2x2 blocks)
+    void ConvertBgraToNv12Region(const uint8_t* src, ptrdiff_t src_pitch, uint8_t* dst_y, ptrdiff_t y_pitch,
+                                 uint8_t* dst_uv, ptrdiff_t uv_pitch, const DirtyRegion& region);
+
+    // Integer-factor box downsample (factor 1..16). Output is floor(width / factor) x floor(height / factor).
+    void DownsampleBgraBox(const uint8_t* src, ptrdiff_t src_pitch, int src_width, int src_height, int factor,
+                           uint8_t* dst, ptrdiff_t dst_pitch);
+    // Updates only the output blocks the region touches
+    void DownsampleBgraBoxRegion(const uint8_t* src, ptrdiff_t src_pitch, int factor, uint8_t* dst, ptrdiff_t dst_pitch,
+                                 const DirtyRegion& region);
+
+    // 64-bin luma histogram (BT.709 luma >> 2) over every row_step-th row. Adds to histogram.
+    void LumaHistogram(const uint8_t* src, ptrdiff_t src_pitch, int width, int height, int row_step, uint32_t histogram[64]);
+
+    // Sum of absolute byte differences between two equally sized buffers
+    uint64_t SumAbsDiff(const uint8_t* a, const uint8_t* b, size_t size);
+
+    // Sum of squared byte differences over an image region
+    uint64_t SumSquaredDiff(const uint8_t* a, ptrdiff_t a_pitch, const uint8_t* b, ptrdiff_t b_pitch, size_t row_bytes, int rows);
+
+    // SSIM statistics of an 8x8 block pair of 8-bit samples: sum a, sum b, sum a^2, sum b^2, sum ab
+    void SsimMoments8x8(const uint8_t* a, ptrdiff_t a_pitch, const uint8_t* b, ptrdiff_t b_pitch, uint32_t moments[5]);
+
+    // Bilinear BGRA resize to an arbitrary size
+    void ScaleBgraBilinear(const uint8_t* src, ptrdiff_t src_pitch, int src_width, int src_height,
+                           uint8_t* dst, ptrdiff_t dst_pitch, int dst_width, int dst_height);
+    // Updates only dst_region (in output pixels, e.g. DirtyRegion::Scaled) of a resize made from
+    // the previous frame; the pixels written match a full ScaleBgraBilinear
+    void ScaleBgraBilinearRegion(const uint8_t* src, ptrdiff_t src_pitch, int src_width, int src_height,
+                                 uint8_t* dst, ptrdiff_t dst_pitch, int dst_width, int dst_height, const DirtyRegion& dst_region);
+
+    // Temporal blending into a 16-bit accumulator of one sample per byte (sum_pitch in bytes too).
+    // sum += src * weight; the weights added before a resolve may total at most 257, so 255 * total fits.
+    void AccumulateWeighted(uint16_t* sum, ptrdiff_t sum_pitch, const uint8_t* src, ptrdiff_t src_pitch, size_t row_bytes, int rows,
+                            uint32_t weight);
+    // dst = (sum + 128) >> 8: the rounded mean of an accumulator whose weights total 256
+    void ResolveAccumulator(uint8_t* dst, ptrdiff_t dst_pitch, const uint16_t* sum, ptrdiff_t sum_pitch, size_t row_bytes, int rows);
+    // dst = max(dst, src) per byte
+    void MaxImage(uint8_t* dst, ptrdiff_t dst_pitch, const uint8_t* src, ptrdiff_t src_pitch, size_t row_bytes, int rows);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "DirtyRegion.h"
+
+// Kernels for the HDR capture path. Source images are scRGB: R16G16B16A16 half floats,
+// linear light with BT.709 primaries and 1.0 = 80 nits, as delivered by an FP16 frame pool.
+// Pitches are in bytes.
+namespace HdrKernels
+{
+    constexpr float kScRgbNits = 80.0f;         // Luminance of scRGB 1.0
+    constexpr float kPqPeakNits = 10000.0f;     // PQ code 1.0
+
+    float HalfToFloat(uint16_t value);
+    // Round to nearest even; overflow gives infinity
+    uint16_t FloatToHalf(float value);
+
+    // scRGB -> P010 with HDR10 signalling: BT.2020 primaries, SMPTE ST 2084 (PQ), BT.2020
+    // non-constant luminance matrix, 10-bit limited range in the high bits of each 16-bit sample.
+    // Chroma is the average of each 2x2 block's PQ-encoded R'G'B'. width and height must be even.
+    void ConvertScRgbToP010(const uint8_t* src, ptrdiff_t src_pitch, int width, int height,
+                            uint8_t* dst_y, ptrdiff_t y_pitch, uint8_t* dst_uv, ptrdiff_t uv_pitch);
+    // Updates only the region of a P010 image converted from the previous frame
+    void ConvertScRgbToP010Region(const uint8_t* src, ptrdiff_t src_pitch, uint8_t* dst_y, ptrdiff_t y_pitch,
+                                  uint8_t* dst_uv, ptrdiff_t uv_pitch, const DirtyRegion& region);
+
+    // scRGB -> sRGB BGRA for SDR output. Content up to white_nits is kept as is (up to a knee)
+    // and highlights up to peak_nits roll off smoothly on the brightest channel, preserving hue.
+    void ToneMapScRgbToBgra(const uint8_t* src, ptrdiff_t src_pitch, int width, int height,
+                            uint8_t* dst, ptrdiff_t dst_pitch, float white_nits, float peak_nits);
+    void ToneMapScRgbToBgraRegion(const uint8_t* src, ptrdiff_t src_pitch, uint8_t* dst, ptrdiff_t dst_pitch,
+                                  float white_nits, float peak_nits, const DirtyRegion& region);
+
+    // sRGB BGRA -> scRGB with an optional gain, e.g. to place SDR white at 203 nits (gain 2.54)
+    void ConvertBgraToScRgb(const uint8_t* src, ptrdiff_t src_pitch, int width, int height,
+                            uint8_t* dst, ptrdiff_t dst_pitch, float gain);
+}
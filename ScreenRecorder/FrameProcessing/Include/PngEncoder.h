@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "FrameDescriptor.h"
+
+struct PngEncodeStats
+{
+    int strips = 0;
+    double filter_ms = 0.0;         // Summed over the strips
+    double deflate_ms = 0.0;
+    double total_ms = 0.0;          // Wall time of Encode
+    size_t raw_bytes = 0;           // Filtered image data before compression
+    size_t png_bytes = 0;
+};
+
+// Lossless BGRA -> 8-bit RGB PNG (alpha is dropped: captures are opaque) with no zlib dependency.
+//
+// The image is cut into row strips that are filtered and compressed on their own threads. Each
+// row takes the filter with the smallest sum of absolute residuals; all five are computed with
+// SSE2. Strips are deflated independently (greedy LZ77 over a 4-byte hash, dynamic Huffman
+// blocks) and end on a byte boundary with an empty stored block, so they concatenate into one
+// zlib stream, as pigz does. Every strip goes out as its own IDAT chunk with the CRC computed
+// on its thread, and the strips' Adler-32s are combined at the end.
+class PngEncoder
+{
+public:
+    // threads = 0 uses every core. on_thread_start runs first on every strip thread the encoder
+    // starts, e.g. to lower its priority.
+    explicit PngEncoder(int threads = 0, std::function<void()> on_thread_start = nullptr);
+
+    // Bgra frames only. png is replaced.
+    bool Encode(const FrameDescriptor& frame, std::vector<uint8_t>& png);
+
+    const PngEncodeStats& GetLastStats() const { return stats_; }
+    int GetThreads() const { return threads_; }
+
+    // Reference checksums, exposed for verification
+    static uint32_t Crc32(uint32_t crc, const uint8_t* data, size_t size);
+    static uint32_t Adler32(uint32_t adler, const uint8_t* data, size_t size);
+
+private:
+    struct Strip
+    {
+        int y_begin = 0;
+        int y_end = 0;
+        std::vector<uint8_t> filtered;      // Filter byte + residuals per row
+        std::vector<uint8_t> chunk;         // Complete IDAT chunk
+        std::vector<uint8_t> rows;          // Previous and current RGB row, with zero padding on the left
+        std::vector<uint8_t> candidates;    // One output row per filter
+        std::vector<int32_t> hash_head;
+        std::vector<uint32_t> tokens;
+        uint32_t adler = 1;
+        double filter_ms = 0.0;
+        double deflate_ms = 0.0;
+    };
+
+    void EncodeStrip(const FrameDescriptor& frame, Strip& strip, bool is_first, bool is_last);
+
+    int threads_;
+    std::function<void()> on_thread_start_;
+    std::vector<Strip> strips_;             // Scratch is kept between snapshots
+    PngEncodeStats stats_;
+};
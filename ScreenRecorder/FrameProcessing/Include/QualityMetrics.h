@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Region classes for per-content quality. Screen content mixes text and UI, where a few
+// exact colours dominate and ringing is obvious, with photos and video where noise hides.
+enum class ContentClass : uint8_t
+{
+    Flat,           // Solid fill
+    Text,           // Few dominant colours with sharp edges: text, UI chrome, line art
+    Image           // Natural imagery, gradients, video
+};
+
+constexpr int kContentClassCount = 3;
+
+struct QualityTotals
+{
+    uint64_t squared_error = 0;
+    uint64_t samples = 0;
+    double ssim_sum = 0.0;
+    uint64_t ssim_windows = 0;
+
+    void Add(const QualityTotals& other);
+    double GetPsnr() const;         // dB, capped at 100 for identical planes
+    double GetSsim() const;         // 1.0 when no window was measured
+};
+
+struct FrameQuality
+{
+    QualityTotals luma;
+    QualityTotals chroma;                               // U and V together; PSNR only
+    QualityTotals luma_by_class[kContentClassCount];
+
+    void Add(const FrameQuality& other);
+};
+
+struct Nv12View
+{
+    const uint8_t* y;
+    ptrdiff_t y_pitch;
+    const uint8_t* uv;
+    ptrdiff_t uv_pitch;
+};
+
+// PSNR and SSIM between a reference and a decoded NV12 frame of the same size. SSIM uses
+// 8x8 windows at a stride of 4 with uniform weights (the libvpx "fast" variant).
+namespace QualityMetrics
+{
+    constexpr int kClassTileSize = 16;
+
+    const char* GetClassName(ContentClass content_class);
+
+    // Classifies the reference luma in kClassTileSize tiles. classes must hold
+    // FrameKernels::TileCount(width, height, kClassTileSize) entries.
+    void ClassifyTiles(const uint8_t* luma, ptrdiff_t pitch, int width, int height, ContentClass* classes);
+
+    // Adds the comparison to quality. classes comes from ClassifyTiles on the reference.
+    void CompareNv12(const Nv12View& reference, const Nv12View& decoded, int width, int height,
+                     const ContentClass* classes, FrameQuality& quality);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class SceneChange
+{
+    Static,         // Nothing visible changed
+    Changed,        // Motion, typing, scrolling
+    Cut             // Most of the picture replaced: alt-tab, new slide, fullscreen video start
+};
+
+struct SceneChangeConfig
+{
+    double cut_histogram_distance = 0.25;   // Half the L1 distance between normalized luma histograms, 0..1
+    double cut_mean_difference = 40.0;      // Mean absolute thumbnail difference per byte that is a cut on its own
+    double change_mean_difference = 0.5;    // Below this the frame counts as static
+    double scroll_ratio = 0.35;             // A vertical shift explaining all but this share of the difference is a scroll
+    int min_keyframe_interval = 30;         // Frames between forced keyframes, so flicker cannot flood the stream
+    int active_keyframe_interval = 120;     // Refresh once content settles after changing for at least this long
+    int max_keyframe_interval = 600;        // The encoder's own GOP, used to track its keyframes
+};
+
+struct SceneChangeResult
+{
+    SceneChange change = SceneChange::Static;
+    bool force_keyframe = false;
+    double histogram_distance = 0.0;
+    double mean_difference = 0.0;
+};
+
+// Cheap CPU scene-cut detector for keyframe placement. Works on a luma histogram of
+// sampled rows plus a box-downsampled thumbnail compared against the previous frame.
+// Scrolls are recognized by testing vertical shifts of the thumbnail, so a long page
+// scroll does not count as a cut.
+class SceneChangeDetector
+{
+public:
+    explicit SceneChangeDetector(const SceneChangeConfig& config = SceneChangeConfig());
+
+    SceneChangeResult Analyze(const uint8_t* image, ptrdiff_t pitch, int width, int height);
+
+    // Keeps the GOP tracking in step when a keyframe is inserted for another reason
+    void OnKeyframe() { frames_since_keyframe_ = 0; }
+    void Reset();
+
+private:
+    static constexpr int kThumbnailWidth = 160;
+
+    bool IsScroll(double mean_difference) const;
+
+    SceneChangeConfig config_;
+
+    std::vector<uint8_t> thumbnail_;
+    std::vector<uint8_t> previous_thumbnail_;
+    uint32_t histogram_[64] = {};
+    uint32_t previous_histogram_[64] = {};
+    int thumbnail_width_ = 0;
+    int thumbnail_height_ = 0;
+    bool has_previous_ = false;
+
+    int frames_since_keyframe_ = 0;
+    bool changed_since_keyframe_ = false;
+};
@@ -0,0 +1,256 @@
+#include <algorithm>
+
+#include "DirtyRegion.h"
+#include "FrameKernels.h"
+#include "HotPathCounters.h"
+
+DirtyRegion DirtyRegion::Full(int width, int height)
+{
+    DirtyRegion region(width, height);
+    region.Add(DirtyRect{ 0, 0, width, height });
+    return region;
+}
+
+DirtyRegion DirtyRegion::FromTiles(const uint8_t* tile_flags, int width, int height, int tile_size)
+{
+    DirtyRegion region(width, height);
+    const int tiles_x = (width + tile_size - 1) / tile_size;
+    const int tiles_y = (height + tile_size - 1) / tile_size;
+
+    // Rects that end on the previous tile row and may still grow down. Every one of them is in
+    // region, so neither list outgrows kMaxRects.
+    size_t open[kMaxRects];
+    size_t next_open[kMaxRects];
+    size_t open_count = 0;
+    bool is_collapsed = false;
+
+    for (int tile_y = 0; tile_y < tiles_y; ++tile_y)
+    {
+        const uint8_t* flags = tile_flags + static_cast<size_t>(tile_y) * tiles_x;
+        const int y = tile_y * tile_size;
+        const int rows = std::min(tile_size, height - y);
+        size_t next_count = 0;
+
+        for (int tile_x = 0; tile_x < tiles_x; )
+        {
+            if (!flags[tile_x])
+            {
+                ++tile_x;
+                continue;
+            }
+
+            int run_end = tile_x;
+            while (run_end < tiles_x && flags[run_end]) ++run_end;
+
+            const int x = tile_x * tile_size;
+            const int run_width = std::min(run_end * tile_size, width) - x;
+            tile_x = run_end;
+            const DirtyRect run{ x, y, run_width, rows };
+
+            // Past kMaxRects the result is the bounding box of every changed tile
+            if (is_collapsed)
+            {
+                region.Extend(run);
+                continue;
+            }
+
+            const size_t* above = std::find_if(open, open + open_count, [&](size_t i)
+            {
+                return region.rects_[i].x == x && region.rects_[i].width == run_width;
+            });
+            if (above != open + open_count)
+            {
+                region.rects_[*above].height += rows;
+                next_open[next_count++] = *above;
+            }
+            else if (region.count_ < kMaxRects)
+            {
+                next_open[next_count++] = region.count_;
+                region.rects_[region.count_++] = run;
+            }
+            else
+            {
+                region.CollapseToBounds();
+                region.Extend(run);
+                is_collapsed = true;
+            }
+        }
+
+        std::copy(next_open, next_open + next_count, open);
+        open_count = next_count;
+    }
+
+    return region;
+}
+
+void DirtyRegion::Add(const DirtyRect& rect)
+{
+    const int x0 = std::max(rect.x, 0);
+    const int y0 = std::max(rect.y, 0);
+    const int x1 = std::min(rect.x + rect.width, width_);
+    const int y1 = std::min(rect.y + rect.height, height_);
+    if (x1 <= x0 || y1 <= y0) return;
+
+    const DirtyRect clipped{ x0, y0, x1 - x0, y1 - y0 };
+    if (count_ == kMaxRects)
+    {
+        CollapseToBounds();
+        Extend(clipped);
+        return;
+    }
+    rects_[count_++] = clipped;
+}
+
+void DirtyRegion::Add(const DirtyRegion& other)
+{
+    if (other.width_ != width_ || other.height_ != height_)
+    {
+        *this = Full(other.width_, other.height_);
+        return;
+    }
+    if (IsFull()) return;
+    if (other.IsFull())
+    {
+        *this = other;
+        return;
+    }
+
+    for (const DirtyRect& rect : other.GetRects()) Add(rect);
+}
+
+DirtyRegion DirtyRegion::ForFrame(int width, int height) const
+{
+    if (width == width_ && height == height_) return *this;
+    return Full(width, height);
+}
+
+DirtyRegion DirtyRegion::Aligned(int alignment) const
+{
+    DirtyRegion aligned(width_, height_);
+    for (const DirtyRect& rect : GetRects())
+    {
+        const int x0 = rect.x / alignment * alignment;
+        const int y0 = rect.y / alignment * alignment;
+        const int x1 = (rect.x + rect.width + alignment - 1) / alignment * alignment;
+        const int y1 = (rect.y + rect.height + alignment - 1) / alignment * alignment;
+        aligned.Add(DirtyRect{ x0, y0, x1 - x0, y1 - y0 });
+    }
+    return aligned;
+}
+
+DirtyRegion DirtyRegion::Scaled(int width, int height) const
+{
+    DirtyRegion scaled(width, height);
+    if (width_ <= 0 || height_ <= 0) return DirtyRegion::Full(width, height);
+
+    // Output pixel x blends source columns floor(fx) and floor(fx) + 1, fx = (x + 0.5) * width_ / width - 0.5
+    auto map = [](int begin, int end, int from, int to, int& out_begin, int& out_end)
+    {
+        out_begin = static_cast<int>(std::max<int64_t>(0, static_cast<int64_t>(begin - 1) * to / from - 1));
+        out_end = static_cast<int>(std::min<int64_t>(to, static_cast<int64_t>(end + 1) * to / from + 2));
+    };
+
+    for (const DirtyRect& rect : GetRects())
+    {
+        int x0, x1, y0, y1;
+        map(rect.x, rect.x + rect.width, width_, width, x0, x1);
+        map(rect.y, rect.y + rect.height, height_, height, y0, y1);
+        scaled.Add(DirtyRect{ x0, y0, x1 - x0, y1 - y0 });
+    }
+    return scaled;
+}
+
+bool DirtyRegion::IsFull() const
+{
+    for (const DirtyRect& rect : GetRects())
+    {
+        if (rect.x == 0 && rect.y == 0 && rect.width == width_ && rect.height == height_) return true;
+    }
+    return false;
+}
+
+uint64_t DirtyRegion::GetArea() const
+{
+    uint64_t area = 0;
+    for (const DirtyRect& rect : GetRects()) area += static_cast<uint64_t>(rect.width) * rect.height;
+    return area;
+}
+
+double DirtyRegion::GetCoverage() const
+{
+    const uint64_t frame_area = static_cast<uint64_t>(width_) * height_;
+    return frame_area ? std::min(1.0, static_cast<double>(GetArea()) / frame_area) : 1.0;
+}
+
+void DirtyRegion::CollapseToBounds()
+{
+    if (count_ == 0) return;
+
+    for (size_t i = 1; i < count_; ++i) Extend(rects_[i]);
+    count_ = 1;
+}
+
+void DirtyRegion::Extend(const DirtyRect& rect)
+{
+    DirtyRect& bounds = rects_[0];
+    const int x1 = std::max(bounds.x + bounds.width, rect.x + rect.width);
+    const int y1 = std::max(bounds.y + bounds.height, rect.y + rect.height);
+    bounds.x = std::min(bounds.x, rect.x);
+    bounds.y = std::min(bounds.y, rect.y);
+    bounds.width = x1 - bounds.x;
+    bounds.height = y1 - bounds.y;
+}
+
+DirtyRegionTracker::DirtyRegionTracker(int tile_size)
+    : tile_size_(std::max(8, tile_size))
+{
+}
+
+const DirtyRegion& DirtyRegionTracker::Update(const uint8_t* frame, ptrdiff_t pitch, int width, int height, int bytes_per_pixel)
+{
+    const size_t row_bytes = static_cast<size_t>(width) * bytes_per_pixel;
+
+    if (width != width_ || height != height_ || bytes_per_pixel != bytes_per_pixel_)
+    {
+        width_ = width;
+        height_ = height;
+        bytes_per_pixel_ = bytes_per_pixel;
+        reference_.resize(row_bytes * height);
+        FrameKernels::CopyImage(reference_.data(), row_bytes, frame, pitch, row_bytes, height);
+        HotPathCounters::CountCopy(TraceStage::Copy, row_bytes * height);
+        region_ = DirtyRegion::Full(width, height);
+        return region_;
+    }
+
+    // The tile diff works in 4-byte units; wider pixels make tiles proportionally narrower
+    const int units = static_cast<int>(row_bytes / 4);
+    const int unit_per_pixel = bytes_per_pixel / 4;
+    tile_flags_.resize(FrameKernels::TileCount(units, height, tile_size_));
+    FrameKernels::DiffTiles(frame, pitch, reference_.data(), row_bytes, units, height, tile_size_, tile_flags_.data());
+
+    DirtyRegion tiles = DirtyRegion::FromTiles(tile_flags_.data(), units, height, tile_size_);
+    region_ = DirtyRegion(width, height);
+    for (const DirtyRect& rect : tiles.GetRects())
+    {
+        region_.Add(DirtyRect{ rect.x / unit_per_pixel, rect.y, (rect.width + unit_per_pixel - 1) / unit_per_pixel, rect.height });
+    }
+
+    // Tiles that compared equal already match
+    HotPathCounters::CountCopy(TraceStage::Copy, region_.GetArea() * bytes_per_pixel);
+    for (const DirtyRect& rect : region_.GetRects())
+    {
+        FrameKernels::CopyImage(reference_.data() + rect.y * row_bytes + static_cast<size_t>(rect.x) * bytes_per_pixel, row_bytes,
+                                frame + rect.y * pitch + static_cast<ptrdiff_t>(rect.x) * bytes_per_pixel, pitch,
+                                static_cast<size_t>(rect.width) * bytes_per_pixel, rect.height);
+    }
+
+    return region_;
+}
+
+void DirtyRegionTracker::Reset()
+{
+    width_ = 0;
+    height_ = 0;
+    bytes_per_pixel_ = 0;
+    region_ = DirtyRegion();
+}
@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <chrono>
+
+#include "FilterChain.h"
+#include "FrameKernels.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FRAME_KERNELS_SSE2 1
+#endif
+
+namespace
+{
+    // A band of output rows plus the two horizontal passes fit in L2 alongside the source rows being read
+    constexpr size_t kBandBytes = 128 * 1024;
+    constexpr int kMaxBandRows = 64;
+
+    // top = left * w0 + right * w1 per channel, which is at most 255 * 256 and kept as 16 bits
+    void ScaleRowHorizontal(const uint8_t* src, const int32_t* offsets, const uint32_t* weights, int width, uint16_t* out)
+    {
+        int x = 0;
+
+#ifdef FRAME_KERNELS_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i bias = _mm_set1_epi32(0x8000);
+        auto tap = [&](int column)
+        {
+            // B0 G0 R0 A0 B1 G1 R1 A1 -> B0 B1 G0 G1 R0 R1 A0 A1, so madd pairs each channel's two taps
+            __m128i pixels = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + offsets[column])), zero);
+            pixels = _mm_unpacklo_epi16(pixels, _mm_srli_si128(pixels, 8));
+            return _mm_sub_epi32(_mm_madd_epi16(pixels, _mm_set1_epi32(static_cast<int>(weights[column]))), bias);
+        };
+        for (; x + 2 <= width; x += 2)
+        {
+            // Biased into int16 range for the signed pack, and back
+            const __m128i packed = _mm_packs_epi32(tap(x), tap(x + 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), _mm_add_epi16(packed, _mm_set1_epi16(-0x8000)));
+        }
+#endif
+
+        for (; x < width; ++x)
+        {
+            const uint8_t* left = src + offsets[x];
+            const uint32_t w0 = weights[x] & 0xFFFF;
+            const uint32_t w1 = weights[x] >> 16;
+            for (int c = 0; c < 4; ++c)
+            {
+                out[x * 4 + c] = static_cast<uint16_t>(left[c] * w0 + left[4 + c] * w1);
+            }
+        }
+    }
+
+    // (top * (256 - wy) + bottom * wy + 32768) >> 16, as ScaleBgraBilinear rounds it
+    void ScaleRowVertical(const uint16_t* top, const uint16_t* bottom, uint32_t wy, size_t count, uint8_t* out)
+    {
+        size_t i = 0;
+
+#ifdef FRAME_KERNELS_SSE2
+        const __m128i w0 = _mm_set1_epi16(static_cast<short>(256 - wy));
+        const __m128i w1 = _mm_set1_epi16(static_cast<short>(wy));
+        const __m128i round = _mm_set1_epi32(32768);
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i*>(top + i));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + i));
+
+            // Full 32-bit products from the low and high halves of the 16x16 multiplies
+            const __m128i t_low = _mm_mullo_epi16(t, w0), t_high = _mm_mulhi_epu16(t, w0);
+            const __m128i b_low = _mm_mullo_epi16(b, w1), b_high = _mm_mulhi_epu16(b, w1);
+            __m128i sum0 = _mm_add_epi32(_mm_unpacklo_epi16(t_low, t_high), _mm_unpacklo_epi16(b_low, b_high));
+            __m128i sum1 = _mm_add_epi32(_mm_unpackhi_epi16(t_low, t_high), _mm_unpackhi_epi16(b_low, b_high));
+            sum0 = _mm_srli_epi32(_mm_add_epi32(sum0, round), 16);
+            sum1 = _mm_srli_epi32(_mm_add_epi32(sum1, round), 16);
+
+            const __m128i words = _mm_packs_epi32(sum0, sum1);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(words, words));
+        }
+#endif
+
+        for (; i < count; ++i)
+        {
+            out[i] = static_cast<uint8_t>((top[i] * (256 - wy) + bottom[i] * wy + 32768) >> 16);
+        }
+    }
+}
+
+FilterChainConfig FilterChainConfig::Resolve(int capture_width, int capture_height) const
+{
+    FilterChainConfig resolved = *this;
+    DirtyRect& crop = resolved.crop;
+    if (crop.width <= 0 || crop.height <= 0) crop = { 0, 0, capture_width, capture_height };
+
+    crop.x = std::clamp(crop.x, 0, std::max(0, capture_width - 2));
+    crop.y = std::clamp(crop.y, 0, std::max(0, capture_height - 2));
+    crop.width = std::max(2, std::min(crop.width, capture_width - crop.x) & ~1);
+    crop.height = std::max(2, std::min(crop.height, capture_height - crop.y) & ~1);
+
+    if (output_width <= 0 || output_height <= 0)
+    {
+        resolved.output_width = crop.width;
+        resolved.output_height = crop.height;
+    }
+    else
+    {
+        resolved.output_width = std::max(2, output_width & ~1);
+        resolved.output_height = std::max(2, output_height & ~1);
+    }
+    return resolved;
+}
+
+FilterChain::FilterChain(const FilterChainConfig& config)
+    : config_(config)
+{
+}
+
+void FilterChain::SetOverlay(const uint8_t* bgra, ptrdiff_t pitch, int width, int height)
+{
+    if (!bgra || width <= 0 || height <= 0)
+    {
+        ClearOverlay();
+        return;
+    }
+
+    const size_t row_bytes = static_cast<size_t>(width) * 4;
+    overlay_.resize(row_bytes * height);
+    FrameKernels::CopyImage(overlay_.data(), static_cast<ptrdiff_t>(row_bytes), bgra, pitch, row_bytes, height);
+    overlay_width_ = width;
+    overlay_height_ = height;
+}
+
+void FilterChain::SetOverlayPosition(int x, int y)
+{
+    overlay_x_ = x;
+    overlay_y_ = y;
+}
+
+void FilterChain::ClearOverlay()
+{
+    overlay_.clear();
+    overlay_width_ = 0;
+    overlay_height_ = 0;
+}
+
+DirtyRect FilterChain::GetOverlayRect() const
+{
+    const int left = std::max(overlay_x_, 0);
+    const int top = std::max(overlay_y_, 0);
+    const int right = std::min(overlay_x_ + overlay_width_, resolved_.output_width);
+    const int bottom = std::min(overlay_y_ + overlay_height_, resolved_.output_height);
+    if (overlay_.empty() || right <= left || bottom <= top) return DirtyRect();
+    return { left, top, right - left, bottom - top };
+}
+
+int FilterChain::GetOutputWidth(int capture_width, int capture_height) const
+{
+    return config_.Resolve(capture_width, capture_height).output_width;
+}
+
+int FilterChain::GetOutputHeight(int capture_width, int capture_height) const
+{
+    return config_.Resolve(capture_width, capture_height).output_height;
+}
+
+bool FilterChain::ProcessToBgra(const FrameDescriptor& frame, uint8_t* dst, ptrdiff_t dst_pitch)
+{
+    if (!dst) return false;
+    return Process(frame, dst, dst_pitch, nullptr, 0, nullptr, 0);
+}
+
+bool FilterChain::ProcessToNv12(const FrameDescriptor& frame, uint8_t* dst_y, ptrdiff_t y_pitch, uint8_t* dst_uv, ptrdiff_t uv_pitch)
+{
+    if (!dst_y || !dst_uv) return false;
+    return Process(frame, nullptr, 0, dst_y, y_pitch, dst_uv, uv_pitch);
+}
+
+void FilterChain::Prepare(int capture_width, int capture_height)
+{
+    capture_width_ = capture_width;
+    capture_height_ = capture_height;
+    resolved_ = config_.Resolve(capture_width, capture_height);
+
+    const int crop_width = resolved_.crop.width;
+    const int crop_height = resolved_.crop.height;
+    const int width = resolved_.output_width;
+    const int height = resolved_.output_height;
+    scales_ = width != crop_width || height != crop_height;
+
+    column_offsets_.clear();
+    column_weights_.clear();
+    row_sources_.clear();
+    row_weights_.clear();
+    if (scales_)
+    {
+        // The coordinates ScaleBgraBilinear computes per pixel, once per column and row
+        const int64_t step_x = (static_cast<int64_t>(crop_width) << 16) / width;
+        for (int x = 0; x < width; ++x)
+        {
+            const int64_t fx = std::max<int64_t>(0, x * step_x + step_x / 2 - 0x8000);
+            const int x0 = std::min(static_cast<int>(fx >> 16), crop_width - 1);
+            const uint32_t wx = static_cast<uint32_t>(fx & 0xFFFF) >> 8;
+            if (x0 == crop_width - 1)
+            {
+                column_offsets_.push_back((x0 - 1) * 4);
+                column_weights_.push_back(256u << 16);
+            }
+            else
+            {
+                column_offsets_.push_back(x0 * 4);
+                column_weights_.push_back((256 - wx) | (wx << 16));
+            }
+        }
+
+        const int64_t step_y = (static_cast<int64_t>(crop_height) << 16) / height;
+        for (int y = 0; y < height; ++y)
+        {
+            const int64_t fy = std::max<int64_t>(0, y * step_y + step_y / 2 - 0x8000);
+            row_sources_.push_back(std::min(static_cast<int>(fy >> 16), crop_height - 1));
+            row_weights_.push_back(static_cast<uint16_t>((fy & 0xFFFF) >> 8));
+        }
+        scaled_rows_.resize(static_cast<size_t>(width) * 4 * 2);
+    }
+
+    scratch_pitch_ = static_cast<ptrdiff_t>((static_cast<size_t>(width) * 4 + 63) / 64 * 64);
+    band_rows_ = config_.fused ? std::clamp(static_cast<int>(kBandBytes / scratch_pitch_) & ~1, 2, kMaxBandRows) : height;
+    scratch_.Resize(static_cast<size_t>(scratch_pitch_) * band_rows_);
+    stats_.scratch_bytes = scratch_.size();
+}
+
+bool FilterChain::Process(const FrameDescriptor& frame, uint8_t* dst_bgra, ptrdiff_t bgra_pitch, uint8_t* dst_y, ptrdiff_t y_pitch,
+                          uint8_t* dst_uv, ptrdiff_t uv_pitch)
+{
+    if (!frame.IsValid() || frame.format != FrameFormat::Bgra || frame.width < 2 || frame.height < 2) return false;
+
+    const auto start = std::chrono::steady_clock::now();
+    if (frame.width != capture_width_ || frame.height != capture_height_) Prepare(frame.width, frame.height);
+
+    const int width = resolved_.output_width;
+    const int height = resolved_.output_height;
+    const size_t row_bytes = static_cast<size_t>(width) * 4;
+    const ptrdiff_t src_pitch = frame.planes[0].pitch;
+    const uint8_t* crop = frame.planes[0].data + resolved_.crop.y * src_pitch + static_cast<ptrdiff_t>(resolved_.crop.x) * 4;
+    const DirtyRect overlay = GetOverlayRect();
+
+    cached_rows_[0] = cached_rows_[1] = -1;
+    source_rows_read_ = 0;
+    uint64_t intermediate_bytes = 0;
+
+    // Bands only pay for themselves by keeping an intermediate frame out of memory. To BGRA, or to
+    // NV12 with nothing to resize or blend, there is none, so fused runs as one pass too.
+    const int band_rows = dst_bgra || (!scales_ && overlay.height == 0) ? height : band_rows_;
+
+    // Unfused, the one band is the whole frame and scratch_ the full-size intermediate
+    for (int y = 0; y < height; y += band_rows)
+    {
+        const int rows = std::min(band_rows, height - y);
+        const bool overlaid = overlay.height > 0 && y < overlay.y + overlay.height && overlay.y < y + rows;
+
+        // Without a resize or the overlay in it, a band converts straight from the capture
+        const uint8_t* band = crop + y * src_pitch;
+        ptrdiff_t band_pitch = src_pitch;
+        if (dst_bgra || scales_ || overlaid)
+        {
+            uint8_t* out = dst_bgra ? dst_bgra + y * bgra_pitch : scratch_.data();
+            const ptrdiff_t out_pitch = dst_bgra ? bgra_pitch : scratch_pitch_;
+            if (scales_)
+            {
+                ScaleRows(crop, src_pitch, y, y + rows, out, out_pitch);
+            }
+            else
+            {
+                FrameKernels::CopyImage(out, out_pitch, band, src_pitch, row_bytes, rows);
+                source_rows_read_ += rows;
+            }
+            if (overlaid) BlendOverlay(out, out_pitch, y, y + rows);
+
+            band = out;
+            band_pitch = out_pitch;
+            if (!dst_bgra && !config_.fused) intermediate_bytes += row_bytes * rows;
+        }
+        else
+        {
+            source_rows_read_ += rows;
+        }
+
+        if (dst_y)
+        {
+            FrameKernels::ConvertBgraToNv12(band, band_pitch, width, rows, dst_y + y * y_pitch, y_pitch, dst_uv + y / 2 * uv_pitch, uv_pitch);
+        }
+    }
+
+    ++stats_.frames;
+    stats_.bytes_read += source_rows_read_ * resolved_.crop.width * 4 + intermediate_bytes;
+    stats_.bytes_written += intermediate_bytes + (dst_bgra ? row_bytes * height : static_cast<uint64_t>(width) * height * 3 / 2);
+    stats_.process_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+void FilterChain::ScaleRows(const uint8_t* crop, ptrdiff_t pitch, int y_begin, int y_end, uint8_t* dst, ptrdiff_t dst_pitch)
+{
+    const size_t count = static_cast<size_t>(resolved_.output_width) * 4;
+    for (int y = y_begin; y < y_end; ++y)
+    {
+        const int source_row = row_sources_[y];
+        const uint16_t* top = GetScaledRow(crop, pitch, source_row);
+        const uint16_t* bottom = GetScaledRow(crop, pitch, std::min(source_row + 1, resolved_.crop.height - 1));
+        ScaleRowVertical(top, bottom, row_weights_[y], count, dst + (y - y_begin) * dst_pitch);
+    }
+}
+
+const uint16_t* FilterChain::GetScaledRow(const uint8_t* crop, ptrdiff_t pitch, int source_row)
+{
+    const size_t count = static_cast<size_t>(resolved_.output_width) * 4;
+    for (int slot = 0; slot < 2; ++slot)
+    {
+        if (cached_rows_[slot] == source_row) return scaled_rows_.data() + slot * count;
+    }
+
+    // Rows are asked for in order, so the lower one is not needed again
+    const int slot = cached_rows_[0] < cached_rows_[1] ? 0 : 1;
+    uint16_t* out = scaled_rows_.data() + slot * count;
+    ScaleRowHorizontal(crop + source_row * pitch, column_offsets_.data(), column_weights_.data(), resolved_.output_width, out);
+    cached_rows_[slot] = source_row;
+    ++source_rows_read_;
+    return out;
+}
+
+void FilterChain::BlendOverlay(uint8_t* rows, ptrdiff_t pitch, int y_begin, int y_end) const
+{
+    const DirtyRect rect = GetOverlayRect();
+    const int top = std::max(rect.y, y_begin);
+    const int bottom = std::min(rect.y + rect.height, y_end);
+    for (int y = top; y < bottom; ++y)
+    {
+        uint8_t* dst = rows + (y - y_begin) * pitch + static_cast<ptrdiff_t>(rect.x) * 4;
+        const uint8_t* src = overlay_.data() + (static_cast<size_t>(y - overlay_y_) * overlay_width_ + (rect.x - overlay_x_)) * 4;
+        for (int x = 0; x < rect.width; ++x, src += 4, dst += 4)
+        {
+            const uint32_t alpha = src[3];
+            if (alpha == 0) continue;
+            // Straight alpha over the frame, rounded; the frame's own alpha is left alone
+            for (int c = 0; c < 3; ++c)
+            {
+                dst[c] = static_cast<uint8_t>((src[c] * alpha + dst[c] * (255 - alpha) + 127) / 255);
+            }
+        }
+    }
+}
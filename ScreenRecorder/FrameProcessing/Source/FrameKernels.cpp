@@ -0,0 +1,572 @@
+#include <algorithm>
+#include <cstring>
+
+#include "FrameKernels.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FRAME_KERNELS_SSE2 1
+#endif
+
+namespace FrameKernels
+{
+    void CopyImage(uint8_t* dst, ptrdiff_t dst_pitch, const uint8_t* src, ptrdiff_t src_pitch, size_t row_bytes, int rows)
+    {
+        if (dst_pitch == src_pitch && static_cast<size_t>(src_pitch) == row_bytes)
+        {
+            std::memcpy(dst, src, row_bytes * rows);
+            return;
+        }
+
+        for (int y = 0; y < rows; ++y)
+        {
+            std::memcpy(dst + y * dst_pitch, src + y * src_pitch, row_bytes);
+        }
+    }
+
+    void CopyImageRegion(uint8_t* dst, ptrdiff_t dst_pitch, const uint8_t* src, ptrdiff_t src_pitch, int bytes_per_pixel,
+                         const DirtyRegion& region)
+    {
+        for (const DirtyRect& rect : region.GetRects())
+        {
+            const ptrdiff_t x_offset = static_cast<ptrdiff_t>(rect.x) * bytes_per_pixel;
+            CopyImage(dst + rect.y * dst_pitch + x_offset, dst_pitch, src + rect.y * src_pitch + x_offset, src_pitch,
+                      static_cast<size_t>(rect.width) * bytes_per_pixel, rect.height);
+        }
+    }
+
+    uint64_t HashImage(const uint8_t* src, ptrdiff_t src_pitch, size_t row_bytes, int rows)
+    {
+        const uint64_t kPrime = 0x9E3779B97F4A7C15ull;
+        uint64_t lanes[4] = { kPrime, kPrime ^ 1, kPrime ^ 2, kPrime ^ 3 };
+
+        for (int y = 0; y < rows; ++y)
+        {
+            const uint8_t* row = src + y * src_pitch;
+            size_t x = 0;
+
+            // Four independent lanes keep the multiply chains out of each other's way
+            for (; x + 32 <= row_bytes; x += 32)
+            {
+                for (int lane = 0; lane < 4; ++lane)
+                {
+                    uint64_t word;
+                    std::memcpy(&word, row + x + lane * 8, sizeof(word));
+                    lanes[lane] = (lanes[lane] ^ word) * kPrime;
+                    lanes[lane] ^= lanes[lane] >> 29;
+                }
+            }
+
+            for (; x < row_bytes; ++x)
+            {
+                lanes[0] = (lanes[0] ^ row[x]) * kPrime;
+            }
+        }
+
+        uint64_t hash = lanes[0] ^ (lanes[1] * 31) ^ (lanes[2] * 131) ^ (lanes[3] * 1031);
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    size_t TileCount(int width, int height, int tile_size)
+    {
+        size_t tiles_x = (width + tile_size - 1) / tile_size;
+        size_t tiles_y = (height + tile_size - 1) / tile_size;
+        return tiles_x * tiles_y;
+    }
+
+    size_t DiffTiles(const uint8_t* a, ptrdiff_t a_pitch, const uint8_t* b, ptrdiff_t b_pitch,
+                     int width, int height, int tile_size, uint8_t* tile_flags)
+    {
+        const int tiles_x = (width + tile_size - 1) / tile_size;
+        const int tiles_y = (height + tile_size - 1) / tile_size;
+        std::memset(tile_flags, 0, static_cast<size_t>(tiles_x) * tiles_y);
+
+        size_t changed = 0;
+        for (int tile_y = 0; tile_y < tiles_y; ++tile_y)
+        {
+            const int y_begin = tile_y * tile_size;
+            const int y_end = std::min(y_begin + tile_size, height);
+            uint8_t* flags = tile_flags + static_cast<size_t>(tile_y) * tiles_x;
+
+            for (int y = y_begin; y < y_end; ++y)
+            {
+                const uint8_t* row_a = a + y * a_pitch;
+                const uint8_t* row_b = b + y * b_pitch;
+
+                for (int tile_x = 0; tile_x < tiles_x; ++tile_x)
+                {
+                    if (flags[tile_x]) continue;
+
+                    const int x_begin = tile_x * tile_size;
+                    const size_t bytes = static_cast<size_t>(std::min(tile_size, width - x_begin)) * 4;
+                    if (std::memcmp(row_a + x_begin * 4, row_b + x_begin * 4, bytes) != 0)
+                    {
+                        flags[tile_x] = 1;
+                        ++changed;
+                    }
+                }
+            }
+        }
+
+        return changed;
+    }
+
+#ifdef FRAME_KERNELS_SSE2
+    namespace
+    {
+        // Eight BGRA pixels -> B, G, R as 16-bit lanes
+        inline void SplitBgr(const uint8_t* pixels, __m128i& b, __m128i& g, __m128i& r)
+        {
+            const __m128i mask = _mm_set1_epi32(0xFF);
+            __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels));
+            __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + 16));
+
+            b = _mm_packs_epi32(_mm_and_si128(lo, mask), _mm_and_si128(hi, mask));
+            g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), mask), _mm_and_si128(_mm_srli_epi32(hi, 8), mask));
+            r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 16), mask), _mm_and_si128(_mm_srli_epi32(hi, 16), mask));
+        }
+
+        // Sum stays below 2^16, so wrapping 16-bit multiplies and a logical shift are exact
+        inline __m128i Luma(__m128i b, __m128i g, __m128i r)
+        {
+            __m128i y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(47)), _mm_mullo_epi16(g, _mm_set1_epi16(157)));
+            y = _mm_add_epi16(y, _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(16)), _mm_set1_epi16(128)));
+            return _mm_add_epi16(_mm_srli_epi16(y, 8), _mm_set1_epi16(16));
+        }
+
+        // Four 2x2 sums (16-bit, two rows added) -> rounded averages
+        inline __m128i Average2x2(__m128i row_sum)
+        {
+            __m128i pair_sum = _mm_madd_epi16(row_sum, _mm_set1_epi16(1));
+            __m128i average = _mm_srli_epi32(_mm_add_epi32(pair_sum, _mm_set1_epi32(2)), 2);
+            return _mm_packs_epi32(average, average);
+        }
+
+        inline uint64_t HorizontalSum32(__m128i value)
+        {
+            alignas(16) uint32_t lanes[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanes), value);
+            return static_cast<uint64_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+        }
+    }
+#endif
+
+    void ConvertBgraToNv12(const uint8_t* src, ptrdiff_t src_pitch, int width, int height,
+                           uint8_t* dst_y, ptrdiff_t y_pitch, uint8_t* dst_uv, ptrdiff_t uv_pitch)
+    {
+        for (int y = 0; y < height; y += 2)
+        {
+            const uint8_t* row0 = src + y * src_pitch;
+            const uint8_t* row1 = row0 + src_pitch;
+            uint8_t* y_row0 = dst_y + y * y_pitch;
+            uint8_t* y_row1 = y_row0 + y_pitch;
+            uint8_t* uv_row = dst_uv + (y / 2) * uv_pitch;
+
+            int x = 0;
+
+#ifdef FRAME_KERNELS_SSE2
+            for (; x + 8 <= width; x += 8)
+            {
+                __m128i b0, g0, r0, b1, g1, r1;
+                SplitBgr(row0 + x * 4, b0, g0, r0);
+                SplitBgr(row1 + x * 4, b1, g1, r1);
+
+                __m128i luma0 = Luma(b0, g0, r0);
+                __m128i luma1 = Luma(b1, g1, r1);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(y_row0 + x), _mm_packus_epi16(luma0, luma0));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(y_row1 + x), _mm_packus_epi16(luma1, luma1));
+
+                __m128i b = Average2x2(_mm_add_epi16(b0, b1));
+                __m128i g = Average2x2(_mm_add_epi16(g0, g1));
+                __m128i r = Average2x2(_mm_add_epi16(r0, r1));
+
+                // |coefficients| * 255 stays inside int16, so signed 16-bit math is exact
+                __m128i u = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(-26)), _mm_mullo_epi16(g, _mm_set1_epi16(-87)));
+                u = _mm_add_epi16(u, _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(112)), _mm_set1_epi16(128)));
+                u = _mm_add_epi16(_mm_srai_epi16(u, 8), _mm_set1_epi16(128));
+
+                __m128i v = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(112)), _mm_mullo_epi16(g, _mm_set1_epi16(-102)));
+                v = _mm_add_epi16(v, _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(-10)), _mm_set1_epi16(128)));
+                v = _mm_add_epi16(_mm_srai_epi16(v, 8), _mm_set1_epi16(128));
+
+                __m128i uv = _mm_unpacklo_epi16(u, v);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(uv_row + x), _mm_packus_epi16(uv, uv));
+            }
+#endif
+
+            for (; x < width; x += 2)
+            {
+                const uint8_t* p[4] = { row0 + x * 4, row0 + x * 4 + 4, row1 + x * 4, row1 + x * 4 + 4 };
+                int sum_b = 0, sum_g = 0, sum_r = 0;
+
+                for (int i = 0; i < 4; ++i)
+                {
+                    int b = p[i][0], g = p[i][1], r = p[i][2];
+                    uint8_t luma = static_cast<uint8_t>(((47 * r + 157 * g + 16 * b + 128) >> 8) + 16);
+                    (i < 2 ? y_row0 : y_row1)[x + (i & 1)] = luma;
+                    sum_b += b; sum_g += g; sum_r += r;
+                }
+
+                int b = (sum_b + 2) >> 2, g = (sum_g + 2) >> 2, r = (sum_r + 2) >> 2;
+                uv_row[x] = static_cast<uint8_t>(((-26 * r - 87 * g + 112 * b + 128) >> 8) + 128);
+                uv_row[x + 1] = static_cast<uint8_t>(((112 * r - 102 * g - 10 * b + 128) >> 8) + 128);
+            }
+        }
+    }
+
+    void ConvertBgraToNv12Region(const uint8_t* src, ptrdiff_t src_pitch, uint8_t* dst_y, ptrdiff_t y_pitch,
+                                 uint8_t* dst_uv, ptrdiff_t uv_pitch, const DirtyRegion& region)
+    {
+        const DirtyRegion aligned = region.Aligned(2);
+        for (const DirtyRect& rect : aligned.GetRects())
+        {
+            ConvertBgraToNv12(src + rect.y * src_pitch + static_cast<ptrdiff_t>(rect.x) * 4, src_pitch, rect.width, rect.height,
+                              dst_y + rect.y * y_pitch + rect.x, y_pitch, dst_uv + rect.y / 2 * uv_pitch + rect.x, uv_pitch);
+        }
+    }
+
+    void DownsampleBgraBox(const uint8_t* src, ptrdiff_t src_pitch, int src_width, int src_height, int factor,
+                           uint8_t* dst, ptrdiff_t dst_pitch)
+    {
+        const int dst_width = src_width / factor;
+        const int dst_height = src_height / factor;
+        const uint32_t area = static_cast<uint32_t>(factor) * factor;
+
+        for (int oy = 0; oy < dst_height; ++oy)
+        {
+            const uint8_t* block_row = src + static_cast<ptrdiff_t>(oy) * factor * src_pitch;
+            uint8_t* out = dst + oy * dst_pitch;
+
+            for (int ox = 0; ox < dst_width; ++ox)
+            {
+                const uint8_t* block = block_row + static_cast<ptrdiff_t>(ox) * factor * 4;
+                uint32_t sums[4] = { 0, 0, 0, 0 };
+
+#ifdef FRAME_KERNELS_SSE2
+                // 16-bit channel accumulators: 16 * 16 * 255 still fits
+                const __m128i zero = _mm_setzero_si128();
+                __m128i accumulator = _mm_setzero_si128();
+                const int vector_pixels = factor & ~3;
+
+                for (int y = 0; y < factor; ++y)
+                {
+                    const uint8_t* row = block + y * src_pitch;
+                    int x = 0;
+                    for (; x < vector_pixels; x += 4)
+                    {
+                        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x * 4));
+                        accumulator = _mm_add_epi16(accumulator, _mm_unpacklo_epi8(pixels, zero));
+                        accumulator = _mm_add_epi16(accumulator, _mm_unpackhi_epi8(pixels, zero));
+                    }
+                    for (; x < factor; ++x)
+                    {
+                        for (int c = 0; c < 4; ++c) sums[c] += row[x * 4 + c];
+                    }
+                }
+
+                alignas(16) uint16_t lanes[8];
+                _mm_store_si128(reinterpret_cast<__m128i*>(lanes), accumulator);
+                for (int c = 0; c < 4; ++c) sums[c] += lanes[c] + lanes[c + 4];
+#else
+                for (int y = 0; y < factor; ++y)
+                {
+                    const uint8_t* row = block + y * src_pitch;
+                    for (int x = 0; x < factor; ++x)
+                    {
+                        for (int c = 0; c < 4; ++c) sums[c] += row[x * 4 + c];
+                    }
+                }
+#endif
+
+                for (int c = 0; c < 4; ++c)
+                {
+                    out[ox * 4 + c] = static_cast<uint8_t>((sums[c] + area / 2) / area);
+                }
+            }
+        }
+    }
+
+    void DownsampleBgraBoxRegion(const uint8_t* src, ptrdiff_t src_pitch, int factor, uint8_t* dst, ptrdiff_t dst_pitch,
+                                 const DirtyRegion& region)
+    {
+        // Whole blocks only; the partial blocks past width / factor are never output
+        const DirtyRegion aligned = region.Aligned(factor);
+        for (const DirtyRect& rect : aligned.GetRects())
+        {
+            DownsampleBgraBox(src + rect.y * src_pitch + static_cast<ptrdiff_t>(rect.x) * 4, src_pitch, rect.width, rect.height, factor,
+                              dst + rect.y / factor * dst_pitch + static_cast<ptrdiff_t>(rect.x / factor) * 4, dst_pitch);
+        }
+    }
+
+    void LumaHistogram(const uint8_t* src, ptrdiff_t src_pitch, int width, int height, int row_step, uint32_t histogram[64])
+    {
+        for (int y = 0; y < height; y += row_step)
+        {
+            const uint8_t* row = src + y * src_pitch;
+            int x = 0;
+
+#ifdef FRAME_KERNELS_SSE2
+            alignas(16) uint16_t lumas[8];
+            for (; x + 8 <= width; x += 8)
+            {
+                __m128i b, g, r;
+                SplitBgr(row + x * 4, b, g, r);
+                _mm_store_si128(reinterpret_cast<__m128i*>(lumas), _mm_srli_epi16(Luma(b, g, r), 2));
+                for (int i = 0; i < 8; ++i) ++histogram[lumas[i]];
+            }
+#endif
+
+            for (; x < width; ++x)
+            {
+                const uint8_t* pixel = row + x * 4;
+                int luma = ((47 * pixel[2] + 157 * pixel[1] + 16 * pixel[0] + 128) >> 8) + 16;
+                ++histogram[luma >> 2];
+            }
+        }
+    }
+
+    uint64_t SumAbsDiff(const uint8_t* a, const uint8_t* b, size_t size)
+    {
+        uint64_t sum = 0;
+        size_t i = 0;
+
+#ifdef FRAME_KERNELS_SSE2
+        __m128i accumulator = _mm_setzero_si128();
+        for (; i + 16 <= size; i += 16)
+        {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+            accumulator = _mm_add_epi64(accumulator, _mm_sad_epu8(va, vb));
+        }
+        alignas(16) uint64_t lanes[2];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), accumulator);
+        sum = lanes[0] + lanes[1];
+#endif
+
+        for (; i < size; ++i)
+        {
+            sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+        }
+        return sum;
+    }
+
+    uint64_t SumSquaredDiff(const uint8_t* a, ptrdiff_t a_pitch, const uint8_t* b, ptrdiff_t b_pitch, size_t row_bytes, int rows)
+    {
+        uint64_t sum = 0;
+
+        for (int y = 0; y < rows; ++y)
+        {
+            const uint8_t* row_a = a + y * a_pitch;
+            const uint8_t* row_b = b + y * b_pitch;
+            size_t x = 0;
+
+#ifdef FRAME_KERNELS_SSE2
+            // Each lane gains at most 4 * 255^2 per 16 bytes, so one row up to 64 KB fits in 32 bits
+            __m128i accumulator = _mm_setzero_si128();
+            const __m128i zero = _mm_setzero_si128();
+            for (; x + 16 <= row_bytes; x += 16)
+            {
+                __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row_a + x));
+                __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row_b + x));
+                __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+                __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+                accumulator = _mm_add_epi32(accumulator, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+            }
+            sum += HorizontalSum32(accumulator);
+#endif
+
+            for (; x < row_bytes; ++x)
+            {
+                int difference = row_a[x] - row_b[x];
+                sum += static_cast<uint64_t>(difference * difference);
+            }
+        }
+        return sum;
+    }
+
+    void SsimMoments8x8(const uint8_t* a, ptrdiff_t a_pitch, const uint8_t* b, ptrdiff_t b_pitch, uint32_t moments[5])
+    {
+#ifdef FRAME_KERNELS_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        __m128i sums = _mm_setzero_si128();
+        __m128i squares_a = _mm_setzero_si128();
+        __m128i squares_b = _mm_setzero_si128();
+        __m128i products = _mm_setzero_si128();
+
+        for (int y = 0; y < 8; ++y)
+        {
+            __m128i va = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(a + y * a_pitch));
+            __m128i vb = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + y * b_pitch));
+
+            // psadbw against zero sums the 8 bytes; a goes to the low lane, b to the high lane
+            sums = _mm_add_epi64(sums, _mm_sad_epu8(_mm_unpacklo_epi64(va, vb), zero));
+
+            va = _mm_unpacklo_epi8(va, zero);
+            vb = _mm_unpacklo_epi8(vb, zero);
+            squares_a = _mm_add_epi32(squares_a, _mm_madd_epi16(va, va));
+            squares_b = _mm_add_epi32(squares_b, _mm_madd_epi16(vb, vb));
+            products = _mm_add_epi32(products, _mm_madd_epi16(va, vb));
+        }
+
+        alignas(16) uint32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), sums);
+        moments[0] = lanes[0];
+        moments[1] = lanes[2];
+        moments[2] = static_cast<uint32_t>(HorizontalSum32(squares_a));
+        moments[3] = static_cast<uint32_t>(HorizontalSum32(squares_b));
+        moments[4] = static_cast<uint32_t>(HorizontalSum32(products));
+#else
+        for (int i = 0; i < 5; ++i) moments[i] = 0;
+        for (int y = 0; y < 8; ++y)
+        {
+            for (int x = 0; x < 8; ++x)
+            {
+                uint32_t va = a[y * a_pitch + x];
+                uint32_t vb = b[y * b_pitch + x];
+                moments[0] += va;
+                moments[1] += vb;
+                moments[2] += va * va;
+                moments[3] += vb * vb;
+                moments[4] += va * vb;
+            }
+        }
+#endif
+    }
+
+    namespace
+    {
+        // Output rows [y_begin, y_end) and columns [x_begin, x_end) of the resize
+        void ScaleBgraBilinearRect(const uint8_t* src, ptrdiff_t src_pitch, int src_width, int src_height,
+                                   uint8_t* dst, ptrdiff_t dst_pitch, int dst_width, int dst_height,
+                                   int x_begin, int y_begin, int x_end, int y_end)
+        {
+            // 16.16 fixed point source coordinates, pixel-centre aligned
+            const int64_t step_x = (static_cast<int64_t>(src_width) << 16) / dst_width;
+            const int64_t step_y = (static_cast<int64_t>(src_height) << 16) / dst_height;
+
+            for (int y = y_begin; y < y_end; ++y)
+            {
+                int64_t fy = std::max<int64_t>(0, y * step_y + step_y / 2 - 0x8000);
+                int y0 = std::min(static_cast<int>(fy >> 16), src_height - 1);
+                int y1 = std::min(y0 + 1, src_height - 1);
+                uint32_t wy = static_cast<uint32_t>(fy & 0xFFFF) >> 8;
+
+                const uint8_t* row0 = src + y0 * src_pitch;
+                const uint8_t* row1 = src + y1 * src_pitch;
+                uint8_t* out = dst + y * dst_pitch;
+
+                for (int x = x_begin; x < x_end; ++x)
+                {
+                    int64_t fx = std::max<int64_t>(0, x * step_x + step_x / 2 - 0x8000);
+                    int x0 = std::min(static_cast<int>(fx >> 16), src_width - 1);
+                    int x1 = std::min(x0 + 1, src_width - 1);
+                    uint32_t wx = static_cast<uint32_t>(fx & 0xFFFF) >> 8;
+
+                    for (int c = 0; c < 4; ++c)
+                    {
+                        uint32_t top = row0[x0 * 4 + c] * (256 - wx) + row0[x1 * 4 + c] * wx;
+                        uint32_t bottom = row1[x0 * 4 + c] * (256 - wx) + row1[x1 * 4 + c] * wx;
+                        out[x * 4 + c] = static_cast<uint8_t>((top * (256 - wy) + bottom * wy + 32768) >> 16);
+                    }
+                }
+            }
+        }
+    }
+
+    void ScaleBgraBilinear(const uint8_t* src, ptrdiff_t src_pitch, int src_width, int src_height,
+                           uint8_t* dst, ptrdiff_t dst_pitch, int dst_width, int dst_height)
+    {
+        ScaleBgraBilinearRect(src, src_pitch, src_width, src_height, dst, dst_pitch, dst_width, dst_height, 0, 0, dst_width, dst_height);
+    }
+
+    void ScaleBgraBilinearRegion(const uint8_t* src, ptrdiff_t src_pitch, int src_width, int src_height,
+                                 uint8_t* dst, ptrdiff_t dst_pitch, int dst_width, int dst_height, const DirtyRegion& dst_region)
+    {
+        for (const DirtyRect& rect : dst_region.ForFrame(dst_width, dst_height).GetRects())
+        {
+            ScaleBgraBilinearRect(src, src_pitch, src_width, src_height, dst, dst_pitch, dst_width, dst_height,
+                                  rect.x, rect.y, rect.x + rect.width, rect.y + rect.height);
+        }
+    }
+
+    void AccumulateWeighted(uint16_t* sum, ptrdiff_t sum_pitch, const uint8_t* src, ptrdiff_t src_pitch, size_t row_bytes, int rows,
+                            uint32_t weight)
+    {
+        for (int y = 0; y < rows; ++y)
+        {
+            uint16_t* out = reinterpret_cast<uint16_t*>(reinterpret_cast<uint8_t*>(sum) + y * sum_pitch);
+            const uint8_t* row = src + y * src_pitch;
+            size_t x = 0;
+
+#ifdef FRAME_KERNELS_SSE2
+            // Products reach 255 * 256, which still fits the unsigned 16-bit lanes mullo keeps
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i factor = _mm_set1_epi16(static_cast<short>(weight));
+            for (; x + 16 <= row_bytes; x += 16)
+            {
+                const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+                __m128i* low = reinterpret_cast<__m128i*>(out + x);
+                __m128i* high = reinterpret_cast<__m128i*>(out + x + 8);
+                _mm_storeu_si128(low, _mm_add_epi16(_mm_loadu_si128(low), _mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero), factor)));
+                _mm_storeu_si128(high, _mm_add_epi16(_mm_loadu_si128(high), _mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero), factor)));
+            }
+#endif
+
+            for (; x < row_bytes; ++x)
+            {
+                out[x] = static_cast<uint16_t>(out[x] + row[x] * weight);
+            }
+        }
+    }
+
+    void ResolveAccumulator(uint8_t* dst, ptrdiff_t dst_pitch, const uint16_t* sum, ptrdiff_t sum_pitch, size_t row_bytes, int rows)
+    {
+        for (int y = 0; y < rows; ++y)
+        {
+            const uint16_t* in = reinterpret_cast<const uint16_t*>(reinterpret_cast<const uint8_t*>(sum) + y * sum_pitch);
+            uint8_t* row = dst + y * dst_pitch;
+            size_t x = 0;
+
+#ifdef FRAME_KERNELS_SSE2
+            const __m128i half = _mm_set1_epi16(128);
+            for (; x + 16 <= row_bytes; x += 16)
+            {
+                const __m128i low = _mm_srli_epi16(_mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x)), half), 8);
+                const __m128i high = _mm_srli_epi16(_mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x + 8)), half), 8);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(row + x), _mm_packus_epi16(low, high));
+            }
+#endif
+
+            for (; x < row_bytes; ++x)
+            {
+                row[x] = static_cast<uint8_t>((in[x] + 128) >> 8);
+            }
+        }
+    }
+
+    void MaxImage(uint8_t* dst, ptrdiff_t dst_pitch, const uint8_t* src, ptrdiff_t src_pitch, size_t row_bytes, int rows)
+    {
+        for (int y = 0; y < rows; ++y)
+        {
+            uint8_t* out = dst + y * dst_pitch;
+            const uint8_t* row = src + y * src_pitch;
+            size_t x = 0;
+
+#ifdef FRAME_KERNELS_SSE2
+            for (; x + 16 <= row_bytes; x += 16)
+            {
+                __m128i* target = reinterpret_cast<__m128i*>(out + x);
+                _mm_storeu_si128(target, _mm_max_epu8(_mm_loadu_si128(target), _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x))));
+            }
+#endif
+
+            for (; x < row_bytes; ++x)
+            {
+                out[x] = std::max(out[x], row[x]);
+            }
+        }
+    }
+}
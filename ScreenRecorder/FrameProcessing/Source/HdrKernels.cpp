@@ -0,0 +1,503 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "HdrKernels.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define HDR_KERNELS_SSE2 1
+#endif
+
+namespace
+{
+    // PQ saturates here, in scRGB units
+    constexpr float kScRgbMax = HdrKernels::kPqPeakNits / HdrKernels::kScRgbNits;
+
+    // BT.709 -> BT.2020 primaries (ITU-R BT.2087)
+    constexpr float kToBt2020[3][3] =
+    {
+        { 0.627403896f, 0.329283039f, 0.043313065f },
+        { 0.069097289f, 0.919540395f, 0.011362316f },
+        { 0.016391439f, 0.088013308f, 0.895595253f }
+    };
+
+    // BT.2020 non-constant luminance
+    constexpr float kLumaR = 0.2627f;
+    constexpr float kLumaG = 0.6780f;
+    constexpr float kLumaB = 0.0593f;
+    constexpr float kCbScale = 1.0f / 1.8814f;
+    constexpr float kCrScale = 1.0f / 1.4746f;
+
+    // Tone mapping keeps everything below this fraction of SDR white untouched
+    constexpr float kToneMapKnee = 0.75f;
+
+    // Piecewise-linear curve indexed by the top 16 bits of the input's float representation:
+    // segments are under 1% wide relative to their position, so steep curves near zero (PQ,
+    // sRGB) stay accurate without a transcendental per sample. Each segment is stored as
+    // (start, slope) next to each other, one 8-byte load per lookup. Inputs must be in [0, max_input].
+    class FloatCurve
+    {
+    public:
+        static constexpr int kShift = 16;
+        static constexpr uint32_t kMask = (1u << kShift) - 1;
+
+        template <typename Function>
+        FloatCurve(float max_input, Function function)
+        {
+            uint32_t max_bits;
+            std::memcpy(&max_bits, &max_input, sizeof(max_bits));
+            const size_t segments = (max_bits >> kShift) + 1;
+            segments_.resize(segments * 2);
+
+            float start = Evaluate(function, 0);
+            for (size_t i = 0; i < segments; ++i)
+            {
+                const float end = Evaluate(function, static_cast<uint32_t>(i + 1) << kShift);
+                segments_[i * 2] = start;
+                segments_[i * 2 + 1] = end - start;
+                start = end;
+            }
+        }
+
+        float operator()(float x) const
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &x, sizeof(bits));
+            const float* segment = segments_.data() + (bits >> kShift) * 2;
+            const float t = static_cast<float>(static_cast<int32_t>(bits & kMask)) * (1.0f / (kMask + 1));
+            return segment[0] + segment[1] * t;
+        }
+
+        const float* GetSegments() const { return segments_.data(); }
+
+    private:
+        template <typename Function>
+        static float Evaluate(Function function, uint32_t bits)
+        {
+            float x;
+            std::memcpy(&x, &bits, sizeof(x));
+            return static_cast<float>(function(static_cast<double>(x)));
+        }
+
+        std::vector<float> segments_;
+    };
+
+    // scRGB units -> PQ signal (SMPTE ST 2084)
+    const FloatCurve& GetPqCurve()
+    {
+        static const FloatCurve curve(kScRgbMax, [](double x)
+        {
+            const double m1 = 2610.0 / 16384.0;
+            const double m2 = 2523.0 / 4096.0 * 128.0;
+            const double c1 = 3424.0 / 4096.0;
+            const double c2 = 2413.0 / 4096.0 * 32.0;
+            const double c3 = 2392.0 / 4096.0 * 32.0;
+
+            const double p = std::pow(std::max(x * HdrKernels::kScRgbNits / HdrKernels::kPqPeakNits, 0.0), m1);
+            return std::pow((c1 + c2 * p) / (1.0 + c3 * p), m2);
+        });
+        return curve;
+    }
+
+    // Linear [0, 1] -> sRGB-encoded [0, 255]
+    const FloatCurve& GetSrgbCurve()
+    {
+        static const FloatCurve curve(1.0f, [](double x)
+        {
+            return 255.0 * (x <= 0.0031308 ? 12.92 * x : 1.055 * std::pow(x, 1.0 / 2.4) - 0.055);
+        });
+        return curve;
+    }
+
+    struct ToneCurve
+    {
+        float scale;        // scRGB -> multiples of SDR white
+        float knee;
+        float range;        // 1 - knee, 0 when there is nothing to roll off
+        float inverse_range;
+        float inverse_q2;   // Extended Reinhard white point, squared and inverted
+    };
+
+    ToneCurve MakeToneCurve(float white_nits, float peak_nits)
+    {
+        ToneCurve curve{};
+        curve.scale = HdrKernels::kScRgbNits / std::max(white_nits, 1.0f);
+
+        const float peak = peak_nits / std::max(white_nits, 1.0f);
+        if (peak > 1.0f)
+        {
+            curve.knee = kToneMapKnee;
+            curve.range = 1.0f - kToneMapKnee;
+            curve.inverse_range = 1.0f / curve.range;
+            const float q = (peak - curve.knee) * curve.inverse_range;
+            curve.inverse_q2 = 1.0f / (q * q);
+        }
+        else
+        {
+            // Nothing brighter than white is expected: clip
+            curve.knee = 1.0f;
+        }
+
+        return curve;
+    }
+
+    uint16_t ToP010(float code)
+    {
+        return static_cast<uint16_t>(static_cast<int32_t>(code + 0.5f) << 6);
+    }
+
+    void EncodePixelPq(const FloatCurve& pq, const uint8_t* pixel, float encoded[3])
+    {
+        uint16_t half[3];
+        std::memcpy(half, pixel, sizeof(half));
+        const float r = HdrKernels::HalfToFloat(half[0]);
+        const float g = HdrKernels::HalfToFloat(half[1]);
+        const float b = HdrKernels::HalfToFloat(half[2]);
+
+        for (int i = 0; i < 3; ++i)
+        {
+            const float value = kToBt2020[i][0] * r + kToBt2020[i][1] * g + kToBt2020[i][2] * b;
+            encoded[i] = pq(std::min(value > 0.0f ? value : 0.0f, kScRgbMax));
+        }
+    }
+
+    uint32_t ToneMapPixel(const FloatCurve& srgb, const ToneCurve& curve, const uint8_t* pixel)
+    {
+        uint16_t half[3];
+        std::memcpy(half, pixel, sizeof(half));
+
+        float rgb[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            const float value = HdrKernels::HalfToFloat(half[i]) * curve.scale;
+            rgb[i] = value > 0.0f ? value : 0.0f;
+        }
+
+        const float peak = std::max(std::max(rgb[0], rgb[1]), rgb[2]);
+        const float t = std::max(peak - curve.knee, 0.0f) * curve.inverse_range;
+        const float rolled = curve.knee + curve.range * (t * (1.0f + t * curve.inverse_q2) / (1.0f + t));
+        const float mapped = peak > curve.knee ? rolled : peak;
+        const float ratio = mapped / std::max(peak, 1e-20f);
+
+        uint32_t out = 0xFF000000u;
+        for (int i = 0; i < 3; ++i)
+        {
+            const float encoded = srgb(std::min(rgb[i] * ratio, 1.0f));
+            out |= static_cast<uint32_t>(static_cast<int32_t>(encoded + 0.5f)) << ((2 - i) * 8);
+        }
+        return out;
+    }
+
+#ifdef HDR_KERNELS_SSE2
+    // One half per 32-bit lane
+    inline __m128 HalfToFloat4(__m128i half)
+    {
+        const __m128i magnitude = _mm_slli_epi32(_mm_and_si128(half, _mm_set1_epi32(0x7FFF)), 13);
+        const __m128i sign = _mm_slli_epi32(_mm_and_si128(half, _mm_set1_epi32(0x8000)), 16);
+
+        // Multiplying by 2^112 rebiases the exponent and normalizes denormals. Infinities and
+        // NaNs come out as large finite values, which every caller clamps.
+        const __m128 value = _mm_mul_ps(_mm_castsi128_ps(magnitude), _mm_castsi128_ps(_mm_set1_epi32(0x77800000)));
+        return _mm_or_ps(value, _mm_castsi128_ps(sign));
+    }
+
+    // Four RGBA half pixels -> planar R, G, B
+    inline void LoadScRgb4(const uint8_t* src, __m128& r, __m128& g, __m128& b)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i p01 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        const __m128i p23 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+
+        __m128 p0 = HalfToFloat4(_mm_unpacklo_epi16(p01, zero));
+        __m128 p1 = HalfToFloat4(_mm_unpackhi_epi16(p01, zero));
+        __m128 p2 = HalfToFloat4(_mm_unpacklo_epi16(p23, zero));
+        __m128 p3 = HalfToFloat4(_mm_unpackhi_epi16(p23, zero));
+        _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+
+        r = p0;
+        g = p1;
+        b = p2;
+    }
+
+    // SSE2 has no gather: one 8-byte load per lane, then deinterleave starts and slopes
+    inline __m128 Lookup4(const FloatCurve& curve, __m128 x)
+    {
+        const __m128i bits = _mm_castps_si128(x);
+        alignas(16) int32_t index[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(index), _mm_srli_epi32(bits, FloatCurve::kShift));
+
+        const float* segments = curve.GetSegments();
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 s01 = _mm_loadh_pi(_mm_loadl_pi(zero, reinterpret_cast<const __m64*>(segments + index[0] * 2)),
+                                        reinterpret_cast<const __m64*>(segments + index[1] * 2));
+        const __m128 s23 = _mm_loadh_pi(_mm_loadl_pi(zero, reinterpret_cast<const __m64*>(segments + index[2] * 2)),
+                                        reinterpret_cast<const __m64*>(segments + index[3] * 2));
+        const __m128 start = _mm_shuffle_ps(s01, s23, _MM_SHUFFLE(2, 0, 2, 0));
+        const __m128 slope = _mm_shuffle_ps(s01, s23, _MM_SHUFFLE(3, 1, 3, 1));
+        const __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(bits, _mm_set1_epi32(FloatCurve::kMask))),
+                                    _mm_set1_ps(1.0f / (FloatCurve::kMask + 1)));
+
+        return _mm_add_ps(start, _mm_mul_ps(slope, t));
+    }
+
+    inline __m128 Dot3(const float m[3], __m128 r, __m128 g, __m128 b)
+    {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0]), r), _mm_mul_ps(_mm_set1_ps(m[1]), g)), _mm_mul_ps(_mm_set1_ps(m[2]), b));
+    }
+
+    inline void EncodePq4(const FloatCurve& pq, const uint8_t* src, __m128& r, __m128& g, __m128& b)
+    {
+        __m128 r709, g709, b709;
+        LoadScRgb4(src, r709, g709, b709);
+
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 max = _mm_set1_ps(kScRgbMax);
+
+        // max_ps returns the second operand for NaN, so NaNs end up black
+        r = Lookup4(pq, _mm_min_ps(_mm_max_ps(Dot3(kToBt2020[0], r709, g709, b709), zero), max));
+        g = Lookup4(pq, _mm_min_ps(_mm_max_ps(Dot3(kToBt2020[1], r709, g709, b709), zero), max));
+        b = Lookup4(pq, _mm_min_ps(_mm_max_ps(Dot3(kToBt2020[2], r709, g709, b709), zero), max));
+    }
+
+    // code + 0.5 truncated, as 10-bit samples in the high bits of 16
+    inline __m128i ToP010x4(__m128 code)
+    {
+        const __m128i value = _mm_cvttps_epi32(_mm_add_ps(code, _mm_set1_ps(0.5f)));
+        return _mm_slli_epi16(_mm_packs_epi32(value, value), 6);
+    }
+#endif
+}
+
+namespace HdrKernels
+{
+    float HalfToFloat(uint16_t value)
+    {
+        const uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+        uint32_t magnitude = static_cast<uint32_t>(value & 0x7FFF) << 13;
+
+        float result;
+        if ((value & 0x7C00) == 0x7C00)
+        {
+            magnitude |= 0x7F800000;
+            std::memcpy(&result, &magnitude, sizeof(result));
+        }
+        else
+        {
+            std::memcpy(&result, &magnitude, sizeof(result));
+            result *= 5.192296858534828e33f;    // 2^112
+        }
+
+        uint32_t bits;
+        std::memcpy(&bits, &result, sizeof(bits));
+        bits |= sign;
+        std::memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    uint16_t FloatToHalf(float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+        bits &= 0x7FFFFFFF;
+
+        if (bits >= 0x47800000)
+        {
+            return sign | (bits > 0x7F800000 ? 0x7E00 : 0x7C00);
+        }
+
+        if (bits < 0x38800000)
+        {
+            // Denormal: adding 0.5 lines the mantissa up with the half's and rounds it
+            float denormal;
+            std::memcpy(&denormal, &bits, sizeof(denormal));
+            denormal += 0.5f;
+            std::memcpy(&bits, &denormal, sizeof(bits));
+            return sign | static_cast<uint16_t>(bits - 0x3F000000);
+        }
+
+        const uint32_t odd = (bits >> 13) & 1;
+        bits += 0xC8000FFF + odd;   // Rebias the exponent, round half to even
+        return sign | static_cast<uint16_t>(bits >> 13);
+    }
+
+    void ConvertScRgbToP010(const uint8_t* src, ptrdiff_t src_pitch, int width, int height,
+                            uint8_t* dst_y, ptrdiff_t y_pitch, uint8_t* dst_uv, ptrdiff_t uv_pitch)
+    {
+        const FloatCurve& pq = GetPqCurve();
+
+        for (int y = 0; y < height; y += 2)
+        {
+            const uint8_t* row0 = src + y * src_pitch;
+            const uint8_t* row1 = row0 + src_pitch;
+            uint16_t* y_row0 = reinterpret_cast<uint16_t*>(dst_y + y * y_pitch);
+            uint16_t* y_row1 = reinterpret_cast<uint16_t*>(dst_y + (y + 1) * y_pitch);
+            uint16_t* uv_row = reinterpret_cast<uint16_t*>(dst_uv + (y / 2) * uv_pitch);
+
+            int x = 0;
+
+#ifdef HDR_KERNELS_SSE2
+            const __m128 luma_scale = _mm_set1_ps(876.0f);
+            const __m128 luma_offset = _mm_set1_ps(64.0f);
+            const __m128 chroma_scale = _mm_set1_ps(896.0f);
+            const __m128 chroma_offset = _mm_set1_ps(512.0f);
+            const float luma[3] = { kLumaR, kLumaG, kLumaB };
+            const __m128 even_lanes = _mm_castsi128_ps(_mm_setr_epi32(-1, 0, -1, 0));
+
+            for (; x + 4 <= width; x += 4)
+            {
+                __m128 r0, g0, b0, r1, g1, b1;
+                EncodePq4(pq, row0 + x * 8, r0, g0, b0);
+                EncodePq4(pq, row1 + x * 8, r1, g1, b1);
+
+                const __m128 luma0 = _mm_add_ps(_mm_mul_ps(Dot3(luma, r0, g0, b0), luma_scale), luma_offset);
+                const __m128 luma1 = _mm_add_ps(_mm_mul_ps(Dot3(luma, r1, g1, b1), luma_scale), luma_offset);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(y_row0 + x), ToP010x4(luma0));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(y_row1 + x), ToP010x4(luma1));
+
+                // 2x2 averages as [block0, block0, block1, block1]
+                const __m128 quarter = _mm_set1_ps(0.25f);
+                __m128 r = _mm_add_ps(r0, r1);
+                __m128 g = _mm_add_ps(g0, g1);
+                __m128 b = _mm_add_ps(b0, b1);
+                r = _mm_mul_ps(_mm_add_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(2, 2, 0, 0)), _mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 1, 1))), quarter);
+                g = _mm_mul_ps(_mm_add_ps(_mm_shuffle_ps(g, g, _MM_SHUFFLE(2, 2, 0, 0)), _mm_shuffle_ps(g, g, _MM_SHUFFLE(3, 3, 1, 1))), quarter);
+                b = _mm_mul_ps(_mm_add_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 0, 0)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 1, 1))), quarter);
+
+                const __m128 block_luma = Dot3(luma, r, g, b);
+                const __m128 cb = _mm_mul_ps(_mm_sub_ps(b, block_luma), _mm_set1_ps(kCbScale));
+                const __m128 cr = _mm_mul_ps(_mm_sub_ps(r, block_luma), _mm_set1_ps(kCrScale));
+                const __m128 cbcr = _mm_or_ps(_mm_and_ps(even_lanes, cb), _mm_andnot_ps(even_lanes, cr));
+
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(uv_row + x), ToP010x4(_mm_add_ps(_mm_mul_ps(cbcr, chroma_scale), chroma_offset)));
+            }
+#endif
+
+            for (; x < width; x += 2)
+            {
+                const uint8_t* pixels[4] = { row0 + x * 8, row0 + x * 8 + 8, row1 + x * 8, row1 + x * 8 + 8 };
+                float sum[3] = { 0.0f, 0.0f, 0.0f };
+                float rgb[4][3];
+
+                for (int i = 0; i < 4; ++i)
+                {
+                    EncodePixelPq(pq, pixels[i], rgb[i]);
+                    const float luma = kLumaR * rgb[i][0] + kLumaG * rgb[i][1] + kLumaB * rgb[i][2];
+                    (i < 2 ? y_row0 : y_row1)[x + (i & 1)] = ToP010(luma * 876.0f + 64.0f);
+                }
+
+                // Same summation order as the vector path: rows first, then the pair
+                for (int c = 0; c < 3; ++c)
+                {
+                    sum[c] = ((rgb[0][c] + rgb[2][c]) + (rgb[1][c] + rgb[3][c])) * 0.25f;
+                }
+
+                const float block_luma = kLumaR * sum[0] + kLumaG * sum[1] + kLumaB * sum[2];
+                uv_row[x] = ToP010((sum[2] - block_luma) * kCbScale * 896.0f + 512.0f);
+                uv_row[x + 1] = ToP010((sum[0] - block_luma) * kCrScale * 896.0f + 512.0f);
+            }
+        }
+    }
+
+    void ConvertScRgbToP010Region(const uint8_t* src, ptrdiff_t src_pitch, uint8_t* dst_y, ptrdiff_t y_pitch,
+                                  uint8_t* dst_uv, ptrdiff_t uv_pitch, const DirtyRegion& region)
+    {
+        const DirtyRegion aligned = region.Aligned(2);
+        for (const DirtyRect& rect : aligned.GetRects())
+        {
+            ConvertScRgbToP010(src + rect.y * src_pitch + static_cast<ptrdiff_t>(rect.x) * 8, src_pitch, rect.width, rect.height,
+                               dst_y + rect.y * y_pitch + static_cast<ptrdiff_t>(rect.x) * 2, y_pitch,
+                               dst_uv + rect.y / 2 * uv_pitch + static_cast<ptrdiff_t>(rect.x) * 2, uv_pitch);
+        }
+    }
+
+    void ToneMapScRgbToBgra(const uint8_t* src, ptrdiff_t src_pitch, int width, int height,
+                            uint8_t* dst, ptrdiff_t dst_pitch, float white_nits, float peak_nits)
+    {
+        const FloatCurve& srgb = GetSrgbCurve();
+        const ToneCurve curve = MakeToneCurve(white_nits, peak_nits);
+
+        for (int y = 0; y < height; ++y)
+        {
+            const uint8_t* in = src + y * src_pitch;
+            uint32_t* out = reinterpret_cast<uint32_t*>(dst + y * dst_pitch);
+            int x = 0;
+
+#ifdef HDR_KERNELS_SSE2
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128 half = _mm_set1_ps(0.5f);
+            const __m128 scale = _mm_set1_ps(curve.scale);
+            const __m128 knee = _mm_set1_ps(curve.knee);
+
+            for (; x + 4 <= width; x += 4)
+            {
+                __m128 r, g, b;
+                LoadScRgb4(in + x * 8, r, g, b);
+                r = _mm_max_ps(_mm_mul_ps(r, scale), zero);
+                g = _mm_max_ps(_mm_mul_ps(g, scale), zero);
+                b = _mm_max_ps(_mm_mul_ps(b, scale), zero);
+
+                const __m128 peak = _mm_max_ps(_mm_max_ps(r, g), b);
+                const __m128 t = _mm_mul_ps(_mm_max_ps(_mm_sub_ps(peak, knee), zero), _mm_set1_ps(curve.inverse_range));
+                const __m128 shape = _mm_div_ps(_mm_mul_ps(t, _mm_add_ps(one, _mm_mul_ps(t, _mm_set1_ps(curve.inverse_q2)))), _mm_add_ps(one, t));
+                const __m128 rolled = _mm_add_ps(knee, _mm_mul_ps(_mm_set1_ps(curve.range), shape));
+                const __m128 above = _mm_cmpgt_ps(peak, knee);
+                const __m128 mapped = _mm_or_ps(_mm_and_ps(above, rolled), _mm_andnot_ps(above, peak));
+                const __m128 ratio = _mm_div_ps(mapped, _mm_max_ps(peak, _mm_set1_ps(1e-20f)));
+
+                const __m128i red = _mm_cvttps_epi32(_mm_add_ps(Lookup4(srgb, _mm_min_ps(_mm_mul_ps(r, ratio), one)), half));
+                const __m128i green = _mm_cvttps_epi32(_mm_add_ps(Lookup4(srgb, _mm_min_ps(_mm_mul_ps(g, ratio), one)), half));
+                const __m128i blue = _mm_cvttps_epi32(_mm_add_ps(Lookup4(srgb, _mm_min_ps(_mm_mul_ps(b, ratio), one)), half));
+
+                __m128i bgra = _mm_or_si128(blue, _mm_slli_epi32(green, 8));
+                bgra = _mm_or_si128(bgra, _mm_or_si128(_mm_slli_epi32(red, 16), _mm_set1_epi32(static_cast<int32_t>(0xFF000000u))));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), bgra);
+            }
+#endif
+
+            for (; x < width; ++x)
+            {
+                out[x] = ToneMapPixel(srgb, curve, in + x * 8);
+            }
+        }
+    }
+
+    void ToneMapScRgbToBgraRegion(const uint8_t* src, ptrdiff_t src_pitch, uint8_t* dst, ptrdiff_t dst_pitch,
+                                  float white_nits, float peak_nits, const DirtyRegion& region)
+    {
+        for (const DirtyRect& rect : region.GetRects())
+        {
+            ToneMapScRgbToBgra(src + rect.y * src_pitch + static_cast<ptrdiff_t>(rect.x) * 8, src_pitch, rect.width, rect.height,
+                               dst + rect.y * dst_pitch + static_cast<ptrdiff_t>(rect.x) * 4, dst_pitch, white_nits, peak_nits);
+        }
+    }
+
+    void ConvertBgraToScRgb(const uint8_t* src, ptrdiff_t src_pitch, int width, int height,
+                            uint8_t* dst, ptrdiff_t dst_pitch, float gain)
+    {
+        uint16_t decode[256];
+        for (int i = 0; i < 256; ++i)
+        {
+            const double v = i / 255.0;
+            const double linear = v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4);
+            decode[i] = FloatToHalf(static_cast<float>(linear * gain));
+        }
+
+        for (int y = 0; y < height; ++y)
+        {
+            const uint8_t* in = src + y * src_pitch;
+            uint16_t* out = reinterpret_cast<uint16_t*>(dst + y * dst_pitch);
+
+            for (int x = 0; x < width; ++x, in += 4, out += 4)
+            {
+                out[0] = decode[in[2]];
+                out[1] = decode[in[1]];
+                out[2] = decode[in[0]];
+                out[3] = FloatToHalf(in[3] * (1.0f / 255.0f));
+            }
+        }
+    }
+}
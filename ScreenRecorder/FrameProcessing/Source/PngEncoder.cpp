@@ -0,0 +1,772 @@
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include "PngEncoder.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define PNG_ENCODER_SSE2 1
+#endif
+
+namespace
+{
+    constexpr int kBytesPerPixel = 3;
+    constexpr size_t kRowPadding = 16;          // Zeros left of each row, so x - 3 can be loaded as a vector
+    constexpr int kFilterCount = 5;             // None, Sub, Up, Average, Paeth
+
+    constexpr int kHashBits = 16;
+    constexpr uint32_t kWindow = 32768;
+    constexpr uint32_t kMinMatch = 4;
+    constexpr uint32_t kMaxMatch = 258;
+    constexpr size_t kBlockTokens = 1 << 16;
+
+    constexpr int kLitLenCodes = 286;
+    constexpr int kDistanceCodes = 30;
+    constexpr int kCodeLengthCodes = 19;
+    constexpr int kEndOfBlock = 256;
+
+    constexpr uint16_t kLengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    constexpr uint8_t kLengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    constexpr uint16_t kDistanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    constexpr uint8_t kDistanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    constexpr uint8_t kCodeLengthOrder[kCodeLengthCodes] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    struct CodeTables
+    {
+        uint8_t length_code[kMaxMatch + 1];     // Match length -> index into kLengthBase
+        uint8_t distance_code[512];             // Distance - 1 below 256, else 256 + ((distance - 1) >> 7)
+        uint32_t crc[256];
+
+        CodeTables()
+        {
+            for (int code = 0; code < 29; ++code)
+            {
+                for (int length = kLengthBase[code]; length < kLengthBase[code] + (1 << kLengthExtra[code]) && length <= static_cast<int>(kMaxMatch); ++length)
+                {
+                    length_code[length] = static_cast<uint8_t>(code);
+                }
+            }
+            // 258 has a code of its own rather than being 227 + 31
+            length_code[kMaxMatch] = 28;
+
+            for (int code = 0; code < kDistanceCodes; ++code)
+            {
+                for (int distance = kDistanceBase[code]; distance < kDistanceBase[code] + (1 << kDistanceExtra[code]); ++distance)
+                {
+                    const int d = distance - 1;
+                    distance_code[d < 256 ? d : 256 + (d >> 7)] = static_cast<uint8_t>(code);
+                }
+            }
+
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t value = i;
+                for (int bit = 0; bit < 8; ++bit) value = value & 1 ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+                crc[i] = value;
+            }
+        }
+    };
+
+    const CodeTables& GetTables()
+    {
+        static const CodeTables tables;
+        return tables;
+    }
+
+    int GetDistanceCode(const CodeTables& tables, uint32_t distance)
+    {
+        const uint32_t d = distance - 1;
+        return tables.distance_code[d < 256 ? d : 256 + (d >> 7)];
+    }
+
+    uint32_t Load32(const uint8_t* data)
+    {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    uint64_t Load64(const uint8_t* data)
+    {
+        uint64_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    uint32_t Hash(uint32_t value)
+    {
+        return (value * 2654435761u) >> (32 - kHashBits);
+    }
+
+    void AppendBe32(std::vector<uint8_t>& out, uint32_t value)
+    {
+        const uint8_t bytes[4] = { static_cast<uint8_t>(value >> 24), static_cast<uint8_t>(value >> 16), static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value) };
+        out.insert(out.end(), bytes, bytes + 4);
+    }
+
+    void AppendChunk(std::vector<uint8_t>& png, const char* type, const uint8_t* data, size_t size)
+    {
+        AppendBe32(png, static_cast<uint32_t>(size));
+        const size_t type_offset = png.size();
+        png.insert(png.end(), type, type + 4);
+        if (size > 0) png.insert(png.end(), data, data + size);
+        AppendBe32(png, PngEncoder::Crc32(0, png.data() + type_offset, size + 4));
+    }
+
+    // LSB-first, as deflate packs its bits. output is grown as needed and trimmed by Finish.
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(std::vector<uint8_t>& output) : output_(output), size_(output.size()) {}
+
+        // count <= 32
+        void Put(uint32_t value, int count)
+        {
+            accumulator_ |= static_cast<uint64_t>(value) << bits_;
+            bits_ += count;
+            if (bits_ >= 32)
+            {
+                Reserve(4);
+                uint8_t* out = output_.data() + size_;
+                out[0] = static_cast<uint8_t>(accumulator_);
+                out[1] = static_cast<uint8_t>(accumulator_ >> 8);
+                out[2] = static_cast<uint8_t>(accumulator_ >> 16);
+                out[3] = static_cast<uint8_t>(accumulator_ >> 24);
+                size_ += 4;
+                accumulator_ >>= 32;
+                bits_ -= 32;
+            }
+        }
+
+        void AlignToByte()
+        {
+            Reserve(4);
+            while (bits_ > 0)
+            {
+                output_[size_++] = static_cast<uint8_t>(accumulator_);
+                accumulator_ >>= 8;
+                bits_ = std::max(0, bits_ - 8);
+            }
+            accumulator_ = 0;
+        }
+
+        void Finish()
+        {
+            AlignToByte();
+            output_.resize(size_);
+        }
+
+    private:
+        void Reserve(size_t bytes)
+        {
+            if (size_ + bytes > output_.size()) output_.resize(std::max(output_.size() * 2, size_ + 4096));
+        }
+
+        std::vector<uint8_t>& output_;
+        size_t size_;
+        uint64_t accumulator_ = 0;
+        int bits_ = 0;
+    };
+
+    // Deflate's code lengths must be complete trees, which needs two used symbols
+    void EnsureTwoSymbols(uint32_t* frequencies, int count)
+    {
+        int used = 0;
+        for (int i = 0; i < count; ++i) used += frequencies[i] ? 1 : 0;
+        for (int i = 0; i < count && used < 2; ++i)
+        {
+            if (!frequencies[i])
+            {
+                frequencies[i] = 1;
+                ++used;
+            }
+        }
+    }
+
+    // Huffman code lengths of at most limit bits. When the tree comes out too deep the frequencies
+    // are halved and it is built again, which costs little against optimal length limiting.
+    void BuildCodeLengths(const uint32_t* frequencies, int count, int limit, uint8_t* lengths)
+    {
+        uint32_t weights[kLitLenCodes];
+        int symbols[kLitLenCodes];
+        uint64_t node_weights[2 * kLitLenCodes];
+        int parents[2 * kLitLenCodes];
+        int depths[2 * kLitLenCodes];
+        std::copy(frequencies, frequencies + count, weights);
+
+        for (;;)
+        {
+            int used = 0;
+            for (int i = 0; i < count; ++i)
+            {
+                lengths[i] = 0;
+                if (weights[i]) symbols[used++] = i;
+            }
+            std::sort(symbols, symbols + used, [&](int a, int b) { return weights[a] < weights[b] || (weights[a] == weights[b] && a < b); });
+
+            // Two queues: the sorted leaves, and internal nodes, which are made in increasing weight
+            for (int i = 0; i < used; ++i) node_weights[i] = weights[symbols[i]];
+            int leaf = 0;
+            int internal = used;
+            auto take = [&](int next) { return leaf < used && (internal >= next || node_weights[leaf] <= node_weights[internal]) ? leaf++ : internal++; };
+            for (int next = used; next < 2 * used - 1; ++next)
+            {
+                const int a = take(next);
+                const int b = take(next);
+                node_weights[next] = node_weights[a] + node_weights[b];
+                parents[a] = next;
+                parents[b] = next;
+            }
+
+            const int root = 2 * used - 2;
+            depths[root] = 0;
+            int max_length = 0;
+            for (int node = root - 1; node >= 0; --node)
+            {
+                depths[node] = depths[parents[node]] + 1;
+                if (node < used) max_length = std::max(max_length, depths[node]);
+            }
+            for (int i = 0; i < used; ++i) lengths[symbols[i]] = static_cast<uint8_t>(depths[i]);
+            if (max_length <= limit) return;
+
+            for (int i = 0; i < count; ++i)
+            {
+                if (weights[i]) weights[i] = (weights[i] + 1) / 2;
+            }
+        }
+    }
+
+    // Canonical codes, bit-reversed for LSB-first output
+    void BuildCodes(const uint8_t* lengths, int count, uint16_t* codes)
+    {
+        int length_counts[16] = {};
+        for (int i = 0; i < count; ++i) ++length_counts[lengths[i]];
+        length_counts[0] = 0;
+
+        int next_codes[16] = {};
+        int code = 0;
+        for (int bits = 1; bits < 16; ++bits)
+        {
+            code = (code + length_counts[bits - 1]) << 1;
+            next_codes[bits] = code;
+        }
+
+        for (int i = 0; i < count; ++i)
+        {
+            const int length = lengths[i];
+            if (length == 0) continue;
+
+            uint32_t value = static_cast<uint32_t>(next_codes[length]++);
+            uint32_t reversed = 0;
+            for (int bit = 0; bit < length; ++bit)
+            {
+                reversed = (reversed << 1) | (value & 1);
+                value >>= 1;
+            }
+            codes[i] = static_cast<uint16_t>(reversed);
+        }
+    }
+
+    // Tokens are a literal (0-255) or 256 + length - 3 in the low 9 bits, and the distance above
+    void WriteBlock(BitWriter& writer, const uint32_t* tokens, size_t count, uint32_t* litlen_frequencies, uint32_t* distance_frequencies, bool is_final)
+    {
+        const CodeTables& tables = GetTables();
+
+        litlen_frequencies[kEndOfBlock] = 1;
+        EnsureTwoSymbols(litlen_frequencies, kLitLenCodes);
+        EnsureTwoSymbols(distance_frequencies, kDistanceCodes);
+
+        uint8_t litlen_lengths[kLitLenCodes];
+        uint8_t distance_lengths[kDistanceCodes];
+        uint16_t litlen_codes[kLitLenCodes];
+        uint16_t distance_codes[kDistanceCodes];
+        BuildCodeLengths(litlen_frequencies, kLitLenCodes, 15, litlen_lengths);
+        BuildCodeLengths(distance_frequencies, kDistanceCodes, 15, distance_lengths);
+        BuildCodes(litlen_lengths, kLitLenCodes, litlen_codes);
+        BuildCodes(distance_lengths, kDistanceCodes, distance_codes);
+
+        int litlen_count = kLitLenCodes;
+        while (litlen_count > 257 && litlen_lengths[litlen_count - 1] == 0) --litlen_count;
+        int distance_count = kDistanceCodes;
+        while (distance_count > 1 && distance_lengths[distance_count - 1] == 0) --distance_count;
+
+        // Both length tables run-length coded with the code length alphabet (16 repeats, 17/18 zeros)
+        uint8_t all_lengths[kLitLenCodes + kDistanceCodes];
+        std::copy(litlen_lengths, litlen_lengths + litlen_count, all_lengths);
+        std::copy(distance_lengths, distance_lengths + distance_count, all_lengths + litlen_count);
+        const int all_count = litlen_count + distance_count;
+
+        uint8_t runs[kLitLenCodes + kDistanceCodes];
+        uint8_t run_extras[kLitLenCodes + kDistanceCodes];
+        int run_count = 0;
+        uint32_t code_length_frequencies[kCodeLengthCodes] = {};
+        auto emit = [&](int symbol, int extra)
+        {
+            runs[run_count] = static_cast<uint8_t>(symbol);
+            run_extras[run_count++] = static_cast<uint8_t>(extra);
+            ++code_length_frequencies[symbol];
+        };
+
+        for (int i = 0; i < all_count;)
+        {
+            const uint8_t length = all_lengths[i];
+            int run = 1;
+            while (i + run < all_count && all_lengths[i + run] == length) ++run;
+            i += run;
+
+            if (length == 0)
+            {
+                while (run >= 11)
+                {
+                    const int repeat = std::min(run, 138);
+                    emit(18, repeat - 11);
+                    run -= repeat;
+                }
+                if (run >= 3)
+                {
+                    emit(17, run - 3);
+                    run = 0;
+                }
+            }
+            else
+            {
+                emit(length, 0);
+                --run;
+                while (run >= 3)
+                {
+                    const int repeat = std::min(run, 6);
+                    emit(16, repeat - 3);
+                    run -= repeat;
+                }
+            }
+            while (run-- > 0) emit(length, 0);
+        }
+
+        EnsureTwoSymbols(code_length_frequencies, kCodeLengthCodes);
+        uint8_t code_length_lengths[kCodeLengthCodes];
+        uint16_t code_length_codes[kCodeLengthCodes];
+        BuildCodeLengths(code_length_frequencies, kCodeLengthCodes, 7, code_length_lengths);
+        BuildCodes(code_length_lengths, kCodeLengthCodes, code_length_codes);
+
+        int code_length_count = kCodeLengthCodes;
+        while (code_length_count > 4 && code_length_lengths[kCodeLengthOrder[code_length_count - 1]] == 0) --code_length_count;
+
+        writer.Put(is_final ? 1 : 0, 1);
+        writer.Put(2, 2);
+        writer.Put(litlen_count - 257, 5);
+        writer.Put(distance_count - 1, 5);
+        writer.Put(code_length_count - 4, 4);
+        for (int i = 0; i < code_length_count; ++i) writer.Put(code_length_lengths[kCodeLengthOrder[i]], 3);
+
+        for (int i = 0; i < run_count; ++i)
+        {
+            const int symbol = runs[i];
+            writer.Put(code_length_codes[symbol], code_length_lengths[symbol]);
+            if (symbol == 16) writer.Put(run_extras[i], 2);
+            else if (symbol == 17) writer.Put(run_extras[i], 3);
+            else if (symbol == 18) writer.Put(run_extras[i], 7);
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const uint32_t token = tokens[i];
+            const uint32_t symbol = token & 0x1FF;
+            if (symbol < 256)
+            {
+                writer.Put(litlen_codes[symbol], litlen_lengths[symbol]);
+                continue;
+            }
+
+            // Code and extra bits in one go: at most 15 + 5 and 15 + 13 bits
+            const uint32_t length = symbol - 256 + 3;
+            const int length_code = tables.length_code[length];
+            const int length_symbol = 257 + length_code;
+            writer.Put(litlen_codes[length_symbol] | ((length - kLengthBase[length_code]) << litlen_lengths[length_symbol]),
+                       litlen_lengths[length_symbol] + kLengthExtra[length_code]);
+
+            const uint32_t distance = token >> 9;
+            const int distance_code = GetDistanceCode(tables, distance);
+            writer.Put(distance_codes[distance_code] | ((distance - kDistanceBase[distance_code]) << distance_lengths[distance_code]),
+                       distance_lengths[distance_code] + kDistanceExtra[distance_code]);
+        }
+        writer.Put(litlen_codes[kEndOfBlock], litlen_lengths[kEndOfBlock]);
+    }
+
+    void ConvertBgraRowToRgb(const uint8_t* bgra, int width, uint8_t* rgb)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            rgb[0] = bgra[2];
+            rgb[1] = bgra[1];
+            rgb[2] = bgra[0];
+            bgra += 4;
+            rgb += 3;
+        }
+    }
+
+    uint8_t PaethPredict(int a, int b, int c)
+    {
+        const int pa = std::abs(b - c);
+        const int pb = std::abs(a - c);
+        const int pc = std::abs(a + b - 2 * c);
+        return static_cast<uint8_t>(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+    }
+
+    uint32_t AbsResidual(uint8_t value)
+    {
+        return value < 128 ? value : 256 - value;
+    }
+
+#ifdef PNG_ENCODER_SSE2
+    __m128i Abs16(__m128i value)
+    {
+        return _mm_max_epi16(value, _mm_sub_epi16(_mm_setzero_si128(), value));
+    }
+
+    // Paeth on 8 pixels' worth of 16-bit lanes
+    __m128i Paeth16(__m128i a, __m128i b, __m128i c)
+    {
+        const __m128i b_c = _mm_sub_epi16(b, c);
+        const __m128i a_c = _mm_sub_epi16(a, c);
+        const __m128i pa = Abs16(b_c);
+        const __m128i pb = Abs16(a_c);
+        const __m128i pc = Abs16(_mm_add_epi16(b_c, a_c));
+        const __m128i not_a = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+        const __m128i use_c = _mm_cmpgt_epi16(pb, pc);
+        const __m128i b_or_c = _mm_or_si128(_mm_andnot_si128(use_c, b), _mm_and_si128(use_c, c));
+        return _mm_or_si128(_mm_andnot_si128(not_a, a), _mm_and_si128(not_a, b_or_c));
+    }
+
+    __m128i SumAbsResiduals(__m128i residual)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        return _mm_sad_epu8(_mm_min_epu8(residual, _mm_sub_epi8(zero, residual)), zero);
+    }
+#endif
+
+    // Every filter of one row into candidates (kFilterCount rows of row_bytes), then the one with
+    // the smallest sum of absolute residuals into out, after its filter byte. raw and prior must
+    // have kBytesPerPixel zero bytes before them.
+    void FilterRow(const uint8_t* raw, const uint8_t* prior, size_t row_bytes, uint8_t* candidates, uint8_t* out)
+    {
+        uint8_t* none = candidates;
+        uint8_t* sub = candidates + row_bytes;
+        uint8_t* up = candidates + row_bytes * 2;
+        uint8_t* average = candidates + row_bytes * 3;
+        uint8_t* paeth = candidates + row_bytes * 4;
+        uint64_t sums[kFilterCount] = {};
+        size_t x = 0;
+
+#ifdef PNG_ENCODER_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one = _mm_set1_epi8(1);
+        __m128i totals[kFilterCount] = { zero, zero, zero, zero, zero };
+        for (; x + 16 <= row_bytes; x += 16)
+        {
+            const __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(raw + x));
+            const __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(raw + x - kBytesPerPixel));
+            const __m128i above = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prior + x));
+            const __m128i above_left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prior + x - kBytesPerPixel));
+
+            // pavgb rounds up; PNG's average rounds down
+            const __m128i mean = _mm_sub_epi8(_mm_avg_epu8(left, above), _mm_and_si128(_mm_xor_si128(left, above), one));
+            const __m128i predicted = _mm_packus_epi16(
+                Paeth16(_mm_unpacklo_epi8(left, zero), _mm_unpacklo_epi8(above, zero), _mm_unpacklo_epi8(above_left, zero)),
+                Paeth16(_mm_unpackhi_epi8(left, zero), _mm_unpackhi_epi8(above, zero), _mm_unpackhi_epi8(above_left, zero)));
+
+            const __m128i residuals[kFilterCount] =
+            {
+                current,
+                _mm_sub_epi8(current, left),
+                _mm_sub_epi8(current, above),
+                _mm_sub_epi8(current, mean),
+                _mm_sub_epi8(current, predicted),
+            };
+            for (int filter = 0; filter < kFilterCount; ++filter)
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(candidates + row_bytes * filter + x), residuals[filter]);
+                totals[filter] = _mm_add_epi64(totals[filter], SumAbsResiduals(residuals[filter]));
+            }
+        }
+        for (int filter = 0; filter < kFilterCount; ++filter)
+        {
+            alignas(16) uint64_t lanes[2];
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanes), totals[filter]);
+            sums[filter] = lanes[0] + lanes[1];
+        }
+#endif
+
+        for (; x < row_bytes; ++x)
+        {
+            const uint8_t current = raw[x];
+            const uint8_t left = raw[x - kBytesPerPixel];
+            const uint8_t above = prior[x];
+            const uint8_t above_left = prior[x - kBytesPerPixel];
+
+            none[x] = current;
+            sub[x] = static_cast<uint8_t>(current - left);
+            up[x] = static_cast<uint8_t>(current - above);
+            average[x] = static_cast<uint8_t>(current - ((left + above) >> 1));
+            paeth[x] = static_cast<uint8_t>(current - PaethPredict(left, above, above_left));
+            for (int filter = 0; filter < kFilterCount; ++filter) sums[filter] += AbsResidual(candidates[row_bytes * filter + x]);
+        }
+
+        int best = 0;
+        for (int filter = 1; filter < kFilterCount; ++filter)
+        {
+            if (sums[filter] < sums[best]) best = filter;
+        }
+        out[0] = static_cast<uint8_t>(best);
+        std::memcpy(out + 1, candidates + row_bytes * best, row_bytes);
+    }
+
+    uint32_t CombineAdler32(uint32_t first, uint32_t second, size_t second_size)
+    {
+        constexpr uint32_t kBase = 65521;
+        const uint32_t remainder = static_cast<uint32_t>(second_size % kBase);
+        uint32_t sum1 = first & 0xFFFF;
+        uint32_t sum2 = static_cast<uint32_t>((static_cast<uint64_t>(remainder) * sum1) % kBase);
+        sum1 += (second & 0xFFFF) + kBase - 1;
+        sum2 += (first >> 16) + (second >> 16) + kBase - remainder;
+        if (sum1 >= kBase) sum1 -= kBase;
+        if (sum1 >= kBase) sum1 -= kBase;
+        if (sum2 >= kBase << 1) sum2 -= kBase << 1;
+        if (sum2 >= kBase) sum2 -= kBase;
+        return sum1 | (sum2 << 16);
+    }
+
+    double ElapsedMs(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+PngEncoder::PngEncoder(int threads, std::function<void()> on_thread_start)
+    : threads_(threads > 0 ? threads : std::max(1, static_cast<int>(std::thread::hardware_concurrency()))),
+      on_thread_start_(std::move(on_thread_start))
+{
+}
+
+uint32_t PngEncoder::Crc32(uint32_t crc, const uint8_t* data, size_t size)
+{
+    const CodeTables& tables = GetTables();
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) crc = tables.crc[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t PngEncoder::Adler32(uint32_t adler, const uint8_t* data, size_t size)
+{
+    // The most bytes before the sums can overflow 32 bits
+    constexpr size_t kRun = 5552;
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+    while (size > 0)
+    {
+        const size_t run = std::min(size, kRun);
+        for (size_t i = 0; i < run; ++i)
+        {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += run;
+        size -= run;
+    }
+    return a | (b << 16);
+}
+
+bool PngEncoder::Encode(const FrameDescriptor& frame, std::vector<uint8_t>& png)
+{
+    if (!frame.IsValid() || frame.format != FrameFormat::Bgra) return false;
+
+    auto encode_start = std::chrono::steady_clock::now();
+    const int strip_count = std::min(threads_, frame.height);
+    strips_.resize(strip_count);
+    for (int i = 0; i < strip_count; ++i)
+    {
+        strips_[i].y_begin = static_cast<int>(static_cast<int64_t>(frame.height) * i / strip_count);
+        strips_[i].y_end = static_cast<int>(static_cast<int64_t>(frame.height) * (i + 1) / strip_count);
+    }
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < strip_count; ++i)
+    {
+        workers.emplace_back([this, &frame, i, strip_count]
+        {
+            if (on_thread_start_) on_thread_start_();
+            EncodeStrip(frame, strips_[i], false, i == strip_count - 1);
+        });
+    }
+    EncodeStrip(frame, strips_[0], true, strip_count == 1);
+    for (std::thread& worker : workers) worker.join();
+
+    png.clear();
+    const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    png.insert(png.end(), signature, signature + 8);
+
+    std::vector<uint8_t> header;
+    AppendBe32(header, static_cast<uint32_t>(frame.width));
+    AppendBe32(header, static_cast<uint32_t>(frame.height));
+    const uint8_t format[5] = { 8, 2, 0, 0, 0 };      // 8-bit RGB, deflate, adaptive filtering, no interlace
+    header.insert(header.end(), format, format + 5);
+    AppendChunk(png, "IHDR", header.data(), header.size());
+
+    stats_ = PngEncodeStats{};
+    stats_.strips = strip_count;
+    uint32_t adler = 1;
+    for (int i = 0; i < strip_count; ++i)
+    {
+        const Strip& strip = strips_[i];
+        png.insert(png.end(), strip.chunk.begin(), strip.chunk.end());
+        adler = i == 0 ? strip.adler : CombineAdler32(adler, strip.adler, strip.filtered.size());
+        stats_.filter_ms += strip.filter_ms;
+        stats_.deflate_ms += strip.deflate_ms;
+        stats_.raw_bytes += strip.filtered.size();
+    }
+
+    // The zlib trailer, after every strip's data
+    std::vector<uint8_t> trailer;
+    AppendBe32(trailer, adler);
+    AppendChunk(png, "IDAT", trailer.data(), trailer.size());
+    AppendChunk(png, "IEND", nullptr, 0);
+
+    stats_.png_bytes = png.size();
+    stats_.total_ms = ElapsedMs(encode_start);
+    return true;
+}
+
+void PngEncoder::EncodeStrip(const FrameDescriptor& frame, Strip& strip, bool is_first, bool is_last)
+{
+    const CodeTables& tables = GetTables();
+    auto filter_start = std::chrono::steady_clock::now();
+
+    const size_t row_bytes = static_cast<size_t>(frame.width) * kBytesPerPixel;
+    const size_t stride = row_bytes + 1;
+    const size_t padded_row = kRowPadding + row_bytes;
+    strip.filtered.resize(stride * (strip.y_end - strip.y_begin));
+    strip.candidates.resize(row_bytes * kFilterCount);
+    strip.rows.assign(padded_row * 2, 0);
+
+    // The row above the strip is filtered against too, so strips match a single-threaded encode
+    uint8_t* prior = strip.rows.data() + kRowPadding;
+    uint8_t* current = prior + padded_row;
+    if (strip.y_begin > 0)
+    {
+        ConvertBgraRowToRgb(frame.planes[0].data + (strip.y_begin - 1) * frame.planes[0].pitch, frame.width, prior);
+    }
+    for (int y = strip.y_begin; y < strip.y_end; ++y)
+    {
+        ConvertBgraRowToRgb(frame.planes[0].data + y * frame.planes[0].pitch, frame.width, current);
+        FilterRow(current, prior, row_bytes, strip.candidates.data(), strip.filtered.data() + (y - strip.y_begin) * stride);
+        std::swap(prior, current);
+    }
+    strip.adler = Adler32(1, strip.filtered.data(), strip.filtered.size());
+    strip.filter_ms = ElapsedMs(filter_start);
+
+    auto deflate_start = std::chrono::steady_clock::now();
+    strip.chunk.clear();
+    const uint8_t chunk_header[8] = { 0, 0, 0, 0, 'I', 'D', 'A', 'T' };
+    strip.chunk.insert(strip.chunk.end(), chunk_header, chunk_header + 8);
+    if (is_first)
+    {
+        // zlib header: deflate with a 32 KB window, fastest level
+        strip.chunk.push_back(0x78);
+        strip.chunk.push_back(0x01);
+    }
+
+    BitWriter writer(strip.chunk);
+    strip.hash_head.assign(size_t(1) << kHashBits, -1);
+    strip.tokens.resize(kBlockTokens);
+    uint32_t litlen_frequencies[kLitLenCodes] = {};
+    uint32_t distance_frequencies[kDistanceCodes] = {};
+    size_t token_count = 0;
+
+    const uint8_t* data = strip.filtered.data();
+    const size_t size = strip.filtered.size();
+    int32_t* head = strip.hash_head.data();
+    uint32_t* tokens = strip.tokens.data();
+    size_t position = 0;
+    while (position < size)
+    {
+        uint32_t length = 0;
+        uint32_t distance = 0;
+        if (position + kMinMatch <= size)
+        {
+            const uint32_t key = Load32(data + position);
+            const uint32_t hash = Hash(key);
+            const int32_t candidate = head[hash];
+            head[hash] = static_cast<int32_t>(position);
+
+            if (candidate >= 0 && position - candidate <= kWindow && Load32(data + candidate) == key)
+            {
+                const uint32_t max_length = static_cast<uint32_t>(std::min<size_t>(kMaxMatch, size - position));
+                length = kMinMatch;
+                while (length + 8 <= max_length)
+                {
+                    const uint64_t difference = Load64(data + position + length) ^ Load64(data + candidate + length);
+                    if (difference)
+                    {
+                        length += static_cast<uint32_t>(std::countr_zero(difference)) / 8;
+                        break;
+                    }
+                    length += 8;
+                }
+                if (length + 8 > max_length)
+                {
+                    while (length < max_length && data[position + length] == data[candidate + length]) ++length;
+                }
+                distance = static_cast<uint32_t>(position - candidate);
+            }
+        }
+
+        if (length >= kMinMatch)
+        {
+            tokens[token_count++] = (distance << 9) | (256 + length - 3);
+            ++litlen_frequencies[257 + tables.length_code[length]];
+            ++distance_frequencies[GetDistanceCode(tables, distance)];
+
+            // Positions inside the match are hashed too, except the middle of long runs
+            const size_t end = position + length;
+            const size_t insert_from = length <= 32 ? position + 1 : end - 16;
+            for (size_t p = insert_from; p < end && p + kMinMatch <= size; ++p) head[Hash(Load32(data + p))] = static_cast<int32_t>(p);
+            position = end;
+        }
+        else
+        {
+            tokens[token_count++] = data[position];
+            ++litlen_frequencies[data[position]];
+            ++position;
+        }
+
+        if (token_count == kBlockTokens)
+        {
+            WriteBlock(writer, tokens, token_count, litlen_frequencies, distance_frequencies, false);
+            token_count = 0;
+            std::fill(std::begin(litlen_frequencies), std::end(litlen_frequencies), 0u);
+            std::fill(std::begin(distance_frequencies), std::end(distance_frequencies), 0u);
+        }
+    }
+    WriteBlock(writer, tokens, token_count, litlen_frequencies, distance_frequencies, is_last);
+
+    if (!is_last)
+    {
+        // Empty stored block: ends the strip on a byte boundary without ending the stream
+        writer.Put(0, 3);
+        writer.AlignToByte();
+        writer.Put(0xFFFF0000u, 32);
+    }
+    writer.Finish();
+
+    const uint32_t data_size = static_cast<uint32_t>(strip.chunk.size() - 8);
+    strip.chunk[0] = static_cast<uint8_t>(data_size >> 24);
+    strip.chunk[1] = static_cast<uint8_t>(data_size >> 16);
+    strip.chunk[2] = static_cast<uint8_t>(data_size >> 8);
+    strip.chunk[3] = static_cast<uint8_t>(data_size);
+    AppendBe32(strip.chunk, Crc32(0, strip.chunk.data() + 4, strip.chunk.size() - 4));
+    strip.deflate_ms = ElapsedMs(deflate_start);
+}
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "FrameKernels.h"
+#include "QualityMetrics.h"
+
+void QualityTotals::Add(const QualityTotals& other)
+{
+    squared_error += other.squared_error;
+    samples += other.samples;
+    ssim_sum += other.ssim_sum;
+    ssim_windows += other.ssim_windows;
+}
+
+double QualityTotals::GetPsnr() const
+{
+    if (samples == 0 || squared_error == 0) return 100.0;
+
+    double mse = static_cast<double>(squared_error) / samples;
+    return std::min(100.0, 10.0 * std::log10(255.0 * 255.0 / mse));
+}
+
+double QualityTotals::GetSsim() const
+{
+    return ssim_windows ? ssim_sum / ssim_windows : 1.0;
+}
+
+void FrameQuality::Add(const FrameQuality& other)
+{
+    luma.Add(other.luma);
+    chroma.Add(other.chroma);
+    for (int i = 0; i < kContentClassCount; ++i)
+    {
+        luma_by_class[i].Add(other.luma_by_class[i]);
+    }
+}
+
+namespace QualityMetrics
+{
+    const char* GetClassName(ContentClass content_class)
+    {
+        switch (content_class)
+        {
+        case ContentClass::Flat: return "flat";
+        case ContentClass::Text: return "text";
+        default: return "image";
+        }
+    }
+
+    void ClassifyTiles(const uint8_t* luma, ptrdiff_t pitch, int width, int height, ContentClass* classes)
+    {
+        const int tiles_x = (width + kClassTileSize - 1) / kClassTileSize;
+        const int tiles_y = (height + kClassTileSize - 1) / kClassTileSize;
+        uint16_t counts[256];
+
+        for (int tile_y = 0; tile_y < tiles_y; ++tile_y)
+        {
+            for (int tile_x = 0; tile_x < tiles_x; ++tile_x)
+            {
+                const int x0 = tile_x * kClassTileSize;
+                const int y0 = tile_y * kClassTileSize;
+                const int x1 = std::min(x0 + kClassTileSize, width);
+                const int y1 = std::min(y0 + kClassTileSize, height);
+
+                std::memset(counts, 0, sizeof(counts));
+                int low = 255;
+                int high = 0;
+                for (int y = y0; y < y1; ++y)
+                {
+                    const uint8_t* row = luma + y * pitch;
+                    for (int x = x0; x < x1; ++x)
+                    {
+                        ++counts[row[x]];
+                        low = std::min<int>(low, row[x]);
+                        high = std::max<int>(high, row[x]);
+                    }
+                }
+
+                // Text is a background and a foreground colour plus antialiasing; photos rarely
+                // repeat any single level that often
+                uint16_t first = 0;
+                uint16_t second = 0;
+                for (int level = low; level <= high; ++level)
+                {
+                    if (counts[level] > first)
+                    {
+                        second = first;
+                        first = counts[level];
+                    }
+                    else if (counts[level] > second)
+                    {
+                        second = counts[level];
+                    }
+                }
+
+                const int area = (x1 - x0) * (y1 - y0);
+                ContentClass& content_class = classes[tile_y * tiles_x + tile_x];
+                if (high - low < 12) content_class = ContentClass::Flat;
+                else if ((first + second) * 2 >= area) content_class = ContentClass::Text;
+                else content_class = ContentClass::Image;
+            }
+        }
+    }
+
+    void CompareNv12(const Nv12View& reference, const Nv12View& decoded, int width, int height,
+                     const ContentClass* classes, FrameQuality& quality)
+    {
+        const int tiles_x = (width + kClassTileSize - 1) / kClassTileSize;
+        const int tiles_y = (height + kClassTileSize - 1) / kClassTileSize;
+
+        // Luma MSE tile by tile, so every sample lands in its region
+        for (int tile_y = 0; tile_y < tiles_y; ++tile_y)
+        {
+            const int y0 = tile_y * kClassTileSize;
+            const int rows = std::min(kClassTileSize, height - y0);
+
+            for (int tile_x = 0; tile_x < tiles_x; ++tile_x)
+            {
+                const int x0 = tile_x * kClassTileSize;
+                const int columns = std::min(kClassTileSize, width - x0);
+
+                uint64_t squared_error = FrameKernels::SumSquaredDiff(reference.y + y0 * reference.y_pitch + x0, reference.y_pitch,
+                                                                      decoded.y + y0 * decoded.y_pitch + x0, decoded.y_pitch, columns, rows);
+                QualityTotals& region = quality.luma_by_class[static_cast<int>(classes[tile_y * tiles_x + tile_x])];
+                region.squared_error += squared_error;
+                region.samples += static_cast<uint64_t>(columns) * rows;
+                quality.luma.squared_error += squared_error;
+                quality.luma.samples += static_cast<uint64_t>(columns) * rows;
+            }
+        }
+
+        quality.chroma.squared_error += FrameKernels::SumSquaredDiff(reference.uv, reference.uv_pitch, decoded.uv, decoded.uv_pitch,
+                                                                     static_cast<size_t>(width / 2) * 2, height / 2);
+        quality.chroma.samples += static_cast<uint64_t>(width / 2) * 2 * (height / 2);
+
+        // 8-bit SSIM constants (K1 = 0.01, K2 = 0.03), scaled for sums over 64 samples
+        const double c1 = 0.01 * 255 * 0.01 * 255 * 64 * 64;
+        const double c2 = 0.03 * 255 * 0.03 * 255 * 64 * 64;
+
+        for (int y = 0; y + 8 <= height; y += 4)
+        {
+            for (int x = 0; x + 8 <= width; x += 4)
+            {
+                uint32_t moments[5];
+                FrameKernels::SsimMoments8x8(reference.y + y * reference.y_pitch + x, reference.y_pitch,
+                                             decoded.y + y * decoded.y_pitch + x, decoded.y_pitch, moments);
+
+                const double sum_a = moments[0];
+                const double sum_b = moments[1];
+                const double variance_a = 64.0 * moments[2] - sum_a * sum_a;
+                const double variance_b = 64.0 * moments[3] - sum_b * sum_b;
+                const double covariance = 64.0 * moments[4] - sum_a * sum_b;
+                const double ssim = ((2 * sum_a * sum_b + c1) * (2 * covariance + c2))
+                                  / ((sum_a * sum_a + sum_b * sum_b + c1) * (variance_a + variance_b + c2));
+
+                // A window belongs to the region under its centre
+                const int tile = ((y + 4) / kClassTileSize) * tiles_x + (x + 4) / kClassTileSize;
+                QualityTotals& region = quality.luma_by_class[static_cast<int>(classes[tile])];
+                region.ssim_sum += ssim;
+                ++region.ssim_windows;
+                quality.luma.ssim_sum += ssim;
+                ++quality.luma.ssim_windows;
+            }
+        }
+    }
+}
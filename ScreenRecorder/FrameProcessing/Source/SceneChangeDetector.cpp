@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <cstring>
+
+#include "FrameKernels.h"
+#include "SceneChangeDetector.h"
+
+SceneChangeDetector::SceneChangeDetector(const SceneChangeConfig& config)
+    : config_(config)
+{
+}
+
+void SceneChangeDetector::Reset()
+{
+    has_previous_ = false;
+    frames_since_keyframe_ = 0;
+    changed_since_keyframe_ = false;
+}
+
+SceneChangeResult SceneChangeDetector::Analyze(const uint8_t* image, ptrdiff_t pitch, int width, int height)
+{
+    SceneChangeResult result;
+
+    const int factor = std::clamp((width + kThumbnailWidth - 1) / kThumbnailWidth, 1, 16);
+    const int thumbnail_width = width / factor;
+    const int thumbnail_height = height / factor;
+
+    if (thumbnail_width != thumbnail_width_ || thumbnail_height != thumbnail_height_)
+    {
+        // New resolution: the encoder restarts with a keyframe anyway
+        thumbnail_width_ = thumbnail_width;
+        thumbnail_height_ = thumbnail_height;
+        Reset();
+    }
+
+    thumbnail_.resize(static_cast<size_t>(thumbnail_width) * thumbnail_height * 4);
+    FrameKernels::DownsampleBgraBox(image, pitch, width, height, factor, thumbnail_.data(), static_cast<ptrdiff_t>(thumbnail_width) * 4);
+
+    std::memset(histogram_, 0, sizeof(histogram_));
+    FrameKernels::LumaHistogram(image, pitch, width, height, 8, histogram_);
+
+    if (!has_previous_)
+    {
+        // The first frame is a keyframe by definition
+        result.change = SceneChange::Cut;
+        frames_since_keyframe_ = 0;
+        changed_since_keyframe_ = false;
+    }
+    else
+    {
+        uint64_t total = 0;
+        uint64_t distance = 0;
+        for (int i = 0; i < 64; ++i)
+        {
+            total += histogram_[i];
+            distance += histogram_[i] > previous_histogram_[i] ? histogram_[i] - previous_histogram_[i] : previous_histogram_[i] - histogram_[i];
+        }
+        result.histogram_distance = total ? distance / (2.0 * total) : 0.0;
+        result.mean_difference = thumbnail_.empty() ? 0.0
+            : static_cast<double>(FrameKernels::SumAbsDiff(thumbnail_.data(), previous_thumbnail_.data(), thumbnail_.size())) / thumbnail_.size();
+
+        if (result.mean_difference < config_.change_mean_difference)
+        {
+            result.change = SceneChange::Static;
+        }
+        else if ((result.histogram_distance > config_.cut_histogram_distance || result.mean_difference > config_.cut_mean_difference)
+                 && !IsScroll(result.mean_difference))
+        {
+            result.change = SceneChange::Cut;
+        }
+        else
+        {
+            result.change = SceneChange::Changed;
+        }
+
+        ++frames_since_keyframe_;
+        changed_since_keyframe_ = changed_since_keyframe_ || result.change != SceneChange::Static;
+
+        if (frames_since_keyframe_ >= config_.max_keyframe_interval)
+        {
+            // The encoder's GOP ends here on its own
+            frames_since_keyframe_ = 0;
+            changed_since_keyframe_ = false;
+        }
+        else if ((result.change == SceneChange::Cut && frames_since_keyframe_ >= config_.min_keyframe_interval)
+                 || (result.change == SceneChange::Static && changed_since_keyframe_ && frames_since_keyframe_ >= config_.active_keyframe_interval))
+        {
+            // After activity, refresh on the first settled frame: it is cheap to code and clears accumulated
+            // scroll artifacts. Untouched static stretches keep the encoder's long GOP.
+            result.force_keyframe = true;
+            frames_since_keyframe_ = 0;
+            changed_since_keyframe_ = false;
+        }
+    }
+
+    thumbnail_.swap(previous_thumbnail_);
+    std::memcpy(previous_histogram_, histogram_, sizeof(histogram_));
+    has_previous_ = true;
+
+    return result;
+}
+
+bool SceneChangeDetector::IsScroll(double mean_difference) const
+{
+    // thumbnail_ holds the current frame, previous_thumbnail_ the last one
+    const size_t row_bytes = static_cast<size_t>(thumbnail_width_) * 4;
+    const int max_shift = thumbnail_height_ / 4;
+    const double limit = mean_difference * config_.scroll_ratio;
+
+    for (int shift = 1; shift <= max_shift; ++shift)
+    {
+        const size_t overlap = (thumbnail_height_ - shift) * row_bytes;
+        const size_t offset = shift * row_bytes;
+
+        // Content moving up (scrolling down) or moving down
+        double up = static_cast<double>(FrameKernels::SumAbsDiff(thumbnail_.data(), previous_thumbnail_.data() + offset, overlap)) / overlap;
+        double down = static_cast<double>(FrameKernels::SumAbsDiff(thumbnail_.data() + offset, previous_thumbnail_.data(), overlap)) / overlap;
+        if (std::min(up, down) < limit) return true;
+    }
+    return false;
+}
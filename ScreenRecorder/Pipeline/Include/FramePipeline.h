@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "DirtyRegion.h"
+#include "FrameDescriptor.h"
+#include "FrameQueue.h"
+#include "FrameSink.h"
+#include "LatencyHistogram.h"
+#include "MemoryBudget.h"
+#include "PreviewTap.h"
+#include "SceneChangeDetector.h"
+#include "SharedFramePublisher.h"
+#include "SnapshotWriter.h"
+
+struct FramePipelineStats
+{
+    uint64_t frames_received = 0;
+    uint64_t frames_encoded = 0;
+    uint64_t frames_failed = 0;
+    uint64_t frames_dropped = 0;        // By backpressure, or for want of memory to scale back up
+    uint64_t frames_downscaled = 0;
+    uint64_t encode_ns = 0;             // In the sink, total
+    uint64_t max_encode_ns = 0;
+    uint64_t scene_cuts = 0;
+    uint64_t static_frames = 0;
+    uint64_t scene_detect_ns = 0;
+};
+
+// What happens to each frame between the capture callback and the sink, without the platform
+// around it. On the capture thread: tone-mapping, the preview tap and the frame queue. On the
+// encode thread (the capture thread without a queue): scaling a downscaled frame back up,
+// snapshots, shared frames, scene detection and the sink. ScreenRecorder calls it from its
+// threads; the bench runs the same calls on the synthetic source.
+class FramePipeline
+{
+public:
+    // The budget holds the tone-map buffer and upscaled frames
+    explicit FramePipeline(MemoryBudget& budget);
+
+    // Wiring, while no frames flow. Anything null is skipped; the caller keeps ownership.
+    void SetSink(FrameSink* sink) { sink_ = sink; }
+    // scRGB FP16 in, BGRA to everything downstream
+    void SetToneMap(bool enabled, float sdr_white_nits = 203.0f, float peak_nits = 1000.0f);
+    void SetPreviewTap(PreviewTap* preview_tap) { preview_tap_ = preview_tap; }
+    void SetSnapshotWriter(SnapshotWriter* snapshot_writer) { snapshot_writer_ = snapshot_writer; }
+    void SetSharedPublisher(SharedFramePublisher* shared_publisher) { shared_publisher_ = shared_publisher; }
+    // BGRA frames are analyzed before the sink, and request_keyframe called when one is due.
+    // An empty request_keyframe turns detection off.
+    void SetSceneDetection(const SceneChangeConfig& config, std::function<void()> request_keyframe);
+    // Also records latency here, e.g. for a tuner that resets it every window
+    void SetWindowLatency(LatencyHistogram* window_latency) { window_latency_ = window_latency; }
+
+    // Starts a recording. With a queue, the capture thread pushes and the encode thread calls
+    // EncodeQueued; without one, frames go to the sink from OnFrameCaptured. upscale_wait bounds
+    // how long the encode thread waits for memory to scale a downscaled frame back up.
+    void Start(FrameQueue* queue, std::chrono::milliseconds upscale_wait);
+
+    // Capture thread
+    void OnFrameCaptured(const FrameDescriptor& captured, const DirtyRegion& dirty);
+    // Encode thread, with each frame popped from the queue. Lets go of its pixels before returning.
+    void EncodeQueued(QueuedFrame& frame);
+
+    FramePipelineStats GetStats() const;
+    const LatencyHistogram& GetLatency() const { return latency_; }
+    void ResetStats();
+
+private:
+    void EncodeFrame(const FrameDescriptor& frame, const DirtyRegion& dirty);
+
+    MemoryBudget& budget_;
+    FrameSink* sink_ = nullptr;
+    PreviewTap* preview_tap_ = nullptr;
+    SnapshotWriter* snapshot_writer_ = nullptr;
+    SharedFramePublisher* shared_publisher_ = nullptr;
+    FrameQueue* queue_ = nullptr;
+    std::chrono::milliseconds upscale_wait_{ 0 };
+
+    bool tone_map_ = false;
+    float sdr_white_nits_ = 203.0f;
+    float peak_nits_ = 1000.0f;
+    std::vector<uint8_t> tone_mapped_;          // Patched in place from each frame's dirty region
+    MemoryBudget::Reservation tone_mapped_reservation_;
+
+    SceneChangeDetector scene_detector_;
+    std::function<void()> request_keyframe_;
+
+    // Capture thread: changed since the last frame the queue accepted
+    DirtyRegion pending_dirty_;
+    // Encode thread: the sink missed the previous frame, so the next one's dirty region is wrong
+    bool is_frame_missed_ = false;
+
+    LatencyHistogram latency_;                  // Capture callback to sink done
+    LatencyHistogram* window_latency_ = nullptr;
+    std::atomic<uint64_t> frames_received_{ 0 };
+    std::atomic<uint64_t> frames_encoded_{ 0 };
+    std::atomic<uint64_t> frames_failed_{ 0 };
+    std::atomic<uint64_t> frames_dropped_{ 0 };
+    std::atomic<uint64_t> frames_downscaled_{ 0 };
+    std::atomic<uint64_t> encode_ns_{ 0 };
+    std::atomic<uint64_t> max_encode_ns_{ 0 };
+    std::atomic<uint64_t> scene_cuts_{ 0 };
+    std::atomic<uint64_t> static_frames_{ 0 };
+    std::atomic<uint64_t> scene_detect_ns_{ 0 };
+};
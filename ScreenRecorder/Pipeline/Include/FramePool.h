@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "AlignedBuffer.h"
+#include "FrameDescriptor.h"
+#include "MemoryBudget.h"
+
+// Owning handle to a pooled frame buffer. Copies share the buffer; it goes back to its pool
+// when the last one is dropped, so a consumer that finishes late (an encoder still holding a
+// sample) keeps the pixels alive simply by keeping a copy. So does any budget reservation the
+// buffer was handed out with.
+using PooledFrame = std::shared_ptr<AlignedBuffer>;
+
+struct FramePoolStats
+{
+    uint64_t allocations = 0;       // Buffers made because none of the right size was free
+    uint64_t reuses = 0;
+    size_t outstanding = 0;         // Handed out and not yet back
+    uint64_t reserved_bytes = 0;    // Budget held by those, given back as they return
+    size_t free = 0;
+};
+
+// Reused frame-sized buffers, so steady-state capture makes no frame-sized allocations. Buffers are
+// page-aligned. Handles may outlive the pool; their buffers are then freed on release. With a
+// memory budget, buffers handed out are held against it and free ones are counted as cached.
+class FramePool
+{
+public:
+    // Up to max_free released buffers are kept, the oldest freed first
+    explicit FramePool(size_t max_free = 8);
+    ~FramePool();
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    // The budget has to outlive the pool and every handle. Buffers already handed out keep
+    // whatever they were acquired with.
+    void SetMemoryBudget(MemoryBudget* budget);
+    // Extra free buffers are freed as they come back
+    void SetMaxFree(size_t max_free);
+    // Makes sure count buffers of bytes, and handles for them, can be out at once without
+    // allocating; as many as max_free allows stay free
+    void Reserve(size_t bytes, size_t count);
+
+    // Contents are whatever the previous holder left. reservation is given back when the last
+    // handle to the buffer is dropped, not when the first consumer is done with it. Without one,
+    // the buffer is charged to the pool's budget, if it has one.
+    PooledFrame Acquire(size_t bytes, MemoryBudget::Reservation reservation = MemoryBudget::Reservation());
+    FramePoolStats GetStats() const;
+
+private:
+    struct Shared
+    {
+        ~Shared();
+
+        std::mutex mutex;
+        std::vector<std::unique_ptr<AlignedBuffer>> free;
+        size_t max_free = 0;
+        FramePoolStats stats;
+        bool is_closed = false;
+        MemoryBudget* budget = nullptr;         // Told about free buffers as cached
+
+        // Released handle control blocks, linked through their own storage, so handing out a
+        // handle allocates nothing once as many have been out at once as ever will be
+        void* free_blocks = nullptr;
+        size_t block_bytes = 0;
+    };
+
+    template <typename T>
+    friend class ControlBlockAllocator;
+
+    static void Return(const std::shared_ptr<Shared>& shared, AlignedBuffer* buffer, MemoryBudget* budget, uint64_t reserved);
+
+    std::shared_ptr<Shared> shared_;
+};
+
+// What a consumer that keeps a single-plane frame past the call (an encoder queueing samples)
+// holds on to: the frame's own buffer when it has an owner and packed rows, otherwise a buffer
+// from pool that the caller packs the rows into, which fill then points at.
+struct RetainedFrame
+{
+    std::shared_ptr<const void> owner;
+    const uint8_t* data = nullptr;
+    uint8_t* fill = nullptr;
+};
+
+RetainedFrame RetainFrame(const FrameDescriptor& frame, FramePool& pool);
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "DirtyRegion.h"
+#include "FrameDescriptor.h"
+#include "FramePool.h"
+#include "MemoryBudget.h"
+
+struct QueuedFrame
+{
+    PooledFrame pixels;                 // Tightly packed, stored_width x stored_height
+    FrameFormat format = FrameFormat::Bgra;
+    int width = 0;                      // Captured resolution
+    int height = 0;
+    int stored_width = 0;               // Smaller than width when downscaled under pressure
+    int stored_height = 0;
+    std::chrono::steady_clock::time_point capture_time;     // The descriptor's timestamp
+    uint64_t trace_frame = 0;           // FrameTracer id of the producer's current frame
+    DirtyRegion dirty;                  // Changed since the previous queued frame; full when downscaled
+};
+
+enum class PushResult
+{
+    Queued,
+    Downscaled,
+    Dropped
+};
+
+// Bounded hand-off between the capture thread and the encode thread. Frames are packed into
+// buffers from the queue's pool, which a sink can keep without copying. Each buffer holds a
+// reservation on the shared MemoryBudget until its last holder, queue, consumer or sink, drops it.
+class FrameQueue
+{
+public:
+    // Downscale only applies to BGRA (4 bytes per pixel); wider frames fall back to Drop
+    FrameQueue(MemoryBudget& budget, size_t capacity, BackpressurePolicy policy, int bytes_per_pixel = 4);
+
+    // Producer. Packs the frame's rows into a queued copy; the frame stays with the caller. Frames
+    // of another pixel size or with more than one plane are dropped. dirty covers everything since
+    // the previous frame that was not dropped. Block waits only for memory this queue's own frames
+    // will give back; if what others hold leaves no room, the frame is dropped.
+    PushResult Push(const FrameDescriptor& frame, const DirtyRegion& dirty);
+
+    // Consumer. Blocks until a frame is available; returns false once closed and drained.
+    bool Pop(QueuedFrame& frame);
+
+    // Wakes both sides. Frames already queued can still be popped.
+    void Close();
+
+    size_t GetPeakDepth() const;
+    // Deepest the queue got since the last call
+    size_t TakeWindowPeakDepth();
+
+    // Takes effect for the next push; frames already queued above a smaller capacity stay
+    void SetCapacity(size_t capacity);
+    size_t GetCapacity() const;
+    // Frames the consumer's sink may still hold after taking the next one (queued renditions),
+    // so the pool keeps enough buffers free for all of them
+    void SetSinkHeldFrames(size_t frames);
+    uint64_t GetBlockedNs() const { return blocked_ns_.load(std::memory_order_relaxed); }
+    // For consumers that need another frame-sized buffer, e.g. to scale a downscaled frame back up
+    FramePool& GetPool() { return pool_; }
+
+private:
+    // Fills the pool with buffers of this size on the first frame of a size, so buffers are
+    // not allocated and freed as the number in flight first reaches its high-water mark
+    void PreparePool(uint64_t bytes);
+    bool WaitForReservation(uint64_t bytes);
+    bool Enqueue(QueuedFrame&& frame);
+    // Makes room for at least slots frames; caller holds mutex_
+    void ReserveSlots(size_t slots);
+
+    MemoryBudget& budget_;
+    size_t capacity_;
+    BackpressurePolicy policy_;
+    int bytes_per_pixel_;
+    FramePool pool_;
+    std::atomic<size_t> sink_held_frames_{ 0 };
+    std::atomic<uint64_t> pooled_bytes_{ 0 };       // Frame size the pool was last filled for; 0 to refill
+
+    mutable std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    // Ring, oldest at head_. Sized by the capacity up front, so pushing and popping allocate nothing.
+    std::vector<QueuedFrame> frames_;
+    size_t head_ = 0;
+    size_t depth_ = 0;
+    size_t peak_depth_ = 0;
+    size_t window_peak_depth_ = 0;
+    bool is_closed_ = false;
+
+    std::atomic<uint64_t> blocked_ns_{ 0 };
+};
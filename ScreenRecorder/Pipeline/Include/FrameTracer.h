@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+
+enum class TraceStage : uint8_t
+{
+    Arrival,            // Capture callback, from frame arrival to hand-off
+    Readback,           // GPU copy to staging and map
+    Copy,               // CPU copies of whole frames
+    Convert,            // Pixel format conversion and scaling
+    EncodeSubmit,       // Handing the frame to the encoder
+    PacketOut,          // Encoded packet leaving a sink that sees packets (the MF sink writer hides them)
+    DiskWrite
+};
+
+constexpr int kTraceStageCount = 7;
+
+struct TraceSummary
+{
+    uint64_t events = 0;                // Kept in the buffers
+    uint64_t overwritten_events = 0;    // Lost to ring wrap-around; the newest events are kept
+    uint32_t threads = 0;
+    double ns_per_event = 0.0;          // Calibrated at Start
+    double overhead_ms = 0.0;           // (events + overwritten) * ns_per_event
+};
+
+// Opt-in per-frame span recorder. Each thread writes to its own fixed-size ring, so
+// recording is a clock read and a store with no locks or allocation after the thread's
+// first event; memory is bounded by events_per_thread. Export happens after Stop, when
+// no thread writes any more.
+//
+// Frames are identified by the id BeginFrame hands out on arrival. Threads that pick a
+// frame up later (the encode thread) make it current with SetCurrentFrame.
+class FrameTracer
+{
+public:
+    static void Start(size_t events_per_thread = 1 << 16);
+    static void Stop();
+    static bool IsEnabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    // New frame id, made current on the calling thread; 0 when tracing is off
+    static uint64_t BeginFrame();
+    static void SetCurrentFrame(uint64_t frame_id);
+    static uint64_t GetCurrentFrame();
+
+    // Label for the calling thread's track; the first name given sticks
+    static void SetThreadName(const char* name);
+
+    static void Record(TraceStage stage, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+    static TraceSummary GetSummary();
+
+    // Chrome trace event JSON (chrome://tracing, ui.perfetto.dev)
+    static bool ExportChromeJson(const std::filesystem::path& path);
+    // Perfetto protobuf trace (ui.perfetto.dev, trace_processor)
+    static bool ExportPerfetto(const std::filesystem::path& path);
+
+    static const char* GetStageName(TraceStage stage);
+
+private:
+    static std::atomic<bool> enabled_;
+};
+
+// Records one span for the current frame over its own lifetime. Costs one relaxed load
+// when tracing is off.
+class TraceSpan
+{
+public:
+    explicit TraceSpan(TraceStage stage)
+        : stage_(stage), is_active_(FrameTracer::IsEnabled())
+    {
+        if (is_active_) start_ = std::chrono::steady_clock::now();
+    }
+
+    ~TraceSpan() { End(); }
+
+    // Ends the span before the scope does
+    void End()
+    {
+        if (is_active_) FrameTracer::Record(stage_, start_, std::chrono::steady_clock::now());
+        is_active_ = false;
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    TraceStage stage_;
+    bool is_active_;
+    std::chrono::steady_clock::time_point start_;
+};
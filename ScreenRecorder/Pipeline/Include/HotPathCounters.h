@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+
+#include "FrameTracer.h"
+
+struct AllocationTally
+{
+    uint64_t allocations = 0;
+    uint64_t frees = 0;
+    uint64_t bytes = 0;             // Requested by allocations
+};
+
+// Accounting for the per-frame path, compiled in with SCREENRECORDER_HOT_PATH_COUNTERS (the bench
+// defines it). Global operator new/delete are replaced to tally every allocation on the thread
+// that makes it, and each stage reports the frame bytes it copies or converts under its trace
+// stage, also per thread. Without the define nothing is replaced, CountCopy compiles to nothing
+// and every tally reads zero.
+namespace HotPathCounters
+{
+#ifdef SCREENRECORDER_HOT_PATH_COUNTERS
+    constexpr bool kEnabled = true;
+
+    void CountCopy(TraceStage stage, uint64_t bytes);
+#else
+    constexpr bool kEnabled = false;
+
+    inline void CountCopy(TraceStage, uint64_t) {}
+#endif
+
+    // Calling thread's totals since it started
+    AllocationTally GetThreadAllocations();
+    uint64_t GetThreadCopyBytes(TraceStage stage);
+}
+
+// Allocations the calling thread made since construction
+class AllocationScope
+{
+public:
+    AllocationScope() : start_(HotPathCounters::GetThreadAllocations()) {}
+
+    AllocationTally Get() const
+    {
+        const AllocationTally now = HotPathCounters::GetThreadAllocations();
+        return AllocationTally{ now.allocations - start_.allocations, now.frees - start_.frees, now.bytes - start_.bytes };
+    }
+
+private:
+    AllocationTally start_;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+// Fixed 20 us buckets up to ~164 ms, enough for capture-to-sink latency at any frame rate
+// we record. One writer, any number of readers; percentiles are bucket upper edges.
+class LatencyHistogram
+{
+public:
+    void Record(uint64_t latency_ns)
+    {
+        uint64_t bucket = latency_ns / kBucketNs;
+        (bucket < kBucketCount ? buckets_[bucket] : overflow_).fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+
+        if (latency_ns > max_ns_.load(std::memory_order_relaxed))
+        {
+            max_ns_.store(latency_ns, std::memory_order_relaxed);
+        }
+    }
+
+    double GetPercentileMs(double percentile) const
+    {
+        uint64_t count = count_.load(std::memory_order_relaxed);
+        if (count == 0) return 0.0;
+
+        uint64_t rank = static_cast<uint64_t>(std::ceil(percentile / 100.0 * count));
+        uint64_t seen = 0;
+        for (uint64_t i = 0; i < kBucketCount; ++i)
+        {
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if (seen >= rank) return (i + 1) * kBucketNs / 1e6;
+        }
+        return GetMaxMs();
+    }
+
+    double GetMaxMs() const { return max_ns_.load(std::memory_order_relaxed) / 1e6; }
+    uint64_t GetCount() const { return count_.load(std::memory_order_relaxed); }
+
+    void Reset()
+    {
+        for (auto& bucket : buckets_)
+        {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        overflow_.store(0, std::memory_order_relaxed);
+        count_.store(0, std::memory_order_relaxed);
+        max_ns_.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr uint64_t kBucketNs = 20000;
+    static constexpr uint64_t kBucketCount = 8192;
+
+    std::atomic<uint64_t> buckets_[kBucketCount]{};
+    std::atomic<uint64_t> overflow_{ 0 };
+    std::atomic<uint64_t> count_{ 0 };
+    std::atomic<uint64_t> max_ns_{ 0 };
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// What a producer does when the recorder is over its memory budget
+enum class BackpressurePolicy
+{
+    Drop,           // Discard the frame
+    Downscale,      // Keep a half-resolution copy; the consumer scales it back up
+    Block           // Stall the producer until memory is released
+};
+
+// Recorder-wide cap on frame-sized memory between capture and the output: queued frames, encoder
+// samples, sink working buffers and pools. Producers that can back off reserve within the limit;
+// holders that can't are charged past it, which the producers then see. Reserving is a lock-free
+// CAS; the mutex is only touched by producers waiting in Reserve() and by Release() when such a
+// waiter exists.
+class MemoryBudget
+{
+public:
+    // Owns reserved bytes and gives them back on destruction
+    class Reservation
+    {
+    public:
+        Reservation() = default;
+        Reservation(MemoryBudget* budget, uint64_t bytes) : budget_(budget), bytes_(bytes) {}
+        Reservation(Reservation&& other) noexcept : budget_(other.budget_), bytes_(other.bytes_) { other.budget_ = nullptr; other.bytes_ = 0; }
+        Reservation& operator=(Reservation&& other) noexcept;
+        Reservation(const Reservation&) = delete;
+        Reservation& operator=(const Reservation&) = delete;
+        ~Reservation() { Reset(); }
+
+        void Reset();
+        uint64_t GetBytes() const { return bytes_; }
+        // Stops owning the bytes; whoever takes them over gives them back with Release
+        MemoryBudget* Detach();
+
+    private:
+        MemoryBudget* budget_ = nullptr;
+        uint64_t bytes_ = 0;
+    };
+
+    explicit MemoryBudget(uint64_t limit_bytes);
+
+    bool TryReserve(uint64_t bytes);
+    // Always succeeds, past the limit if need be, for holders that can neither wait nor drop
+    Reservation Charge(uint64_t bytes);
+
+    // Waits up to timeout for other holders to release. Fails at once if bytes exceeds the limit.
+    bool Reserve(uint64_t bytes, std::chrono::milliseconds timeout);
+    void Release(uint64_t bytes);
+
+    void SetLimit(uint64_t limit_bytes);
+    uint64_t GetLimit() const { return limit_.load(std::memory_order_relaxed); }
+    uint64_t GetUsage() const { return usage_.load(std::memory_order_relaxed); }
+
+    // Free buffers pools keep for reuse. Counted in the peak, not against the limit: the next
+    // reservation that needs a buffer takes one of these rather than new memory.
+    void AddCached(uint64_t bytes);
+    void RemoveCached(uint64_t bytes);
+    uint64_t GetCached() const { return cached_.load(std::memory_order_relaxed); }
+
+    // Highest usage plus cached
+    uint64_t GetPeak() const { return peak_.load(std::memory_order_relaxed); }
+    void ResetPeak() { peak_.store(usage_.load(std::memory_order_relaxed) + cached_.load(std::memory_order_relaxed), std::memory_order_relaxed); }
+
+private:
+    void UpdatePeak();
+
+    std::atomic<uint64_t> limit_;
+    std::atomic<uint64_t> usage_{ 0 };
+    std::atomic<uint64_t> cached_{ 0 };
+    std::atomic<uint64_t> peak_{ 0 };
+    std::atomic<int> waiters_{ 0 };
+    std::mutex wait_mutex_;
+    std::condition_variable released_;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct PipelineTunerConfig
+{
+    int min_pool_buffers = 1;
+    int max_pool_buffers = 4;
+    size_t min_queue_capacity = 1;
+    size_t max_queue_capacity = 16;
+    double window_seconds = 1.0;
+    double max_drop_rate = 0.001;           // Queue drops per offered frame tolerated in a window
+    double latency_budget_ms = 50.0;        // p99 capture-to-done; the queue never grows while above it
+    int calm_windows = 5;                   // Quiet windows in a row before a buffer is given back
+};
+
+// What the pipeline did during one tuning window
+struct TunerWindow
+{
+    uint64_t frames = 0;                    // Offered to the queue, dropped or not
+    uint64_t dropped = 0;
+    double latency_p99_ms = 0.0;
+    double max_hold_ms = 0.0;               // Longest a capture pool buffer was held
+    size_t queue_peak_depth = 0;
+};
+
+struct TunerDecision
+{
+    uint64_t window = 0;
+    int pool_buffers = 0;
+    size_t queue_capacity = 0;
+    std::string reason;                     // Empty when nothing was decided
+};
+
+// Sizes the capture frame pool and the frame queue from what the pipeline is doing.
+//
+// Pool: a buffer stays with the capture callback for its whole readback, so the pool needs
+// ceil(hold / frame interval) + 1 buffers to never stall the compositor. It grows at once
+// when holds get longer and shrinks one buffer at a time after calm_windows quiet windows.
+//
+// Queue: drops double the capacity, but never past the length whose p99 would reach 80% of the
+// latency budget (more queue would only trade drops for latency). Over budget, it is cut back
+// in proportion; after calm_windows windows that never use half of it, it gives one slot back.
+// Every change is kept in the decision log.
+class PipelineTuner
+{
+public:
+    // queue_capacity 0 means there is no queue and only the pool is tuned
+    PipelineTuner(const PipelineTunerConfig& config, double frame_interval_ms, int pool_buffers, size_t queue_capacity);
+
+    TunerDecision Observe(const TunerWindow& window);
+
+    int GetPoolBuffers() const { return pool_buffers_; }
+    size_t GetQueueCapacity() const { return queue_capacity_; }
+    const PipelineTunerConfig& GetConfig() const { return config_; }
+
+    // Windows with a decision only; safe to read while another thread observes
+    std::vector<TunerDecision> GetLog() const;
+
+private:
+    void TunePool(const TunerWindow& window, std::string& reason);
+    void TuneQueue(const TunerWindow& window, std::string& reason);
+
+    static constexpr double kGrowthBudget = 0.8;
+
+    PipelineTunerConfig config_;
+    double frame_interval_ms_;
+    int pool_buffers_;
+    size_t queue_capacity_;
+    uint64_t windows_ = 0;
+    int calm_pool_windows_ = 0;
+    int calm_queue_windows_ = 0;
+    bool latency_bound_ = false;            // Logged once until the drops stop
+
+    mutable std::mutex log_mutex_;
+    std::vector<TunerDecision> log_;
+};
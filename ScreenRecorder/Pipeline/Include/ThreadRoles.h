@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+enum class ThreadRole
+{
+    Capture,
+    Convert,
+    Encode,
+    Io,
+    Stats
+};
+
+constexpr int kThreadRoleCount = 5;
+
+// Named after the Windows thread priorities; on Linux the first four map to nice values
+// and TimeCritical to SCHED_FIFO, which needs CAP_SYS_NICE.
+enum class ThreadPriority
+{
+    BelowNormal,
+    Normal,
+    AboveNormal,
+    Highest,
+    TimeCritical
+};
+
+struct ThreadRoleConfig
+{
+    uint64_t affinity_mask = 0;                 // Bit per logical core; 0 = any core
+    ThreadPriority priority = ThreadPriority::Normal;
+    bool isolate_from_target = false;           // Stay off the cores the recorded process may run on
+};
+
+// Per-role scheduling for the recorder's own threads. Each pipeline thread calls
+// ApplyToCurrentThread once for its role; threads we don't own (capture callbacks on the
+// frame pool) apply it lazily and re-apply when the configuration generation changes.
+class ThreadRoles
+{
+public:
+    void Configure(ThreadRole role, const ThreadRoleConfig& config);
+    const ThreadRoleConfig& GetConfig(ThreadRole role) const { return configs_[static_cast<int>(role)]; }
+
+    // Cores of the recorded process, read from its affinity mask
+    bool SetTargetProcess(uint32_t process_id);
+    void SetTargetCores(uint64_t core_mask) { target_cores_.store(core_mask, std::memory_order_relaxed); Touch(); }
+    uint64_t GetTargetCores() const { return target_cores_.load(std::memory_order_relaxed); }
+
+    // The role's mask after isolation. Isolation never leaves a role without a core.
+    uint64_t GetEffectiveAffinity(ThreadRole role) const;
+
+    // Names the calling thread and applies affinity and priority. Returns false if the OS refused any of it.
+    bool ApplyToCurrentThread(ThreadRole role) const;
+
+    // Cheap check for threads we don't own: applies the role only when the configuration changed
+    void EnsureApplied(ThreadRole role) const;
+
+    static const char* GetRoleName(ThreadRole role);
+    static bool ParseRole(const std::string& name, ThreadRole& role);
+    static bool ParsePriority(const std::string& name, ThreadPriority& priority);
+    static bool ParseCoreList(const std::string& list, uint64_t& core_mask);     // "0-3,6"
+    static uint64_t GetProcessCores();
+    static bool SetCurrentThreadAffinity(uint64_t core_mask);
+    static bool SetCurrentThreadPriority(ThreadPriority priority);
+
+private:
+    void Touch() { generation_.store(next_generation_.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    static std::atomic<uint32_t> next_generation_;
+
+    ThreadRoleConfig configs_[kThreadRoleCount];
+    std::atomic<uint64_t> target_cores_{ 0 };
+    std::atomic<uint32_t> generation_{ 0 };
+};
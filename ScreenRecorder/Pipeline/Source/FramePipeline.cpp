@@ -0,0 +1,197 @@
+#include <algorithm>
+
+#include "FrameKernels.h"
+#include "FramePipeline.h"
+#include "FrameTracer.h"
+#include "HdrKernels.h"
+#include "HotPathCounters.h"
+
+FramePipeline::FramePipeline(MemoryBudget& budget)
+    : budget_(budget)
+{
+}
+
+void FramePipeline::SetToneMap(bool enabled, float sdr_white_nits, float peak_nits)
+{
+    tone_map_ = enabled;
+    sdr_white_nits_ = sdr_white_nits;
+    peak_nits_ = peak_nits;
+}
+
+void FramePipeline::SetSceneDetection(const SceneChangeConfig& config, std::function<void()> request_keyframe)
+{
+    scene_detector_ = SceneChangeDetector(config);
+    request_keyframe_ = std::move(request_keyframe);
+}
+
+void FramePipeline::Start(FrameQueue* queue, std::chrono::milliseconds upscale_wait)
+{
+    queue_ = queue;
+    upscale_wait_ = upscale_wait;
+    pending_dirty_ = DirtyRegion();
+    is_frame_missed_ = false;
+    tone_mapped_.clear();
+}
+
+void FramePipeline::OnFrameCaptured(const FrameDescriptor& captured, const DirtyRegion& dirty)
+{
+    frames_received_.fetch_add(1, std::memory_order_relaxed);
+
+    const int width = captured.width;
+    const int height = captured.height;
+    const DirtyRegion frame_dirty = dirty.ForFrame(width, height);
+    FrameDescriptor frame = captured;
+
+    if (tone_map_)
+    {
+        TraceSpan convert_span(TraceStage::Convert);
+        const size_t bytes = static_cast<size_t>(width) * height * 4;
+        const bool is_reused = tone_mapped_.size() == bytes;
+        const DirtyRegion region = is_reused ? frame_dirty : DirtyRegion::Full(width, height);
+        tone_mapped_.resize(bytes);
+        if (!is_reused)
+        {
+            tone_mapped_reservation_.Reset();
+            tone_mapped_reservation_ = budget_.Charge(bytes);
+        }
+        HdrKernels::ToneMapScRgbToBgraRegion(captured.planes[0].data, captured.planes[0].pitch,
+                                             tone_mapped_.data(), static_cast<ptrdiff_t>(width) * 4, sdr_white_nits_, peak_nits_, region);
+        HotPathCounters::CountCopy(TraceStage::Convert, region.GetArea() * 8);
+        frame = FrameDescriptor::Packed(tone_mapped_.data(), FrameFormat::Bgra, width, height, captured.timestamp);
+    }
+
+    // Thumbnails are BGRA only
+    if (preview_tap_ && frame.format == FrameFormat::Bgra)
+    {
+        preview_tap_->OnFrame(frame.planes[0].data, frame.planes[0].pitch, width, height, frame_dirty);
+    }
+
+    if (!queue_)
+    {
+        EncodeFrame(frame, frame_dirty);
+        return;
+    }
+
+    // The encode thread sees only queued frames, so changes in dropped ones carry over to the next
+    pending_dirty_.Add(frame_dirty);
+
+    switch (queue_->Push(frame, pending_dirty_))
+    {
+    case PushResult::Dropped:
+        frames_dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    case PushResult::Downscaled:
+        frames_downscaled_.fetch_add(1, std::memory_order_relaxed);
+        break;
+    default:
+        break;
+    }
+
+    pending_dirty_ = DirtyRegion(width, height);
+}
+
+void FramePipeline::EncodeQueued(QueuedFrame& frame)
+{
+    FrameTracer::SetCurrentFrame(frame.trace_frame);
+
+    if (frame.stored_width != frame.width || frame.stored_height != frame.height)
+    {
+        TraceSpan convert_span(TraceStage::Convert);
+        // Downscaled under memory pressure; the sink still gets the capture resolution, if the budget has room for it
+        const uint64_t bytes = static_cast<uint64_t>(frame.width) * frame.height * 4;
+        if (!budget_.Reserve(bytes, upscale_wait_))
+        {
+            frames_dropped_.fetch_add(1, std::memory_order_relaxed);
+            is_frame_missed_ = true;
+            frame.pixels.reset();
+            return;
+        }
+
+        PooledFrame upscaled = queue_->GetPool().Acquire(bytes, MemoryBudget::Reservation(&budget_, bytes));
+        FrameKernels::ScaleBgraBilinear(frame.pixels->data(), static_cast<ptrdiff_t>(frame.stored_width) * 4, frame.stored_width, frame.stored_height,
+                                        upscaled->data(), static_cast<ptrdiff_t>(frame.width) * 4, frame.width, frame.height);
+        HotPathCounters::CountCopy(TraceStage::Convert, bytes);
+        frame.pixels = std::move(upscaled);
+    }
+
+    if (is_frame_missed_)
+    {
+        frame.dirty = DirtyRegion::Full(frame.width, frame.height);
+        is_frame_missed_ = false;
+    }
+
+    // The sink may keep the pooled buffer (the encoder wraps it as its sample) instead of copying.
+    // Its reservation goes with it and is given back when the last holder drops the buffer.
+    FrameDescriptor descriptor = FrameDescriptor::Packed(frame.pixels->data(), frame.format, frame.width, frame.height, frame.capture_time);
+    descriptor.owner = frame.pixels;
+    EncodeFrame(descriptor, frame.dirty);
+
+    frame.pixels.reset();
+}
+
+void FramePipeline::EncodeFrame(const FrameDescriptor& frame, const DirtyRegion& dirty)
+{
+    // Pooled frames are pinned by reference here, before EncodeQueued lets go of the buffer
+    if (snapshot_writer_) snapshot_writer_->OnFrame(frame);
+    if (shared_publisher_) shared_publisher_->ProcessFrame(frame, dirty);
+
+    if (request_keyframe_ && frame.format == FrameFormat::Bgra)
+    {
+        auto detect_start = std::chrono::steady_clock::now();
+        SceneChangeResult scene = scene_detector_.Analyze(frame.planes[0].data, frame.planes[0].pitch, frame.width, frame.height);
+        scene_detect_ns_.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - detect_start).count(),
+                                   std::memory_order_relaxed);
+
+        if (scene.change == SceneChange::Cut) scene_cuts_.fetch_add(1, std::memory_order_relaxed);
+        if (scene.change == SceneChange::Static) static_frames_.fetch_add(1, std::memory_order_relaxed);
+        if (scene.force_keyframe) request_keyframe_();
+    }
+
+    auto encode_start = std::chrono::steady_clock::now();
+    const bool result = sink_ && sink_->ProcessFrame(frame, dirty);
+    auto encode_end = std::chrono::steady_clock::now();
+    const uint64_t encode_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(encode_end - encode_start).count();
+    const uint64_t latency_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(encode_end - frame.timestamp).count();
+    latency_.Record(latency_ns);
+    if (window_latency_) window_latency_->Record(latency_ns);
+
+    (result ? frames_encoded_ : frames_failed_).fetch_add(1, std::memory_order_relaxed);
+    encode_ns_.fetch_add(encode_ns, std::memory_order_relaxed);
+
+    uint64_t current_max = max_encode_ns_.load(std::memory_order_relaxed);
+    while (encode_ns > current_max && !max_encode_ns_.compare_exchange_weak(current_max, encode_ns, std::memory_order_relaxed))
+    {
+    }
+}
+
+FramePipelineStats FramePipeline::GetStats() const
+{
+    FramePipelineStats stats;
+    stats.frames_received = frames_received_.load(std::memory_order_relaxed);
+    stats.frames_encoded = frames_encoded_.load(std::memory_order_relaxed);
+    stats.frames_failed = frames_failed_.load(std::memory_order_relaxed);
+    stats.frames_dropped = frames_dropped_.load(std::memory_order_relaxed);
+    stats.frames_downscaled = frames_downscaled_.load(std::memory_order_relaxed);
+    stats.encode_ns = encode_ns_.load(std::memory_order_relaxed);
+    stats.max_encode_ns = max_encode_ns_.load(std::memory_order_relaxed);
+    stats.scene_cuts = scene_cuts_.load(std::memory_order_relaxed);
+    stats.static_frames = static_frames_.load(std::memory_order_relaxed);
+    stats.scene_detect_ns = scene_detect_ns_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void FramePipeline::ResetStats()
+{
+    frames_received_.store(0, std::memory_order_relaxed);
+    frames_encoded_.store(0, std::memory_order_relaxed);
+    frames_failed_.store(0, std::memory_order_relaxed);
+    frames_dropped_.store(0, std::memory_order_relaxed);
+    frames_downscaled_.store(0, std::memory_order_relaxed);
+    encode_ns_.store(0, std::memory_order_relaxed);
+    max_encode_ns_.store(0, std::memory_order_relaxed);
+    scene_cuts_.store(0, std::memory_order_relaxed);
+    static_frames_.store(0, std::memory_order_relaxed);
+    scene_detect_ns_.store(0, std::memory_order_relaxed);
+    scene_detector_.Reset();
+    latency_.Reset();
+}
@@ -0,0 +1,201 @@
+#include <algorithm>
+
+#include "FramePool.h"
+
+// Allocator for the handles' shared_ptr control blocks. Blocks go back to the pool's list
+// instead of the heap; the allocator keeps the list alive for as long as any block exists.
+template <typename T>
+class ControlBlockAllocator
+{
+public:
+    using value_type = T;
+
+    explicit ControlBlockAllocator(std::shared_ptr<FramePool::Shared> shared) : shared_(std::move(shared)) {}
+    template <typename U>
+    ControlBlockAllocator(const ControlBlockAllocator<U>& other) : shared_(other.shared_) {}
+
+    T* allocate(size_t count)
+    {
+        const size_t bytes = count * sizeof(T);
+        {
+            std::lock_guard<std::mutex> lock(shared_->mutex);
+            if (shared_->block_bytes == 0) shared_->block_bytes = bytes;
+            if (bytes == shared_->block_bytes && shared_->free_blocks)
+            {
+                void* block = shared_->free_blocks;
+                shared_->free_blocks = *static_cast<void**>(block);
+                return static_cast<T*>(block);
+            }
+        }
+        return static_cast<T*>(::operator new(std::max(bytes, sizeof(void*))));
+    }
+
+    void deallocate(T* pointer, size_t count)
+    {
+        {
+            std::lock_guard<std::mutex> lock(shared_->mutex);
+            if (count * sizeof(T) == shared_->block_bytes)
+            {
+                *reinterpret_cast<void**>(pointer) = shared_->free_blocks;
+                shared_->free_blocks = pointer;
+                return;
+            }
+        }
+        ::operator delete(pointer);
+    }
+
+    template <typename U>
+    bool operator==(const ControlBlockAllocator<U>& other) const { return shared_ == other.shared_; }
+
+private:
+    template <typename U>
+    friend class ControlBlockAllocator;
+
+    std::shared_ptr<FramePool::Shared> shared_;
+};
+
+FramePool::Shared::~Shared()
+{
+    while (free_blocks)
+    {
+        void* block = free_blocks;
+        free_blocks = *static_cast<void**>(block);
+        ::operator delete(block);
+    }
+}
+
+FramePool::FramePool(size_t max_free)
+    : shared_(std::make_shared<Shared>())
+{
+    shared_->max_free = max_free;
+    // Returning a buffer must not grow the list
+    shared_->free.reserve(max_free);
+}
+
+FramePool::~FramePool()
+{
+    // Outstanding handles still reference the shared state; they free their buffers instead
+    std::lock_guard<std::mutex> lock(shared_->mutex);
+    shared_->is_closed = true;
+    for (const std::unique_ptr<AlignedBuffer>& free : shared_->free)
+    {
+        if (shared_->budget) shared_->budget->RemoveCached(free->size());
+    }
+    shared_->free.clear();
+}
+
+void FramePool::SetMemoryBudget(MemoryBudget* budget)
+{
+    std::lock_guard<std::mutex> lock(shared_->mutex);
+    for (const std::unique_ptr<AlignedBuffer>& free : shared_->free)
+    {
+        if (shared_->budget) shared_->budget->RemoveCached(free->size());
+        if (budget) budget->AddCached(free->size());
+    }
+    shared_->budget = budget;
+}
+
+void FramePool::SetMaxFree(size_t max_free)
+{
+    std::lock_guard<std::mutex> lock(shared_->mutex);
+    shared_->max_free = max_free;
+    shared_->free.reserve(max_free);
+    while (shared_->free.size() > max_free)
+    {
+        if (shared_->budget) shared_->budget->RemoveCached(shared_->free.front()->size());
+        shared_->free.erase(shared_->free.begin());
+    }
+}
+
+void FramePool::Reserve(size_t bytes, size_t count)
+{
+    // Handed out and returned together, so their handle control blocks are pooled along with them
+    std::vector<PooledFrame> frames;
+    frames.reserve(count);
+    while (frames.size() < count) frames.push_back(Acquire(bytes));
+}
+
+PooledFrame FramePool::Acquire(size_t bytes, MemoryBudget::Reservation reservation)
+{
+    AlignedBuffer* buffer = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(shared_->mutex);
+        auto match = std::find_if(shared_->free.begin(), shared_->free.end(), [bytes](const std::unique_ptr<AlignedBuffer>& free) { return free->size() == bytes; });
+        if (match != shared_->free.end())
+        {
+            buffer = match->release();
+            shared_->free.erase(match);
+            ++shared_->stats.reuses;
+            if (shared_->budget) shared_->budget->RemoveCached(bytes);
+        }
+        else
+        {
+            ++shared_->stats.allocations;
+        }
+        ++shared_->stats.outstanding;
+
+        if (shared_->budget && !reservation.GetBytes()) reservation = shared_->budget->Charge(bytes);
+        shared_->stats.reserved_bytes += reservation.GetBytes();
+    }
+
+    if (!buffer) buffer = new AlignedBuffer(bytes);
+
+    // The allocator keeps the shared state alive, so the buffer can always go back through it;
+    // once the pool is gone Return frees it instead
+    std::shared_ptr<Shared> shared = shared_;
+    const uint64_t reserved = reservation.GetBytes();
+    MemoryBudget* budget = reservation.Detach();
+    return PooledFrame(buffer, [shared, budget, reserved](AlignedBuffer* released) { Return(shared, released, budget, reserved); },
+                       ControlBlockAllocator<AlignedBuffer>(shared_));
+}
+
+void FramePool::Return(const std::shared_ptr<Shared>& shared, AlignedBuffer* buffer, MemoryBudget* budget, uint64_t reserved)
+{
+    bool is_kept = false;
+    {
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        --shared->stats.outstanding;
+        shared->stats.reserved_bytes -= reserved;
+        if (!shared->is_closed && shared->max_free > 0)
+        {
+            // Oldest first, so buffers of a size no longer asked for age out
+            if (shared->free.size() >= shared->max_free)
+            {
+                if (shared->budget) shared->budget->RemoveCached(shared->free.front()->size());
+                shared->free.erase(shared->free.begin());
+            }
+            shared->free.emplace_back(buffer);
+            if (shared->budget) shared->budget->AddCached(buffer->size());
+            is_kept = true;
+        }
+    }
+    if (!is_kept) delete buffer;
+
+    // After the buffer is back, so a producer woken by the release can reuse it
+    if (budget && reserved) budget->Release(reserved);
+}
+
+FramePoolStats FramePool::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(shared_->mutex);
+    FramePoolStats stats = shared_->stats;
+    stats.free = shared_->free.size();
+    return stats;
+}
+
+RetainedFrame RetainFrame(const FrameDescriptor& frame, FramePool& pool)
+{
+    RetainedFrame retained;
+    if (frame.owner && frame.IsPacked())
+    {
+        retained.owner = frame.owner;
+        retained.data = frame.planes[0].data;
+        return retained;
+    }
+
+    PooledFrame buffer = pool.Acquire(frame.GetRowBytes(0) * frame.height);
+    retained.fill = buffer->data();
+    retained.data = retained.fill;
+    retained.owner = std::move(buffer);
+    return retained;
+}
@@ -0,0 +1,218 @@
+#include <algorithm>
+
+#include "FrameKernels.h"
+#include "FrameQueue.h"
+#include "FrameTracer.h"
+#include "HotPathCounters.h"
+
+FrameQueue::FrameQueue(MemoryBudget& budget, size_t capacity, BackpressurePolicy policy, int bytes_per_pixel)
+    : budget_(budget),
+      capacity_(capacity),
+      policy_(policy),
+      bytes_per_pixel_(bytes_per_pixel)
+{
+    pool_.SetMemoryBudget(&budget_);
+    ReserveSlots(capacity_);
+}
+
+PushResult FrameQueue::Push(const FrameDescriptor& source, const DirtyRegion& dirty)
+{
+    if (!source.IsValid() || source.GetPlaneCount() != 1 || source.GetBytesPerPixel() != bytes_per_pixel_) return PushResult::Dropped;
+
+    const int width = source.width;
+    const int height = source.height;
+    const uint64_t bytes = static_cast<uint64_t>(width) * height * bytes_per_pixel_;
+    const size_t row_bytes = source.GetRowBytes(0);
+    PreparePool(bytes);
+
+    QueuedFrame frame;
+    frame.format = source.format;
+    frame.width = width;
+    frame.height = height;
+    frame.stored_width = width;
+    frame.stored_height = height;
+    frame.capture_time = source.timestamp;
+    frame.trace_frame = FrameTracer::GetCurrentFrame();
+    frame.dirty = dirty;
+
+    PushResult result = PushResult::Queued;
+
+    if (policy_ == BackpressurePolicy::Block)
+    {
+        if (!WaitForReservation(bytes)) return PushResult::Dropped;
+
+        frame.pixels = pool_.Acquire(bytes, MemoryBudget::Reservation(&budget_, bytes));
+        FrameKernels::CopyImage(frame.pixels->data(), row_bytes, source.planes[0].data, source.planes[0].pitch, row_bytes, height);
+        HotPathCounters::CountCopy(TraceStage::Copy, bytes);
+    }
+    else
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (is_closed_ || depth_ >= capacity_) return PushResult::Dropped;
+        }
+
+        if (budget_.TryReserve(bytes))
+        {
+            frame.pixels = pool_.Acquire(bytes, MemoryBudget::Reservation(&budget_, bytes));
+            FrameKernels::CopyImage(frame.pixels->data(), row_bytes, source.planes[0].data, source.planes[0].pitch, row_bytes, height);
+            HotPathCounters::CountCopy(TraceStage::Copy, bytes);
+        }
+        else if (policy_ == BackpressurePolicy::Downscale && bytes_per_pixel_ == 4 && width >= 2 && height >= 2)
+        {
+            const int half_width = width / 2;
+            const int half_height = height / 2;
+            const uint64_t half_bytes = static_cast<uint64_t>(half_width) * half_height * 4;
+            if (!budget_.TryReserve(half_bytes)) return PushResult::Dropped;
+
+            TraceSpan convert_span(TraceStage::Convert);
+            frame.pixels = pool_.Acquire(half_bytes, MemoryBudget::Reservation(&budget_, half_bytes));
+            FrameKernels::DownsampleBgraBox(source.planes[0].data, source.planes[0].pitch, width, height, 2,
+                                            frame.pixels->data(), static_cast<ptrdiff_t>(half_width) * 4);
+            HotPathCounters::CountCopy(TraceStage::Convert, bytes);
+            frame.stored_width = half_width;
+            frame.stored_height = half_height;
+            frame.dirty = DirtyRegion::Full(width, height);
+            result = PushResult::Downscaled;
+        }
+        else
+        {
+            return PushResult::Dropped;
+        }
+    }
+
+    return Enqueue(std::move(frame)) ? result : PushResult::Dropped;
+}
+
+bool FrameQueue::WaitForReservation(uint64_t bytes)
+{
+    auto wait_start = std::chrono::steady_clock::now();
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this] { return is_closed_ || depth_ < capacity_; });
+        if (is_closed_) return false;
+    }
+
+    bool reserved = budget_.TryReserve(bytes);
+    while (!reserved)
+    {
+        // Only this queue's frames are sure to come back as the consumer drains. If the rest of
+        // the budget is held past the limit by charges that stay, waiting would never end.
+        // Read first: a buffer coming back leaves the pool's count before the budget's.
+        const uint64_t held = pool_.GetStats().reserved_bytes;
+        const uint64_t usage = budget_.GetUsage();
+        if (usage - std::min(usage, held) + bytes > budget_.GetLimit()) break;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (is_closed_) break;
+        }
+
+        // Short slices so Close() is noticed even if the consumer never releases
+        reserved = budget_.Reserve(bytes, std::chrono::milliseconds(50));
+    }
+
+    blocked_ns_.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - wait_start).count(),
+                          std::memory_order_relaxed);
+    return reserved;
+}
+
+bool FrameQueue::Enqueue(QueuedFrame&& frame)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (is_closed_) return false;
+
+        // Pushes check the capacity first, so this only guards a frame pushed past it by a race
+        if (depth_ == frames_.size()) ReserveSlots(depth_ + 1);
+        frames_[(head_ + depth_) % frames_.size()] = std::move(frame);
+        ++depth_;
+        if (depth_ > peak_depth_) peak_depth_ = depth_;
+        if (depth_ > window_peak_depth_) window_peak_depth_ = depth_;
+    }
+    not_empty_.notify_one();
+    return true;
+}
+
+void FrameQueue::ReserveSlots(size_t slots)
+{
+    if (slots <= frames_.size()) return;
+
+    std::vector<QueuedFrame> grown(slots);
+    for (size_t i = 0; i < depth_; ++i) grown[i] = std::move(frames_[(head_ + i) % frames_.size()]);
+    frames_.swap(grown);
+    head_ = 0;
+}
+
+bool FrameQueue::Pop(QueuedFrame& frame)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return is_closed_ || depth_ > 0; });
+        if (depth_ == 0) return false;
+
+        frame = std::move(frames_[head_]);
+        head_ = (head_ + 1) % frames_.size();
+        --depth_;
+    }
+    not_full_.notify_one();
+    return true;
+}
+
+void FrameQueue::Close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_closed_ = true;
+    }
+    not_empty_.notify_all();
+    not_full_.notify_all();
+}
+
+size_t FrameQueue::GetPeakDepth() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return peak_depth_;
+}
+
+size_t FrameQueue::TakeWindowPeakDepth()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const size_t depth = window_peak_depth_;
+    window_peak_depth_ = depth_;
+    return depth;
+}
+
+void FrameQueue::SetCapacity(size_t capacity)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        capacity_ = capacity > 0 ? capacity : 1;
+        ReserveSlots(capacity_);
+    }
+    pooled_bytes_.store(0, std::memory_order_relaxed);
+    not_full_.notify_all();
+}
+
+void FrameQueue::SetSinkHeldFrames(size_t frames)
+{
+    sink_held_frames_.store(frames, std::memory_order_relaxed);
+    pooled_bytes_.store(0, std::memory_order_relaxed);
+}
+
+void FrameQueue::PreparePool(uint64_t bytes)
+{
+    if (pooled_bytes_.exchange(bytes, std::memory_order_relaxed) == bytes) return;
+
+    // Queued, popped and being encoded, just acquired by the producer, plus whatever the sink keeps
+    const size_t frames = GetCapacity() + 2 + sink_held_frames_.load(std::memory_order_relaxed);
+    pool_.SetMaxFree(std::max<size_t>(frames, 8));
+    pool_.Reserve(bytes, frames);
+}
+
+size_t FrameQueue::GetCapacity() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return capacity_;
+}
@@ -0,0 +1,417 @@
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "FrameTracer.h"
+
+std::atomic<bool> FrameTracer::enabled_{ false };
+
+namespace
+{
+    const char* const kStageNames[kTraceStageCount] = { "arrival", "readback", "copy", "convert", "encode_submit", "packet_out", "disk_write" };
+
+    struct TraceEvent
+    {
+        uint64_t frame;
+        int64_t start_ns;
+        uint32_t duration_ns;
+        TraceStage stage;
+    };
+
+    struct ThreadBuffer
+    {
+        std::vector<TraceEvent> events;             // Ring, power-of-two size
+        std::atomic<uint64_t> written{ 0 };         // Events recorded this session, including overwritten ones
+        uint64_t session = 0;
+        uint32_t thread_id = 0;
+        std::string name;
+        std::atomic<bool> owner_alive{ true };
+    };
+
+    struct ThreadSlot
+    {
+        ThreadBuffer* buffer = nullptr;
+        uint64_t current_frame = 0;
+
+        ~ThreadSlot()
+        {
+            if (buffer) buffer->owner_alive.store(false, std::memory_order_release);
+        }
+    };
+
+    std::mutex registry_mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> registry;
+    std::atomic<uint64_t> session{ 0 };
+    size_t capacity = 0;
+    std::chrono::steady_clock::time_point epoch;
+    std::atomic<uint64_t> next_frame{ 0 };
+    double ns_per_event = 0.0;
+
+    thread_local ThreadSlot thread_slot;
+
+    uint32_t GetCurrentThreadIdentifier()
+    {
+#ifdef _WIN32
+        return static_cast<uint32_t>(GetCurrentThreadId());
+#else
+        return static_cast<uint32_t>(syscall(SYS_gettid));
+#endif
+    }
+
+    uint32_t GetCurrentProcessIdentifier()
+    {
+#ifdef _WIN32
+        return static_cast<uint32_t>(GetCurrentProcessId());
+#else
+        return static_cast<uint32_t>(getpid());
+#endif
+    }
+
+    // The calling thread's ring for the current session. Only the first event of a
+    // session takes the lock.
+    ThreadBuffer* AcquireBuffer()
+    {
+        ThreadBuffer* buffer = thread_slot.buffer;
+        const uint64_t current_session = session.load(std::memory_order_acquire);
+        if (buffer && buffer->session == current_session) return buffer;
+
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        if (!buffer)
+        {
+            registry.push_back(std::make_unique<ThreadBuffer>());
+            buffer = registry.back().get();
+            buffer->thread_id = GetCurrentThreadIdentifier();
+            thread_slot.buffer = buffer;
+        }
+
+        if (buffer->events.size() != capacity) buffer->events.assign(capacity, TraceEvent{});
+        buffer->written.store(0, std::memory_order_relaxed);
+        buffer->session = current_session;
+        return buffer;
+    }
+
+    // Buffers that recorded in the current session, oldest event first
+    template <typename Visitor>
+    void ForEachEvent(const ThreadBuffer& buffer, Visitor visitor)
+    {
+        const uint64_t written = buffer.written.load(std::memory_order_acquire);
+        const uint64_t kept = std::min<uint64_t>(written, buffer.events.size());
+        for (uint64_t i = written - kept; i < written; ++i)
+        {
+            visitor(buffer.events[i & (buffer.events.size() - 1)]);
+        }
+    }
+
+    std::vector<const ThreadBuffer*> GetSessionBuffers()
+    {
+        std::vector<const ThreadBuffer*> buffers;
+        const uint64_t current_session = session.load(std::memory_order_acquire);
+        for (const auto& buffer : registry)
+        {
+            if (buffer->session == current_session && buffer->written.load(std::memory_order_acquire) > 0)
+            {
+                buffers.push_back(buffer.get());
+            }
+        }
+        return buffers;
+    }
+
+    std::string GetTrackName(const ThreadBuffer& buffer)
+    {
+        return buffer.name.empty() ? "thread " + std::to_string(buffer.thread_id) : buffer.name;
+    }
+
+    // Just enough protobuf encoding for the Perfetto trace format
+    class ProtoWriter
+    {
+    public:
+        void Varint(uint32_t field, uint64_t value)
+        {
+            Tag(field, 0);
+            Raw(value);
+        }
+        void Bytes(uint32_t field, const std::string& value)
+        {
+            Tag(field, 2);
+            Raw(value.size());
+            data_ += value;
+        }
+        void Message(uint32_t field, const ProtoWriter& message) { Bytes(field, message.data_); }
+        const std::string& Data() const { return data_; }
+
+    private:
+        void Tag(uint32_t field, uint32_t wire_type) { Raw((static_cast<uint64_t>(field) << 3) | wire_type); }
+        void Raw(uint64_t value)
+        {
+            while (value >= 0x80)
+            {
+                data_.push_back(static_cast<char>((value & 0x7F) | 0x80));
+                value >>= 7;
+            }
+            data_.push_back(static_cast<char>(value));
+        }
+
+        std::string data_;
+    };
+}
+
+void FrameTracer::Start(size_t events_per_thread)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    // Threads that exited no longer touch their rings
+    registry.erase(std::remove_if(registry.begin(), registry.end(),
+                                  [](const std::unique_ptr<ThreadBuffer>& buffer) { return !buffer->owner_alive.load(std::memory_order_acquire); }),
+                   registry.end());
+
+    capacity = 1;
+    while (capacity < std::max<size_t>(events_per_thread, 16)) capacity <<= 1;
+
+    // What one span costs on this machine: two clock reads and a ring store
+    std::vector<TraceEvent> scratch(256);
+    const int kCalibrationEvents = 4096;
+    auto calibration_start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kCalibrationEvents; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto end = std::chrono::steady_clock::now();
+        scratch[i & 255] = TraceEvent{ static_cast<uint64_t>(i), start.time_since_epoch().count(),
+                                       static_cast<uint32_t>((end - start).count()), TraceStage::Copy };
+    }
+    ns_per_event = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - calibration_start).count() / kCalibrationEvents;
+
+    epoch = std::chrono::steady_clock::now();
+    next_frame.store(0, std::memory_order_relaxed);
+    session.fetch_add(1, std::memory_order_acq_rel);
+    enabled_.store(true, std::memory_order_release);
+}
+
+void FrameTracer::Stop()
+{
+    enabled_.store(false, std::memory_order_release);
+}
+
+uint64_t FrameTracer::BeginFrame()
+{
+    if (!IsEnabled()) return 0;
+
+    thread_slot.current_frame = next_frame.fetch_add(1, std::memory_order_relaxed) + 1;
+    return thread_slot.current_frame;
+}
+
+void FrameTracer::SetCurrentFrame(uint64_t frame_id)
+{
+    thread_slot.current_frame = frame_id;
+}
+
+uint64_t FrameTracer::GetCurrentFrame()
+{
+    return thread_slot.current_frame;
+}
+
+void FrameTracer::SetThreadName(const char* name)
+{
+    if (!IsEnabled()) return;
+
+    ThreadBuffer* buffer = AcquireBuffer();
+    if (buffer->name.empty()) buffer->name = name;
+}
+
+void FrameTracer::Record(TraceStage stage, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+    if (!IsEnabled()) return;
+
+    ThreadBuffer* buffer = AcquireBuffer();
+    const uint64_t index = buffer->written.load(std::memory_order_relaxed);
+
+    TraceEvent& event = buffer->events[index & (buffer->events.size() - 1)];
+    event.frame = thread_slot.current_frame;
+    event.start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(start - epoch).count();
+    event.duration_ns = static_cast<uint32_t>(std::min<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), UINT32_MAX));
+    event.stage = stage;
+
+    buffer->written.store(index + 1, std::memory_order_release);
+}
+
+TraceSummary FrameTracer::GetSummary()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    TraceSummary summary;
+    for (const ThreadBuffer* buffer : GetSessionBuffers())
+    {
+        const uint64_t written = buffer->written.load(std::memory_order_acquire);
+        const uint64_t kept = std::min<uint64_t>(written, buffer->events.size());
+        summary.events += kept;
+        summary.overwritten_events += written - kept;
+        ++summary.threads;
+    }
+
+    summary.ns_per_event = ns_per_event;
+    summary.overhead_ms = (summary.events + summary.overwritten_events) * ns_per_event / 1e6;
+    return summary;
+}
+
+bool FrameTracer::ExportChromeJson(const std::filesystem::path& path)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    const uint32_t process_id = GetCurrentProcessIdentifier();
+    std::ostringstream json;
+    json.setf(std::ios::fixed);
+    json.precision(3);
+    json << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    bool first = true;
+    for (const ThreadBuffer* buffer : GetSessionBuffers())
+    {
+        json << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << process_id << ",\"tid\":" << buffer->thread_id
+             << ",\"args\":{\"name\":\"" << GetTrackName(*buffer) << "\"}}";
+        first = false;
+
+        ForEachEvent(*buffer, [&](const TraceEvent& event)
+        {
+            json << ",\n{\"name\":\"" << GetStageName(event.stage) << "\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":" << event.start_ns / 1e3
+                 << ",\"dur\":" << event.duration_ns / 1e3 << ",\"pid\":" << process_id << ",\"tid\":" << buffer->thread_id
+                 << ",\"args\":{\"frame\":" << event.frame << "}}";
+        });
+
+        // Flush per thread so a long trace never sits in memory twice
+        file << json.str();
+        json.str(std::string());
+    }
+
+    json << "\n]}\n";
+    file << json.str();
+    return static_cast<bool>(file);
+}
+
+bool FrameTracer::ExportPerfetto(const std::filesystem::path& path)
+{
+    // Field numbers from perfetto/protos/perfetto/trace/trace_packet.proto and track_event/*.proto
+    enum : uint32_t
+    {
+        kTracePacket = 1,
+        kPacketTimestamp = 8,
+        kPacketSequenceId = 10,
+        kPacketTrackEvent = 11,
+        kPacketTrackDescriptor = 60,
+        kTrackUuid = 1,
+        kTrackName = 2,
+        kTrackThread = 4,
+        kThreadPid = 1,
+        kThreadTid = 2,
+        kThreadName = 5,
+        kEventDebugAnnotations = 4,
+        kEventType = 9,
+        kEventTrackUuid = 11,
+        kEventCategories = 22,
+        kEventName = 23,
+        kAnnotationUintValue = 3,
+        kAnnotationName = 10,
+        kSliceBegin = 1,
+        kSliceEnd = 2
+    };
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    const uint32_t process_id = GetCurrentProcessIdentifier();
+    const int64_t epoch_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(epoch.time_since_epoch()).count();
+    uint32_t sequence_id = 0;
+
+    for (const ThreadBuffer* buffer : GetSessionBuffers())
+    {
+        ++sequence_id;
+        const uint64_t track_uuid = (static_cast<uint64_t>(process_id) << 32) | buffer->thread_id;
+
+        ProtoWriter thread;
+        thread.Varint(kThreadPid, process_id);
+        thread.Varint(kThreadTid, buffer->thread_id);
+        thread.Bytes(kThreadName, GetTrackName(*buffer));
+
+        ProtoWriter descriptor;
+        descriptor.Varint(kTrackUuid, track_uuid);
+        descriptor.Bytes(kTrackName, GetTrackName(*buffer));
+        descriptor.Message(kTrackThread, thread);
+
+        ProtoWriter descriptor_packet;
+        descriptor_packet.Varint(kPacketSequenceId, sequence_id);
+        descriptor_packet.Message(kPacketTrackDescriptor, descriptor);
+
+        ProtoWriter trace;
+        trace.Message(kTracePacket, descriptor_packet);
+
+        // Track events have no duration, so each span becomes a begin/end pair. Sort so that
+        // back-to-back spans end before the next begins and nested spans close inside out.
+        struct Edge
+        {
+            int64_t time;
+            bool is_end;
+            int64_t order;
+            const TraceEvent* event;
+        };
+        std::vector<Edge> edges;
+        ForEachEvent(*buffer, [&](const TraceEvent& event)
+        {
+            const int64_t end_ns = event.start_ns + event.duration_ns;
+            edges.push_back(Edge{ event.start_ns, false, -static_cast<int64_t>(event.duration_ns), &event });
+            edges.push_back(Edge{ end_ns, true, -event.start_ns, &event });
+        });
+        std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b)
+        {
+            if (a.time != b.time) return a.time < b.time;
+            if (a.is_end != b.is_end) return a.is_end;
+            return a.order < b.order;
+        });
+
+        for (const Edge& edge : edges)
+        {
+            ProtoWriter event;
+            event.Varint(kEventType, edge.is_end ? kSliceEnd : kSliceBegin);
+            event.Varint(kEventTrackUuid, track_uuid);
+            if (!edge.is_end)
+            {
+                ProtoWriter annotation;
+                annotation.Bytes(kAnnotationName, "frame");
+                annotation.Varint(kAnnotationUintValue, edge.event->frame);
+
+                event.Bytes(kEventCategories, "frame");
+                event.Bytes(kEventName, GetStageName(edge.event->stage));
+                event.Message(kEventDebugAnnotations, annotation);
+            }
+
+            ProtoWriter packet;
+            packet.Varint(kPacketTimestamp, static_cast<uint64_t>(epoch_ns + edge.time));
+            packet.Varint(kPacketSequenceId, sequence_id);
+            packet.Message(kPacketTrackEvent, event);
+            trace.Message(kTracePacket, packet);
+        }
+
+        file.write(trace.Data().data(), static_cast<std::streamsize>(trace.Data().size()));
+    }
+
+    return static_cast<bool>(file);
+}
+
+const char* FrameTracer::GetStageName(TraceStage stage)
+{
+    return kStageNames[static_cast<int>(stage)];
+}
@@ -0,0 +1,122 @@
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "HotPathCounters.h"
+
+#ifdef SCREENRECORDER_HOT_PATH_COUNTERS
+
+namespace
+{
+    // Trivial, so they are constant-initialized and safe to touch from inside operator new
+    thread_local AllocationTally thread_tally;
+    thread_local uint64_t thread_copy_bytes[kTraceStageCount];
+
+    void* Allocate(size_t size, size_t alignment)
+    {
+        if (size == 0) size = 1;
+
+        for (;;)
+        {
+            void* memory = nullptr;
+            if (alignment <= alignof(std::max_align_t))
+            {
+                memory = std::malloc(size);
+            }
+            else
+            {
+#ifdef _WIN32
+                memory = _aligned_malloc(size, alignment);
+#else
+                if (posix_memalign(&memory, alignment, size) != 0) memory = nullptr;
+#endif
+            }
+
+            if (memory)
+            {
+                ++thread_tally.allocations;
+                thread_tally.bytes += size;
+                return memory;
+            }
+
+            std::new_handler handler = std::get_new_handler();
+            if (!handler) return nullptr;
+            handler();
+        }
+    }
+
+    void Free(void* memory, size_t alignment)
+    {
+        if (!memory) return;
+
+        ++thread_tally.frees;
+#ifdef _WIN32
+        if (alignment > alignof(std::max_align_t))
+        {
+            _aligned_free(memory);
+            return;
+        }
+#else
+        (void)alignment;
+#endif
+        std::free(memory);
+    }
+
+    void* AllocateOrThrow(size_t size, size_t alignment)
+    {
+        void* memory = Allocate(size, alignment);
+        if (!memory) throw std::bad_alloc();
+        return memory;
+    }
+}
+
+void* operator new(size_t size) { return AllocateOrThrow(size, 0); }
+void* operator new[](size_t size) { return AllocateOrThrow(size, 0); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return Allocate(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return Allocate(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment) { return AllocateOrThrow(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return AllocateOrThrow(size, static_cast<size_t>(alignment)); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return Allocate(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return Allocate(size, static_cast<size_t>(alignment)); }
+
+void operator delete(void* memory) noexcept { Free(memory, 0); }
+void operator delete[](void* memory) noexcept { Free(memory, 0); }
+void operator delete(void* memory, size_t) noexcept { Free(memory, 0); }
+void operator delete[](void* memory, size_t) noexcept { Free(memory, 0); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { Free(memory, 0); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { Free(memory, 0); }
+void operator delete(void* memory, std::align_val_t alignment) noexcept { Free(memory, static_cast<size_t>(alignment)); }
+void operator delete[](void* memory, std::align_val_t alignment) noexcept { Free(memory, static_cast<size_t>(alignment)); }
+void operator delete(void* memory, size_t, std::align_val_t alignment) noexcept { Free(memory, static_cast<size_t>(alignment)); }
+void operator delete[](void* memory, size_t, std::align_val_t alignment) noexcept { Free(memory, static_cast<size_t>(alignment)); }
+void operator delete(void* memory, std::align_val_t alignment, const std::nothrow_t&) noexcept { Free(memory, static_cast<size_t>(alignment)); }
+void operator delete[](void* memory, std::align_val_t alignment, const std::nothrow_t&) noexcept { Free(memory, static_cast<size_t>(alignment)); }
+
+void HotPathCounters::CountCopy(TraceStage stage, uint64_t bytes)
+{
+    thread_copy_bytes[static_cast<int>(stage)] += bytes;
+}
+
+AllocationTally HotPathCounters::GetThreadAllocations()
+{
+    return thread_tally;
+}
+
+uint64_t HotPathCounters::GetThreadCopyBytes(TraceStage stage)
+{
+    return thread_copy_bytes[static_cast<int>(stage)];
+}
+
+#else
+
+AllocationTally HotPathCounters::GetThreadAllocations()
+{
+    return AllocationTally{};
+}
+
+uint64_t HotPathCounters::GetThreadCopyBytes(TraceStage)
+{
+    return 0;
+}
+
+#endif
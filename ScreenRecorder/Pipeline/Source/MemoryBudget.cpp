@@ -0,0 +1,122 @@
+#include "MemoryBudget.h"
+
+MemoryBudget::Reservation& MemoryBudget::Reservation::operator=(Reservation&& other) noexcept
+{
+    if (this != &other)
+    {
+        Reset();
+        budget_ = other.budget_;
+        bytes_ = other.bytes_;
+        other.budget_ = nullptr;
+        other.bytes_ = 0;
+    }
+    return *this;
+}
+
+void MemoryBudget::Reservation::Reset()
+{
+    if (budget_ && bytes_)
+    {
+        budget_->Release(bytes_);
+    }
+    budget_ = nullptr;
+    bytes_ = 0;
+}
+
+MemoryBudget* MemoryBudget::Reservation::Detach()
+{
+    MemoryBudget* budget = budget_;
+    budget_ = nullptr;
+    bytes_ = 0;
+    return budget;
+}
+
+MemoryBudget::MemoryBudget(uint64_t limit_bytes)
+    : limit_(limit_bytes)
+{
+}
+
+bool MemoryBudget::TryReserve(uint64_t bytes)
+{
+    // Sequentially consistent load pairs with the waiter handshake in Reserve/Release
+    uint64_t usage = usage_.load();
+    do
+    {
+        if (usage + bytes > limit_.load(std::memory_order_relaxed)) return false;
+    }
+    while (!usage_.compare_exchange_weak(usage, usage + bytes, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+    UpdatePeak();
+    return true;
+}
+
+MemoryBudget::Reservation MemoryBudget::Charge(uint64_t bytes)
+{
+    usage_.fetch_add(bytes, std::memory_order_acq_rel);
+    UpdatePeak();
+    return Reservation(this, bytes);
+}
+
+void MemoryBudget::AddCached(uint64_t bytes)
+{
+    // Cached buffers come back from use, where they were already counted, so the peak stands
+    cached_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void MemoryBudget::RemoveCached(uint64_t bytes)
+{
+    cached_.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void MemoryBudget::UpdatePeak()
+{
+    const uint64_t held = usage_.load(std::memory_order_relaxed) + cached_.load(std::memory_order_relaxed);
+    uint64_t peak = peak_.load(std::memory_order_relaxed);
+    while (held > peak && !peak_.compare_exchange_weak(peak, held, std::memory_order_relaxed))
+    {
+    }
+}
+
+bool MemoryBudget::Reserve(uint64_t bytes, std::chrono::milliseconds timeout)
+{
+    if (TryReserve(bytes)) return true;
+    if (bytes > limit_.load(std::memory_order_relaxed)) return false;
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    std::unique_lock<std::mutex> lock(wait_mutex_);
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+
+    bool reserved = false;
+    while (!(reserved = TryReserve(bytes)))
+    {
+        if (released_.wait_until(lock, deadline) == std::cv_status::timeout)
+        {
+            reserved = TryReserve(bytes);
+            break;
+        }
+    }
+
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+    return reserved;
+}
+
+void MemoryBudget::Release(uint64_t bytes)
+{
+    usage_.fetch_sub(bytes, std::memory_order_seq_cst);
+
+    // Taking the mutex orders this against a waiter between its failed TryReserve and its wait
+    if (waiters_.load(std::memory_order_seq_cst) > 0)
+    {
+        std::lock_guard<std::mutex> lock(wait_mutex_);
+        released_.notify_all();
+    }
+}
+
+void MemoryBudget::SetLimit(uint64_t limit_bytes)
+{
+    limit_.store(limit_bytes, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(wait_mutex_);
+    released_.notify_all();
+}
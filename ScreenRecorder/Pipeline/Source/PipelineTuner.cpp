@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "PipelineTuner.h"
+
+PipelineTuner::PipelineTuner(const PipelineTunerConfig& config, double frame_interval_ms, int pool_buffers, size_t queue_capacity)
+    : config_(config), frame_interval_ms_(frame_interval_ms > 0 ? frame_interval_ms : 1000.0 / 60.0)
+{
+    config_.min_pool_buffers = std::max(1, config_.min_pool_buffers);
+    config_.max_pool_buffers = std::max(config_.min_pool_buffers, config_.max_pool_buffers);
+    config_.min_queue_capacity = std::max<size_t>(1, config_.min_queue_capacity);
+    config_.max_queue_capacity = std::max(config_.min_queue_capacity, config_.max_queue_capacity);
+    config_.calm_windows = std::max(1, config_.calm_windows);
+
+    pool_buffers_ = std::clamp(pool_buffers, config_.min_pool_buffers, config_.max_pool_buffers);
+    queue_capacity_ = queue_capacity == 0 ? 0 : std::clamp(queue_capacity, config_.min_queue_capacity, config_.max_queue_capacity);
+}
+
+TunerDecision PipelineTuner::Observe(const TunerWindow& window)
+{
+    TunerDecision decision;
+    decision.window = ++windows_;
+
+    TunePool(window, decision.reason);
+    if (queue_capacity_ > 0) TuneQueue(window, decision.reason);
+
+    decision.pool_buffers = pool_buffers_;
+    decision.queue_capacity = queue_capacity_;
+
+    if (!decision.reason.empty())
+    {
+        std::lock_guard<std::mutex> lock(log_mutex_);
+        log_.push_back(decision);
+    }
+
+    return decision;
+}
+
+std::vector<TunerDecision> PipelineTuner::GetLog() const
+{
+    std::lock_guard<std::mutex> lock(log_mutex_);
+    return log_;
+}
+
+void PipelineTuner::TunePool(const TunerWindow& window, std::string& reason)
+{
+    const int needed = std::clamp(static_cast<int>(std::ceil(window.max_hold_ms / frame_interval_ms_)) + 1,
+                                  config_.min_pool_buffers, config_.max_pool_buffers);
+
+    if (needed > pool_buffers_)
+    {
+        std::ostringstream text;
+        text << "pool " << pool_buffers_ << "->" << needed << ": buffer held " << window.max_hold_ms << " ms";
+        reason = text.str();
+        pool_buffers_ = needed;
+        calm_pool_windows_ = 0;
+        return;
+    }
+
+    calm_pool_windows_ = needed < pool_buffers_ ? calm_pool_windows_ + 1 : 0;
+    if (calm_pool_windows_ >= config_.calm_windows)
+    {
+        std::ostringstream text;
+        text << "pool " << pool_buffers_ << "->" << pool_buffers_ - 1 << ": " << calm_pool_windows_ << " windows needing " << needed;
+        reason = text.str();
+        --pool_buffers_;
+        calm_pool_windows_ = 0;
+    }
+}
+
+void PipelineTuner::TuneQueue(const TunerWindow& window, std::string& reason)
+{
+    auto append = [&](const std::string& text) { reason += reason.empty() ? text : "; " + text; };
+
+    const double drop_rate = window.frames ? static_cast<double>(window.dropped) / window.frames : 0.0;
+    const double p99 = window.latency_p99_ms;
+
+    // A full queue's latency grows with its length, so sizes are scaled against the budget.
+    // Growth aims below the budget so it does not undo the next shrink.
+    if (p99 > config_.latency_budget_ms && queue_capacity_ > config_.min_queue_capacity)
+    {
+        const size_t fitted = static_cast<size_t>(queue_capacity_ * config_.latency_budget_ms / p99);
+        const size_t shrunk = std::max(config_.min_queue_capacity, std::min(fitted, queue_capacity_ - 1));
+
+        std::ostringstream text;
+        text << "queue " << queue_capacity_ << "->" << shrunk << ": p99 " << p99 << " ms is over budget";
+        append(text.str());
+        queue_capacity_ = shrunk;
+        calm_queue_windows_ = 0;
+        return;
+    }
+
+    if (drop_rate > config_.max_drop_rate)
+    {
+        calm_queue_windows_ = 0;
+        if (queue_capacity_ >= config_.max_queue_capacity) return;
+
+        size_t grown = std::min(queue_capacity_ * 2, config_.max_queue_capacity);
+        if (p99 > 0.0)
+        {
+            grown = std::min(grown, static_cast<size_t>(queue_capacity_ * kGrowthBudget * config_.latency_budget_ms / p99));
+        }
+
+        std::ostringstream text;
+        if (grown <= queue_capacity_)
+        {
+            // More queue would only trade drops for latency; the sink is too slow
+            if (!latency_bound_)
+            {
+                text << "queue stays " << queue_capacity_ << ": " << window.dropped << " drops but p99 " << p99 << " ms is near budget";
+                append(text.str());
+                latency_bound_ = true;
+            }
+            return;
+        }
+
+        text << "queue " << queue_capacity_ << "->" << grown << ": " << window.dropped << " of " << window.frames << " frames dropped";
+        append(text.str());
+        queue_capacity_ = grown;
+        latency_bound_ = false;
+        return;
+    }
+
+    latency_bound_ = false;
+
+    // Keep one spare slot above the deepest backlog seen
+    const size_t floor = std::max(config_.min_queue_capacity, window.queue_peak_depth + 1);
+    calm_queue_windows_ = window.queue_peak_depth * 2 < queue_capacity_ && floor < queue_capacity_ ? calm_queue_windows_ + 1 : 0;
+    if (calm_queue_windows_ >= config_.calm_windows)
+    {
+        std::ostringstream text;
+        text << "queue " << queue_capacity_ << "->" << queue_capacity_ - 1 << ": peak depth " << window.queue_peak_depth
+             << " for " << calm_queue_windows_ << " windows";
+        append(text.str());
+        --queue_capacity_;
+        calm_queue_windows_ = 0;
+    }
+}
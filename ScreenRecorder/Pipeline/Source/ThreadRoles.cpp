@@ -0,0 +1,239 @@
+#include <cstdlib>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "ThreadRoles.h"
+
+std::atomic<uint32_t> ThreadRoles::next_generation_{ 0 };
+
+namespace
+{
+    const char* const kRoleNames[kThreadRoleCount] = { "capture", "convert", "encode", "io", "stats" };
+}
+
+void ThreadRoles::Configure(ThreadRole role, const ThreadRoleConfig& config)
+{
+    configs_[static_cast<int>(role)] = config;
+    Touch();
+}
+
+bool ThreadRoles::SetTargetProcess(uint32_t process_id)
+{
+    uint64_t core_mask = 0;
+
+#ifdef _WIN32
+    HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, process_id);
+    if (!process) return false;
+
+    DWORD_PTR process_mask = 0;
+    DWORD_PTR system_mask = 0;
+    BOOL result = GetProcessAffinityMask(process, &process_mask, &system_mask);
+    CloseHandle(process);
+    if (!result) return false;
+
+    core_mask = process_mask;
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(static_cast<pid_t>(process_id), sizeof(set), &set) != 0) return false;
+
+    for (int core = 0; core < 64; ++core)
+    {
+        if (CPU_ISSET(core, &set)) core_mask |= 1ull << core;
+    }
+#endif
+
+    SetTargetCores(core_mask);
+    return true;
+}
+
+uint64_t ThreadRoles::GetEffectiveAffinity(ThreadRole role) const
+{
+    const ThreadRoleConfig& config = GetConfig(role);
+    const uint64_t process_cores = GetProcessCores();
+
+    uint64_t mask = config.affinity_mask ? config.affinity_mask & process_cores : process_cores;
+    if (mask == 0) mask = process_cores;
+
+    if (config.isolate_from_target)
+    {
+        // A target allowed on every core (the usual case) leaves nothing to avoid
+        uint64_t isolated = mask & ~GetTargetCores();
+        if (isolated != 0) mask = isolated;
+    }
+
+    return mask;
+}
+
+bool ThreadRoles::ApplyToCurrentThread(ThreadRole role) const
+{
+    const ThreadRoleConfig& config = GetConfig(role);
+
+#ifdef _WIN32
+    std::string name = std::string("ZA ") + GetRoleName(role);
+    SetThreadDescription(GetCurrentThread(), std::wstring(name.begin(), name.end()).c_str());
+#else
+    pthread_setname_np(pthread_self(), (std::string("za-") + GetRoleName(role)).c_str());
+#endif
+
+    bool result = true;
+    if (config.affinity_mask != 0 || config.isolate_from_target)
+    {
+        result = SetCurrentThreadAffinity(GetEffectiveAffinity(role));
+    }
+
+    return SetCurrentThreadPriority(config.priority) && result;
+}
+
+void ThreadRoles::EnsureApplied(ThreadRole role) const
+{
+    thread_local uint32_t applied_generation[kThreadRoleCount] = {};
+
+    uint32_t generation = generation_.load(std::memory_order_acquire);
+    if (generation == 0 || applied_generation[static_cast<int>(role)] == generation) return;
+
+    applied_generation[static_cast<int>(role)] = generation;
+    ApplyToCurrentThread(role);
+}
+
+const char* ThreadRoles::GetRoleName(ThreadRole role)
+{
+    return kRoleNames[static_cast<int>(role)];
+}
+
+bool ThreadRoles::ParseRole(const std::string& name, ThreadRole& role)
+{
+    for (int i = 0; i < kThreadRoleCount; ++i)
+    {
+        if (name == kRoleNames[i])
+        {
+            role = static_cast<ThreadRole>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadRoles::ParsePriority(const std::string& name, ThreadPriority& priority)
+{
+    if (name == "below-normal") priority = ThreadPriority::BelowNormal;
+    else if (name == "normal") priority = ThreadPriority::Normal;
+    else if (name == "above-normal") priority = ThreadPriority::AboveNormal;
+    else if (name == "highest") priority = ThreadPriority::Highest;
+    else if (name == "time-critical") priority = ThreadPriority::TimeCritical;
+    else return false;
+
+    return true;
+}
+
+bool ThreadRoles::ParseCoreList(const std::string& list, uint64_t& core_mask)
+{
+    core_mask = 0;
+    size_t position = 0;
+
+    while (position < list.size())
+    {
+        size_t end = list.find(',', position);
+        if (end == std::string::npos) end = list.size();
+
+        std::string range = list.substr(position, end - position);
+        size_t dash = range.find('-');
+
+        char* parse_end = nullptr;
+        long first = std::strtol(range.c_str(), &parse_end, 10);
+        long last = dash == std::string::npos ? first : std::strtol(range.c_str() + dash + 1, &parse_end, 10);
+        if (range.empty() || *parse_end != '\0' || first < 0 || last < first || last > 63) return false;
+
+        for (long core = first; core <= last; ++core)
+        {
+            core_mask |= 1ull << core;
+        }
+
+        position = end + 1;
+    }
+
+    return core_mask != 0;
+}
+
+uint64_t ThreadRoles::GetProcessCores()
+{
+#ifdef _WIN32
+    DWORD_PTR process_mask = 0;
+    DWORD_PTR system_mask = 0;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask)) return ~0ull;
+
+    return process_mask;
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return ~0ull;
+
+    uint64_t core_mask = 0;
+    for (int core = 0; core < 64; ++core)
+    {
+        if (CPU_ISSET(core, &set)) core_mask |= 1ull << core;
+    }
+    return core_mask;
+#endif
+}
+
+bool ThreadRoles::SetCurrentThreadAffinity(uint64_t core_mask)
+{
+#ifdef _WIN32
+    return SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(core_mask)) != 0;
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int core = 0; core < 64; ++core)
+    {
+        if (core_mask & (1ull << core)) CPU_SET(core, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
+
+bool ThreadRoles::SetCurrentThreadPriority(ThreadPriority priority)
+{
+#ifdef _WIN32
+    int thread_priority = THREAD_PRIORITY_NORMAL;
+    switch (priority)
+    {
+    case ThreadPriority::BelowNormal: thread_priority = THREAD_PRIORITY_BELOW_NORMAL; break;
+    case ThreadPriority::AboveNormal: thread_priority = THREAD_PRIORITY_ABOVE_NORMAL; break;
+    case ThreadPriority::Highest: thread_priority = THREAD_PRIORITY_HIGHEST; break;
+    case ThreadPriority::TimeCritical: thread_priority = THREAD_PRIORITY_TIME_CRITICAL; break;
+    default: break;
+    }
+    return SetThreadPriority(GetCurrentThread(), thread_priority) != 0;
+#else
+    if (priority == ThreadPriority::TimeCritical)
+    {
+        sched_param param{};
+        param.sched_priority = 10;
+        return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+    }
+
+    sched_param param{};
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+
+    // Linux nice values are per thread when addressed by tid
+    int nice_value = 0;
+    switch (priority)
+    {
+    case ThreadPriority::BelowNormal: nice_value = 5; break;
+    case ThreadPriority::AboveNormal: nice_value = -5; break;
+    case ThreadPriority::Highest: nice_value = -10; break;
+    default: break;
+    }
+    return setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), nice_value) == 0;
+#endif
+}
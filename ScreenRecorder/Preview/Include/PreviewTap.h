@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "DirtyRegion.h"
+
+struct PreviewFrame
+{
+    int width = 0;
+    int height = 0;
+    uint64_t sequence = 0;
+    std::vector<uint8_t> pixels;        // BGRA, tightly packed
+};
+
+// Taps the recording path for a low-rate thumbnail. The recording thread box-downsamples
+// at most max_fps times a second into a triple-buffered single-slot mailbox; the UI thread
+// picks up the newest thumbnail without either side ever waiting on the other.
+class PreviewTap
+{
+public:
+    explicit PreviewTap(int max_fps = 5, int max_width = 240);
+
+    void SetEnabled(bool enabled) { is_enabled_.store(enabled, std::memory_order_relaxed); }
+
+    // Recording thread. Returns immediately unless a new thumbnail is due; changes are gathered
+    // until then, and only their blocks are downsampled again.
+    void OnFrame(const uint8_t* image, ptrdiff_t pitch, int width, int height, const DirtyRegion& dirty);
+
+    // UI thread. Returns the newest published thumbnail, or nullptr if nothing new arrived since
+    // the last call. The frame stays valid until the next call.
+    const PreviewFrame* AcquireLatest();
+
+    // Total time spent inside OnFrame, for hot-path overhead accounting
+    uint64_t GetCostNs() const { return cost_ns_.load(std::memory_order_relaxed); }
+    void ResetCost() { cost_ns_.store(0, std::memory_order_relaxed); }
+
+private:
+    static constexpr uint32_t kFreshFlag = 4;   // Set on the shared index when the producer published since the last read
+
+    std::chrono::nanoseconds min_interval_;
+    int max_width_;
+
+    PreviewFrame slots_[3];
+    uint32_t producer_slot_ = 0;                // Owned by the recording thread
+    uint32_t consumer_slot_ = 1;                // Owned by the UI thread
+    std::atomic<uint32_t> shared_slot_{ 2 };    // Slot index | kFreshFlag
+    uint64_t sequence_ = 0;
+
+    std::vector<uint8_t> thumbnail_;            // Kept between publishes so unchanged blocks carry over
+    int thumbnail_factor_ = 0;
+    int thumbnail_width_ = 0;
+    int thumbnail_height_ = 0;
+    DirtyRegion pending_dirty_;                 // Changed since thumbnail_ was last brought up to date
+
+    std::chrono::steady_clock::time_point next_due_{};
+    std::atomic<bool> is_enabled_{ true };
+    std::atomic<uint64_t> cost_ns_{ 0 };
+};
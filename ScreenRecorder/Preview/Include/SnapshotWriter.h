@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FramePool.h"
+#include "PngEncoder.h"
+
+struct SnapshotResult
+{
+    std::wstring path;
+    int width = 0;
+    int height = 0;
+    bool saved = false;
+    double pin_us = 0.0;            // Recording thread: taking a reference, or the copy for a frame without an owner
+    double wait_ms = 0.0;           // Request to frame pinned
+    double encode_ms = 0.0;
+    size_t bytes = 0;
+};
+
+// Lossless PNG stills taken while recording, without holding up the recording path. A request
+// pins the next frame that goes by: for a pooled frame that is one more reference, so the pixels
+// stay put while the pool hands out other buffers. A background thread at below-normal priority
+// encodes the PNG across several cores and drops the reference when done.
+class SnapshotWriter
+{
+public:
+    // encode_threads = 0 uses half the cores, leaving the rest to the encoder
+    explicit SnapshotWriter(int encode_threads = 0);
+    ~SnapshotWriter();
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    // Any thread. The next BGRA frame through OnFrame is written to path.
+    void Request(const std::wstring& path);
+    // Recording thread. A single atomic load unless a snapshot is waiting for a frame.
+    void OnFrame(const FrameDescriptor& frame);
+    // Waits until every pinned snapshot is written. Requests no frame has arrived for stay pending.
+    void Flush();
+
+    bool HasPending() const { return pending_.load(std::memory_order_relaxed) > 0; }
+    // Copies of frames without an owner are held against it; pinned frames already are by their owner
+    void SetMemoryBudget(MemoryBudget* budget) { pool_.SetMemoryBudget(budget); }
+    std::vector<SnapshotResult> GetResults() const;
+
+private:
+    struct PendingRequest
+    {
+        std::wstring path;
+        std::chrono::steady_clock::time_point requested;
+    };
+
+    struct Job
+    {
+        std::vector<PendingRequest> requests;   // Every request that was waiting shares the frame
+        FrameDescriptor frame;              // Owned
+        double pin_us = 0.0;
+        std::chrono::steady_clock::time_point pinned;
+    };
+
+    void RunWorker();
+
+    int encode_threads_;
+    std::atomic<uint32_t> pending_{ 0 };
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    std::vector<PendingRequest> requests_;
+    std::vector<Job> jobs_;                 // Room for one per request, reserved by Request
+    std::vector<SnapshotResult> results_;
+    bool is_busy_ = false;
+    bool stop_ = false;
+    std::thread worker_;                    // Started with the first request
+
+    FramePool pool_;                        // Copies of frames that arrive without an owner
+};
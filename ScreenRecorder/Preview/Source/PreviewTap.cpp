@@ -0,0 +1,62 @@
+#include <algorithm>
+
+#include "FrameKernels.h"
+#include "PreviewTap.h"
+
+PreviewTap::PreviewTap(int max_fps, int max_width)
+    : min_interval_(std::chrono::nanoseconds(1000000000LL / std::max(1, max_fps))),
+      max_width_(max_width)
+{
+}
+
+void PreviewTap::OnFrame(const uint8_t* image, ptrdiff_t pitch, int width, int height, const DirtyRegion& dirty)
+{
+    if (!is_enabled_.load(std::memory_order_relaxed))
+    {
+        // Frames go by unseen, so the thumbnail can't be patched any more
+        pending_dirty_ = DirtyRegion();
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    pending_dirty_.Add(dirty.ForFrame(width, height));
+    if (start < next_due_) return;
+    next_due_ = start + min_interval_;
+
+    // Integer factor so the kernel stays a pure box filter; 16 is its accumulator limit
+    int factor = std::clamp((width + max_width_ - 1) / max_width_, 1, 16);
+
+    if (factor != thumbnail_factor_ || width / factor != thumbnail_width_ || height / factor != thumbnail_height_)
+    {
+        thumbnail_factor_ = factor;
+        thumbnail_width_ = width / factor;
+        thumbnail_height_ = height / factor;
+        thumbnail_.resize(static_cast<size_t>(thumbnail_width_) * thumbnail_height_ * 4);
+        pending_dirty_ = DirtyRegion::Full(width, height);
+    }
+
+    if (thumbnail_width_ > 0 && thumbnail_height_ > 0)
+    {
+        FrameKernels::DownsampleBgraBoxRegion(image, pitch, factor, thumbnail_.data(), thumbnail_width_ * 4, pending_dirty_);
+    }
+    pending_dirty_ = DirtyRegion(width, height);
+
+    PreviewFrame& frame = slots_[producer_slot_];
+    frame.width = thumbnail_width_;
+    frame.height = thumbnail_height_;
+    frame.sequence = ++sequence_;
+    frame.pixels.assign(thumbnail_.begin(), thumbnail_.end());
+
+    producer_slot_ = shared_slot_.exchange(producer_slot_ | kFreshFlag, std::memory_order_acq_rel) & ~kFreshFlag;
+
+    cost_ns_.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(),
+                       std::memory_order_relaxed);
+}
+
+const PreviewFrame* PreviewTap::AcquireLatest()
+{
+    if ((shared_slot_.load(std::memory_order_relaxed) & kFreshFlag) == 0) return nullptr;
+
+    consumer_slot_ = shared_slot_.exchange(consumer_slot_, std::memory_order_acq_rel) & ~kFreshFlag;
+    return &slots_[consumer_slot_];
+}
@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+#include "FrameKernels.h"
+#include "FrameTracer.h"
+#include "HotPathCounters.h"
+#include "SnapshotWriter.h"
+#include "ThreadRoles.h"
+
+namespace
+{
+    double ElapsedMs(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+    {
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    bool WriteFile(const std::wstring& path, const std::vector<uint8_t>& data)
+    {
+        std::ofstream file(std::filesystem::path(path), std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        return static_cast<bool>(file);
+    }
+}
+
+SnapshotWriter::SnapshotWriter(int encode_threads)
+    : encode_threads_(encode_threads > 0 ? encode_threads : std::max(1, static_cast<int>(std::thread::hardware_concurrency()) / 2)),
+      pool_(1)
+{
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    if (worker_.joinable()) worker_.join();
+}
+
+void SnapshotWriter::Request(const std::wstring& path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    requests_.push_back({ path, std::chrono::steady_clock::now() });
+    // Room for the job the waiting requests become, so pinning it on the recording thread allocates nothing
+    jobs_.reserve(jobs_.size() + 1);
+    pending_.fetch_add(1, std::memory_order_release);
+    if (!worker_.joinable()) worker_ = std::thread([this] { RunWorker(); });
+}
+
+void SnapshotWriter::OnFrame(const FrameDescriptor& frame)
+{
+    if (pending_.load(std::memory_order_acquire) == 0) return;
+    if (frame.format != FrameFormat::Bgra || !frame.IsValid()) return;
+
+    auto pin_start = std::chrono::steady_clock::now();
+    Job job;
+    RetainedFrame retained = RetainFrame(frame, pool_);
+    if (retained.fill)
+    {
+        TraceSpan copy_span(TraceStage::Copy);
+        const size_t row_bytes = frame.GetRowBytes(0);
+        FrameKernels::CopyImage(retained.fill, row_bytes, frame.planes[0].data, frame.planes[0].pitch, row_bytes, frame.height);
+        HotPathCounters::CountCopy(TraceStage::Copy, row_bytes * frame.height);
+    }
+    job.frame = FrameDescriptor::Packed(retained.data, FrameFormat::Bgra, frame.width, frame.height, frame.timestamp);
+    job.frame.owner = std::move(retained.owner);
+    job.pinned = std::chrono::steady_clock::now();
+    job.pin_us = ElapsedMs(pin_start, job.pinned) * 1e3;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job.requests.swap(requests_);
+        pending_.fetch_sub(static_cast<uint32_t>(job.requests.size()), std::memory_order_relaxed);
+        jobs_.push_back(std::move(job));
+    }
+    wake_.notify_one();
+}
+
+void SnapshotWriter::Flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [&] { return jobs_.empty() && !is_busy_; });
+}
+
+std::vector<SnapshotResult> SnapshotWriter::GetResults() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return results_;
+}
+
+void SnapshotWriter::RunWorker()
+{
+    FrameTracer::SetThreadName("snapshot");
+    ThreadRoles::SetCurrentThreadPriority(ThreadPriority::BelowNormal);
+
+    PngEncoder encoder(encode_threads_, [] { ThreadRoles::SetCurrentThreadPriority(ThreadPriority::BelowNormal); });
+    std::vector<uint8_t> png;
+
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&] { return stop_ || !jobs_.empty(); });
+            if (jobs_.empty()) break;
+
+            job = std::move(jobs_.front());
+            jobs_.erase(jobs_.begin());
+            is_busy_ = true;
+        }
+
+        auto encode_start = std::chrono::steady_clock::now();
+        const bool encoded = encoder.Encode(job.frame, png);
+        const double encode_ms = ElapsedMs(encode_start, std::chrono::steady_clock::now());
+
+        // Back to the pool before the file writes
+        job.frame.owner.reset();
+
+        std::vector<SnapshotResult> results;
+        for (const PendingRequest& request : job.requests)
+        {
+            SnapshotResult result;
+            result.path = request.path;
+            result.width = job.frame.width;
+            result.height = job.frame.height;
+            result.saved = encoded && WriteFile(request.path, png);
+            result.pin_us = job.pin_us;
+            result.wait_ms = ElapsedMs(request.requested, job.pinned);
+            result.encode_ms = encode_ms;
+            result.bytes = encoded ? png.size() : 0;
+            results.push_back(std::move(result));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            results_.insert(results_.end(), results.begin(), results.end());
+            is_busy_ = false;
+        }
+        idle_.notify_all();
+    }
+}
@@ -1,8 +1,35 @@
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include "FilterChainSink.h"
+#include "FramePipeline.h"
+#include "FrameQueue.h"
+#include "FrameTracer.h"
+#include "LatencyHistogram.h"
+#include "LiveStreamer.h"
+#include "MemoryBudget.h"
+#include "PipelineTuner.h"
+#include "PreviewTap.h"
+#include "RawVideoWriter.h"
+#include "SceneChangeDetector.h"
+#include "SharedFramePublisher.h"
+#include "SimulcastSink.h"
+#include "SnapshotWriter.h"
+#include "SyntheticFrameSource.h"
+#include "ThreadRoles.h"
+#include "TimeLapseSink.h"
+#include "VideoCodec.h"
+
+#ifdef _WIN32
 #include "CaptureEngine.h"
+#include "StreamEncoder.h"
 #include "VideoEncoder.h"
+#endif
 
 
 struct RecordingParams
@@ -13,36 +40,213 @@ struct RecordingParams
 	int bitrate;
 };
 
+enum class OutputMode
+{
+	Encoded,
+	RawBgra,
+	RawNv12,
+	Stream			// Low-latency H.264/H.265 as MPEG-TS over UDP; no file is written
+};
+
+enum class HdrMode
+{
+	Off,			// BGRA capture
+	Hdr10,			// FP16 capture encoded as BT.2020 PQ 10-bit; Encoded mode with H265 or AV1
+	ToneMapSdr		// FP16 capture tone-mapped to BGRA on arrival; everything downstream stays SDR
+};
+
+// An extra encode of the same capture, written next to the main file as <name>_<width>x<height>.mp4
+struct RenditionConfig
+{
+	int width;
+	int height;
+	int bitrate;
+	VideoCodec codec;
+};
+
+struct RecordingStats
+{
+	uint64_t frames_received;
+	uint64_t frames_encoded;
+	uint64_t frames_failed;
+	double duration_seconds;
+	double average_encode_ms;
+	double max_encode_ms;
+	double average_preview_us;
+	double preview_overhead_percent;	// Preview tap time relative to encode time on the capture thread
+	uint64_t frames_dropped;			// Rejected by backpressure before reaching the sink
+	uint64_t frames_downscaled;
+	uint64_t memory_budget_bytes;
+	uint64_t memory_in_use_bytes;		// Queued frames, encoder samples, sink buffers and the pools' free buffers
+	uint64_t memory_cached_bytes;		// Of which free buffers kept for reuse
+	uint64_t memory_peak_bytes;
+	uint64_t queue_peak_depth;
+	double producer_blocked_ms;
+	double latency_p50_ms;				// Capture callback to sink done
+	double latency_p99_ms;
+	double latency_max_ms;
+	uint64_t scene_cuts;
+	uint64_t static_frames;
+	uint64_t keyframes_forced;			// Accepted by the encoder
+	double average_scene_detect_us;
+	uint64_t trace_events;
+	uint64_t trace_overwritten_events;	// Oldest spans lost to the per-thread rings
+	double trace_overhead_ms;			// Calibrated cost of recording the spans
+	double trace_overhead_percent;		// Relative to encode time
+	uint64_t tuner_adjustments;			// Entries in the auto-tuner's decision log
+	uint64_t queue_capacity;			// Current, which the tuner may have moved
+	int frame_pool_buffers;
+	uint64_t stream_bytes;				// UDP payload sent, FEC and retransmissions included
+	double stream_packetize_p99_ms;		// Encoded access unit to last datagram sent
+	uint64_t stream_retransmits;
+	uint64_t time_lapse_frames;			// Output frames, one per interval
+	uint64_t time_lapse_repeated;		// Intervals without a new capture
+	double average_time_lapse_us;		// Blend cost per captured frame
+	uint64_t shared_frames_published;
+	double average_shared_publish_us;
+	double average_filter_us;			// Filter chain per frame
+	uint64_t filter_bytes_per_frame;	// Its traffic to frame-sized buffers, read and written
+};
+
 class ScreenRecorder
 {
 public:
 	ScreenRecorder();
 	~ScreenRecorder();
 	
-	bool Initialize(int monitor_number, int width, int height, int fps, int bitrate);
+	bool Initialize(int monitor_number, int width, int height, int fps, int bitrate, VideoCodec codec = VideoCodec::H264);
 
+#ifdef _WIN32
 	bool StartMonitorCapture(HMONITOR monitor);
 	bool StartWindowCapture(HWND window_handle);
+#endif
+	bool StartSyntheticCapture(bool paced = true, SyntheticPattern pattern = SyntheticPattern::Motion);
+	// False if the output could not be finalized, e.g. the encoder failed to write the MP4 index
 	bool StopCapture();
 	bool CreateOutputFolder(const std::wstring& folder_path);
+	void SetOutputFile(const std::wstring& folder_path, const std::wstring& file_name);
+	void SetOutputMode(OutputMode output_mode) { output_mode_ = output_mode; }
+	// Destination and transport for OutputMode::Stream. Applies from the next Initialize.
+	void SetStreamConfig(const StreamConfig& config) { stream_config_ = config; }
+	// Frames queued between capture and the sink; 0 encodes on the capture thread. Applies from the next Start*Capture.
+	void SetFrameQueue(size_t capacity, uint64_t memory_budget_bytes, BackpressurePolicy policy);
+	// Keyframes on scene cuts and after activity settles, with a long encoder GOP in between. Applies from the next Initialize.
+	void SetSceneDetection(bool enabled, double gop_seconds = 10.0);
+	// Applies from the next Initialize. sdr_white_nits is where SDR white sits on the desktop
+	// (Windows' SDR content brightness), peak_nits the brightest highlight kept by the tone map.
+	void SetHdrMode(HdrMode mode, float sdr_white_nits = 203.0f, float peak_nits = 1000.0f);
+	// Encoded mode, not HDR10. The capture is read back once and scaled once per rendition, each
+	// encoding on a worker of its own alongside the main encoder. Applies from the next Initialize.
+	void SetRenditions(const std::vector<RenditionConfig>& renditions) { renditions_ = renditions; }
+	// Main output first; empty without renditions
+	std::vector<RenditionStats> GetRenditionStats() const;
+	// Encoded mode, not HDR10. Every interval_seconds of capture becomes one output frame, played
+	// back at playback_fps; 0 turns it off. Scene detection is skipped. Applies from the next Initialize.
+	void SetTimeLapse(double interval_seconds, TimeLapseBlend blend = TimeLapseBlend::Average, int playback_fps = 30);
+	// Resizes the capture frame pool and the frame queue every tuning window from drops, latency
+	// and buffer hold times, within the config's bounds. Applies from the next Start*Capture.
+	void SetAutoTune(bool enabled, const PipelineTunerConfig& config = {});
+	std::vector<TunerDecision> GetTunerLog() const;
+	// Per-frame stage spans, recorded from the next Start*Capture until StopCapture
+	void SetTracing(bool enabled, size_t events_per_thread = 1 << 16);
+	// Perfetto protobuf for .pftrace/.perfetto-trace, Chrome trace JSON otherwise. Call after StopCapture.
+	bool ExportTrace(const std::wstring& path) const;
 	std::wstring GetOutputPath() const { return output_path_; }
+	std::wstring GetOutputFileName() const { return output_filename_; }
 	bool IsInitialized() const { return is_initialized_; }
+	RecordingStats GetStats() const;
+	// Configure before Start*Capture; window capture sets the target process for isolation
+	ThreadRoles& GetThreadRoles() { return thread_roles_; }
+	const PreviewFrame* AcquirePreview() { return preview_tap_.AcquireLatest(); }
+	// Every frame the sink gets also goes to a shared-memory ring of that name, which local
+	// processes read with SharedFrameReader; empty turns it off. Applies from the next Initialize.
+	void SetSharedFrames(const std::string& name, int slots = 4);
+	// Not HDR10. Every frame is cropped and resized, with the overlay blended in, before any
+	// encoder or raw writer sees it, and the output is that size; raw NV12 gets it converted in the
+	// same pass. Snapshots, shared frames and scene detection still see the capture. Applies from
+	// the next Initialize; enabled = false turns it off.
+	void SetFilterChain(const FilterChainConfig& config, bool enabled = true);
+	// Straight-alpha BGRA placed in output pixels (a cursor, a watermark). After Initialize with a
+	// filter chain; from any thread while recording.
+	void SetOverlay(const uint8_t* bgra, ptrdiff_t pitch, int width, int height);
+	void SetOverlayPosition(int x, int y);
+	// Lossless PNG of the next frame, pinned and encoded off the recording path. Not with HDR10.
+	bool RequestSnapshot(const std::wstring& path);
+	// Waits for snapshots already pinned to be written
+	std::vector<SnapshotResult> GetSnapshotResults();
 
 private:
 	bool CreateAndGetApplicationDirectoryPath(const std::wstring& folder_name, const std::wstring folder_path,  std::wstring& output_full_path);
 	bool GetOutputFileName(std::wstring& file_name);
+	void OnFrameCaptured(const FrameDescriptor& captured, const DirtyRegion& dirty);
+	void EncodeLoop();
+	void StartPipeline();
+	void StopPipeline();
+	void TuneLoop();
+	void ResetStats();
+	int GetFrameBytesPerPixel() const { return hdr_mode_ == HdrMode::Hdr10 ? 8 : 4; }
 
 private:
+	// First, so it outlives the sinks that may still hold buffers reserved against it
+	MemoryBudget memory_budget_{ 1024ull * 1024 * 1024 };
+#ifdef _WIN32
 	std::shared_ptr<CaptureEngine> capture_engine_;
 	std::shared_ptr<VideoEncoder> video_encoder_;
+	std::vector<std::shared_ptr<VideoEncoder>> rendition_encoders_;
+	std::shared_ptr<StreamEncoder> stream_encoder_;
+#endif
+	std::shared_ptr<SyntheticFrameSource> synthetic_source_;
+	std::shared_ptr<FrameSink> frame_sink_;
+	std::shared_ptr<SimulcastSink> simulcast_sink_;
+	std::vector<RenditionConfig> renditions_;
+	std::shared_ptr<TimeLapseSink> time_lapse_sink_;
+	double time_lapse_seconds_ = 0.0;
+	TimeLapseBlend time_lapse_blend_ = TimeLapseBlend::Average;
+	int time_lapse_fps_ = 30;
+	std::unique_ptr<LiveStreamer> live_streamer_;
+	StreamConfig stream_config_;
 	int width_;
 	int height_;
 	std::wstring output_path_;
 	std::wstring output_filename_;
+	std::wstring requested_filename_;
 	int fps_;
 	int bitrate_;
 	int monitor_number_;
 	bool is_initialized_;
+	OutputMode output_mode_ = OutputMode::Encoded;
+	PreviewTap preview_tap_;
+	SnapshotWriter snapshot_writer_;
+	std::unique_ptr<SharedFramePublisher> shared_publisher_;
+	std::string shared_frames_name_;
+	int shared_frame_slots_ = 4;
+	std::shared_ptr<FilterChainSink> filter_chain_sink_;
+	FilterChainConfig filter_chain_config_;
+	bool filter_chain_ = false;
+
+	size_t queue_capacity_ = 4;
+	BackpressurePolicy backpressure_policy_ = BackpressurePolicy::Drop;
+	std::unique_ptr<FrameQueue> frame_queue_;
+	FramePipeline pipeline_{ memory_budget_ };	// Per-frame work from the capture callback to the sink
+	std::thread encode_thread_;
+	ThreadRoles thread_roles_;
+	bool scene_detection_ = true;
+	double gop_seconds_ = 10.0;
+	HdrMode hdr_mode_ = HdrMode::Off;
+	float sdr_white_nits_ = 203.0f;
+	float hdr_peak_nits_ = 1000.0f;
+	bool tracing_ = false;
+	size_t trace_events_per_thread_ = 1 << 16;
+	bool auto_tune_ = false;
+	PipelineTunerConfig tuner_config_;
+	std::unique_ptr<PipelineTuner> tuner_;
+	std::thread tuner_thread_;
+	std::mutex tuner_mutex_;
+	std::condition_variable tuner_wake_;
+	bool tuner_stop_ = false;
+	LatencyHistogram window_latency_;	// Reset by the tuner every window
 
+	std::chrono::steady_clock::time_point start_time_;
+	std::chrono::steady_clock::time_point stop_time_;
 };
 
@@ -1,8 +1,13 @@
+#define NOMINMAX
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
 #include <iostream>
-#include <shlobj.h> 
 
-#include "CaptureEngine.h"
-#include "VideoEncoder.h"
+#ifdef _WIN32
+#include <shlobj.h>
+#endif
+
 #include "ScreenRecorder.h"
 #include "Utils.h"
 
@@ -18,35 +23,66 @@ ScreenRecorder::ScreenRecorder()
 	fps_ = 60;
 	bitrate_ = 8000000;
 	is_initialized_ = false;
+	snapshot_writer_.SetMemoryBudget(&memory_budget_);
+	pipeline_.SetPreviewTap(&preview_tap_);
+	pipeline_.SetSnapshotWriter(&snapshot_writer_);
 }
 
 ScreenRecorder::~ScreenRecorder()
 {
-	if (video_encoder_)
+	if (frame_queue_)
+	{
+		frame_queue_->Close();
+	}
+	if (synthetic_source_)
 	{
-		video_encoder_->Finalize();
+		synthetic_source_->StopCapture();
 	}
+#ifdef _WIN32
 	if (capture_engine_)
 	{
 		capture_engine_->StopCapture();
 	}
+#endif
+
+	StopPipeline();
+
+	if (frame_sink_)
+	{
+		frame_sink_->Close();
+	}
+	if (shared_publisher_)
+	{
+		shared_publisher_->Close();
+	}
 
-	if (video_encoder_)
+	frame_sink_.reset();
+	filter_chain_sink_.reset();
+	time_lapse_sink_.reset();
+	simulcast_sink_.reset();
+#ifdef _WIN32
+	video_encoder_.reset();
+	rendition_encoders_.clear();
+	stream_encoder_.reset();
+#endif
+
+	if (live_streamer_)
 	{
-		video_encoder_.reset();
-		video_encoder_ = nullptr;
+		live_streamer_->Stop();
 	}
 
+#ifdef _WIN32
 	if (capture_engine_)
 	{
 		capture_engine_.reset();
 		capture_engine_ = nullptr;
 	}
+#endif
 
 	is_initialized_ = false;
 }
 
-bool ScreenRecorder::Initialize(int monitor_number, int width, int height, int fps, int bitrate)
+bool ScreenRecorder::Initialize(int monitor_number, int width, int height, int fps, int bitrate, VideoCodec codec)
 {
 	monitor_number_ = monitor_number;
 	width_ = width;
@@ -54,36 +90,228 @@ bool ScreenRecorder::Initialize(int monitor_number, int width, int height, int f
 	bitrate_ = bitrate;
 	fps_ = fps;
 	
-	GetOutputFileName(output_filename_);
+	if (requested_filename_.empty())
+	{
+		GetOutputFileName(output_filename_);
+	}
+	else
+	{
+		output_filename_ = requested_filename_;
+	}
+
+	// Raw recordings and the scene detector only understand BGRA
+	if (hdr_mode_ == HdrMode::Hdr10 && output_mode_ != OutputMode::Encoded)
+	{
+		return false;
+	}
+	// Renditions are scaled as BGRA and share the main encoder's keyframes
+	if (!renditions_.empty() && (output_mode_ != OutputMode::Encoded || hdr_mode_ == HdrMode::Hdr10))
+	{
+		return false;
+	}
+	// The time-lapse blends BGRA, and the encoders run at the playback rate
+	if (time_lapse_seconds_ > 0.0 && (output_mode_ != OutputMode::Encoded || hdr_mode_ == HdrMode::Hdr10))
+	{
+		return false;
+	}
+
+	// The filter chain works on BGRA
+	if (filter_chain_ && hdr_mode_ == HdrMode::Hdr10)
+	{
+		return false;
+	}
 
-	video_encoder_ = std::make_shared<VideoEncoder>(width_, height_, fps_, bitrate_, output_path_, output_filename_);
-	if (!video_encoder_->Initialize(VideoCodec::H264))
+#ifndef _WIN32
+	// The encoders are Media Foundation; elsewhere only the raw writers exist
+	if (output_mode_ == OutputMode::Encoded || output_mode_ == OutputMode::Stream)
 	{
 		return false;
 	}
+#endif
+
+	time_lapse_sink_.reset();
+	filter_chain_sink_.reset();
+	pipeline_.SetToneMap(hdr_mode_ == HdrMode::ToneMapSdr, sdr_white_nits_, hdr_peak_nits_);
+	pipeline_.SetSceneDetection(SceneChangeConfig(), nullptr);
+	// Sinks are made at the size the filter chain outputs
+	const FilterChainConfig filters = filter_chain_config_.Resolve(width_, height_);
+	const int output_width = filter_chain_ ? filters.output_width : width_;
+	const int output_height = filter_chain_ ? filters.output_height : height_;
+
+#ifdef _WIN32
+	if (output_mode_ == OutputMode::Encoded)
+	{
+		const int encoder_fps = time_lapse_seconds_ > 0.0 ? time_lapse_fps_ : fps_;
+		video_encoder_ = std::make_shared<VideoEncoder>(output_width, output_height, encoder_fps, bitrate_, output_path_, output_filename_);
+		video_encoder_->SetHdr10(hdr_mode_ == HdrMode::Hdr10);
+		video_encoder_->SetMemoryBudget(&memory_budget_);
+		uint32_t gop_frames = 0;
+		if (scene_detection_ && hdr_mode_ != HdrMode::Hdr10 && time_lapse_seconds_ <= 0.0)
+		{
+			// Long GOP: the scene detector places keyframes where the content needs them
+			gop_frames = static_cast<uint32_t>(gop_seconds_ * fps_);
+			video_encoder_->SetKeyframeInterval(gop_frames);
+
+			SceneChangeConfig scene_config;
+			scene_config.min_keyframe_interval = fps_ / 2;
+			scene_config.active_keyframe_interval = fps_ * 2;
+			scene_config.max_keyframe_interval = static_cast<int>(gop_frames);
+			// Through the fan-out, so every rendition cuts on the same frame
+			pipeline_.SetSceneDetection(scene_config, [this]
+			{
+				if (simulcast_sink_) simulcast_sink_->RequestKeyframe();
+				else video_encoder_->RequestKeyframe();
+			});
+		}
+		if (!video_encoder_->Initialize(codec))
+		{
+			return false;
+		}
+
+		frame_sink_ = video_encoder_;
+		simulcast_sink_.reset();
+		rendition_encoders_.clear();
+
+		if (!renditions_.empty())
+		{
+			simulcast_sink_ = std::make_shared<SimulcastSink>(&thread_roles_);
+			simulcast_sink_->SetMemoryBudget(&memory_budget_);
+			VideoEncoder* main_encoder = video_encoder_.get();
+			simulcast_sink_->AddRendition(video_encoder_, 0, 0, [main_encoder] { main_encoder->RequestKeyframe(); });
+
+			const std::wstring stem = output_filename_.substr(0, output_filename_.rfind(L'.'));
+			for (const RenditionConfig& rendition : renditions_)
+			{
+				const int rendition_width = std::max(2, rendition.width & ~1);
+				const int rendition_height = std::max(2, rendition.height & ~1);
+				const std::wstring file_name = stem + L"_" + std::to_wstring(rendition_width) + L"x" + std::to_wstring(rendition_height) + L".mp4";
+
+				auto encoder = std::make_shared<VideoEncoder>(rendition_width, rendition_height, encoder_fps, rendition.bitrate, output_path_, file_name);
+				encoder->SetMemoryBudget(&memory_budget_);
+				if (gop_frames > 0)
+				{
+					encoder->SetKeyframeInterval(gop_frames);
+				}
+				if (!encoder->Initialize(rendition.codec))
+				{
+					return false;
+				}
+
+				VideoEncoder* rendition_encoder = encoder.get();
+				simulcast_sink_->AddRendition(encoder, rendition_width, rendition_height, [rendition_encoder] { rendition_encoder->RequestKeyframe(); });
+				rendition_encoders_.push_back(std::move(encoder));
+			}
+
+			frame_sink_ = simulcast_sink_;
+		}
+
+		if (time_lapse_seconds_ > 0.0)
+		{
+			time_lapse_sink_ = std::make_shared<TimeLapseSink>(frame_sink_, time_lapse_seconds_, time_lapse_blend_);
+			time_lapse_sink_->SetMemoryBudget(&memory_budget_);
+			frame_sink_ = time_lapse_sink_;
+		}
+	}
+	else if (output_mode_ == OutputMode::Stream)
+	{
+		if (codec != VideoCodec::H264 && codec != VideoCodec::H265)
+		{
+			return false;
+		}
+
+		live_streamer_ = std::make_unique<LiveStreamer>();
+		if (!live_streamer_->Start(stream_config_, codec == VideoCodec::H265 ? NalCodec::H265 : NalCodec::H264))
+		{
+			return false;
+		}
+
+		// Each access unit goes out from the encode thread as soon as the encoder returns it
+		LiveStreamer* streamer = live_streamer_.get();
+		stream_encoder_ = std::make_shared<StreamEncoder>(output_width, output_height, fps_, bitrate_, [streamer](const EncodedPacket& packet)
+		{
+			streamer->WriteAccessUnit(packet.data, packet.size, packet.capture_time, packet.is_keyframe);
+		});
+		stream_encoder_->SetMemoryBudget(&memory_budget_);
+
+		// A one-second GOP bounds how long a joining or recovering receiver waits for a picture
+		if (!stream_encoder_->Initialize(codec, static_cast<uint32_t>(fps_)))
+		{
+			return false;
+		}
+
+		frame_sink_ = stream_encoder_;
+	}
+	else
+#endif
+	{
+		RawPixelFormat pixel_format = output_mode_ == OutputMode::RawNv12 ? RawPixelFormat::NV12 : RawPixelFormat::BGRA;
+		auto raw_writer = std::make_shared<RawVideoWriter>(output_width, output_height, fps_, pixel_format, output_path_ + output_filename_);
+		raw_writer->SetMemoryBudget(&memory_budget_);
+		if (!raw_writer->Initialize())
+		{
+			return false;
+		}
+
+		frame_sink_ = raw_writer;
+	}
+
+	if (filter_chain_)
+	{
+		// Raw NV12 takes the conversion in the chain's pass instead of a second one in the writer
+		const FrameFormat filter_format = output_mode_ == OutputMode::RawNv12 ? FrameFormat::Nv12 : FrameFormat::Bgra;
+		filter_chain_sink_ = std::make_shared<FilterChainSink>(frame_sink_, filter_chain_config_, filter_format);
+		filter_chain_sink_->SetMemoryBudget(&memory_budget_);
+		frame_sink_ = filter_chain_sink_;
+	}
 
-	capture_engine_ = std::make_shared<CaptureEngine>(monitor_number_, width_, height_);
-	if (!capture_engine_->Initialize())
+	pipeline_.SetSink(frame_sink_.get());
+	pipeline_.SetSharedPublisher(nullptr);
+	shared_publisher_.reset();
+	if (!shared_frames_name_.empty())
 	{
+		shared_publisher_ = std::make_unique<SharedFramePublisher>(shared_frames_name_, shared_frame_slots_);
+		shared_publisher_->SetMemoryBudget(&memory_budget_);
+		if (!shared_publisher_->Open(width_, height_, GetFrameBytesPerPixel()))
+		{
+			return false;
+		}
+		pipeline_.SetSharedPublisher(shared_publisher_.get());
+	}
+
+	// Monitor 0 means no screen source; only StartSyntheticCapture is usable
+	if (monitor_number_ > 0)
+	{
+#ifdef _WIN32
+		capture_engine_ = std::make_shared<CaptureEngine>(monitor_number_, width_, height_);
+		if (!capture_engine_->Initialize())
+		{
+			return false;
+		}
+		capture_engine_->SetHdrCapture(hdr_mode_ != HdrMode::Off);
+#else
 		return false;
+#endif
 	}
 
 	is_initialized_ = true;
 	return true;
 }
 
+#ifdef _WIN32
 bool ScreenRecorder::StartMonitorCapture(HMONITOR monitor)
 {
 	if (!capture_engine_) return false;
-	if (!video_encoder_) return false;
+	if (!frame_sink_) return false;
 
 	if (!capture_engine_->CaptureMonitor(monitor))
 	{
 		return false;
 	}
 
+	ResetStats();
+	StartPipeline();
+	capture_engine_->SetOutputCallback(std::bind(&ScreenRecorder::OnFrameCaptured, this, std::placeholders::_1, std::placeholders::_2));
 	capture_engine_->StartCapture();
-	capture_engine_->SetOutputCallback(std::bind(&VideoEncoder::ProcessFrame, video_encoder_, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
 
 	return true;
 }
@@ -91,45 +319,433 @@ bool ScreenRecorder::StartMonitorCapture(HMONITOR monitor)
 bool ScreenRecorder::StartWindowCapture(HWND window_handle)
 {
 	if (!capture_engine_) return false;
-	if (!video_encoder_) return false;
+	if (!frame_sink_) return false;
 
 	if (!capture_engine_->CaptureWindow(window_handle))
 	{
 		return false;
 	}
 
+	DWORD process_id = 0;
+	if (GetWindowThreadProcessId(window_handle, &process_id))
+	{
+		thread_roles_.SetTargetProcess(process_id);
+	}
+
+	ResetStats();
+	StartPipeline();
+	capture_engine_->SetOutputCallback(std::bind(&ScreenRecorder::OnFrameCaptured, this, std::placeholders::_1, std::placeholders::_2));
 	capture_engine_->StartCapture();
-	capture_engine_->SetOutputCallback(std::bind(&VideoEncoder::ProcessFrame, video_encoder_, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
 
 	return true;
 
 }
+#endif
+
+bool ScreenRecorder::StartSyntheticCapture(bool paced, SyntheticPattern pattern)
+{
+	if (!frame_sink_) return false;
+
+	synthetic_source_ = std::make_shared<SyntheticFrameSource>(width_, height_, paced ? fps_ : 0, pattern);
+	synthetic_source_->SetHdrOutput(hdr_mode_ != HdrMode::Off);
+
+	ResetStats();
+	StartPipeline();
+	synthetic_source_->SetOutputCallback(std::bind(&ScreenRecorder::OnFrameCaptured, this, std::placeholders::_1, std::placeholders::_2));
+	synthetic_source_->StartCapture();
+
+	return true;
+}
 
 bool ScreenRecorder::StopCapture()
 {
-	if (!capture_engine_) return false;
-	if (!video_encoder_) return false;
+	if (!frame_sink_) return false;
 
-	if (video_encoder_)
+	// Wakes a producer blocked on the queue, which the sources below wait for. Queued frames still drain.
+	if (frame_queue_)
 	{
-		video_encoder_->Finalize();
+		frame_queue_->Close();
 	}
 
+	if (synthetic_source_)
+	{
+		synthetic_source_->StopCapture();
+	}
+
+#ifdef _WIN32
+	// Stop first: StopCapture waits for the in-flight frame, so nothing reaches the encoder after Finalize
 	if (capture_engine_)
 	{
 		capture_engine_->StopCapture();
 	}
+#endif
+
+	// Drain what is still queued before the sink is finalized
+	StopPipeline();
+
+	stop_time_ = std::chrono::steady_clock::now();
+
+	bool closed = true;
+	if (frame_sink_)
+	{
+		closed = frame_sink_->Close();
+	}
+
+	if (tracing_)
+	{
+		FrameTracer::Stop();
+	}
+
+	return closed;
+}
 
+void ScreenRecorder::SetOutputFile(const std::wstring& folder_path, const std::wstring& file_name)
+{
+	output_path_ = folder_path;
+	if (!output_path_.empty() && output_path_.back() != L'\\' && output_path_.back() != L'/')
+	{
+		output_path_.push_back(static_cast<wchar_t>(std::filesystem::path::preferred_separator));
+	}
+
+	requested_filename_ = file_name;
+}
+
+void ScreenRecorder::SetFrameQueue(size_t capacity, uint64_t memory_budget_bytes, BackpressurePolicy policy)
+{
+	queue_capacity_ = capacity;
+	backpressure_policy_ = policy;
+	memory_budget_.SetLimit(memory_budget_bytes);
+}
+
+void ScreenRecorder::SetSceneDetection(bool enabled, double gop_seconds)
+{
+	scene_detection_ = enabled;
+	gop_seconds_ = gop_seconds;
+}
+
+void ScreenRecorder::SetHdrMode(HdrMode mode, float sdr_white_nits, float peak_nits)
+{
+	hdr_mode_ = mode;
+	sdr_white_nits_ = sdr_white_nits;
+	hdr_peak_nits_ = peak_nits;
+}
+
+void ScreenRecorder::SetAutoTune(bool enabled, const PipelineTunerConfig& config)
+{
+	auto_tune_ = enabled;
+	tuner_config_ = config;
+}
+
+std::vector<TunerDecision> ScreenRecorder::GetTunerLog() const
+{
+	return tuner_ ? tuner_->GetLog() : std::vector<TunerDecision>();
+}
+
+void ScreenRecorder::SetTracing(bool enabled, size_t events_per_thread)
+{
+	tracing_ = enabled;
+	trace_events_per_thread_ = events_per_thread;
+}
+
+bool ScreenRecorder::ExportTrace(const std::wstring& path) const
+{
+	if (!tracing_ || FrameTracer::IsEnabled()) return false;
+
+	std::filesystem::path trace_path(path);
+	std::wstring extension = trace_path.extension().wstring();
+	if (extension == L".pftrace" || extension == L".perfetto-trace")
+	{
+		return FrameTracer::ExportPerfetto(trace_path);
+	}
+
+	return FrameTracer::ExportChromeJson(trace_path);
+}
+
+void ScreenRecorder::SetSharedFrames(const std::string& name, int slots)
+{
+	shared_frames_name_ = name;
+	shared_frame_slots_ = slots;
+}
+
+void ScreenRecorder::SetFilterChain(const FilterChainConfig& config, bool enabled)
+{
+	filter_chain_config_ = config;
+	filter_chain_ = enabled;
+}
+
+void ScreenRecorder::SetOverlay(const uint8_t* bgra, ptrdiff_t pitch, int width, int height)
+{
+	if (filter_chain_sink_) filter_chain_sink_->SetOverlay(bgra, pitch, width, height);
+}
+
+void ScreenRecorder::SetOverlayPosition(int x, int y)
+{
+	if (filter_chain_sink_) filter_chain_sink_->SetOverlayPosition(x, y);
+}
+
+void ScreenRecorder::SetTimeLapse(double interval_seconds, TimeLapseBlend blend, int playback_fps)
+{
+	time_lapse_seconds_ = std::max(0.0, interval_seconds);
+	time_lapse_blend_ = blend;
+	time_lapse_fps_ = std::max(1, playback_fps);
+}
+
+std::vector<RenditionStats> ScreenRecorder::GetRenditionStats() const
+{
+	if (!simulcast_sink_) return {};
+
+	std::vector<RenditionStats> stats = simulcast_sink_->GetStats();
+	for (RenditionStats& rendition : stats)
+	{
+		if (rendition.width == 0)
+		{
+			const FilterChainConfig filters = filter_chain_config_.Resolve(width_, height_);
+			rendition.width = filter_chain_ ? filters.output_width : width_;
+			rendition.height = filter_chain_ ? filters.output_height : height_;
+		}
+	}
+	return stats;
+}
+
+bool ScreenRecorder::RequestSnapshot(const std::wstring& path)
+{
+	if (hdr_mode_ == HdrMode::Hdr10) return false;
+
+	snapshot_writer_.Request(path);
 	return true;
 }
 
+std::vector<SnapshotResult> ScreenRecorder::GetSnapshotResults()
+{
+	snapshot_writer_.Flush();
+	return snapshot_writer_.GetResults();
+}
+
+RecordingStats ScreenRecorder::GetStats() const
+{
+	RecordingStats stats{};
+	const FramePipelineStats pipeline = pipeline_.GetStats();
+	stats.frames_received = pipeline.frames_received;
+	stats.frames_encoded = pipeline.frames_encoded;
+	stats.frames_failed = pipeline.frames_failed;
+
+	auto end_time = stop_time_ > start_time_ ? stop_time_ : std::chrono::steady_clock::now();
+	stats.duration_seconds = std::chrono::duration<double>(end_time - start_time_).count();
+
+	uint64_t encoded = stats.frames_encoded + stats.frames_failed;
+	stats.average_encode_ms = encoded ? (pipeline.encode_ns / 1e6) / encoded : 0.0;
+	stats.max_encode_ms = pipeline.max_encode_ns / 1e6;
+
+	double preview_ns = static_cast<double>(preview_tap_.GetCostNs());
+	double encode_ns = static_cast<double>(pipeline.encode_ns);
+	stats.average_preview_us = stats.frames_received ? preview_ns / 1e3 / stats.frames_received : 0.0;
+	stats.preview_overhead_percent = encode_ns > 0 ? preview_ns * 100.0 / encode_ns : 0.0;
+
+	stats.frames_dropped = pipeline.frames_dropped;
+	stats.frames_downscaled = pipeline.frames_downscaled;
+	stats.memory_budget_bytes = memory_budget_.GetLimit();
+	stats.memory_in_use_bytes = memory_budget_.GetUsage() + memory_budget_.GetCached();
+	stats.memory_cached_bytes = memory_budget_.GetCached();
+	stats.memory_peak_bytes = memory_budget_.GetPeak();
+	stats.queue_peak_depth = frame_queue_ ? frame_queue_->GetPeakDepth() : 0;
+	stats.producer_blocked_ms = frame_queue_ ? frame_queue_->GetBlockedNs() / 1e6 : 0.0;
+
+	const LatencyHistogram& latency = pipeline_.GetLatency();
+	stats.latency_p50_ms = latency.GetPercentileMs(50.0);
+	stats.latency_p99_ms = latency.GetPercentileMs(99.0);
+	stats.latency_max_ms = latency.GetMaxMs();
+
+	stats.scene_cuts = pipeline.scene_cuts;
+	stats.static_frames = pipeline.static_frames;
+#ifdef _WIN32
+	stats.keyframes_forced = video_encoder_ ? video_encoder_->GetForcedKeyframeCount() : 0;
+#endif
+	stats.average_scene_detect_us = encoded ? pipeline.scene_detect_ns / 1e3 / encoded : 0.0;
+
+	if (tracing_)
+	{
+		TraceSummary trace = FrameTracer::GetSummary();
+		stats.trace_events = trace.events;
+		stats.trace_overwritten_events = trace.overwritten_events;
+		stats.trace_overhead_ms = trace.overhead_ms;
+		stats.trace_overhead_percent = encode_ns > 0 ? trace.overhead_ms * 1e6 * 100.0 / encode_ns : 0.0;
+	}
+
+	stats.tuner_adjustments = tuner_ ? tuner_->GetLog().size() : 0;
+	stats.queue_capacity = frame_queue_ ? frame_queue_->GetCapacity() : 0;
+#ifdef _WIN32
+	stats.frame_pool_buffers = capture_engine_ ? capture_engine_->GetFramePoolBuffers() : 0;
+#endif
+
+	if (live_streamer_)
+	{
+		LiveStreamStats stream = live_streamer_->GetStats();
+		stats.stream_bytes = stream.transport.bytes;
+		stats.stream_packetize_p99_ms = stream.packetize_p99_ms;
+		stats.stream_retransmits = stream.transport.retransmitted;
+	}
+
+	if (shared_publisher_)
+	{
+		SharedFramePublisherStats shared = shared_publisher_->GetStats();
+		stats.shared_frames_published = shared.frames_published;
+		stats.average_shared_publish_us = shared.frames_published ? shared.publish_ms * 1e3 / shared.frames_published : 0.0;
+	}
+
+	if (time_lapse_sink_)
+	{
+		TimeLapseStats time_lapse = time_lapse_sink_->GetStats();
+		stats.time_lapse_frames = time_lapse.frames_out;
+		stats.time_lapse_repeated = time_lapse.frames_repeated;
+		stats.average_time_lapse_us = time_lapse.frames_in ? time_lapse.blend_ms * 1e3 / time_lapse.frames_in : 0.0;
+	}
+
+	if (filter_chain_sink_)
+	{
+		FilterChainStats filters = filter_chain_sink_->GetStats();
+		stats.average_filter_us = filters.frames ? filters.process_ms * 1e3 / filters.frames : 0.0;
+		stats.filter_bytes_per_frame = filters.frames ? (filters.bytes_read + filters.bytes_written) / filters.frames : 0;
+	}
+
+	return stats;
+}
+
+void ScreenRecorder::OnFrameCaptured(const FrameDescriptor& captured, const DirtyRegion& dirty)
+{
+	// Frame pool callbacks arrive on threads we don't create
+	thread_roles_.EnsureApplied(ThreadRole::Capture);
+	pipeline_.OnFrameCaptured(captured, dirty);
+}
+
+void ScreenRecorder::EncodeLoop()
+{
+	thread_roles_.ApplyToCurrentThread(ThreadRole::Encode);
+	FrameTracer::SetThreadName("encode");
+
+	QueuedFrame frame;
+	while (frame_queue_->Pop(frame))
+	{
+		pipeline_.EncodeQueued(frame);
+	}
+}
+
+void ScreenRecorder::StartPipeline()
+{
+	StopPipeline();
+	memory_budget_.ResetPeak();
+
+	frame_queue_.reset();
+	if (queue_capacity_ > 0)
+	{
+		frame_queue_ = std::make_unique<FrameQueue>(memory_budget_, queue_capacity_, backpressure_policy_, GetFrameBytesPerPixel());
+		if (simulcast_sink_) frame_queue_->SetSinkHeldFrames(simulcast_sink_->GetHeldFrames());
+	}
+	pipeline_.SetWindowLatency(auto_tune_ ? &window_latency_ : nullptr);
+	pipeline_.Start(frame_queue_.get(), std::chrono::milliseconds(1000 / std::max(fps_, 1)));
+	if (frame_queue_)
+	{
+		encode_thread_ = std::thread(&ScreenRecorder::EncodeLoop, this);
+	}
+
+	if (auto_tune_)
+	{
+		int pool_buffers = 2;
+#ifdef _WIN32
+		if (capture_engine_) pool_buffers = capture_engine_->GetFramePoolBuffers();
+#endif
+		tuner_ = std::make_unique<PipelineTuner>(tuner_config_, 1000.0 / fps_, pool_buffers, frame_queue_ ? queue_capacity_ : 0);
+		window_latency_.Reset();
+		tuner_stop_ = false;
+		tuner_thread_ = std::thread(&ScreenRecorder::TuneLoop, this);
+	}
+}
+
+void ScreenRecorder::StopPipeline()
+{
+	// The tuner resizes the queue, so it goes before the queue closes
+	if (tuner_thread_.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(tuner_mutex_);
+			tuner_stop_ = true;
+		}
+		tuner_wake_.notify_all();
+		tuner_thread_.join();
+	}
+
+	if (frame_queue_)
+	{
+		frame_queue_->Close();
+	}
+	if (encode_thread_.joinable())
+	{
+		encode_thread_.join();
+	}
+}
+
+void ScreenRecorder::TuneLoop()
+{
+	thread_roles_.ApplyToCurrentThread(ThreadRole::Stats);
+
+	const auto window = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>(tuner_->GetConfig().window_seconds));
+	FramePipelineStats last = pipeline_.GetStats();
+#ifdef _WIN32
+	if (capture_engine_) capture_engine_->TakeMaxFrameHoldNs();
+#endif
+
+	std::unique_lock<std::mutex> lock(tuner_mutex_);
+	while (!tuner_wake_.wait_for(lock, window, [this] { return tuner_stop_; }))
+	{
+		TunerWindow observed;
+		const FramePipelineStats current = pipeline_.GetStats();
+		observed.frames = current.frames_received - last.frames_received;
+		observed.dropped = current.frames_dropped - last.frames_dropped;
+		last = current;
+
+		// Racing a Record only misplaces a sample between windows
+		observed.latency_p99_ms = window_latency_.GetPercentileMs(99.0);
+		window_latency_.Reset();
+
+		observed.queue_peak_depth = frame_queue_ ? frame_queue_->TakeWindowPeakDepth() : 0;
+#ifdef _WIN32
+		observed.max_hold_ms = capture_engine_ ? capture_engine_->TakeMaxFrameHoldNs() / 1e6 : 0.0;
+#endif
+		if (observed.frames == 0) continue;
+
+		TunerDecision decision = tuner_->Observe(observed);
+		if (decision.reason.empty()) continue;
+
+		if (frame_queue_) frame_queue_->SetCapacity(decision.queue_capacity);
+#ifdef _WIN32
+		if (capture_engine_) capture_engine_->SetFramePoolBuffers(decision.pool_buffers);
+#endif
+	}
+}
+
+void ScreenRecorder::ResetStats()
+{
+	pipeline_.ResetStats();
+	preview_tap_.ResetCost();
+
+	// Stages record from here on, so the trace covers the whole session
+	if (tracing_)
+	{
+		FrameTracer::Start(trace_events_per_thread_);
+	}
+
+	start_time_ = std::chrono::steady_clock::now();
+	stop_time_ = start_time_;
+}
+
 bool ScreenRecorder::CreateOutputFolder(const std::wstring& folder_path)
 {
-	PWSTR user_video_folder;
 	std::wstring output_folder_path;
 	
 	if (folder_path.empty())
 	{
+#ifdef _WIN32
+		PWSTR user_video_folder;
 		HRESULT hr = SHGetKnownFolderPath(FOLDERID_Videos, 0, NULL, &user_video_folder);
 
 		if (SUCCEEDED(hr))
@@ -138,6 +754,10 @@ bool ScreenRecorder::CreateOutputFolder(const std::wstring& folder_path)
 		}
 
 		CoTaskMemFree(user_video_folder);
+#else
+		const char* home = std::getenv("HOME");
+		output_folder_path = home ? (std::filesystem::path(home) / "Videos").wstring() : L".";
+#endif
 	}
 	else
 	{
@@ -151,17 +771,22 @@ bool ScreenRecorder::CreateOutputFolder(const std::wstring& folder_path)
 
 bool ScreenRecorder::CreateAndGetApplicationDirectoryPath(const std::wstring& folder_name, const std::wstring folder_path, std::wstring& output_full_path)
 {
+#ifdef _WIN32
 	output_full_path = folder_path + L"\\" + folder_name + L"\\";
 	return CreateDirectoryW(output_full_path.c_str(), nullptr) || GetLastError() == ERROR_ALREADY_EXISTS;
-
-	return false;
+#else
+	output_full_path = folder_path + L"/" + folder_name + L"/";
+	std::error_code error;
+	std::filesystem::create_directories(output_full_path, error);
+	return std::filesystem::is_directory(output_full_path, error);
+#endif
 }
 
 bool ScreenRecorder::GetOutputFileName(std::wstring& file_name)
 {
 	file_name.clear();
 	file_name.append(RecorderUtils::GetCurrentDateTime());
-	file_name.append(L".mp4");
+	file_name.append(output_mode_ == OutputMode::Encoded ? L".mp4" : L".zraw");
 
 	return file_name.size() > 0;
 }
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "LatencyHistogram.h"
+#include "NalUnits.h"
+#include "TsMuxer.h"
+#include "UdpStream.h"
+
+struct StreamConfig
+{
+    std::string host = "127.0.0.1";
+    uint16_t port = 5000;
+    StreamTransportConfig transport;
+    int pts_delay_ms = 50;              // Receiver buffer the timestamps allow for
+};
+
+struct LiveStreamStats
+{
+    uint64_t access_units = 0;
+    uint64_t keyframes = 0;
+    uint64_t ts_bytes = 0;
+    uint64_t send_failures = 0;
+    double packetize_p50_ms = 0.0;      // Access unit in to last datagram out
+    double packetize_p99_ms = 0.0;
+    double packetize_max_ms = 0.0;
+    StreamSenderStats transport;
+};
+
+// "udp://host:port"; a bare "host:port" works too
+bool ParseStreamUrl(const std::string& url, std::string& host, uint16_t& port);
+
+// Live output: each encoded access unit is muxed to MPEG-TS and sent as soon as it arrives.
+// Timestamps come from capture time, so the PCR tracks the screen rather than the encoder.
+class LiveStreamer
+{
+public:
+    bool Start(const StreamConfig& config, NalCodec codec);
+    void Stop();
+
+    // One Annex B access unit from the encoder. Call from one thread.
+    bool WriteAccessUnit(const uint8_t* data, size_t size, std::chrono::steady_clock::time_point capture_time, bool is_keyframe);
+
+    LiveStreamStats GetStats() const;
+    UdpStreamSender& GetSender() { return sender_; }
+
+private:
+    std::unique_ptr<TsMuxer> muxer_;
+    UdpStreamSender sender_;
+    std::vector<uint8_t> ts_;
+    bool has_epoch_ = false;
+    std::chrono::steady_clock::time_point epoch_;
+
+    // Read by GetStats from other threads
+    std::atomic<uint64_t> access_units_{ 0 };
+    std::atomic<uint64_t> keyframes_{ 0 };
+    std::atomic<uint64_t> ts_bytes_{ 0 };
+    std::atomic<uint64_t> send_failures_{ 0 };
+    LatencyHistogram packetize_latency_;
+};
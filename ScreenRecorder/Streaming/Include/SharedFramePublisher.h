@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "FrameSink.h"
+#include "MemoryBudget.h"
+#include "SharedFrameRing.h"
+#include "SharedMemory.h"
+
+struct SharedFramePublisherStats
+{
+    uint64_t frames_published = 0;
+    uint64_t frames_rejected = 0;       // Larger than a slot, or more than one plane
+    uint64_t bytes_copied = 0;          // Into the ring; only what changed since the slot was last written
+    uint64_t wakeups = 0;               // Publishes that found readers asleep
+    double publish_ms = 0.0;            // Total
+    size_t ring_bytes = 0;
+};
+
+// Publishes frames into a named shared-memory ring that any number of local processes can read
+// in place with SharedFrameReader. Readers never hold the publisher up: a slot is rewritten when
+// the ring comes round whether or not someone is reading it, and the reader finds out from the
+// slot's sequence. Each slot is patched with only the rects that changed since it last held a
+// frame, so a mostly static screen costs little more than its dirty area per frame.
+class SharedFramePublisher : public FrameSink
+{
+public:
+    explicit SharedFramePublisher(std::string name, int slot_count = 4);
+    ~SharedFramePublisher() override;
+
+    // Creates the ring, every slot sized for width x height at bytes_per_pixel. Smaller frames fit too.
+    bool Open(int width, int height, int bytes_per_pixel = 4);
+
+    bool ProcessFrame(const std::vector<uint8_t>& image_buffer, int width, int height) override;
+    // Single-plane formats (BGRA, scRGB). Copies into the ring and wakes waiting readers.
+    bool ProcessFrame(const FrameDescriptor& frame, const DirtyRegion& dirty) override;
+    // Tells readers the stream has ended and removes the name
+    bool Close() override;
+
+    const std::string& GetName() const { return name_; }
+    // The ring is held against it while open. Before Open.
+    void SetMemoryBudget(MemoryBudget* budget) { budget_ = budget; }
+    SharedFramePublisherStats GetStats() const;
+
+private:
+    std::string name_;
+    uint32_t slot_count_;
+    SharedMemory memory_;
+    MemoryBudget* budget_ = nullptr;
+    MemoryBudget::Reservation ring_reservation_;
+    SharedFrameRing::RingHeader* header_ = nullptr;
+    SharedFrameRing::SlotHeader* slots_ = nullptr;
+    size_t slot_bytes_ = 0;
+    uint32_t published_ = 0;
+    std::vector<DirtyRegion> stale_;    // Per slot: changed since the frame it holds
+
+    std::atomic<uint64_t> frames_published_{ 0 };
+    std::atomic<uint64_t> frames_rejected_{ 0 };
+    std::atomic<uint64_t> bytes_copied_{ 0 };
+    std::atomic<uint64_t> wakeups_{ 0 };
+    std::atomic<uint64_t> publish_ns_{ 0 };
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "FrameDescriptor.h"
+#include "SharedFrameRing.h"
+#include "SharedMemory.h"
+
+enum class SharedFrameStatus
+{
+    Ok,
+    Timeout,
+    Closed          // The publisher closed the ring, or it was never a valid one
+};
+
+// A frame in place in the ring. The pixels stay the publisher's: once it has gone round the
+// ring it rewrites them, so check Validate after using them.
+struct SharedFrameView
+{
+    const uint8_t* data = nullptr;
+    FrameFormat format = FrameFormat::Bgra;
+    int width = 0;
+    int height = 0;
+    ptrdiff_t pitch = 0;
+    uint64_t frame_number = 0;
+    std::chrono::steady_clock::time_point capture_time;
+    std::chrono::steady_clock::time_point publish_time;
+    DirtyRegion dirty;          // Changed since frame_number - 1; frames skipped in between are not included
+
+    uint32_t slot = 0;
+    uint32_t sequence = 0;
+
+    // Borrowed, like a frame handed to a sink
+    FrameDescriptor GetDescriptor() const;
+};
+
+struct SharedFrameReaderStats
+{
+    uint64_t frames_read = 0;
+    uint64_t frames_skipped = 0;    // Published but never returned, because newer ones had arrived
+    uint64_t frames_torn = 0;       // Overwritten before Validate, or while being read
+};
+
+// Reads frames from a SharedFramePublisher's ring in another process (or the same one), without
+// copying them out and without the publisher ever waiting on it. A reader always moves to the
+// newest frame, so a slow one skips frames instead of falling behind.
+class SharedFrameReader
+{
+public:
+    SharedFrameReader() = default;
+    ~SharedFrameReader() { Close(); }
+
+    SharedFrameReader(const SharedFrameReader&) = delete;
+    SharedFrameReader& operator=(const SharedFrameReader&) = delete;
+
+    bool Open(const std::string& name);
+    void Close();
+    bool IsOpen() const { return header_ != nullptr; }
+
+    // The newest frame this reader has not returned yet, sleeping up to timeout for one
+    SharedFrameStatus WaitForFrame(SharedFrameView& view, std::chrono::microseconds timeout);
+    // Whether the view's pixels are still the frame it was returned with. Call after using them;
+    // false means the publisher has started rewriting the slot and what was read may be torn.
+    bool Validate(const SharedFrameView& view);
+    // WaitForFrame, then a packed copy that is known whole
+    SharedFrameStatus CopyFrame(std::vector<uint8_t>& pixels, SharedFrameView& view, std::chrono::microseconds timeout);
+
+    SharedFrameReaderStats GetStats() const { return stats_; }
+
+private:
+    // Fills view from the slot holding frame_number; false if it is being written or already newer
+    bool ReadSlot(uint32_t frame_number, SharedFrameView& view);
+
+    SharedMemory memory_;
+    SharedFrameRing::RingHeader* header_ = nullptr;
+    SharedFrameRing::SlotHeader* slots_ = nullptr;
+    uint32_t last_frame_ = 0;
+    SharedFrameReaderStats stats_;
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "DirtyRegion.h"
+
+// Layout of the shared-memory frame ring, shared by SharedFramePublisher and SharedFrameReader.
+//
+//   RingHeader | SlotHeader x slot_count | pixels of slot 0 | pixels of slot 1 | ...
+//
+// Frame n (from 1) goes into slot (n - 1) % slot_count. Each slot is a seqlock: its sequence is
+// odd while the publisher writes it and even once it is whole, so a reader that sees the same
+// even sequence before and after using the pixels knows they were not overwritten meanwhile. The
+// publisher never waits for readers. RingHeader::published is the latest whole frame's number and
+// the word readers sleep on.
+namespace SharedFrameRing
+{
+    constexpr uint32_t kMagic = 0x46525353;     // "SSRF"
+    constexpr uint32_t kVersion = 1;
+    constexpr size_t kMaxDirtyRects = 16;       // Past this a slot carries the bounding box
+    constexpr size_t kPageSize = 4096;
+
+    struct RingHeader
+    {
+        uint32_t magic;                         // Stored last, once the rest is set up
+        uint32_t version;
+        uint32_t slot_count;
+        uint32_t reserved;
+        uint64_t slot_offset;                   // First slot's pixels, from the start of the ring
+        uint64_t slot_stride;                   // Pixel bytes each slot holds, page-rounded
+
+        alignas(64) std::atomic<uint32_t> published;
+        alignas(64) std::atomic<uint32_t> waiters;
+        std::atomic<uint32_t> closed;           // Set by the publisher on Close; readers get Closed
+    };
+
+    struct alignas(64) SlotHeader
+    {
+        std::atomic<uint32_t> sequence;
+        uint32_t format;                        // FrameFormat; single-plane formats only
+        int32_t width;
+        int32_t height;
+        int64_t pitch;
+        uint64_t frame_number;
+        int64_t capture_ns;                     // steady_clock, which is system-wide
+        int64_t publish_ns;
+        uint32_t dirty_count;                   // Changed since frame_number - 1
+        DirtyRect dirty[kMaxDirtyRects];
+    };
+
+    inline size_t RoundUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    inline size_t GetSlotOffset(uint32_t slot_count)
+    {
+        return RoundUp(sizeof(RingHeader) + sizeof(SlotHeader) * slot_count, kPageSize);
+    }
+
+    inline SlotHeader* GetSlots(void* ring)
+    {
+        return reinterpret_cast<SlotHeader*>(static_cast<uint8_t*>(ring) + sizeof(RingHeader));
+    }
+
+    // Rows start 64-byte aligned
+    inline ptrdiff_t GetPitch(size_t row_bytes)
+    {
+        return static_cast<ptrdiff_t>(RoundUp(row_bytes, 64));
+    }
+}
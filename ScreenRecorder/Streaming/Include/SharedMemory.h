@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A named memory mapping other processes can open, over POSIX shm or a Windows file mapping, with
+// a wait and wake on a 32-bit word inside it: a shared futex on Linux, a named semaphore released
+// once per waiter on Windows.
+class SharedMemory
+{
+public:
+    SharedMemory() = default;
+    ~SharedMemory() { Close(); }
+
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator=(const SharedMemory&) = delete;
+
+    // Zero-filled. Replaces a region of the same name a crashed creator left behind.
+    bool Create(const std::string& name, size_t bytes);
+    bool Open(const std::string& name);
+    // The creator's close removes the name; mappings already open stay valid
+    void Close();
+
+    bool IsOpen() const { return data_ != nullptr; }
+    uint8_t* GetData() const { return data_; }
+    size_t GetSize() const { return size_; }
+
+    // Blocks while word holds expected, up to timeout. Returns false on timeout; may return early.
+    bool Wait(std::atomic<uint32_t>& word, uint32_t expected, std::chrono::microseconds timeout);
+    // Wakes everyone in Wait on word; waiters is how many there may be
+    void WakeAll(std::atomic<uint32_t>& word, uint32_t waiters);
+
+private:
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    bool is_creator_ = false;
+    std::string name_;
+#ifdef _WIN32
+    void* mapping_ = nullptr;
+    void* wake_ = nullptr;
+#else
+    int file_descriptor_ = -1;
+#endif
+};
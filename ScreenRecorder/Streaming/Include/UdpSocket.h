@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct UdpEndpoint
+{
+    uint32_t address = 0;               // IPv4, host byte order
+    uint16_t port = 0;
+
+    bool operator==(const UdpEndpoint& other) const { return address == other.address && port == other.port; }
+    bool operator!=(const UdpEndpoint& other) const { return !(*this == other); }
+};
+
+// Blocking IPv4 datagram socket over Winsock or BSD sockets
+class UdpSocket
+{
+public:
+    UdpSocket() = default;
+    ~UdpSocket() { Close(); }
+
+    UdpSocket(const UdpSocket&) = delete;
+    UdpSocket& operator=(const UdpSocket&) = delete;
+
+    // port 0 binds an ephemeral port. buffer_bytes sizes the kernel send and receive buffers,
+    // which have to absorb a keyframe's burst of datagrams.
+    bool Open(uint16_t port = 0, int buffer_bytes = 4 << 20);
+    void Close();
+    bool IsOpen() const { return is_open_; }
+
+    bool SendTo(const uint8_t* data, size_t size, const UdpEndpoint& to);
+    // Waits up to timeout. Returns the datagram size, 0 on timeout, -1 on error.
+    int ReceiveFrom(uint8_t* data, size_t capacity, UdpEndpoint& from, std::chrono::microseconds timeout);
+
+    UdpEndpoint GetLocalEndpoint() const;
+
+    // Name or dotted address
+    static bool Resolve(const std::string& host, uint16_t port, UdpEndpoint& endpoint);
+
+private:
+#ifdef _WIN32
+    uintptr_t socket_ = ~static_cast<uintptr_t>(0);
+#else
+    int socket_ = -1;
+#endif
+    bool is_open_ = false;
+};
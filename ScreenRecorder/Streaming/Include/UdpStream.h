@@ -0,0 +1,169 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "UdpSocket.h"
+
+struct StreamTransportConfig
+{
+    int packets_per_datagram = 7;       // TS packets; 7 * 188 fits a 1500-byte MTU
+    // One XOR parity datagram per this many media datagrams, never spanning an access unit.
+    // Recovers one lost datagram per group without a round trip. 0 disables.
+    int fec_group = 0;
+    // The receiver NACKs gaps and the sender resends from its history
+    bool retransmit = false;
+    // How long the receiver holds later datagrams back waiting for a missing one before
+    // giving up on it. Only gaps wait; in-order datagrams are handed on at once.
+    int latency_ms = 80;
+    int history_datagrams = 2048;       // Sender side, for retransmission
+
+    // Plain TS over UDP (what ffplay/VLC expect) unless a reliability feature needs an RTP header
+    bool UsesRtp() const { return fec_group > 0 || retransmit; }
+};
+
+struct StreamSenderStats
+{
+    uint64_t datagrams = 0;
+    uint64_t bytes = 0;                 // UDP payload, headers and parity included
+    uint64_t parity_datagrams = 0;
+    uint64_t nacks_received = 0;
+    uint64_t retransmitted = 0;
+    uint64_t simulated_losses = 0;
+};
+
+struct StreamReceiverStats
+{
+    uint64_t datagrams = 0;
+    uint64_t parity_datagrams = 0;
+    uint64_t duplicates = 0;
+    uint64_t recovered_fec = 0;
+    uint64_t recovered_retransmit = 0;  // Arrived after being NACKed
+    uint64_t lost = 0;                  // Given up on after latency_ms
+    uint64_t nacks_sent = 0;
+};
+
+// Sends a TS byte stream as datagrams of whole TS packets. With RTP framing every datagram gets a
+// sequence number (payload type 33, MP2T), FEC parity goes out as payload type 96 in the same
+// flow, and RTCP generic NACKs (RFC 4585) coming back on the socket trigger resends.
+class UdpStreamSender
+{
+public:
+    ~UdpStreamSender() { Close(); }
+
+    bool Open(const UdpEndpoint& destination, const StreamTransportConfig& config);
+    void Close();
+
+    // ts holds whole TS packets, normally one access unit; the last datagram may be short rather
+    // than wait for the next frame. clock_90k becomes the RTP timestamp.
+    bool Send(const uint8_t* ts, size_t size, uint32_t clock_90k);
+
+    // Test hook: drops this fraction of outgoing datagrams, retransmissions included
+    void SetSimulatedLoss(double rate, uint32_t seed = 1);
+
+    StreamSenderStats GetStats() const;
+    UdpEndpoint GetLocalEndpoint() const { return socket_.GetLocalEndpoint(); }
+
+private:
+    bool SendDatagram(const uint8_t* data, size_t size);
+    void SendParity();
+    void FeedbackLoop();
+
+    StreamTransportConfig config_;
+    UdpEndpoint destination_;
+    UdpSocket socket_;
+    uint32_t ssrc_ = 0;
+    uint16_t sequence_ = 0;
+
+    // Running XOR of the current FEC group's payloads and their lengths
+    std::vector<uint8_t> parity_;
+    uint16_t parity_length_ = 0;
+    uint16_t group_base_ = 0;
+    int group_count_ = 0;
+
+    struct SentDatagram
+    {
+        uint16_t sequence = 0;
+        std::vector<uint8_t> data;
+    };
+    std::vector<SentDatagram> history_;
+    std::vector<uint8_t> datagram_;
+
+    mutable std::mutex send_mutex_;             // Socket sends, history and loss simulation
+    double loss_rate_ = 0.0;
+    std::mt19937 loss_random_;
+    std::thread feedback_thread_;
+    std::atomic<bool> running_{ false };
+
+    StreamSenderStats stats_;
+};
+
+// Receives what UdpStreamSender sends and puts the TS byte stream back in order, repairing
+// losses with FEC and NACKs where configured. Single threaded: the caller polls.
+class UdpStreamReceiver
+{
+public:
+    bool Open(uint16_t port, const StreamTransportConfig& config);
+    void Close() { socket_.Close(); }
+
+    // Waits up to timeout for datagrams and appends the TS bytes that are ready, in order, to ts.
+    // Returns false on a socket error.
+    bool Poll(std::vector<uint8_t>& ts, std::chrono::microseconds timeout);
+
+    StreamReceiverStats GetStats() const { return stats_; }
+    UdpEndpoint GetLocalEndpoint() const { return socket_.GetLocalEndpoint(); }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Parity
+    {
+        uint64_t base = 0;
+        int count = 0;
+        uint16_t length = 0;
+        std::vector<uint8_t> payload;
+    };
+
+    struct Missing
+    {
+        Clock::time_point detected;
+        Clock::time_point next_nack;
+        bool nacked = false;
+    };
+
+    void OnDatagram(const uint8_t* data, size_t size, Clock::time_point now);
+    void StoreMedia(uint64_t sequence, const uint8_t* payload, size_t size, Clock::time_point now, bool recovered);
+    void TryRecover(Clock::time_point now);
+    void SendNacks(Clock::time_point now);
+    void Deliver(std::vector<uint8_t>& ts, Clock::time_point now);
+    uint64_t Extend(uint16_t sequence);
+    bool Has(uint64_t sequence) const;
+
+    StreamTransportConfig config_;
+    UdpSocket socket_;
+    UdpEndpoint sender_;                // Where NACKs go: the source of the first datagram
+    uint32_t sender_ssrc_ = 0;
+    std::vector<uint8_t> datagram_;
+
+    // Ring of recent media payloads by extended sequence; kept after delivery for FEC
+    struct Slot
+    {
+        uint64_t sequence = ~0ull;
+        std::vector<uint8_t> payload;
+    };
+    std::vector<Slot> slots_;
+    bool started_ = false;
+    uint64_t next_ = 0;                 // Next sequence to hand on
+    uint64_t highest_ = 0;
+    std::map<uint64_t, Missing> missing_;
+    std::map<uint64_t, Parity> parity_;
+
+    StreamReceiverStats stats_;
+};
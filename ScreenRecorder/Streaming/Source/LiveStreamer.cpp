@@ -0,0 +1,85 @@
+#include <cstdlib>
+
+#include "LiveStreamer.h"
+
+bool ParseStreamUrl(const std::string& url, std::string& host, uint16_t& port)
+{
+    const std::string scheme = "udp://";
+    std::string address = url.compare(0, scheme.size(), scheme) == 0 ? url.substr(scheme.size()) : url;
+
+    // udp://@:port is the listening form players use; a sender reads it as this machine
+    if (!address.empty() && address[0] == '@') address.erase(0, 1);
+
+    const size_t colon = address.rfind(':');
+    if (colon == std::string::npos) return false;
+
+    const long value = std::strtol(address.c_str() + colon + 1, nullptr, 10);
+    if (value <= 0 || value > 0xFFFF) return false;
+
+    host = colon > 0 ? address.substr(0, colon) : "127.0.0.1";
+    port = static_cast<uint16_t>(value);
+    return true;
+}
+
+bool LiveStreamer::Start(const StreamConfig& config, NalCodec codec)
+{
+    UdpEndpoint destination;
+    if (!UdpSocket::Resolve(config.host, config.port, destination)) return false;
+    if (!sender_.Open(destination, config.transport)) return false;
+
+    muxer_ = std::make_unique<TsMuxer>(codec, config.pts_delay_ms);
+    has_epoch_ = false;
+    access_units_.store(0, std::memory_order_relaxed);
+    keyframes_.store(0, std::memory_order_relaxed);
+    ts_bytes_.store(0, std::memory_order_relaxed);
+    send_failures_.store(0, std::memory_order_relaxed);
+    packetize_latency_.Reset();
+    return true;
+}
+
+void LiveStreamer::Stop()
+{
+    sender_.Close();
+    muxer_.reset();
+}
+
+bool LiveStreamer::WriteAccessUnit(const uint8_t* data, size_t size, std::chrono::steady_clock::time_point capture_time, bool is_keyframe)
+{
+    if (!muxer_) return false;
+
+    const auto start = std::chrono::steady_clock::now();
+    if (!has_epoch_)
+    {
+        epoch_ = capture_time;
+        has_epoch_ = true;
+    }
+
+    const uint64_t clock_90k = capture_time > epoch_
+        ? static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(capture_time - epoch_).count()) * 9 / 100
+        : 0;
+
+    ts_.clear();
+    muxer_->WriteAccessUnit(data, size, clock_90k, is_keyframe, ts_);
+    const bool sent = sender_.Send(ts_.data(), ts_.size(), static_cast<uint32_t>(clock_90k));
+
+    packetize_latency_.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    access_units_.fetch_add(1, std::memory_order_relaxed);
+    if (is_keyframe) keyframes_.fetch_add(1, std::memory_order_relaxed);
+    ts_bytes_.fetch_add(ts_.size(), std::memory_order_relaxed);
+    if (!sent) send_failures_.fetch_add(1, std::memory_order_relaxed);
+    return sent;
+}
+
+LiveStreamStats LiveStreamer::GetStats() const
+{
+    LiveStreamStats stats;
+    stats.access_units = access_units_.load(std::memory_order_relaxed);
+    stats.keyframes = keyframes_.load(std::memory_order_relaxed);
+    stats.ts_bytes = ts_bytes_.load(std::memory_order_relaxed);
+    stats.send_failures = send_failures_.load(std::memory_order_relaxed);
+    stats.packetize_p50_ms = packetize_latency_.GetPercentileMs(50.0);
+    stats.packetize_p99_ms = packetize_latency_.GetPercentileMs(99.0);
+    stats.packetize_max_ms = packetize_latency_.GetMaxMs();
+    stats.transport = sender_.GetStats();
+    return stats;
+}
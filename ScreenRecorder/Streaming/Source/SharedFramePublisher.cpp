@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <chrono>
+#include <new>
+
+#include "FrameKernels.h"
+#include "FrameTracer.h"
+#include "HotPathCounters.h"
+#include "SharedFramePublisher.h"
+
+namespace
+{
+    int64_t ToNs(std::chrono::steady_clock::time_point time)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
+}
+
+SharedFramePublisher::SharedFramePublisher(std::string name, int slot_count)
+    : name_(std::move(name)),
+      slot_count_(static_cast<uint32_t>(std::max(2, slot_count)))
+{
+}
+
+SharedFramePublisher::~SharedFramePublisher()
+{
+    Close();
+}
+
+bool SharedFramePublisher::Open(int width, int height, int bytes_per_pixel)
+{
+    Close();
+    if (width <= 0 || height <= 0 || bytes_per_pixel <= 0) return false;
+
+    const size_t row_bytes = static_cast<size_t>(width) * bytes_per_pixel;
+    slot_bytes_ = SharedFrameRing::RoundUp(static_cast<size_t>(SharedFrameRing::GetPitch(row_bytes)) * height, SharedFrameRing::kPageSize);
+    const size_t slot_offset = SharedFrameRing::GetSlotOffset(slot_count_);
+    if (!memory_.Create(name_, slot_offset + slot_bytes_ * slot_count_)) return false;
+
+    header_ = new (memory_.GetData()) SharedFrameRing::RingHeader();
+    slots_ = SharedFrameRing::GetSlots(memory_.GetData());
+    for (uint32_t i = 0; i < slot_count_; ++i) new (&slots_[i]) SharedFrameRing::SlotHeader();
+    header_->version = SharedFrameRing::kVersion;
+    header_->slot_count = slot_count_;
+    header_->slot_offset = slot_offset;
+    header_->slot_stride = slot_bytes_;
+    std::atomic_thread_fence(std::memory_order_release);
+    header_->magic = SharedFrameRing::kMagic;
+
+    published_ = 0;
+    stale_.assign(slot_count_, DirtyRegion());
+    if (budget_) ring_reservation_ = budget_->Charge(memory_.GetSize());
+    return true;
+}
+
+bool SharedFramePublisher::ProcessFrame(const std::vector<uint8_t>& image_buffer, int width, int height)
+{
+    return ProcessFrame(FrameDescriptor::Packed(image_buffer.data(), FrameFormat::Bgra, width, height), DirtyRegion::Full(width, height));
+}
+
+bool SharedFramePublisher::ProcessFrame(const FrameDescriptor& frame, const DirtyRegion& dirty)
+{
+    if (!header_) return false;
+
+    const size_t row_bytes = frame.GetRowBytes(0);
+    const ptrdiff_t pitch = SharedFrameRing::GetPitch(row_bytes);
+    if (!frame.IsValid() || frame.GetPlaneCount() != 1 || static_cast<size_t>(pitch) * frame.height > slot_bytes_)
+    {
+        frames_rejected_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    auto publish_start = std::chrono::steady_clock::now();
+    const uint32_t frame_number = published_ + 1;
+    const uint32_t index = (frame_number - 1) % slot_count_;
+    SharedFrameRing::SlotHeader& slot = slots_[index];
+    uint8_t* pixels = memory_.GetData() + header_->slot_offset + static_cast<size_t>(index) * slot_bytes_;
+
+    // The slot holds an older frame; bring it up to date with everything changed since
+    const DirtyRegion region = dirty.ForFrame(frame.width, frame.height);
+    DirtyRegion copy = stale_[index];
+    copy.Add(region);
+    if (slot.width != frame.width || slot.height != frame.height || slot.format != static_cast<uint32_t>(frame.format))
+    {
+        copy = DirtyRegion::Full(frame.width, frame.height);
+    }
+
+    const uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.format = static_cast<uint32_t>(frame.format);
+    slot.width = frame.width;
+    slot.height = frame.height;
+    slot.pitch = pitch;
+    slot.frame_number = frame_number;
+    slot.capture_ns = ToNs(frame.timestamp);
+    const std::span<const DirtyRect> rects = region.GetRects();
+    if (rects.size() <= SharedFrameRing::kMaxDirtyRects)
+    {
+        std::copy(rects.begin(), rects.end(), slot.dirty);
+        slot.dirty_count = static_cast<uint32_t>(rects.size());
+    }
+    else
+    {
+        int left = frame.width, top = frame.height, right = 0, bottom = 0;
+        for (const DirtyRect& rect : rects)
+        {
+            left = std::min(left, rect.x);
+            top = std::min(top, rect.y);
+            right = std::max(right, rect.x + rect.width);
+            bottom = std::max(bottom, rect.y + rect.height);
+        }
+        slot.dirty[0] = { left, top, right - left, bottom - top };
+        slot.dirty_count = 1;
+    }
+
+    {
+        TraceSpan copy_span(TraceStage::Copy);
+        FrameKernels::CopyImageRegion(pixels, pitch, frame.planes[0].data, frame.planes[0].pitch, frame.GetBytesPerPixel(), copy);
+        HotPathCounters::CountCopy(TraceStage::Copy, copy.GetArea() * frame.GetBytesPerPixel());
+    }
+    slot.publish_ns = ToNs(std::chrono::steady_clock::now());
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+
+    for (uint32_t i = 0; i < slot_count_; ++i)
+    {
+        if (i != index) stale_[i].Add(region);
+    }
+    stale_[index] = DirtyRegion(frame.width, frame.height);
+
+    // Pairs with the reader counting itself in before it re-checks published and sleeps
+    published_ = frame_number;
+    header_->published.store(frame_number, std::memory_order_seq_cst);
+    const uint32_t waiters = header_->waiters.load(std::memory_order_seq_cst);
+    if (waiters > 0)
+    {
+        memory_.WakeAll(header_->published, waiters);
+        wakeups_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    frames_published_.fetch_add(1, std::memory_order_relaxed);
+    bytes_copied_.fetch_add(copy.GetArea() * frame.GetBytesPerPixel(), std::memory_order_relaxed);
+    publish_ns_.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - publish_start).count(),
+                          std::memory_order_relaxed);
+    return true;
+}
+
+bool SharedFramePublisher::Close()
+{
+    if (!header_) return true;
+
+    header_->closed.store(1, std::memory_order_seq_cst);
+    memory_.WakeAll(header_->published, header_->waiters.load(std::memory_order_seq_cst));
+    header_ = nullptr;
+    slots_ = nullptr;
+    memory_.Close();
+    ring_reservation_.Reset();
+    return true;
+}
+
+SharedFramePublisherStats SharedFramePublisher::GetStats() const
+{
+    SharedFramePublisherStats stats;
+    stats.frames_published = frames_published_.load(std::memory_order_relaxed);
+    stats.frames_rejected = frames_rejected_.load(std::memory_order_relaxed);
+    stats.bytes_copied = bytes_copied_.load(std::memory_order_relaxed);
+    stats.wakeups = wakeups_.load(std::memory_order_relaxed);
+    stats.publish_ms = publish_ns_.load(std::memory_order_relaxed) / 1e6;
+    stats.ring_bytes = SharedFrameRing::GetSlotOffset(slot_count_) + slot_bytes_ * slot_count_;
+    return stats;
+}
@@ -0,0 +1,149 @@
+#include <algorithm>
+
+#include "FrameKernels.h"
+#include "SharedFrameReader.h"
+
+namespace
+{
+    std::chrono::steady_clock::time_point FromNs(int64_t ns)
+    {
+        return std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(ns)));
+    }
+}
+
+FrameDescriptor SharedFrameView::GetDescriptor() const
+{
+    FrameDescriptor frame = FrameDescriptor::Packed(data, format, width, height, capture_time);
+    frame.planes[0].pitch = pitch;
+    return frame;
+}
+
+bool SharedFrameReader::Open(const std::string& name)
+{
+    Close();
+    if (!memory_.Open(name)) return false;
+
+    auto* header = reinterpret_cast<SharedFrameRing::RingHeader*>(memory_.GetData());
+    const bool valid = memory_.GetSize() >= sizeof(SharedFrameRing::RingHeader) && header->magic == SharedFrameRing::kMagic
+                       && header->version == SharedFrameRing::kVersion && header->slot_count > 0
+                       && header->slot_offset + header->slot_stride * header->slot_count <= memory_.GetSize();
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!valid)
+    {
+        memory_.Close();
+        return false;
+    }
+
+    header_ = header;
+    slots_ = SharedFrameRing::GetSlots(memory_.GetData());
+    last_frame_ = 0;
+    stats_ = SharedFrameReaderStats();
+    return true;
+}
+
+void SharedFrameReader::Close()
+{
+    header_ = nullptr;
+    slots_ = nullptr;
+    memory_.Close();
+}
+
+SharedFrameStatus SharedFrameReader::WaitForFrame(SharedFrameView& view, std::chrono::microseconds timeout)
+{
+    if (!header_) return SharedFrameStatus::Closed;
+
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    for (;;)
+    {
+        const uint32_t published = header_->published.load(std::memory_order_acquire);
+        // A failed read means the slot was lapped meanwhile; published has moved on, so the wait
+        // below returns at once and the next pass takes the newer frame
+        if (published != last_frame_ && published != 0 && ReadSlot(published, view))
+        {
+            if (last_frame_ != 0) stats_.frames_skipped += published - last_frame_ - 1;
+            last_frame_ = published;
+            ++stats_.frames_read;
+            return SharedFrameStatus::Ok;
+        }
+        if (header_->closed.load(std::memory_order_acquire)) return SharedFrameStatus::Closed;
+
+        const auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0) return SharedFrameStatus::Timeout;
+
+        // Counted in before the re-check, so a publish after it sees a waiter and wakes us
+        header_->waiters.fetch_add(1, std::memory_order_seq_cst);
+        if (header_->published.load(std::memory_order_seq_cst) == published && !header_->closed.load(std::memory_order_seq_cst))
+        {
+            memory_.Wait(header_->published, published, remaining);
+        }
+        header_->waiters.fetch_sub(1, std::memory_order_seq_cst);
+    }
+}
+
+bool SharedFrameReader::Validate(const SharedFrameView& view)
+{
+    if (!header_) return false;
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const bool whole = slots_[view.slot].sequence.load(std::memory_order_relaxed) == view.sequence;
+    if (!whole) ++stats_.frames_torn;
+    return whole;
+}
+
+SharedFrameStatus SharedFrameReader::CopyFrame(std::vector<uint8_t>& pixels, SharedFrameView& view, std::chrono::microseconds timeout)
+{
+    for (;;)
+    {
+        const SharedFrameStatus status = WaitForFrame(view, timeout);
+        if (status != SharedFrameStatus::Ok) return status;
+
+        const size_t row_bytes = view.GetDescriptor().GetRowBytes(0);
+        pixels.resize(row_bytes * view.height);
+        FrameKernels::CopyImage(pixels.data(), row_bytes, view.data, view.pitch, row_bytes, view.height);
+        if (Validate(view)) return status;
+    }
+}
+
+bool SharedFrameReader::ReadSlot(uint32_t frame_number, SharedFrameView& view)
+{
+    const uint32_t index = (frame_number - 1) % header_->slot_count;
+    const SharedFrameRing::SlotHeader& slot = slots_[index];
+
+    const uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence & 1) return false;
+
+    FrameDescriptor frame;
+    frame.format = static_cast<FrameFormat>(slot.format);
+    frame.width = slot.width;
+    frame.height = slot.height;
+    const int64_t pitch = slot.pitch;
+    const uint64_t slot_frame = slot.frame_number;
+    const int64_t capture_ns = slot.capture_ns;
+    const int64_t publish_ns = slot.publish_ns;
+    DirtyRegion dirty(frame.width, frame.height);
+    const uint32_t dirty_count = std::min<uint32_t>(slot.dirty_count, SharedFrameRing::kMaxDirtyRects);
+    for (uint32_t i = 0; i < dirty_count; ++i) dirty.Add(slot.dirty[i]);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != sequence || slot_frame != frame_number) return false;
+
+    // A header that does not fit its slot is not one the publisher wrote
+    if (frame.width <= 0 || frame.height <= 0 || frame.GetPlaneCount() != 1 || pitch < static_cast<int64_t>(frame.GetRowBytes(0))
+        || static_cast<uint64_t>(pitch) * frame.height > header_->slot_stride)
+    {
+        return false;
+    }
+
+    view.data = memory_.GetData() + header_->slot_offset + static_cast<size_t>(index) * header_->slot_stride;
+    view.format = frame.format;
+    view.width = frame.width;
+    view.height = frame.height;
+    view.pitch = static_cast<ptrdiff_t>(pitch);
+    view.frame_number = slot_frame;
+    view.capture_time = FromNs(capture_ns);
+    view.publish_time = FromNs(publish_ns);
+    view.dirty = dirty;
+    view.slot = index;
+    view.sequence = sequence;
+    return true;
+}
@@ -0,0 +1,198 @@
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "SharedMemory.h"
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) && std::atomic<uint32_t>::is_always_lock_free,
+              "shared words are waited on as plain 32-bit values");
+
+#ifdef _WIN32
+namespace
+{
+    std::string GetObjectName(const std::string& name, const char* suffix)
+    {
+        return "Local\\ScreenRecorder." + name + suffix;
+    }
+}
+
+bool SharedMemory::Create(const std::string& name, size_t bytes)
+{
+    Close();
+
+    const uint64_t size = bytes;
+    mapping_ = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32),
+                                  static_cast<DWORD>(size), GetObjectName(name, "").c_str());
+    // A mapping of that name still open elsewhere would be handed back at its old size
+    if (!mapping_ || GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        Close();
+        return false;
+    }
+    wake_ = CreateSemaphoreA(nullptr, 0, LONG_MAX, GetObjectName(name, ".wake").c_str());
+    data_ = static_cast<uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, bytes));
+    if (!wake_ || !data_)
+    {
+        Close();
+        return false;
+    }
+
+    size_ = bytes;
+    is_creator_ = true;
+    name_ = name;
+    return true;
+}
+
+bool SharedMemory::Open(const std::string& name)
+{
+    Close();
+
+    mapping_ = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, GetObjectName(name, "").c_str());
+    wake_ = OpenSemaphoreA(SEMAPHORE_ALL_ACCESS, FALSE, GetObjectName(name, ".wake").c_str());
+    if (!mapping_ || !wake_)
+    {
+        Close();
+        return false;
+    }
+    data_ = static_cast<uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+    MEMORY_BASIC_INFORMATION info = {};
+    if (!data_ || VirtualQuery(data_, &info, sizeof(info)) == 0)
+    {
+        Close();
+        return false;
+    }
+
+    size_ = info.RegionSize;
+    name_ = name;
+    return true;
+}
+
+void SharedMemory::Close()
+{
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(mapping_);
+    if (wake_) CloseHandle(wake_);
+    data_ = nullptr;
+    mapping_ = nullptr;
+    wake_ = nullptr;
+    size_ = 0;
+    is_creator_ = false;
+    name_.clear();
+}
+
+bool SharedMemory::Wait(std::atomic<uint32_t>& word, uint32_t expected, std::chrono::microseconds timeout)
+{
+    if (word.load(std::memory_order_acquire) != expected) return true;
+
+    // Releases meant for waiters that already left can wake this one early; the caller re-checks
+    const DWORD timeout_ms = static_cast<DWORD>((timeout.count() + 999) / 1000);
+    return WaitForSingleObject(wake_, timeout_ms) == WAIT_OBJECT_0;
+}
+
+void SharedMemory::WakeAll(std::atomic<uint32_t>& word, uint32_t waiters)
+{
+    if (wake_ && waiters > 0) ReleaseSemaphore(wake_, static_cast<LONG>(waiters), nullptr);
+}
+#else
+namespace
+{
+    std::string GetObjectName(const std::string& name)
+    {
+        return "/screenrecorder." + name;
+    }
+}
+
+bool SharedMemory::Create(const std::string& name, size_t bytes)
+{
+    Close();
+
+    const std::string object_name = GetObjectName(name);
+    shm_unlink(object_name.c_str());
+    file_descriptor_ = shm_open(object_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (file_descriptor_ < 0) return false;
+
+    is_creator_ = true;
+    name_ = name;
+    if (ftruncate(file_descriptor_, static_cast<off_t>(bytes)) != 0)
+    {
+        Close();
+        return false;
+    }
+
+    void* data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor_, 0);
+    if (data == MAP_FAILED)
+    {
+        Close();
+        return false;
+    }
+
+    data_ = static_cast<uint8_t*>(data);
+    size_ = bytes;
+    return true;
+}
+
+bool SharedMemory::Open(const std::string& name)
+{
+    Close();
+
+    // Readers write too: they count themselves in as waiters
+    file_descriptor_ = shm_open(GetObjectName(name).c_str(), O_RDWR, 0);
+    if (file_descriptor_ < 0) return false;
+
+    struct stat status = {};
+    void* data = MAP_FAILED;
+    if (fstat(file_descriptor_, &status) == 0 && status.st_size > 0)
+    {
+        data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor_, 0);
+    }
+    if (data == MAP_FAILED)
+    {
+        Close();
+        return false;
+    }
+
+    data_ = static_cast<uint8_t*>(data);
+    size_ = static_cast<size_t>(status.st_size);
+    name_ = name;
+    return true;
+}
+
+void SharedMemory::Close()
+{
+    if (data_) munmap(data_, size_);
+    if (file_descriptor_ >= 0) close(file_descriptor_);
+    if (is_creator_) shm_unlink(GetObjectName(name_).c_str());
+    data_ = nullptr;
+    file_descriptor_ = -1;
+    size_ = 0;
+    is_creator_ = false;
+    name_.clear();
+}
+
+bool SharedMemory::Wait(std::atomic<uint32_t>& word, uint32_t expected, std::chrono::microseconds timeout)
+{
+    timespec relative = {};
+    relative.tv_sec = static_cast<time_t>(timeout.count() / 1000000);
+    relative.tv_nsec = static_cast<long>(timeout.count() % 1000000) * 1000;
+
+    // Not FUTEX_PRIVATE: the word lives in a mapping other processes wait on
+    const long result = syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &relative, nullptr, 0);
+    return result == 0 || errno != ETIMEDOUT;
+}
+
+void SharedMemory::WakeAll(std::atomic<uint32_t>& word, uint32_t waiters)
+{
+    if (waiters > 0) syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+#endif
@@ -0,0 +1,151 @@
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "UdpSocket.h"
+
+namespace
+{
+    sockaddr_in ToSockaddr(const UdpEndpoint& endpoint)
+    {
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(endpoint.address);
+        address.sin_port = htons(endpoint.port);
+        return address;
+    }
+
+    UdpEndpoint FromSockaddr(const sockaddr_in& address)
+    {
+        return UdpEndpoint{ ntohl(address.sin_addr.s_addr), ntohs(address.sin_port) };
+    }
+}
+
+bool UdpSocket::Open(uint16_t port, int buffer_bytes)
+{
+    Close();
+
+#ifdef _WIN32
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) return false;
+
+    SOCKET handle = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (handle == INVALID_SOCKET)
+    {
+        WSACleanup();
+        return false;
+    }
+    socket_ = static_cast<uintptr_t>(handle);
+#else
+    socket_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (socket_ < 0) return false;
+#endif
+    is_open_ = true;
+
+    // Best effort; the OS may cap them
+    setsockopt(socket_, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&buffer_bytes), sizeof(buffer_bytes));
+    setsockopt(socket_, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&buffer_bytes), sizeof(buffer_bytes));
+
+    sockaddr_in address = ToSockaddr(UdpEndpoint{ INADDR_ANY, port });
+    if (bind(socket_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void UdpSocket::Close()
+{
+    if (!is_open_) return;
+
+#ifdef _WIN32
+    closesocket(static_cast<SOCKET>(socket_));
+    WSACleanup();
+#else
+    close(socket_);
+#endif
+    is_open_ = false;
+}
+
+bool UdpSocket::SendTo(const uint8_t* data, size_t size, const UdpEndpoint& to)
+{
+    if (!is_open_) return false;
+
+    sockaddr_in address = ToSockaddr(to);
+    const auto sent = sendto(socket_, reinterpret_cast<const char*>(data), static_cast<int>(size), 0,
+                             reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+#ifdef _WIN32
+    return sent == static_cast<int>(size);
+#else
+    return sent == static_cast<ssize_t>(size);
+#endif
+}
+
+int UdpSocket::ReceiveFrom(uint8_t* data, size_t capacity, UdpEndpoint& from, std::chrono::microseconds timeout)
+{
+    if (!is_open_) return -1;
+
+    const int timeout_ms = static_cast<int>((timeout.count() + 999) / 1000);
+#ifdef _WIN32
+    WSAPOLLFD poll_entry = { static_cast<SOCKET>(socket_), POLLRDNORM, 0 };
+    const int ready = WSAPoll(&poll_entry, 1, timeout_ms);
+#else
+    pollfd poll_entry = { socket_, POLLIN, 0 };
+    const int ready = poll(&poll_entry, 1, timeout_ms);
+#endif
+    if (ready == 0) return 0;
+    if (ready < 0) return -1;
+
+    sockaddr_in address = {};
+    socklen_t address_size = sizeof(address);
+    const auto received = recvfrom(socket_, reinterpret_cast<char*>(data), static_cast<int>(capacity), 0,
+                                   reinterpret_cast<sockaddr*>(&address), &address_size);
+    if (received < 0) return -1;
+
+    from = FromSockaddr(address);
+    return static_cast<int>(received);
+}
+
+UdpEndpoint UdpSocket::GetLocalEndpoint() const
+{
+    sockaddr_in address = {};
+    socklen_t address_size = sizeof(address);
+    if (!is_open_ || getsockname(socket_, reinterpret_cast<sockaddr*>(&address), &address_size) != 0) return UdpEndpoint();
+    return FromSockaddr(address);
+}
+
+bool UdpSocket::Resolve(const std::string& host, uint16_t port, UdpEndpoint& endpoint)
+{
+#ifdef _WIN32
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) return false;
+#endif
+
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* result = nullptr;
+    const bool resolved = getaddrinfo(host.c_str(), nullptr, &hints, &result) == 0 && result;
+    if (resolved)
+    {
+        endpoint = FromSockaddr(*reinterpret_cast<const sockaddr_in*>(result->ai_addr));
+        endpoint.port = port;
+        freeaddrinfo(result);
+    }
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return resolved;
+}
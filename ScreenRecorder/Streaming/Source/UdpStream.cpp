@@ -0,0 +1,454 @@
+#include <algorithm>
+#include <cstring>
+
+#include "UdpStream.h"
+
+namespace
+{
+    constexpr size_t kTsPacketBytes = 188;
+    constexpr size_t kRtpHeaderSize = 12;
+    constexpr uint8_t kPayloadMp2t = 33;
+    constexpr uint8_t kPayloadParity = 96;
+    constexpr uint8_t kRtcpFeedback = 205;
+    constexpr uint8_t kFormatNack = 1;
+    constexpr size_t kMaxDatagram = 65536;
+    constexpr size_t kReceiveSlots = 4096;
+
+    // Reordering shows up as a gap that fills within a millisecond or two; asking sooner only
+    // gets duplicates
+    constexpr auto kNackDelay = std::chrono::milliseconds(2);
+
+    void PutU16(uint8_t* out, uint16_t value)
+    {
+        out[0] = static_cast<uint8_t>(value >> 8);
+        out[1] = static_cast<uint8_t>(value);
+    }
+
+    void PutU32(uint8_t* out, uint32_t value)
+    {
+        PutU16(out, static_cast<uint16_t>(value >> 16));
+        PutU16(out + 2, static_cast<uint16_t>(value));
+    }
+
+    uint16_t GetU16(const uint8_t* in) { return static_cast<uint16_t>((in[0] << 8) | in[1]); }
+    uint32_t GetU32(const uint8_t* in) { return (static_cast<uint32_t>(GetU16(in)) << 16) | GetU16(in + 2); }
+
+    void WriteRtpHeader(uint8_t* out, uint8_t payload_type, bool marker, uint16_t sequence, uint32_t timestamp, uint32_t ssrc)
+    {
+        out[0] = 0x80;
+        out[1] = static_cast<uint8_t>((marker ? 0x80 : 0) | payload_type);
+        PutU16(out + 2, sequence);
+        PutU32(out + 4, timestamp);
+        PutU32(out + 8, ssrc);
+    }
+}
+
+bool UdpStreamSender::Open(const UdpEndpoint& destination, const StreamTransportConfig& config)
+{
+    Close();
+
+    config_ = config;
+    config_.packets_per_datagram = std::clamp(config_.packets_per_datagram, 1, 7);
+    destination_ = destination;
+    if (!socket_.Open()) return false;
+
+    std::random_device random;
+    ssrc_ = random();
+    sequence_ = static_cast<uint16_t>(random());
+    group_count_ = 0;
+    history_.assign(config_.retransmit ? std::max(64, config_.history_datagrams) : 0, SentDatagram());
+    stats_ = StreamSenderStats();
+
+    if (config_.retransmit)
+    {
+        running_.store(true, std::memory_order_relaxed);
+        feedback_thread_ = std::thread(&UdpStreamSender::FeedbackLoop, this);
+    }
+    return true;
+}
+
+void UdpStreamSender::Close()
+{
+    running_.store(false, std::memory_order_relaxed);
+    if (feedback_thread_.joinable()) feedback_thread_.join();
+    socket_.Close();
+}
+
+void UdpStreamSender::SetSimulatedLoss(double rate, uint32_t seed)
+{
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    loss_rate_ = rate;
+    loss_random_.seed(seed);
+}
+
+StreamSenderStats UdpStreamSender::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    return stats_;
+}
+
+bool UdpStreamSender::SendDatagram(const uint8_t* data, size_t size)
+{
+    if (loss_rate_ > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(loss_random_) < loss_rate_)
+    {
+        ++stats_.simulated_losses;
+        return true;
+    }
+
+    ++stats_.datagrams;
+    stats_.bytes += size;
+    return socket_.SendTo(data, size, destination_);
+}
+
+bool UdpStreamSender::Send(const uint8_t* ts, size_t size, uint32_t clock_90k)
+{
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (!socket_.IsOpen()) return false;
+
+    const size_t chunk_size = kTsPacketBytes * config_.packets_per_datagram;
+    const bool rtp = config_.UsesRtp();
+    bool sent = true;
+
+    for (size_t offset = 0; offset < size; offset += chunk_size)
+    {
+        const size_t chunk = std::min(chunk_size, size - offset);
+        if (!rtp)
+        {
+            sent &= SendDatagram(ts + offset, chunk);
+            continue;
+        }
+
+        const bool last = offset + chunk >= size;
+        datagram_.resize(kRtpHeaderSize + chunk);
+        WriteRtpHeader(datagram_.data(), kPayloadMp2t, last, sequence_, clock_90k, ssrc_);
+        std::memcpy(datagram_.data() + kRtpHeaderSize, ts + offset, chunk);
+
+        if (!history_.empty())
+        {
+            SentDatagram& entry = history_[sequence_ % history_.size()];
+            entry.sequence = sequence_;
+            entry.data.assign(datagram_.begin(), datagram_.end());
+        }
+
+        if (config_.fec_group > 0)
+        {
+            if (group_count_ == 0)
+            {
+                group_base_ = sequence_;
+                parity_.assign(chunk, 0);
+                parity_length_ = 0;
+            }
+            if (parity_.size() < chunk) parity_.resize(chunk, 0);
+            for (size_t i = 0; i < chunk; ++i) parity_[i] ^= ts[offset + i];
+            parity_length_ ^= static_cast<uint16_t>(chunk);
+            ++group_count_;
+        }
+
+        sent &= SendDatagram(datagram_.data(), datagram_.size());
+        ++sequence_;
+
+        // Groups close at the end of the access unit so its parity follows right behind it
+        if (config_.fec_group > 0 && (group_count_ == config_.fec_group || last)) SendParity();
+    }
+
+    return sent;
+}
+
+void UdpStreamSender::SendParity()
+{
+    // Sequence is the group's first media datagram; the timestamp field carries the group size
+    // and the XOR of the payload lengths
+    datagram_.resize(kRtpHeaderSize + parity_.size());
+    WriteRtpHeader(datagram_.data(), kPayloadParity, false, group_base_,
+                   (static_cast<uint32_t>(group_count_) << 16) | parity_length_, ssrc_);
+    std::memcpy(datagram_.data() + kRtpHeaderSize, parity_.data(), parity_.size());
+
+    SendDatagram(datagram_.data(), datagram_.size());
+    ++stats_.parity_datagrams;
+    group_count_ = 0;
+}
+
+void UdpStreamSender::FeedbackLoop()
+{
+    std::vector<uint8_t> packet(kMaxDatagram);
+
+    while (running_.load(std::memory_order_relaxed))
+    {
+        UdpEndpoint from;
+        const int size = socket_.ReceiveFrom(packet.data(), packet.size(), from, std::chrono::milliseconds(20));
+        if (size < 12) continue;
+
+        // Generic NACK: header, sender SSRC, media SSRC, then PID/BLP pairs
+        const uint8_t* data = packet.data();
+        if ((data[0] & 0xC0) != 0x80 || (data[0] & 0x1F) != kFormatNack || data[1] != kRtcpFeedback) continue;
+        const size_t length = std::min<size_t>(size, (static_cast<size_t>(GetU16(data + 2)) + 1) * 4);
+        if (GetU32(data + 8) != ssrc_) continue;
+
+        std::lock_guard<std::mutex> lock(send_mutex_);
+        ++stats_.nacks_received;
+        for (size_t offset = 12; offset + 4 <= length; offset += 4)
+        {
+            const uint16_t pid = GetU16(data + offset);
+            const uint16_t blp = GetU16(data + offset + 2);
+            for (int bit = -1; bit < 16; ++bit)
+            {
+                if (bit >= 0 && !(blp & (1 << bit))) continue;
+                const uint16_t sequence = static_cast<uint16_t>(pid + bit + 1);
+                const SentDatagram& entry = history_[sequence % history_.size()];
+                if (entry.sequence != sequence || entry.data.empty()) continue;
+
+                SendDatagram(entry.data.data(), entry.data.size());
+                ++stats_.retransmitted;
+            }
+        }
+    }
+}
+
+bool UdpStreamReceiver::Open(uint16_t port, const StreamTransportConfig& config)
+{
+    config_ = config;
+    datagram_.resize(kMaxDatagram);
+    slots_.assign(kReceiveSlots, Slot());
+    started_ = false;
+    missing_.clear();
+    parity_.clear();
+    stats_ = StreamReceiverStats();
+    return socket_.Open(port);
+}
+
+uint64_t UdpStreamReceiver::Extend(uint16_t sequence)
+{
+    // Nearest to the highest seen; starts well clear of zero so early reordering can't underflow
+    if (!started_) return (1ull << 32) + sequence;
+
+    uint64_t extended = (highest_ & ~0xFFFFull) | sequence;
+    if (extended + 0x8000 < highest_) extended += 0x10000;
+    else if (extended > highest_ + 0x8000) extended -= 0x10000;
+    return extended;
+}
+
+bool UdpStreamReceiver::Has(uint64_t sequence) const
+{
+    return slots_[sequence % slots_.size()].sequence == sequence;
+}
+
+bool UdpStreamReceiver::Poll(std::vector<uint8_t>& ts, std::chrono::microseconds timeout)
+{
+    // A gap has a deadline, so don't sleep past it
+    if (!missing_.empty()) timeout = std::min<std::chrono::microseconds>(timeout, std::chrono::milliseconds(1));
+
+    UdpEndpoint from;
+    int size = socket_.ReceiveFrom(datagram_.data(), datagram_.size(), from, timeout);
+    while (size > 0)
+    {
+        if (config_.UsesRtp())
+        {
+            if (!sender_.port) sender_ = from;
+            OnDatagram(datagram_.data(), size, Clock::now());
+        }
+        else
+        {
+            ++stats_.datagrams;
+            ts.insert(ts.end(), datagram_.begin(), datagram_.begin() + size);
+        }
+        size = socket_.ReceiveFrom(datagram_.data(), datagram_.size(), from, std::chrono::microseconds(0));
+    }
+    if (size < 0) return false;
+
+    if (config_.UsesRtp())
+    {
+        const Clock::time_point now = Clock::now();
+        SendNacks(now);
+        Deliver(ts, now);
+    }
+    return true;
+}
+
+void UdpStreamReceiver::OnDatagram(const uint8_t* data, size_t size, Clock::time_point now)
+{
+    if (size < kRtpHeaderSize || (data[0] & 0xC0) != 0x80) return;
+
+    const uint8_t payload_type = data[1] & 0x7F;
+    const uint64_t sequence = Extend(GetU16(data + 2));
+    sender_ssrc_ = GetU32(data + 8);
+
+    if (payload_type == kPayloadMp2t)
+    {
+        ++stats_.datagrams;
+        StoreMedia(sequence, data + kRtpHeaderSize, size - kRtpHeaderSize, now, false);
+    }
+    else if (payload_type == kPayloadParity && config_.fec_group > 0)
+    {
+        ++stats_.parity_datagrams;
+        const uint32_t field = GetU32(data + 4);
+        Parity parity;
+        parity.base = sequence;
+        parity.count = static_cast<int>(field >> 16);
+        parity.length = static_cast<uint16_t>(field);
+        if (!started_ || parity.count == 0 || parity.base + parity.count <= next_) return;
+        parity.payload.assign(data + kRtpHeaderSize, data + size);
+        parity_[parity.base] = std::move(parity);
+    }
+
+    TryRecover(now);
+}
+
+void UdpStreamReceiver::StoreMedia(uint64_t sequence, const uint8_t* payload, size_t size, Clock::time_point now, bool recovered)
+{
+    if (!started_ || sequence > highest_ + slots_.size())
+    {
+        // First datagram, or so far ahead that everything in between is gone anyway
+        started_ = true;
+        next_ = sequence;
+        highest_ = sequence;
+        missing_.clear();
+        parity_.clear();
+    }
+
+    if (sequence < next_ || Has(sequence))
+    {
+        ++stats_.duplicates;
+        return;
+    }
+
+    Slot& slot = slots_[sequence % slots_.size()];
+    slot.sequence = sequence;
+    slot.payload.assign(payload, payload + size);
+
+    auto missing = missing_.find(sequence);
+    if (missing != missing_.end())
+    {
+        if (missing->second.nacked && !recovered) ++stats_.recovered_retransmit;
+        missing_.erase(missing);
+    }
+
+    if (sequence > highest_)
+    {
+        for (uint64_t gap = highest_ + 1; gap < sequence; ++gap)
+        {
+            missing_[gap] = Missing{ now, now + kNackDelay, false };
+        }
+        highest_ = sequence;
+    }
+}
+
+void UdpStreamReceiver::TryRecover(Clock::time_point now)
+{
+    for (auto it = parity_.begin(); it != parity_.end(); )
+    {
+        const Parity& parity = it->second;
+        if (parity.base + parity.count <= next_)
+        {
+            it = parity_.erase(it);
+            continue;
+        }
+
+        int absent = 0;
+        uint64_t lost = 0;
+        for (uint64_t sequence = parity.base; sequence < parity.base + parity.count; ++sequence)
+        {
+            if (!Has(sequence))
+            {
+                ++absent;
+                lost = sequence;
+            }
+        }
+
+        // The parity proves the group was sent, so a lost last datagram is repaired without
+        // waiting for the next access unit to reveal the gap
+        if (absent != 1 || lost < next_)
+        {
+            it = absent == 0 ? parity_.erase(it) : std::next(it);
+            continue;
+        }
+
+        std::vector<uint8_t> payload = parity.payload;
+        uint16_t length = parity.length;
+        for (uint64_t sequence = parity.base; sequence < parity.base + parity.count; ++sequence)
+        {
+            if (sequence == lost) continue;
+            const std::vector<uint8_t>& other = slots_[sequence % slots_.size()].payload;
+            for (size_t i = 0; i < other.size() && i < payload.size(); ++i) payload[i] ^= other[i];
+            length ^= static_cast<uint16_t>(other.size());
+        }
+
+        it = parity_.erase(it);
+        if (length == 0 || length > payload.size() || length % kTsPacketBytes != 0) continue;
+
+        StoreMedia(lost, payload.data(), length, now, true);
+        ++stats_.recovered_fec;
+    }
+}
+
+void UdpStreamReceiver::SendNacks(Clock::time_point now)
+{
+    if (!config_.retransmit || !sender_.port || missing_.empty()) return;
+
+    const auto interval = std::chrono::milliseconds(std::max(5, config_.latency_ms / 4));
+    std::vector<uint8_t> packet(12);
+    uint16_t pid = 0;
+    uint16_t blp = 0;
+    bool open = false;
+
+    auto flush = [&]()
+    {
+        if (!open) return;
+        packet.resize(packet.size() + 4);
+        PutU16(packet.data() + packet.size() - 4, pid);
+        PutU16(packet.data() + packet.size() - 2, blp);
+        open = false;
+    };
+
+    for (auto& [sequence, missing] : missing_)
+    {
+        if (missing.next_nack > now) continue;
+        missing.nacked = true;
+        missing.next_nack = now + interval;
+
+        const uint16_t wire = static_cast<uint16_t>(sequence);
+        const uint16_t offset = static_cast<uint16_t>(wire - pid - 1);
+        if (open && offset < 16)
+        {
+            blp |= static_cast<uint16_t>(1 << offset);
+            continue;
+        }
+        flush();
+        pid = wire;
+        blp = 0;
+        open = true;
+    }
+    flush();
+    if (packet.size() == 12) return;
+
+    packet[0] = 0x80 | kFormatNack;
+    packet[1] = kRtcpFeedback;
+    PutU16(packet.data() + 2, static_cast<uint16_t>(packet.size() / 4 - 1));
+    PutU32(packet.data() + 4, 0);
+    PutU32(packet.data() + 8, sender_ssrc_);
+
+    socket_.SendTo(packet.data(), packet.size(), sender_);
+    ++stats_.nacks_sent;
+}
+
+void UdpStreamReceiver::Deliver(std::vector<uint8_t>& ts, Clock::time_point now)
+{
+    const auto latency = std::chrono::milliseconds(config_.latency_ms);
+
+    while (started_ && next_ <= highest_)
+    {
+        if (Has(next_))
+        {
+            const std::vector<uint8_t>& payload = slots_[next_ % slots_.size()].payload;
+            ts.insert(ts.end(), payload.begin(), payload.end());
+            ++next_;
+            continue;
+        }
+
+        auto missing = missing_.find(next_);
+        if (missing != missing_.end() && now - missing->second.detected < latency) break;
+
+        if (missing != missing_.end()) missing_.erase(missing);
+        ++stats_.lost;
+        ++next_;
+    }
+}
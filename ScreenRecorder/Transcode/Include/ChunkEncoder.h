@@ -0,0 +1,70 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "LosslessDeltaCodec.h"
+#include "Mp4Writer.h"
+
+#ifdef _WIN32
+#include "VideoEncoder.h"
+#endif
+
+// Encodes one chunk of a transcode into its own MP4. A chunk opens with a keyframe and
+// references nothing outside itself, so chunks can be encoded in any order on any thread
+// and their samples concatenated afterwards. One instance encodes one chunk at a time.
+class ChunkEncoder
+{
+public:
+    virtual ~ChunkEncoder() = default;
+
+    virtual bool Open(const std::filesystem::path& path) = 0;
+    // Payload as read from the .zraw input
+    virtual bool EncodeFrame(const std::vector<uint8_t>& frame) = 0;
+    virtual bool Close() = 0;
+};
+
+// One encoder per worker thread
+using ChunkEncoderFactory = std::function<std::unique_ptr<ChunkEncoder>()>;
+
+class LosslessChunkEncoder : public ChunkEncoder
+{
+public:
+    LosslessChunkEncoder(int width, int height, int fps, RawPixelFormat pixel_format);
+
+    bool Open(const std::filesystem::path& path) override;
+    bool EncodeFrame(const std::vector<uint8_t>& frame) override;
+    bool Close() override;
+
+private:
+    int width_;
+    int height_;
+    int fps_;
+    RawPixelFormat pixel_format_;
+    LosslessDeltaCodec codec_;
+    std::unique_ptr<Mp4Writer> writer_;
+    std::vector<uint8_t> packet_;
+};
+
+#ifdef _WIN32
+// Media Foundation encoder per chunk. BGRA input only.
+class MediaFoundationChunkEncoder : public ChunkEncoder
+{
+public:
+    MediaFoundationChunkEncoder(int width, int height, int fps, int bitrate, VideoCodec codec);
+
+    bool Open(const std::filesystem::path& path) override;
+    bool EncodeFrame(const std::vector<uint8_t>& frame) override;
+    bool Close() override;
+
+private:
+    int width_;
+    int height_;
+    int fps_;
+    int bitrate_;
+    VideoCodec codec_;
+    std::shared_ptr<VideoEncoder> encoder_;
+};
+#endif
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "ChunkEncoder.h"
+
+struct TranscodeOptions
+{
+    int workers = 0;                        // 0 = one per hardware thread
+    bool split_on_scenes = true;            // Chunk at scene cuts (BGRA input); fixed lengths otherwise
+    double min_chunk_seconds = 2.0;         // Cuts closer than this to the previous boundary are ignored
+    double max_chunk_seconds = 10.0;        // Longer scenes are split evenly, so this is also the longest GOP
+    uint64_t max_frames = 0;                // 0 = whole input
+    std::filesystem::path work_dir;         // Chunk files; the output's folder when empty
+    bool keep_chunks = false;
+};
+
+struct TranscodeChunk
+{
+    uint64_t first_frame = 0;
+    uint64_t frame_count = 0;
+    bool starts_at_cut = false;
+    uint64_t bytes = 0;
+    double encode_ms = 0.0;
+};
+
+struct TranscodeResult
+{
+    std::vector<TranscodeChunk> chunks;
+    uint64_t frames = 0;
+    uint64_t scene_cuts = 0;
+    uint64_t output_bytes = 0;
+    int workers = 0;
+    double analyze_ms = 0.0;                // Wall time of the scene pass
+    double encode_ms = 0.0;                 // Wall time of the parallel encode
+    double concat_ms = 0.0;
+    double worker_busy_ms = 0.0;            // Encode time summed over chunks
+    std::string error;
+
+    // Share of the workers' wall time spent encoding; 1.0 is perfect scaling
+    double GetParallelEfficiency() const { return encode_ms > 0 && workers > 0 ? worker_busy_ms / (encode_ms * workers) : 0.0; }
+};
+
+// Offline transcode of a .zraw recording on every core. The input is split into chunks at
+// scene cuts (bounded by min/max chunk length), chunks are encoded independently by a pool
+// of workers, largest first, and their samples are concatenated in order into one MP4
+// retimed from the input's timestamp index. Every chunk starts with a keyframe, so the
+// result is one stream with a keyframe at each chunk boundary.
+class ChunkedTranscoder
+{
+public:
+    ChunkedTranscoder(const TranscodeOptions& options, ChunkEncoderFactory factory);
+
+    bool Run(const std::filesystem::path& input, const std::filesystem::path& output, TranscodeResult& result);
+
+    // A boundary at every cut at least min_frames after the previous one; longer runs split evenly
+    static std::vector<TranscodeChunk> PlanChunks(uint64_t frame_count, const std::vector<uint64_t>& cuts,
+                                                  uint64_t min_frames, uint64_t max_frames);
+
+private:
+    static constexpr uint32_t kOutputTimescale = 90000;
+
+    bool FindSceneCuts(const std::filesystem::path& input, uint64_t frame_count, int workers,
+                       std::vector<uint64_t>& cuts, std::string& error) const;
+    bool EncodeChunks(const std::filesystem::path& input, const std::filesystem::path& work_dir, int workers,
+                      TranscodeResult& result) const;
+    bool Concatenate(const std::filesystem::path& input, const std::filesystem::path& work_dir,
+                     const std::filesystem::path& output, TranscodeResult& result) const;
+
+    static std::filesystem::path GetChunkPath(const std::filesystem::path& work_dir, size_t index);
+
+    TranscodeOptions options_;
+    ChunkEncoderFactory factory_;
+};
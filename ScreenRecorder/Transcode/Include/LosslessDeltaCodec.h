@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "RawVideoWriter.h"
+
+// Portable lossless codec, the stand-in for a software archival encoder where Media
+// Foundation is unavailable. It is CPU-bound per frame the way a real encoder is, so it
+// exercises chunked parallel encoding honestly.
+//
+// Keyframes predict each byte from the same channel of the previous pixel, other frames
+// from the co-located byte of the previous frame. Residuals are Rice-coded in 32-byte
+// blocks; an unchanged block costs one bit.
+class LosslessDeltaCodec
+{
+public:
+    LosslessDeltaCodec(int width, int height, RawPixelFormat pixel_format);
+
+    // packet is replaced; the first frame after construction or Reset must be a keyframe
+    void Encode(const uint8_t* frame, bool is_keyframe, std::vector<uint8_t>& packet);
+    bool Decode(const uint8_t* packet, size_t size, std::vector<uint8_t>& frame);
+    void Reset() { has_reference_ = false; }
+
+    size_t GetFrameSize() const { return frame_size_; }
+
+    // 'zdlt' visual sample entry carrying the pixel format, for Mp4Writer
+    static std::vector<uint8_t> BuildSampleEntry(int width, int height, RawPixelFormat pixel_format);
+    static bool ParseSampleEntry(const std::vector<uint8_t>& sample_entry, int& width, int& height, RawPixelFormat& pixel_format);
+
+private:
+    static constexpr size_t kBlockSize = 32;
+
+    size_t frame_size_;
+    size_t pixel_bytes_;
+    std::vector<uint8_t> reference_;
+    bool has_reference_ = false;
+};
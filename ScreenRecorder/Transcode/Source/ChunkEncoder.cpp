@@ -0,0 +1,65 @@
+#include "ChunkEncoder.h"
+
+LosslessChunkEncoder::LosslessChunkEncoder(int width, int height, int fps, RawPixelFormat pixel_format)
+    : width_(width), height_(height), fps_(fps > 0 ? fps : 60), pixel_format_(pixel_format), codec_(width, height, pixel_format)
+{
+}
+
+bool LosslessChunkEncoder::Open(const std::filesystem::path& path)
+{
+    // Chunk timing is a placeholder; the concatenated output is retimed from the input index
+    writer_ = std::make_unique<Mp4Writer>(static_cast<uint32_t>(fps_));
+    if (!writer_->Open(path)) return false;
+
+    writer_->SetVideoFormat(width_, height_, LosslessDeltaCodec::BuildSampleEntry(width_, height_, pixel_format_));
+    codec_.Reset();
+    return true;
+}
+
+bool LosslessChunkEncoder::EncodeFrame(const std::vector<uint8_t>& frame)
+{
+    if (!writer_ || frame.size() < codec_.GetFrameSize()) return false;
+
+    const bool is_keyframe = writer_->GetSampleCount() == 0;
+    codec_.Encode(frame.data(), is_keyframe, packet_);
+    return writer_->WriteSample(packet_.data(), packet_.size(), 1, is_keyframe);
+}
+
+bool LosslessChunkEncoder::Close()
+{
+    if (!writer_) return false;
+
+    bool result = writer_->Close();
+    writer_.reset();
+    return result;
+}
+
+#ifdef _WIN32
+MediaFoundationChunkEncoder::MediaFoundationChunkEncoder(int width, int height, int fps, int bitrate, VideoCodec codec)
+    : width_(width), height_(height), fps_(fps > 0 ? fps : 60), bitrate_(bitrate), codec_(codec)
+{
+}
+
+bool MediaFoundationChunkEncoder::Open(const std::filesystem::path& path)
+{
+    encoder_ = std::make_shared<VideoEncoder>(width_, height_, fps_, bitrate_, L"", path.wstring());
+
+    // Chunks are at most one GOP long; the only keyframe is the one every chunk starts with
+    encoder_->SetKeyframeInterval(0xFFFF);
+    return encoder_->Initialize(codec_);
+}
+
+bool MediaFoundationChunkEncoder::EncodeFrame(const std::vector<uint8_t>& frame)
+{
+    return encoder_ && encoder_->ProcessFrame(frame, width_, height_);
+}
+
+bool MediaFoundationChunkEncoder::Close()
+{
+    if (!encoder_) return false;
+
+    bool result = encoder_->Close();
+    encoder_.reset();
+    return result;
+}
+#endif
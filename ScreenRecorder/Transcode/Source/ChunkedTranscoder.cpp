@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <numeric>
+#include <thread>
+
+#include "ChunkedTranscoder.h"
+#include "Mp4Reader.h"
+#include "RawVideoReader.h"
+#include "SceneChangeDetector.h"
+
+namespace
+{
+    double MillisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Input timestamps are 100 ns units
+    uint64_t ToOutputTime(uint64_t timestamp, uint32_t timescale)
+    {
+        return timestamp * timescale / 10000000;
+    }
+}
+
+ChunkedTranscoder::ChunkedTranscoder(const TranscodeOptions& options, ChunkEncoderFactory factory)
+    : options_(options), factory_(std::move(factory))
+{
+}
+
+bool ChunkedTranscoder::Run(const std::filesystem::path& input, const std::filesystem::path& output, TranscodeResult& result)
+{
+    RawVideoReader reader;
+    if (!reader.Open(input))
+    {
+        result.error = "cannot read " + input.string();
+        return false;
+    }
+
+    const RawFileHeader& header = reader.GetHeader();
+    const int fps = header.fps > 0 ? static_cast<int>(header.fps) : 60;
+    result.frames = options_.max_frames ? std::min(options_.max_frames, reader.GetFrameCount()) : reader.GetFrameCount();
+    if (result.frames == 0)
+    {
+        result.error = "input has no frames";
+        return false;
+    }
+
+    result.workers = options_.workers > 0 ? options_.workers : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+    std::vector<uint64_t> cuts;
+    if (options_.split_on_scenes && reader.GetPixelFormat() == RawPixelFormat::BGRA)
+    {
+        auto analyze_start = std::chrono::steady_clock::now();
+        if (!FindSceneCuts(input, result.frames, result.workers, cuts, result.error)) return false;
+        result.analyze_ms = MillisecondsSince(analyze_start);
+        result.scene_cuts = cuts.size();
+    }
+
+    const uint64_t min_frames = std::max<uint64_t>(1, static_cast<uint64_t>(options_.min_chunk_seconds * fps));
+    const uint64_t max_frames = std::max<uint64_t>(min_frames, static_cast<uint64_t>(options_.max_chunk_seconds * fps));
+    result.chunks = PlanChunks(result.frames, cuts, min_frames, max_frames);
+
+    std::filesystem::path work_dir = options_.work_dir;
+    if (work_dir.empty())
+    {
+        work_dir = output.parent_path() / (output.stem().string() + "_chunks");
+    }
+    std::error_code error;
+    const bool created_work_dir = std::filesystem::create_directories(work_dir, error);
+
+    bool succeeded = EncodeChunks(input, work_dir, result.workers, result) && Concatenate(input, work_dir, output, result);
+
+    if (!options_.keep_chunks)
+    {
+        for (size_t i = 0; i < result.chunks.size(); ++i)
+        {
+            std::filesystem::remove(GetChunkPath(work_dir, i), error);
+        }
+        if (created_work_dir) std::filesystem::remove(work_dir, error);
+    }
+
+    return succeeded;
+}
+
+std::vector<TranscodeChunk> ChunkedTranscoder::PlanChunks(uint64_t frame_count, const std::vector<uint64_t>& cuts,
+                                                          uint64_t min_frames, uint64_t max_frames)
+{
+    std::vector<uint64_t> boundaries = cuts;
+    std::sort(boundaries.begin(), boundaries.end());
+    boundaries.push_back(frame_count);
+
+    std::vector<TranscodeChunk> chunks;
+    uint64_t start = 0;
+    bool starts_at_cut = false;
+
+    for (uint64_t boundary : boundaries)
+    {
+        if (boundary > frame_count) break;
+        if (boundary < frame_count && boundary - start < min_frames) continue;
+        if (boundary == start) continue;
+
+        // Split evenly rather than leave a short remainder
+        const uint64_t length = boundary - start;
+        const uint64_t parts = (length + max_frames - 1) / max_frames;
+        uint64_t first = start;
+        for (uint64_t part = 0; part < parts; ++part)
+        {
+            TranscodeChunk chunk;
+            chunk.first_frame = first;
+            chunk.frame_count = length / parts + (part < length % parts ? 1 : 0);
+            chunk.starts_at_cut = part == 0 && starts_at_cut;
+            chunks.push_back(chunk);
+            first += chunk.frame_count;
+        }
+
+        start = boundary;
+        starts_at_cut = true;
+    }
+
+    return chunks;
+}
+
+bool ChunkedTranscoder::FindSceneCuts(const std::filesystem::path& input, uint64_t frame_count, int workers,
+                                      std::vector<uint64_t>& cuts, std::string& error) const
+{
+    // Each worker scans a contiguous range, primed with the frame before it
+    const uint64_t ranges = std::min<uint64_t>(static_cast<uint64_t>(workers), frame_count);
+    std::vector<std::vector<uint64_t>> range_cuts(ranges);
+    std::atomic<bool> failed{ false };
+    std::vector<std::thread> threads;
+
+    for (uint64_t range = 0; range < ranges; ++range)
+    {
+        threads.emplace_back([&, range]
+        {
+            const uint64_t begin = frame_count * range / ranges;
+            const uint64_t end = frame_count * (range + 1) / ranges;
+
+            RawVideoReader reader;
+            if (!reader.Open(input))
+            {
+                failed.store(true);
+                return;
+            }
+
+            const int width = static_cast<int>(reader.GetHeader().width);
+            const int height = static_cast<int>(reader.GetHeader().height);
+            SceneChangeDetector detector;
+            std::vector<uint8_t> frame;
+
+            for (uint64_t i = begin > 0 ? begin - 1 : 0; i < end && !failed.load(std::memory_order_relaxed); ++i)
+            {
+                if (!reader.ReadFrame(i, frame))
+                {
+                    failed.store(true);
+                    return;
+                }
+
+                SceneChangeResult scene = detector.Analyze(frame.data(), static_cast<ptrdiff_t>(width) * 4, width, height);
+                if (i >= begin && i > 0 && scene.change == SceneChange::Cut) range_cuts[range].push_back(i);
+            }
+        });
+    }
+
+    for (std::thread& thread : threads) thread.join();
+
+    if (failed.load())
+    {
+        error = "cannot read " + input.string();
+        return false;
+    }
+
+    for (const auto& found : range_cuts) cuts.insert(cuts.end(), found.begin(), found.end());
+    return true;
+}
+
+bool ChunkedTranscoder::EncodeChunks(const std::filesystem::path& input, const std::filesystem::path& work_dir, int workers,
+                                     TranscodeResult& result) const
+{
+    // Largest first, so no long chunk is left to run alone at the end
+    std::vector<size_t> order(result.chunks.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return result.chunks[a].frame_count > result.chunks[b].frame_count; });
+
+    std::atomic<size_t> next_chunk{ 0 };
+    std::atomic<bool> failed{ false };
+    std::mutex error_mutex;
+    std::vector<std::thread> threads;
+
+    auto encode_start = std::chrono::steady_clock::now();
+
+    const size_t thread_count = std::min(order.size(), static_cast<size_t>(workers));
+    for (size_t t = 0; t < thread_count; ++t)
+    {
+        threads.emplace_back([&]
+        {
+            auto fail = [&](const std::string& message)
+            {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!failed.exchange(true)) result.error = message;
+            };
+
+            RawVideoReader reader;
+            std::unique_ptr<ChunkEncoder> encoder = factory_();
+            if (!reader.Open(input) || !encoder)
+            {
+                fail("cannot start a worker");
+                return;
+            }
+
+            std::vector<uint8_t> frame;
+            for (size_t slot = next_chunk.fetch_add(1); slot < order.size() && !failed.load(); slot = next_chunk.fetch_add(1))
+            {
+                const size_t index = order[slot];
+                TranscodeChunk& chunk = result.chunks[index];
+                const std::filesystem::path path = GetChunkPath(work_dir, index);
+                auto chunk_start = std::chrono::steady_clock::now();
+
+                if (!encoder->Open(path))
+                {
+                    fail("cannot create " + path.string());
+                    return;
+                }
+
+                for (uint64_t i = chunk.first_frame; i < chunk.first_frame + chunk.frame_count; ++i)
+                {
+                    if (!reader.ReadFrame(i, frame) || !encoder->EncodeFrame(frame))
+                    {
+                        fail("chunk " + std::to_string(index) + " failed at frame " + std::to_string(i));
+                        encoder->Close();
+                        return;
+                    }
+                }
+
+                if (!encoder->Close())
+                {
+                    fail("cannot finalize " + path.string());
+                    return;
+                }
+
+                std::error_code error;
+                chunk.bytes = std::filesystem::file_size(path, error);
+                chunk.encode_ms = MillisecondsSince(chunk_start);
+            }
+        });
+    }
+
+    for (std::thread& thread : threads) thread.join();
+
+    result.encode_ms = MillisecondsSince(encode_start);
+    for (const TranscodeChunk& chunk : result.chunks) result.worker_busy_ms += chunk.encode_ms;
+
+    return !failed.load();
+}
+
+bool ChunkedTranscoder::Concatenate(const std::filesystem::path& input, const std::filesystem::path& work_dir,
+                                    const std::filesystem::path& output, TranscodeResult& result) const
+{
+    auto concat_start = std::chrono::steady_clock::now();
+
+    RawVideoReader timing;
+    if (!timing.Open(input))
+    {
+        result.error = "cannot read " + input.string();
+        return false;
+    }
+    const uint32_t fps = timing.GetHeader().fps > 0 ? timing.GetHeader().fps : 60;
+
+    Mp4Writer writer(kOutputTimescale);
+    if (!writer.Open(output))
+    {
+        result.error = "cannot create " + output.string();
+        return false;
+    }
+
+    std::vector<uint8_t> sample_entry;
+    std::vector<uint8_t> data;
+
+    for (size_t index = 0; index < result.chunks.size(); ++index)
+    {
+        const TranscodeChunk& chunk = result.chunks[index];
+        const std::filesystem::path path = GetChunkPath(work_dir, index);
+
+        Mp4Reader reader;
+        if (!reader.Open(path))
+        {
+            result.error = path.string() + ": " + reader.GetError();
+            return false;
+        }
+        if (reader.GetSampleCount() != chunk.frame_count)
+        {
+            result.error = path.string() + ": encoder dropped or added frames";
+            return false;
+        }
+        if (reader.HasReordering())
+        {
+            result.error = path.string() + ": encoder reorders frames, which concatenation does not support";
+            return false;
+        }
+
+        // Samples only concatenate when every chunk uses the same stream parameters
+        if (index == 0)
+        {
+            sample_entry = reader.GetSampleEntry();
+            writer.SetVideoFormat(reader.GetWidth(), reader.GetHeight(), sample_entry);
+        }
+        else if (reader.GetSampleEntry() != sample_entry)
+        {
+            result.error = path.string() + ": sample description differs from the first chunk";
+            return false;
+        }
+
+        for (uint64_t i = 0; i < chunk.frame_count; ++i)
+        {
+            const uint64_t frame = chunk.first_frame + i;
+            const uint64_t time = ToOutputTime(timing.GetTimestamp(frame), kOutputTimescale);
+            const uint64_t duration = frame + 1 < timing.GetFrameCount()
+                ? ToOutputTime(timing.GetTimestamp(frame + 1), kOutputTimescale) - time
+                : kOutputTimescale / fps;
+
+            if (!reader.ReadSample(i, data)
+                || !writer.WriteSample(data.data(), data.size(), static_cast<uint32_t>(duration), i == 0 || reader.GetSample(i).is_keyframe))
+            {
+                result.error = "cannot copy sample " + std::to_string(frame);
+                return false;
+            }
+        }
+    }
+
+    if (!writer.Close())
+    {
+        result.error = "cannot finalize " + output.string();
+        return false;
+    }
+
+    std::error_code error;
+    result.output_bytes = std::filesystem::file_size(output, error);
+    result.concat_ms = MillisecondsSince(concat_start);
+    return true;
+}
+
+std::filesystem::path ChunkedTranscoder::GetChunkPath(const std::filesystem::path& work_dir, size_t index)
+{
+    return work_dir / ("chunk_" + std::to_string(index) + ".mp4");
+}
@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <cstring>
+
+#include "LosslessDeltaCodec.h"
+#include "Mp4Box.h"
+
+namespace
+{
+    constexpr uint32_t kEscapeLength = 15;      // Quotients this large are sent as 8 raw bits
+
+    // MSB-first bit packer
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(std::vector<uint8_t>& output) : output_(output) {}
+
+        // count <= 32
+        void Put(uint32_t value, uint32_t count)
+        {
+            accumulator_ = (accumulator_ << count) | value;
+            bits_ += count;
+            while (bits_ >= 8)
+            {
+                bits_ -= 8;
+                output_.push_back(static_cast<uint8_t>(accumulator_ >> bits_));
+            }
+        }
+
+        void Flush()
+        {
+            if (bits_ > 0) output_.push_back(static_cast<uint8_t>(accumulator_ << (8 - bits_)));
+            bits_ = 0;
+        }
+
+    private:
+        std::vector<uint8_t>& output_;
+        uint64_t accumulator_ = 0;
+        uint32_t bits_ = 0;
+    };
+
+    class BitReader
+    {
+    public:
+        BitReader(const uint8_t* data, size_t size) : data_(data), end_(data + size) {}
+
+        // count <= 24; reads past the end return zeros and set the overrun flag
+        uint32_t Get(uint32_t count)
+        {
+            while (bits_ < count)
+            {
+                accumulator_ = (accumulator_ << 8) | (data_ < end_ ? *data_ : 0);
+                overrun_ |= data_ >= end_;
+                ++data_;
+                bits_ += 8;
+            }
+            bits_ -= count;
+            return static_cast<uint32_t>(accumulator_ >> bits_) & ((1u << count) - 1);
+        }
+
+        bool IsOverrun() const { return overrun_; }
+
+    private:
+        const uint8_t* data_;
+        const uint8_t* end_;
+        uint64_t accumulator_ = 0;
+        uint32_t bits_ = 0;
+        bool overrun_ = false;
+    };
+
+    uint8_t ZigZag(uint8_t residual)
+    {
+        const int8_t value = static_cast<int8_t>(residual);
+        return static_cast<uint8_t>((value << 1) ^ (value >> 7));
+    }
+
+    uint8_t UnZigZag(uint8_t value)
+    {
+        return static_cast<uint8_t>((value >> 1) ^ -(value & 1));
+    }
+
+    void EncodeBlock(BitWriter& writer, const uint8_t* values, size_t count)
+    {
+        uint32_t sum = 0;
+        for (size_t i = 0; i < count; ++i) sum += values[i];
+
+        if (sum == 0)
+        {
+            writer.Put(0, 1);
+            return;
+        }
+
+        // Rice parameter near log2 of the mean
+        uint32_t k = 0;
+        while (k < 7 && (static_cast<uint32_t>(count) << (k + 1)) <= sum) ++k;
+        writer.Put(1, 1);
+        writer.Put(k, 3);
+
+        const uint32_t low_mask = (1u << k) - 1;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const uint32_t quotient = values[i] >> k;
+            if (quotient < kEscapeLength)
+            {
+                // quotient ones, a zero, then the k low bits
+                writer.Put(((((1u << quotient) - 1) << 1) << k) | (values[i] & low_mask), quotient + 1 + k);
+            }
+            else
+            {
+                writer.Put((1u << kEscapeLength) - 1, kEscapeLength);
+                writer.Put(values[i], 8);
+            }
+        }
+    }
+
+    bool DecodeBlock(BitReader& reader, uint8_t* values, size_t count)
+    {
+        if (reader.Get(1) == 0)
+        {
+            std::memset(values, 0, count);
+            return true;
+        }
+
+        const uint32_t k = reader.Get(3);
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint32_t quotient = 0;
+            while (quotient < kEscapeLength && reader.Get(1)) ++quotient;
+
+            if (quotient == kEscapeLength) values[i] = static_cast<uint8_t>(reader.Get(8));
+            else values[i] = static_cast<uint8_t>((quotient << k) | (k ? reader.Get(k) : 0));
+        }
+        return !reader.IsOverrun();
+    }
+}
+
+LosslessDeltaCodec::LosslessDeltaCodec(int width, int height, RawPixelFormat pixel_format)
+{
+    const size_t pixels = static_cast<size_t>(width) * height;
+    frame_size_ = pixel_format == RawPixelFormat::NV12 ? pixels * 3 / 2 : pixels * 4;
+    pixel_bytes_ = pixel_format == RawPixelFormat::NV12 ? 1 : 4;
+    reference_.resize(frame_size_);
+}
+
+void LosslessDeltaCodec::Encode(const uint8_t* frame, bool is_keyframe, std::vector<uint8_t>& packet)
+{
+    is_keyframe = is_keyframe || !has_reference_;
+
+    packet.clear();
+    packet.reserve(frame_size_ / 2);
+    packet.push_back(is_keyframe ? 1 : 0);
+
+    BitWriter writer(packet);
+    uint8_t residuals[kBlockSize];
+
+    for (size_t block = 0; block < frame_size_; block += kBlockSize)
+    {
+        const size_t count = std::min(kBlockSize, frame_size_ - block);
+        const uint8_t* current = frame + block;
+
+        if (is_keyframe)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                const size_t position = block + i;
+                const uint8_t prediction = position >= pixel_bytes_ ? frame[position - pixel_bytes_] : 0;
+                residuals[i] = ZigZag(static_cast<uint8_t>(current[i] - prediction));
+            }
+        }
+        else
+        {
+            const uint8_t* previous = reference_.data() + block;
+            if (std::memcmp(current, previous, count) == 0)
+            {
+                writer.Put(0, 1);
+                continue;
+            }
+            for (size_t i = 0; i < count; ++i)
+            {
+                residuals[i] = ZigZag(static_cast<uint8_t>(current[i] - previous[i]));
+            }
+        }
+
+        EncodeBlock(writer, residuals, count);
+    }
+
+    writer.Flush();
+
+    std::memcpy(reference_.data(), frame, frame_size_);
+    has_reference_ = true;
+}
+
+bool LosslessDeltaCodec::Decode(const uint8_t* packet, size_t size, std::vector<uint8_t>& frame)
+{
+    if (size < 1) return false;
+
+    const bool is_keyframe = (packet[0] & 1) != 0;
+    if (!is_keyframe && !has_reference_) return false;
+
+    BitReader reader(packet + 1, size - 1);
+    uint8_t residuals[kBlockSize];
+
+    for (size_t block = 0; block < frame_size_; block += kBlockSize)
+    {
+        const size_t count = std::min(kBlockSize, frame_size_ - block);
+        if (!DecodeBlock(reader, residuals, count)) return false;
+
+        uint8_t* current = reference_.data() + block;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const size_t position = block + i;
+            uint8_t prediction = current[i];
+            if (is_keyframe) prediction = position >= pixel_bytes_ ? reference_[position - pixel_bytes_] : 0;
+            current[i] = static_cast<uint8_t>(prediction + UnZigZag(residuals[i]));
+        }
+    }
+
+    has_reference_ = true;
+    frame.assign(reference_.begin(), reference_.end());
+    return true;
+}
+
+std::vector<uint8_t> LosslessDeltaCodec::BuildSampleEntry(int width, int height, RawPixelFormat pixel_format)
+{
+    Mp4Box::Builder box;
+    size_t entry = box.Begin("zdlt");
+    box.Zeros(6);
+    box.U16(1);                 // data_reference_index
+    box.Zeros(16);
+    box.U16(static_cast<uint32_t>(width));
+    box.U16(static_cast<uint32_t>(height));
+    box.U32(0x00480000);        // 72 dpi
+    box.U32(0x00480000);
+    box.U32(0);
+    box.U16(1);                 // frame_count
+    box.Zeros(32);              // compressorname
+    box.U16(0x0018);            // depth
+    box.U16(0xFFFF);
+
+    size_t config = box.BeginFull("zdlC", 0, 0);
+    box.U32(static_cast<uint32_t>(pixel_format));
+    box.End(config);
+
+    box.End(entry);
+    return box.Data();
+}
+
+bool LosslessDeltaCodec::ParseSampleEntry(const std::vector<uint8_t>& sample_entry, int& width, int& height, RawPixelFormat& pixel_format)
+{
+    constexpr size_t kVisualEntrySize = 86;
+    if (sample_entry.size() < kVisualEntrySize || std::memcmp(sample_entry.data() + 4, "zdlt", 4) != 0) return false;
+
+    const uint8_t* config;
+    size_t config_size;
+    if (!Mp4Box::FindChild(sample_entry.data() + kVisualEntrySize, sample_entry.size() - kVisualEntrySize, "zdlC", config, config_size)
+        || config_size < 8)
+    {
+        return false;
+    }
+
+    width = Mp4Box::ReadBe16(sample_entry.data() + 32);
+    height = Mp4Box::ReadBe16(sample_entry.data() + 34);
+    pixel_format = static_cast<RawPixelFormat>(Mp4Box::ReadBe32(config + 4));
+    return pixel_format == RawPixelFormat::BGRA || pixel_format == RawPixelFormat::NV12;
+}
@@ -14,6 +14,9 @@
 #include <wx/icon.h>
 #include <wx/timer.h>
 #include <wx/dirdlg.h>
+#include <wx/statbmp.h>
+#include <wx/image.h>
+#include <wx/bitmap.h>
 
 #include <shellscalingapi.h>
 
@@ -270,13 +273,16 @@ namespace SimpleScreenRecorder
             elapsed_seconds = 0;
             timer_label->SetLabel("Duration : 00:00:00");
             timer.Start(1000);
+            preview_timer.Start(kPreviewIntervalMs);
         }
 
 		void StopTimer()
 		{
 			timer.Stop();
+			preview_timer.Stop();
 			elapsed_seconds = 0;
             timer_label->SetLabel("Duration : 00:00:00");
+            preview_bitmap->SetBitmap(wxNullBitmap);
 		}
 
         void OnTimer(wxTimerEvent&) 
@@ -291,6 +297,32 @@ namespace SimpleScreenRecorder
             timer_label->SetLabel(timeStr);
         }
 
+        void OnPreviewTimer(wxTimerEvent&)
+        {
+            const PreviewFrame* preview = screen_recorder.AcquirePreview();
+            if (!preview || preview->width == 0 || preview->height == 0)
+            {
+                return;
+            }
+
+            wxImage image(preview->width, preview->height, false);
+            unsigned char* rgb = image.GetData();
+            const uint8_t* bgra = preview->pixels.data();
+            const size_t pixel_count = static_cast<size_t>(preview->width) * preview->height;
+
+            for (size_t i = 0; i < pixel_count; ++i)
+            {
+                rgb[i * 3 + 0] = bgra[i * 4 + 2];
+                rgb[i * 3 + 1] = bgra[i * 4 + 1];
+                rgb[i * 3 + 2] = bgra[i * 4 + 0];
+            }
+
+            double scale = std::min(static_cast<double>(kPreviewWidth) / preview->width, static_cast<double>(kPreviewHeight) / preview->height);
+            image.Rescale(std::max(1, static_cast<int>(preview->width * scale)), std::max(1, static_cast<int>(preview->height * scale)), wxIMAGE_QUALITY_BILINEAR);
+
+            preview_bitmap->SetBitmap(wxBitmap(image));
+        }
+
         wxString SelectFolder() 
         {
             wxDirDialog dirDialog(this, "Select a folder", "", wxDD_DEFAULT_STYLE | wxDD_DIR_MUST_EXIST);
@@ -349,6 +381,9 @@ namespace SimpleScreenRecorder
 			timer_label->SetForegroundColour(wxColour(0, 122, 204));
 
             timer.Bind(wxEVT_TIMER, &Frame::OnTimer, this);
+
+            preview_bitmap = std::make_shared<wxStaticBitmap>(panel.get(), wxID_ANY, wxNullBitmap, wxPoint(360, 75), wxSize(kPreviewWidth, kPreviewHeight));
+            preview_timer.Bind(wxEVT_TIMER, &Frame::OnPreviewTimer, this);
         }
 
         void LoadData() 
@@ -414,11 +449,19 @@ namespace SimpleScreenRecorder
                 start_stop_button->SetLabel("Start Recording");
                 start_stop_button->SetBackgroundColour(wxColour(0, 122, 204)); 
 
-				screen_recorder.StopCapture();
+				const bool finalized = screen_recorder.StopCapture();
                 StopTimer();
 
-				wxString message = "Recording stopped. File stored in \n" + screen_recorder.GetOutputPath();
-				wxMessageBox(message, "Info", wxOK | wxICON_INFORMATION, this);
+				if (finalized)
+				{
+					wxString message = "Recording stopped. File stored in \n" + screen_recorder.GetOutputPath();
+					wxMessageBox(message, "Info", wxOK | wxICON_INFORMATION, this);
+				}
+				else
+				{
+					wxString message = "Recording stopped, but the file in \n" + screen_recorder.GetOutputPath() + "\ncould not be finalized.";
+					wxMessageBox(message, "Error", wxOK | wxICON_ERROR, this);
+				}
 				capture_item_list->Enable();
 				monitor_or_app_cb->Enable();
 
@@ -526,6 +569,10 @@ namespace SimpleScreenRecorder
         }
 
         private:
+
+        static constexpr int kPreviewWidth = 224;
+        static constexpr int kPreviewHeight = 110;
+        static constexpr int kPreviewIntervalMs = 200;
 		
         std::shared_ptr<wxPanel> panel = std::make_shared<wxPanel>(this, wxID_ANY);
         std::shared_ptr<wxComboBox> monitor_or_app_cb = std::make_shared<wxComboBox>(panel.get(), wxID_ANY, wxEmptyString, wxPoint(10, 40), wxSize(300, 170));
@@ -545,6 +592,8 @@ namespace SimpleScreenRecorder
         wxTimer timer;
         int elapsed_seconds;
         std::shared_ptr<wxStaticText> timer_label = nullptr;
+        wxTimer preview_timer;
+        std::shared_ptr<wxStaticBitmap> preview_bitmap = nullptr;
         ScreenRecorder screen_recorder;
     };
 
@@ -1,6 +1,9 @@
 #pragma once
 #include <string>
 #include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
 
 namespace RecorderUtils
 {
@@ -11,7 +14,11 @@ namespace RecorderUtils
 		std::time_t current_time = std::chrono::system_clock::to_time_t(now);
 		std::tm local_time;
 
+#ifdef _WIN32
 		localtime_s(&local_time, &current_time);
+#else
+		localtime_r(&current_time, &local_time);
+#endif
 
 		std::wostringstream time_stream;
 		time_stream << std::put_time(&local_time, L"%d-%m-%Y_%H-%M-%S");
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "FilterChain.h"
+#include "FramePool.h"
+#include "FrameSink.h"
+
+// Runs every frame through a FilterChain on its way to the sink: cropped, resized and overlaid as
+// BGRA for an encoder, or all the way to NV12 for a sink that takes it (a raw NV12 recording).
+// Output frames come from a pool, so an encoder can keep them as samples.
+class FilterChainSink : public FrameSink
+{
+public:
+    FilterChainSink(std::shared_ptr<FrameSink> sink, const FilterChainConfig& config, FrameFormat output_format = FrameFormat::Bgra);
+    ~FilterChainSink() override;
+
+    bool ProcessFrame(const std::vector<uint8_t>& image_buffer, int width, int height) override;
+    // BGRA in. The sink's dirty region is the input's mapped through crop and resize, plus where
+    // the overlay is and was.
+    bool ProcessFrame(const FrameDescriptor& frame, const DirtyRegion& dirty) override;
+    bool Close() override;
+
+    // From any thread; applied from the next frame
+    void SetOverlay(const uint8_t* bgra, ptrdiff_t pitch, int width, int height);
+    void SetOverlayPosition(int x, int y);
+
+    FilterChainStats GetStats() const;
+    // Output frames and the chain's scratch are held against it. Before the first frame.
+    void SetMemoryBudget(MemoryBudget* budget);
+
+private:
+    DirtyRegion MapDirty(const DirtyRegion& dirty, int width, int height) const;
+
+    std::shared_ptr<FrameSink> sink_;
+    FilterChain chain_;
+    FrameFormat output_format_;
+    FramePool pool_;
+    MemoryBudget* budget_ = nullptr;
+    MemoryBudget::Reservation scratch_reservation_;
+    int capture_width_ = 0;
+    int capture_height_ = 0;
+    DirtyRect last_overlay_;
+
+    mutable std::mutex mutex_;                  // Overlay updates and stats, against the frame thread
+    std::vector<uint8_t> pending_overlay_;
+    int pending_overlay_width_ = 0;
+    int pending_overlay_height_ = 0;
+    int pending_overlay_x_ = 0;
+    int pending_overlay_y_ = 0;
+    bool overlay_changed_ = false;
+    FilterChainStats stats_;
+};
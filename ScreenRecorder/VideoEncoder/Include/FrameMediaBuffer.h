@@ -0,0 +1,31 @@
+#pragma once
+
+#include <mfapi.h>
+#include <mfidl.h>
+#include <wrl/client.h>
+#include <wrl/implements.h>
+#include <memory>
+
+// IMFMediaBuffer over memory the encoder doesn't allocate, usually a pooled frame. The buffer
+// holds owner until Media Foundation releases it, i.e. once the encoder is done with the sample,
+// and that release is what returns the frame to its pool. Encoders only read input samples, so
+// the memory is handed out as is.
+class FrameMediaBuffer : public Microsoft::WRL::RuntimeClass<Microsoft::WRL::RuntimeClassFlags<Microsoft::WRL::ClassicCom>, IMFMediaBuffer>
+{
+public:
+    static HRESULT Create(std::shared_ptr<const void> owner, const uint8_t* data, DWORD length, IMFMediaBuffer** buffer);
+
+    HRESULT RuntimeClassInitialize(std::shared_ptr<const void> owner, const uint8_t* data, DWORD length);
+
+    IFACEMETHODIMP Lock(BYTE** buffer, DWORD* max_length, DWORD* current_length) override;
+    IFACEMETHODIMP Unlock() override;
+    IFACEMETHODIMP GetCurrentLength(DWORD* current_length) override;
+    IFACEMETHODIMP SetCurrentLength(DWORD current_length) override;
+    IFACEMETHODIMP GetMaxLength(DWORD* max_length) override;
+
+private:
+    std::shared_ptr<const void> owner_;
+    BYTE* data_ = nullptr;
+    DWORD max_length_ = 0;
+    DWORD current_length_ = 0;
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "DirtyRegion.h"
+#include "FrameDescriptor.h"
+
+// Consumer of captured BGRA frames. ScreenRecorder feeds every delivered frame
+// to its sink; Close flushes and finishes the output file.
+class FrameSink
+{
+public:
+    virtual ~FrameSink() = default;
+
+    // A tightly packed frame in the sink's input format, all of it new
+    virtual bool ProcessFrame(const std::vector<uint8_t>& image_buffer, int width, int height) = 0;
+    // Rows are read at the frame's pitch. Only dirty changed since the previous frame this sink
+    // was given; sinks that keep converted output between frames update just that part.
+    virtual bool ProcessFrame(const FrameDescriptor& frame, const DirtyRegion& dirty) = 0;
+    virtual bool Close() = 0;
+};
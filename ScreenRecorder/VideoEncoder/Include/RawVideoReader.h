@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "RawVideoWriter.h"
+
+// Reads .zraw files produced by RawVideoWriter, frame by frame in any order.
+class RawVideoReader
+{
+public:
+    bool Open(const std::filesystem::path& path);
+
+    const RawFileHeader& GetHeader() const { return header_; }
+    uint64_t GetFrameCount() const { return header_.frame_count; }
+    RawPixelFormat GetPixelFormat() const { return static_cast<RawPixelFormat>(header_.pixel_format); }
+
+    // Payload of one frame: tightly packed BGRA, or the NV12 Y plane followed by UV
+    bool ReadFrame(uint64_t index, std::vector<uint8_t>& pixels);
+
+    // 100 ns units since the first frame
+    uint64_t GetTimestamp(uint64_t index) const { return index < timestamps_.size() ? timestamps_[index] : 0; }
+
+private:
+    std::ifstream file_;
+    RawFileHeader header_{};
+    std::vector<uint64_t> timestamps_;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "AlignedBuffer.h"
+#include "FrameSink.h"
+#include "MemoryBudget.h"
+
+enum class RawPixelFormat : uint32_t
+{
+    BGRA = 0,
+    NV12 = 1
+};
+
+// On-disk layout of a .zraw file. Frames live in fixed slots aligned to kRawSlotAlignment
+// so readers can mmap or read them unbuffered; a timestamp index follows the last frame.
+//
+//   [RawFileHeader, padded to kRawSlotAlignment][frame 0 slot][frame 1 slot]...[uint64 timestamps x frame_count]
+#pragma pack(push, 1)
+struct RawFileHeader
+{
+    char magic[8];                  // "ZARAWV01"
+    uint32_t version;
+    uint32_t pixel_format;          // RawPixelFormat
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps;                   // Nominal rate; real timing comes from the index
+    uint32_t reserved;
+    uint64_t frame_size;            // Payload bytes per frame
+    uint64_t frame_stride;          // Slot size, frame_size rounded up to kRawSlotAlignment
+    uint64_t frame_count;
+    uint64_t index_offset;          // Byte offset of the timestamp index (100 ns units since first frame)
+};
+#pragma pack(pop)
+
+constexpr uint64_t kRawSlotAlignment = 4096;
+
+#ifndef _WIN32
+struct iovec;
+#endif
+
+// Writes frames uncompressed, straight from the caller's buffers. BGRA frames are
+// written with no intermediate copy, padded rows included (gathered by pwritev, packed
+// into a reused buffer on Windows); NV12 is converted once into a reused buffer.
+// Chunks that are page-aligned in address and size go through an unbuffered handle
+// (O_DIRECT / FILE_FLAG_NO_BUFFERING), skipping the page-cache copy entirely.
+class RawVideoWriter : public FrameSink
+{
+public:
+    RawVideoWriter(int width, int height, int fps, RawPixelFormat pixel_format, const std::filesystem::path& output_file);
+    ~RawVideoWriter() override;
+
+    bool Initialize();
+    bool ProcessFrame(const std::vector<uint8_t>& image_buffer, int width, int height) override;
+    // BGRA rows with padding are written as one chunk each. NV12 converts only the dirty part;
+    // the converted frame is kept between calls; NV12 frames are written as they come. The index
+    // records the frame's timestamp.
+    bool ProcessFrame(const FrameDescriptor& frame, const DirtyRegion& dirty) override;
+    bool Close() override;
+
+    // Writes one frame made of several planes/rows laid out back to back in the slot
+    bool WriteFrame(const uint8_t* const* chunks, const size_t* chunk_sizes, int chunk_count,
+                    std::chrono::steady_clock::time_point timestamp = std::chrono::steady_clock::now());
+
+    uint64_t GetFrameCount() const { return frame_count_; }
+    // The conversion buffer is held against it. Before Initialize.
+    void SetMemoryBudget(MemoryBudget* budget) { budget_ = budget; }
+
+private:
+    bool OpenFile(const std::filesystem::path& path);
+    bool WriteAt(uint64_t offset, const uint8_t* const* chunks, const size_t* chunk_sizes, int chunk_count);
+    bool IsDirectWritable(uint64_t offset, const uint8_t* const* chunks, const size_t* chunk_sizes, int chunk_count) const;
+    void CloseFile();
+    void ResizeConversionBuffer(size_t bytes);
+
+    int width_;
+    int height_;
+    int fps_;
+    RawPixelFormat pixel_format_;
+    std::filesystem::path output_file_;
+
+    uint64_t frame_size_ = 0;
+    uint64_t frame_stride_ = 0;
+    uint64_t frame_count_ = 0;
+    std::vector<uint64_t> timestamps_;
+    AlignedBuffer conversion_buffer_;
+    MemoryBudget* budget_ = nullptr;
+    MemoryBudget::Reservation conversion_reservation_;
+    std::vector<const uint8_t*> row_chunks_;
+    std::vector<size_t> row_chunk_sizes_;
+    bool conversion_valid_ = false;            // conversion_buffer_ holds the previous frame
+    std::chrono::steady_clock::time_point first_frame_time_;
+
+#ifdef _WIN32
+    void* file_handle_ = nullptr;
+    void* direct_file_handle_ = nullptr;       // Unbuffered handle; null when the volume refuses it
+#else
+    int file_descriptor_ = -1;
+    int direct_file_descriptor_ = -1;          // O_DIRECT descriptor; -1 on filesystems without it (tmpfs)
+    std::vector<iovec> write_vectors_;         // Reused by every pwritev
+#endif
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "AlignedBuffer.h"
+#include "FramePool.h"
+#include "FrameSink.h"
+#include "ThreadRoles.h"
+
+struct RenditionStats
+{
+    int width = 0;                  // Configured; 0 follows the capture
+    int height = 0;
+    uint64_t frames = 0;
+    uint64_t failed = 0;
+    double scale_ms = 0.0;          // Totals over the session
+    double sink_ms = 0.0;
+    double waited_ms = 0.0;         // Fan-out held up by this rendition's full queue
+};
+
+// One capture fed to several sinks at different sizes, e.g. a full-resolution archive and a
+// 540p review proxy, instead of one recorder per output. The frame arrives once, already read
+// back and converted; every rendition has a worker of its own that scales from the shared frame,
+// only where dirty, into a frame it keeps, and feeds its sink from there. A rendition at the
+// capture size gets the frame itself, so an encoder can wrap it without a copy. Queues are
+// bounded and a full one holds up the fan-out rather than dropping, so every sink sees every frame.
+class SimulcastSink : public FrameSink
+{
+public:
+    // thread_roles, if given, places the workers as Encode threads
+    explicit SimulcastSink(const ThreadRoles* thread_roles = nullptr, size_t queue_depth = 4);
+    ~SimulcastSink() override;
+
+    // Before the first frame. 0 x 0 follows the capture size, which changes with it.
+    // request_keyframe is how RequestKeyframe reaches this rendition's encoder.
+    void AddRendition(std::shared_ptr<FrameSink> sink, int width = 0, int height = 0,
+                      std::function<void()> request_keyframe = nullptr);
+    // The next frame is a keyframe in every rendition, whatever each worker is busy with now.
+    // From the thread that calls ProcessFrame.
+    void RequestKeyframe() { keyframe_requested_ = true; }
+    // Shared copies and scaled frames are held against it. Before the first frame.
+    void SetMemoryBudget(MemoryBudget* budget);
+
+    bool ProcessFrame(const std::vector<uint8_t>& image_buffer, int width, int height) override;
+    // BGRA. A frame without an owner is copied once for all renditions to share.
+    bool ProcessFrame(const FrameDescriptor& frame, const DirtyRegion& dirty) override;
+    // Waits for every rendition to finish its queue, then closes the sinks
+    bool Close() override;
+
+    size_t GetRenditionCount() const { return renditions_.size(); }
+    // Frames still held after ProcessFrame returns: a full queue and the one being worked on.
+    // Renditions share them, so the slowest one sets the count.
+    size_t GetHeldFrames() const { return queue_depth_ + 1; }
+    std::vector<RenditionStats> GetStats() const;
+
+private:
+    struct Job
+    {
+        FrameDescriptor frame;      // Owned
+        DirtyRegion dirty;
+        bool keyframe = false;
+    };
+
+    struct Rendition
+    {
+        std::shared_ptr<FrameSink> sink;
+        std::function<void()> request_keyframe;
+        int width = 0;
+        int height = 0;
+
+        std::mutex mutex;
+        std::condition_variable not_empty;
+        std::condition_variable not_full;
+        std::vector<Job> jobs;      // Ring of queue_depth slots
+        size_t head = 0;
+        size_t depth = 0;
+        bool is_closed = false;
+        std::thread worker;
+
+        // Worker only: the scaled frame, updated where dirty, and the source size it came from
+        AlignedBuffer scaled;
+        MemoryBudget::Reservation scaled_reservation;
+        int source_width = 0;
+        int source_height = 0;
+
+        std::atomic<uint64_t> frames{ 0 };
+        std::atomic<uint64_t> failed{ 0 };
+        std::atomic<uint64_t> scale_ns{ 0 };
+        std::atomic<uint64_t> sink_ns{ 0 };
+        std::atomic<uint64_t> waited_ns{ 0 };
+    };
+
+    void RunWorker(Rendition& rendition);
+    void Stop();
+
+    const ThreadRoles* thread_roles_;
+    size_t queue_depth_;
+    std::vector<std::unique_ptr<Rendition>> renditions_;
+    FramePool pool_;                // Shared copies of frames that arrive without an owner
+    MemoryBudget* budget_ = nullptr;
+    bool keyframe_requested_ = false;
+    bool is_closed_ = false;
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <mfapi.h>
+#include <mfidl.h>
+#include <mftransform.h>
+#include <wrl/client.h>
+#include <icodecapi.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "FramePool.h"
+#include "FrameSink.h"
+#include "VideoEncoder.h"
+
+// One access unit as Annex B, valid only during the callback
+struct EncodedPacket
+{
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    std::chrono::steady_clock::time_point capture_time;
+    bool is_keyframe = false;
+};
+
+using EncodedPacketCallback = std::function<void(const EncodedPacket&)>;
+
+// H.264/H.265 for live output. Drives the encoder MFT directly rather than through a sink writer,
+// so every access unit is handed to the callback the moment the encoder produces it. Tuned for
+// latency: low-latency mode, no B-frames, a short GOP, CBR and several slices per picture, so a
+// lost packet damages a band of the picture rather than all of it.
+class StreamEncoder : public FrameSink
+{
+public:
+    StreamEncoder(int width, int height, int fps, int bitrate, EncodedPacketCallback callback);
+    ~StreamEncoder() override;
+
+    // H264 and H265 only. keyframe_interval is in frames; a receiver joining mid-stream waits for
+    // the next one.
+    bool Initialize(VideoCodec codec_type, uint32_t keyframe_interval, int slices = 4);
+    bool ProcessFrame(const std::vector<uint8_t>& image_buffer, int width, int height) override;
+    // BGRA; converted to NV12 only where dirty. Odd sizes lose their last row or column.
+    bool ProcessFrame(const FrameDescriptor& frame, const DirtyRegion& dirty) override;
+    bool Close() override;
+
+    void RequestKeyframe() { keyframe_requested_.store(true, std::memory_order_relaxed); }
+    uint64_t GetForcedKeyframeCount() const { return forced_keyframes_.load(std::memory_order_relaxed); }
+
+    // The kept NV12 frame and the samples the encoder holds are charged to it. Before the first frame.
+    void SetMemoryBudget(MemoryBudget* budget) { budget_ = budget; sample_pool_.SetMemoryBudget(budget); }
+
+private:
+    HRESULT CreateEncoder();
+    HRESULT ConfigureEncoder();
+    void ConfigureCodecApi();
+    HRESULT EncodeFrame(const FrameDescriptor& frame, const DirtyRegion& dirty);
+    HRESULT DrainOutput();
+    void DeliverSample(IMFSample* sample);
+    void Shutdown();
+
+    int width_;
+    int height_;
+    int fps_;
+    int bitrate_;
+    uint32_t keyframe_interval_ = 0;
+    int slices_ = 4;
+    uint64_t frame_count_ = 0;
+    EncodedPacketCallback callback_;
+
+    GUID codec_guid_ = MFVideoFormat_H264;
+    Microsoft::WRL::ComPtr<IMFTransform> encoder_;
+    Microsoft::WRL::ComPtr<ICodecAPI> codec_api_;
+    DWORD input_id_ = 0;
+    DWORD output_id_ = 0;
+    MFT_OUTPUT_STREAM_INFO output_info_ = {};
+    bool is_streaming_ = false;
+
+    std::vector<uint8_t> nv12_frame_;           // Last converted frame, updated where dirty
+    int nv12_width_ = 0;
+    int nv12_height_ = 0;
+    FramePool sample_pool_;
+    MemoryBudget* budget_ = nullptr;
+    MemoryBudget::Reservation nv12_reservation_;
+    std::vector<uint8_t> sequence_header_;      // For encoders that don't repeat parameter sets in-band
+    std::vector<uint8_t> packet_;
+    std::map<LONGLONG, std::chrono::steady_clock::time_point> capture_times_;   // By sample time
+
+    std::atomic<bool> keyframe_requested_{ false };
+    std::atomic<uint64_t> forced_keyframes_{ 0 };
+};
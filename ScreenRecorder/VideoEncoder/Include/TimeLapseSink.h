@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "AlignedBuffer.h"
+#include "FramePool.h"
+#include "FrameSink.h"
+
+enum class TimeLapseBlend
+{
+    Average,        // Mean of the interval, each frame weighted by how long it was on screen
+    Max,            // Brightest value each pixel reached, so brief changes (a cursor, a toast) stay visible
+    Sample          // The last frame of the interval, as plain frame dropping would give
+};
+
+struct TimeLapseStats
+{
+    uint64_t frames_in = 0;
+    uint64_t frames_out = 0;
+    uint64_t frames_repeated = 0;   // Intervals with no new capture, sent on as the last frame
+    double blend_ms = 0.0;          // Totals: folding captured frames in, and resolving the output
+    double resolve_ms = 0.0;
+    size_t buffer_bytes = 0;        // Held between frames, output frames excluded
+};
+
+// Turns a capture into a time-lapse: every interval of capture time becomes one frame for the
+// sink. The blend runs at full capture rate but only where frames changed: each 64x64 tile keeps
+// the tick at which its current content appeared, and content is added to a 16-bit accumulator,
+// weighted by the ticks it stayed on screen, only when the tile changes again or the interval
+// ends. A static screen costs nothing per frame. An interval is 256 ticks, so the weights of a
+// full interval total 256 and the mean is a rounding shift.
+class TimeLapseSink : public FrameSink
+{
+public:
+    static constexpr int kTicks = 256;
+    static constexpr int kTileSize = 64;
+
+    TimeLapseSink(std::shared_ptr<FrameSink> sink, double interval_seconds, TimeLapseBlend blend = TimeLapseBlend::Average);
+
+    bool ProcessFrame(const std::vector<uint8_t>& image_buffer, int width, int height) override;
+    // BGRA. The frame's timestamp places it in its interval, and it counts until the next frame.
+    bool ProcessFrame(const FrameDescriptor& frame, const DirtyRegion& dirty) override;
+    // Sends the interval in progress as if the last frame stayed up to its end, then closes the sink
+    bool Close() override;
+
+    TimeLapseStats GetStats() const;
+    // The accumulator and output frames are held against it. Before the first frame.
+    void SetMemoryBudget(MemoryBudget* budget);
+
+private:
+    void Start(const FrameDescriptor& frame);
+    int GetTick(std::chrono::steady_clock::time_point time) const;
+    // Adds the tile's content for the ticks since it appeared up to tick, and marks it current from there
+    void FoldTile(int tile_x, int tile_y, int tick);
+    bool EmitInterval();
+
+    std::shared_ptr<FrameSink> sink_;
+    std::chrono::nanoseconds interval_;
+    TimeLapseBlend blend_;
+
+    int width_ = 0;
+    int height_ = 0;
+    int tiles_x_ = 0;
+    int tiles_y_ = 0;
+    AlignedBuffer screen_;                      // The latest frame, patched where dirty
+    std::vector<uint16_t> sum_;                 // Average: 16-bit sums, one per byte of screen_
+    AlignedBuffer peak_;                        // Max
+    std::vector<uint16_t> since_;               // Per tile: tick from which screen_ shows it unfolded
+    std::vector<uint8_t> tile_flags_;
+    std::chrono::steady_clock::time_point interval_start_;
+    uint64_t frames_in_interval_ = 0;
+    bool was_repeat_ = false;                   // The last frame sent was a repeat of screen_
+    PooledFrame repeat_;                        // Shared by a run of repeats
+    FramePool pool_;                            // Output frames, which an encoder may keep as samples
+    MemoryBudget* budget_ = nullptr;
+    MemoryBudget::Reservation buffer_reservation_;
+    bool is_closed_ = false;
+
+    std::atomic<uint64_t> frames_in_{ 0 };
+    std::atomic<uint64_t> frames_out_{ 0 };
+    std::atomic<uint64_t> frames_repeated_{ 0 };
+    std::atomic<uint64_t> blend_ns_{ 0 };
+    std::atomic<uint64_t> resolve_ns_{ 0 };
+    std::atomic<size_t> buffer_bytes_{ 0 };
+};
@@ -0,0 +1,10 @@
+#pragma once
+
+enum class VideoCodec
+{
+	H264,
+	H265,
+	VP8,
+	VP9,
+	AV1
+};
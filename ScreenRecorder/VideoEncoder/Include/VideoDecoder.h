@@ -0,0 +1,31 @@
+#pragma once
+
+#include <mfapi.h>
+#include <mfidl.h>
+#include <mfreadwrite.h>
+#include <wrl/client.h>
+#include <string>
+#include <vector>
+
+// Decodes a recorded file back to BGRA frames through the Media Foundation source reader.
+// Used by the quality harness to compare encoder output against its input.
+class VideoDecoder
+{
+public:
+    VideoDecoder();
+    ~VideoDecoder();
+
+    bool Open(const std::wstring& file_path);
+
+    // Next frame as tightly packed BGRA; false at the end of the stream or on error
+    bool ReadFrame(std::vector<uint8_t>& image_buffer, int& width, int& height);
+
+private:
+    HRESULT UpdateFrameSize();
+
+    Microsoft::WRL::ComPtr<IMFSourceReader> source_reader_;
+    int width_ = 0;
+    int height_ = 0;
+    int coded_height_ = 0;
+    LONG stride_ = 0;
+};
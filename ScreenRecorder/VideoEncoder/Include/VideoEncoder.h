@@ -4,30 +4,47 @@
 #include <mfidl.h>
 #include <mfreadwrite.h>
 #include <wrl/client.h>
+#include <icodecapi.h>
+#include <atomic>
 #include <string>
 #include <vector>
 
+#include "DirtyRegion.h"
+#include "FramePool.h"
+#include "FrameSink.h"
+#include "VideoCodec.h"
 
-enum class VideoCodec
-{
-	H264,
-	H265,
-	VP8,
-	VP9,
-	AV1
-};
-
-class VideoEncoder 
+class VideoEncoder : public FrameSink
 {
 public:
     VideoEncoder(int width, int height, int fps, int bitrate,
         const std::wstring& output_path, const std::wstring& output_filename);
-    ~VideoEncoder();
+    ~VideoEncoder() override;
 
     bool Initialize(VideoCodec codec_type);
-    bool ProcessFrame(const std::vector<uint8_t>& image_buffer, int width, int height);
+    bool ProcessFrame(const std::vector<uint8_t>& image_buffer, int width, int height) override;
+    // HDR10 converts only what changed into a P010 sample kept between calls. An owned, packed
+    // BGRA frame becomes the sample without a copy; the encoder holds it until it is done.
+    bool ProcessFrame(const FrameDescriptor& frame, const DirtyRegion& dirty) override;
+    bool Close() override { return SUCCEEDED(Finalize()); }
     HRESULT Finalize();
 
+    // GOP length in frames for the next Initialize; 0 leaves the encoder default
+    void SetKeyframeInterval(uint32_t frames) { keyframe_interval_ = frames; }
+
+    // HDR10 from the next Initialize: ProcessFrame takes scRGB FP16 frames (8 bytes per pixel, as
+    // captured by CaptureEngine::SetHdrCapture) and encodes BT.2020 PQ 10-bit. H265 and AV1 only.
+    // An odd width or height loses its last column or row.
+    void SetHdr10(bool enabled) { hdr10_ = enabled; }
+    bool IsHdr10() const { return hdr10_; }
+
+    // The next frame handed to ProcessFrame is encoded as an IDR. Safe from any thread.
+    void RequestKeyframe() { keyframe_requested_.store(true, std::memory_order_relaxed); }
+    uint64_t GetForcedKeyframeCount() const { return forced_keyframes_.load(std::memory_order_relaxed); }
+
+    // Samples the encoder holds are charged to it; owned frames already are by their owner
+    void SetMemoryBudget(MemoryBudget* budget) { sample_pool_.SetMemoryBudget(budget); }
+
 private:
 
     HRESULT ConfigureSinkWriter();
@@ -36,7 +53,7 @@ private:
 	HRESULT ConfigureInputType();
 	HRESULT ConfigureOutputType();
 
-    HRESULT EncodeFrame(const std::vector<uint8_t>& image_buffer, int width, int height);
+    HRESULT EncodeFrame(const FrameDescriptor& frame, const DirtyRegion& dirty);
 
     int width_;
     int height_;
@@ -48,6 +65,28 @@ private:
     std::wstring output_filename_;
     Microsoft::WRL::ComPtr<IMFSinkWriter> sink_writer_;
     DWORD stream_index_ = 0;
+    Microsoft::WRL::ComPtr<ICodecAPI> codec_api_;
+
+    uint32_t keyframe_interval_ = 0;
+    bool hdr10_ = false;
+    // HDR10 samples, kept after the encoder releases them and reused once it has. Each is brought up
+    // to date by converting what changed since it was last written, straight from the capture.
+    struct P010Sample
+    {
+        PooledFrame pixels;
+        DirtyRegion stale;                      // Changed since the frame it holds
+    };
+    static constexpr size_t kMaxP010Samples = 4;
+
+    // A kept sample the encoder no longer holds, or a new one if it holds them all
+    P010Sample& AcquireP010Sample(size_t bytes, int width, int height);
+
+    std::vector<P010Sample> p010_samples_;
+    FramePool sample_pool_;                     // Sample memory for frames that can't be wrapped
+    int p010_width_ = 0;
+    int p010_height_ = 0;
+    std::atomic<bool> keyframe_requested_{ false };
+    std::atomic<uint64_t> forced_keyframes_{ 0 };
 
 	GUID codec_guid_ = MFVideoFormat_H264;
 };
@@ -0,0 +1,137 @@
+#include <algorithm>
+
+#include "FilterChainSink.h"
+#include "FrameTracer.h"
+#include "HotPathCounters.h"
+
+FilterChainSink::FilterChainSink(std::shared_ptr<FrameSink> sink, const FilterChainConfig& config, FrameFormat output_format)
+    : sink_(std::move(sink)),
+      chain_(config),
+      output_format_(output_format),
+      pool_(4)
+{
+}
+
+FilterChainSink::~FilterChainSink() = default;
+
+bool FilterChainSink::ProcessFrame(const std::vector<uint8_t>& image_buffer, int width, int height)
+{
+    return ProcessFrame(FrameDescriptor::Packed(image_buffer.data(), FrameFormat::Bgra, width, height), DirtyRegion::Full(width, height));
+}
+
+bool FilterChainSink::ProcessFrame(const FrameDescriptor& frame, const DirtyRegion& dirty)
+{
+    if (!frame.IsValid() || frame.format != FrameFormat::Bgra) return false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (overlay_changed_)
+        {
+            chain_.SetOverlay(pending_overlay_.data(), static_cast<ptrdiff_t>(pending_overlay_width_) * 4, pending_overlay_width_,
+                              pending_overlay_height_);
+            chain_.SetOverlayPosition(pending_overlay_x_, pending_overlay_y_);
+            overlay_changed_ = false;
+        }
+    }
+
+    const int width = chain_.GetOutputWidth(frame.width, frame.height);
+    const int height = chain_.GetOutputHeight(frame.width, frame.height);
+    const size_t pixels = static_cast<size_t>(width) * height;
+
+    DirtyRegion output_dirty = DirtyRegion::Full(width, height);
+    if (frame.width == capture_width_ && frame.height == capture_height_) output_dirty = MapDirty(dirty, frame.width, frame.height);
+    capture_width_ = frame.width;
+    capture_height_ = frame.height;
+
+    const size_t output_bytes = output_format_ == FrameFormat::Nv12 ? pixels * 3 / 2 : pixels * 4;
+    PooledFrame output = pool_.Acquire(output_bytes);
+    {
+        TraceSpan convert_span(TraceStage::Convert);
+        const bool processed = output_format_ == FrameFormat::Nv12
+            ? chain_.ProcessToNv12(frame, output->data(), width, output->data() + pixels, width)
+            : chain_.ProcessToBgra(frame, output->data(), static_cast<ptrdiff_t>(width) * 4);
+        if (!processed) return false;
+        // The whole output is written each frame; the capture is read through L2-sized bands
+        HotPathCounters::CountCopy(TraceStage::Convert, output_bytes);
+    }
+
+    const DirtyRect overlay = chain_.GetOverlayRect();
+    output_dirty.Add(overlay);
+    output_dirty.Add(last_overlay_);
+    last_overlay_ = overlay;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_ = chain_.GetStats();
+    }
+    if (budget_ && scratch_reservation_.GetBytes() != stats_.scratch_bytes)
+    {
+        scratch_reservation_.Reset();
+        scratch_reservation_ = budget_->Charge(stats_.scratch_bytes);
+    }
+
+    FrameDescriptor descriptor = FrameDescriptor::Packed(output->data(), output_format_, width, height, frame.timestamp);
+    descriptor.owner = std::move(output);
+    return sink_->ProcessFrame(descriptor, output_dirty);
+}
+
+bool FilterChainSink::Close()
+{
+    return sink_->Close();
+}
+
+void FilterChainSink::SetOverlay(const uint8_t* bgra, ptrdiff_t pitch, int width, int height)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_overlay_.clear();
+    pending_overlay_width_ = 0;
+    pending_overlay_height_ = 0;
+    if (bgra && width > 0 && height > 0)
+    {
+        const size_t row_bytes = static_cast<size_t>(width) * 4;
+        pending_overlay_.resize(row_bytes * height);
+        for (int y = 0; y < height; ++y) std::copy(bgra + y * pitch, bgra + y * pitch + row_bytes, pending_overlay_.data() + y * row_bytes);
+        pending_overlay_width_ = width;
+        pending_overlay_height_ = height;
+    }
+    overlay_changed_ = true;
+}
+
+void FilterChainSink::SetOverlayPosition(int x, int y)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_overlay_x_ = x;
+    pending_overlay_y_ = y;
+    overlay_changed_ = true;
+}
+
+FilterChainStats FilterChainSink::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void FilterChainSink::SetMemoryBudget(MemoryBudget* budget)
+{
+    budget_ = budget;
+    pool_.SetMemoryBudget(budget);
+}
+
+DirtyRegion FilterChainSink::MapDirty(const DirtyRegion& dirty, int width, int height) const
+{
+    const FilterChainConfig resolved = chain_.GetConfig().Resolve(width, height);
+    const DirtyRect& crop = resolved.crop;
+
+    DirtyRegion cropped(crop.width, crop.height);
+    for (const DirtyRect& rect : dirty.ForFrame(width, height).GetRects())
+    {
+        const int left = std::max(rect.x, crop.x);
+        const int top = std::max(rect.y, crop.y);
+        const int right = std::min(rect.x + rect.width, crop.x + crop.width);
+        const int bottom = std::min(rect.y + rect.height, crop.y + crop.height);
+        if (right > left && bottom > top) cropped.Add(DirtyRect{ left - crop.x, top - crop.y, right - left, bottom - top });
+    }
+
+    if (resolved.output_width == crop.width && resolved.output_height == crop.height) return cropped;
+    return cropped.Scaled(resolved.output_width, resolved.output_height);
+}
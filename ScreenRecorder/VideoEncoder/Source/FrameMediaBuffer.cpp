@@ -0,0 +1,56 @@
+#include "FrameMediaBuffer.h"
+
+HRESULT FrameMediaBuffer::Create(std::shared_ptr<const void> owner, const uint8_t* data, DWORD length, IMFMediaBuffer** buffer)
+{
+    return Microsoft::WRL::MakeAndInitialize<FrameMediaBuffer>(buffer, std::move(owner), data, length);
+}
+
+HRESULT FrameMediaBuffer::RuntimeClassInitialize(std::shared_ptr<const void> owner, const uint8_t* data, DWORD length)
+{
+    if (!owner || !data) return E_INVALIDARG;
+
+    owner_ = std::move(owner);
+    data_ = const_cast<BYTE*>(data);
+    max_length_ = length;
+    current_length_ = length;
+    return S_OK;
+}
+
+IFACEMETHODIMP FrameMediaBuffer::Lock(BYTE** buffer, DWORD* max_length, DWORD* current_length)
+{
+    if (!buffer) return E_POINTER;
+
+    *buffer = data_;
+    if (max_length) *max_length = max_length_;
+    if (current_length) *current_length = current_length_;
+    return S_OK;
+}
+
+IFACEMETHODIMP FrameMediaBuffer::Unlock()
+{
+    return S_OK;
+}
+
+IFACEMETHODIMP FrameMediaBuffer::GetCurrentLength(DWORD* current_length)
+{
+    if (!current_length) return E_POINTER;
+
+    *current_length = current_length_;
+    return S_OK;
+}
+
+IFACEMETHODIMP FrameMediaBuffer::SetCurrentLength(DWORD current_length)
+{
+    if (current_length > max_length_) return E_INVALIDARG;
+
+    current_length_ = current_length;
+    return S_OK;
+}
+
+IFACEMETHODIMP FrameMediaBuffer::GetMaxLength(DWORD* max_length)
+{
+    if (!max_length) return E_POINTER;
+
+    *max_length = max_length_;
+    return S_OK;
+}
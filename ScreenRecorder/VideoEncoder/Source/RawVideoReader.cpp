@@ -0,0 +1,39 @@
+#include <cstring>
+
+#include "RawVideoReader.h"
+
+bool RawVideoReader::Open(const std::filesystem::path& path)
+{
+    file_.close();
+    file_.open(path, std::ios::binary);
+    if (!file_) return false;
+
+    header_ = RawFileHeader{};
+    if (!file_.read(reinterpret_cast<char*>(&header_), sizeof(header_))) return false;
+
+    // A recorder that never reached Close leaves the header zeroed
+    if (std::memcmp(header_.magic, "ZARAWV01", sizeof(header_.magic)) != 0 || header_.version != 1) return false;
+    if (header_.frame_size == 0 || header_.frame_stride < header_.frame_size) return false;
+
+    timestamps_.assign(header_.frame_count, 0);
+    if (header_.frame_count > 0)
+    {
+        file_.seekg(static_cast<std::streamoff>(header_.index_offset));
+        if (!file_.read(reinterpret_cast<char*>(timestamps_.data()), timestamps_.size() * sizeof(uint64_t)))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool RawVideoReader::ReadFrame(uint64_t index, std::vector<uint8_t>& pixels)
+{
+    if (index >= header_.frame_count) return false;
+
+    pixels.resize(header_.frame_size);
+    file_.clear();
+    file_.seekg(static_cast<std::streamoff>(kRawSlotAlignment + index * header_.frame_stride));
+    return static_cast<bool>(file_.read(reinterpret_cast<char*>(pixels.data()), pixels.size()));
+}
@@ -0,0 +1,338 @@
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "FrameKernels.h"
+#include "FrameTracer.h"
+#include "HotPathCounters.h"
+#include "RawVideoWriter.h"
+
+RawVideoWriter::RawVideoWriter(int width, int height, int fps, RawPixelFormat pixel_format, const std::filesystem::path& output_file)
+    :   width_(width),
+        height_(height),
+        fps_(fps),
+        pixel_format_(pixel_format),
+        output_file_(output_file)
+{
+}
+
+RawVideoWriter::~RawVideoWriter()
+{
+    Close();
+}
+
+bool RawVideoWriter::Initialize()
+{
+    frame_size_ = pixel_format_ == RawPixelFormat::NV12
+        ? static_cast<uint64_t>(width_) * height_ * 3 / 2
+        : static_cast<uint64_t>(width_) * height_ * 4;
+    frame_stride_ = (frame_size_ + kRawSlotAlignment - 1) / kRawSlotAlignment * kRawSlotAlignment;
+    frame_count_ = 0;
+    timestamps_.clear();
+    // An hour of index up front; growing it reallocates and copies on the frame path
+    timestamps_.reserve(static_cast<size_t>(std::max(fps_, 1)) * 3600);
+
+    if (pixel_format_ == RawPixelFormat::NV12)
+    {
+        // Whole slot, so the converted frame is aligned in both address and size
+        ResizeConversionBuffer(frame_stride_);
+        conversion_valid_ = false;
+    }
+
+    return OpenFile(output_file_);
+}
+
+bool RawVideoWriter::ProcessFrame(const std::vector<uint8_t>& image_buffer, int width, int height)
+{
+    if (image_buffer.size() < static_cast<size_t>(width) * height * 4) return false;
+
+    return ProcessFrame(FrameDescriptor::Packed(image_buffer.data(), FrameFormat::Bgra, width, height), DirtyRegion::Full(width, height));
+}
+
+bool RawVideoWriter::ProcessFrame(const FrameDescriptor& frame, const DirtyRegion& dirty)
+{
+    const bool is_nv12 = frame.format == FrameFormat::Nv12;
+    if (!frame.IsValid() || (frame.format != FrameFormat::Bgra && !(is_nv12 && pixel_format_ == RawPixelFormat::NV12))) return false;
+
+    const int width = frame.width;
+    const int height = frame.height;
+    if (width != width_ || height != height_)
+    {
+        // Same policy as VideoEncoder: a resolution change starts a new file
+        Close();
+
+        width_ = width;
+        height_ = height;
+        output_file_.replace_filename(output_file_.stem().string() + "_" + std::to_string(width) + "x" + std::to_string(height)
+                                      + output_file_.extension().string());
+
+        if (!Initialize()) return false;
+    }
+
+    const uint8_t* chunk = frame.planes[0].data;
+    size_t chunk_size = frame.GetRowBytes(0) * height;
+
+    if (is_nv12)
+    {
+        // Already converted (by a FilterChainSink); the planes go out as they are
+        const uint8_t* planes[2] = { frame.planes[0].data, frame.planes[1].data };
+        size_t plane_sizes[2] = { frame.GetRowBytes(0) * height, frame.GetRowBytes(1) * frame.GetPlaneHeight(1) };
+        if (!frame.IsPacked())
+        {
+            TraceSpan copy_span(TraceStage::Copy);
+            uint8_t* y_plane = conversion_buffer_.data();
+            FrameKernels::CopyImage(y_plane, width, frame.planes[0].data, frame.planes[0].pitch, frame.GetRowBytes(0), height);
+            FrameKernels::CopyImage(y_plane + plane_sizes[0], width, frame.planes[1].data, frame.planes[1].pitch, frame.GetRowBytes(1),
+                                    frame.GetPlaneHeight(1));
+            HotPathCounters::CountCopy(TraceStage::Copy, plane_sizes[0] + plane_sizes[1]);
+            planes[0] = y_plane;
+            planes[1] = y_plane + plane_sizes[0];
+        }
+        conversion_valid_ = false;
+
+        TraceSpan write_span(TraceStage::DiskWrite);
+        return WriteFrame(planes, plane_sizes, 2, frame.timestamp);
+    }
+    else if (pixel_format_ == RawPixelFormat::NV12)
+    {
+        TraceSpan convert_span(TraceStage::Convert);
+        uint8_t* y_plane = conversion_buffer_.data();
+        uint8_t* uv_plane = y_plane + static_cast<size_t>(width) * height;
+        const DirtyRegion region = conversion_valid_ ? dirty.ForFrame(width, height) : DirtyRegion::Full(width, height);
+        FrameKernels::ConvertBgraToNv12Region(frame.planes[0].data, frame.planes[0].pitch, y_plane, width, uv_plane, width, region);
+        HotPathCounters::CountCopy(TraceStage::Convert, region.GetArea() * 4);
+        conversion_valid_ = true;
+
+        chunk = conversion_buffer_.data();
+        chunk_size = conversion_buffer_.size();
+    }
+    else if (!frame.IsPacked())
+    {
+#ifdef _WIN32
+        // WriteFile per row costs more than packing them
+        TraceSpan copy_span(TraceStage::Copy);
+        ResizeConversionBuffer(frame_stride_);
+        FrameKernels::CopyImage(conversion_buffer_.data(), frame.GetRowBytes(0), frame.planes[0].data, frame.planes[0].pitch,
+                                frame.GetRowBytes(0), height);
+        HotPathCounters::CountCopy(TraceStage::Copy, conversion_buffer_.size());
+        chunk = conversion_buffer_.data();
+        chunk_size = conversion_buffer_.size();
+#else
+        row_chunks_.resize(height);
+        row_chunk_sizes_.assign(height, frame.GetRowBytes(0));
+        for (int y = 0; y < height; ++y) row_chunks_[y] = frame.planes[0].data + y * frame.planes[0].pitch;
+
+        TraceSpan write_span(TraceStage::DiskWrite);
+        return WriteFrame(row_chunks_.data(), row_chunk_sizes_.data(), height, frame.timestamp);
+#endif
+    }
+
+    TraceSpan write_span(TraceStage::DiskWrite);
+    return WriteFrame(&chunk, &chunk_size, 1, frame.timestamp);
+}
+
+bool RawVideoWriter::WriteFrame(const uint8_t* const* chunks, const size_t* chunk_sizes, int chunk_count,
+                                std::chrono::steady_clock::time_point timestamp)
+{
+#ifdef _WIN32
+    if (!file_handle_) return false;
+#else
+    if (file_descriptor_ < 0) return false;
+#endif
+
+    if (frame_count_ == 0)
+    {
+        first_frame_time_ = timestamp;
+    }
+
+    uint64_t offset = kRawSlotAlignment + frame_count_ * frame_stride_;
+    if (!WriteAt(offset, chunks, chunk_sizes, chunk_count)) return false;
+    for (int i = 0; i < chunk_count; ++i) HotPathCounters::CountCopy(TraceStage::DiskWrite, chunk_sizes[i]);
+
+    timestamps_.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(timestamp - first_frame_time_).count() / 100);
+    ++frame_count_;
+    return true;
+}
+
+bool RawVideoWriter::Close()
+{
+#ifdef _WIN32
+    if (!file_handle_) return true;
+#else
+    if (file_descriptor_ < 0) return true;
+#endif
+
+    RawFileHeader header{};
+    std::memcpy(header.magic, "ZARAWV01", sizeof(header.magic));
+    header.version = 1;
+    header.pixel_format = static_cast<uint32_t>(pixel_format_);
+    header.width = width_;
+    header.height = height_;
+    header.fps = fps_;
+    header.frame_size = frame_size_;
+    header.frame_stride = frame_stride_;
+    header.frame_count = frame_count_;
+    header.index_offset = kRawSlotAlignment + frame_count_ * frame_stride_;
+
+    const uint8_t* index_chunk = reinterpret_cast<const uint8_t*>(timestamps_.data());
+    size_t index_size = timestamps_.size() * sizeof(uint64_t);
+    bool result = index_size == 0 || WriteAt(header.index_offset, &index_chunk, &index_size, 1);
+
+    const uint8_t* header_chunk = reinterpret_cast<const uint8_t*>(&header);
+    size_t header_size = sizeof(header);
+    result = WriteAt(0, &header_chunk, &header_size, 1) && result;
+
+    CloseFile();
+    return result;
+}
+
+bool RawVideoWriter::OpenFile(const std::filesystem::path& path)
+{
+#ifdef _WIN32
+    HANDLE handle = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+                                FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+
+    file_handle_ = handle;
+
+    handle = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+                         FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH, nullptr);
+    direct_file_handle_ = handle == INVALID_HANDLE_VALUE ? nullptr : handle;
+#else
+    file_descriptor_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file_descriptor_ < 0) return false;
+
+#ifdef O_DIRECT
+    direct_file_descriptor_ = open(path.c_str(), O_WRONLY | O_DIRECT);
+#endif
+#endif
+
+    return true;
+}
+
+bool RawVideoWriter::IsDirectWritable(uint64_t offset, const uint8_t* const* chunks, const size_t* chunk_sizes, int chunk_count) const
+{
+#ifdef _WIN32
+    if (!direct_file_handle_) return false;
+#else
+    if (direct_file_descriptor_ < 0) return false;
+#endif
+
+    if (offset % kRawSlotAlignment != 0) return false;
+
+    for (int i = 0; i < chunk_count; ++i)
+    {
+        if (reinterpret_cast<uintptr_t>(chunks[i]) % kRawSlotAlignment != 0 || chunk_sizes[i] % kRawSlotAlignment != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool RawVideoWriter::WriteAt(uint64_t offset, const uint8_t* const* chunks, const size_t* chunk_sizes, int chunk_count)
+{
+    const bool direct = IsDirectWritable(offset, chunks, chunk_sizes, chunk_count);
+
+#ifdef _WIN32
+    HANDLE handle = direct ? direct_file_handle_ : file_handle_;
+
+    for (int i = 0; i < chunk_count; ++i)
+    {
+        size_t written_total = 0;
+        while (written_total < chunk_sizes[i])
+        {
+            OVERLAPPED overlapped{};
+            overlapped.Offset = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+            DWORD to_write = static_cast<DWORD>(std::min<size_t>(chunk_sizes[i] - written_total, 1u << 30));
+            DWORD written = 0;
+            if (!WriteFile(handle, chunks[i] + written_total, to_write, &written, &overlapped) || written == 0)
+            {
+                return false;
+            }
+
+            written_total += written;
+            offset += written;
+        }
+    }
+#else
+    // One pwritev per frame; chunks are consumed in place, partial writes resume mid-chunk
+    std::vector<iovec>& vectors = write_vectors_;
+    vectors.resize(chunk_count);
+    for (int i = 0; i < chunk_count; ++i)
+    {
+        vectors[i].iov_base = const_cast<uint8_t*>(chunks[i]);
+        vectors[i].iov_len = chunk_sizes[i];
+    }
+
+    const int descriptor = direct ? direct_file_descriptor_ : file_descriptor_;
+
+    size_t first = 0;
+    while (first < vectors.size())
+    {
+        // A padded frame is one chunk per row, more than one call may take
+        const int count = static_cast<int>(std::min<size_t>(vectors.size() - first, IOV_MAX));
+        ssize_t written = pwritev(descriptor, vectors.data() + first, count, static_cast<off_t>(offset));
+        if (written <= 0) return false;
+
+        offset += written;
+        while (first < vectors.size() && static_cast<size_t>(written) >= vectors[first].iov_len)
+        {
+            written -= vectors[first].iov_len;
+            ++first;
+        }
+        if (first < vectors.size())
+        {
+            vectors[first].iov_base = static_cast<uint8_t*>(vectors[first].iov_base) + written;
+            vectors[first].iov_len -= written;
+        }
+    }
+#endif
+
+    return true;
+}
+
+void RawVideoWriter::CloseFile()
+{
+#ifdef _WIN32
+    if (direct_file_handle_)
+    {
+        CloseHandle(direct_file_handle_);
+        direct_file_handle_ = nullptr;
+    }
+
+    CloseHandle(file_handle_);
+    file_handle_ = nullptr;
+#else
+    if (direct_file_descriptor_ >= 0)
+    {
+        close(direct_file_descriptor_);
+        direct_file_descriptor_ = -1;
+    }
+
+    close(file_descriptor_);
+    file_descriptor_ = -1;
+#endif
+}
+
+void RawVideoWriter::ResizeConversionBuffer(size_t bytes)
+{
+    conversion_buffer_.Resize(bytes);
+    if (budget_ && conversion_reservation_.GetBytes() != conversion_buffer_.size())
+    {
+        conversion_reservation_.Reset();
+        conversion_reservation_ = budget_->Charge(conversion_buffer_.size());
+    }
+}
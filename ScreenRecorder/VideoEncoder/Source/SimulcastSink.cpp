@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <chrono>
+
+#include "FrameKernels.h"
+#include "FrameTracer.h"
+#include "HotPathCounters.h"
+#include "SimulcastSink.h"
+
+namespace
+{
+    uint64_t ElapsedNs(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+SimulcastSink::SimulcastSink(const ThreadRoles* thread_roles, size_t queue_depth)
+    : thread_roles_(thread_roles),
+      queue_depth_(std::max<size_t>(1, queue_depth))
+{
+}
+
+SimulcastSink::~SimulcastSink()
+{
+    Stop();
+}
+
+void SimulcastSink::AddRendition(std::shared_ptr<FrameSink> sink, int width, int height, std::function<void()> request_keyframe)
+{
+    auto rendition = std::make_unique<Rendition>();
+    rendition->sink = std::move(sink);
+    rendition->request_keyframe = std::move(request_keyframe);
+    // 4:2:0 encoders need even sizes
+    rendition->width = width > 0 && height > 0 ? std::max(2, width & ~1) : 0;
+    rendition->height = width > 0 && height > 0 ? std::max(2, height & ~1) : 0;
+    rendition->jobs.resize(queue_depth_);
+
+    Rendition& worker_rendition = *rendition;
+    rendition->worker = std::thread([this, &worker_rendition] { RunWorker(worker_rendition); });
+    renditions_.push_back(std::move(rendition));
+}
+
+void SimulcastSink::SetMemoryBudget(MemoryBudget* budget)
+{
+    budget_ = budget;
+    pool_.SetMemoryBudget(budget);
+}
+
+bool SimulcastSink::ProcessFrame(const std::vector<uint8_t>& image_buffer, int width, int height)
+{
+    return ProcessFrame(FrameDescriptor::Packed(image_buffer.data(), FrameFormat::Bgra, width, height), DirtyRegion::Full(width, height));
+}
+
+bool SimulcastSink::ProcessFrame(const FrameDescriptor& frame, const DirtyRegion& dirty)
+{
+    if (is_closed_ || renditions_.empty() || !frame.IsValid() || frame.format != FrameFormat::Bgra) return false;
+
+    Job job;
+    job.dirty = dirty.ForFrame(frame.width, frame.height);
+    job.keyframe = keyframe_requested_;
+    keyframe_requested_ = false;
+
+    RetainedFrame retained = RetainFrame(frame, pool_);
+    if (retained.fill)
+    {
+        TraceSpan copy_span(TraceStage::Copy);
+        const size_t row_bytes = frame.GetRowBytes(0);
+        FrameKernels::CopyImage(retained.fill, row_bytes, frame.planes[0].data, frame.planes[0].pitch, row_bytes, frame.height);
+        HotPathCounters::CountCopy(TraceStage::Copy, row_bytes * frame.height);
+    }
+    job.frame = FrameDescriptor::Packed(retained.data, FrameFormat::Bgra, frame.width, frame.height, frame.timestamp);
+    job.frame.owner = std::move(retained.owner);
+
+    for (const std::unique_ptr<Rendition>& rendition : renditions_)
+    {
+        {
+            std::unique_lock<std::mutex> lock(rendition->mutex);
+            if (rendition->depth == rendition->jobs.size())
+            {
+                auto wait_start = std::chrono::steady_clock::now();
+                rendition->not_full.wait(lock, [&] { return rendition->depth < rendition->jobs.size(); });
+                rendition->waited_ns.fetch_add(ElapsedNs(wait_start), std::memory_order_relaxed);
+            }
+
+            rendition->jobs[(rendition->head + rendition->depth) % rendition->jobs.size()] = job;
+            ++rendition->depth;
+        }
+        rendition->not_empty.notify_one();
+    }
+
+    return true;
+}
+
+bool SimulcastSink::Close()
+{
+    if (is_closed_) return true;
+
+    Stop();
+
+    bool result = true;
+    for (const std::unique_ptr<Rendition>& rendition : renditions_)
+    {
+        result = rendition->sink->Close() && result;
+    }
+    return result;
+}
+
+std::vector<RenditionStats> SimulcastSink::GetStats() const
+{
+    std::vector<RenditionStats> stats;
+    for (const std::unique_ptr<Rendition>& rendition : renditions_)
+    {
+        RenditionStats rendition_stats;
+        rendition_stats.width = rendition->width;
+        rendition_stats.height = rendition->height;
+        rendition_stats.frames = rendition->frames.load(std::memory_order_relaxed);
+        rendition_stats.failed = rendition->failed.load(std::memory_order_relaxed);
+        rendition_stats.scale_ms = rendition->scale_ns.load(std::memory_order_relaxed) / 1e6;
+        rendition_stats.sink_ms = rendition->sink_ns.load(std::memory_order_relaxed) / 1e6;
+        rendition_stats.waited_ms = rendition->waited_ns.load(std::memory_order_relaxed) / 1e6;
+        stats.push_back(rendition_stats);
+    }
+    return stats;
+}
+
+void SimulcastSink::RunWorker(Rendition& rendition)
+{
+    FrameTracer::SetThreadName("rendition");
+
+    Job job;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(rendition.mutex);
+            rendition.not_empty.wait(lock, [&] { return rendition.is_closed || rendition.depth > 0; });
+            if (rendition.depth == 0) break;
+
+            job = std::move(rendition.jobs[rendition.head]);
+            rendition.head = (rendition.head + 1) % rendition.jobs.size();
+            --rendition.depth;
+        }
+        rendition.not_full.notify_one();
+
+        // Workers start at AddRendition, before the roles are usually configured
+        if (thread_roles_) thread_roles_->EnsureApplied(ThreadRole::Encode);
+        if (job.keyframe && rendition.request_keyframe) rendition.request_keyframe();
+
+        const FrameDescriptor& source = job.frame;
+        const int width = rendition.width > 0 ? rendition.width : source.width;
+        const int height = rendition.height > 0 ? rendition.height : source.height;
+
+        if (width == source.width && height == source.height)
+        {
+            auto sink_start = std::chrono::steady_clock::now();
+            const bool processed = rendition.sink->ProcessFrame(source, job.dirty);
+            rendition.sink_ns.fetch_add(ElapsedNs(sink_start), std::memory_order_relaxed);
+            (processed ? rendition.frames : rendition.failed).fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            auto scale_start = std::chrono::steady_clock::now();
+            DirtyRegion scaled_dirty;
+            {
+                TraceSpan convert_span(TraceStage::Convert);
+                const size_t bytes = static_cast<size_t>(width) * height * 4;
+                const bool is_reused = rendition.scaled.size() == bytes && rendition.source_width == source.width
+                                       && rendition.source_height == source.height;
+                rendition.scaled.Resize(bytes);
+                if (budget_ && rendition.scaled_reservation.GetBytes() != bytes)
+                {
+                    rendition.scaled_reservation.Reset();
+                    rendition.scaled_reservation = budget_->Charge(bytes);
+                }
+                rendition.source_width = source.width;
+                rendition.source_height = source.height;
+
+                scaled_dirty = is_reused ? job.dirty.Scaled(width, height) : DirtyRegion::Full(width, height);
+                FrameKernels::ScaleBgraBilinearRegion(source.planes[0].data, source.planes[0].pitch, source.width, source.height,
+                                                      rendition.scaled.data(), static_cast<ptrdiff_t>(width) * 4, width, height, scaled_dirty);
+                HotPathCounters::CountCopy(TraceStage::Convert, scaled_dirty.GetArea() * 4);
+            }
+            rendition.scale_ns.fetch_add(ElapsedNs(scale_start), std::memory_order_relaxed);
+
+            // The shared frame is done with; the sink copies the scaled one if it keeps it
+            job.frame.owner.reset();
+
+            auto sink_start = std::chrono::steady_clock::now();
+            const FrameDescriptor scaled = FrameDescriptor::Packed(rendition.scaled.data(), FrameFormat::Bgra, width, height, source.timestamp);
+            const bool processed = rendition.sink->ProcessFrame(scaled, scaled_dirty);
+            rendition.sink_ns.fetch_add(ElapsedNs(sink_start), std::memory_order_relaxed);
+            (processed ? rendition.frames : rendition.failed).fetch_add(1, std::memory_order_relaxed);
+        }
+
+        job.frame.owner.reset();
+    }
+}
+
+void SimulcastSink::Stop()
+{
+    is_closed_ = true;
+    for (const std::unique_ptr<Rendition>& rendition : renditions_)
+    {
+        {
+            std::lock_guard<std::mutex> lock(rendition->mutex);
+            rendition->is_closed = true;
+        }
+        rendition->not_empty.notify_all();
+    }
+    for (const std::unique_ptr<Rendition>& rendition : renditions_)
+    {
+        if (rendition->worker.joinable()) rendition->worker.join();
+    }
+}
@@ -0,0 +1,420 @@
+#include <mferror.h>
+#include <Codecapi.h>
+#include <algorithm>
+#include <cstring>
+
+#include "FrameKernels.h"
+#include "FrameMediaBuffer.h"
+#include "FrameTracer.h"
+#include "HotPathCounters.h"
+#include "StreamEncoder.h"
+
+using namespace Microsoft::WRL;
+
+namespace
+{
+    constexpr uint64_t kHundredNsPerSecond = 10000000;
+
+    void SetCodecValue(ICodecAPI* codec_api, const GUID& property, ULONG value)
+    {
+        VARIANT variant;
+        VariantInit(&variant);
+        variant.vt = VT_UI4;
+        variant.ulVal = value;
+        codec_api->SetValue(&property, &variant);
+    }
+
+    // Whether an Annex B access unit carries an SPS (H.264 type 7, H.265 type 33)
+    bool HasSequenceParameterSet(const uint8_t* data, size_t size, bool is_h265)
+    {
+        for (size_t i = 0; i + 3 < size; ++i)
+        {
+            if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1) continue;
+
+            const uint8_t header = data[i + 3];
+            const int type = is_h265 ? (header >> 1) & 0x3F : header & 0x1F;
+            if (type == (is_h265 ? 33 : 7)) return true;
+            i += 2;
+        }
+        return false;
+    }
+}
+
+StreamEncoder::StreamEncoder(int width, int height, int fps, int bitrate, EncodedPacketCallback callback)
+    :   width_(width & ~1),
+        height_(height & ~1),
+        fps_(fps),
+        bitrate_(bitrate),
+        callback_(std::move(callback))
+{
+    MFStartup(MF_VERSION);
+}
+
+StreamEncoder::~StreamEncoder()
+{
+    Close();
+    MFShutdown();
+}
+
+bool StreamEncoder::Initialize(VideoCodec codec_type, uint32_t keyframe_interval, int slices)
+{
+    if (codec_type != VideoCodec::H264 && codec_type != VideoCodec::H265) return false;
+
+    codec_guid_ = codec_type == VideoCodec::H265 ? MFVideoFormat_H265 : MFVideoFormat_H264;
+    keyframe_interval_ = keyframe_interval;
+    slices_ = std::max(1, slices);
+    nv12_width_ = 0;
+    nv12_height_ = 0;
+
+    return SUCCEEDED(CreateEncoder()) && SUCCEEDED(ConfigureEncoder());
+}
+
+bool StreamEncoder::ProcessFrame(const std::vector<uint8_t>& image_buffer, int width, int height)
+{
+    if (image_buffer.size() < static_cast<size_t>(width) * height * 4) return false;
+
+    return SUCCEEDED(EncodeFrame(FrameDescriptor::Packed(image_buffer.data(), FrameFormat::Bgra, width, height), DirtyRegion::Full(width, height)));
+}
+
+bool StreamEncoder::ProcessFrame(const FrameDescriptor& frame, const DirtyRegion& dirty)
+{
+    return SUCCEEDED(EncodeFrame(frame, dirty));
+}
+
+HRESULT StreamEncoder::CreateEncoder()
+{
+    Shutdown();
+
+    // Synchronous MFTs only: an asynchronous (hardware) encoder needs an event loop and
+    // buffers several frames before its first output
+    MFT_REGISTER_TYPE_INFO input_info = { MFMediaType_Video, MFVideoFormat_NV12 };
+    MFT_REGISTER_TYPE_INFO output_info = { MFMediaType_Video, codec_guid_ };
+    IMFActivate** activates = nullptr;
+    UINT32 count = 0;
+
+    HRESULT hr = MFTEnumEx(MFT_CATEGORY_VIDEO_ENCODER, MFT_ENUM_FLAG_SYNCMFT | MFT_ENUM_FLAG_LOCALMFT | MFT_ENUM_FLAG_SORTANDFILTER,
+                           &input_info, &output_info, &activates, &count);
+    if (FAILED(hr)) return hr;
+
+    hr = count > 0 ? activates[0]->ActivateObject(IID_PPV_ARGS(&encoder_)) : MF_E_TOPO_CODEC_NOT_FOUND;
+    for (UINT32 i = 0; i < count; ++i)
+    {
+        activates[i]->Release();
+    }
+    CoTaskMemFree(activates);
+    if (FAILED(hr)) return hr;
+
+    ComPtr<IMFAttributes> attributes;
+    if (SUCCEEDED(encoder_->GetAttributes(&attributes)))
+    {
+        attributes->SetUINT32(MF_LOW_LATENCY, TRUE);
+    }
+
+    if (encoder_->GetStreamIDs(1, &input_id_, 1, &output_id_) == E_NOTIMPL)
+    {
+        input_id_ = 0;
+        output_id_ = 0;
+    }
+
+    codec_api_ = nullptr;
+    encoder_.As(&codec_api_);
+    return S_OK;
+}
+
+void StreamEncoder::ConfigureCodecApi()
+{
+    if (!codec_api_) return;
+
+    // Best effort: encoders ignore what they don't support
+    SetCodecValue(codec_api_.Get(), CODECAPI_AVLowLatencyMode, TRUE);
+    SetCodecValue(codec_api_.Get(), CODECAPI_AVEncMPVDefaultBPictureCount, 0);
+    SetCodecValue(codec_api_.Get(), CODECAPI_AVEncCommonRateControlMode, eAVEncCommonRateControlMode_CBR);
+    SetCodecValue(codec_api_.Get(), CODECAPI_AVEncCommonMeanBitRate, static_cast<ULONG>(bitrate_));
+    if (keyframe_interval_ > 0)
+    {
+        SetCodecValue(codec_api_.Get(), CODECAPI_AVEncMPVGOPSize, keyframe_interval_);
+    }
+
+    // Slice size in macroblock rows (mode 2)
+    const ULONG macroblock_rows = static_cast<ULONG>((height_ + 15) / 16);
+    SetCodecValue(codec_api_.Get(), CODECAPI_AVEncSliceControlMode, 2);
+    SetCodecValue(codec_api_.Get(), CODECAPI_AVEncSliceControlSize, (macroblock_rows + slices_ - 1) / slices_);
+}
+
+HRESULT StreamEncoder::ConfigureEncoder()
+{
+    if (!encoder_) return E_UNEXPECTED;
+
+    ConfigureCodecApi();
+
+    // Encoders take the output type first; it fixes what inputs they offer
+    ComPtr<IMFMediaType> output_type;
+    HRESULT hr = MFCreateMediaType(&output_type);
+    if (FAILED(hr)) return hr;
+
+    output_type->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
+    output_type->SetGUID(MF_MT_SUBTYPE, codec_guid_);
+    output_type->SetUINT32(MF_MT_AVG_BITRATE, bitrate_);
+    output_type->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
+    MFSetAttributeSize(output_type.Get(), MF_MT_FRAME_SIZE, width_, height_);
+    MFSetAttributeRatio(output_type.Get(), MF_MT_FRAME_RATE, fps_, 1);
+    MFSetAttributeRatio(output_type.Get(), MF_MT_PIXEL_ASPECT_RATIO, 1, 1);
+
+    hr = encoder_->SetOutputType(output_id_, output_type.Get(), 0);
+    if (FAILED(hr)) return hr;
+
+    ComPtr<IMFMediaType> input_type;
+    hr = MFCreateMediaType(&input_type);
+    if (FAILED(hr)) return hr;
+
+    input_type->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
+    input_type->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_NV12);
+    input_type->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
+    input_type->SetUINT32(MF_MT_DEFAULT_STRIDE, width_);
+    MFSetAttributeSize(input_type.Get(), MF_MT_FRAME_SIZE, width_, height_);
+    MFSetAttributeRatio(input_type.Get(), MF_MT_FRAME_RATE, fps_, 1);
+    MFSetAttributeRatio(input_type.Get(), MF_MT_PIXEL_ASPECT_RATIO, 1, 1);
+
+    hr = encoder_->SetInputType(input_id_, input_type.Get(), 0);
+    if (FAILED(hr)) return hr;
+
+    // Parameter sets, if the encoder publishes them; prepended to keyframes that lack them
+    sequence_header_.clear();
+    ComPtr<IMFMediaType> current_type;
+    UINT32 header_size = 0;
+    if (SUCCEEDED(encoder_->GetOutputCurrentType(output_id_, &current_type)) &&
+        SUCCEEDED(current_type->GetBlobSize(MF_MT_MPEG_SEQUENCE_HEADER, &header_size)) && header_size > 0)
+    {
+        sequence_header_.resize(header_size);
+        current_type->GetBlob(MF_MT_MPEG_SEQUENCE_HEADER, sequence_header_.data(), header_size, nullptr);
+    }
+
+    hr = encoder_->GetOutputStreamInfo(output_id_, &output_info_);
+    if (FAILED(hr)) return hr;
+
+    encoder_->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, 0);
+    encoder_->ProcessMessage(MFT_MESSAGE_NOTIFY_START_OF_STREAM, 0);
+    is_streaming_ = true;
+    return S_OK;
+}
+
+HRESULT StreamEncoder::EncodeFrame(const FrameDescriptor& frame, const DirtyRegion& dirty)
+{
+    if (!frame.IsValid() || frame.format != FrameFormat::Bgra) return E_INVALIDARG;
+
+    // NV12 needs even dimensions
+    const int width = frame.width & ~1;
+    const int height = frame.height & ~1;
+    if (width == 0 || height == 0) return E_INVALIDARG;
+
+    if (width != width_ || height != height_ || !encoder_)
+    {
+        // New parameter sets; the next frame is an IDR, so the receiver can switch there. Frames
+        // still inside the old encoder are drained out first.
+        Close();
+        width_ = width;
+        height_ = height;
+        HRESULT hr = CreateEncoder();
+        if (SUCCEEDED(hr)) hr = ConfigureEncoder();
+        if (FAILED(hr)) return hr;
+    }
+
+    const size_t luma_size = static_cast<size_t>(width) * height;
+    const DWORD buffer_size = static_cast<DWORD>(luma_size * 3 / 2);
+
+    {
+        TraceSpan convert_span(TraceStage::Convert);
+        DirtyRegion region = dirty.ForFrame(width, height);
+        if (width != nv12_width_ || height != nv12_height_)
+        {
+            nv12_frame_.resize(buffer_size);
+            if (budget_)
+            {
+                nv12_reservation_.Reset();
+                nv12_reservation_ = budget_->Charge(buffer_size);
+            }
+            nv12_width_ = width;
+            nv12_height_ = height;
+            region = DirtyRegion::Full(width, height);
+        }
+
+        FrameKernels::ConvertBgraToNv12Region(frame.planes[0].data, frame.planes[0].pitch, nv12_frame_.data(), width,
+                                              nv12_frame_.data() + luma_size, width, region);
+        HotPathCounters::CountCopy(TraceStage::Convert, region.GetArea() * 4);
+    }
+
+    // The encoder may keep the sample as a reference, so it gets its own copy of the kept frame
+    PooledFrame pixels = sample_pool_.Acquire(buffer_size);
+    std::memcpy(pixels->data(), nv12_frame_.data(), buffer_size);
+    HotPathCounters::CountCopy(TraceStage::Copy, buffer_size);
+    const uint8_t* data = pixels->data();
+
+    ComPtr<IMFMediaBuffer> buffer;
+    HRESULT hr = FrameMediaBuffer::Create(std::move(pixels), data, buffer_size, &buffer);
+    if (FAILED(hr)) return hr;
+
+    ComPtr<IMFSample> sample;
+    hr = MFCreateSample(&sample);
+    if (FAILED(hr)) return hr;
+    sample->AddBuffer(buffer.Get());
+
+    const LONGLONG duration = static_cast<LONGLONG>(kHundredNsPerSecond / fps_);
+    const LONGLONG timestamp = static_cast<LONGLONG>(frame_count_) * duration;
+    sample->SetSampleTime(timestamp);
+    sample->SetSampleDuration(duration);
+    capture_times_[timestamp] = frame.timestamp;
+
+    if (keyframe_requested_.exchange(false, std::memory_order_relaxed) && codec_api_)
+    {
+        VARIANT value;
+        VariantInit(&value);
+        value.vt = VT_UI4;
+        value.ulVal = 1;
+        if (SUCCEEDED(codec_api_->SetValue(&CODECAPI_AVEncVideoForceKeyFrame, &value)))
+        {
+            forced_keyframes_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    {
+        TraceSpan submit_span(TraceStage::EncodeSubmit);
+        hr = encoder_->ProcessInput(input_id_, sample.Get(), 0);
+        if (hr == MF_E_NOTACCEPTING)
+        {
+            DrainOutput();
+            hr = encoder_->ProcessInput(input_id_, sample.Get(), 0);
+        }
+    }
+    if (FAILED(hr))
+    {
+        capture_times_.erase(timestamp);
+        return hr;
+    }
+
+    ++frame_count_;
+    return DrainOutput();
+}
+
+HRESULT StreamEncoder::DrainOutput()
+{
+    for (;;)
+    {
+        // Encoders that don't allocate their own output samples are given one of the size they ask for
+        ComPtr<IMFSample> output_sample;
+        const bool provides_samples = (output_info_.dwFlags & (MFT_OUTPUT_STREAM_PROVIDES_SAMPLES | MFT_OUTPUT_STREAM_CAN_PROVIDE_SAMPLES)) != 0;
+        if (!provides_samples)
+        {
+            ComPtr<IMFMediaBuffer> buffer;
+            HRESULT hr = MFCreateMemoryBuffer(std::max<DWORD>(output_info_.cbSize, 1 << 20), &buffer);
+            if (FAILED(hr)) return hr;
+            hr = MFCreateSample(&output_sample);
+            if (FAILED(hr)) return hr;
+            output_sample->AddBuffer(buffer.Get());
+        }
+
+        MFT_OUTPUT_DATA_BUFFER output = {};
+        output.dwStreamID = output_id_;
+        output.pSample = output_sample.Get();
+        DWORD status = 0;
+
+        HRESULT hr = encoder_->ProcessOutput(0, 1, &output, &status);
+        if (output.pEvents)
+        {
+            output.pEvents->Release();
+        }
+
+        if (hr == MF_E_TRANSFORM_NEED_MORE_INPUT) return S_OK;
+        if (hr == MF_E_TRANSFORM_STREAM_CHANGE)
+        {
+            ComPtr<IMFMediaType> output_type;
+            hr = encoder_->GetOutputAvailableType(output_id_, 0, &output_type);
+            if (SUCCEEDED(hr)) hr = encoder_->SetOutputType(output_id_, output_type.Get(), 0);
+            if (SUCCEEDED(hr)) hr = encoder_->GetOutputStreamInfo(output_id_, &output_info_);
+            if (FAILED(hr)) return hr;
+            continue;
+        }
+        if (FAILED(hr)) return hr;
+
+        DeliverSample(output.pSample);
+        if (provides_samples && output.pSample)
+        {
+            output.pSample->Release();
+        }
+    }
+}
+
+void StreamEncoder::DeliverSample(IMFSample* sample)
+{
+    if (!sample) return;
+
+    ComPtr<IMFMediaBuffer> buffer;
+    if (FAILED(sample->ConvertToContiguousBuffer(&buffer))) return;
+
+    BYTE* data = nullptr;
+    DWORD length = 0;
+    if (FAILED(buffer->Lock(&data, nullptr, &length))) return;
+
+    EncodedPacket packet;
+    packet.is_keyframe = MFGetAttributeUINT32(sample, MFSampleExtension_CleanPoint, FALSE) != FALSE;
+
+    LONGLONG timestamp = 0;
+    sample->GetSampleTime(&timestamp);
+    auto capture_time = capture_times_.find(timestamp);
+    if (capture_time != capture_times_.end())
+    {
+        packet.capture_time = capture_time->second;
+        capture_times_.erase(capture_times_.begin(), std::next(capture_time));
+    }
+    else
+    {
+        packet.capture_time = std::chrono::steady_clock::now();
+    }
+
+    // A receiver joining at a keyframe needs the parameter sets in the stream
+    const bool is_h265 = codec_guid_ == MFVideoFormat_H265;
+    if (packet.is_keyframe && !sequence_header_.empty() && !HasSequenceParameterSet(data, length, is_h265))
+    {
+        packet_.assign(sequence_header_.begin(), sequence_header_.end());
+        packet_.insert(packet_.end(), data, data + length);
+        packet.data = packet_.data();
+        packet.size = packet_.size();
+    }
+    else
+    {
+        packet.data = data;
+        packet.size = length;
+    }
+
+    if (callback_)
+    {
+        callback_(packet);
+    }
+
+    buffer->Unlock();
+}
+
+bool StreamEncoder::Close()
+{
+    if (encoder_ && is_streaming_)
+    {
+        encoder_->ProcessMessage(MFT_MESSAGE_NOTIFY_END_OF_STREAM, 0);
+        encoder_->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN, 0);
+        DrainOutput();
+    }
+
+    Shutdown();
+    return true;
+}
+
+void StreamEncoder::Shutdown()
+{
+    if (encoder_ && is_streaming_)
+    {
+        encoder_->ProcessMessage(MFT_MESSAGE_NOTIFY_END_STREAMING, 0);
+    }
+
+    is_streaming_ = false;
+    codec_api_ = nullptr;
+    encoder_ = nullptr;
+    capture_times_.clear();
+}
@@ -0,0 +1,243 @@
+#include <algorithm>
+
+#include "FrameKernels.h"
+#include "TimeLapseSink.h"
+
+namespace
+{
+    uint64_t ElapsedNs(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+TimeLapseSink::TimeLapseSink(std::shared_ptr<FrameSink> sink, double interval_seconds, TimeLapseBlend blend)
+    : sink_(std::move(sink)),
+      interval_(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(std::max(interval_seconds, 0.001)))),
+      blend_(blend),
+      pool_(4)
+{
+}
+
+bool TimeLapseSink::ProcessFrame(const std::vector<uint8_t>& image_buffer, int width, int height)
+{
+    return ProcessFrame(FrameDescriptor::Packed(image_buffer.data(), FrameFormat::Bgra, width, height), DirtyRegion::Full(width, height));
+}
+
+bool TimeLapseSink::ProcessFrame(const FrameDescriptor& frame, const DirtyRegion& dirty)
+{
+    if (is_closed_ || !frame.IsValid() || frame.format != FrameFormat::Bgra) return false;
+
+    frames_in_.fetch_add(1, std::memory_order_relaxed);
+    bool result = true;
+
+    if (frame.width != width_ || frame.height != height_)
+    {
+        // The interval in progress is cut short; the sink sees the new size from here
+        if (width_ > 0 && frames_in_interval_ > 0) result = EmitInterval();
+
+        auto start_time = std::chrono::steady_clock::now();
+        Start(frame);
+        blend_ns_.fetch_add(ElapsedNs(start_time), std::memory_order_relaxed);
+        return result;
+    }
+
+    // Intervals that ended before this frame, with the screen as it was
+    while (frame.timestamp - interval_start_ >= interval_)
+    {
+        result = EmitInterval() && result;
+        interval_start_ += interval_;
+    }
+
+    auto blend_start = std::chrono::steady_clock::now();
+    const int tick = GetTick(frame.timestamp);
+
+    std::fill(tile_flags_.begin(), tile_flags_.end(), 0);
+    for (const DirtyRect& rect : dirty.ForFrame(width_, height_).GetRects())
+    {
+        if (rect.width <= 0 || rect.height <= 0) continue;
+        for (int tile_y = rect.y / kTileSize; tile_y <= (rect.y + rect.height - 1) / kTileSize; ++tile_y)
+        {
+            for (int tile_x = rect.x / kTileSize; tile_x <= (rect.x + rect.width - 1) / kTileSize; ++tile_x)
+            {
+                tile_flags_[tile_y * tiles_x_ + tile_x] = 1;
+            }
+        }
+    }
+
+    // Each changed tile's old content is folded in for as long as it was up, then replaced
+    const ptrdiff_t pitch = static_cast<ptrdiff_t>(width_) * 4;
+    const ptrdiff_t frame_pitch = frame.planes[0].pitch;
+    for (int tile_y = 0; tile_y < tiles_y_; ++tile_y)
+    {
+        for (int tile_x = 0; tile_x < tiles_x_; ++tile_x)
+        {
+            if (!tile_flags_[tile_y * tiles_x_ + tile_x]) continue;
+
+            FoldTile(tile_x, tile_y, tick);
+
+            const int x = tile_x * kTileSize;
+            const int y = tile_y * kTileSize;
+            const size_t row_bytes = static_cast<size_t>(std::min(kTileSize, width_ - x)) * 4;
+            const int rows = std::min(kTileSize, height_ - y);
+            const uint8_t* source = frame.planes[0].data + y * frame_pitch + static_cast<ptrdiff_t>(x) * 4;
+            FrameKernels::CopyImage(screen_.data() + y * pitch + static_cast<ptrdiff_t>(x) * 4, pitch, source, frame_pitch, row_bytes, rows);
+            if (blend_ == TimeLapseBlend::Max)
+            {
+                FrameKernels::MaxImage(peak_.data() + y * pitch + static_cast<ptrdiff_t>(x) * 4, pitch, source, frame_pitch, row_bytes, rows);
+            }
+        }
+    }
+
+    ++frames_in_interval_;
+    blend_ns_.fetch_add(ElapsedNs(blend_start), std::memory_order_relaxed);
+    return result;
+}
+
+bool TimeLapseSink::Close()
+{
+    if (is_closed_) return true;
+
+    bool result = true;
+    if (width_ > 0 && frames_in_interval_ > 0) result = EmitInterval();
+    is_closed_ = true;
+
+    return sink_->Close() && result;
+}
+
+TimeLapseStats TimeLapseSink::GetStats() const
+{
+    TimeLapseStats stats;
+    stats.frames_in = frames_in_.load(std::memory_order_relaxed);
+    stats.frames_out = frames_out_.load(std::memory_order_relaxed);
+    stats.frames_repeated = frames_repeated_.load(std::memory_order_relaxed);
+    stats.blend_ms = blend_ns_.load(std::memory_order_relaxed) / 1e6;
+    stats.resolve_ms = resolve_ns_.load(std::memory_order_relaxed) / 1e6;
+    stats.buffer_bytes = buffer_bytes_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void TimeLapseSink::SetMemoryBudget(MemoryBudget* budget)
+{
+    budget_ = budget;
+    pool_.SetMemoryBudget(budget);
+}
+
+void TimeLapseSink::Start(const FrameDescriptor& frame)
+{
+    width_ = frame.width;
+    height_ = frame.height;
+    tiles_x_ = (width_ + kTileSize - 1) / kTileSize;
+    tiles_y_ = (height_ + kTileSize - 1) / kTileSize;
+
+    const size_t bytes = static_cast<size_t>(width_) * height_ * 4;
+    screen_.Resize(bytes);
+    FrameKernels::CopyImage(screen_.data(), static_cast<ptrdiff_t>(width_) * 4, frame.planes[0].data, frame.planes[0].pitch,
+                            static_cast<size_t>(width_) * 4, height_);
+
+    sum_.clear();
+    peak_.Resize(0);
+    if (blend_ == TimeLapseBlend::Average)
+    {
+        sum_.assign(bytes, 0);
+    }
+    else if (blend_ == TimeLapseBlend::Max)
+    {
+        peak_.Resize(bytes);
+        std::copy(screen_.data(), screen_.data() + bytes, peak_.data());
+    }
+
+    since_.assign(static_cast<size_t>(tiles_x_) * tiles_y_, 0);
+    tile_flags_.assign(since_.size(), 0);
+    interval_start_ = frame.timestamp;
+    frames_in_interval_ = 1;
+    was_repeat_ = false;
+    repeat_.reset();
+
+    const size_t buffer_bytes = screen_.size() + sum_.size() * sizeof(uint16_t) + peak_.size() + since_.size() * sizeof(uint16_t) + tile_flags_.size();
+    buffer_bytes_.store(buffer_bytes, std::memory_order_relaxed);
+    buffer_reservation_.Reset();
+    if (budget_) buffer_reservation_ = budget_->Charge(buffer_bytes);
+}
+
+int TimeLapseSink::GetTick(std::chrono::steady_clock::time_point time) const
+{
+    const std::chrono::nanoseconds elapsed = time - interval_start_;
+    if (elapsed.count() <= 0) return 0;
+    if (elapsed >= interval_) return kTicks;
+    return static_cast<int>(elapsed.count() * kTicks / interval_.count());
+}
+
+void TimeLapseSink::FoldTile(int tile_x, int tile_y, int tick)
+{
+    uint16_t& since = since_[tile_y * tiles_x_ + tile_x];
+    if (tick <= since) return;
+
+    if (blend_ == TimeLapseBlend::Average)
+    {
+        const int x = tile_x * kTileSize;
+        const int y = tile_y * kTileSize;
+        const ptrdiff_t pitch = static_cast<ptrdiff_t>(width_) * 4;
+        FrameKernels::AccumulateWeighted(sum_.data() + y * pitch + static_cast<ptrdiff_t>(x) * 4, pitch * 2,
+                                         screen_.data() + y * pitch + static_cast<ptrdiff_t>(x) * 4, pitch,
+                                         static_cast<size_t>(std::min(kTileSize, width_ - x)) * 4, std::min(kTileSize, height_ - y),
+                                         static_cast<uint32_t>(tick - since));
+    }
+    since = static_cast<uint16_t>(tick);
+}
+
+bool TimeLapseSink::EmitInterval()
+{
+    auto resolve_start = std::chrono::steady_clock::now();
+    const size_t bytes = static_cast<size_t>(width_) * height_ * 4;
+    const ptrdiff_t pitch = static_cast<ptrdiff_t>(width_) * 4;
+
+    PooledFrame output;
+    DirtyRegion output_dirty = DirtyRegion::Full(width_, height_);
+    if (frames_in_interval_ == 0)
+    {
+        // Nothing arrived, so every blend is the screen as it stands; one copy serves the whole run
+        if (!repeat_)
+        {
+            repeat_ = pool_.Acquire(bytes);
+            std::copy(screen_.data(), screen_.data() + bytes, repeat_->data());
+        }
+        output = repeat_;
+        if (was_repeat_) output_dirty = DirtyRegion(width_, height_);
+        was_repeat_ = true;
+        frames_repeated_.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        output = pool_.Acquire(bytes);
+        switch (blend_)
+        {
+        case TimeLapseBlend::Average:
+            for (int tile_y = 0; tile_y < tiles_y_; ++tile_y)
+            {
+                for (int tile_x = 0; tile_x < tiles_x_; ++tile_x) FoldTile(tile_x, tile_y, kTicks);
+            }
+            FrameKernels::ResolveAccumulator(output->data(), pitch, sum_.data(), pitch * 2, static_cast<size_t>(pitch), height_);
+            std::fill(sum_.begin(), sum_.end(), 0);
+            break;
+        case TimeLapseBlend::Max:
+            std::copy(peak_.data(), peak_.data() + bytes, output->data());
+            std::copy(screen_.data(), screen_.data() + bytes, peak_.data());
+            break;
+        default:
+            std::copy(screen_.data(), screen_.data() + bytes, output->data());
+            break;
+        }
+        std::fill(since_.begin(), since_.end(), 0);
+        repeat_.reset();
+        was_repeat_ = false;
+    }
+
+    FrameDescriptor descriptor = FrameDescriptor::Packed(output->data(), FrameFormat::Bgra, width_, height_, interval_start_ + interval_);
+    descriptor.owner = std::move(output);
+    frames_in_interval_ = 0;
+    resolve_ns_.fetch_add(ElapsedNs(resolve_start), std::memory_order_relaxed);
+
+    frames_out_.fetch_add(1, std::memory_order_relaxed);
+    return sink_->ProcessFrame(descriptor, output_dirty);
+}
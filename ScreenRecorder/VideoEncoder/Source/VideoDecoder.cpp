@@ -0,0 +1,120 @@
+#include <mferror.h>
+
+#include "FrameKernels.h"
+#include "VideoDecoder.h"
+
+
+using namespace Microsoft::WRL;
+
+VideoDecoder::VideoDecoder()
+{
+    MFStartup(MF_VERSION);
+}
+
+VideoDecoder::~VideoDecoder()
+{
+    source_reader_ = nullptr;
+    MFShutdown();
+}
+
+bool VideoDecoder::Open(const std::wstring& file_path)
+{
+    ComPtr<IMFAttributes> attributes;
+    HRESULT hr = MFCreateAttributes(&attributes, 1);
+    if (FAILED(hr)) return false;
+
+    // Lets the reader insert the YUV -> RGB32 converter after the decoder
+    attributes->SetUINT32(MF_SOURCE_READER_ENABLE_VIDEO_PROCESSING, TRUE);
+
+    hr = MFCreateSourceReaderFromURL(file_path.c_str(), attributes.Get(), &source_reader_);
+    if (FAILED(hr)) return false;
+
+    source_reader_->SetStreamSelection(static_cast<DWORD>(MF_SOURCE_READER_ALL_STREAMS), FALSE);
+    source_reader_->SetStreamSelection(static_cast<DWORD>(MF_SOURCE_READER_FIRST_VIDEO_STREAM), TRUE);
+
+    ComPtr<IMFMediaType> output_type;
+    hr = MFCreateMediaType(&output_type);
+    if (FAILED(hr)) return false;
+
+    output_type->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
+    output_type->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_RGB32);
+
+    hr = source_reader_->SetCurrentMediaType(static_cast<DWORD>(MF_SOURCE_READER_FIRST_VIDEO_STREAM), nullptr, output_type.Get());
+    if (FAILED(hr)) return false;
+
+    return SUCCEEDED(UpdateFrameSize());
+}
+
+HRESULT VideoDecoder::UpdateFrameSize()
+{
+    ComPtr<IMFMediaType> current_type;
+    HRESULT hr = source_reader_->GetCurrentMediaType(static_cast<DWORD>(MF_SOURCE_READER_FIRST_VIDEO_STREAM), &current_type);
+    if (FAILED(hr)) return hr;
+
+    UINT32 width = 0;
+    UINT32 height = 0;
+    hr = MFGetAttributeSize(current_type.Get(), MF_MT_FRAME_SIZE, &width, &height);
+    if (FAILED(hr)) return hr;
+
+    // Coded size is padded to macroblocks (1080 -> 1088); the aperture is the picture
+    MFVideoArea aperture = {};
+    if (SUCCEEDED(current_type->GetBlob(MF_MT_MINIMUM_DISPLAY_APERTURE, reinterpret_cast<UINT8*>(&aperture), sizeof(aperture), nullptr)))
+    {
+        width_ = static_cast<int>(aperture.Area.cx);
+        height_ = static_cast<int>(aperture.Area.cy);
+    }
+    else
+    {
+        width_ = static_cast<int>(width);
+        height_ = static_cast<int>(height);
+    }
+
+    coded_height_ = static_cast<int>(height);
+    stride_ = static_cast<LONG>(MFGetAttributeUINT32(current_type.Get(), MF_MT_DEFAULT_STRIDE, width * 4));
+    return S_OK;
+}
+
+bool VideoDecoder::ReadFrame(std::vector<uint8_t>& image_buffer, int& width, int& height)
+{
+    if (!source_reader_) return false;
+
+    ComPtr<IMFSample> sample;
+    while (!sample)
+    {
+        DWORD flags = 0;
+        HRESULT hr = source_reader_->ReadSample(static_cast<DWORD>(MF_SOURCE_READER_FIRST_VIDEO_STREAM), 0, nullptr, &flags, nullptr, &sample);
+        if (FAILED(hr) || (flags & MF_SOURCE_READERF_ENDOFSTREAM)) return false;
+
+        if ((flags & MF_SOURCE_READERF_CURRENTMEDIATYPECHANGED) && FAILED(UpdateFrameSize())) return false;
+    }
+
+    ComPtr<IMFMediaBuffer> buffer;
+    if (FAILED(sample->ConvertToContiguousBuffer(&buffer))) return false;
+
+    width = width_;
+    height = height_;
+    image_buffer.resize(static_cast<size_t>(width_) * height_ * 4);
+
+    ComPtr<IMF2DBuffer> buffer_2d;
+    BYTE* scanline0 = nullptr;
+    LONG pitch = 0;
+    bool locked_2d = SUCCEEDED(buffer.As(&buffer_2d)) && SUCCEEDED(buffer_2d->Lock2D(&scanline0, &pitch));
+
+    BYTE* data = nullptr;
+    if (!locked_2d)
+    {
+        DWORD length = 0;
+        if (FAILED(buffer->Lock(&data, nullptr, &length))) return false;
+
+        // Negative default stride means bottom-up rows
+        pitch = stride_;
+        scanline0 = stride_ < 0 ? data + static_cast<ptrdiff_t>(-stride_) * (coded_height_ - 1) : data;
+    }
+
+    FrameKernels::CopyImage(image_buffer.data(), static_cast<ptrdiff_t>(width_) * 4, scanline0, pitch, static_cast<size_t>(width_) * 4, height_);
+
+    if (locked_2d) buffer_2d->Unlock2D();
+    else buffer->Unlock();
+
+    return true;
+}
@@ -3,12 +3,35 @@
 #include <Codecapi.h>
 #include <chrono>
 
+#include "FrameMediaBuffer.h"
+#include "FrameTracer.h"
+#include "HdrKernels.h"
+#include "HotPathCounters.h"
+#include "KeyframeIndex.h"
 #include "VideoEncoder.h"
 #include "Utils.h"
 
 
 using namespace Microsoft::WRL;
 
+namespace
+{
+    // HDR10 signalling. Chroma is the 2x2 average, so it is sited at the block centre. Static
+    // metadata describes a typical 1000-nit HDR desktop display.
+    void SetHdr10Attributes(IMFMediaType* media_type)
+    {
+        media_type->SetUINT32(MF_MT_VIDEO_PRIMARIES, MFVideoPrimaries_BT2020);
+        media_type->SetUINT32(MF_MT_TRANSFER_FUNCTION, MFVideoTransFunc_2084);
+        media_type->SetUINT32(MF_MT_YUV_MATRIX, MFVideoTransferMatrix_BT2020_10);
+        media_type->SetUINT32(MF_MT_VIDEO_NOMINAL_RANGE, MFNominalRange_16_235);
+        media_type->SetUINT32(MF_MT_VIDEO_CHROMA_SITING, MFVideoChromaSubsampling_MPEG1);
+        media_type->SetUINT32(MF_MT_MAX_MASTERING_LUMINANCE, 1000);
+        media_type->SetUINT32(MF_MT_MIN_MASTERING_LUMINANCE, 50);          // 0.0001 nit units
+        media_type->SetUINT32(MF_MT_MAX_LUMINANCE_LEVEL, 1000);
+        media_type->SetUINT32(MF_MT_MAX_FRAME_AVERAGE_LUMINANCE_LEVEL, 400);
+    }
+}
+
 VideoEncoder::VideoEncoder(int width, int height, int fps, int bitrate,
     const std::wstring& output_path, const std::wstring& output_filename)
     :   width_(width),
@@ -50,13 +73,37 @@ bool VideoEncoder::Initialize(VideoCodec codec_type)
             break;
     }
 
+    // 10-bit needs a Main10-capable codec
+    if (hdr10_ && codec_type != VideoCodec::H265 && codec_type != VideoCodec::AV1)
+    {
+        return false;
+    }
 
+    // P010 needs even dimensions; an odd last column or row is left out, as NV12 streaming does
+    if (hdr10_)
+    {
+        width_ &= ~1;
+        height_ &= ~1;
+        if (width_ == 0 || height_ == 0) return false;
+    }
+
+    p010_samples_.clear();
+    p010_width_ = 0;
+    p010_height_ = 0;
     return SUCCEEDED(ConfigureSinkWriter());
 }
 
 bool VideoEncoder::ProcessFrame(const std::vector<uint8_t>& image_buffer, int width, int height)
 {
-	return SUCCEEDED(EncodeFrame(image_buffer, width, height));
+	const FrameFormat format = hdr10_ ? FrameFormat::ScRgb : FrameFormat::Bgra;
+	if (image_buffer.size() < static_cast<size_t>(width) * height * (hdr10_ ? 8 : 4)) return false;
+
+	return SUCCEEDED(EncodeFrame(FrameDescriptor::Packed(image_buffer.data(), format, width, height), DirtyRegion::Full(width, height)));
+}
+
+bool VideoEncoder::ProcessFrame(const FrameDescriptor& frame, const DirtyRegion& dirty)
+{
+	return SUCCEEDED(EncodeFrame(frame, dirty));
 }
 
 HRESULT VideoEncoder::ConfigureSinkWriter() 
@@ -76,7 +123,14 @@ HRESULT VideoEncoder::ConfigureSinkWriter()
 	if (FAILED(ConfigureOutputType())) return E_FAIL;
 	if (FAILED(ConfigureInputType())) return E_FAIL;
 
-    return sink_writer_->BeginWriting();
+    hr = sink_writer_->BeginWriting();
+    if (FAILED(hr)) return hr;
+
+    // Needed for forced keyframes; encoders without ICodecAPI simply ignore requests
+    codec_api_ = nullptr;
+    sink_writer_->GetServiceForStream(stream_index_, GUID_NULL, IID_PPV_ARGS(&codec_api_));
+
+    return S_OK;
 }
 
 HRESULT VideoEncoder::ReConfigureSinkWriter(int width, int height)
@@ -99,10 +153,10 @@ HRESULT VideoEncoder::ConfigureInputType()
     HRESULT hr = MFCreateMediaType(&input_type);
     if (FAILED(hr)) return hr;
 
-    int default_stride = width_ * 4;
+    int default_stride = hdr10_ ? width_ * 2 : width_ * 4;
 
     input_type->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
-    input_type->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_ARGB32);
+    input_type->SetGUID(MF_MT_SUBTYPE, hdr10_ ? MFVideoFormat_P010 : MFVideoFormat_ARGB32);
 
     MFSetAttributeSize(input_type.Get(), MF_MT_FRAME_SIZE, width_, height_);
     MFSetAttributeRatio(input_type.Get(), MF_MT_FRAME_RATE, fps_, 1);
@@ -111,7 +165,18 @@ HRESULT VideoEncoder::ConfigureInputType()
     input_type->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
     input_type->SetUINT32(MF_MT_DEFAULT_STRIDE, default_stride);
 
-    hr = sink_writer_->SetInputMediaType(stream_index_, input_type.Get(), nullptr);
+    if (hdr10_)
+    {
+        SetHdr10Attributes(input_type.Get());
+    }
+
+    ComPtr<IMFAttributes> encoding_parameters;
+    if (keyframe_interval_ > 0 && SUCCEEDED(MFCreateAttributes(&encoding_parameters, 1)))
+    {
+        encoding_parameters->SetUINT32(CODECAPI_AVEncMPVGOPSize, keyframe_interval_);
+    }
+
+    hr = sink_writer_->SetInputMediaType(stream_index_, input_type.Get(), encoding_parameters.Get());
     
     return hr;
 }
@@ -132,12 +197,27 @@ HRESULT VideoEncoder::ConfigureOutputType()
     output_type->SetUINT32(MF_MT_AVG_BITRATE, bitrate_);
     output_type->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
 
+    if (hdr10_)
+    {
+        // AV1 Main already covers 10-bit; the P010 input selects it
+        if (codec_guid_ == MFVideoFormat_H265)
+        {
+            output_type->SetUINT32(MF_MT_MPEG2_PROFILE, eAVEncH265VProfile_Main_420_10);
+        }
+        SetHdr10Attributes(output_type.Get());
+    }
+
     hr = sink_writer_->AddStream(output_type.Get(), &stream_index_);
     return hr;
 }
 
-HRESULT VideoEncoder::EncodeFrame(const std::vector<uint8_t>& image_buffer, int width, int height) 
+HRESULT VideoEncoder::EncodeFrame(const FrameDescriptor& frame, const DirtyRegion& dirty) 
 {
+    if (!frame.IsValid() || frame.format != (hdr10_ ? FrameFormat::ScRgb : FrameFormat::Bgra)) return E_INVALIDARG;
+
+    const int width = hdr10_ ? frame.width & ~1 : frame.width;
+    const int height = hdr10_ ? frame.height & ~1 : frame.height;
+    if (width == 0 || height == 0) return E_INVALIDARG;
 	if (width != width_ || height != height_)
 	{
         width_ = width;
@@ -149,33 +229,69 @@ HRESULT VideoEncoder::EncodeFrame(const std::vector<uint8_t>& image_buffer, int
     ComPtr<IMFSample> sample;
     ComPtr<IMFMediaBuffer> buffer;
 
-    DWORD buffer_size = static_cast<DWORD>(image_buffer.size());
-    HRESULT hr = MFCreateMemoryBuffer(buffer_size, &buffer);
-    if (FAILED(hr)) return hr;
-
-    BYTE* dest = nullptr;
-    DWORD max_len = 0;
-    DWORD current_len = 0;
-
-    hr = buffer->Lock(&dest, &max_len, &current_len);
-    if (FAILED(hr)) return hr;
-
-    const LONG stride = 4 * width;
+    // P010 is 16-bit luma plus half as much interleaved chroma
+    const size_t pixel_count = static_cast<size_t>(width) * height;
+    const DWORD buffer_size = static_cast<DWORD>(hdr10_ ? pixel_count * 3 : pixel_count * 4);
+    HRESULT hr = S_OK;
 
-    hr = MFCopyImage(
-        dest,                      // Destination buffer.
-        stride,                    // Destination stride.
-        image_buffer.data(),       // First row in source image.
-        stride,                    // Source stride.
-        stride,                    // Image width in bytes.
-        height                     // Image height in pixels.
-    );
+    // The sample wraps pooled memory rather than a fresh MF buffer. A queued frame is wrapped as
+    // is; anything else is copied once into a buffer from sample_pool_.
+    RetainedFrame retained;
+    if (hdr10_)
+    {
+        TraceSpan convert_span(TraceStage::Convert);
+        if (width != p010_width_ || height != p010_height_)
+        {
+            p010_samples_.clear();
+            p010_width_ = width;
+            p010_height_ = height;
+        }
+
+        // The sink writer keeps the sample, so the frame is converted into one the encoder is done with
+        const DirtyRegion region = dirty.ForFrame(width, height);
+        P010Sample& target = AcquireP010Sample(buffer_size, width, height);
+        target.stale.Add(region);
+        uint8_t* p010 = target.pixels->data();
+        HdrKernels::ConvertScRgbToP010Region(frame.planes[0].data, frame.planes[0].pitch, p010, static_cast<ptrdiff_t>(width) * 2,
+                                             p010 + pixel_count * 2, static_cast<ptrdiff_t>(width) * 2, target.stale);
+        HotPathCounters::CountCopy(TraceStage::Convert, target.stale.GetArea() * 8);
+
+        for (P010Sample& kept : p010_samples_)
+        {
+            if (&kept != &target) kept.stale.Add(region);
+        }
+        target.stale = DirtyRegion(width, height);
+        retained.data = p010;
+        retained.owner = target.pixels;
+    }
+    else
+    {
+        retained = RetainFrame(frame, sample_pool_);
+        if (retained.fill)
+        {
+            const LONG stride = 4 * width;
+
+            // The one copy into the sample packs rows from the source pitch on the way
+            TraceSpan copy_span(TraceStage::Copy);
+            hr = MFCopyImage(
+                retained.fill,             // Destination buffer.
+                stride,                    // Destination stride.
+                frame.planes[0].data,      // First row in source image.
+                static_cast<LONG>(frame.planes[0].pitch), // Source stride.
+                stride,                    // Image width in bytes.
+                height                     // Image height in pixels.
+            );
+
+            if (FAILED(hr)) return hr;
+            HotPathCounters::CountCopy(TraceStage::Copy, buffer_size);
+        }
+    }
 
+    // Media Foundation releases the buffer once the encoder is done with the sample, and with it
+    // the pooled memory
+    hr = FrameMediaBuffer::Create(std::move(retained.owner), retained.data, buffer_size, &buffer);
     if (FAILED(hr)) return hr;
 
-    buffer->SetCurrentLength(buffer_size);
-    buffer->Unlock();
-
     hr = MFCreateSample(&sample);
     if (FAILED(hr)) return hr;
 
@@ -188,9 +304,22 @@ HRESULT VideoEncoder::EncodeFrame(const std::vector<uint8_t>& image_buffer, int
     sample->SetSampleTime(timestamp);
     sample->SetSampleDuration(duration);
 
+    if (keyframe_requested_.exchange(false, std::memory_order_relaxed) && codec_api_)
+    {
+        VARIANT value;
+        VariantInit(&value);
+        value.vt = VT_UI4;
+        value.ulVal = 1;
+        if (SUCCEEDED(codec_api_->SetValue(&CODECAPI_AVEncVideoForceKeyFrame, &value)))
+        {
+            forced_keyframes_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
     hr = E_FAIL;
     if (sink_writer_)
     {
+        TraceSpan submit_span(TraceStage::EncodeSubmit);
         hr = sink_writer_->WriteSample(stream_index_, sample.Get());
     }
 
@@ -202,13 +331,48 @@ HRESULT VideoEncoder::EncodeFrame(const std::vector<uint8_t>& image_buffer, int
     return hr;
 }
 
+VideoEncoder::P010Sample& VideoEncoder::AcquireP010Sample(size_t bytes, int width, int height)
+{
+    for (P010Sample& kept : p010_samples_)
+    {
+        if (kept.pixels.use_count() == 1)
+        {
+            // Media Foundation's last access happened before it dropped its reference
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return kept;
+        }
+    }
+
+    // Everything kept is still queued in the encoder; past the limit the oldest is let go
+    if (p010_samples_.size() >= kMaxP010Samples) p010_samples_.erase(p010_samples_.begin());
+    p010_samples_.push_back({ sample_pool_.Acquire(bytes), DirtyRegion::Full(width, height) });
+    return p010_samples_.back();
+}
+
 HRESULT VideoEncoder::Finalize() 
 {
+    codec_api_ = nullptr;
+
+    HRESULT hr = S_OK;
     if (sink_writer_) 
     {
-        sink_writer_->Finalize();
+        hr = sink_writer_->Finalize();
         sink_writer_ = nullptr;
+
+        // Sample offsets are only final once the sink writer has written moov. Without it there
+        // is nothing to index, and an index left by an earlier file of that name would be wrong.
+        std::filesystem::path path = output_path_ + output_filename_;
+        if (SUCCEEDED(hr))
+        {
+            KeyframeIndex index;
+            if (index.Build(path)) index.Save(KeyframeIndex::SidecarPath(path));
+        }
+        else
+        {
+            std::error_code error;
+            std::filesystem::remove(KeyframeIndex::SidecarPath(path), error);
+        }
     }
 
-    return S_OK;
+    return hr;
 }